@@ -0,0 +1,89 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstddef>
+
+#if defined(__GLIBC__)
+#include <pthread.h>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+}
+
+namespace {
+
+// Plain atomics only: the wrappers run before static constructors and on
+// every thread, so they must not depend on initialization or TLS
+std::atomic<bool> s_counting{false};
+std::atomic<pthread_t> s_thread{pthread_t()};
+std::atomic<qint64> s_count{0};
+
+inline void countAllocation()
+{
+    if (s_counting.load(std::memory_order_relaxed)
+        && pthread_equal(pthread_self(), s_thread.load(std::memory_order_relaxed))) {
+        s_count.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+extern "C" {
+
+void* malloc(size_t size)
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size)
+{
+    countAllocation();
+    return __libc_realloc(pointer, size);
+}
+
+} // extern "C"
+
+bool AllocationCounter::isSupported()
+{
+    return true;
+}
+
+void AllocationCounter::start()
+{
+    s_thread.store(pthread_self(), std::memory_order_relaxed);
+    s_count.store(0, std::memory_order_relaxed);
+    s_counting.store(true, std::memory_order_release);
+}
+
+qint64 AllocationCounter::stop()
+{
+    s_counting.store(false, std::memory_order_release);
+    return s_count.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool AllocationCounter::isSupported()
+{
+    return false;
+}
+
+void AllocationCounter::start()
+{
+}
+
+qint64 AllocationCounter::stop()
+{
+    return 0;
+}
+
+#endif
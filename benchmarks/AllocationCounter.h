@@ -0,0 +1,34 @@
+#pragma once
+
+#include <QtGlobal>
+
+/**
+ * @brief Counts heap allocations made by one thread
+ *
+ * On glibc the bench binary replaces malloc, calloc and realloc with
+ * wrappers that forward to the C library and count calls from the thread
+ * that called start(). operator new goes through malloc and is counted as
+ * well. Other platforms report isSupported() == false.
+ *
+ * Allocations made by the GL driver on the counting thread are included.
+ */
+class AllocationCounter
+{
+public:
+    /**
+     * @brief Check if allocations can be counted on this platform
+     * @return true if supported
+     */
+    static bool isSupported();
+
+    /**
+     * @brief Start counting allocations of the calling thread
+     */
+    static void start();
+
+    /**
+     * @brief Stop counting
+     * @return Allocations since start()
+     */
+    static qint64 stop();
+};
@@ -0,0 +1,305 @@
+#include "Benchmark.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+
+namespace {
+
+struct Registration
+{
+    QString name;
+    BenchmarkFunction function;
+    qint64 argument;
+    bool hasArgument;
+};
+
+QVector<Registration>& registry()
+{
+    static QVector<Registration> benchmarks;
+    return benchmarks;
+}
+
+// Iteration growth stops once a run takes this share of the minimum time
+const double kIterationMargin = 1.4;
+const qint64 kMaxIterations = 1000000000;
+
+} // namespace
+
+BenchmarkState::BenchmarkState(qint64 maxIterations, qint64 argument)
+    : m_maxIterations(maxIterations)
+    , m_argument(argument)
+    , m_completed(0)
+    , m_started(false)
+    , m_running(false)
+    , m_timing(false)
+    , m_cpuStart(0)
+    , m_realTime(0)
+    , m_cpuTime(0.0)
+    , m_items(0)
+    , m_bytes(0)
+{
+}
+
+bool BenchmarkState::keepRunningBatch(qint64 count)
+{
+    if (!m_started) {
+        m_started = true;
+        m_running = true;
+        resumeTiming();
+    }
+
+    if (m_running && m_error.isEmpty() && m_skipMessage.isEmpty() && m_completed < m_maxIterations) {
+        m_completed += count;
+        return true;
+    }
+
+    if (m_running) {
+        pauseTiming();
+        m_running = false;
+    }
+    return false;
+}
+
+void BenchmarkState::pauseTiming()
+{
+    if (!m_timing) {
+        return;
+    }
+
+    m_realTime += m_timer.nsecsElapsed();
+    m_cpuTime += double(std::clock() - m_cpuStart) / CLOCKS_PER_SEC;
+    m_timing = false;
+}
+
+void BenchmarkState::resumeTiming()
+{
+    if (m_timing) {
+        return;
+    }
+
+    m_timer.start();
+    m_cpuStart = std::clock();
+    m_timing = true;
+}
+
+void BenchmarkState::skipWithError(const QString& message)
+{
+    m_error = message;
+    if (m_running) {
+        pauseTiming();
+        m_running = false;
+    }
+}
+
+void BenchmarkState::skip(const QString& message)
+{
+    m_skipMessage = message;
+    if (m_running) {
+        pauseTiming();
+        m_running = false;
+    }
+}
+
+bool BenchmarkRunner::add(const char* name, BenchmarkFunction function, const QVector<qint64>& arguments)
+{
+    QString baseName = QString::fromLatin1(name);
+    if (arguments.isEmpty()) {
+        registry().append(Registration{baseName, function, 0, false});
+        return true;
+    }
+
+    for (qint64 argument : arguments) {
+        registry().append(Registration{baseName + '/' + QString::number(argument), function, argument, true});
+    }
+    return true;
+}
+
+int BenchmarkRunner::run(const QStringList& arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("T-GUI benchmark suite");
+    parser.addHelpOption();
+    const QCommandLineOption filterOption("benchmark_filter", "Run benchmarks matching <regex>.", "regex", ".");
+    const QCommandLineOption minTimeOption("benchmark_min_time", "Minimum time per benchmark in seconds.",
+                                           "seconds", "0.5");
+    const QCommandLineOption formatOption("benchmark_format", "Console format: console or json.",
+                                          "format", "console");
+    const QCommandLineOption outOption("benchmark_out", "Also write JSON results to <file>.", "file");
+    const QCommandLineOption listOption("benchmark_list_tests", "List benchmark names and exit.");
+    parser.addOption(filterOption);
+    parser.addOption(minTimeOption);
+    parser.addOption(formatOption);
+    parser.addOption(outOption);
+    parser.addOption(listOption);
+    parser.process(arguments);
+
+    const QRegularExpression filter(parser.value(filterOption));
+    if (!filter.isValid()) {
+        qWarning() << "Invalid benchmark filter:" << filter.errorString();
+        return 1;
+    }
+    const double minTime = qMax(0.001, parser.value(minTimeOption).toDouble());
+    const bool jsonToConsole = parser.value(formatOption) == "json";
+
+    QTextStream console(stdout);
+    QVector<const Registration*> selected;
+    for (const Registration& benchmark : qAsConst(registry())) {
+        if (filter.match(benchmark.name).hasMatch()) {
+            selected.append(&benchmark);
+        }
+    }
+
+    if (parser.isSet(listOption)) {
+        for (const Registration* benchmark : qAsConst(selected)) {
+            console << benchmark->name << '\n';
+        }
+        return 0;
+    }
+
+    int nameWidth = 10;
+    for (const Registration* benchmark : qAsConst(selected)) {
+        nameWidth = qMax(nameWidth, benchmark->name.size());
+    }
+    if (!jsonToConsole) {
+        console << QString("%1 %2 %3 %4\n").arg("Benchmark", -nameWidth).arg("Time", 15).arg("CPU", 15)
+                   .arg("Iterations", 12);
+        console << QString(nameWidth + 45, '-') << '\n';
+        console.flush();
+    }
+
+    QJsonArray results;
+    int failures = 0;
+    int skips = 0;
+    int familyIndex = -1;
+    QString lastFamily;
+
+    for (const Registration* benchmark : qAsConst(selected)) {
+        const QString family = benchmark->name.section('/', 0, 0);
+        if (family != lastFamily) {
+            ++familyIndex;
+            lastFamily = family;
+        }
+
+        // Grow the iteration count until one run lasts long enough
+        qint64 iterations = 1;
+        BenchmarkState state(iterations, benchmark->argument);
+        for (;;) {
+            state = BenchmarkState(iterations, benchmark->argument);
+            benchmark->function(state);
+
+            const double seconds = state.m_realTime / 1.0e9;
+            if (!state.m_error.isEmpty() || !state.m_skipMessage.isEmpty() || seconds >= minTime
+                || iterations >= kMaxIterations) {
+                break;
+            }
+
+            double multiplier = seconds > 0.0 ? minTime * kIterationMargin / seconds : 10.0;
+            multiplier = qBound(2.0, multiplier, 10.0);
+            iterations = qMin(kMaxIterations, qint64(std::max<double>(iterations * multiplier, iterations + 1)));
+        }
+
+        const qint64 done = qMax<qint64>(state.m_completed, 1);
+        const double realTime = double(state.m_realTime) / done;
+        const double cpuTime = state.m_cpuTime * 1.0e9 / done;
+
+        QJsonObject result;
+        result.insert("name", benchmark->name);
+        result.insert("family_index", familyIndex);
+        result.insert("run_name", benchmark->name);
+        result.insert("run_type", "iteration");
+        result.insert("repetitions", 1);
+        result.insert("threads", 1);
+        result.insert("iterations", double(state.m_completed));
+        result.insert("real_time", realTime);
+        result.insert("cpu_time", cpuTime);
+        result.insert("time_unit", "ns");
+        if (state.m_items > 0 && state.m_realTime > 0) {
+            result.insert("items_per_second", state.m_items * 1.0e9 / state.m_realTime);
+        }
+        if (state.m_bytes > 0 && state.m_realTime > 0) {
+            result.insert("bytes_per_second", state.m_bytes * 1.0e9 / state.m_realTime);
+        }
+        if (!state.m_label.isEmpty()) {
+            result.insert("label", state.m_label);
+        }
+        if (!state.m_error.isEmpty()) {
+            result.insert("error_occurred", true);
+            result.insert("error_message", state.m_error);
+            ++failures;
+        } else if (!state.m_skipMessage.isEmpty()) {
+            // Same keys as Google Benchmark's SkipWithMessage
+            result.insert("skipped", true);
+            result.insert("skip_message", state.m_skipMessage);
+            ++skips;
+        }
+        results.append(result);
+
+        if (!jsonToConsole) {
+            if (!state.m_error.isEmpty()) {
+                console << QString("%1 ERROR: %2\n").arg(benchmark->name, -nameWidth).arg(state.m_error);
+            } else if (!state.m_skipMessage.isEmpty()) {
+                console << QString("%1 SKIPPED: %2\n").arg(benchmark->name, -nameWidth).arg(state.m_skipMessage);
+            } else {
+                QString line = QString("%1 %2 ns %3 ns %4").arg(benchmark->name, -nameWidth)
+                    .arg(realTime, 12, 'f', 1).arg(cpuTime, 12, 'f', 1).arg(state.m_completed, 12);
+                if (result.contains("items_per_second")) {
+                    line += QString(" items/s=%1").arg(result.value("items_per_second").toDouble(), 0, 'g', 4);
+                }
+                if (!state.m_label.isEmpty()) {
+                    line += ' ' + state.m_label;
+                }
+                console << line << '\n';
+            }
+            console.flush();
+        }
+    }
+
+    QJsonObject context;
+    context.insert("date", QDateTime::currentDateTime().toString(Qt::ISODate));
+    context.insert("host_name", QSysInfo::machineHostName());
+    context.insert("executable", QCoreApplication::applicationFilePath());
+    context.insert("num_cpus", QThread::idealThreadCount());
+    context.insert("qt_version", QString::fromLatin1(qVersion()));
+    context.insert("t_gui_version", QCoreApplication::applicationVersion());
+#ifdef NDEBUG
+    context.insert("library_build_type", "release");
+#else
+    context.insert("library_build_type", "debug");
+#endif
+
+    QJsonObject report;
+    report.insert("context", context);
+    report.insert("benchmarks", results);
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if (jsonToConsole) {
+        console << QString::fromUtf8(json);
+        console.flush();
+    }
+
+    if (parser.isSet(outOption)) {
+        QFile file(parser.value(outOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+            qWarning() << "Cannot write benchmark results to" << file.fileName();
+            return 1;
+        }
+    }
+
+    if (!jsonToConsole && (failures > 0 || skips > 0)) {
+        console << QString("%1 failed, %2 skipped\n").arg(failures).arg(skips);
+        console.flush();
+    }
+
+    return failures > 0 ? 1 : 0;
+}
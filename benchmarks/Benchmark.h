@@ -0,0 +1,180 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <ctime>
+#include <functional>
+
+/**
+ * @brief Timing state handed to a running benchmark
+ *
+ * A benchmark does its setup, then repeats the measured operation while
+ * keepRunning() returns true. Timing starts with the first keepRunning()
+ * call and stops when it returns false, so setup and teardown around the
+ * loop are not measured. Modelled on Google Benchmark's State, whose
+ * JSON output the harness reproduces.
+ */
+class BenchmarkState
+{
+public:
+    /**
+     * @brief Constructor
+     * @param maxIterations Iterations to run
+     * @param argument Benchmark argument, or 0
+     */
+    BenchmarkState(qint64 maxIterations, qint64 argument);
+
+    /**
+     * @brief Advance by one iteration
+     * @return true while iterations remain
+     */
+    bool keepRunning() { return keepRunningBatch(1); }
+
+    /**
+     * @brief Advance by several iterations at once
+     *
+     * For benchmarks whose measured operation does many units of work,
+     * e.g. one batch per thread. The last batch may overshoot the
+     * requested count; iterations() reports what was actually done.
+     *
+     * @param count Iterations done by the next pass
+     * @return true while iterations remain
+     */
+    bool keepRunningBatch(qint64 count);
+
+    /**
+     * @brief Stop timing, e.g. around per-iteration setup
+     */
+    void pauseTiming();
+
+    /**
+     * @brief Resume timing after pauseTiming()
+     */
+    void resumeTiming();
+
+    /**
+     * @brief Mark the benchmark as failed
+     *
+     * keepRunning() returns false afterwards.
+     *
+     * @param message Error message
+     */
+    void skipWithError(const QString& message);
+
+    /**
+     * @brief Skip the benchmark without failing, e.g. when the environment lacks a feature
+     *
+     * keepRunning() returns false afterwards. Skipped benchmarks do not
+     * affect the exit code.
+     *
+     * @param message Reason for skipping
+     */
+    void skip(const QString& message);
+
+    /**
+     * @brief Get the benchmark argument
+     * @return Argument given at registration
+     */
+    qint64 range() const { return m_argument; }
+
+    /**
+     * @brief Get iterations done so far
+     * @return Iteration count
+     */
+    qint64 iterations() const { return m_completed; }
+
+    /**
+     * @brief Set number of items processed, for items_per_second
+     * @param items Item count over all iterations
+     */
+    void setItemsProcessed(qint64 items) { m_items = items; }
+
+    /**
+     * @brief Set number of bytes processed, for bytes_per_second
+     * @param bytes Byte count over all iterations
+     */
+    void setBytesProcessed(qint64 bytes) { m_bytes = bytes; }
+
+    /**
+     * @brief Attach a note to the result
+     * @param label Label text
+     */
+    void setLabel(const QString& label) { m_label = label; }
+
+private:
+    friend class BenchmarkRunner;
+
+    qint64 m_maxIterations;
+    qint64 m_argument;
+    qint64 m_completed;
+    bool m_started;
+    bool m_running;
+    bool m_timing;
+
+    QElapsedTimer m_timer;
+    std::clock_t m_cpuStart;
+    qint64 m_realTime;
+    double m_cpuTime;
+
+    qint64 m_items;
+    qint64 m_bytes;
+    QString m_label;
+    QString m_error;
+    QString m_skipMessage;
+};
+
+using BenchmarkFunction = std::function<void(BenchmarkState&)>;
+
+/**
+ * @brief Registers, runs and reports benchmarks
+ */
+class BenchmarkRunner
+{
+public:
+    /**
+     * @brief Register a benchmark
+     * @param name Benchmark name
+     * @param function Benchmark function
+     * @param arguments Arguments to run it with; one run per argument
+     * @return Always true, for static registration
+     */
+    static bool add(const char* name, BenchmarkFunction function, const QVector<qint64>& arguments = {});
+
+    /**
+     * @brief Run registered benchmarks from command line options
+     *
+     * Understands the Google Benchmark options --benchmark_filter,
+     * --benchmark_min_time, --benchmark_format, --benchmark_out and
+     * --benchmark_list_tests.
+     *
+     * @param arguments Command line arguments
+     * @return Process exit code; 1 if a benchmark failed, skips do not count
+     */
+    static int run(const QStringList& arguments);
+};
+
+#define TGUI_BENCHMARK_CONCAT_IMPL(a, b) a##b
+#define TGUI_BENCHMARK_CONCAT(a, b) TGUI_BENCHMARK_CONCAT_IMPL(a, b)
+
+/**
+ * @brief Register a benchmark function, optionally with arguments
+ */
+#define TGUI_BENCHMARK(function, ...) \
+    static const bool TGUI_BENCHMARK_CONCAT(benchmarkRegistered_, __LINE__) = \
+        BenchmarkRunner::add(#function, function, QVector<qint64>{__VA_ARGS__})
+
+/**
+ * @brief Keep the compiler from optimizing a value away
+ */
+template<typename T>
+inline void doNotOptimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
@@ -0,0 +1,464 @@
+#include "Benchmark.h"
+#include "core/ChunkedExecutor.h"
+#include "core/CommandHistory.h"
+#include "core/EventSystem.h"
+#include "core/FrameCache.h"
+#include "core/ImageLayer.h"
+#include "core/LabelsLayer.h"
+#include "core/LayerManager.h"
+#include "core/SimpleLayer.h"
+#include "plugins/PluginManager.h"
+#include "utils/Config.h"
+#include "utils/ImageKernels.h"
+#include "utils/Logger.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+namespace {
+
+QList<Layer*> createLayers(int count)
+{
+    QList<Layer*> layers;
+    layers.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        layers.append(new SimpleLayer(QString("Layer %1").arg(i)));
+    }
+    return layers;
+}
+
+void destroyLayers(LayerManager& manager)
+{
+    const QList<Layer*> layers = manager.layers();
+    manager.clear();
+    qDeleteAll(layers);
+}
+
+} // namespace
+
+// Insert N layers with a single model reset
+static void BM_LayerManagerAddLayers(BenchmarkState& state)
+{
+    const int count = int(state.range());
+    LayerManager manager;
+
+    while (state.keepRunning()) {
+        state.pauseTiming();
+        const QList<Layer*> layers = createLayers(count);
+        state.resumeTiming();
+
+        manager.addLayers(layers);
+
+        state.pauseTiming();
+        destroyLayers(manager);
+        state.resumeTiming();
+    }
+    state.setItemsProcessed(state.iterations() * count);
+}
+TGUI_BENCHMARK(BM_LayerManagerAddLayers, 10000);
+
+// Insert N layers one at a time, each at the top of the list
+static void BM_LayerManagerAddLayer(BenchmarkState& state)
+{
+    const int count = int(state.range());
+    LayerManager manager;
+
+    while (state.keepRunning()) {
+        state.pauseTiming();
+        const QList<Layer*> layers = createLayers(count);
+        state.resumeTiming();
+
+        for (Layer* layer : layers) {
+            manager.addLayer(layer, 0);
+        }
+
+        state.pauseTiming();
+        destroyLayers(manager);
+        state.resumeTiming();
+    }
+    state.setItemsProcessed(state.iterations() * count);
+}
+TGUI_BENCHMARK(BM_LayerManagerAddLayer, 10000);
+
+// Remove every other layer of N, the worst case for contiguous-run removal
+static void BM_LayerManagerRemoveLayers(BenchmarkState& state)
+{
+    const int count = int(state.range());
+    LayerManager manager;
+
+    while (state.keepRunning()) {
+        state.pauseTiming();
+        const QList<Layer*> layers = createLayers(count);
+        manager.addLayers(layers);
+        QList<Layer*> removed;
+        for (int i = 0; i < count; i += 2) {
+            removed.append(layers[i]);
+        }
+        state.resumeTiming();
+
+        manager.removeLayers(removed);
+
+        state.pauseTiming();
+        destroyLayers(manager);
+        qDeleteAll(removed);
+        state.resumeTiming();
+    }
+    state.setItemsProcessed(state.iterations() * (count / 2));
+}
+TGUI_BENCHMARK(BM_LayerManagerRemoveLayers, 10000);
+
+// Look layers up by pointer and by name among N
+static void BM_LayerManagerLookup(BenchmarkState& state)
+{
+    const int count = int(state.range());
+    LayerManager manager;
+    const QList<Layer*> layers = createLayers(count);
+    manager.addLayers(layers);
+
+    QStringList names;
+    for (Layer* layer : layers) {
+        names.append(layer->name());
+    }
+
+    int i = 0;
+    while (state.keepRunning()) {
+        doNotOptimize(manager.indexOf(layers[i]));
+        doNotOptimize(manager.layer(names[i]));
+        i = (i + 7919) % count;
+    }
+    state.setItemsProcessed(state.iterations() * 2);
+    destroyLayers(manager);
+}
+TGUI_BENCHMARK(BM_LayerManagerLookup, 10000);
+
+// Synchronous publish to N subscribers
+static void BM_EventSystemPublish(BenchmarkState& state)
+{
+    EventSystem eventSystem;
+    qint64 received = 0;
+    for (qint64 i = 0; i < state.range(); ++i) {
+        eventSystem.subscribe(CustomEventType::ViewChanged, [&received](const QVariant&) { ++received; });
+    }
+
+    const QVariant data(42);
+    while (state.keepRunning()) {
+        eventSystem.publish(CustomEventType::ViewChanged, data);
+    }
+    doNotOptimize(received);
+    state.setItemsProcessed(state.iterations());
+}
+TGUI_BENCHMARK(BM_EventSystemPublish, 1, 16);
+
+// publishAsync and delivery through the Qt event queue, in batches
+static void BM_EventSystemPublishAsync(BenchmarkState& state)
+{
+    const int batch = int(state.range());
+    EventSystem eventSystem;
+    qint64 received = 0;
+    eventSystem.subscribe(CustomEventType::ViewChanged, [&received](const QVariant&) { ++received; });
+
+    const QVariant data(42);
+    while (state.keepRunningBatch(batch)) {
+        for (int i = 0; i < batch; ++i) {
+            eventSystem.publishAsync(CustomEventType::ViewChanged, data);
+        }
+        QCoreApplication::sendPostedEvents(&eventSystem);
+    }
+    if (received != state.iterations()) {
+        state.setLabel(QString("delivered %1 of %2").arg(received).arg(state.iterations()));
+    }
+    state.setItemsProcessed(state.iterations());
+}
+TGUI_BENCHMARK(BM_EventSystemPublishAsync, 1000);
+
+// publishQueued and an explicit drain, in batches
+static void BM_EventSystemPublishQueued(BenchmarkState& state)
+{
+    const int batch = int(state.range());
+    EventSystem eventSystem;
+    qint64 received = 0;
+    eventSystem.subscribe(CustomEventType::ViewChanged, [&received](const QVariant&) { ++received; });
+
+    const QVariant data(42);
+    while (state.keepRunningBatch(batch)) {
+        for (int i = 0; i < batch; ++i) {
+            eventSystem.publishQueued(CustomEventType::ViewChanged, data);
+        }
+        eventSystem.processQueuedEvents();
+    }
+    doNotOptimize(received);
+    state.setItemsProcessed(state.iterations());
+    QCoreApplication::sendPostedEvents(&eventSystem);
+}
+TGUI_BENCHMARK(BM_EventSystemPublishQueued, 1000);
+
+// Logger::log from N threads at once; measures the producer side
+static void BM_LoggerLogContended(BenchmarkState& state)
+{
+    const int threadCount = int(state.range());
+    const int perThread = 10000;
+
+    Logger logger;
+    logger.setConsoleOutput(false);
+    logger.setFileOutput(false);
+    logger.setLogLevel(LogLevel::Info);
+    const QString message("Benchmark message with a typical length for this application");
+    const QString category("Bench");
+
+    while (state.keepRunningBatch(qint64(threadCount) * perThread)) {
+        std::vector<std::unique_ptr<QThread>> threads;
+        for (int t = 0; t < threadCount; ++t) {
+            threads.emplace_back(QThread::create([&logger, &message, &category, perThread]() {
+                for (int i = 0; i < perThread; ++i) {
+                    logger.log(LogLevel::Info, category, message);
+                }
+            }));
+            threads.back()->start();
+        }
+        for (auto& thread : threads) {
+            thread->wait();
+        }
+    }
+    state.setItemsProcessed(state.iterations());
+
+    logger.flush();
+    if (logger.droppedCount() > 0) {
+        state.setLabel(QString("dropped=%1").arg(logger.droppedCount()));
+    }
+}
+TGUI_BENCHMARK(BM_LoggerLogContended, 1, 4, 8);
+
+// Config::value over a populated configuration
+static void BM_ConfigValue(BenchmarkState& state)
+{
+    QTemporaryDir directory;
+    if (!directory.isValid()) {
+        state.skipWithError("Cannot create temporary directory");
+        return;
+    }
+
+    Config config(directory.path());
+    config.load();
+
+    QStringList keys;
+    for (int i = 0; i < 256; ++i) {
+        keys.append(QString("bench/group%1/key%2").arg(i % 16).arg(i));
+        config.setValue(keys.last(), i);
+    }
+    keys << "viewer/tileCacheMemoryMB" << "viewer/zoomStep" << "ui/showGrid";
+
+    int i = 0;
+    while (state.keepRunning()) {
+        doNotOptimize(config.value(keys[i]));
+        i = (i + 1) % keys.size();
+    }
+    state.setItemsProcessed(state.iterations());
+}
+TGUI_BENCHMARK(BM_ConfigValue);
+
+// Config::value with precomputed keys, as used on hot paths
+static void BM_ConfigValueKey(BenchmarkState& state)
+{
+    QTemporaryDir directory;
+    if (!directory.isValid()) {
+        state.skipWithError("Cannot create temporary directory");
+        return;
+    }
+
+    Config config(directory.path());
+    config.load();
+
+    QVector<Config::Key> keys;
+    for (int i = 0; i < 256; ++i) {
+        keys.append(Config::Key(QString("bench/group%1/key%2").arg(i % 16).arg(i)));
+        config.setValue(keys.last().path(), i);
+    }
+
+    int i = 0;
+    while (state.keepRunning()) {
+        doNotOptimize(config.value(keys[i]));
+        i = (i + 1) % keys.size();
+    }
+    state.setItemsProcessed(state.iterations());
+}
+TGUI_BENCHMARK(BM_ConfigValueKey);
+
+// Brush stroke across a 4096 x 4096 labels slice, re-encoded at the end
+static void BM_LabelsLayerStroke(BenchmarkState& state)
+{
+    const int radius = int(state.range());
+    LabelsLayer layer("Labels");
+    layer.resize(4096, 4096, 1);
+
+    quint32 label = 1;
+    while (state.keepRunning()) {
+        layer.beginStroke();
+        for (int x = 256; x < 3840; x += qMax(1, radius / 2)) {
+            layer.paint(QPoint(x, 2048 + (x % 512) - 256), radius, label);
+        }
+        delete layer.endStroke();
+        label = label % 255 + 1;
+    }
+    state.setItemsProcessed(state.iterations());
+    state.setLabel(QString("%1 tiles, %2 KiB").arg(layer.tileCount()).arg(layer.memoryUsage() / 1024));
+}
+TGUI_BENCHMARK(BM_LabelsLayerStroke, 4, 32);
+
+// Min/max and colour table lookup over a 4096 x 4096 uint16 image; the
+// argument selects the kernel implementation (0 = scalar, 1 = SSE4.1, 2 = AVX2, 3 = NEON)
+static void BM_ImageKernelsColorize(BenchmarkState& state)
+{
+    const qint64 count = 4096 * 4096;
+    std::vector<quint16> pixels(size_t(count));
+    for (qint64 i = 0; i < count; ++i) {
+        pixels[size_t(i)] = quint16((i * 2654435761u) >> 16);
+    }
+    std::vector<quint32> colors(size_t(count));
+
+    ImageKernels::setInstructionSet(ImageKernels::InstructionSet(state.range()));
+    while (state.keepRunning()) {
+        double low = 0.0;
+        double high = 0.0;
+        ImageKernels::minMax(pixels.data(), count, &low, &high);
+        const QVector<quint32> table = ImageKernels::colorTable(65536, low, high, 0.8f, ImageKernels::linearColormap());
+        ImageKernels::applyTable(pixels.data(), count, table.constData(), colors.data());
+    }
+    state.setItemsProcessed(state.iterations() * count);
+    state.setLabel(ImageKernels::instructionSetName(ImageKernels::instructionSet()));
+    ImageKernels::setInstructionSet(ImageKernels::supportedInstructionSet());
+}
+TGUI_BENCHMARK(BM_ImageKernelsColorize, 0, 1, 2, 3);
+
+// 3x3 box filter over a 4096 x 4096 float image in default blocks; the
+// argument is the number of workers
+static void BM_ChunkedExecutorBoxFilter(BenchmarkState& state)
+{
+    const qint64 size = 4096;
+    std::vector<float> input(size_t(size * size));
+    for (size_t i = 0; i < input.size(); ++i) {
+        input[i] = float((i * 2654435761u) >> 24);
+    }
+    std::vector<float> output(input.size());
+
+    const BlockGrid grid({size, size}, BlockGrid::defaultBlockShape({size, size}));
+    QThreadPool pool;
+    pool.setMaxThreadCount(int(state.range()));
+
+    while (state.keepRunning()) {
+        ChunkedExecutor executor(&pool);
+        executor.start(grid.blockCount(), [&](qint64 index) {
+            QVector<qint64> start;
+            QVector<qint64> extent;
+            grid.block(index, &start, &extent);
+            for (qint64 y = qMax<qint64>(1, start[0]); y < qMin(size - 1, start[0] + extent[0]); ++y) {
+                for (qint64 x = qMax<qint64>(1, start[1]); x < qMin(size - 1, start[1] + extent[1]); ++x) {
+                    float sum = 0.0f;
+                    for (qint64 dy = -1; dy <= 1; ++dy) {
+                        const float* row = &input[size_t((y + dy) * size + x)];
+                        sum += row[-1] + row[0] + row[1];
+                    }
+                    output[size_t(y * size + x)] = sum / 9.0f;
+                }
+            }
+            return true;
+        });
+        executor.wait();
+    }
+    state.setItemsProcessed(state.iterations() * size * size);
+    state.setLabel(QString("%1 blocks").arg(grid.blockCount()));
+}
+TGUI_BENCHMARK(BM_ChunkedExecutorBoxFilter, 1, 4);
+
+// Step through a 32 x 1024 x 1024 uint16 stack; the argument selects
+// decoding every frame (0) or showing frames from a warm FrameCache (1)
+static void BM_ImageLayerStepFrames(BenchmarkState& state)
+{
+    const qint64 frames = 32;
+    const qint64 size = 1024;
+    DataBuffer stack(DataType::UInt16, {frames, size, size});
+    quint16* pixels = stack.data<quint16>();
+    for (qint64 i = 0; i < stack.elementCount(); ++i) {
+        pixels[i] = quint16((i * 2654435761u) >> 16);
+    }
+
+    std::unique_ptr<FrameCache> cache;
+    if (state.range() == 1) {
+        cache = std::make_unique<FrameCache>(1024ll * 1024 * 1024);
+    }
+
+    ImageLayer layer("Stack");
+    layer.setBuffer(stack);
+    if (cache) {
+        // One pass leaves every frame in the cache
+        for (qint64 frame = 1; frame <= frames; ++frame) {
+            layer.setSlicePoint({frame % frames});
+        }
+    }
+
+    qint64 frame = 0;
+    while (state.keepRunning()) {
+        frame = (frame + 1) % frames;
+        layer.setSlicePoint({frame});
+    }
+    state.setItemsProcessed(state.iterations());
+    if (cache) {
+        state.setLabel(QString("%1 MiB cached").arg(cache->memoryUsage() / (1024 * 1024)));
+    }
+}
+TGUI_BENCHMARK(BM_ImageLayerStepFrames, 0, 1);
+
+namespace {
+
+QString benchmarkPluginDirectory()
+{
+    QString directory = qEnvironmentVariable("TGUI_BENCH_PLUGIN_DIR");
+    if (directory.isEmpty()) {
+        directory = QDir(QCoreApplication::applicationDirPath()).filePath("../plugins");
+    }
+    return directory;
+}
+
+} // namespace
+
+// Application startup path: plugin metadata only, from the cache
+static void BM_PluginManagerDiscover(BenchmarkState& state)
+{
+    const QString directory = benchmarkPluginDirectory();
+    if (!QDir(directory).exists()) {
+        state.skip(QString("Plugin directory not found: %1").arg(directory));
+        return;
+    }
+
+    int discovered = 0;
+    while (state.keepRunning()) {
+        PluginManager manager(directory);
+        discovered = manager.discoverPlugins(directory);
+    }
+    state.setLabel(QString("%1 plugins from %2").arg(discovered).arg(QDir::cleanPath(directory)));
+}
+TGUI_BENCHMARK(BM_PluginManagerDiscover);
+
+// Plugin discovery, loading and unloading from a directory
+static void BM_PluginManagerStartup(BenchmarkState& state)
+{
+    const QString directory = benchmarkPluginDirectory();
+    if (!QDir(directory).exists()) {
+        state.skip(QString("Plugin directory not found: %1").arg(directory));
+        return;
+    }
+
+    int loaded = 0;
+    while (state.keepRunning()) {
+        PluginManager manager(directory);
+        loaded = manager.loadPluginsFromDirectory(directory);
+        manager.unloadAllPlugins();
+    }
+    state.setLabel(QString("%1 plugins from %2").arg(loaded).arg(QDir::cleanPath(directory)));
+}
+TGUI_BENCHMARK(BM_PluginManagerStartup);
@@ -0,0 +1,203 @@
+#include "AllocationCounter.h"
+#include "Benchmark.h"
+#include "core/ImageLayer.h"
+#include "core/LayerManager.h"
+#include "core/PointsLayer.h"
+#include "core/TileSource.h"
+#include "core/TiledImageLayer.h"
+#include "ui/ViewerWidget.h"
+
+#include <QCoreApplication>
+#include <QImage>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QRandomGenerator>
+#include <QThread>
+#include <memory>
+
+namespace {
+
+const QSize kViewportSize(1280, 720);
+
+/**
+ * @brief Check that an offscreen GL context can be created at all
+ * @param error Receives the reason on failure
+ * @return true if GL rendering is possible
+ */
+bool offscreenGLAvailable(QString* error)
+{
+    QOffscreenSurface surface;
+    surface.create();
+    QOpenGLContext context;
+    if (!context.create()) {
+        *error = "Cannot create an OpenGL context";
+        return false;
+    }
+    if (!context.makeCurrent(&surface)) {
+        *error = "Cannot make an offscreen OpenGL surface current";
+        return false;
+    }
+    context.doneCurrent();
+    return true;
+}
+
+/**
+ * @brief Viewer counting the heap allocations made inside paintGL()
+ */
+class CountingViewer : public ViewerWidget
+{
+public:
+    bool counting = false;
+    qint64 allocations = 0;
+    qint64 frames = 0;
+
+protected:
+    void paintGL() override
+    {
+        if (!counting) {
+            ViewerWidget::paintGL();
+            return;
+        }
+
+        AllocationCounter::start();
+        ViewerWidget::paintGL();
+        allocations += AllocationCounter::stop();
+        ++frames;
+    }
+};
+
+} // namespace
+
+// Full ViewerWidget frame with N points, rendered without a window.
+// The widget is never shown; QOpenGLWidget then renders into its FBO on a
+// QOffscreenSurface, and grabFramebuffer() runs paintGL and reads it back.
+static void BM_ViewerRenderPoints(BenchmarkState& state)
+{
+    QString error;
+    if (!offscreenGLAvailable(&error)) {
+        state.skip(error);
+        return;
+    }
+
+    LayerManager manager;
+    auto* points = new PointsLayer("Points");
+    QVector<QVector3D> positions;
+    positions.reserve(int(state.range()));
+    QRandomGenerator random(1);
+    for (qint64 i = 0; i < state.range(); ++i) {
+        positions.append(QVector3D(float(random.bounded(1000.0)), float(random.bounded(1000.0)), 0.0f));
+    }
+    points->setPoints(positions);
+    manager.addLayer(points);
+
+    ViewerWidget viewer;
+    viewer.resize(kViewportSize);
+    viewer.setLayerManager(&manager);
+    viewer.zoomToFit();
+
+    // First frame creates the context and uploads the buffers
+    if (viewer.grabFramebuffer().isNull()) {
+        state.skipWithError("ViewerWidget did not render offscreen");
+        return;
+    }
+
+    while (state.keepRunning()) {
+        // A dirty scene so the layer cache is not reused between frames
+        viewer.updateDisplay();
+        doNotOptimize(viewer.grabFramebuffer());
+    }
+    state.setItemsProcessed(state.iterations() * state.range());
+    state.setBytesProcessed(state.iterations() * kViewportSize.width() * kViewportSize.height() * 4);
+    state.setLabel(QString("%1x%2, includes readback").arg(kViewportSize.width()).arg(kViewportSize.height()));
+}
+TGUI_BENCHMARK(BM_ViewerRenderPoints, 10000, 1000000);
+
+// Heap allocations per steady-state frame while panning over points, an
+// image and a tiled image. Fails if any frame allocates; the count covers
+// everything paintGL() reaches, the GL driver included.
+static void BM_ViewerFrameAllocations(BenchmarkState& state)
+{
+    if (!AllocationCounter::isSupported()) {
+        state.skip("Allocation counting needs glibc");
+        return;
+    }
+
+    QString error;
+    if (!offscreenGLAvailable(&error)) {
+        state.skip(error);
+        return;
+    }
+
+    LayerManager manager;
+    auto* points = new PointsLayer("Points");
+    QVector<QVector3D> positions;
+    QRandomGenerator random(1);
+    for (int i = 0; i < 10000; ++i) {
+        positions.append(QVector3D(float(random.bounded(4096.0)), float(random.bounded(2048.0)), 0.0f));
+    }
+    points->setPoints(positions);
+
+    QImage pixels(2048, 2048, QImage::Format_RGBA8888);
+    pixels.fill(Qt::darkGray);
+    auto* image = new ImageLayer("Image");
+    image->setImage(pixels);
+
+    QImage tiled(4096, 2048, QImage::Format_RGBA8888);
+    tiled.fill(Qt::darkCyan);
+    auto* tiles = new TiledImageLayer("Tiles", std::make_shared<ImagePyramidSource>(tiled));
+
+    manager.addLayer(tiles);
+    manager.addLayer(image);
+    manager.addLayer(points);
+
+    CountingViewer viewer;
+    viewer.resize(kViewportSize);
+    viewer.setLayerManager(&manager);
+    viewer.zoomToFit();
+    viewer.setZoomLevel(viewer.zoomLevel() * 2.0f);
+
+    // A short pan loop over the scene
+    const QVector3D center = viewer.viewCenter();
+    QVector<QVector3D> path;
+    for (int i = 0; i < 8; ++i) {
+        path.append(center + QVector3D(float(256 * (i % 4)), float(256 * (i / 4)), 0.0f));
+    }
+
+    // Warm up until the tiles are loaded and the arena and pools have
+    // settled; tiles arrive from worker threads through queued events
+    qint64 tileUpdates = 0;
+    QObject::connect(tiles, &Layer::changed, [&tileUpdates]() { ++tileUpdates; });
+    for (int pass = 0; pass < 50; ++pass) {
+        const qint64 before = tileUpdates;
+        for (const QVector3D& position : qAsConst(path)) {
+            viewer.setViewCenter(position);
+            if (viewer.grabFramebuffer().isNull()) {
+                state.skipWithError("ViewerWidget did not render offscreen");
+                return;
+            }
+        }
+        QThread::msleep(10);
+        QCoreApplication::processEvents();
+        if (pass > 2 && tileUpdates == before) {
+            break;
+        }
+    }
+
+    viewer.counting = true;
+    int step = 0;
+    while (state.keepRunning()) {
+        viewer.setViewCenter(path[step++ % path.size()]);
+        doNotOptimize(viewer.grabFramebuffer());
+    }
+    viewer.counting = false;
+
+    const double perFrame = viewer.frames > 0 ? double(viewer.allocations) / viewer.frames : 0.0;
+    if (viewer.allocations > 0) {
+        state.skipWithError(QString("%1 heap allocations in %2 frames (%3 per frame)")
+                                .arg(viewer.allocations).arg(viewer.frames).arg(perFrame, 0, 'f', 2));
+        return;
+    }
+    state.setItemsProcessed(viewer.frames);
+    state.setLabel(QString("0 allocations in %1 frames").arg(viewer.frames));
+}
+TGUI_BENCHMARK(BM_ViewerFrameAllocations);
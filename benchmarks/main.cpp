@@ -0,0 +1,34 @@
+#include "Benchmark.h"
+
+#include <QApplication>
+#include <QSurfaceFormat>
+
+/**
+ * @brief Benchmark entry point
+ *
+ * Without a display the offscreen platform is used, so the suite runs on
+ * build machines; set QT_QPA_PLATFORM to override.
+ */
+int main(int argc, char* argv[])
+{
+#ifdef Q_OS_LINUX
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM") && qEnvironmentVariableIsEmpty("DISPLAY")
+        && qEnvironmentVariableIsEmpty("WAYLAND_DISPLAY")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+#endif
+
+    // Same context as the application, see main.cpp
+    QSurfaceFormat format;
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CompatibilityProfile);
+    format.setDepthBufferSize(24);
+    QSurfaceFormat::setDefaultFormat(format);
+
+    QApplication app(argc, argv);
+    QCoreApplication::setApplicationName("T-GUI Benchmarks");
+    QCoreApplication::setApplicationVersion("1.0.0");
+    QCoreApplication::setOrganizationName("T-GUI");
+
+    return BenchmarkRunner::run(app.arguments());
+}
@@ -3,21 +3,32 @@
 #include "../plugins/PluginManager.h"
 #include "LayerManager.h"
 #include "EventSystem.h"
+#include "TileCache.h"
+#include "FrameCache.h"
+#include "FileLoadService.h"
+#include "ProcessingService.h"
+#include "CommandHistory.h"
 #include "../utils/Logger.h"
 #include "../utils/Config.h"
+#include "../utils/Profiler.h"
+#include "../utils/StartupTimer.h"
+#include "../ui/ViewerWidget.h"
 
 #include <QStandardPaths>
 #include <QDir>
 #include <QMessageBox>
 #include <QDebug>
+#include <QTimer>
 
 Application* Application::s_instance = nullptr;
 
 Application::Application(int& argc, char** argv)
     : QApplication(argc, argv)
     , m_initialized(false)
+    , m_startupFinished(false)
 {
     s_instance = this;
+    startupTimer().mark("QApplication created");
     
     // Set application properties
     setApplicationName("T-GUI Framework");
@@ -57,12 +68,8 @@ bool Application::initialize()
     // Setup connections between components
     setupConnections();
 
-    // Load plugins
-    if (!loadPlugins()) {
-        qWarning() << "Some plugins failed to load";
-        // Don't fail initialization for plugin loading issues
-    }
-
+    // Plugins and the configuration file are loaded after the first
+    // frame, see runDeferredStartup()
     m_initialized = true;
     qDebug() << "T-GUI Framework initialized successfully";
     
@@ -74,6 +81,12 @@ Application* Application::instance()
     return s_instance;
 }
 
+StartupTimer& Application::startupTimer()
+{
+    static StartupTimer timer;
+    return timer;
+}
+
 void Application::showMainWindow()
 {
     if (m_logger) {
@@ -81,9 +94,22 @@ void Application::showMainWindow()
     }
 
     if (m_mainWindow) {
-        m_mainWindow->show();
-        m_mainWindow->raise();
-        m_mainWindow->activateWindow();
+        {
+            StartupTimer::Scope stage(startupTimer(), "show main window");
+            m_mainWindow->show();
+            m_mainWindow->raise();
+            m_mainWindow->activateWindow();
+        }
+
+        // Continue startup once the viewer has presented a frame
+        if (!m_startupFinished && !m_firstFrameConnection) {
+            if (ViewerWidget* viewer = m_mainWindow->viewerWidget()) {
+                m_firstFrameConnection = connect(viewer, &QOpenGLWidget::frameSwapped,
+                                                 this, &Application::onFirstFrame);
+            } else {
+                QTimer::singleShot(0, this, &Application::runDeferredStartup);
+            }
+        }
 
         if (m_logger) {
             m_logger->info("Main window shown successfully");
@@ -110,28 +136,134 @@ void Application::onAboutToQuit()
         m_logger->info("Application about to quit");
     }
 
-    // Save configuration
-    if (m_config) {
+    // Write pending changes; before deferred startup it holds only defaults
+    if (m_config && m_config->isLoaded() && m_config->isModified()) {
         m_config->save();
     }
 
+    // Stop loads before the plugins they may be calling go away
+    if (m_fileLoadService) {
+        m_fileLoadService->shutdown();
+    }
+    if (m_processingService) {
+        m_processingService->shutdown();
+    }
+
+    // Commands may own layers created by plugin code
+    if (m_commandHistory) {
+        m_commandHistory->clear();
+    }
+
     // Cleanup plugins
     if (m_pluginManager) {
         m_pluginManager->unloadAllPlugins();
     }
 }
 
+void Application::onFirstFrame()
+{
+    disconnect(m_firstFrameConnection);
+    m_firstFrameConnection = QMetaObject::Connection();
+    startupTimer().mark("first frame");
+
+    // Let the frame reach the screen before doing more work
+    QTimer::singleShot(0, this, &Application::runDeferredStartup);
+}
+
+void Application::runDeferredStartup()
+{
+    if (m_startupFinished || !m_initialized) {
+        return;
+    }
+    m_startupFinished = true;
+    StartupTimer& timer = startupTimer();
+
+    StartupIO io;
+    {
+        StartupTimer::Scope stage(timer, "wait for startup I/O");
+        if (m_startupIO.valid()) {
+            io = m_startupIO.get();
+        }
+    }
+    if (!io.directoriesCreated) {
+        m_logger->error(QString("Failed to create application directories in %1").arg(m_dataDir));
+    }
+
+    {
+        StartupTimer::Scope stage(timer, "apply configuration");
+        m_config->applyLoaded(io.config);
+
+        // Memory budgets start at the defaults until the configuration is known
+        static const Config::Key tileCacheKey("viewer/tileCacheMemoryMB");
+        static const Config::Key tileTextureKey("viewer/tileTextureMemoryMB");
+        m_tileCache->setMemoryBudget(m_config->value(tileCacheKey, 512).toLongLong() * 1024 * 1024);
+        m_tileCache->setTextureMemoryBudget(m_config->value(tileTextureKey, 256).toLongLong() * 1024 * 1024);
+        static const Config::Key frameCacheKey("viewer/frameCacheMemoryMB");
+        m_frameCache->setMemoryBudget(m_config->value(frameCacheKey, 1024).toLongLong() * 1024 * 1024);
+        static const Config::Key historyMemoryKey("history/memoryLimitMB");
+        m_commandHistory->setMemoryLimit(m_config->value(historyMemoryKey, 256).toLongLong() * 1024 * 1024);
+        static const Config::Key historyDiskKey("history/diskLimitMB");
+        m_commandHistory->setDiskLimit(m_config->value(historyDiskKey, 4096).toLongLong() * 1024 * 1024);
+        m_logger->info("Configuration loaded");
+    }
+
+    {
+        StartupTimer::Scope stage(timer, "plugins");
+        if (!loadPlugins()) {
+            qWarning() << "Some plugins failed to load";
+            // Don't fail startup for plugin loading issues
+        }
+    }
+
+    timer.mark("startup finished");
+    reportStartup();
+    emit startupFinished();
+}
+
+void Application::reportStartup()
+{
+    // Target for the first frame on a cold start
+    const qint64 firstFrameBudget = 300;
+
+    const StartupTimer& timer = startupTimer();
+    const qint64 firstFrame = timer.markTime("first frame");
+    const QString report = QString("Startup timing:\n%1").arg(timer.report().trimmed());
+    m_logger->info(report, "Startup");
+
+    if (firstFrame >= 0 && firstFrame / 1000000 > firstFrameBudget) {
+        m_logger->warning(QString("First frame after %1 ms, budget is %2 ms")
+                              .arg(firstFrame / 1000000).arg(firstFrameBudget), "Startup");
+    }
+}
+
 bool Application::initializeCore()
 {
+    StartupTimer& timer = startupTimer();
     try {
+        // Create the profiler first so startup can be timed; it stays
+        // disabled until the overlay or a trace capture turns it on
+        m_profiler = std::make_unique<Profiler>();
+        m_profiler->setEnabled(qEnvironmentVariableIsSet("TGUI_PROFILE"));
+
         // Initialize logger first
-        m_logger = std::make_unique<Logger>();
+        {
+            StartupTimer::Scope stage(timer, "logger");
+            m_logger = std::make_unique<Logger>();
+        }
         m_logger->info("Logger initialized");
 
-        // Initialize configuration
+        // Configuration is read on the startup worker and applied after the
+        // first frame; until then values are the defaults
+        const qint64 coreStart = timer.elapsed();
         m_config = std::make_unique<Config>(m_configDir);
-        m_config->load();
-        m_logger->info("Configuration loaded");
+
+        // Initialize tile cache; budgets are updated once the configuration is loaded
+        m_tileCache = std::make_unique<TileCache>(512ll * 1024 * 1024);
+        m_tileCache->setTextureMemoryBudget(256ll * 1024 * 1024);
+        m_logger->info("Tile cache initialized");
+
+        m_frameCache = std::make_unique<FrameCache>(1024ll * 1024 * 1024);
+        m_logger->info("Frame cache initialized");
 
         // Initialize event system
         m_eventSystem = std::make_unique<EventSystem>();
@@ -143,11 +275,31 @@ bool Application::initializeCore()
 
         // Initialize plugin manager
         m_pluginManager = std::make_unique<PluginManager>(m_pluginsDir);
+        m_pluginManager->setApplication(this);
         m_logger->info("Plugin manager initialized");
 
+        // Initialize background file loading
+        m_fileLoadService = std::make_unique<FileLoadService>();
+        m_fileLoadService->setLayerManager(m_layerManager.get());
+        m_logger->info("File load service initialized");
+
+        // Initialize block-wise processing for plugin operations
+        m_processingService = std::make_unique<ProcessingService>();
+        m_processingService->setLayerManager(m_layerManager.get());
+        m_logger->info("Processing service initialized");
+
+        // Initialize undo history; the memory limit follows the configuration
+        m_commandHistory = std::make_unique<CommandHistory>();
+        m_logger->info("Command history initialized");
+
+        timer.addStage("core components", coreStart, timer.elapsed());
+
         // Initialize main window
         m_logger->info("Creating main window...");
-        m_mainWindow = std::make_unique<MainWindow>();
+        {
+            StartupTimer::Scope stage(timer, "main window");
+            m_mainWindow = std::make_unique<MainWindow>();
+        }
         m_logger->info("Main window initialized");
 
         return true;
@@ -164,25 +316,31 @@ bool Application::initializeDirectories()
     m_dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
     m_configDir = QDir(m_dataDir).filePath("config");
     m_pluginsDir = QDir(m_dataDir).filePath("plugins");
-
-    // Create directories if they don't exist
-    QDir dataDir(m_dataDir);
-    if (!dataDir.exists() && !dataDir.mkpath(".")) {
-        qCritical() << "Failed to create data directory:" << m_dataDir;
-        return false;
-    }
-
-    QDir configDir(m_configDir);
-    if (!configDir.exists() && !configDir.mkpath(".")) {
-        qCritical() << "Failed to create config directory:" << m_configDir;
+    if (m_dataDir.isEmpty()) {
+        qCritical() << "No writable application data location";
         return false;
     }
 
-    QDir pluginsDir(m_pluginsDir);
-    if (!pluginsDir.exists() && !pluginsDir.mkpath(".")) {
-        qCritical() << "Failed to create plugins directory:" << m_pluginsDir;
-        return false;
-    }
+    // Creating directories and reading the configuration file touch the
+    // disk, which on a cold start can take longer than the whole first
+    // frame; they run on a worker and are collected after the first frame
+    const QStringList directories{m_dataDir, m_configDir, m_pluginsDir};
+    const QString configFile = QDir(m_configDir).filePath("config.json");
+    m_startupIO = std::async(std::launch::async, [directories, configFile]() {
+        const qint64 start = startupTimer().elapsed();
+        StartupIO io;
+        io.directoriesCreated = true;
+        for (const QString& path : directories) {
+            QDir dir(path);
+            if (!dir.exists() && !dir.mkpath(".")) {
+                qCritical() << "Failed to create directory:" << path;
+                io.directoriesCreated = false;
+            }
+        }
+        io.config = Config::readFile(configFile);
+        startupTimer().addStage("startup I/O (worker)", start, startupTimer().elapsed());
+        return io;
+    });
 
     qDebug() << "Data directory:" << m_dataDir;
     qDebug() << "Config directory:" << m_configDir;
@@ -198,16 +356,17 @@ bool Application::loadPlugins()
         return false;
     }
 
-    // Load plugins from the plugins directory
-    int loadedCount = m_pluginManager->loadPluginsFromDirectory(m_pluginsDir);
+    // Only metadata is read here; plugins are loaded when first used
+    int discoveredCount = m_pluginManager->discoverPlugins(m_pluginsDir);
     
-    // Also try to load from application directory
+    // Also look in the application directory
     QString appPluginsDir = QDir(applicationDirPath()).filePath("plugins");
     if (QDir(appPluginsDir).exists()) {
-        loadedCount += m_pluginManager->loadPluginsFromDirectory(appPluginsDir);
+        discoveredCount += m_pluginManager->discoverPlugins(appPluginsDir);
     }
 
-    m_logger->info(QString("Loaded %1 plugins").arg(loadedCount));
+    const int loadedCount = m_pluginManager->loadStartupPlugins();
+    m_logger->info(QString("Found %1 plugins, loaded %2 at startup").arg(discoveredCount).arg(loadedCount));
     return true;
 }
 
@@ -218,6 +377,24 @@ void Application::setupConnections()
         // These connections will be implemented when we create the specific classes
     }
 
+    // Apply tile cache, frame cache and history budget changes
+    if (m_config && m_tileCache && m_frameCache && m_commandHistory) {
+        connect(m_config.get(), &Config::configurationChanged, this,
+                [this](const QString& key, const QVariant& value) {
+            if (key == "viewer/tileCacheMemoryMB") {
+                m_tileCache->setMemoryBudget(value.toLongLong() * 1024 * 1024);
+            } else if (key == "viewer/tileTextureMemoryMB") {
+                m_tileCache->setTextureMemoryBudget(value.toLongLong() * 1024 * 1024);
+            } else if (key == "viewer/frameCacheMemoryMB") {
+                m_frameCache->setMemoryBudget(value.toLongLong() * 1024 * 1024);
+            } else if (key == "history/memoryLimitMB") {
+                m_commandHistory->setMemoryLimit(value.toLongLong() * 1024 * 1024);
+            } else if (key == "history/diskLimitMB") {
+                m_commandHistory->setDiskLimit(value.toLongLong() * 1024 * 1024);
+            }
+        });
+    }
+
     // Connect event system to components
     if (m_eventSystem) {
         // Event system connections will be set up here
@@ -2,6 +2,8 @@
 
 #include <QApplication>
 #include <QDir>
+#include <QJsonObject>
+#include <future>
 #include <memory>
 
 class MainWindow;
@@ -10,6 +12,13 @@ class LayerManager;
 class EventSystem;
 class Logger;
 class Config;
+class TileCache;
+class FrameCache;
+class FileLoadService;
+class ProcessingService;
+class CommandHistory;
+class Profiler;
+class StartupTimer;
 
 /**
  * @brief Main application class for the GUI framework
@@ -46,6 +55,22 @@ public:
      */
     static Application* instance();
 
+    /**
+     * @brief Get the startup timer
+     *
+     * The clock starts on the first call, which main() makes before
+     * anything else.
+     *
+     * @return Startup timer
+     */
+    static StartupTimer& startupTimer();
+
+    /**
+     * @brief Check if deferred startup has finished
+     * @return true once plugins and the full configuration are loaded
+     */
+    bool isStartupFinished() const { return m_startupFinished; }
+
     /**
      * @brief Get the main window
      * @return Pointer to main window
@@ -82,6 +107,42 @@ public:
      */
     Config* config() const { return m_config.get(); }
 
+    /**
+     * @brief Get the shared image tile cache
+     * @return Pointer to tile cache
+     */
+    TileCache* tileCache() const { return m_tileCache.get(); }
+
+    /**
+     * @brief Get the shared decoded frame cache
+     * @return Pointer to frame cache
+     */
+    FrameCache* frameCache() const { return m_frameCache.get(); }
+
+    /**
+     * @brief Get file load service
+     * @return Pointer to file load service
+     */
+    FileLoadService* fileLoadService() const { return m_fileLoadService.get(); }
+
+    /**
+     * @brief Get processing service running plugin operations
+     * @return Pointer to processing service
+     */
+    ProcessingService* processingService() const { return m_processingService.get(); }
+
+    /**
+     * @brief Get the undo/redo history
+     * @return Pointer to command history
+     */
+    CommandHistory* commandHistory() const { return m_commandHistory.get(); }
+
+    /**
+     * @brief Get the frame profiler
+     * @return Pointer to profiler
+     */
+    Profiler* profiler() const { return m_profiler.get(); }
+
     /**
      * @brief Get application data directory
      * @return Path to application data directory
@@ -94,9 +155,18 @@ public:
      */
     QString pluginsDirectory() const { return m_pluginsDir; }
 
+signals:
+    /**
+     * @brief Emitted when deferred startup has finished
+     */
+    void startupFinished();
+
 public slots:
     /**
      * @brief Show the main window
+     *
+     * Deferred startup (configuration, plugins) runs after the window's
+     * first frame.
      */
     void showMainWindow();
 
@@ -111,6 +181,16 @@ private slots:
      */
     void onAboutToQuit();
 
+    /**
+     * @brief Record the first frame and schedule deferred startup
+     */
+    void onFirstFrame();
+
+    /**
+     * @brief Apply the configuration and load plugins after the first frame
+     */
+    void runDeferredStartup();
+
 private:
     /**
      * @brief Initialize core components
@@ -119,11 +199,16 @@ private:
     bool initializeCore();
 
     /**
-     * @brief Initialize directories
+     * @brief Resolve directories and start creating them on a worker
      * @return true if successful
      */
     bool initializeDirectories();
 
+    /**
+     * @brief Log the startup report
+     */
+    void reportStartup();
+
     /**
      * @brief Load plugins
      * @return true if successful
@@ -138,19 +223,38 @@ private:
 private:
     static Application* s_instance;
 
-    // Core components
+    // Core components; the profiler is destroyed last
+    std::unique_ptr<Profiler> m_profiler;
     std::unique_ptr<MainWindow> m_mainWindow;
     std::unique_ptr<PluginManager> m_pluginManager;
     std::unique_ptr<LayerManager> m_layerManager;
     std::unique_ptr<EventSystem> m_eventSystem;
     std::unique_ptr<Logger> m_logger;
     std::unique_ptr<Config> m_config;
+    std::unique_ptr<TileCache> m_tileCache;
+    std::unique_ptr<FrameCache> m_frameCache;
+    std::unique_ptr<FileLoadService> m_fileLoadService;
+    std::unique_ptr<ProcessingService> m_processingService;
+    // Destroyed before the layer manager; owns layers removed by commands
+    std::unique_ptr<CommandHistory> m_commandHistory;
 
     // Directories
     QString m_dataDir;
     QString m_pluginsDir;
     QString m_configDir;
 
+    /**
+     * @brief Result of the startup I/O done on a worker thread
+     */
+    struct StartupIO
+    {
+        bool directoriesCreated = false;
+        QJsonObject config;
+    };
+
     // State
     bool m_initialized;
+    bool m_startupFinished;
+    std::future<StartupIO> m_startupIO;
+    QMetaObject::Connection m_firstFrameConnection;
 };
@@ -0,0 +1,574 @@
+#include "BatchRenderer.h"
+#include "DataLoader.h"
+#include "Dims.h"
+#include "ImageLayer.h"
+#include "LayerManager.h"
+#include "OffscreenRenderer.h"
+#include "SessionFile.h"
+
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QImageReader>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QStandardPaths>
+#include <QSurfaceFormat>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// Time ffmpeg may take to accept a frame or to finish the file
+const int kEncoderTimeoutMs = 120000;
+
+bool setError(QString* errorMessage, const QString& message)
+{
+    qWarning() << "BatchRenderer:" << message;
+    if (errorMessage) {
+        *errorMessage = message;
+    }
+    return false;
+}
+
+bool parseSize(const QString& text, QSize* size)
+{
+    const QStringList parts = text.toLower().split('x');
+    bool widthOk = false;
+    bool heightOk = false;
+    if (parts.size() == 2) {
+        *size = QSize(parts[0].toInt(&widthOk), parts[1].toInt(&heightOk));
+    }
+    return widthOk && heightOk && !size->isEmpty();
+}
+
+bool parseRegion(const QVariantList& values, QRectF* region)
+{
+    if (values.size() != 4) {
+        return false;
+    }
+    *region = QRectF(values[0].toDouble(), values[1].toDouble(), values[2].toDouble(), values[3].toDouble());
+    return !region->isEmpty();
+}
+
+bool parseFrames(const QString& text, qint64* first, qint64* last)
+{
+    const QStringList parts = text.split(':');
+    bool firstOk = false;
+    bool lastOk = true;
+    *first = parts.value(0).toLongLong(&firstOk);
+    *last = parts.size() > 1 && !parts[1].isEmpty() ? parts[1].toLongLong(&lastOk) : -1;
+    return parts.size() <= 2 && firstOk && lastOk && *first >= 0 && (*last < 0 || *last >= *first);
+}
+
+/**
+ * @brief Pipes raw RGBA frames into an ffmpeg process
+ */
+class VideoEncoder
+{
+public:
+    bool start(const QString& fileName, const QSize& size, double fps, QString* errorMessage)
+    {
+        const QString ffmpeg = qEnvironmentVariableIsSet("TGUI_FFMPEG")
+            ? qEnvironmentVariable("TGUI_FFMPEG") : QStandardPaths::findExecutable("ffmpeg");
+        if (ffmpeg.isEmpty()) {
+            return setError(errorMessage, "ffmpeg not found; install it or set TGUI_FFMPEG");
+        }
+
+        // yuv420p, which players expect, needs even dimensions
+        const QStringList arguments = {
+            "-y", "-loglevel", "error",
+            "-f", "rawvideo", "-pix_fmt", "rgba",
+            "-s", QString("%1x%2").arg(size.width()).arg(size.height()),
+            "-r", QString::number(fps),
+            "-i", "-",
+            "-vf", "pad=ceil(iw/2)*2:ceil(ih/2)*2",
+            "-pix_fmt", "yuv420p",
+            fileName
+        };
+        m_process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        m_process.start(ffmpeg, arguments);
+        if (!m_process.waitForStarted()) {
+            return setError(errorMessage, QString("Cannot start %1: %2").arg(ffmpeg, m_process.errorString()));
+        }
+        m_size = size;
+        return true;
+    }
+
+    bool write(const QImage& frame, QString* errorMessage)
+    {
+        if (frame.size() != m_size || frame.format() != QImage::Format_RGBA8888) {
+            return setError(errorMessage, "Frame does not match the video format");
+        }
+
+        // Rows of RGBA8888 images are tightly packed
+        m_process.write(reinterpret_cast<const char*>(frame.constBits()), frame.sizeInBytes());
+        while (m_process.bytesToWrite() > 0) {
+            if (!m_process.waitForBytesWritten(kEncoderTimeoutMs)) {
+                return setError(errorMessage, QString("ffmpeg stopped accepting frames: %1").arg(m_process.errorString()));
+            }
+        }
+        return true;
+    }
+
+    bool finish(QString* errorMessage)
+    {
+        m_process.closeWriteChannel();
+        if (!m_process.waitForFinished(kEncoderTimeoutMs)) {
+            m_process.kill();
+            return setError(errorMessage, "ffmpeg did not finish");
+        }
+        if (m_process.exitStatus() != QProcess::NormalExit || m_process.exitCode() != 0) {
+            return setError(errorMessage, QString("ffmpeg failed with exit code %1").arg(m_process.exitCode()));
+        }
+        return true;
+    }
+
+private:
+    QProcess m_process;
+    QSize m_size;
+};
+
+/**
+ * @brief Remove an option and its value from an argument list
+ * @param arguments Arguments
+ * @param name Option name without dashes
+ * @return Remaining arguments
+ */
+QStringList withoutOption(const QStringList& arguments, const QString& name)
+{
+    QStringList result;
+    const QString option = "--" + name;
+    for (int i = 0; i < arguments.size(); ++i) {
+        if (arguments[i] == option) {
+            ++i;
+        } else if (!arguments[i].startsWith(option + "=")) {
+            result.append(arguments[i]);
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+bool RenderJob::fromJson(const QJsonObject& object, const RenderJob& defaults, QString* errorMessage)
+{
+    *this = defaults;
+
+    if (object.contains("input")) {
+        const QJsonValue input = object.value("input");
+        inputs = input.isArray() ? input.toVariant().toStringList() : QStringList{input.toString()};
+    }
+    output = object.value("output").toString(output);
+    video = object.value("video").toString(video);
+    if (object.contains("margin")) {
+        // Half the image or more on each side leaves no room for the scene
+        const QJsonValue value = object.value("margin");
+        margin = value.toDouble(-1.0);
+        if (!value.isDouble() || margin < 0.0 || margin >= 0.5) {
+            return setError(errorMessage, "Invalid margin; expected a fraction in [0, 0.5)");
+        }
+    }
+    fps = object.value("fps").toDouble(fps);
+    axis = object.value("axis").toInt(axis);
+
+    if (object.contains("size") && !parseSize(object.value("size").toString(), &size)) {
+        return setError(errorMessage, "Invalid size; expected \"WIDTHxHEIGHT\"");
+    }
+    if (object.contains("region") && !parseRegion(object.value("region").toArray().toVariantList(), &region)) {
+        return setError(errorMessage, "Invalid region; expected [x, y, width, height]");
+    }
+    if (object.contains("frames") && !parseFrames(object.value("frames").toString(), &firstFrame, &lastFrame)) {
+        return setError(errorMessage, "Invalid frames; expected \"first:last\"");
+    }
+    if (object.contains("background")) {
+        background = QColor(object.value("background").toString());
+        if (!background.isValid()) {
+            return setError(errorMessage, "Invalid background color");
+        }
+    }
+
+    if (!(fps > 0.0)) {
+        return setError(errorMessage, "Frame rate must be positive");
+    }
+    return true;
+}
+
+bool RenderJob::isComplete(QString* errorMessage) const
+{
+    if (inputs.isEmpty()) {
+        return setError(errorMessage, "Job has no input");
+    }
+    if (output.isEmpty() && video.isEmpty()) {
+        return setError(errorMessage, "Job has neither an output image nor a video");
+    }
+    return true;
+}
+
+bool BatchRenderer::isHeadless(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--headless") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int BatchRenderer::run(int argc, char* argv[])
+{
+    // A platform plugin that needs no display, chosen before the application exists
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    // Same context as the viewer requests, so the layer shaders work unchanged
+    QSurfaceFormat format;
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CompatibilityProfile);
+    format.setDepthBufferSize(24);
+    QSurfaceFormat::setDefaultFormat(format);
+
+    QGuiApplication app(argc, argv);
+    QCoreApplication::setApplicationName("T-GUI Framework");
+    QCoreApplication::setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Render figures and movies without a display");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"headless", "Run without a window."},
+        {{"i", "input"}, "Session (.tgs) or data file; repeat to stack layers.", "file"},
+        {{"o", "output"}, "Image file; '#' runs are replaced by the frame number.", "file"},
+        {"video", "Movie file encoded with ffmpeg.", "file"},
+        {"size", "Output size in pixels (default 1920x1080).", "WxH"},
+        {"region", "World area to render (default: fit the scene).", "x,y,w,h"},
+        {"margin", "Free border when fitting, as a fraction of the image.", "fraction"},
+        {"background", "Background color, e.g. black or #00000000.", "color"},
+        {"axis", "Slider dimension to animate.", "axis"},
+        {"frames", "Frames to render along the axis.", "first:last"},
+        {"fps", "Movie frame rate (default 10).", "fps"},
+        {"script", "JSON file with render jobs.", "file"},
+        {"tile-size", "Largest tile rendered in one pass.", "pixels"},
+        {"timeout", "Seconds to wait for streamed data per tile (default 60).", "seconds"},
+        {"workers", "Number of worker processes.", "count"},
+        {"gpus", "GPU ids assigned to workers round robin.", "ids"},
+        {"shard", "Render only every count-th job, starting at index.", "index/count"},
+        {"verbose", "Print the GPU and a summary of the run."}
+    });
+    parser.process(app);
+
+    // Command line values form the job, or the defaults of scripted jobs
+    QJsonObject options;
+    if (parser.isSet("input")) options.insert("input", QJsonArray::fromStringList(parser.values("input")));
+    if (parser.isSet("output")) options.insert("output", parser.value("output"));
+    if (parser.isSet("video")) options.insert("video", parser.value("video"));
+    if (parser.isSet("size")) options.insert("size", parser.value("size"));
+    if (parser.isSet("margin")) {
+        // Unparsable values stay strings, which fromJson() rejects
+        bool ok = false;
+        const double margin = parser.value("margin").toDouble(&ok);
+        options.insert("margin", ok ? QJsonValue(margin) : QJsonValue(parser.value("margin")));
+    }
+    if (parser.isSet("background")) options.insert("background", parser.value("background"));
+    if (parser.isSet("axis")) options.insert("axis", parser.value("axis").toInt());
+    if (parser.isSet("frames")) options.insert("frames", parser.value("frames"));
+    if (parser.isSet("fps")) options.insert("fps", parser.value("fps").toDouble());
+    if (parser.isSet("region")) {
+        QJsonArray region;
+        for (const QString& value : parser.value("region").split(',')) {
+            region.append(value.toDouble());
+        }
+        options.insert("region", region);
+    }
+
+    QString error;
+    QList<RenderJob> jobs;
+    if (parser.isSet("script")) {
+        QFile file(parser.value("script"));
+        if (!file.open(QIODevice::ReadOnly)) {
+            qCritical() << "Cannot open script" << file.fileName() << ":" << file.errorString();
+            return 1;
+        }
+        QJsonParseError parseError;
+        const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+        if (document.isNull()) {
+            qCritical() << "Invalid script" << file.fileName() << ":" << parseError.errorString();
+            return 1;
+        }
+
+        // Script defaults apply first, command line options override them
+        QJsonObject defaultsObject = document.object().value("defaults").toObject();
+        for (auto it = options.constBegin(); it != options.constEnd(); ++it) {
+            defaultsObject.insert(it.key(), it.value());
+        }
+        RenderJob defaults;
+        if (!defaults.fromJson(defaultsObject, RenderJob(), &error)) {
+            qCritical() << "Defaults in" << file.fileName() << ":" << error;
+            return 1;
+        }
+
+        const QJsonArray entries = document.isArray() ? document.array() : document.object().value("jobs").toArray();
+        for (int i = 0; i < entries.size(); ++i) {
+            RenderJob job;
+            if (!job.fromJson(entries[i].toObject(), defaults, &error) || !job.isComplete(&error)) {
+                qCritical() << "Job" << i << "in" << file.fileName() << ":" << error;
+                return 1;
+            }
+            jobs.append(job);
+        }
+    } else {
+        RenderJob job;
+        if (!job.fromJson(options, RenderJob(), &error) || !job.isComplete(&error)) {
+            qCritical().noquote() << error << "\n\n" << parser.helpText();
+            return 1;
+        }
+        jobs.append(job);
+    }
+
+    const int workers = parser.value("workers").toInt();
+    if (workers > 1 && !parser.isSet("shard")) {
+        QStringList arguments = QCoreApplication::arguments().mid(1);
+        arguments = withoutOption(withoutOption(arguments, "workers"), "gpus");
+        const QStringList gpus = parser.value("gpus").split(',', Qt::SkipEmptyParts);
+        return runWorkers(arguments, qMin(workers, jobs.size()), gpus, parser.isSet("verbose"));
+    }
+
+    int shardIndex = 0;
+    int shardCount = 1;
+    if (parser.isSet("shard")) {
+        const QStringList parts = parser.value("shard").split('/');
+        shardIndex = parts.value(0).toInt();
+        shardCount = parts.value(1).toInt();
+        if (parts.size() != 2 || shardCount < 1 || shardIndex < 0 || shardIndex >= shardCount) {
+            qCritical() << "Invalid shard" << parser.value("shard") << "; expected index/count";
+            return 1;
+        }
+    }
+
+    OffscreenRenderer renderer;
+    if (!renderer.initialize(&error)) {
+        qCritical() << "Headless rendering is not available:" << error;
+        return 1;
+    }
+    if (parser.isSet("tile-size")) {
+        const int tileSize = parser.value("tile-size").toInt();
+        renderer.setMaxTileSize(QSize(tileSize, tileSize));
+    }
+    if (parser.isSet("timeout")) {
+        renderer.setLoadTimeout(qRound(parser.value("timeout").toDouble() * 1000.0));
+    }
+    const bool verbose = parser.isSet("verbose");
+    if (verbose) {
+        qInfo().noquote() << "Rendering on" << renderer.rendererName() << "with tiles up to"
+                          << renderer.maxTileSize().width() << "x" << renderer.maxTileSize().height();
+    }
+
+    BatchRenderer batch(&renderer);
+    int failures = 0;
+    int rendered = 0;
+    QElapsedTimer clock;
+    clock.start();
+    for (int i = shardIndex; i < jobs.size(); i += shardCount) {
+        const RenderJob& job = jobs[i];
+        if (!batch.render(job, &error)) {
+            qCritical() << "Job" << i << "failed:" << error;
+            ++failures;
+        }
+        ++rendered;
+    }
+
+    if (verbose) {
+        qInfo() << rendered << "jobs in" << clock.elapsed() << "ms," << failures << "failed";
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+BatchRenderer::BatchRenderer(OffscreenRenderer* renderer)
+    : m_renderer(renderer)
+{
+}
+
+bool BatchRenderer::render(const RenderJob& job, QString* errorMessage)
+{
+    if (!m_renderer || !m_renderer->isInitialized()) {
+        return setError(errorMessage, "Renderer is not initialized");
+    }
+
+    LayerManager layers;
+    if (!loadInputs(job.inputs, &layers, errorMessage)) {
+        return false;
+    }
+
+    const QRectF region = job.region.isEmpty()
+        ? OffscreenRenderer::fitRect(layers.sceneBounds(), job.size, job.margin) : job.region;
+    if (region.isEmpty()) {
+        return setError(errorMessage, "Cannot fit the scene into the image; check size and margin");
+    }
+
+    qint64 first = 0;
+    qint64 last = 0;
+    Dims* dims = layers.dims();
+    if (job.axis >= 0) {
+        if (job.axis >= dims->ndim()) {
+            return setError(errorMessage, QString("Axis %1 does not exist; the scene has %2 slider dimensions")
+                                              .arg(job.axis).arg(dims->ndim()));
+        }
+        const qint64 steps = dims->range()[job.axis];
+        if (job.firstFrame >= steps) {
+            return setError(errorMessage, QString("No frames to render: axis %1 has %2 steps, first frame is %3")
+                                              .arg(job.axis).arg(steps).arg(job.firstFrame));
+        }
+        first = job.firstFrame;
+        last = job.lastFrame < 0 ? steps - 1 : qMin(job.lastFrame, steps - 1);
+    }
+    const qint64 frameCount = last - first + 1;
+
+    VideoEncoder encoder;
+    if (!job.video.isEmpty() && !encoder.start(job.video, job.size, job.fps, errorMessage)) {
+        return false;
+    }
+
+    m_renderer->setBackgroundColor(job.background);
+    bool ok = true;
+    for (qint64 frame = first; frame <= last && ok; ++frame) {
+        if (job.axis >= 0) {
+            dims->setIndex(job.axis, frame);
+        }
+
+        const QImage image = m_renderer->render(&layers, region, job.size, errorMessage);
+        if (image.isNull()) {
+            ok = false;
+            break;
+        }
+
+        if (!job.output.isEmpty()) {
+            const QString fileName = frameFileName(job.output, frame, frameCount);
+            if (!image.save(fileName)) {
+                ok = setError(errorMessage, QString("Cannot write %1").arg(fileName));
+                break;
+            }
+        }
+        if (!job.video.isEmpty()) {
+            ok = encoder.write(image, errorMessage);
+        }
+    }
+
+    if (!job.video.isEmpty()) {
+        QString encoderError;
+        if (!encoder.finish(&encoderError) && ok) {
+            ok = setError(errorMessage, encoderError);
+        }
+    }
+
+    // Layers are deleted with the manager; their GL objects live in the
+    // renderer's context
+    m_renderer->releaseLayers(&layers);
+    return ok;
+}
+
+bool BatchRenderer::loadInputs(const QStringList& inputs, LayerManager* layers, QString* errorMessage)
+{
+    for (const QString& fileName : inputs) {
+        if (SessionFile::isSessionFile(fileName)) {
+            SessionFile session;
+            QList<Layer*> sessionLayers;
+            QString error;
+            if (!session.load(fileName, &sessionLayers, nullptr, &error)) {
+                return setError(errorMessage, error);
+            }
+            layers->addLayers(sessionLayers);
+            continue;
+        }
+
+        const QString layerName = QFileInfo(fileName).completeBaseName();
+        Layer* layer = nullptr;
+        QString error;
+        if (DataLoader::canLoad(fileName)) {
+            const DataBuffer buffer = DataLoader::load(fileName, &error);
+            if (!buffer.isNull()) {
+                layer = DataLoader::createLayer(buffer, layerName);
+            }
+        } else {
+            // Compressed or common image formats go through Qt's decoders
+            QImageReader reader(fileName);
+            const QImage image = reader.read();
+            if (!image.isNull()) {
+                ImageLayer* imageLayer = new ImageLayer(layerName);
+                imageLayer->setImage(image);
+                layer = imageLayer;
+            } else {
+                error = reader.errorString();
+            }
+        }
+
+        if (!layer) {
+            return setError(errorMessage, QString("Cannot load %1: %2").arg(fileName, error));
+        }
+        layers->addLayer(layer);
+    }
+    return true;
+}
+
+QString BatchRenderer::frameFileName(const QString& pattern, qint64 frame, qint64 frameCount)
+{
+    static const QRegularExpression placeholder("#+");
+    const QRegularExpressionMatch match = placeholder.match(pattern);
+    if (match.hasMatch()) {
+        QString name = pattern;
+        return name.replace(match.capturedStart(), match.capturedLength(),
+                            QString("%1").arg(frame, match.capturedLength(), 10, QChar('0')));
+    }
+    if (frameCount <= 1) {
+        return pattern;
+    }
+
+    const QFileInfo info(pattern);
+    const QString number = QString("%1").arg(frame, 5, 10, QChar('0'));
+    const QString base = info.path() + "/" + info.completeBaseName() + "_" + number;
+    return info.suffix().isEmpty() ? base : base + "." + info.suffix();
+}
+
+int BatchRenderer::runWorkers(const QStringList& arguments, int workers, const QStringList& gpus, bool verbose)
+{
+    std::vector<std::unique_ptr<QProcess>> processes;
+    int failures = 0;
+
+    for (int i = 0; i < workers; ++i) {
+        auto process = std::make_unique<QProcess>();
+        QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+        if (!gpus.isEmpty()) {
+            // CUDA_VISIBLE_DEVICES selects NVIDIA devices, DRI_PRIME Mesa ones
+            const QString gpu = gpus[i % gpus.size()];
+            environment.insert("CUDA_VISIBLE_DEVICES", gpu);
+            environment.insert("DRI_PRIME", gpu);
+        }
+        process->setProcessEnvironment(environment);
+        process->setProcessChannelMode(QProcess::ForwardedChannels);
+        process->start(QCoreApplication::applicationFilePath(),
+                       arguments + QStringList{"--shard", QString("%1/%2").arg(i).arg(workers)});
+        if (!process->waitForStarted()) {
+            qCritical() << "Cannot start render worker" << i << ":" << process->errorString();
+            ++failures;
+            continue;
+        }
+        processes.push_back(std::move(process));
+    }
+
+    for (const std::unique_ptr<QProcess>& process : processes) {
+        process->waitForFinished(-1);
+        if (process->exitStatus() != QProcess::NormalExit || process->exitCode() != 0) {
+            ++failures;
+        }
+    }
+
+    if (verbose) {
+        qInfo() << workers << "workers finished," << failures << "failed";
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <QColor>
+#include <QJsonObject>
+#include <QList>
+#include <QRectF>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+
+class LayerManager;
+class OffscreenRenderer;
+
+/**
+ * @brief One figure or movie rendered in batch mode
+ */
+struct RenderJob
+{
+    QStringList inputs;              ///< Session (.tgs) or data files, stacked in order
+    QString output;                  ///< Image file; '#' runs are replaced by the frame number
+    QString video;                   ///< Movie file encoded with ffmpeg, or empty
+    QSize size = QSize(1920, 1080);  ///< Output size in pixels
+    QRectF region;                   ///< World area (x, y, width, height); empty fits the scene
+    qreal margin = 0.0;              ///< Free border when fitting, fraction of the image in [0, 0.5)
+    QColor background = Qt::black;   ///< Background; may be transparent for PNG/TIFF
+    int axis = -1;                   ///< Slider dimension to animate, or -1 for one image
+    qint64 firstFrame = 0;           ///< First frame of the animation
+    qint64 lastFrame = -1;           ///< Last frame, or -1 for the end of the axis
+    double fps = 10.0;               ///< Movie frame rate
+
+    /**
+     * @brief Read a job from its JSON form
+     *
+     * Keys are the command line option names: "input" (string or array),
+     * "output", "video", "size" ("WxH"), "region" ([x, y, w, h]),
+     * "margin", "background", "axis", "frames" ("first:last"), "fps".
+     *
+     * Only the values present are checked; use isComplete() before
+     * rendering. That way a block of defaults can be read on its own.
+     *
+     * @param object JSON object
+     * @param defaults Values for keys the object does not set
+     * @param errorMessage Receives the reason on failure (may be nullptr)
+     * @return true if every value present is valid
+     */
+    bool fromJson(const QJsonObject& object, const RenderJob& defaults, QString* errorMessage = nullptr);
+
+    /**
+     * @brief Check if the job names its inputs and at least one output
+     * @param errorMessage Receives the reason on failure (may be nullptr)
+     * @return true if the job can be rendered
+     */
+    bool isComplete(QString* errorMessage = nullptr) const;
+};
+
+/**
+ * @brief Headless figure and movie export
+ *
+ * Started by main() when the command line contains --headless. No window
+ * or Application is created: a QGuiApplication on a display-less platform
+ * plugin ("offscreen" unless QT_QPA_PLATFORM says otherwise; use an EGL
+ * plugin such as "eglfs" on nodes without X) drives an OffscreenRenderer.
+ *
+ * Each job loads its inputs into a LayerManager of its own, renders the
+ * still image or every frame along one slider dimension, and writes image
+ * files or pipes raw frames into ffmpeg. Jobs come from the command line
+ * or from a JSON script ({"defaults": {...}, "jobs": [{...}, ...]}).
+ *
+ * With --workers N the process starts N copies of itself, each rendering
+ * every N-th job (--shard i/N), and waits for them. --gpus assigns the
+ * workers to GPUs round robin through CUDA_VISIBLE_DEVICES and DRI_PRIME;
+ * workers on other machines are started by the job scheduler with
+ * --shard directly.
+ */
+class BatchRenderer
+{
+public:
+    /**
+     * @brief Check if the command line asks for headless mode
+     * @param argc Argument count
+     * @param argv Arguments
+     * @return true if --headless is given
+     */
+    static bool isHeadless(int argc, char* argv[]);
+
+    /**
+     * @brief Run headless mode
+     *
+     * Creates the QGuiApplication itself.
+     *
+     * @param argc Argument count
+     * @param argv Arguments
+     * @return Process exit code: 0 if every job succeeded
+     */
+    static int run(int argc, char* argv[]);
+
+    /**
+     * @brief Constructor
+     * @param renderer Initialized renderer
+     */
+    explicit BatchRenderer(OffscreenRenderer* renderer);
+
+    /**
+     * @brief Render one job
+     * @param job Job
+     * @param errorMessage Receives the reason on failure (may be nullptr)
+     * @return true if all outputs were written
+     */
+    bool render(const RenderJob& job, QString* errorMessage = nullptr);
+
+    /**
+     * @brief Load the inputs of a job into a layer stack
+     * @param inputs Session or data files
+     * @param layers Receives the layers
+     * @param errorMessage Receives the reason on failure (may be nullptr)
+     * @return true if every input loaded
+     */
+    static bool loadInputs(const QStringList& inputs, LayerManager* layers, QString* errorMessage = nullptr);
+
+    /**
+     * @brief Get the image file name of a frame
+     * @param pattern Output name; a run of '#' is replaced by the zero-padded
+     *        frame number, otherwise "_<frame>" is inserted before the suffix
+     * @param frame Frame number
+     * @param frameCount Number of frames; 1 leaves the name unchanged
+     * @return File name
+     */
+    static QString frameFileName(const QString& pattern, qint64 frame, qint64 frameCount);
+
+private:
+    /**
+     * @brief Start worker processes and wait for them
+     * @param arguments Own arguments without --workers
+     * @param workers Number of workers
+     * @param gpus GPU ids assigned round robin, may be empty
+     * @param verbose true to print a summary
+     * @return 0 if every worker succeeded
+     */
+    static int runWorkers(const QStringList& arguments, int workers, const QStringList& gpus, bool verbose);
+
+private:
+    OffscreenRenderer* m_renderer;
+};
@@ -0,0 +1,313 @@
+#include "ChunkedExecutor.h"
+
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Short last axes are treated as channels and never split
+constexpr qint64 kMaxChannelAxis = 4;
+
+// A worker's remaining block range [begin, end), packed into one word so
+// that the owner and thieves can claim blocks with a single CAS
+quint64 packRange(quint32 begin, quint32 end)
+{
+    return (quint64(begin) << 32) | end;
+}
+
+quint32 rangeBegin(quint64 range)
+{
+    return quint32(range >> 32);
+}
+
+quint32 rangeEnd(quint64 range)
+{
+    return quint32(range);
+}
+
+qint64 rangeSize(quint64 range)
+{
+    return qint64(rangeEnd(range)) - qint64(rangeBegin(range));
+}
+
+} // namespace
+
+BlockGrid::BlockGrid(const QVector<qint64>& shape, const QVector<qint64>& blockShape)
+    : m_shape(shape)
+    , m_blockShape(shape.size(), 1)
+    , m_gridShape(shape.size(), 0)
+    , m_blockCount(shape.isEmpty() ? 0 : 1)
+{
+    for (int axis = 0; axis < shape.size(); ++axis) {
+        const qint64 extent = qMax<qint64>(0, shape[axis]);
+        const qint64 requested = blockShape.value(axis, 0);
+        m_blockShape[axis] = requested > 0 ? qMin(requested, qMax<qint64>(1, extent)) : qMax<qint64>(1, extent);
+        m_gridShape[axis] = (extent + m_blockShape[axis] - 1) / m_blockShape[axis];
+        m_blockCount *= m_gridShape[axis];
+    }
+}
+
+QVector<qint64> BlockGrid::defaultBlockShape(const QVector<qint64>& shape, qint64 elementTarget)
+{
+    QVector<qint64> blockShape = shape;
+    int spatialAxes = shape.size();
+    qint64 target = qMax<qint64>(1, elementTarget);
+
+    if (shape.size() > 1 && shape.last() <= kMaxChannelAxis) {
+        --spatialAxes;
+        target = qMax<qint64>(1, target / qMax<qint64>(1, shape.last()));
+    }
+    if (spatialAxes == 0) {
+        return blockShape;
+    }
+
+    // Equal edges first; axes shorter than the edge give their share to the others
+    const qint64 edge = qMax<qint64>(1, qRound64(std::pow(double(target), 1.0 / spatialAxes)));
+    qint64 elements = 1;
+    for (int axis = 0; axis < spatialAxes; ++axis) {
+        blockShape[axis] = qMax<qint64>(1, qMin(shape[axis], edge));
+        elements *= blockShape[axis];
+    }
+    for (int axis = spatialAxes - 1; axis >= 0 && elements < target; --axis) {
+        const qint64 others = elements / blockShape[axis];
+        const qint64 grown = qMax<qint64>(1, qMin(shape[axis], target / others));
+        if (grown > blockShape[axis]) {
+            elements = others * grown;
+            blockShape[axis] = grown;
+        }
+    }
+    return blockShape;
+}
+
+void BlockGrid::block(qint64 index, QVector<qint64>* start, QVector<qint64>* extent) const
+{
+    const int dims = m_shape.size();
+    start->resize(dims);
+    extent->resize(dims);
+
+    for (int axis = dims - 1; axis >= 0; --axis) {
+        const qint64 cell = index % m_gridShape[axis];
+        index /= m_gridShape[axis];
+        (*start)[axis] = cell * m_blockShape[axis];
+        (*extent)[axis] = qMin(m_blockShape[axis], m_shape[axis] - (*start)[axis]);
+    }
+}
+
+/**
+ * @brief Shared state of one run; outlives the executor while workers run
+ */
+struct ChunkedExecutor::State
+{
+    explicit State(int workers)
+        : workerCount(workers)
+        , ranges(new std::atomic<quint64>[size_t(workers)])
+    {
+    }
+
+    BlockFunction function;
+    ProgressCallback progressCallback;
+    FinishedCallback finishedCallback;
+
+    const int workerCount;
+    std::unique_ptr<std::atomic<quint64>[]> ranges;
+
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> failed{false};
+    std::atomic<qint64> completed{0};
+    std::atomic<int> running{0};
+
+    QMutex mutex;
+    QWaitCondition finishedCondition;
+    bool finished = false;
+
+    /**
+     * @brief Claim the next block of a worker's own range
+     */
+    bool take(int worker, quint32* index)
+    {
+        std::atomic<quint64>& range = ranges[worker];
+        quint64 current = range.load(std::memory_order_acquire);
+        while (rangeSize(current) > 0) {
+            if (range.compare_exchange_weak(current, packRange(rangeBegin(current) + 1, rangeEnd(current)),
+                                            std::memory_order_acq_rel)) {
+                *index = rangeBegin(current);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Move the back half of the largest other range to a worker
+     */
+    bool steal(int worker, quint32* index)
+    {
+        for (;;) {
+            int victim = -1;
+            quint64 victimRange = 0;
+            for (int i = 1; i < workerCount; ++i) {
+                const int candidate = (worker + i) % workerCount;
+                const quint64 range = ranges[candidate].load(std::memory_order_acquire);
+                if (rangeSize(range) > rangeSize(victimRange)) {
+                    victim = candidate;
+                    victimRange = range;
+                }
+            }
+            if (victim < 0) {
+                return false;
+            }
+
+            const quint32 end = rangeEnd(victimRange);
+            const quint32 split = end - quint32((rangeSize(victimRange) + 1) / 2);
+            if (ranges[victim].compare_exchange_strong(victimRange, packRange(rangeBegin(victimRange), split),
+                                                       std::memory_order_acq_rel)) {
+                // Only the owner refills its empty range, so a plain store is safe
+                ranges[worker].store(packRange(split + 1, end), std::memory_order_release);
+                *index = split;
+                return true;
+            }
+            if (cancelled.load(std::memory_order_acquire)) {
+                return false;
+            }
+        }
+    }
+
+    void run(int worker)
+    {
+        quint32 index = 0;
+        while (!cancelled.load(std::memory_order_acquire) && (take(worker, &index) || steal(worker, &index))) {
+            if (!function(qint64(index))) {
+                failed.store(true, std::memory_order_release);
+                cancelled.store(true, std::memory_order_release);
+                break;
+            }
+
+            const qint64 done = completed.fetch_add(1, std::memory_order_acq_rel) + 1;
+            if (progressCallback) {
+                progressCallback(done);
+            }
+        }
+
+        if (running.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (finishedCallback) {
+                finishedCallback();
+            }
+            QMutexLocker locker(&mutex);
+            finished = true;
+            finishedCondition.wakeAll();
+        }
+    }
+};
+
+/**
+ * @brief Pool task running one worker of a ChunkedExecutor
+ */
+class ChunkedWorker : public QRunnable
+{
+public:
+    ChunkedWorker(const std::shared_ptr<ChunkedExecutor::State>& state, int worker)
+        : m_state(state), m_worker(worker) {}
+
+    void run() override
+    {
+        m_state->run(m_worker);
+    }
+
+private:
+    std::shared_ptr<ChunkedExecutor::State> m_state;
+    int m_worker;
+};
+
+ChunkedExecutor::ChunkedExecutor(QThreadPool* pool)
+    : m_pool(pool ? pool : QThreadPool::globalInstance())
+    , m_blockCount(0)
+{
+}
+
+ChunkedExecutor::~ChunkedExecutor()
+{
+    cancel();
+    wait();
+}
+
+bool ChunkedExecutor::start(qint64 blockCount, BlockFunction function, int maxWorkers)
+{
+    if (m_state) {
+        qWarning() << "ChunkedExecutor: already started";
+        return false;
+    }
+    if (blockCount < 0 || blockCount > qint64(std::numeric_limits<quint32>::max())) {
+        qWarning() << "ChunkedExecutor: invalid block count" << blockCount;
+        return false;
+    }
+
+    int workers = maxWorkers > 0 ? maxWorkers : m_pool->maxThreadCount();
+    workers = int(qBound<qint64>(1, qMin<qint64>(workers, blockCount), 1024));
+
+    m_blockCount = blockCount;
+    m_state = std::make_shared<State>(workers);
+    m_state->function = std::move(function);
+    m_state->progressCallback = m_progressCallback;
+    m_state->finishedCallback = m_finishedCallback;
+
+    // Contiguous initial ranges keep each worker on neighbouring blocks
+    for (int worker = 0; worker < workers; ++worker) {
+        const quint32 begin = quint32(blockCount * worker / workers);
+        const quint32 end = quint32(blockCount * (worker + 1) / workers);
+        m_state->ranges[worker].store(packRange(begin, end), std::memory_order_relaxed);
+    }
+    m_state->running.store(workers, std::memory_order_release);
+
+    for (int worker = 0; worker < workers; ++worker) {
+        m_pool->start(new ChunkedWorker(m_state, worker));
+    }
+    return true;
+}
+
+void ChunkedExecutor::cancel()
+{
+    if (m_state) {
+        m_state->cancelled.store(true, std::memory_order_release);
+    }
+}
+
+bool ChunkedExecutor::isCancelled() const
+{
+    return m_state && m_state->cancelled.load(std::memory_order_acquire);
+}
+
+bool ChunkedExecutor::hasFailed() const
+{
+    return m_state && m_state->failed.load(std::memory_order_acquire);
+}
+
+bool ChunkedExecutor::isFinished() const
+{
+    if (!m_state) {
+        return true;
+    }
+    QMutexLocker locker(&m_state->mutex);
+    return m_state->finished;
+}
+
+qint64 ChunkedExecutor::completedCount() const
+{
+    return m_state ? m_state->completed.load(std::memory_order_acquire) : 0;
+}
+
+void ChunkedExecutor::wait()
+{
+    if (!m_state) {
+        return;
+    }
+    QMutexLocker locker(&m_state->mutex);
+    while (!m_state->finished) {
+        m_state->finishedCondition.wait(&m_state->mutex);
+    }
+}
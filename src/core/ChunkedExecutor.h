@@ -0,0 +1,207 @@
+#pragma once
+
+#include <QVector>
+#include <QtGlobal>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class QThreadPool;
+
+/**
+ * @brief Decomposition of an N-D array into rectangular blocks
+ *
+ * Blocks are numbered in row-major order of the block grid, so
+ * consecutive indices are neighbours in memory. Edge blocks are clipped
+ * to the array.
+ */
+class BlockGrid
+{
+public:
+    // Elements per block aimed for by defaultBlockShape()
+    static constexpr qint64 kDefaultBlockElements = 256 * 256;
+
+    /**
+     * @brief Constructor
+     * @param shape Array shape
+     * @param blockShape Block extent per axis; values <= 0 take the whole axis
+     */
+    BlockGrid(const QVector<qint64>& shape, const QVector<qint64>& blockShape);
+
+    /**
+     * @brief Pick a roughly cubic block shape
+     *
+     * Spatial axes get equal edges so that blocks hold about
+     * elementTarget elements. A short last axis (up to 4 elements, e.g.
+     * colour channels) is never split.
+     *
+     * @param shape Array shape
+     * @param elementTarget Elements per block
+     * @return Block extent per axis
+     */
+    static QVector<qint64> defaultBlockShape(const QVector<qint64>& shape,
+                                             qint64 elementTarget = kDefaultBlockElements);
+
+    /**
+     * @brief Get array shape
+     * @return Shape
+     */
+    const QVector<qint64>& shape() const { return m_shape; }
+
+    /**
+     * @brief Get block extent of interior blocks
+     * @return Extent per axis
+     */
+    const QVector<qint64>& blockShape() const { return m_blockShape; }
+
+    /**
+     * @brief Get number of blocks
+     * @return Block count (0 for an empty array)
+     */
+    qint64 blockCount() const { return m_blockCount; }
+
+    /**
+     * @brief Get the region covered by a block
+     * @param index Block index in [0, blockCount())
+     * @param start Receives the start index per axis
+     * @param extent Receives the extent per axis
+     */
+    void block(qint64 index, QVector<qint64>* start, QVector<qint64>* extent) const;
+
+private:
+    QVector<qint64> m_shape;
+    QVector<qint64> m_blockShape;
+    QVector<qint64> m_gridShape;
+    qint64 m_blockCount;
+};
+
+/**
+ * @brief Runs a function over numbered blocks on a thread pool
+ *
+ * Every worker starts with a contiguous range of block indices and takes
+ * blocks from its front. A worker that runs out steals the back half of
+ * the largest remaining range of another worker, so uneven block costs
+ * (empty tiles, early-out filters) do not leave threads idle, and each
+ * worker still walks neighbouring blocks. Ranges are claimed with
+ * compare-and-swap; no lock is taken per block.
+ *
+ * The block function runs on pool threads and must be reentrant. It
+ * should return early once isCancelled() is true. Callbacks run on the
+ * worker thread that triggered them.
+ */
+class ChunkedExecutor
+{
+public:
+    /**
+     * @brief Function processing one block
+     *
+     * Returning false fails the run: no further blocks are started.
+     */
+    using BlockFunction = std::function<bool(qint64 index)>;
+
+    /**
+     * @brief Progress callback with the number of completed blocks
+     */
+    using ProgressCallback = std::function<void(qint64 completed)>;
+
+    /**
+     * @brief Callback invoked once after the last worker stopped
+     */
+    using FinishedCallback = std::function<void()>;
+
+    /**
+     * @brief Constructor
+     * @param pool Thread pool running the workers (nullptr uses the global pool)
+     */
+    explicit ChunkedExecutor(QThreadPool* pool);
+
+    /**
+     * @brief Destructor; cancels the run and waits for the workers
+     */
+    ~ChunkedExecutor();
+
+    /**
+     * @brief Set progress callback
+     *
+     * Must be set before start().
+     *
+     * @param callback Callback
+     */
+    void setProgressCallback(ProgressCallback callback) { m_progressCallback = std::move(callback); }
+
+    /**
+     * @brief Set finished callback
+     *
+     * Must be set before start(). Also invoked for cancelled and failed
+     * runs.
+     *
+     * @param callback Callback
+     */
+    void setFinishedCallback(FinishedCallback callback) { m_finishedCallback = std::move(callback); }
+
+    /**
+     * @brief Start processing blocks; returns immediately
+     *
+     * An executor runs once; later calls return false.
+     *
+     * @param blockCount Number of blocks
+     * @param function Block function
+     * @param maxWorkers Worker limit (0 uses the pool's thread count)
+     * @return false if already started or blockCount is out of range
+     */
+    bool start(qint64 blockCount, BlockFunction function, int maxWorkers = 0);
+
+    /**
+     * @brief Request cancellation; blocks already running complete
+     */
+    void cancel();
+
+    /**
+     * @brief Check if cancellation was requested or a block failed
+     *
+     * Thread-safe; block functions poll this.
+     *
+     * @return true if the run should stop
+     */
+    bool isCancelled() const;
+
+    /**
+     * @brief Check if a block function returned false
+     * @return true if failed
+     */
+    bool hasFailed() const;
+
+    /**
+     * @brief Check if all workers stopped
+     * @return true if finished (or never started)
+     */
+    bool isFinished() const;
+
+    /**
+     * @brief Get number of completed blocks
+     * @return Completed block count
+     */
+    qint64 completedCount() const;
+
+    /**
+     * @brief Get number of blocks
+     * @return Block count passed to start()
+     */
+    qint64 blockCount() const { return m_blockCount; }
+
+    /**
+     * @brief Block until all workers stopped
+     */
+    void wait();
+
+private:
+    Q_DISABLE_COPY(ChunkedExecutor)
+    friend class ChunkedWorker;
+    struct State;
+
+    QThreadPool* m_pool;
+    std::shared_ptr<State> m_state;
+    ProgressCallback m_progressCallback;
+    FinishedCallback m_finishedCallback;
+    qint64 m_blockCount;
+};
@@ -0,0 +1,348 @@
+#include "CommandHistory.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QStandardPaths>
+#include <QTemporaryFile>
+#include <QUndoStack>
+#include <algorithm>
+
+namespace {
+
+// Spilled buffers up to this size are compressed
+const qint64 kMaxCompressedSpill = 16ll * 1024 * 1024;
+
+// Spill I/O is done in pieces of this size
+const qint64 kIoBlockSize = 64ll * 1024 * 1024;
+
+// Released bytes below this size are not worth a compaction
+const qint64 kMinCompactBytes = 64ll * 1024 * 1024;
+
+void collectCommands(const QUndoCommand* command, QVector<HistoryCommand*>* result)
+{
+    if (const HistoryCommand* history = dynamic_cast<const HistoryCommand*>(command)) {
+        result->append(const_cast<HistoryCommand*>(history));
+    }
+    for (int i = 0; i < command->childCount(); ++i) {
+        collectCommands(command->child(i), result);
+    }
+}
+
+} // namespace
+
+// HistorySpillFile implementation
+HistorySpillFile::HistorySpillFile(const QString& directory)
+    : m_directory(directory)
+    , m_nextId(1)
+    , m_liveBytes(0)
+    , m_diskLimit(kDefaultDiskLimit)
+    , m_diskLimitWarned(false)
+{
+}
+
+HistorySpillFile::~HistorySpillFile() = default;
+
+std::unique_ptr<QTemporaryFile> HistorySpillFile::createFile() const
+{
+    QDir().mkpath(m_directory);
+    auto file = std::make_unique<QTemporaryFile>(QDir(m_directory).filePath("history-XXXXXX.spill"));
+    if (!file->open()) {
+        qWarning() << "CommandHistory: cannot create spill file in" << m_directory << file->errorString();
+        return nullptr;
+    }
+    return file;
+}
+
+HistorySpillFile::Record HistorySpillFile::write(const DataBuffer& buffer)
+{
+    Record record;
+    if (buffer.isNull()) {
+        return record;
+    }
+
+    if (!m_file) {
+        m_file = createFile();
+        if (!m_file) {
+            return record;
+        }
+    }
+
+    const DataBuffer contiguous = buffer.isContiguous() ? buffer : buffer.copy();
+    const char* data = reinterpret_cast<const char*>(contiguous.constData());
+    qint64 size = contiguous.byteSize();
+
+    Entry entry;
+    QByteArray packed;
+    if (size <= kMaxCompressedSpill) {
+        packed = qCompress(reinterpret_cast<const uchar*>(data), int(size), 1);
+        if (packed.size() < size) {
+            data = packed.constData();
+            size = packed.size();
+            entry.compressed = true;
+        }
+    }
+
+    if (m_liveBytes + size > m_diskLimit) {
+        if (!m_diskLimitWarned) {
+            qWarning() << "CommandHistory: spill file limit of" << m_diskLimit << "bytes reached";
+            m_diskLimitWarned = true;
+        }
+        return record;
+    }
+
+    const qint64 offset = m_file->size();
+    if (!m_file->seek(offset)) {
+        return record;
+    }
+    for (qint64 done = 0; done < size;) {
+        const qint64 written = m_file->write(data + done, qMin(size - done, kIoBlockSize));
+        if (written <= 0) {
+            qWarning() << "CommandHistory: cannot write spill file" << m_file->errorString();
+            // Drop the partial write so it is not counted as dead space
+            m_file->resize(offset);
+            return record;
+        }
+        done += written;
+    }
+
+    entry.offset = offset;
+    entry.storedSize = size;
+    record.id = m_nextId++;
+    m_entries.insert(record.id, entry);
+    m_liveBytes += size;
+    return record;
+}
+
+DataBuffer HistorySpillFile::read(const Record& record, DataType type, const QVector<qint64>& shape)
+{
+    const auto it = m_entries.constFind(record.id);
+    if (!m_file || it == m_entries.constEnd() || !m_file->seek(it->offset)) {
+        return DataBuffer();
+    }
+    const Entry entry = *it;
+
+    DataBuffer buffer(type, shape);
+    if (entry.compressed) {
+        const QByteArray data = qUncompress(m_file->read(entry.storedSize));
+        if (data.size() != buffer.byteSize()) {
+            return DataBuffer();
+        }
+        std::copy(data.constBegin(), data.constEnd(), reinterpret_cast<char*>(buffer.data()));
+        return buffer;
+    }
+
+    if (entry.storedSize != buffer.byteSize()) {
+        return DataBuffer();
+    }
+    char* data = reinterpret_cast<char*>(buffer.data());
+    for (qint64 done = 0; done < entry.storedSize;) {
+        const qint64 read = m_file->read(data + done, qMin(entry.storedSize - done, kIoBlockSize));
+        if (read <= 0) {
+            qWarning() << "CommandHistory: cannot read spill file" << m_file->errorString();
+            return DataBuffer();
+        }
+        done += read;
+    }
+    return buffer;
+}
+
+void HistorySpillFile::release(Record& record)
+{
+    const auto it = m_entries.find(record.id);
+    record = Record();
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    m_liveBytes -= it->storedSize;
+    m_entries.erase(it);
+    m_diskLimitWarned = false;
+
+    if (m_entries.isEmpty()) {
+        // Nothing left to keep; start over at the beginning of the file
+        if (m_file) {
+            m_file->resize(0);
+        }
+        m_liveBytes = 0;
+        return;
+    }
+
+    const qint64 dead = size() - m_liveBytes;
+    if (dead > kMinCompactBytes && dead > size() / 2) {
+        compact();
+    }
+}
+
+bool HistorySpillFile::compact()
+{
+    std::unique_ptr<QTemporaryFile> file = createFile();
+    if (!file) {
+        return false;
+    }
+
+    // Copy in file order, so the old file is read sequentially
+    QVector<quint64> ids = m_entries.keys().toVector();
+    std::sort(ids.begin(), ids.end(), [this](quint64 a, quint64 b) {
+        return m_entries.value(a).offset < m_entries.value(b).offset;
+    });
+
+    QHash<quint64, Entry> entries;
+    entries.reserve(m_entries.size());
+    QByteArray block;
+    for (quint64 id : qAsConst(ids)) {
+        Entry entry = m_entries.value(id);
+        if (!m_file->seek(entry.offset)) {
+            return false;
+        }
+        const qint64 offset = file->size();
+        for (qint64 done = 0; done < entry.storedSize;) {
+            block = m_file->read(qMin(entry.storedSize - done, kIoBlockSize));
+            if (block.isEmpty() || file->write(block) != block.size()) {
+                qWarning() << "CommandHistory: cannot compact spill file" << file->errorString();
+                return false;
+            }
+            done += block.size();
+        }
+        entry.offset = offset;
+        entries.insert(id, entry);
+    }
+
+    m_file = std::move(file);
+    m_entries = std::move(entries);
+    return true;
+}
+
+qint64 HistorySpillFile::size() const
+{
+    return m_file ? m_file->size() : 0;
+}
+
+void HistorySpillFile::clear()
+{
+    m_file.reset();
+    m_entries.clear();
+    m_liveBytes = 0;
+    m_diskLimitWarned = false;
+}
+
+// CommandHistory implementation
+CommandHistory::CommandHistory(QObject* parent)
+    : QObject(parent)
+    , m_spillFile(std::make_unique<HistorySpillFile>(
+          QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("history")))
+    , m_stack(std::make_unique<QUndoStack>())
+    , m_memoryLimit(kDefaultMemoryLimit)
+    , m_memoryUsage(0)
+{
+    connect(m_stack.get(), &QUndoStack::indexChanged, this, &CommandHistory::onIndexChanged);
+}
+
+CommandHistory::~CommandHistory()
+{
+    // Commands may read the spill file while they are deleted
+    m_stack.reset();
+}
+
+void CommandHistory::push(QUndoCommand* command)
+{
+    if (!command) {
+        return;
+    }
+    m_stack->push(command);
+    enforceMemoryLimit();
+}
+
+void CommandHistory::beginMacro(const QString& text)
+{
+    m_stack->beginMacro(text);
+}
+
+void CommandHistory::endMacro()
+{
+    m_stack->endMacro();
+    enforceMemoryLimit();
+}
+
+void CommandHistory::clear()
+{
+    m_stack->clear();
+    m_spillFile->clear();
+    enforceMemoryLimit();
+}
+
+void CommandHistory::setMemoryLimit(qint64 bytes)
+{
+    m_memoryLimit = qMax<qint64>(0, bytes);
+    enforceMemoryLimit();
+}
+
+qint64 CommandHistory::spilledBytes() const
+{
+    return m_spillFile->size();
+}
+
+void CommandHistory::setDiskLimit(qint64 bytes)
+{
+    m_spillFile->setDiskLimit(bytes);
+}
+
+void CommandHistory::setSpillDirectory(const QString& directory)
+{
+    m_stack->clear();
+    const qint64 diskLimit = m_spillFile->diskLimit();
+    m_spillFile = std::make_unique<HistorySpillFile>(directory);
+    m_spillFile->setDiskLimit(diskLimit);
+    enforceMemoryLimit();
+}
+
+void CommandHistory::onIndexChanged()
+{
+    // Undo and redo read spilled payloads back into memory
+    enforceMemoryLimit();
+}
+
+void CommandHistory::enforceMemoryLimit()
+{
+    // Commands ordered from the furthest to the nearest to the current index
+    struct Candidate
+    {
+        int distance;
+        HistoryCommand* command;
+    };
+
+    QVector<Candidate> candidates;
+    qint64 usage = 0;
+    const int index = m_stack->index();
+    QVector<HistoryCommand*> commands;
+    for (int i = 0; i < m_stack->count(); ++i) {
+        commands.clear();
+        collectCommands(m_stack->command(i), &commands);
+        const int distance = i < index ? index - 1 - i : i - index;
+        for (HistoryCommand* command : qAsConst(commands)) {
+            const qint64 cost = command->memoryCost();
+            if (cost > 0) {
+                usage += cost;
+                candidates.append(Candidate{distance, command});
+            }
+        }
+    }
+
+    if (usage > m_memoryLimit) {
+        std::stable_sort(candidates.begin(), candidates.end(),
+                         [](const Candidate& a, const Candidate& b) { return a.distance > b.distance; });
+        for (const Candidate& candidate : qAsConst(candidates)) {
+            if (usage <= m_memoryLimit) {
+                break;
+            }
+            const qint64 before = candidate.command->memoryCost();
+            if (candidate.command->spill(m_spillFile.get())) {
+                usage -= before - candidate.command->memoryCost();
+            }
+        }
+    }
+
+    if (usage != m_memoryUsage) {
+        m_memoryUsage = usage;
+        emit memoryUsageChanged(usage);
+    }
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include "DataBuffer.h"
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QUndoCommand>
+#include <memory>
+
+class QTemporaryFile;
+class QUndoStack;
+
+/**
+ * @brief Scratch file for history payloads
+ *
+ * Buffers moved out of memory by the history are appended here, small
+ * ones zlib-compressed, and read back when their command is undone or
+ * redone. Commands release their records when they are deleted; once
+ * the released bytes are both large and the bigger part of the file, the
+ * live records are copied into a fresh file. The live total is capped by
+ * diskLimit(); writes beyond it fail and the payload stays in memory.
+ */
+class HistorySpillFile
+{
+public:
+    /**
+     * @brief Location of a spilled buffer
+     */
+    struct Record
+    {
+        quint64 id = 0;             ///< Record ID, 0 if not spilled
+
+        bool isValid() const { return id != 0; }
+    };
+
+    // Live bytes allowed by default
+    static constexpr qint64 kDefaultDiskLimit = 4096ll * 1024 * 1024;
+
+    /**
+     * @brief Constructor
+     * @param directory Directory for the file, created on first use
+     */
+    explicit HistorySpillFile(const QString& directory);
+
+    /**
+     * @brief Destructor; removes the file
+     */
+    ~HistorySpillFile();
+
+    HistorySpillFile(const HistorySpillFile&) = delete;
+    HistorySpillFile& operator=(const HistorySpillFile&) = delete;
+
+    /**
+     * @brief Write a buffer's elements in C order
+     * @param buffer Buffer
+     * @return Record, invalid on failure
+     */
+    Record write(const DataBuffer& buffer);
+
+    /**
+     * @brief Read a buffer back
+     * @param record Record returned by write()
+     * @param type Element type of the buffer
+     * @param shape Shape of the buffer
+     * @return Contiguous buffer, null on failure
+     */
+    DataBuffer read(const Record& record, DataType type, const QVector<qint64>& shape);
+
+    /**
+     * @brief Give up a record
+     *
+     * May compact the file. Invalid records are ignored.
+     *
+     * @param record Record; reset to invalid
+     */
+    void release(Record& record);
+
+    /**
+     * @brief Get size of the file on disk
+     * @return File size, including released records not yet reclaimed
+     */
+    qint64 size() const;
+
+    /**
+     * @brief Get bytes held by live records
+     * @return Live bytes
+     */
+    qint64 liveSize() const { return m_liveBytes; }
+
+    /**
+     * @brief Set the cap on live bytes
+     * @param bytes Limit in bytes
+     */
+    void setDiskLimit(qint64 bytes) { m_diskLimit = qMax<qint64>(0, bytes); }
+
+    /**
+     * @brief Get the cap on live bytes
+     * @return Limit in bytes
+     */
+    qint64 diskLimit() const { return m_diskLimit; }
+
+    /**
+     * @brief Discard all records
+     */
+    void clear();
+
+private:
+    /**
+     * @brief Location of a live record
+     */
+    struct Entry
+    {
+        qint64 offset = 0;          ///< Offset in the file
+        qint64 storedSize = 0;      ///< Bytes in the file
+        bool compressed = false;    ///< true if zlib-compressed
+    };
+
+    /**
+     * @brief Open a new temporary file in the directory
+     * @return File, null on failure
+     */
+    std::unique_ptr<QTemporaryFile> createFile() const;
+
+    /**
+     * @brief Copy the live records into a new file and drop the old one
+     * @return true if compacted
+     */
+    bool compact();
+
+private:
+    QString m_directory;
+    std::unique_ptr<QTemporaryFile> m_file;
+    QHash<quint64, Entry> m_entries;
+    quint64 m_nextId;
+    qint64 m_liveBytes;
+    qint64 m_diskLimit;
+    bool m_diskLimitWarned;
+};
+
+/**
+ * @brief Undo command whose payload counts against the history memory limit
+ *
+ * Commands report the memory they hold in copies of layer data. When the
+ * history is over its limit it asks the commands furthest from the
+ * current state to spill their payload; a spilled command reads it back
+ * the next time it is undone or redone.
+ */
+class HistoryCommand : public QUndoCommand
+{
+public:
+    /**
+     * @brief Constructor
+     * @param text Command text shown in undo actions
+     * @param parent Parent command
+     */
+    explicit HistoryCommand(const QString& text, QUndoCommand* parent = nullptr)
+        : QUndoCommand(text, parent) {}
+
+    /**
+     * @brief Get memory held by the command
+     * @return Bytes of payload resident in memory
+     */
+    virtual qint64 memoryCost() const { return 0; }
+
+    /**
+     * @brief Move the payload to disk
+     * @param file Spill file; outlives the command
+     * @return true if memory was released
+     */
+    virtual bool spill(HistorySpillFile* file) { Q_UNUSED(file) return false; }
+};
+
+/**
+ * @brief Undo/redo history of layer edits
+ *
+ * Wraps a QUndoStack and keeps the memory held by its commands under a
+ * limit: after every change the payloads of the commands furthest from
+ * the current index are spilled to a scratch file until the resident
+ * total fits. Commands that do not derive from HistoryCommand cost
+ * nothing.
+ */
+class CommandHistory : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Resident payload allowed by default
+    static constexpr qint64 kDefaultMemoryLimit = 256ll * 1024 * 1024;
+
+    /**
+     * @brief Constructor
+     * @param parent Parent object
+     */
+    explicit CommandHistory(QObject* parent = nullptr);
+
+    /**
+     * @brief Destructor
+     */
+    ~CommandHistory();
+
+    /**
+     * @brief Get the undo stack, e.g. to create undo actions
+     * @return Undo stack
+     */
+    QUndoStack* undoStack() const { return m_stack.get(); }
+
+    /**
+     * @brief Run a command and add it to the history
+     * @param command Command; ownership is taken (nullptr is ignored)
+     */
+    void push(QUndoCommand* command);
+
+    /**
+     * @brief Start a group of commands undone as one
+     * @param text Group text
+     */
+    void beginMacro(const QString& text);
+
+    /**
+     * @brief End a group started with beginMacro()
+     */
+    void endMacro();
+
+    /**
+     * @brief Remove all commands
+     */
+    void clear();
+
+    /**
+     * @brief Set the resident memory limit
+     * @param bytes Limit in bytes
+     */
+    void setMemoryLimit(qint64 bytes);
+
+    /**
+     * @brief Get the resident memory limit
+     * @return Limit in bytes
+     */
+    qint64 memoryLimit() const { return m_memoryLimit; }
+
+    /**
+     * @brief Get memory held by commands
+     * @return Resident payload in bytes
+     */
+    qint64 memoryUsage() const { return m_memoryUsage; }
+
+    /**
+     * @brief Get bytes spilled to disk
+     * @return Spill file size
+     */
+    qint64 spilledBytes() const;
+
+    /**
+     * @brief Set the cap on spilled payload
+     *
+     * Payloads that would exceed it stay in memory.
+     *
+     * @param bytes Limit in bytes
+     */
+    void setDiskLimit(qint64 bytes);
+
+    /**
+     * @brief Get the cap on spilled payload
+     * @return Limit in bytes
+     */
+    qint64 diskLimit() const { return m_spillFile->diskLimit(); }
+
+    /**
+     * @brief Set the directory of the spill file
+     *
+     * Takes effect for a new history; changing it discards spilled data,
+     * so it also clears the history. The disk limit is kept.
+     *
+     * @param directory Directory
+     */
+    void setSpillDirectory(const QString& directory);
+
+signals:
+    /**
+     * @brief Emitted when the resident memory changes
+     * @param bytes Resident payload in bytes
+     */
+    void memoryUsageChanged(qint64 bytes);
+
+private slots:
+    /**
+     * @brief Re-check the limit after undo or redo
+     */
+    void onIndexChanged();
+
+private:
+    /**
+     * @brief Spill payloads until the resident total fits the limit
+     */
+    void enforceMemoryLimit();
+
+private:
+    // The spill file outlives the stack, whose commands refer to it
+    std::unique_ptr<HistorySpillFile> m_spillFile;
+    std::unique_ptr<QUndoStack> m_stack;
+    qint64 m_memoryLimit;
+    qint64 m_memoryUsage;
+};
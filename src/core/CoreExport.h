@@ -0,0 +1,15 @@
+#pragma once
+
+#include <QtGlobal>
+
+/**
+ * @brief Marks framework symbols that plugins resolve against the application
+ *
+ * The framework is linked into the executable, which exports its symbols
+ * (ENABLE_EXPORTS); plugin modules import them.
+ */
+#if defined(TGUI_CORE_LIBRARY)
+#  define TGUI_CORE_EXPORT Q_DECL_EXPORT
+#else
+#  define TGUI_CORE_EXPORT Q_DECL_IMPORT
+#endif
@@ -0,0 +1,361 @@
+#include "DataBuffer.h"
+
+#include <QDebug>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+
+namespace {
+
+template<typename Out, typename In>
+void convertRange(const In* in, Out* out, qint64 count)
+{
+    for (qint64 i = 0; i < count; ++i) {
+        out[i] = static_cast<Out>(in[i]);
+    }
+}
+
+template<typename In>
+void convertElements(const In* in, DataType type, uchar* out, qint64 count)
+{
+    switch (type) {
+    case DataType::UInt8:   convertRange(in, reinterpret_cast<quint8*>(out), count); break;
+    case DataType::UInt16:  convertRange(in, reinterpret_cast<quint16*>(out), count); break;
+    case DataType::UInt32:  convertRange(in, reinterpret_cast<quint32*>(out), count); break;
+    case DataType::Int8:    convertRange(in, reinterpret_cast<qint8*>(out), count); break;
+    case DataType::Int16:   convertRange(in, reinterpret_cast<qint16*>(out), count); break;
+    case DataType::Int32:   convertRange(in, reinterpret_cast<qint32*>(out), count); break;
+    case DataType::Float32: convertRange(in, reinterpret_cast<float*>(out), count); break;
+    case DataType::Float64: convertRange(in, reinterpret_cast<double*>(out), count); break;
+    default:                break;
+    }
+}
+
+// a * b for non-negative factors; false on overflow
+bool checkedMultiply(qint64 a, qint64 b, qint64* result)
+{
+    if (a < 0 || b < 0 || (a != 0 && b > std::numeric_limits<qint64>::max() / a)) {
+        return false;
+    }
+    *result = a * b;
+    return true;
+}
+
+bool checkedAdd(qint64 a, qint64 b, qint64* result)
+{
+    if ((b > 0 && a > std::numeric_limits<qint64>::max() - b)
+        || (b < 0 && a < std::numeric_limits<qint64>::min() - b)) {
+        return false;
+    }
+    *result = a + b;
+    return true;
+}
+
+} // namespace
+
+int dataTypeSize(DataType type)
+{
+    switch (type) {
+    case DataType::UInt8:
+    case DataType::Int8:    return 1;
+    case DataType::UInt16:
+    case DataType::Int16:   return 2;
+    case DataType::UInt32:
+    case DataType::Int32:
+    case DataType::Float32: return 4;
+    case DataType::Float64: return 8;
+    default:                return 0;
+    }
+}
+
+QString dataTypeName(DataType type)
+{
+    switch (type) {
+    case DataType::UInt8:   return "uint8";
+    case DataType::UInt16:  return "uint16";
+    case DataType::UInt32:  return "uint32";
+    case DataType::Int8:    return "int8";
+    case DataType::Int16:   return "int16";
+    case DataType::Int32:   return "int32";
+    case DataType::Float32: return "float32";
+    case DataType::Float64: return "float64";
+    default:                return "unknown";
+    }
+}
+
+DataType dataTypeFromName(const QString& name)
+{
+    static const DataType types[] = {
+        DataType::UInt8, DataType::UInt16, DataType::UInt32,
+        DataType::Int8, DataType::Int16, DataType::Int32,
+        DataType::Float32, DataType::Float64
+    };
+
+    for (DataType type : types) {
+        if (dataTypeName(type) == name) {
+            return type;
+        }
+    }
+    return DataType::Unknown;
+}
+
+// HeapStorage implementation
+HeapStorage::HeapStorage(qint64 size)
+    : m_data(nullptr)
+    , m_size(qMax<qint64>(0, size))
+{
+    // calloc lets the OS hand out lazily zeroed pages for large buffers
+    m_data = static_cast<uchar*>(std::calloc(size_t(qMax<qint64>(1, m_size)), 1));
+    if (!m_data) {
+        throw std::bad_alloc();
+    }
+}
+
+HeapStorage::~HeapStorage()
+{
+    std::free(m_data);
+}
+
+// DataBuffer implementation
+DataBuffer::DataBuffer()
+    : m_type(DataType::Unknown)
+    , m_offset(0)
+{
+}
+
+DataBuffer::DataBuffer(DataType type, const QVector<qint64>& shape)
+    : m_type(type)
+    , m_shape(shape)
+    , m_strides(contiguousStrides(type, shape))
+    , m_offset(0)
+{
+    qint64 bytes = 0;
+    if (!checkedByteSize(type, shape, &bytes)) {
+        throw std::bad_alloc();
+    }
+    m_storage = std::make_shared<HeapStorage>(bytes);
+}
+
+DataBuffer::DataBuffer(DataType type, const QVector<qint64>& shape, const QVector<qint64>& strides,
+                       std::shared_ptr<BufferStorage> storage, qint64 offset)
+    : m_type(type)
+    , m_shape(shape)
+    , m_strides(strides)
+    , m_storage(std::move(storage))
+    , m_offset(offset)
+{
+    if (m_strides.size() != m_shape.size()) {
+        m_strides = contiguousStrides(type, shape);
+    }
+
+    // A view reaching outside its storage would read arbitrary memory
+    if (m_storage && !fitsStorage(m_type, m_shape, m_strides, m_offset, m_storage->size())) {
+        qWarning() << "DataBuffer: view of shape" << m_shape << "at offset" << m_offset
+                   << "does not fit storage of" << m_storage->size() << "bytes";
+        m_storage.reset();
+        m_shape.clear();
+        m_strides.clear();
+        m_offset = 0;
+    }
+}
+
+QVector<qint64> DataBuffer::contiguousStrides(DataType type, const QVector<qint64>& shape)
+{
+    QVector<qint64> strides(shape.size());
+    qint64 stride = dataTypeSize(type);
+    for (int axis = shape.size() - 1; axis >= 0; --axis) {
+        strides[axis] = stride;
+        stride *= shape[axis];
+    }
+    return strides;
+}
+
+bool DataBuffer::checkedByteSize(DataType type, const QVector<qint64>& shape, qint64* bytes)
+{
+    qint64 size = dataTypeSize(type);
+    for (qint64 extent : shape) {
+        if (!checkedMultiply(size, extent, &size)) {
+            return false;
+        }
+    }
+    *bytes = shape.isEmpty() ? 0 : size;
+    return true;
+}
+
+bool DataBuffer::fitsStorage(DataType type, const QVector<qint64>& shape, const QVector<qint64>& strides,
+                             qint64 offset, qint64 storageSize)
+{
+    if (shape.size() != strides.size() || offset < 0 || offset > storageSize || dataTypeSize(type) == 0) {
+        return false;
+    }
+
+    // Lowest and highest byte addressed, as offsets from the first element
+    qint64 low = 0;
+    qint64 high = 0;
+    bool empty = shape.isEmpty();
+    for (int axis = 0; axis < shape.size(); ++axis) {
+        if (shape[axis] < 0) {
+            return false;
+        }
+        if (shape[axis] == 0) {
+            empty = true;
+            continue;
+        }
+
+        qint64 span = 0;
+        const qint64 stride = strides[axis];
+        if (stride == std::numeric_limits<qint64>::min()
+            || !checkedMultiply(shape[axis] - 1, qAbs(stride), &span)
+            || !checkedAdd(stride < 0 ? low : high, stride < 0 ? -span : span, stride < 0 ? &low : &high)) {
+            return false;
+        }
+    }
+    if (empty) {
+        return true;
+    }
+
+    qint64 first = 0;
+    qint64 last = 0;
+    return checkedAdd(offset, low, &first) && first >= 0
+        && checkedAdd(offset, high, &last) && checkedAdd(last, dataTypeSize(type), &last)
+        && last <= storageSize;
+}
+
+qint64 DataBuffer::elementCount() const
+{
+    if (m_shape.isEmpty()) {
+        return 0;
+    }
+
+    qint64 count = 1;
+    for (qint64 extent : m_shape) {
+        count *= extent;
+    }
+    return count;
+}
+
+bool DataBuffer::isContiguous() const
+{
+    return m_strides == contiguousStrides(m_type, m_shape);
+}
+
+qint64 DataBuffer::byteOffset(const QVector<qint64>& index) const
+{
+    qint64 offset = 0;
+    const int count = qMin(index.size(), m_strides.size());
+    for (int axis = 0; axis < count; ++axis) {
+        offset += index[axis] * m_strides[axis];
+    }
+    return offset;
+}
+
+DataBuffer DataBuffer::slice(int axis, qint64 index) const
+{
+    if (axis < 0 || axis >= ndim() || index < 0 || index >= m_shape[axis]) {
+        return DataBuffer();
+    }
+
+    QVector<qint64> shape = m_shape;
+    QVector<qint64> strides = m_strides;
+    const qint64 offset = m_offset + index * strides[axis];
+    shape.remove(axis);
+    strides.remove(axis);
+    return DataBuffer(m_type, shape, strides, m_storage, offset);
+}
+
+DataBuffer DataBuffer::region(const QVector<qint64>& start, const QVector<qint64>& extent) const
+{
+    if (start.size() != ndim() || extent.size() != ndim()) {
+        return DataBuffer();
+    }
+
+    for (int axis = 0; axis < ndim(); ++axis) {
+        if (start[axis] < 0 || extent[axis] < 0 || start[axis] + extent[axis] > m_shape[axis]) {
+            return DataBuffer();
+        }
+    }
+
+    return DataBuffer(m_type, extent, m_strides, m_storage, m_offset + byteOffset(start));
+}
+
+DataBuffer DataBuffer::copy() const
+{
+    if (isNull()) {
+        return DataBuffer();
+    }
+
+    DataBuffer result(m_type, m_shape);
+    if (isContiguous()) {
+        std::memcpy(result.data(), constData(), size_t(byteSize()));
+        return result;
+    }
+
+    // Copy innermost rows one at a time, walking the outer indices
+    const int dims = ndim();
+    const qint64 rowBytes = m_shape[dims - 1] * elementSize();
+    const bool innerContiguous = m_strides[dims - 1] == elementSize();
+    QVector<qint64> index(dims, 0);
+    uchar* out = result.data();
+
+    const qint64 rows = elementCount() / qMax<qint64>(1, m_shape[dims - 1]);
+    for (qint64 row = 0; row < rows; ++row) {
+        const uchar* in = constData() + byteOffset(index);
+        if (innerContiguous) {
+            std::memcpy(out, in, size_t(rowBytes));
+        } else {
+            for (qint64 i = 0; i < m_shape[dims - 1]; ++i) {
+                std::memcpy(out + i * elementSize(), in + i * m_strides[dims - 1], size_t(elementSize()));
+            }
+        }
+        out += rowBytes;
+
+        for (int axis = dims - 2; axis >= 0; --axis) {
+            if (++index[axis] < m_shape[axis]) {
+                break;
+            }
+            index[axis] = 0;
+        }
+    }
+
+    return result;
+}
+
+DataBuffer DataBuffer::converted(DataType type) const
+{
+    if (isNull() || dataTypeSize(type) == 0) {
+        return DataBuffer();
+    }
+
+    DataBuffer source = isContiguous() ? *this : copy();
+    if (type == m_type) {
+        return source.isSameView(*this) ? copy() : source;
+    }
+
+    DataBuffer result(type, m_shape);
+    const qint64 count = elementCount();
+    uchar* out = result.data();
+
+    switch (m_type) {
+    case DataType::UInt8:   convertElements(source.constData<quint8>(), type, out, count); break;
+    case DataType::UInt16:  convertElements(source.constData<quint16>(), type, out, count); break;
+    case DataType::UInt32:  convertElements(source.constData<quint32>(), type, out, count); break;
+    case DataType::Int8:    convertElements(source.constData<qint8>(), type, out, count); break;
+    case DataType::Int16:   convertElements(source.constData<qint16>(), type, out, count); break;
+    case DataType::Int32:   convertElements(source.constData<qint32>(), type, out, count); break;
+    case DataType::Float32: convertElements(source.constData<float>(), type, out, count); break;
+    case DataType::Float64: convertElements(source.constData<double>(), type, out, count); break;
+    default:                return DataBuffer();
+    }
+
+    return result;
+}
+
+bool DataBuffer::isSameView(const DataBuffer& other) const
+{
+    return m_storage == other.m_storage
+        && m_offset == other.m_offset
+        && m_type == other.m_type
+        && m_shape == other.m_shape
+        && m_strides == other.m_strides;
+}
@@ -0,0 +1,444 @@
+#pragma once
+
+#include <QByteArray>
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+/**
+ * @brief Element types for typed data buffers
+ */
+enum class DataType
+{
+    Unknown,    ///< Unknown element type
+    UInt8,      ///< 8-bit unsigned integer
+    UInt16,     ///< 16-bit unsigned integer
+    UInt32,     ///< 32-bit unsigned integer
+    Int8,       ///< 8-bit signed integer
+    Int16,      ///< 16-bit signed integer
+    Int32,      ///< 32-bit signed integer
+    Float32,    ///< 32-bit floating point
+    Float64     ///< 64-bit floating point
+};
+
+/**
+ * @brief Get element size of a data type
+ * @param type Data type
+ * @return Size in bytes (0 for Unknown)
+ */
+int dataTypeSize(DataType type);
+
+/**
+ * @brief Get name of a data type
+ * @param type Data type
+ * @return Name such as "uint16" or "float32"
+ */
+QString dataTypeName(DataType type);
+
+/**
+ * @brief Parse a data type name
+ * @param name Name as returned by dataTypeName()
+ * @return Data type or Unknown
+ */
+DataType dataTypeFromName(const QString& name);
+
+/**
+ * @brief Memory backing one or more data buffers
+ *
+ * Storage is shared between buffers via std::shared_ptr; views created
+ * with DataBuffer::slice() or DataBuffer::region() reference the same
+ * storage. The modification version is kept here so all views of the
+ * same memory observe the same version.
+ */
+class BufferStorage
+{
+public:
+    /**
+     * @brief Virtual destructor
+     */
+    virtual ~BufferStorage() = default;
+
+    /**
+     * @brief Get writable pointer to the memory
+     * @return Data pointer or nullptr if read-only
+     */
+    virtual uchar* data() = 0;
+
+    /**
+     * @brief Get read-only pointer to the memory
+     * @return Data pointer
+     */
+    virtual const uchar* constData() const = 0;
+
+    /**
+     * @brief Get storage size
+     * @return Size in bytes
+     */
+    virtual qint64 size() const = 0;
+
+    /**
+     * @brief Check if the memory may be written
+     * @return true if writable
+     */
+    virtual bool isWritable() const { return true; }
+
+    /**
+     * @brief Get modification version
+     * @return Version, incremented by markModified()
+     */
+    quint64 version() const { return m_version.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Record a modification
+     */
+    void markModified() { m_version.fetch_add(1, std::memory_order_acq_rel); }
+
+private:
+    std::atomic<quint64> m_version{0};
+};
+
+/**
+ * @brief Zero-initialized heap storage
+ */
+class HeapStorage : public BufferStorage
+{
+public:
+    /**
+     * @brief Constructor
+     * @param size Size in bytes
+     */
+    explicit HeapStorage(qint64 size);
+
+    /**
+     * @brief Destructor
+     */
+    ~HeapStorage();
+
+    uchar* data() override { return m_data; }
+    const uchar* constData() const override { return m_data; }
+    qint64 size() const override { return m_size; }
+
+private:
+    uchar* m_data;
+    qint64 m_size;
+};
+
+/**
+ * @brief Storage sharing the memory of a QByteArray
+ *
+ * Read-only storage shares the array and never copies it. Writable
+ * storage detaches once, in the constructor, so that data() is a plain
+ * pointer that is safe to hand to worker threads.
+ */
+class ByteArrayStorage : public BufferStorage
+{
+public:
+    /**
+     * @brief Access requested from the storage
+     */
+    enum Access
+    {
+        ReadOnly,   ///< Share the array; data() returns nullptr
+        Writable    ///< Detach the array, copying it if it is still shared elsewhere
+    };
+
+    /**
+     * @brief Constructor
+     * @param data Byte array (implicitly shared)
+     * @param access ReadOnly never copies; Writable copies a shared array
+     */
+    explicit ByteArrayStorage(const QByteArray& data, Access access = ReadOnly)
+        : m_data(data)
+        , m_writableData(access == Writable ? reinterpret_cast<uchar*>(m_data.data()) : nullptr)
+    {
+    }
+
+    uchar* data() override { return m_writableData; }
+    const uchar* constData() const override { return reinterpret_cast<const uchar*>(m_data.constData()); }
+    qint64 size() const override { return m_data.size(); }
+    bool isWritable() const override { return m_writableData != nullptr; }
+
+private:
+    QByteArray m_data;
+    uchar* m_writableData;
+};
+
+/**
+ * @brief Read-only storage sharing the elements of a QVector
+ *
+ * Lets a layer expose its vertex arrays as a DataBuffer without copying.
+ * The vector is implicitly shared, so later modifications by the layer
+ * detach and do not show through the buffer.
+ */
+template<typename T>
+class VectorStorage : public BufferStorage
+{
+public:
+    /**
+     * @brief Constructor
+     * @param data Vector (implicitly shared, not copied)
+     */
+    explicit VectorStorage(const QVector<T>& data) : m_data(data) {}
+
+    uchar* data() override { return nullptr; }
+    const uchar* constData() const override { return reinterpret_cast<const uchar*>(m_data.constData()); }
+    qint64 size() const override { return qint64(m_data.size()) * qint64(sizeof(T)); }
+    bool isWritable() const override { return false; }
+
+private:
+    QVector<T> m_data;
+};
+
+/**
+ * @brief Typed, reference-counted N-dimensional data buffer
+ *
+ * A lightweight handle describing element type, shape and byte strides
+ * over shared storage. Copying a DataBuffer never copies the elements;
+ * use copy() for a deep copy. Change detection uses version() instead of
+ * comparing contents; writers call markModified() after editing in place.
+ */
+class DataBuffer
+{
+public:
+    /**
+     * @brief Construct a null buffer
+     */
+    DataBuffer();
+
+    /**
+     * @brief Allocate a zero-initialized contiguous buffer
+     *
+     * Throws std::bad_alloc if the memory cannot be allocated, including
+     * shapes whose size is negative or overflows.
+     *
+     * @param type Element type
+     * @param shape Extent of each dimension (slowest first)
+     */
+    DataBuffer(DataType type, const QVector<qint64>& shape);
+
+    /**
+     * @brief Create a view over existing storage
+     *
+     * The result is a null buffer if the view does not fit the storage
+     * (see fitsStorage()).
+     *
+     * @param type Element type
+     * @param shape Extent of each dimension
+     * @param strides Byte stride of each dimension
+     * @param storage Backing storage
+     * @param offset Byte offset of the first element
+     */
+    DataBuffer(DataType type, const QVector<qint64>& shape, const QVector<qint64>& strides,
+               std::shared_ptr<BufferStorage> storage, qint64 offset = 0);
+
+    /**
+     * @brief Compute C-order (row-major) byte strides
+     * @param type Element type
+     * @param shape Shape
+     * @return Strides in bytes
+     */
+    static QVector<qint64> contiguousStrides(DataType type, const QVector<qint64>& shape);
+
+    /**
+     * @brief Compute the size of a contiguous layout without overflow
+     * @param type Element type
+     * @param shape Shape; extents must not be negative
+     * @param bytes Receives the size in bytes
+     * @return false if an extent is negative or the size overflows
+     */
+    static bool checkedByteSize(DataType type, const QVector<qint64>& shape, qint64* bytes);
+
+    /**
+     * @brief Check that a strided view stays inside its storage
+     *
+     * Every element addressed by the shape, strides and offset has to lie
+     * within [0, storageSize). Views with an empty extent address nothing
+     * and only need a valid offset.
+     *
+     * @param type Element type
+     * @param shape Shape; extents must not be negative
+     * @param strides Byte stride of each dimension, may be negative
+     * @param offset Byte offset of the first element
+     * @param storageSize Storage size in bytes
+     * @return true if the view is in bounds
+     */
+    static bool fitsStorage(DataType type, const QVector<qint64>& shape, const QVector<qint64>& strides,
+                            qint64 offset, qint64 storageSize);
+
+    /**
+     * @brief Check if the buffer is null
+     * @return true if it has no storage
+     */
+    bool isNull() const { return !m_storage; }
+
+    /**
+     * @brief Get element type
+     * @return Data type
+     */
+    DataType dtype() const { return m_type; }
+
+    /**
+     * @brief Get element size
+     * @return Size in bytes
+     */
+    int elementSize() const { return dataTypeSize(m_type); }
+
+    /**
+     * @brief Get number of dimensions
+     * @return Dimension count
+     */
+    int ndim() const { return m_shape.size(); }
+
+    /**
+     * @brief Get shape
+     * @return Extent of each dimension
+     */
+    const QVector<qint64>& shape() const { return m_shape; }
+
+    /**
+     * @brief Get extent of one dimension
+     * @param axis Dimension index
+     * @return Extent
+     */
+    qint64 shape(int axis) const { return m_shape.value(axis, 0); }
+
+    /**
+     * @brief Get strides
+     * @return Byte stride of each dimension
+     */
+    const QVector<qint64>& strides() const { return m_strides; }
+
+    /**
+     * @brief Get total element count
+     * @return Number of elements
+     */
+    qint64 elementCount() const;
+
+    /**
+     * @brief Get size of the elements in bytes
+     * @return elementCount() * elementSize()
+     */
+    qint64 byteSize() const { return elementCount() * elementSize(); }
+
+    /**
+     * @brief Check if elements are laid out contiguously in C order
+     * @return true if contiguous
+     */
+    bool isContiguous() const;
+
+    /**
+     * @brief Check if the buffer may be written
+     * @return true if writable
+     */
+    bool isWritable() const { return m_storage && m_storage->isWritable(); }
+
+    /**
+     * @brief Get read-only pointer to the first element
+     * @return Data pointer or nullptr
+     */
+    const uchar* constData() const { return m_storage ? m_storage->constData() + m_offset : nullptr; }
+
+    /**
+     * @brief Get writable pointer to the first element
+     * @return Data pointer or nullptr if null or read-only
+     */
+    uchar* data() { return isWritable() ? m_storage->data() + m_offset : nullptr; }
+
+    /**
+     * @brief Get typed read-only pointer to the first element
+     * @return Data pointer
+     */
+    template<typename T>
+    const T* constData() const { return reinterpret_cast<const T*>(constData()); }
+
+    /**
+     * @brief Get typed writable pointer to the first element
+     * @return Data pointer
+     */
+    template<typename T>
+    T* data() { return reinterpret_cast<T*>(data()); }
+
+    /**
+     * @brief Get byte offset of an element
+     * @param index Index per dimension
+     * @return Offset relative to constData()
+     */
+    qint64 byteOffset(const QVector<qint64>& index) const;
+
+    /**
+     * @brief Get backing storage
+     * @return Shared storage
+     */
+    std::shared_ptr<BufferStorage> storage() const { return m_storage; }
+
+    /**
+     * @brief Get byte offset of the first element in the storage
+     * @return Offset in bytes
+     */
+    qint64 offset() const { return m_offset; }
+
+    /**
+     * @brief Get modification version of the storage
+     * @return Version
+     */
+    quint64 version() const { return m_storage ? m_storage->version() : 0; }
+
+    /**
+     * @brief Record an in-place modification
+     */
+    void markModified() { if (m_storage) m_storage->markModified(); }
+
+    /**
+     * @brief Take a view at a fixed index along one axis
+     * @param axis Axis to remove
+     * @param index Index along the axis
+     * @return View with one dimension fewer
+     */
+    DataBuffer slice(int axis, qint64 index) const;
+
+    /**
+     * @brief Take a rectangular sub-region view
+     * @param start Start index per dimension
+     * @param extent Extent per dimension
+     * @return View of the region
+     */
+    DataBuffer region(const QVector<qint64>& start, const QVector<qint64>& extent) const;
+
+    /**
+     * @brief Make a contiguous deep copy
+     * @return New buffer with its own storage
+     */
+    DataBuffer copy() const;
+
+    /**
+     * @brief Make a contiguous deep copy with a different element type
+     *
+     * Elements are converted as by static_cast; converting to the same type
+     * is equivalent to copy().
+     *
+     * @param type Element type of the result
+     * @return New buffer with its own storage, or a null buffer for Unknown
+     */
+    DataBuffer converted(DataType type) const;
+
+    /**
+     * @brief Check if two buffers view the same memory with the same layout
+     *
+     * This is an identity check and never compares element values.
+     *
+     * @param other Other buffer
+     * @return true if identical views
+     */
+    bool isSameView(const DataBuffer& other) const;
+
+private:
+    DataType m_type;
+    QVector<qint64> m_shape;
+    QVector<qint64> m_strides;
+    std::shared_ptr<BufferStorage> m_storage;
+    qint64 m_offset;
+};
+
+Q_DECLARE_METATYPE(DataBuffer)
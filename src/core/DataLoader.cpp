@@ -0,0 +1,767 @@
+#include "DataLoader.h"
+#include "ImageLayer.h"
+#include "TiledImageLayer.h"
+#include "TileSource.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QSet>
+#include <QSysInfo>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Buffers up to this size are shown in a single ImageLayer; larger ones
+// are streamed as tiles
+const qint64 kMaxImageLayerBytes = 64ll * 1024 * 1024;
+
+// Guard against cyclic or corrupt IFD chains
+const int kMaxTiffPages = 1000000;
+
+void setError(QString* errorMessage, const QString& message)
+{
+    if (errorMessage) {
+        *errorMessage = message;
+    }
+}
+
+// Shapes read from file headers or descriptions: every extent positive
+// and the byte size representable
+bool validShape(DataType type, const QVector<qint64>& shape, qint64* bytes, QString* errorMessage)
+{
+    for (qint64 extent : shape) {
+        if (extent <= 0) {
+            setError(errorMessage, QString("Invalid extent %1 in data shape").arg(extent));
+            return false;
+        }
+    }
+    if (!DataBuffer::checkedByteSize(type, shape, bytes)) {
+        setError(errorMessage, "Data shape is too large");
+        return false;
+    }
+    return true;
+}
+
+// Converts a JSON number to an integer, or -1 if it is not a valid one
+qint64 jsonInteger(const QJsonValue& value, qint64 defaultValue)
+{
+    if (value.isUndefined()) {
+        return defaultValue;
+    }
+    const double number = value.toDouble(-1.0);
+    return number >= 0.0 && number <= 9007199254740992.0 && number == std::floor(number) ? qint64(number) : -1;
+}
+
+bool hostIsLittleEndian()
+{
+    return QSysInfo::ByteOrder == QSysInfo::LittleEndian;
+}
+
+// Elements converted between cancellation checks
+const qint64 kSwapChunkElements = 1 << 20;
+
+bool isCancelled(const LoadRequest* request, QString* errorMessage)
+{
+    if (request && request->isCancelled()) {
+        setError(errorMessage, "Loading cancelled");
+        return true;
+    }
+    return false;
+}
+
+void reportProgress(LoadRequest* request, qint64 done, qint64 total)
+{
+    if (request && total > 0) {
+        request->setProgress(int(done * 100 / total));
+    }
+}
+
+// Contiguous copy with every element's bytes reversed
+DataBuffer byteSwapped(const DataBuffer& buffer, LoadRequest* request, QString* errorMessage)
+{
+    DataBuffer result = buffer.copy();
+    const int size = result.elementSize();
+    if (size <= 1) {
+        return result;
+    }
+
+    uchar* data = result.data();
+    const qint64 count = result.elementCount();
+    for (qint64 begin = 0; begin < count; begin += kSwapChunkElements) {
+        if (isCancelled(request, errorMessage)) {
+            return DataBuffer();
+        }
+
+        const qint64 end = qMin(count, begin + kSwapChunkElements);
+        for (qint64 i = begin; i < end; ++i) {
+            std::reverse(data + i * size, data + (i + 1) * size);
+        }
+        reportProgress(request, end, count);
+    }
+    return result;
+}
+
+DataType npyType(QChar kind, int size)
+{
+    switch (kind.toLatin1()) {
+    case 'b':
+        return size == 1 ? DataType::UInt8 : DataType::Unknown;
+    case 'u':
+        return size == 1 ? DataType::UInt8 : size == 2 ? DataType::UInt16
+             : size == 4 ? DataType::UInt32 : DataType::Unknown;
+    case 'i':
+        return size == 1 ? DataType::Int8 : size == 2 ? DataType::Int16
+             : size == 4 ? DataType::Int32 : DataType::Unknown;
+    case 'f':
+        return size == 4 ? DataType::Float32 : size == 8 ? DataType::Float64 : DataType::Unknown;
+    default:
+        return DataType::Unknown;
+    }
+}
+
+DataType tiffType(int sampleFormat, int bitsPerSample)
+{
+    switch (sampleFormat) {
+    case 1:
+        return bitsPerSample == 8 ? DataType::UInt8 : bitsPerSample == 16 ? DataType::UInt16
+             : bitsPerSample == 32 ? DataType::UInt32 : DataType::Unknown;
+    case 2:
+        return bitsPerSample == 8 ? DataType::Int8 : bitsPerSample == 16 ? DataType::Int16
+             : bitsPerSample == 32 ? DataType::Int32 : DataType::Unknown;
+    case 3:
+        return bitsPerSample == 32 ? DataType::Float32 : bitsPerSample == 64 ? DataType::Float64
+             : DataType::Unknown;
+    default:
+        return DataType::Unknown;
+    }
+}
+
+/**
+ * @brief Image file directory of a TIFF page
+ */
+struct TiffPage
+{
+    qint64 width = 0;
+    qint64 height = 0;
+    int bitsPerSample = 0;
+    int samplesPerPixel = 1;
+    int sampleFormat = 1;
+    int compression = 1;
+    int planarConfiguration = 1;
+    qint64 rowsPerStrip = 0;
+    bool tiled = false;
+    QVector<quint64> stripOffsets;
+    QVector<quint64> stripByteCounts;
+    QByteArray description;
+
+    bool sameLayout(const TiffPage& other) const
+    {
+        return width == other.width && height == other.height
+            && bitsPerSample == other.bitsPerSample && samplesPerPixel == other.samplesPerPixel
+            && sampleFormat == other.sampleFormat && compression == other.compression
+            && planarConfiguration == other.planarConfiguration && tiled == other.tiled;
+    }
+};
+
+/**
+ * @brief Minimal reader for classic TIFF and BigTIFF directory structures
+ */
+class TiffParser
+{
+public:
+    TiffParser(const uchar* data, qint64 size)
+        : m_data(data), m_size(size), m_littleEndian(true), m_bigTiff(false), m_firstIfd(0) {}
+
+    bool littleEndian() const { return m_littleEndian; }
+
+    bool readHeader(QString* errorMessage)
+    {
+        if (m_size < 8) {
+            setError(errorMessage, "File too small for a TIFF header");
+            return false;
+        }
+
+        if (m_data[0] == 'I' && m_data[1] == 'I') {
+            m_littleEndian = true;
+        } else if (m_data[0] == 'M' && m_data[1] == 'M') {
+            m_littleEndian = false;
+        } else {
+            setError(errorMessage, "Not a TIFF file");
+            return false;
+        }
+
+        bool ok = true;
+        const quint64 version = read(2, 2, &ok);
+        if (version == 42) {
+            m_bigTiff = false;
+            m_firstIfd = read(4, 4, &ok);
+        } else if (version == 43) {
+            m_bigTiff = true;
+            m_firstIfd = read(8, 8, &ok);
+        } else {
+            setError(errorMessage, "Unsupported TIFF version");
+            return false;
+        }
+
+        if (!ok) {
+            setError(errorMessage, "Truncated TIFF header");
+        }
+        return ok;
+    }
+
+    bool readPages(QVector<TiffPage>& pages, QString* errorMessage)
+    {
+        QSet<quint64> visited;
+        quint64 offset = m_firstIfd;
+
+        while (offset != 0 && pages.size() < kMaxTiffPages) {
+            if (visited.contains(offset)) {
+                break;
+            }
+            visited.insert(offset);
+
+            TiffPage page;
+            if (!readPage(offset, page, offset)) {
+                if (pages.isEmpty()) {
+                    setError(errorMessage, "Corrupt TIFF directory");
+                    return false;
+                }
+                break;
+            }
+            pages.append(page);
+        }
+
+        if (pages.isEmpty()) {
+            setError(errorMessage, "TIFF file has no pages");
+            return false;
+        }
+        return true;
+    }
+
+private:
+    quint64 read(qint64 offset, int bytes, bool* ok) const
+    {
+        if (offset < 0 || offset + bytes > m_size) {
+            *ok = false;
+            return 0;
+        }
+
+        quint64 value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            const int index = m_littleEndian ? bytes - 1 - i : i;
+            value = (value << 8) | m_data[offset + index];
+        }
+        return value;
+    }
+
+    static int typeSize(int type)
+    {
+        switch (type) {
+        case 1: case 2: case 6: case 7:            return 1;
+        case 3: case 8:                            return 2;
+        case 4: case 9: case 11: case 13:          return 4;
+        case 5: case 10: case 12: case 16:
+        case 17: case 18:                          return 8;
+        default:                                   return 0;
+        }
+    }
+
+    bool readPage(quint64 ifdOffset, TiffPage& page, quint64& nextOffset) const
+    {
+        bool ok = true;
+        const int countSize = m_bigTiff ? 8 : 2;
+        const int entrySize = m_bigTiff ? 20 : 12;
+        const int inlineSize = m_bigTiff ? 8 : 4;
+
+        const quint64 entryCount = read(qint64(ifdOffset), countSize, &ok);
+        if (!ok || entryCount == 0 || entryCount > 4096) {
+            return false;
+        }
+
+        for (quint64 i = 0; i < entryCount; ++i) {
+            const qint64 entry = qint64(ifdOffset) + countSize + qint64(i) * entrySize;
+            const int tag = int(read(entry, 2, &ok));
+            const int type = int(read(entry + 2, 2, &ok));
+            const quint64 count = read(entry + 4, m_bigTiff ? 8 : 4, &ok);
+            const qint64 field = entry + (m_bigTiff ? 12 : 8);
+            if (!ok) {
+                return false;
+            }
+
+            const int size = typeSize(type);
+            if (size == 0 || count > quint64(m_size)) {
+                continue;
+            }
+
+            const qint64 valueOffset = qint64(count) * size <= inlineSize
+                                     ? field
+                                     : qint64(read(field, inlineSize, &ok));
+
+            auto values = [&]() {
+                QVector<quint64> result;
+                if (qint64(count) * size > m_size) {
+                    return result;
+                }
+                result.reserve(int(count));
+                for (quint64 k = 0; k < count && ok; ++k) {
+                    result.append(read(valueOffset + qint64(k) * size, size, &ok));
+                }
+                return result;
+            };
+            auto first = [&]() { return count > 0 ? read(valueOffset, size, &ok) : 0; };
+
+            switch (tag) {
+            case 256: page.width = qint64(first()); break;
+            case 257: page.height = qint64(first()); break;
+            case 258: page.bitsPerSample = int(first()); break;
+            case 259: page.compression = int(first()); break;
+            case 270:
+                if (valueOffset >= 0 && valueOffset + qint64(count) <= m_size) {
+                    page.description = QByteArray(reinterpret_cast<const char*>(m_data + valueOffset), int(count));
+                }
+                break;
+            case 273: page.stripOffsets = values(); break;
+            case 277: page.samplesPerPixel = int(first()); break;
+            case 278: page.rowsPerStrip = qint64(first()); break;
+            case 279: page.stripByteCounts = values(); break;
+            case 284: page.planarConfiguration = int(first()); break;
+            case 322: // TileWidth
+            case 324: // TileOffsets
+                page.tiled = true;
+                break;
+            case 339: page.sampleFormat = int(first()); break;
+            default: break;
+            }
+
+            if (!ok) {
+                return false;
+            }
+        }
+
+        const qint64 nextField = qint64(ifdOffset) + countSize + qint64(entryCount) * entrySize;
+        nextOffset = read(nextField, inlineSize, &ok);
+        if (!ok) {
+            nextOffset = 0;
+        }
+
+        if (page.rowsPerStrip <= 0 || page.rowsPerStrip > page.height) {
+            page.rowsPerStrip = page.height;
+        }
+        return page.width > 0 && page.height > 0;
+    }
+
+private:
+    const uchar* m_data;
+    qint64 m_size;
+    bool m_littleEndian;
+    bool m_bigTiff;
+    quint64 m_firstIfd;
+};
+
+// File offset of the page's pixels if all strips lie back to back, else -1
+qint64 contiguousPageStart(const TiffPage& page, qint64 rowBytes, qint64 fileSize)
+{
+    if (page.stripOffsets.isEmpty()) {
+        return -1;
+    }
+
+    const qint64 start = qint64(page.stripOffsets.first());
+    qint64 expected = start;
+    qint64 remainingRows = page.height;
+
+    for (int i = 0; i < page.stripOffsets.size(); ++i) {
+        if (qint64(page.stripOffsets[i]) != expected) {
+            return -1;
+        }
+        const qint64 rows = qMin(page.rowsPerStrip, remainingRows);
+        const qint64 bytes = i < page.stripByteCounts.size() ? qint64(page.stripByteCounts[i]) : rows * rowBytes;
+        expected += bytes;
+        remainingRows -= rows;
+    }
+
+    const qint64 pageBytes = rowBytes * page.height;
+    if (expected - start < pageBytes || start + pageBytes > fileSize) {
+        return -1;
+    }
+    return start;
+}
+
+} // namespace
+
+// MappedFileStorage implementation
+MappedFileStorage::MappedFileStorage(std::unique_ptr<QFile> file, uchar* data, qint64 size)
+    : m_file(std::move(file))
+    , m_data(data)
+    , m_size(size)
+{
+}
+
+MappedFileStorage::~MappedFileStorage()
+{
+    if (m_file && m_data) {
+        m_file->unmap(m_data);
+    }
+}
+
+std::shared_ptr<MappedFileStorage> MappedFileStorage::map(const QString& fileName, QString* errorMessage)
+{
+    auto file = std::make_unique<QFile>(fileName);
+    if (!file->open(QIODevice::ReadOnly)) {
+        setError(errorMessage, QString("Cannot open %1: %2").arg(fileName, file->errorString()));
+        return nullptr;
+    }
+
+    const qint64 size = file->size();
+    if (size <= 0) {
+        setError(errorMessage, QString("File is empty: %1").arg(fileName));
+        return nullptr;
+    }
+
+    // Private mapping: writes are copy-on-write and never reach the file
+    uchar* data = file->map(0, size, QFileDevice::MapPrivateOption);
+    if (!data) {
+        setError(errorMessage, QString("Cannot map %1: %2").arg(fileName, file->errorString()));
+        return nullptr;
+    }
+
+    return std::shared_ptr<MappedFileStorage>(new MappedFileStorage(std::move(file), data, size));
+}
+
+QString MappedFileStorage::fileName() const
+{
+    return m_file ? m_file->fileName() : QString();
+}
+
+// DataLoader implementation
+QStringList DataLoader::supportedSuffixes()
+{
+    return QStringList({"raw", "npy", "tif", "tiff"});
+}
+
+bool DataLoader::canLoad(const QString& fileName)
+{
+    return supportedSuffixes().contains(QFileInfo(fileName).suffix().toLower());
+}
+
+DataBuffer DataLoader::load(const QString& fileName, QString* errorMessage, LoadRequest* request)
+{
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+
+    if (suffix == "npy") {
+        return loadNpy(fileName, errorMessage, request);
+    }
+
+    if (suffix == "tif" || suffix == "tiff") {
+        return loadTiff(fileName, errorMessage, request);
+    }
+
+    if (suffix == "raw") {
+        QFile sidecar(fileName + ".json");
+        if (!sidecar.open(QIODevice::ReadOnly)) {
+            setError(errorMessage, QString("Raw file needs a layout description in %1").arg(sidecar.fileName()));
+            return DataBuffer();
+        }
+
+        const QJsonObject description = QJsonDocument::fromJson(sidecar.readAll()).object();
+        RawFormat format;
+        format.type = dataTypeFromName(description.value("dtype").toString());
+        format.headerSize = jsonInteger(description.value("offset"), 0);
+        format.littleEndian = description.value("endian").toString("little") != "big";
+        for (const QJsonValue& extent : description.value("shape").toArray()) {
+            format.shape.append(jsonInteger(extent, -1));
+        }
+        return loadRaw(fileName, format, errorMessage, request);
+    }
+
+    setError(errorMessage, QString("Unsupported file format: %1").arg(fileName));
+    return DataBuffer();
+}
+
+DataBuffer DataLoader::loadRaw(const QString& fileName, const RawFormat& format, QString* errorMessage,
+                               LoadRequest* request)
+{
+    if (format.type == DataType::Unknown || format.shape.isEmpty() || format.headerSize < 0) {
+        setError(errorMessage, "Invalid raw data layout");
+        return DataBuffer();
+    }
+
+    qint64 bytes = 0;
+    if (!validShape(format.type, format.shape, &bytes, errorMessage)) {
+        return DataBuffer();
+    }
+
+    std::shared_ptr<MappedFileStorage> storage = MappedFileStorage::map(fileName, errorMessage);
+    if (!storage) {
+        return DataBuffer();
+    }
+
+    if (format.headerSize > storage->size() || bytes > storage->size() - format.headerSize) {
+        setError(errorMessage, QString("File is smaller than the described layout: %1").arg(fileName));
+        return DataBuffer();
+    }
+    DataBuffer buffer(format.type, format.shape, DataBuffer::contiguousStrides(format.type, format.shape),
+                      storage, format.headerSize);
+
+    if (format.littleEndian != hostIsLittleEndian()) {
+        return byteSwapped(buffer, request, errorMessage);
+    }
+    return buffer;
+}
+
+DataBuffer DataLoader::loadNpy(const QString& fileName, QString* errorMessage, LoadRequest* request)
+{
+    std::shared_ptr<MappedFileStorage> storage = MappedFileStorage::map(fileName, errorMessage);
+    if (!storage) {
+        return DataBuffer();
+    }
+
+    const uchar* data = storage->constData();
+    const qint64 size = storage->size();
+    if (size < 10 || std::memcmp(data, "\x93NUMPY", 6) != 0) {
+        setError(errorMessage, QString("Not a NumPy file: %1").arg(fileName));
+        return DataBuffer();
+    }
+
+    // Version 1 stores the header length in 2 bytes, later versions in 4
+    const int major = data[6];
+    qint64 headerStart = 10;
+    qint64 headerLength = data[8] | (data[9] << 8);
+    if (major >= 2) {
+        if (size < 12) {
+            setError(errorMessage, "Truncated NumPy header");
+            return DataBuffer();
+        }
+        headerStart = 12;
+        headerLength = qint64(data[8]) | (qint64(data[9]) << 8) | (qint64(data[10]) << 16) | (qint64(data[11]) << 24);
+    }
+
+    if (headerStart + headerLength > size) {
+        setError(errorMessage, "Truncated NumPy header");
+        return DataBuffer();
+    }
+
+    const QString header = QString::fromLatin1(reinterpret_cast<const char*>(data + headerStart), int(headerLength));
+
+    static const QRegularExpression descrPattern("'descr'\\s*:\\s*'([<>|=])([a-z])(\\d+)'");
+    static const QRegularExpression fortranPattern("'fortran_order'\\s*:\\s*(True|False)");
+    static const QRegularExpression shapePattern("'shape'\\s*:\\s*\\(([^)]*)\\)");
+
+    const QRegularExpressionMatch descr = descrPattern.match(header);
+    const QRegularExpressionMatch fortran = fortranPattern.match(header);
+    const QRegularExpressionMatch shapeMatch = shapePattern.match(header);
+    if (!descr.hasMatch() || !shapeMatch.hasMatch()) {
+        setError(errorMessage, "Unsupported NumPy header");
+        return DataBuffer();
+    }
+
+    const QChar byteOrder = descr.captured(1).at(0);
+    const int elementSize = descr.captured(3).toInt();
+    const DataType type = npyType(descr.captured(2).at(0), elementSize);
+    if (type == DataType::Unknown) {
+        setError(errorMessage, QString("Unsupported NumPy element type: %1").arg(descr.captured(0)));
+        return DataBuffer();
+    }
+
+    QVector<qint64> shape;
+    for (const QString& extent : shapeMatch.captured(1).split(',', Qt::SkipEmptyParts)) {
+        bool ok = false;
+        const qint64 value = extent.trimmed().toLongLong(&ok);
+        shape.append(ok ? value : -1);
+    }
+    if (shape.isEmpty()) {
+        shape.append(1);
+    }
+
+    qint64 bytes = 0;
+    if (!validShape(type, shape, &bytes, errorMessage)) {
+        return DataBuffer();
+    }
+    const qint64 dataStart = headerStart + headerLength;
+    if (bytes > size - dataStart) {
+        setError(errorMessage, QString("NumPy file is truncated: %1").arg(fileName));
+        return DataBuffer();
+    }
+
+    QVector<qint64> strides = DataBuffer::contiguousStrides(type, shape);
+    if (fortran.hasMatch() && fortran.captured(1) == "True") {
+        // Column-major data is described with reversed strides, no copy
+        qint64 stride = elementSize;
+        for (int axis = 0; axis < shape.size(); ++axis) {
+            strides[axis] = stride;
+            stride *= shape[axis];
+        }
+    }
+
+    const DataBuffer buffer(type, shape, strides, storage, dataStart);
+    if (buffer.isNull()) {
+        setError(errorMessage, QString("NumPy layout does not fit the file: %1").arg(fileName));
+        return DataBuffer();
+    }
+
+    const bool bigEndian = byteOrder == '>' || (byteOrder == '=' && !hostIsLittleEndian());
+    if (elementSize > 1 && bigEndian == hostIsLittleEndian()) {
+        return byteSwapped(buffer, request, errorMessage);
+    }
+    return buffer;
+}
+
+DataBuffer DataLoader::loadTiff(const QString& fileName, QString* errorMessage, LoadRequest* request)
+{
+    std::shared_ptr<MappedFileStorage> storage = MappedFileStorage::map(fileName, errorMessage);
+    if (!storage) {
+        return DataBuffer();
+    }
+
+    TiffParser parser(storage->constData(), storage->size());
+    QVector<TiffPage> pages;
+    if (!parser.readHeader(errorMessage) || !parser.readPages(pages, errorMessage)) {
+        return DataBuffer();
+    }
+
+    const TiffPage& first = pages.first();
+    const DataType type = tiffType(first.sampleFormat, first.bitsPerSample);
+    if (first.compression != 1 || first.tiled || type == DataType::Unknown
+        || (first.samplesPerPixel > 1 && first.planarConfiguration != 1)) {
+        setError(errorMessage, "Only uncompressed, stripped, interleaved TIFF files can be mapped");
+        return DataBuffer();
+    }
+
+    // Stack the leading run of pages that share the first page's layout;
+    // trailing thumbnails or masks are ignored
+    int pageCount = 1;
+    while (pageCount < pages.size() && pages[pageCount].sameLayout(first)) {
+        ++pageCount;
+    }
+
+    const qint64 elementSize = dataTypeSize(type);
+    const qint64 samples = first.samplesPerPixel;
+    qint64 pageBytes = 0;
+    if (!validShape(type, {first.height, first.width, samples}, &pageBytes, errorMessage)) {
+        return DataBuffer();
+    }
+    const qint64 rowBytes = first.width * samples * elementSize;
+
+    QVector<qint64> starts;
+    bool contiguous = true;
+    for (int i = 0; i < pageCount && contiguous; ++i) {
+        const qint64 start = contiguousPageStart(pages[i], rowBytes, storage->size());
+        contiguous = start >= 0;
+        starts.append(start);
+    }
+
+    qint64 pageStride = pageBytes;
+    if (contiguous && pageCount > 1) {
+        pageStride = starts[1] - starts[0];
+        for (int i = 2; i < pageCount && contiguous; ++i) {
+            contiguous = starts[i] - starts[i - 1] == pageStride;
+        }
+        contiguous = contiguous && pageStride >= pageBytes;
+    }
+
+    // ImageJ writes large hyperstacks with a single IFD followed by all
+    // planes back to back
+    if (contiguous && pageCount == 1) {
+        static const QRegularExpression imagesPattern("images=(\\d+)");
+        const QString description = QString::fromLatin1(first.description);
+        const QRegularExpressionMatch images = imagesPattern.match(description);
+        if (description.startsWith("ImageJ=") && images.hasMatch()) {
+            const qint64 planes = images.captured(1).toLongLong();
+            if (planes > 1 && planes <= kMaxTiffPages && planes <= (storage->size() - starts[0]) / pageBytes) {
+                pageCount = int(planes);
+            }
+        }
+    }
+
+    QVector<qint64> shape({first.height, first.width});
+    QVector<qint64> strides({rowBytes, samples * elementSize});
+    if (samples > 1) {
+        shape.append(samples);
+        strides.append(elementSize);
+    }
+    if (pageCount > 1) {
+        shape.prepend(pageCount);
+        strides.prepend(pageStride);
+    }
+
+    DataBuffer buffer;
+    if (contiguous) {
+        buffer = DataBuffer(type, shape, strides, storage, starts[0]);
+        if (buffer.isNull()) {
+            setError(errorMessage, QString("TIFF pages do not fit the file: %1").arg(fileName));
+            return DataBuffer();
+        }
+    } else {
+        // Scattered strips cannot be described with strides; gather them
+        qint64 totalBytes = 0;
+        if (!validShape(type, shape, &totalBytes, errorMessage)) {
+            return DataBuffer();
+        }
+        buffer = DataBuffer(type, shape);
+        uchar* out = buffer.data();
+        const uchar* in = storage->constData();
+
+        for (int p = 0; p < pageCount; ++p) {
+            if (isCancelled(request, errorMessage)) {
+                return DataBuffer();
+            }
+            reportProgress(request, p, pageCount);
+
+            const TiffPage& page = pages[p];
+            qint64 written = 0;
+            for (int s = 0; s < page.stripOffsets.size() && written < pageBytes; ++s) {
+                const qint64 offset = qint64(page.stripOffsets[s]);
+                qint64 bytes = s < page.stripByteCounts.size()
+                             ? qint64(page.stripByteCounts[s])
+                             : page.rowsPerStrip * rowBytes;
+                bytes = qMin(bytes, pageBytes - written);
+                if (offset < 0 || bytes < 0 || offset > storage->size() - bytes) {
+                    setError(errorMessage, QString("TIFF strip outside of file: %1").arg(fileName));
+                    return DataBuffer();
+                }
+                std::memcpy(out + p * pageBytes + written, in + offset, size_t(bytes));
+                written += bytes;
+            }
+        }
+    }
+
+    if (elementSize > 1 && parser.littleEndian() != hostIsLittleEndian()) {
+        return byteSwapped(buffer, request, errorMessage);
+    }
+    return buffer;
+}
+
+Layer* DataLoader::createLayer(const DataBuffer& buffer, const QString& name)
+{
+    // The plane size decides how stacks are shown; a trailing extent of 3
+    // or 4 is color. Image layers keep every plane for the dims sliders,
+    // tiled layers show the first one
+    DataBuffer image = buffer;
+    while (image.ndim() > 3 || (image.ndim() == 3 && image.shape(2) != 3 && image.shape(2) != 4)) {
+        image = image.slice(0, 0);
+    }
+
+    if (image.ndim() < 2) {
+        return nullptr;
+    }
+
+    if (image.byteSize() <= kMaxImageLayerBytes) {
+        ImageLayer* layer = new ImageLayer(name);
+        if (layer->setBuffer(buffer)) {
+            return layer;
+        }
+        delete layer;
+        return nullptr;
+    }
+
+    auto source = std::make_shared<BufferTileSource>(image);
+    if (source->imageSize().isEmpty()) {
+        return nullptr;
+    }
+    return new TiledImageLayer(name, source);
+}
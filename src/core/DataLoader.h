@@ -0,0 +1,151 @@
+#pragma once
+
+#include "DataBuffer.h"
+#include "LoadRequest.h"
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <memory>
+
+class QFile;
+class Layer;
+
+/**
+ * @brief Storage backed by a memory-mapped file
+ *
+ * The whole file is mapped privately: pages are read from disk on first
+ * access, and in-place edits stay in memory and never reach the file.
+ */
+class MappedFileStorage : public BufferStorage
+{
+public:
+    /**
+     * @brief Map a file
+     * @param fileName File to map
+     * @param errorMessage Receives the reason on failure (may be nullptr)
+     * @return Storage or nullptr on failure
+     */
+    static std::shared_ptr<MappedFileStorage> map(const QString& fileName, QString* errorMessage = nullptr);
+
+    /**
+     * @brief Destructor
+     */
+    ~MappedFileStorage();
+
+    uchar* data() override { return m_data; }
+    const uchar* constData() const override { return m_data; }
+    qint64 size() const override { return m_size; }
+
+    /**
+     * @brief Get mapped file name
+     * @return File name
+     */
+    QString fileName() const;
+
+private:
+    MappedFileStorage(std::unique_ptr<QFile> file, uchar* data, qint64 size);
+
+    std::unique_ptr<QFile> m_file;
+    uchar* m_data;
+    qint64 m_size;
+};
+
+/**
+ * @brief Layout of a headerless raw file
+ */
+struct RawFormat
+{
+    DataType type = DataType::Unknown;  ///< Element type
+    QVector<qint64> shape;              ///< Extent of each dimension
+    qint64 headerSize = 0;              ///< Bytes to skip at the start of the file
+    bool littleEndian = true;           ///< Byte order of multi-byte elements
+};
+
+/**
+ * @brief Loads array files into data buffers
+ *
+ * Raw, NPY and uncompressed TIFF files are memory-mapped, so opening a
+ * file costs no more than parsing its header and pixels are paged in as
+ * they are displayed. Data is only copied to the heap when its layout
+ * cannot be viewed in place (foreign byte order, scattered TIFF strips).
+ * All functions are thread-safe and may run on a worker thread.
+ */
+class DataLoader
+{
+public:
+    /**
+     * @brief Get file suffixes handled by the loader
+     * @return Lower case suffixes without dot
+     */
+    static QStringList supportedSuffixes();
+
+    /**
+     * @brief Check if a file can be loaded
+     * @param fileName File name
+     * @return true if the suffix is supported
+     */
+    static bool canLoad(const QString& fileName);
+
+    /**
+     * @brief Load a file, picking the format from its suffix
+     *
+     * Raw files need a sidecar "<file>.json" with "dtype", "shape" and
+     * optionally "offset" and "endian" entries.
+     *
+     * @param fileName File name
+     * @param errorMessage Receives the reason on failure (may be nullptr)
+     * @param request Progress and cancellation state (may be nullptr)
+     * @return Buffer or a null buffer on failure
+     */
+    static DataBuffer load(const QString& fileName, QString* errorMessage = nullptr,
+                           LoadRequest* request = nullptr);
+
+    /**
+     * @brief Load a headerless raw file
+     * @param fileName File name
+     * @param format Data layout
+     * @param errorMessage Receives the reason on failure (may be nullptr)
+     * @param request Progress and cancellation state (may be nullptr)
+     * @return Buffer or a null buffer on failure
+     */
+    static DataBuffer loadRaw(const QString& fileName, const RawFormat& format,
+                              QString* errorMessage = nullptr, LoadRequest* request = nullptr);
+
+    /**
+     * @brief Load a NumPy .npy file
+     * @param fileName File name
+     * @param errorMessage Receives the reason on failure (may be nullptr)
+     * @param request Progress and cancellation state (may be nullptr)
+     * @return Buffer or a null buffer on failure
+     */
+    static DataBuffer loadNpy(const QString& fileName, QString* errorMessage = nullptr,
+                              LoadRequest* request = nullptr);
+
+    /**
+     * @brief Load an uncompressed, stripped TIFF or BigTIFF file
+     *
+     * Multi-page files with identical pages become a [pages, height, width]
+     * stack; ImageJ hyperstacks that store only the first IFD are
+     * recognized through their "images=" description entry.
+     *
+     * @param fileName File name
+     * @param errorMessage Receives the reason on failure (may be nullptr)
+     * @param request Progress and cancellation state (may be nullptr)
+     * @return Buffer or a null buffer on failure
+     */
+    static DataBuffer loadTiff(const QString& fileName, QString* errorMessage = nullptr,
+                               LoadRequest* request = nullptr);
+
+    /**
+     * @brief Create a layer displaying a buffer
+     *
+     * Small buffers become an ImageLayer; large ones are streamed through
+     * a TiledImageLayer so that only visible tiles are read. For image
+     * stacks the first plane is shown.
+     *
+     * @param buffer Data buffer
+     * @param name Layer name
+     * @return New layer owned by the caller, or nullptr if not displayable
+     */
+    static Layer* createLayer(const DataBuffer& buffer, const QString& name);
+};
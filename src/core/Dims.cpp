@@ -0,0 +1,173 @@
+#include "Dims.h"
+
+#include <QtMath>
+
+namespace {
+
+// Playback rates accepted by setFps()
+const double kMinFps = 0.1;
+const double kMaxFps = 120.0;
+
+} // namespace
+
+Dims::Dims(QObject* parent)
+    : QObject(parent)
+    , m_framesPlayed(0)
+    , m_playbackAxis(0)
+    , m_fps(10.0)
+    , m_loop(true)
+{
+    m_playTimer.setSingleShot(true);
+    m_playTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_playTimer, &QTimer::timeout, this, &Dims::advancePlayback);
+}
+
+void Dims::setRange(const QVector<qint64>& range)
+{
+    QVector<qint64> steps = range;
+    for (qint64& count : steps) {
+        count = qMax<qint64>(1, count);
+    }
+    if (steps == m_range) {
+        return;
+    }
+
+    m_range = steps;
+    emit rangeChanged(m_range);
+
+    if (m_playbackAxis >= ndim()) {
+        stop();
+    }
+
+    const QVector<qint64> point = clamped(m_point);
+    if (point != m_point) {
+        m_point = point;
+        emit pointChanged(m_point);
+    }
+}
+
+void Dims::setPoint(const QVector<qint64>& point)
+{
+    const QVector<qint64> clampedPoint = clamped(point);
+    if (clampedPoint != m_point) {
+        m_point = clampedPoint;
+        emit pointChanged(m_point);
+    }
+}
+
+void Dims::setIndex(int axis, qint64 index)
+{
+    if (axis < 0 || axis >= ndim()) {
+        return;
+    }
+
+    QVector<qint64> point = m_point;
+    point[axis] = index;
+    setPoint(point);
+}
+
+void Dims::step(int axis, qint64 delta)
+{
+    if (axis < 0 || axis >= ndim()) {
+        return;
+    }
+
+    qint64 index = m_point[axis] + delta;
+    if (m_loop) {
+        index %= m_range[axis];
+        if (index < 0) {
+            index += m_range[axis];
+        }
+    }
+    setIndex(axis, index);
+}
+
+QVector<qint64> Dims::alignedPoint(int dimensions) const
+{
+    QVector<qint64> point(dimensions, 0);
+    for (int i = 0; i < qMin(dimensions, ndim()); ++i) {
+        point[dimensions - 1 - i] = m_point[ndim() - 1 - i];
+    }
+    return point;
+}
+
+void Dims::setFps(double fps)
+{
+    const double magnitude = qBound(kMinFps, qAbs(fps), kMaxFps);
+    fps = fps < 0.0 ? -magnitude : magnitude;
+    if (m_fps == fps) {
+        return;
+    }
+
+    m_fps = fps;
+    if (isPlaying()) {
+        restartPlaybackClock();
+    }
+}
+
+void Dims::play(int axis)
+{
+    if (axis < 0 || axis >= ndim()) {
+        return;
+    }
+
+    m_playbackAxis = axis;
+    restartPlaybackClock();
+    if (!m_playTimer.isActive()) {
+        m_playTimer.start(qRound(1000.0 / qAbs(m_fps)));
+        emit playbackChanged(true);
+    }
+}
+
+void Dims::stop()
+{
+    if (m_playTimer.isActive()) {
+        m_playTimer.stop();
+        emit playbackChanged(false);
+    }
+}
+
+void Dims::advancePlayback()
+{
+    const int axis = m_playbackAxis;
+    if (axis >= ndim()) {
+        emit playbackChanged(false);
+        return;
+    }
+
+    const qint64 before = m_point[axis];
+    step(axis, m_fps < 0.0 ? -1 : 1);
+    if (m_point[axis] == before) {
+        // Reached the end without looping
+        emit playbackChanged(false);
+        return;
+    }
+
+    // Schedule against the clock so timer latency does not accumulate;
+    // after a stall of more than a frame start over instead of catching up
+    const double interval = 1000.0 / qAbs(m_fps);
+    ++m_framesPlayed;
+    const qint64 due = qRound64((m_framesPlayed + 1) * interval);
+    const qint64 elapsed = m_playClock.elapsed();
+    if (elapsed > due) {
+        restartPlaybackClock();
+        m_playTimer.start(qRound(interval));
+    } else {
+        m_playTimer.start(int(due - elapsed));
+    }
+}
+
+QVector<qint64> Dims::clamped(const QVector<qint64>& point) const
+{
+    QVector<qint64> result(ndim(), 0);
+    for (int axis = 0; axis < ndim(); ++axis) {
+        result[axis] = qBound<qint64>(0, point.value(axis, 0), m_range[axis] - 1);
+    }
+    return result;
+}
+
+void Dims::restartPlaybackClock()
+{
+    m_playClock.start();
+    m_framesPlayed = 0;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+/**
+ * @brief Slicing state of the dimensions that are not displayed
+ *
+ * Layers with more dimensions than the view shows (time series, image
+ * stacks, label volumes) are cut at the current point: one index per
+ * leading, non-displayed dimension. Layers are aligned to the last
+ * dimensions, so a layer with one slider dimension follows the last
+ * slider of a scene with two.
+ *
+ * Playback advances one axis at a fixed rate. Ticks are scheduled
+ * against a clock, so timer latency does not accumulate and frames are
+ * shown at an even pace.
+ */
+class Dims : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * @param parent Parent object
+     */
+    explicit Dims(QObject* parent = nullptr);
+
+    /**
+     * @brief Get number of slider dimensions
+     * @return Dimension count
+     */
+    int ndim() const { return m_range.size(); }
+
+    /**
+     * @brief Get number of steps per dimension
+     * @return Step counts
+     */
+    const QVector<qint64>& range() const { return m_range; }
+
+    /**
+     * @brief Set number of steps per dimension
+     *
+     * The point is clamped to the new range; new dimensions start at 0.
+     *
+     * @param range Step counts
+     */
+    void setRange(const QVector<qint64>& range);
+
+    /**
+     * @brief Get current index per dimension
+     * @return Indices
+     */
+    const QVector<qint64>& point() const { return m_point; }
+
+    /**
+     * @brief Set current index per dimension
+     * @param point Indices, clamped to the range
+     */
+    void setPoint(const QVector<qint64>& point);
+
+    /**
+     * @brief Set current index of one dimension
+     * @param axis Dimension
+     * @param index Index, clamped to the range
+     */
+    void setIndex(int axis, qint64 index);
+
+    /**
+     * @brief Move one dimension by a number of steps
+     * @param axis Dimension
+     * @param delta Steps; wraps around when looping is enabled
+     */
+    void step(int axis, qint64 delta);
+
+    /**
+     * @brief Get the point of a layer with fewer slider dimensions
+     * @param dimensions Slider dimensions of the layer
+     * @return The last dimensions of point()
+     */
+    QVector<qint64> alignedPoint(int dimensions) const;
+
+    /**
+     * @brief Check if playback is running
+     * @return true while playing
+     */
+    bool isPlaying() const { return m_playTimer.isActive(); }
+
+    /**
+     * @brief Get dimension advanced by playback
+     * @return Axis
+     */
+    int playbackAxis() const { return m_playbackAxis; }
+
+    /**
+     * @brief Get playback rate
+     * @return Frames per second
+     */
+    double fps() const { return m_fps; }
+
+    /**
+     * @brief Set playback rate
+     * @param fps Frames per second; negative rates play backwards
+     */
+    void setFps(double fps);
+
+    /**
+     * @brief Check if playback wraps around at the end
+     * @return true if looping
+     */
+    bool isLooping() const { return m_loop; }
+
+    /**
+     * @brief Set if playback wraps around at the end
+     * @param loop true to loop
+     */
+    void setLooping(bool loop) { m_loop = loop; }
+
+public slots:
+    /**
+     * @brief Start playback
+     * @param axis Dimension to advance
+     */
+    void play(int axis = 0);
+
+    /**
+     * @brief Stop playback
+     */
+    void stop();
+
+signals:
+    /**
+     * @brief Emitted when the number of dimensions or their steps change
+     * @param range Step counts
+     */
+    void rangeChanged(const QVector<qint64>& range);
+
+    /**
+     * @brief Emitted when the current point changes
+     * @param point Indices
+     */
+    void pointChanged(const QVector<qint64>& point);
+
+    /**
+     * @brief Emitted when playback starts or stops
+     * @param playing true while playing
+     */
+    void playbackChanged(bool playing);
+
+private slots:
+    /**
+     * @brief Show the next frame and schedule the following one
+     */
+    void advancePlayback();
+
+private:
+    /**
+     * @brief Clamp a point to the range
+     * @param point Indices
+     * @return Clamped indices, one per dimension
+     */
+    QVector<qint64> clamped(const QVector<qint64>& point) const;
+
+    /**
+     * @brief Restart the playback clock at the current frame
+     */
+    void restartPlaybackClock();
+
+private:
+    QVector<qint64> m_range;
+    QVector<qint64> m_point;
+
+    // Playback
+    QTimer m_playTimer;
+    QElapsedTimer m_playClock;
+    qint64 m_framesPlayed;
+    int m_playbackAxis;
+    double m_fps;
+    bool m_loop;
+};
@@ -0,0 +1,20 @@
+#include "EventChannel.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutexLocker>
+
+void* EventChannelRegistry::channel(const char* typeName, void* (*create)())
+{
+    static QMutex mutex;
+    static QHash<QByteArray, void*> channels;
+
+    QMutexLocker locker(&mutex);
+    void*& channel = channels[QByteArray(typeName)];
+    if (!channel) {
+        // Channels live until the process exits, so a plugin unloaded
+        // after subscribing never leaves a dangling channel behind
+        channel = create();
+    }
+    return channel;
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include "CoreExport.h"
+#include "EventSystem.h"
+#include "../utils/SnapshotPtr.h"
+#include <QDebug>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPoint>
+#include <QVariantMap>
+#include <QVector>
+#include <QVector3D>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <typeinfo>
+
+/**
+ * @brief Legacy mapping of a typed channel payload
+ *
+ * Specialize for a payload type to forward every publish on its channel
+ * to EventSystem subscribers of legacyType. The payload is boxed by
+ * toVariant() only when such a subscriber exists.
+ */
+template<typename T>
+struct EventChannelTraits
+{
+    static constexpr bool hasLegacyType = false;
+    static constexpr CustomEventType legacyType = CustomEventType::UserDefined;
+    static QVariant toVariant(const T&) { return QVariant(); }
+};
+
+/**
+ * @brief Process-wide table of event channels, by payload type
+ *
+ * EventChannel is a header template, so every module that instantiates
+ * it would otherwise get its own channel; on Windows a plugin DLL would
+ * publish into a channel nobody in the application subscribed to. The
+ * table lives in the application and is shared by all modules.
+ */
+class TGUI_CORE_EXPORT EventChannelRegistry
+{
+public:
+    /**
+     * @brief Get channel of a payload type, creating it on first use
+     * @param typeName Payload type name, from typeid
+     * @param create Function allocating a new channel
+     * @return Channel
+     */
+    static void* channel(const char* typeName, void* (*create)());
+};
+
+/**
+ * @brief Synchronous publish/subscribe channel for one payload type
+ *
+ * There is one channel per payload type, reached through instance(), so
+ * routing is resolved at compile time instead of by hashing an event
+ * type. Handlers receive the payload by reference; publishing neither
+ * copies nor boxes it. Like EventSystem, subscriptions are copy-on-write
+ * snapshots read through a SnapshotPtr, so publish() locks only on the
+ * first call on a thread after a change, and handlers may unsubscribe
+ * from inside a dispatch.
+ */
+template<typename T>
+class EventChannel
+{
+public:
+    using Handler = std::function<void(const T&)>;
+
+    /**
+     * @brief Get channel of this payload type
+     *
+     * The same channel in the application and in every plugin module.
+     *
+     * @return Channel
+     */
+    static EventChannel& instance()
+    {
+        static EventChannel* const channel = static_cast<EventChannel*>(
+            EventChannelRegistry::channel(typeid(T).name(), []() -> void* { return new EventChannel; }));
+        return *channel;
+    }
+
+    /**
+     * @brief Subscribe to the channel
+     * @param handler Handler function
+     * @return Subscription ID
+     */
+    int subscribe(Handler handler) { return subscribe(nullptr, std::move(handler)); }
+
+    /**
+     * @brief Subscribe with object context
+     *
+     * The subscription ends automatically when the receiver is destroyed.
+     *
+     * @param receiver Receiver object
+     * @param handler Handler function
+     * @return Subscription ID
+     */
+    int subscribe(QObject* receiver, Handler handler)
+    {
+        QMutexLocker locker(&m_writeMutex);
+
+        auto subscription = std::make_shared<Subscription>();
+        subscription->id = m_nextSubscriptionId++;
+        subscription->handler = std::move(handler);
+
+        if (receiver) {
+            const int id = subscription->id;
+            subscription->destroyedConnection = QObject::connect(
+                receiver, &QObject::destroyed, [this, id]() { unsubscribe(id); });
+        }
+
+        auto list = std::make_shared<SubscriptionList>(*subscriptions());
+        list->append(subscription);
+        m_subscriptionsById.insert(subscription->id, subscription);
+        m_subscriptions.store(std::move(list));
+        return subscription->id;
+    }
+
+    /**
+     * @brief Unsubscribe
+     * @param subscriptionId Subscription ID
+     */
+    void unsubscribe(int subscriptionId)
+    {
+        QMutexLocker locker(&m_writeMutex);
+
+        const SubscriptionPtr subscription = m_subscriptionsById.take(subscriptionId);
+        if (!subscription) {
+            return;
+        }
+
+        subscription->active.store(false, std::memory_order_release);
+        QObject::disconnect(subscription->destroyedConnection);
+
+        auto list = std::make_shared<SubscriptionList>(*subscriptions());
+        list->removeOne(subscription);
+        m_subscriptions.store(std::move(list));
+    }
+
+    /**
+     * @brief Check if the channel has subscribers
+     * @return true if at least one handler is subscribed
+     */
+    bool hasSubscribers() const { return !subscriptions()->isEmpty(); }
+
+    /**
+     * @brief Get number of subscribers
+     * @return Subscriber count
+     */
+    int subscriberCount() const { return subscriptions()->size(); }
+
+    /**
+     * @brief Deliver a payload to all handlers on the calling thread
+     *
+     * Payloads with a legacy mapping are also published to EventSystem
+     * subscribers of the mapped CustomEventType, if there are any.
+     *
+     * @param payload Payload
+     */
+    void publish(const T& payload) const
+    {
+        const std::shared_ptr<const SubscriptionList> list = subscriptions();
+        for (const SubscriptionPtr& subscription : *list) {
+            if (!subscription->active.load(std::memory_order_acquire)) {
+                continue;
+            }
+            try {
+                subscription->handler(payload);
+            } catch (const std::exception& e) {
+                qWarning() << "Exception in channel handler:" << e.what();
+            } catch (...) {
+                qWarning() << "Unknown exception in channel handler";
+            }
+        }
+
+        if (EventChannelTraits<T>::hasLegacyType) {
+            EventSystem* eventSystem = EventSystem::instance();
+            if (eventSystem && eventSystem->hasSubscribers(EventChannelTraits<T>::legacyType)) {
+                eventSystem->publish(EventChannelTraits<T>::legacyType, EventChannelTraits<T>::toVariant(payload));
+            }
+        }
+    }
+
+private:
+    EventChannel() : m_nextSubscriptionId(1) {}
+    EventChannel(const EventChannel&) = delete;
+    EventChannel& operator=(const EventChannel&) = delete;
+
+    struct Subscription
+    {
+        int id = 0;
+        Handler handler;
+        QMetaObject::Connection destroyedConnection;
+        std::atomic<bool> active{true};
+    };
+
+    using SubscriptionPtr = std::shared_ptr<Subscription>;
+    using SubscriptionList = QVector<SubscriptionPtr>;
+
+    std::shared_ptr<const SubscriptionList> subscriptions() const
+    {
+        std::shared_ptr<const SubscriptionList> list = m_subscriptions.load();
+        if (!list) {
+            static const std::shared_ptr<const SubscriptionList> empty = std::make_shared<SubscriptionList>();
+            return empty;
+        }
+        return list;
+    }
+
+private:
+    // Readers load the snapshot, writers replace it under m_writeMutex
+    SnapshotPtr<SubscriptionList> m_subscriptions;
+
+    // Writer state, guarded by m_writeMutex
+    QMutex m_writeMutex;
+    QHash<int, SubscriptionPtr> m_subscriptionsById;
+    int m_nextSubscriptionId;
+};
+
+/**
+ * @brief Per-frame view change of a viewer
+ */
+struct ViewChangedPayload
+{
+    QVector3D center;   ///< View center in world coordinates
+    float zoom;         ///< Zoom level
+};
+
+/**
+ * @brief Mouse position over a viewer
+ */
+struct MousePositionPayload
+{
+    QVector3D worldPos; ///< Position in world coordinates
+    QPoint screenPos;   ///< Position in widget pixels
+};
+
+/**
+ * @brief Progress tick of a file load
+ */
+struct FileLoadProgressPayload
+{
+    int requestId;      ///< Load request ID
+    QString fileName;   ///< File being loaded
+    int progress;       ///< Progress in percent
+};
+
+/**
+ * @brief Progress tick of a processing job
+ */
+struct ProcessingProgressPayload
+{
+    int jobId;          ///< Processing job ID
+    QString operation;  ///< Operation name
+    int progress;       ///< Progress in percent
+};
+
+template<>
+struct EventChannelTraits<ViewChangedPayload>
+{
+    static constexpr bool hasLegacyType = true;
+    static constexpr CustomEventType legacyType = CustomEventType::ViewChanged;
+    static QVariant toVariant(const ViewChangedPayload& payload)
+    {
+        QVariantMap data;
+        data.insert("center", payload.center);
+        data.insert("zoom", payload.zoom);
+        return data;
+    }
+};
+
+template<>
+struct EventChannelTraits<FileLoadProgressPayload>
+{
+    static constexpr bool hasLegacyType = true;
+    static constexpr CustomEventType legacyType = CustomEventType::FileLoadProgress;
+    static QVariant toVariant(const FileLoadProgressPayload& payload)
+    {
+        QVariantMap data;
+        data.insert("requestId", payload.requestId);
+        data.insert("fileName", payload.fileName);
+        data.insert("progress", payload.progress);
+        return data;
+    }
+};
+
+template<>
+struct EventChannelTraits<ProcessingProgressPayload>
+{
+    static constexpr bool hasLegacyType = true;
+    static constexpr CustomEventType legacyType = CustomEventType::ProcessingProgress;
+    static QVariant toVariant(const ProcessingProgressPayload& payload)
+    {
+        QVariantMap data;
+        data.insert("jobId", payload.jobId);
+        data.insert("operation", payload.operation);
+        data.insert("progress", payload.progress);
+        return data;
+    }
+};
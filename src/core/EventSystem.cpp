@@ -1,15 +1,34 @@
 #include "EventSystem.h"
+#include "../utils/Profiler.h"
 #include <QCoreApplication>
 #include <QDebug>
+#include <QMutexLocker>
 
 EventSystem* EventSystem::s_instance = nullptr;
 
+namespace {
+
+// Enough for several frames of a fast producer
+const int kQueueCapacity = 16384;
+
+// About one display refresh
+const int kDefaultDrainInterval = 16;
+
+} // namespace
+
 EventSystem::EventSystem(QObject* parent)
     : QObject(parent)
     , m_nextSubscriptionId(1)
+    , m_queue(kQueueCapacity)
+    , m_drainScheduled(false)
+    , m_queueOverflows(0)
     , m_eventLogging(false)
 {
     s_instance = this;
+
+    m_drainTimer.setSingleShot(true);
+    m_drainTimer.setInterval(kDefaultDrainInterval);
+    connect(&m_drainTimer, &QTimer::timeout, this, &EventSystem::onDrainTimeout);
 }
 
 EventSystem::~EventSystem()
@@ -30,14 +49,30 @@ int EventSystem::subscribe(CustomEventType eventType, EventHandler handler)
 
 int EventSystem::subscribe(CustomEventType eventType, QObject* receiver, EventHandler handler)
 {
+    QMutexLocker locker(&m_writeMutex);
+
     int subscriptionId = m_nextSubscriptionId++;
-    
-    Subscription subscription(subscriptionId, eventType, receiver, handler);
-    m_subscriptions[eventType].append(subscription);
-    
+    SubscriptionPtr subscription = std::make_shared<Subscription>(subscriptionId, eventType, receiver, handler);
+    m_subscriptionsById.insert(subscriptionId, subscription);
+
+    // Copy only the list of this type; the other lists are shared
+    SubscriptionTable table = *subscriptionTable();
+    auto list = std::make_shared<SubscriptionList>();
+    if (const auto current = table.value(eventType)) {
+        *list = *current;
+    }
+    list->append(subscription);
+    table.insert(eventType, list);
+    m_table.store(std::make_shared<SubscriptionTable>(std::move(table)));
+
     if (receiver) {
-        m_objectSubscriptions[receiver].append(subscriptionId);
-        connect(receiver, &QObject::destroyed, this, &EventSystem::onObjectDestroyed);
+        QVector<int>& ids = m_objectSubscriptions[receiver];
+        if (ids.isEmpty()) {
+            // Direct, so subscriptions are gone before the receiver is, on any thread
+            connect(receiver, &QObject::destroyed, this, &EventSystem::onObjectDestroyed,
+                    Qt::DirectConnection);
+        }
+        ids.append(subscriptionId);
     }
     
     return subscriptionId;
@@ -45,35 +80,90 @@ int EventSystem::subscribe(CustomEventType eventType, QObject* receiver, EventHa
 
 void EventSystem::unsubscribe(int subscriptionId)
 {
-    for (auto& subscriptionList : m_subscriptions) {
-        for (int i = 0; i < subscriptionList.size(); ++i) {
-            if (subscriptionList[i].id == subscriptionId) {
-                QObject* receiver = subscriptionList[i].receiver;
-                subscriptionList.removeAt(i);
-                
-                // Remove from object subscriptions
-                if (receiver && m_objectSubscriptions.contains(receiver)) {
-                    m_objectSubscriptions[receiver].removeAll(subscriptionId);
-                    if (m_objectSubscriptions[receiver].isEmpty()) {
-                        m_objectSubscriptions.remove(receiver);
-                    }
-                }
-                return;
+    QMutexLocker locker(&m_writeMutex);
+
+    auto it = m_subscriptionsById.constFind(subscriptionId);
+    if (it == m_subscriptionsById.constEnd()) {
+        return;
+    }
+
+    QObject* receiver = (*it)->receiver;
+    if (receiver) {
+        auto objectIt = m_objectSubscriptions.find(receiver);
+        if (objectIt != m_objectSubscriptions.end()) {
+            objectIt->removeOne(subscriptionId);
+            if (objectIt->isEmpty()) {
+                m_objectSubscriptions.erase(objectIt);
+                disconnect(receiver, &QObject::destroyed, this, &EventSystem::onObjectDestroyed);
             }
         }
     }
+
+    removeSubscriptionsLocked(QVector<int>() << subscriptionId);
 }
 
 void EventSystem::unsubscribe(QObject* receiver)
 {
+    QMutexLocker locker(&m_writeMutex);
+
     if (!receiver || !m_objectSubscriptions.contains(receiver)) {
         return;
     }
     
-    QList<int> subscriptionIds = m_objectSubscriptions[receiver];
-    for (int id : subscriptionIds) {
-        unsubscribe(id);
+    const QVector<int> subscriptionIds = m_objectSubscriptions.take(receiver);
+    disconnect(receiver, &QObject::destroyed, this, &EventSystem::onObjectDestroyed);
+    removeSubscriptionsLocked(subscriptionIds);
+}
+
+std::shared_ptr<const EventSystem::SubscriptionTable> EventSystem::subscriptionTable() const
+{
+    std::shared_ptr<const SubscriptionTable> table = m_table.load();
+    if (!table) {
+        static const std::shared_ptr<const SubscriptionTable> empty = std::make_shared<SubscriptionTable>();
+        return empty;
+    }
+    return table;
+}
+
+void EventSystem::removeSubscriptionsLocked(const QVector<int>& ids)
+{
+    QSet<CustomEventType> types;
+    for (int id : ids) {
+        const SubscriptionPtr subscription = m_subscriptionsById.take(id);
+        if (subscription) {
+            // Handlers already in a dispatch loop skip it from now on
+            subscription->active.store(false, std::memory_order_release);
+            types.insert(subscription->eventType);
+        }
+    }
+
+    if (types.isEmpty()) {
+        return;
     }
+
+    // One new table for the whole batch, copying only the affected lists
+    SubscriptionTable table = *subscriptionTable();
+    for (CustomEventType type : qAsConst(types)) {
+        const auto current = table.value(type);
+        if (!current) {
+            continue;
+        }
+
+        auto list = std::make_shared<SubscriptionList>();
+        list->reserve(current->size());
+        for (const SubscriptionPtr& subscription : *current) {
+            if (subscription->active.load(std::memory_order_relaxed)) {
+                list->append(subscription);
+            }
+        }
+
+        if (list->isEmpty()) {
+            table.remove(type);
+        } else {
+            table.insert(type, list);
+        }
+    }
+    m_table.store(std::make_shared<SubscriptionTable>(std::move(table)));
 }
 
 void EventSystem::publish(CustomEventType eventType, const QVariant& data)
@@ -94,23 +184,110 @@ void EventSystem::publishAsync(CustomEventType eventType, const QVariant& data)
     QCoreApplication::postEvent(this, event);
 }
 
+void EventSystem::publishQueued(CustomEventType eventType, const QVariant& data)
+{
+    QueuedEvent queued;
+    queued.type = eventType;
+    queued.data = data;
+
+    if (!m_queue.tryPush(std::move(queued))) {
+        m_queueOverflows.fetch_add(1, std::memory_order_relaxed);
+        publishAsync(eventType, data);
+        return;
+    }
+
+    // Only the first event after a drain wakes up the event system thread
+    if (!m_drainScheduled.exchange(true, std::memory_order_acq_rel)) {
+        QMetaObject::invokeMethod(this, [this]() { scheduleQueueDrain(); }, Qt::QueuedConnection);
+    }
+}
+
+int EventSystem::processQueuedEvents(int maxEvents)
+{
+    m_drainBatch.clear();
+
+    QueuedEvent queued;
+    while ((maxEvents < 0 || m_drainBatch.size() < maxEvents) && m_queue.tryPop(queued)) {
+        m_drainBatch.append(std::move(queued));
+    }
+
+    const int count = m_drainBatch.size();
+    if (count == 0) {
+        return 0;
+    }
+
+    // Position of the latest event of every coalesced type in the batch
+    QHash<CustomEventType, int> latest;
+    if (!m_coalescedTypes.isEmpty()) {
+        for (int i = 0; i < count; ++i) {
+            if (m_coalescedTypes.contains(m_drainBatch[i].type)) {
+                latest.insert(m_drainBatch[i].type, i);
+            }
+        }
+    }
+
+    for (int i = 0; i < count; ++i) {
+        const QueuedEvent& event = m_drainBatch[i];
+        auto it = latest.constFind(event.type);
+        if (it != latest.constEnd() && *it != i) {
+            continue;
+        }
+        publish(event.type, event.data);
+    }
+
+    // Keep the capacity, drop the payloads
+    m_drainBatch.clear();
+    return count;
+}
+
+void EventSystem::setCoalesced(CustomEventType eventType, bool coalesced)
+{
+    if (coalesced) {
+        m_coalescedTypes.insert(eventType);
+    } else {
+        m_coalescedTypes.remove(eventType);
+    }
+}
+
+void EventSystem::scheduleQueueDrain()
+{
+    if (!m_drainTimer.isActive()) {
+        m_drainTimer.start();
+    }
+}
+
+void EventSystem::onDrainTimeout()
+{
+    // Cleared first, so events pushed during delivery schedule a new drain
+    m_drainScheduled.store(false, std::memory_order_release);
+    processQueuedEvents();
+}
+
 bool EventSystem::hasSubscribers(CustomEventType eventType) const
 {
-    return m_subscriptions.contains(eventType) && !m_subscriptions[eventType].isEmpty();
+    return subscriptionTable()->contains(eventType);
 }
 
 int EventSystem::subscriberCount(CustomEventType eventType) const
 {
-    if (m_subscriptions.contains(eventType)) {
-        return m_subscriptions[eventType].size();
-    }
-    return 0;
+    const auto list = subscriptionTable()->value(eventType);
+    return list ? list->size() : 0;
 }
 
 void EventSystem::clear()
 {
-    m_subscriptions.clear();
+    QMutexLocker locker(&m_writeMutex);
+
+    for (const SubscriptionPtr& subscription : qAsConst(m_subscriptionsById)) {
+        subscription->active.store(false, std::memory_order_release);
+    }
+    for (auto it = m_objectSubscriptions.constBegin(); it != m_objectSubscriptions.constEnd(); ++it) {
+        disconnect(it.key(), &QObject::destroyed, this, &EventSystem::onObjectDestroyed);
+    }
+
+    m_subscriptionsById.clear();
     m_objectSubscriptions.clear();
+    m_table.store(nullptr);
 }
 
 bool EventSystem::event(QEvent* event)
@@ -131,16 +308,22 @@ void EventSystem::onObjectDestroyed(QObject* obj)
 
 void EventSystem::processEvent(const CustomEvent& event)
 {
+    PROFILE_SCOPE("EventSystem::processEvent");
     CustomEventType eventType = event.customType();
-    
-    if (!m_subscriptions.contains(eventType)) {
+
+    // The snapshot keeps the list alive even if a handler unsubscribes
+    const std::shared_ptr<const SubscriptionTable> table = subscriptionTable();
+    const auto subscriptions = table->value(eventType);
+    if (!subscriptions) {
         return;
     }
     
-    const QList<Subscription>& subscriptions = m_subscriptions[eventType];
-    for (const Subscription& subscription : subscriptions) {
+    for (const SubscriptionPtr& subscription : *subscriptions) {
+        if (!subscription->active.load(std::memory_order_acquire)) {
+            continue;
+        }
         try {
-            subscription.handler(event);
+            subscription->handler(event);
         } catch (const std::exception& e) {
             qWarning() << "Exception in event handler:" << e.what();
         } catch (...) {
@@ -176,6 +359,15 @@ QString EventSystem::eventTypeName(CustomEventType eventType) const
     case CustomEventType::ConfigurationChanged: return "ConfigurationChanged";
     case CustomEventType::FileOpened:          return "FileOpened";
     case CustomEventType::FileSaved:           return "FileSaved";
+    case CustomEventType::FileLoadStarted:     return "FileLoadStarted";
+    case CustomEventType::FileLoadProgress:    return "FileLoadProgress";
+    case CustomEventType::FileLoadFailed:      return "FileLoadFailed";
+    case CustomEventType::FileLoadCancelled:   return "FileLoadCancelled";
+    case CustomEventType::ProcessingStarted:   return "ProcessingStarted";
+    case CustomEventType::ProcessingProgress:  return "ProcessingProgress";
+    case CustomEventType::ProcessingFinished:  return "ProcessingFinished";
+    case CustomEventType::ProcessingFailed:    return "ProcessingFailed";
+    case CustomEventType::ProcessingCancelled: return "ProcessingCancelled";
     default:                                    return "Unknown";
     }
 }
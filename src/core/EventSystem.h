@@ -5,7 +5,15 @@
 #include <QVariant>
 #include <QHash>
 #include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
 #include <functional>
+#include <memory>
+#include "../utils/LockFreeQueue.h"
+#include "../utils/SnapshotPtr.h"
 
 /**
  * @brief Custom event types
@@ -24,6 +32,15 @@ enum class CustomEventType
     ConfigurationChanged,
     FileOpened,
     FileSaved,
+    FileLoadStarted,
+    FileLoadProgress,
+    FileLoadFailed,
+    FileLoadCancelled,
+    ProcessingStarted,
+    ProcessingProgress,
+    ProcessingFinished,
+    ProcessingFailed,
+    ProcessingCancelled,
     UserDefined = QEvent::User + 1000
 };
 
@@ -75,6 +92,20 @@ using EventHandler = std::function<void(const CustomEvent&)>;
  * @brief Event system class
  * 
  * Provides a centralized event system for communication between components.
+ *
+ * Besides synchronous publish() and posted publishAsync(), high-rate
+ * producers on worker threads can use publishQueued(). Queued events go
+ * into a fixed-size lock-free ring and are delivered on the event system's
+ * thread in batches, at most once per drain interval (one frame by
+ * default). Types marked with setCoalesced() are delivered only once per
+ * batch, with the data of the latest event.
+ *
+ * Subscribing and unsubscribing are thread-safe and allowed from inside
+ * handlers. Writers copy the affected subscription list under a mutex and
+ * swap in a new immutable table; dispatch reads the current table through
+ * a SnapshotPtr, which locks only on the first dispatch on a thread after
+ * a change. A handler unsubscribed while an event is being dispatched is
+ * not called for the rest of that dispatch.
  */
 class EventSystem : public QObject
 {
@@ -141,6 +172,63 @@ public:
      */
     void publishAsync(CustomEventType eventType, const QVariant& data = QVariant());
 
+    /**
+     * @brief Publish event through the queued dispatch
+     *
+     * Thread-safe. The push into the ring is lock-free; only the first
+     * event after a drain posts a wake-up to the event system's thread,
+     * which takes Qt's event queue lock. If the ring is full the event
+     * falls back to publishAsync(), so it is still delivered, possibly
+     * out of order.
+     *
+     * @param eventType Event type
+     * @param data Event data
+     */
+    void publishQueued(CustomEventType eventType, const QVariant& data = QVariant());
+
+    /**
+     * @brief Deliver queued events now
+     *
+     * Called automatically after each drain interval; must run on the
+     * event system's thread.
+     *
+     * @param maxEvents Maximum number of events to take from the ring (-1 for all)
+     * @return Number of events taken from the ring
+     */
+    int processQueuedEvents(int maxEvents = -1);
+
+    /**
+     * @brief Set whether queued events of a type are coalesced
+     * @param eventType Event type
+     * @param coalesced true to deliver only the latest event per batch
+     */
+    void setCoalesced(CustomEventType eventType, bool coalesced);
+
+    /**
+     * @brief Check if queued events of a type are coalesced
+     * @param eventType Event type
+     * @return true if coalesced
+     */
+    bool isCoalesced(CustomEventType eventType) const { return m_coalescedTypes.contains(eventType); }
+
+    /**
+     * @brief Set delay between the first queued event and its delivery
+     * @param msec Interval in milliseconds
+     */
+    void setQueueDrainInterval(int msec) { m_drainTimer.setInterval(qMax(0, msec)); }
+
+    /**
+     * @brief Get delay between the first queued event and its delivery
+     * @return Interval in milliseconds
+     */
+    int queueDrainInterval() const { return m_drainTimer.interval(); }
+
+    /**
+     * @brief Get number of queued events that overflowed the ring
+     * @return Overflow count
+     */
+    quint64 queueOverflowCount() const { return m_queueOverflows.load(std::memory_order_relaxed); }
+
     /**
      * @brief Check if there are subscribers for event type
      * @param eventType Event type
@@ -195,6 +283,11 @@ private slots:
      */
     void onObjectDestroyed(QObject* obj);
 
+    /**
+     * @brief Deliver the queued events and re-arm if more arrived
+     */
+    void onDrainTimeout();
+
 private:
     /**
      * @brief Subscription information
@@ -205,11 +298,46 @@ private:
         CustomEventType eventType;
         QObject* receiver;
         EventHandler handler;
+        std::atomic<bool> active;
         
         Subscription(int id, CustomEventType type, QObject* recv, EventHandler h)
-            : id(id), eventType(type), receiver(recv), handler(h) {}
+            : id(id), eventType(type), receiver(recv), handler(h), active(true) {}
+    };
+
+    using SubscriptionPtr = std::shared_ptr<Subscription>;
+    using SubscriptionList = QVector<SubscriptionPtr>;
+
+    /**
+     * @brief Immutable snapshot of all subscriptions, by event type
+     */
+    using SubscriptionTable = QHash<CustomEventType, std::shared_ptr<const SubscriptionList>>;
+
+    /**
+     * @brief Get current subscription table
+     * @return Snapshot, never null
+     */
+    std::shared_ptr<const SubscriptionTable> subscriptionTable() const;
+
+    /**
+     * @brief Remove subscriptions and publish the new table (writer mutex held)
+     * @param ids Subscription IDs
+     */
+    void removeSubscriptionsLocked(const QVector<int>& ids);
+
+    /**
+     * @brief Event waiting in the queued dispatch ring
+     */
+    struct QueuedEvent
+    {
+        CustomEventType type = CustomEventType::UserDefined;
+        QVariant data;
     };
 
+    /**
+     * @brief Start the drain timer (event system thread only)
+     */
+    void scheduleQueueDrain();
+
     /**
      * @brief Process event synchronously
      * @param event Custom event
@@ -233,11 +361,23 @@ private:
 private:
     static EventSystem* s_instance;
 
-    // Subscriptions
-    QHash<CustomEventType, QList<Subscription>> m_subscriptions;
-    QHash<QObject*, QList<int>> m_objectSubscriptions;
+    // Subscriptions; readers load the snapshot, writers replace it under m_writeMutex
+    SnapshotPtr<SubscriptionTable> m_table;
+
+    // Writer state, guarded by m_writeMutex
+    QMutex m_writeMutex;
+    QHash<int, SubscriptionPtr> m_subscriptionsById;
+    QHash<QObject*, QVector<int>> m_objectSubscriptions;
     int m_nextSubscriptionId;
 
+    // Queued dispatch; slots of the ring are reused, not allocated per event
+    LockFreeQueue<QueuedEvent> m_queue;
+    std::atomic<bool> m_drainScheduled;
+    std::atomic<quint64> m_queueOverflows;
+    QTimer m_drainTimer;
+    QSet<CustomEventType> m_coalescedTypes;
+    QVector<QueuedEvent> m_drainBatch;
+
     // Configuration
     bool m_eventLogging;
 };
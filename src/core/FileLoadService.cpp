@@ -0,0 +1,278 @@
+#include "FileLoadService.h"
+#include "Application.h"
+#include "DataLoader.h"
+#include "EventChannel.h"
+#include "ImageLayer.h"
+#include "LayerManager.h"
+#include "TiledImageLayer.h"
+#include "TileSource.h"
+#include "../plugins/PluginManager.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+
+FileLoadService* FileLoadService::s_instance = nullptr;
+
+/**
+ * @brief Worker task loading a single file
+ */
+class FileLoadTask : public QRunnable
+{
+public:
+    FileLoadTask(FileLoadService* service, int requestId, const std::shared_ptr<LoadRequest>& request,
+                 const QList<DataPluginInterface*>& plugins)
+        : m_service(service), m_requestId(requestId), m_request(request), m_plugins(plugins) {}
+
+    void run() override
+    {
+        m_service->runLoad(m_requestId, m_request, m_plugins);
+    }
+
+private:
+    FileLoadService* m_service;
+    int m_requestId;
+    std::shared_ptr<LoadRequest> m_request;
+    QList<DataPluginInterface*> m_plugins;
+};
+
+FileLoadService::FileLoadService(QObject* parent)
+    : QObject(parent)
+    , m_nextRequestId(1)
+{
+    s_instance = this;
+
+    // Loads are dominated by I/O; a few in parallel keep the disk busy
+    m_pool.setMaxThreadCount(qBound(2, QThread::idealThreadCount() / 2, 4));
+}
+
+FileLoadService::~FileLoadService()
+{
+    shutdown();
+
+    // Layers that finished after the last delivery are still owned here
+    for (const Result& result : qAsConst(m_results)) {
+        delete result.layer;
+    }
+
+    if (s_instance == this) {
+        s_instance = nullptr;
+    }
+}
+
+FileLoadService* FileLoadService::instance()
+{
+    return s_instance;
+}
+
+int FileLoadService::load(const QString& fileName)
+{
+    const int requestId = m_nextRequestId++;
+    auto request = std::make_shared<LoadRequest>(fileName);
+
+    // Progress arrives on the worker thread; forward it to the GUI thread
+    request->setProgressCallback([this, requestId, fileName](int percent) {
+        QMetaObject::invokeMethod(this, [this, requestId, fileName, percent]() {
+            if (m_requests.contains(requestId)) {
+                emit loadProgress(requestId, fileName, percent);
+                // Typed channel; legacy FileLoadProgress subscribers still get a QVariantMap
+                EventChannel<FileLoadProgressPayload>::instance().publish({requestId, fileName, percent});
+            }
+        }, Qt::QueuedConnection);
+    });
+
+    // Plugins are queried here because the plugin manager is not thread-safe
+    QList<DataPluginInterface*> plugins;
+    Application* app = Application::instance();
+    if (app && app->pluginManager()) {
+        for (DataPluginInterface* plugin : app->pluginManager()->pluginsByInterface<DataPluginInterface>()) {
+            if (plugin->canHandle(fileName)) {
+                plugins.append(plugin);
+            }
+        }
+    }
+
+    m_requests.insert(requestId, request);
+    m_pool.start(new FileLoadTask(this, requestId, request, plugins));
+
+    emit loadStarted(requestId, fileName);
+    publish(CustomEventType::FileLoadStarted, requestId, fileName);
+    return requestId;
+}
+
+void FileLoadService::cancel(int requestId)
+{
+    std::shared_ptr<LoadRequest> request = m_requests.take(requestId);
+    if (!request) {
+        return;
+    }
+
+    // The worker notices the flag at its next check; its result is dropped
+    request->cancel();
+    emit loadCancelled(requestId, request->fileName());
+    publish(CustomEventType::FileLoadCancelled, requestId, request->fileName());
+}
+
+void FileLoadService::cancelAll()
+{
+    const QList<int> requestIds = m_requests.keys();
+    for (int requestId : requestIds) {
+        cancel(requestId);
+    }
+}
+
+void FileLoadService::shutdown()
+{
+    cancelAll();
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void FileLoadService::runLoad(int requestId, const std::shared_ptr<LoadRequest>& request,
+                              const QList<DataPluginInterface*>& plugins)
+{
+    const QString fileName = request->fileName();
+    const QString layerName = QFileInfo(fileName).completeBaseName();
+    Result result;
+
+    if (!request->isCancelled()) {
+        request->setProgress(0);
+
+        // Plugins get the first chance so they can override built-in formats
+        for (DataPluginInterface* plugin : plugins) {
+            if (request->isCancelled()) {
+                break;
+            }
+
+            DataBuffer buffer = plugin->loadBuffer(fileName, *request);
+            if (!buffer.isNull()) {
+                result.layer = DataLoader::createLayer(buffer, layerName);
+                break;
+            }
+
+            if (std::shared_ptr<TileSource> source = plugin->openTileSource(fileName)) {
+                result.layer = new TiledImageLayer(layerName, source);
+                break;
+            }
+
+            if (!result.legacyPlugin) {
+                result.legacyPlugin = plugin;
+            }
+        }
+
+        if (result.layer) {
+            result.legacyPlugin = nullptr;
+        }
+    }
+
+    const bool tryBuiltIn = !result.layer && !result.legacyPlugin && !request->isCancelled();
+
+    if (tryBuiltIn && DataLoader::canLoad(fileName)) {
+        DataBuffer buffer = DataLoader::load(fileName, &result.errorMessage, request.get());
+        if (!buffer.isNull()) {
+            result.layer = DataLoader::createLayer(buffer, layerName);
+        }
+    }
+
+    if (tryBuiltIn && !result.layer && !request->isCancelled()) {
+        // Compressed or common image formats go through Qt's decoders
+        QImageReader reader(fileName);
+        QImage image = reader.read();
+        if (!image.isNull()) {
+            ImageLayer* imageLayer = new ImageLayer(layerName);
+            imageLayer->setImage(image);
+            result.layer = imageLayer;
+        } else if (result.errorMessage.isEmpty()) {
+            result.errorMessage = QString("Cannot load %1: %2").arg(fileName, reader.errorString());
+        }
+    }
+
+    if (request->isCancelled()) {
+        delete result.layer;
+        return;
+    }
+
+    if (result.layer) {
+        // Layers are QObjects; the GUI thread must own them before use
+        result.layer->moveToThread(QCoreApplication::instance()->thread());
+        request->setProgress(100);
+    }
+
+    {
+        QMutexLocker locker(&m_resultsMutex);
+        m_results.insert(requestId, result);
+    }
+
+    QMetaObject::invokeMethod(this, [this]() { deliverResults(); }, Qt::QueuedConnection);
+}
+
+void FileLoadService::deliverResults()
+{
+    QHash<int, Result> results;
+    {
+        QMutexLocker locker(&m_resultsMutex);
+        results.swap(m_results);
+    }
+
+    for (auto it = results.constBegin(); it != results.constEnd(); ++it) {
+        const int requestId = it.key();
+        Result result = it.value();
+
+        std::shared_ptr<LoadRequest> request = m_requests.take(requestId);
+        if (!request || request->isCancelled()) {
+            // Cancelled while the worker was finishing
+            delete result.layer;
+            continue;
+        }
+
+        const QString fileName = request->fileName();
+
+        if (result.legacyPlugin) {
+            if (result.legacyPlugin->loadData(fileName)) {
+                emit loadFinished(requestId, fileName, nullptr);
+                publish(CustomEventType::FileOpened, requestId, fileName);
+                continue;
+            }
+            result.errorMessage = QString("Plugin failed to load %1").arg(fileName);
+        }
+
+        if (result.layer && !m_layerManager) {
+            delete result.layer;
+            result.layer = nullptr;
+            result.errorMessage = "No layer manager available";
+        }
+
+        if (!result.layer) {
+            if (result.errorMessage.isEmpty()) {
+                result.errorMessage = QString("Cannot load %1").arg(fileName);
+            }
+            qWarning() << "File load failed:" << result.errorMessage;
+            emit loadFailed(requestId, fileName, result.errorMessage);
+            publish(CustomEventType::FileLoadFailed, requestId, fileName, {{"error", result.errorMessage}});
+            continue;
+        }
+
+        m_layerManager->addLayer(result.layer);
+        emit loadFinished(requestId, fileName, result.layer);
+        publish(CustomEventType::FileOpened, requestId, fileName, {{"layerName", result.layer->name()}});
+    }
+}
+
+void FileLoadService::publish(CustomEventType eventType, int requestId, const QString& fileName,
+                              const QVariantMap& extra)
+{
+    EventSystem* eventSystem = EventSystem::instance();
+    if (!eventSystem) {
+        return;
+    }
+
+    QVariantMap data = extra;
+    data.insert("requestId", requestId);
+    data.insert("fileName", fileName);
+    eventSystem->publish(eventType, data);
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "EventSystem.h"
+#include "LoadRequest.h"
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QThreadPool>
+#include <QVariantMap>
+#include <memory>
+
+class Layer;
+class LayerManager;
+class DataPluginInterface;
+
+/**
+ * @brief Loads files into layers on a background thread pool
+ *
+ * Each load() runs plugins and the built-in DataLoader on a worker
+ * thread, builds the layer there and hands it to the GUI thread, where it
+ * is added to the LayerManager. Progress and results are reported through
+ * signals and through EventSystem (FileLoadStarted, FileLoadProgress,
+ * FileOpened, FileLoadFailed and FileLoadCancelled, each carrying a
+ * QVariantMap with "requestId" and "fileName").
+ *
+ * All public functions must be called on the GUI thread.
+ */
+class FileLoadService : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * @param parent Parent object
+     */
+    explicit FileLoadService(QObject* parent = nullptr);
+
+    /**
+     * @brief Destructor
+     */
+    ~FileLoadService();
+
+    /**
+     * @brief Get singleton instance
+     * @return FileLoadService instance
+     */
+    static FileLoadService* instance();
+
+    /**
+     * @brief Set layer manager receiving loaded layers
+     * @param layerManager Layer manager
+     */
+    void setLayerManager(LayerManager* layerManager) { m_layerManager = layerManager; }
+
+    /**
+     * @brief Start loading a file
+     * @param fileName File name
+     * @return Request id
+     */
+    int load(const QString& fileName);
+
+    /**
+     * @brief Cancel a pending load
+     * @param requestId Request id
+     */
+    void cancel(int requestId);
+
+    /**
+     * @brief Cancel all pending loads
+     */
+    void cancelAll();
+
+    /**
+     * @brief Cancel all loads and wait for the workers to stop
+     */
+    void shutdown();
+
+    /**
+     * @brief Check if a load is still pending
+     * @param requestId Request id
+     * @return true if pending
+     */
+    bool isPending(int requestId) const { return m_requests.contains(requestId); }
+
+    /**
+     * @brief Get number of pending loads
+     * @return Pending load count
+     */
+    int pendingCount() const { return m_requests.size(); }
+
+signals:
+    /**
+     * @brief Emitted when a load is queued
+     * @param requestId Request id
+     * @param fileName File name
+     */
+    void loadStarted(int requestId, const QString& fileName);
+
+    /**
+     * @brief Emitted when a load reports progress
+     * @param requestId Request id
+     * @param fileName File name
+     * @param percent Percentage (0 - 100)
+     */
+    void loadProgress(int requestId, const QString& fileName, int percent);
+
+    /**
+     * @brief Emitted when a file was loaded
+     * @param requestId Request id
+     * @param fileName File name
+     * @param layer New layer, or nullptr if a plugin added its own layers
+     */
+    void loadFinished(int requestId, const QString& fileName, Layer* layer);
+
+    /**
+     * @brief Emitted when a load failed
+     * @param requestId Request id
+     * @param fileName File name
+     * @param errorMessage Reason
+     */
+    void loadFailed(int requestId, const QString& fileName, const QString& errorMessage);
+
+    /**
+     * @brief Emitted when a load was cancelled
+     * @param requestId Request id
+     * @param fileName File name
+     */
+    void loadCancelled(int requestId, const QString& fileName);
+
+private:
+    friend class FileLoadTask;
+
+    /**
+     * @brief Outcome of a worker load
+     */
+    struct Result
+    {
+        Layer* layer = nullptr;
+        DataPluginInterface* legacyPlugin = nullptr;
+        QString errorMessage;
+    };
+
+    /**
+     * @brief Load a file (runs on a worker thread)
+     * @param requestId Request id
+     * @param request Progress and cancellation state
+     * @param plugins Data plugins that accept the file, in priority order
+     */
+    void runLoad(int requestId, const std::shared_ptr<LoadRequest>& request,
+                 const QList<DataPluginInterface*>& plugins);
+
+    /**
+     * @brief Hand finished loads to the layer manager (GUI thread)
+     */
+    void deliverResults();
+
+    /**
+     * @brief Publish a load event
+     * @param eventType Event type
+     * @param requestId Request id
+     * @param fileName File name
+     * @param extra Additional entries
+     */
+    void publish(CustomEventType eventType, int requestId, const QString& fileName,
+                 const QVariantMap& extra = QVariantMap());
+
+private:
+    static FileLoadService* s_instance;
+
+    QThreadPool m_pool;
+    QPointer<LayerManager> m_layerManager;
+
+    // Pending requests (GUI thread only)
+    QHash<int, std::shared_ptr<LoadRequest>> m_requests;
+    int m_nextRequestId;
+
+    // Results waiting for delivery, written by workers
+    QMutex m_resultsMutex;
+    QHash<int, Result> m_results;
+};
@@ -0,0 +1,204 @@
+#include "FrameCache.h"
+
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <atomic>
+
+FrameCache* FrameCache::s_instance = nullptr;
+
+/**
+ * @brief Worker task decoding a single frame
+ */
+class FrameDecodeTask : public QRunnable
+{
+public:
+    FrameDecodeTask(FrameCache* cache, const FrameCache::CacheKey& key, const FrameCache::Decoder& decoder)
+        : m_cache(cache), m_key(key), m_decoder(decoder) {}
+
+    void run() override
+    {
+        m_cache->decodeFrame(m_key, m_decoder);
+    }
+
+private:
+    FrameCache* m_cache;
+    FrameCache::CacheKey m_key;
+    FrameCache::Decoder m_decoder;
+};
+
+namespace {
+
+int frameCostKb(const QImage& image)
+{
+    return qMax(1, int(image.sizeInBytes() / 1024));
+}
+
+} // namespace
+
+FrameCache::FrameCache(qint64 memoryBudget, QObject* parent)
+    : QObject(parent)
+    , m_shuttingDown(false)
+{
+    s_instance = this;
+
+    m_cache.setMaxCost(int(qMax<qint64>(1, memoryBudget / 1024)));
+
+    // A few frames ahead keep playback fed; leave cores for tiles and processing
+    m_pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount() / 2));
+}
+
+FrameCache::~FrameCache()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_shuttingDown = true;
+        m_wanted.clear();
+    }
+    m_pool.waitForDone();
+
+    if (s_instance == this) {
+        s_instance = nullptr;
+    }
+}
+
+FrameCache* FrameCache::instance()
+{
+    return s_instance;
+}
+
+quint64 FrameCache::createSourceId()
+{
+    static std::atomic<quint64> counter(1);
+    return counter++;
+}
+
+void FrameCache::setMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.setMaxCost(int(qMax<qint64>(1, bytes / 1024)));
+}
+
+qint64 FrameCache::memoryBudget() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_cache.maxCost()) * 1024;
+}
+
+qint64 FrameCache::memoryUsage() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_cache.totalCost()) * 1024;
+}
+
+QImage FrameCache::frame(quint64 sourceId, quint64 generation, qint64 frame) const
+{
+    QMutexLocker locker(&m_mutex);
+    QImage* image = m_cache.object(CacheKey{sourceId, generation, frame});
+    return image ? *image : QImage();
+}
+
+void FrameCache::insert(quint64 sourceId, quint64 generation, qint64 frame, const QImage& image)
+{
+    if (image.isNull()) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    auto it = m_wanted.constFind(sourceId);
+    if (m_shuttingDown || (it != m_wanted.constEnd() && it->generation != generation)) {
+        return;
+    }
+    m_cache.insert(CacheKey{sourceId, generation, frame}, new QImage(image), frameCostKb(image));
+}
+
+void FrameCache::request(quint64 sourceId, quint64 generation, const QVector<qint64>& frames,
+                         const Decoder& decoder)
+{
+    if (!decoder) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (m_shuttingDown) {
+        return;
+    }
+
+    Wanted& wanted = m_wanted[sourceId];
+    if (wanted.generation != generation) {
+        // Frames of older generations can never be shown again
+        removeFrames(sourceId, generation);
+        wanted.generation = generation;
+    }
+    wanted.frames.clear();
+
+    for (qint64 frame : frames) {
+        wanted.frames.insert(frame);
+
+        const CacheKey key{sourceId, generation, frame};
+        if (m_cache.contains(key) || m_inFlight.contains(key)) {
+            continue;
+        }
+
+        m_inFlight.insert(key);
+        m_pool.start(new FrameDecodeTask(this, key, decoder));
+    }
+}
+
+void FrameCache::removeSource(quint64 sourceId)
+{
+    QMutexLocker locker(&m_mutex);
+    m_wanted.remove(sourceId);
+    removeFrames(sourceId, 0);
+}
+
+void FrameCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.clear();
+}
+
+void FrameCache::removeFrames(quint64 sourceId, quint64 keepGeneration)
+{
+    const QList<CacheKey> keys = m_cache.keys();
+    for (const CacheKey& key : keys) {
+        if (key.sourceId == sourceId && (keepGeneration == 0 || key.generation != keepGeneration)) {
+            m_cache.remove(key);
+        }
+    }
+}
+
+void FrameCache::decodeFrame(const CacheKey& key, const Decoder& decoder)
+{
+    const auto isWanted = [this, &key]() {
+        auto it = m_wanted.constFind(key.sourceId);
+        return !m_shuttingDown && it != m_wanted.constEnd() && it->generation == key.generation
+            && it->frames.contains(key.frame);
+    };
+
+    {
+        // Skip frames the layer moved away from while queued
+        QMutexLocker locker(&m_mutex);
+        if (!isWanted()) {
+            m_inFlight.remove(key);
+            return;
+        }
+    }
+
+    const QImage image = decoder(key.frame);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_inFlight.remove(key);
+        auto it = m_wanted.constFind(key.sourceId);
+        if (image.isNull() || m_shuttingDown || it == m_wanted.constEnd() || it->generation != key.generation) {
+            return;
+        }
+        m_cache.insert(key, new QImage(image), frameCostKb(image));
+    }
+
+    QMetaObject::invokeMethod(this, [this, key]() {
+        emit frameLoaded(key.sourceId, key.generation, key.frame);
+    }, Qt::QueuedConnection);
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <QObject>
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QSet>
+#include <QThreadPool>
+#include <QVector>
+#include <functional>
+
+/**
+ * @brief LRU cache of decoded frames with a background prefetcher
+ *
+ * Holds coloured planes of stacked and time-series layers within a shared
+ * memory budget, so stepping back to a frame that was shown recently does
+ * not decode it again. Layers ask for the frames they expect to show next
+ * with request(); missing frames are decoded on a worker pool and
+ * frameLoaded() is emitted on the cache's thread when one is available.
+ *
+ * Frames are filed under a generation chosen by the layer, which bumps it
+ * whenever the data or colouring changes. Requesting a new generation
+ * drops the older frames of that source.
+ */
+class FrameCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Decodes one frame (called on a worker thread)
+     */
+    using Decoder = std::function<QImage(qint64 frame)>;
+
+    /**
+     * @brief Constructor
+     * @param memoryBudget Maximum memory for cached frames in bytes
+     * @param parent Parent object
+     */
+    explicit FrameCache(qint64 memoryBudget = 1024ll * 1024 * 1024, QObject* parent = nullptr);
+
+    /**
+     * @brief Destructor
+     */
+    ~FrameCache();
+
+    /**
+     * @brief Get singleton instance
+     * @return FrameCache instance
+     */
+    static FrameCache* instance();
+
+    /**
+     * @brief Get a new source id
+     * @return Id unique within the process
+     */
+    static quint64 createSourceId();
+
+    /**
+     * @brief Set memory budget for cached frames
+     * @param bytes Budget in bytes
+     */
+    void setMemoryBudget(qint64 bytes);
+
+    /**
+     * @brief Get memory budget for cached frames
+     * @return Budget in bytes
+     */
+    qint64 memoryBudget() const;
+
+    /**
+     * @brief Get memory currently used by cached frames
+     * @return Usage in bytes
+     */
+    qint64 memoryUsage() const;
+
+    /**
+     * @brief Get a cached frame
+     * @param sourceId Source id
+     * @param generation Generation of the source
+     * @param frame Frame index
+     * @return Frame or null image if not cached
+     */
+    QImage frame(quint64 sourceId, quint64 generation, qint64 frame) const;
+
+    /**
+     * @brief Store a frame decoded by the caller
+     * @param sourceId Source id
+     * @param generation Generation of the source
+     * @param frame Frame index
+     * @param image Frame
+     */
+    void insert(quint64 sourceId, quint64 generation, qint64 frame, const QImage& image);
+
+    /**
+     * @brief Request frames for a source
+     *
+     * Replaces the set of wanted frames for the source. Frames that are
+     * not cached or already decoding are queued on the worker pool.
+     *
+     * @param sourceId Source id
+     * @param generation Generation of the source
+     * @param frames Wanted frames, most important first
+     * @param decoder Decodes a frame of this generation
+     */
+    void request(quint64 sourceId, quint64 generation, const QVector<qint64>& frames, const Decoder& decoder);
+
+    /**
+     * @brief Drop pending requests and cached frames of a source
+     * @param sourceId Source id
+     */
+    void removeSource(quint64 sourceId);
+
+    /**
+     * @brief Clear all cached frames
+     */
+    void clear();
+
+signals:
+    /**
+     * @brief Emitted when a requested frame has been decoded
+     * @param sourceId Source id
+     * @param generation Generation of the source
+     * @param frame Frame index
+     */
+    void frameLoaded(quint64 sourceId, quint64 generation, qint64 frame);
+
+private:
+    friend class FrameDecodeTask;
+
+    /**
+     * @brief Cache key combining source, generation and frame
+     */
+    struct CacheKey
+    {
+        quint64 sourceId;
+        quint64 generation;
+        qint64 frame;
+
+        bool operator==(const CacheKey& other) const
+        {
+            return sourceId == other.sourceId && generation == other.generation && frame == other.frame;
+        }
+    };
+
+    friend uint qHash(const CacheKey& key, uint seed)
+    {
+        return qHash(key.frame, seed) ^ qHash(key.sourceId ^ (key.generation << 40), seed);
+    }
+
+    /**
+     * @brief Frames a source currently wants
+     */
+    struct Wanted
+    {
+        quint64 generation = 0;
+        QSet<qint64> frames;
+    };
+
+    /**
+     * @brief Drop cached frames of a source (m_mutex held)
+     * @param sourceId Source id
+     * @param keepGeneration Generation to keep, or 0 to drop all
+     */
+    void removeFrames(quint64 sourceId, quint64 keepGeneration);
+
+    /**
+     * @brief Decode a frame (runs on a worker thread)
+     * @param key Frame key
+     * @param decoder Decoder of the frame's generation
+     */
+    void decodeFrame(const CacheKey& key, const Decoder& decoder);
+
+private:
+    static FrameCache* s_instance;
+
+    // Cached frames, cost in kilobytes
+    mutable QMutex m_mutex;
+    mutable QCache<CacheKey, QImage> m_cache;
+
+    // Prefetch state
+    QHash<quint64, Wanted> m_wanted;
+    QSet<CacheKey> m_inFlight;
+    QThreadPool m_pool;
+    bool m_shuttingDown;
+};
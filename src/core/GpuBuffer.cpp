@@ -0,0 +1,120 @@
+#include "GpuBuffer.h"
+#include "GpuResourcePool.h"
+
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// Smallest allocation, so that tiny layers do not reallocate on every append
+const qint64 kMinCapacity = 4096;
+
+} // namespace
+
+GpuBuffer::GpuBuffer()
+    : m_bufferId(0)
+    , m_size(0)
+    , m_capacity(0)
+    , m_dirtyBegin(0)
+    , m_dirtyEnd(0)
+{
+}
+
+void GpuBuffer::markDirty(qint64 offset, qint64 bytes)
+{
+    if (bytes <= 0) {
+        return;
+    }
+
+    if (m_dirtyBegin == m_dirtyEnd) {
+        m_dirtyBegin = offset;
+        m_dirtyEnd = offset + bytes;
+    } else {
+        m_dirtyBegin = qMin(m_dirtyBegin, offset);
+        m_dirtyEnd = qMax(m_dirtyEnd, offset + bytes);
+    }
+}
+
+void GpuBuffer::markAllDirty()
+{
+    m_dirtyBegin = 0;
+    m_dirtyEnd = std::numeric_limits<qint64>::max();
+}
+
+void GpuBuffer::sync(QOpenGLFunctions* gl, const void* data, qint64 bytes)
+{
+    GpuResourcePool* pool = GpuResourcePool::current();
+    if (!pool) {
+        return;
+    }
+
+    if (!m_bufferId || bytes > m_capacity) {
+        // Grow geometrically so appends do not reallocate every time; the
+        // outgrown store goes back to the pool for other layers
+        const qint64 capacity = qMax(kMinCapacity, qMax(bytes, m_capacity * 2));
+        pool->releaseBuffer(gl, m_bufferId);
+        m_bufferId = pool->acquireBuffer(gl, capacity, &m_capacity);
+        gl->glBindBuffer(GL_ARRAY_BUFFER, m_bufferId);
+        if (bytes > 0) {
+            gl->glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(bytes), data);
+        }
+    } else {
+        gl->glBindBuffer(GL_ARRAY_BUFFER, m_bufferId);
+        const qint64 begin = qMax<qint64>(0, m_dirtyBegin);
+        const qint64 end = qMin(bytes, m_dirtyEnd);
+        if (end > begin) {
+            gl->glBufferSubData(GL_ARRAY_BUFFER, GLintptr(begin), GLsizeiptr(end - begin),
+                                static_cast<const uchar*>(data) + begin);
+        }
+    }
+
+    gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_size = bytes;
+    m_dirtyBegin = 0;
+    m_dirtyEnd = 0;
+}
+
+void GpuBuffer::bindAttribute(QOpenGLFunctions* gl, GLuint location, int components,
+                              GLenum type, bool normalized) const
+{
+    gl->glBindBuffer(GL_ARRAY_BUFFER, m_bufferId);
+    gl->glEnableVertexAttribArray(location);
+    gl->glVertexAttribPointer(location, components, type, normalized ? GL_TRUE : GL_FALSE, 0, nullptr);
+}
+
+void GpuBuffer::destroy(QOpenGLFunctions* gl)
+{
+    if (m_bufferId) {
+        if (GpuResourcePool* pool = GpuResourcePool::current()) {
+            pool->releaseBuffer(gl, m_bufferId);
+        } else {
+            gl->glDeleteBuffers(1, &m_bufferId);
+        }
+    }
+    invalidate();
+}
+
+void GpuBuffer::invalidate()
+{
+    m_bufferId = 0;
+    m_size = 0;
+    m_capacity = 0;
+    markAllDirty();
+}
+
+quint32 packVertexColor(const QColor& color)
+{
+    const uchar bytes[4] = {
+        uchar(color.red()), uchar(color.green()), uchar(color.blue()), uchar(color.alpha())
+    };
+    quint32 packed;
+    std::memcpy(&packed, bytes, sizeof(packed));
+    return packed;
+}
+
+QColor unpackVertexColor(quint32 packed)
+{
+    uchar bytes[4];
+    std::memcpy(bytes, &packed, sizeof(bytes));
+    return QColor(bytes[0], bytes[1], bytes[2], bytes[3]);
+}
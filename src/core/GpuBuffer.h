@@ -0,0 +1,116 @@
+#pragma once
+
+#include <QColor>
+#include <QOpenGLFunctions>
+#include <QtGlobal>
+
+/**
+ * @brief Growable OpenGL vertex buffer with incremental uploads
+ *
+ * The owner keeps the vertex data in CPU memory and marks modified byte
+ * ranges with markDirty(). sync() then uploads only the modified range
+ * with glBufferSubData. When the data outgrows the buffer, storage is
+ * reallocated with geometric growth and uploaded once in full, so a
+ * sequence of appends costs amortized upload time proportional to the
+ * appended data. Storage comes from the context's GpuResourcePool and
+ * returns to it when outgrown or destroyed.
+ *
+ * The buffer belongs to the context that was current at the first sync().
+ */
+class GpuBuffer
+{
+public:
+    /**
+     * @brief Constructor
+     */
+    GpuBuffer();
+
+    /**
+     * @brief Check if the GL buffer exists
+     * @return true if created
+     */
+    bool isCreated() const { return m_bufferId != 0; }
+
+    /**
+     * @brief Get GL buffer name
+     * @return Buffer id (0 if not created)
+     */
+    GLuint bufferId() const { return m_bufferId; }
+
+    /**
+     * @brief Get number of bytes currently uploaded
+     * @return Size in bytes
+     */
+    qint64 size() const { return m_size; }
+
+    /**
+     * @brief Get allocated GPU storage
+     * @return Capacity in bytes
+     */
+    qint64 capacity() const { return m_capacity; }
+
+    /**
+     * @brief Mark a byte range as modified
+     * @param offset First modified byte
+     * @param bytes Number of modified bytes
+     */
+    void markDirty(qint64 offset, qint64 bytes);
+
+    /**
+     * @brief Mark the whole buffer as modified
+     */
+    void markAllDirty();
+
+    /**
+     * @brief Upload pending changes
+     * @param gl OpenGL functions
+     * @param data CPU copy of the buffer contents
+     * @param bytes Current size of the contents
+     */
+    void sync(QOpenGLFunctions* gl, const void* data, qint64 bytes);
+
+    /**
+     * @brief Bind the buffer as a tightly packed vertex attribute
+     * @param gl OpenGL functions
+     * @param location Attribute location
+     * @param components Components per vertex
+     * @param type Component type
+     * @param normalized Normalize integer components to [0, 1]
+     */
+    void bindAttribute(QOpenGLFunctions* gl, GLuint location, int components,
+                       GLenum type = GL_FLOAT, bool normalized = false) const;
+
+    /**
+     * @brief Delete the GL buffer (context must be current)
+     * @param gl OpenGL functions
+     */
+    void destroy(QOpenGLFunctions* gl);
+
+    /**
+     * @brief Forget the GL buffer without deleting it
+     *
+     * Used when the owning context is gone and the buffer cannot be freed.
+     */
+    void invalidate();
+
+private:
+    GLuint m_bufferId;
+    qint64 m_size;
+    qint64 m_capacity;
+    qint64 m_dirtyBegin;
+    qint64 m_dirtyEnd;
+};
+
+/**
+ * @brief Pack a color as four normalized bytes in R, G, B, A memory order
+ * @param color Color
+ * @return Packed color for a GL_UNSIGNED_BYTE vertex attribute
+ */
+quint32 packVertexColor(const QColor& color);
+
+/**
+ * @brief Unpack a color packed with packVertexColor()
+ * @param packed Packed color
+ * @return Color
+ */
+QColor unpackVertexColor(quint32 packed);
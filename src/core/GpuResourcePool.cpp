@@ -0,0 +1,193 @@
+#include "GpuResourcePool.h"
+
+#include <QOpenGLContext>
+
+QHash<QOpenGLContext*, GpuResourcePool*> GpuResourcePool::s_pools;
+
+namespace {
+
+// Idle memory kept for reuse by default
+const qint64 kDefaultIdleBudget = 64 * 1024 * 1024;
+
+// Smallest buffer size class
+const qint64 kMinBufferSize = 4096;
+
+qint64 bufferSizeClass(qint64 bytes)
+{
+    qint64 size = kMinBufferSize;
+    while (size < bytes) {
+        size *= 2;
+    }
+    return size;
+}
+
+qint64 textureBytes(const QSize& size)
+{
+    return qint64(size.width()) * size.height() * 4;
+}
+
+} // namespace
+
+GpuResourcePool* GpuResourcePool::forContext(QOpenGLContext* context)
+{
+    if (!context) {
+        return nullptr;
+    }
+
+    GpuResourcePool* pool = s_pools.value(context);
+    if (!pool) {
+        pool = new GpuResourcePool(context);
+        s_pools.insert(context, pool);
+    }
+    return pool;
+}
+
+GpuResourcePool* GpuResourcePool::current()
+{
+    return forContext(QOpenGLContext::currentContext());
+}
+
+GpuResourcePool::GpuResourcePool(QOpenGLContext* context)
+    : QObject(context)
+    , m_context(context)
+    , m_idleBytes(0)
+    , m_idleBudget(kDefaultIdleBudget)
+{
+    // Children are deleted after the native context is gone, so GL objects
+    // have to be freed from the signal
+    connect(context, &QOpenGLContext::aboutToBeDestroyed,
+            this, &GpuResourcePool::onContextAboutToBeDestroyed, Qt::DirectConnection);
+}
+
+GpuResourcePool::~GpuResourcePool()
+{
+    s_pools.remove(m_context);
+}
+
+GLuint GpuResourcePool::acquireTexture(QOpenGLFunctions* gl, int width, int height)
+{
+    auto it = m_freeTextures.find(textureKey(width, height));
+    if (it != m_freeTextures.end() && !it->isEmpty()) {
+        m_idleBytes -= qint64(width) * height * 4;
+        return it->takeLast();
+    }
+
+    GLuint textureId = 0;
+    gl->glGenTextures(1, &textureId);
+    gl->glBindTexture(GL_TEXTURE_2D, textureId);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_textureSizes.insert(textureId, QSize(width, height));
+    return textureId;
+}
+
+void GpuResourcePool::releaseTexture(QOpenGLFunctions* gl, GLuint textureId)
+{
+    if (!textureId) {
+        return;
+    }
+
+    auto it = m_textureSizes.constFind(textureId);
+    if (it == m_textureSizes.constEnd() || m_idleBytes + textureBytes(*it) > m_idleBudget) {
+        gl->glDeleteTextures(1, &textureId);
+        m_textureSizes.remove(textureId);
+        return;
+    }
+
+    m_idleBytes += textureBytes(*it);
+    m_freeTextures[textureKey(it->width(), it->height())].append(textureId);
+}
+
+GLuint GpuResourcePool::acquireBuffer(QOpenGLFunctions* gl, qint64 bytes, qint64* capacity)
+{
+    const qint64 size = bufferSizeClass(bytes);
+    if (capacity) {
+        *capacity = size;
+    }
+
+    auto it = m_freeBuffers.find(size);
+    if (it != m_freeBuffers.end() && !it->isEmpty()) {
+        m_idleBytes -= size;
+        return it->takeLast();
+    }
+
+    GLuint bufferId = 0;
+    gl->glGenBuffers(1, &bufferId);
+    gl->glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+    gl->glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(size), nullptr, GL_DYNAMIC_DRAW);
+    gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_bufferSizes.insert(bufferId, size);
+    return bufferId;
+}
+
+void GpuResourcePool::releaseBuffer(QOpenGLFunctions* gl, GLuint bufferId)
+{
+    if (!bufferId) {
+        return;
+    }
+
+    auto it = m_bufferSizes.constFind(bufferId);
+    if (it == m_bufferSizes.constEnd() || m_idleBytes + *it > m_idleBudget) {
+        gl->glDeleteBuffers(1, &bufferId);
+        m_bufferSizes.remove(bufferId);
+        return;
+    }
+
+    m_idleBytes += *it;
+    m_freeBuffers[*it].append(bufferId);
+}
+
+void GpuResourcePool::trim(QOpenGLFunctions* gl)
+{
+    shrinkTo(gl, 0);
+}
+
+void GpuResourcePool::setIdleBudget(qint64 bytes)
+{
+    m_idleBudget = qMax<qint64>(0, bytes);
+    if (m_idleBytes > m_idleBudget && QOpenGLContext::currentContext() == m_context) {
+        shrinkTo(m_context->functions(), m_idleBudget);
+    }
+}
+
+void GpuResourcePool::onContextAboutToBeDestroyed()
+{
+    if (QOpenGLContext::currentContext() == m_context) {
+        trim(m_context->functions());
+    }
+
+    // Whatever is left dies with the context
+    m_freeTextures.clear();
+    m_freeBuffers.clear();
+    m_textureSizes.clear();
+    m_bufferSizes.clear();
+    m_idleBytes = 0;
+}
+
+void GpuResourcePool::shrinkTo(QOpenGLFunctions* gl, qint64 budget)
+{
+    for (auto it = m_freeTextures.begin(); it != m_freeTextures.end() && m_idleBytes > budget; ++it) {
+        const qint64 bytes = textureBytes(QSize(int(it.key() >> 32), int(it.key() & 0xffffffffu)));
+        while (!it->isEmpty() && m_idleBytes > budget) {
+            GLuint textureId = it->takeLast();
+            gl->glDeleteTextures(1, &textureId);
+            m_textureSizes.remove(textureId);
+            m_idleBytes -= bytes;
+        }
+    }
+
+    for (auto it = m_freeBuffers.begin(); it != m_freeBuffers.end() && m_idleBytes > budget; ++it) {
+        while (!it->isEmpty() && m_idleBytes > budget) {
+            GLuint bufferId = it->takeLast();
+            gl->glDeleteBuffers(1, &bufferId);
+            m_bufferSizes.remove(bufferId);
+            m_idleBytes -= it.key();
+        }
+    }
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QOpenGLFunctions>
+#include <QSize>
+#include <QVector>
+
+class QOpenGLContext;
+
+/**
+ * @brief Reuses GL textures and buffers of one context across layers
+ *
+ * Tiles scrolling out of view, bricks of a replaced image and grown
+ * vertex buffers are returned to the pool instead of deleted, and the
+ * next layer asking for the same texture size or buffer size class gets
+ * them back without a glGen/glTexImage2D/glBufferData round trip.
+ *
+ * Textures are RGBA8 with linear minification, nearest magnification
+ * and edge clamping. Buffers are GL_ARRAY_BUFFER stores rounded up to a
+ * power of two; their contents are undefined when acquired.
+ *
+ * Idle objects are kept up to idleBudget() bytes; further releases are
+ * deleted right away. The pool is owned by its context and frees the
+ * idle objects when the context is about to be destroyed.
+ *
+ * All functions must be called with the pool's context current.
+ */
+class GpuResourcePool : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Get the pool of a context, creating it on first use
+     * @param context OpenGL context
+     * @return Pool, or nullptr if context is nullptr
+     */
+    static GpuResourcePool* forContext(QOpenGLContext* context);
+
+    /**
+     * @brief Get the pool of the current context
+     * @return Pool, or nullptr if no context is current
+     */
+    static GpuResourcePool* current();
+
+    /**
+     * @brief Destructor
+     */
+    ~GpuResourcePool();
+
+    /**
+     * @brief Get a texture of a given size
+     * @param gl OpenGL functions
+     * @param width Width in pixels
+     * @param height Height in pixels
+     * @return Texture id; contents are undefined
+     */
+    GLuint acquireTexture(QOpenGLFunctions* gl, int width, int height);
+
+    /**
+     * @brief Return a texture obtained from acquireTexture()
+     *
+     * Textures the pool did not create are deleted.
+     *
+     * @param gl OpenGL functions
+     * @param textureId Texture id
+     */
+    void releaseTexture(QOpenGLFunctions* gl, GLuint textureId);
+
+    /**
+     * @brief Get an array buffer with at least a given capacity
+     * @param gl OpenGL functions
+     * @param bytes Minimum capacity in bytes
+     * @param capacity Receives the actual capacity
+     * @return Buffer id; contents are undefined
+     */
+    GLuint acquireBuffer(QOpenGLFunctions* gl, qint64 bytes, qint64* capacity);
+
+    /**
+     * @brief Return a buffer obtained from acquireBuffer()
+     *
+     * Buffers the pool did not create are deleted.
+     *
+     * @param gl OpenGL functions
+     * @param bufferId Buffer id
+     */
+    void releaseBuffer(QOpenGLFunctions* gl, GLuint bufferId);
+
+    /**
+     * @brief Delete all idle objects
+     * @param gl OpenGL functions
+     */
+    void trim(QOpenGLFunctions* gl);
+
+    /**
+     * @brief Get memory held by idle objects
+     * @return Size in bytes
+     */
+    qint64 idleBytes() const { return m_idleBytes; }
+
+    /**
+     * @brief Get memory limit for idle objects
+     * @return Size in bytes
+     */
+    qint64 idleBudget() const { return m_idleBudget; }
+
+    /**
+     * @brief Set memory limit for idle objects
+     * @param bytes Size in bytes
+     */
+    void setIdleBudget(qint64 bytes);
+
+private:
+    /**
+     * @brief Constructor
+     * @param context Owning context
+     */
+    explicit GpuResourcePool(QOpenGLContext* context);
+
+    /**
+     * @brief Free idle objects while the context is still usable
+     */
+    void onContextAboutToBeDestroyed();
+
+    /**
+     * @brief Delete idle objects until they fit a budget
+     * @param gl OpenGL functions
+     * @param budget Size in bytes
+     */
+    void shrinkTo(QOpenGLFunctions* gl, qint64 budget);
+
+    static quint64 textureKey(int width, int height) { return (quint64(quint32(width)) << 32) | quint32(height); }
+
+private:
+    static QHash<QOpenGLContext*, GpuResourcePool*> s_pools;
+
+    QOpenGLContext* m_context;
+
+    // Sizes of all objects created by the pool, handed out or idle
+    QHash<GLuint, QSize> m_textureSizes;
+    QHash<GLuint, qint64> m_bufferSizes;
+
+    // Idle objects by texture size and buffer capacity
+    QHash<quint64, QVector<GLuint>> m_freeTextures;
+    QHash<qint64, QVector<GLuint>> m_freeBuffers;
+
+    qint64 m_idleBytes;
+    qint64 m_idleBudget;
+};
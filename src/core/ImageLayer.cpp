@@ -0,0 +1,991 @@
+#include "ImageLayer.h"
+#include "GpuResourcePool.h"
+#include "RenderContext.h"
+#include "../utils/ImageKernels.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QOpenGLContext>
+#include <QPainter>
+#include <QPointer>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QtMath>
+#include <limits>
+#include <utility>
+
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2
+#endif
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+
+namespace {
+
+// Upper bound for a single texture brick, even if the driver allows more
+const int kMaxBrickSize = 4096;
+
+/**
+ * @brief Read-only storage exposing the pixels of an implicitly shared QImage
+ */
+class ImageStorage : public BufferStorage
+{
+public:
+    explicit ImageStorage(const QImage& image) : m_image(image) {}
+
+    uchar* data() override { return nullptr; }
+    const uchar* constData() const override { return m_image.constBits(); }
+    qint64 size() const override { return m_image.sizeInBytes(); }
+    bool isWritable() const override { return false; }
+
+private:
+    QImage m_image;
+};
+
+void releaseStorage(void* info)
+{
+    delete static_cast<std::shared_ptr<BufferStorage>*>(info);
+}
+
+// Wrap buffer memory in a QImage that keeps the storage alive
+QImage wrapBuffer(const DataBuffer& buffer, QImage::Format format)
+{
+    const int width = int(buffer.shape(1));
+    const int height = int(buffer.shape(0));
+    const int bytesPerLine = int(buffer.strides().at(0));
+    auto* keepAlive = new std::shared_ptr<BufferStorage>(buffer.storage());
+
+    DataBuffer view = buffer;
+    if (view.isWritable()) {
+        return QImage(view.data(), width, height, bytesPerLine, format, releaseStorage, keepAlive);
+    }
+    return QImage(view.constData(), width, height, bytesPerLine, format, releaseStorage, keepAlive);
+}
+
+// Entries of the colour table used for float data
+const int kFloatTableSize = 4096;
+
+// Bins of float histograms for auto contrast
+const int kFloatHistogramBins = 4096;
+
+// Samples taken for the immediate auto contrast estimate
+const qint64 kAutoContrastSamples = 1 << 16;
+
+// Frames decoded ahead of the current one while stepping through a stack
+const int kPrefetchFrames = 8;
+
+/**
+ * @brief Get the number of trailing dimensions forming one plane
+ *
+ * A trailing extent of 3 or 4 is colour; all other leading dimensions
+ * are slider dimensions.
+ */
+int planeDimensions(const DataBuffer& buffer)
+{
+    const int dims = buffer.ndim();
+    return dims >= 3 && (buffer.shape(dims - 1) == 3 || buffer.shape(dims - 1) == 4) ? 3 : 2;
+}
+
+DataBuffer planeAt(const DataBuffer& buffer, const QVector<qint64>& point)
+{
+    DataBuffer plane = buffer;
+    for (qint64 index : point) {
+        plane = plane.slice(0, index);
+    }
+    return plane;
+}
+
+qint64 frameIndex(const QVector<qint64>& point, const QVector<qint64>& shape)
+{
+    qint64 frame = 0;
+    for (int axis = 0; axis < shape.size(); ++axis) {
+        frame = frame * shape[axis] + point.value(axis, 0);
+    }
+    return frame;
+}
+
+QVector<qint64> framePoint(qint64 frame, const QVector<qint64>& shape)
+{
+    QVector<qint64> point(shape.size());
+    for (int axis = shape.size() - 1; axis >= 0; --axis) {
+        point[axis] = frame % shape[axis];
+        frame /= shape[axis];
+    }
+    return point;
+}
+
+bool isScalarBuffer(const DataBuffer& buffer)
+{
+    return !buffer.isNull() && dataTypeSize(buffer.dtype()) > 0
+        && (buffer.ndim() == 2 || (buffer.ndim() == 3 && buffer.shape(2) == 1))
+        && buffer.shape(0) > 0 && buffer.shape(1) > 0
+        && buffer.shape(0) <= std::numeric_limits<int>::max()
+        && buffer.shape(1) <= std::numeric_limits<int>::max();
+}
+
+/**
+ * @brief Get single channel data in a layout the kernels accept
+ * @return The buffer itself if it is contiguous uint8, uint16 or float32,
+ *         otherwise a contiguous copy (converted to float32 for other types)
+ */
+DataBuffer scalarSource(const DataBuffer& buffer)
+{
+    const DataType type = buffer.dtype();
+    const bool kernelType = type == DataType::UInt8 || type == DataType::UInt16 || type == DataType::Float32;
+    if (!kernelType) {
+        return buffer.converted(DataType::Float32);
+    }
+    return buffer.isContiguous() ? buffer : buffer.copy();
+}
+
+bool valueRange(const DataBuffer& source, qint64 step, double* low, double* high)
+{
+    const qint64 count = source.elementCount();
+    switch (source.dtype()) {
+    case DataType::UInt8:   return ImageKernels::minMax(source.constData<quint8>(), count, low, high, step);
+    case DataType::UInt16:  return ImageKernels::minMax(source.constData<quint16>(), count, low, high, step);
+    case DataType::Float32: return ImageKernels::minMax(source.constData<float>(), count, low, high, step);
+    default:                return false;
+    }
+}
+
+bool percentileLimits(const DataBuffer& source, qint64 step, double lowFraction, double highFraction,
+                      double* low, double* high)
+{
+    const qint64 count = source.elementCount();
+    ImageKernels::Histogram histogram;
+    switch (source.dtype()) {
+    case DataType::UInt8:
+        histogram = ImageKernels::histogram(source.constData<quint8>(), count, step);
+        break;
+    case DataType::UInt16:
+        histogram = ImageKernels::histogram(source.constData<quint16>(), count, step);
+        break;
+    case DataType::Float32: {
+        double min = 0.0;
+        double max = 0.0;
+        if (!valueRange(source, step, &min, &max)) {
+            return false;
+        }
+        histogram = ImageKernels::histogram(source.constData<float>(), count, min, max, kFloatHistogramBins, step);
+        break;
+    }
+    default:
+        return false;
+    }
+
+    if (histogram.total == 0) {
+        return false;
+    }
+    *low = histogram.percentile(lowFraction);
+    *high = qMax(histogram.percentile(highFraction), *low + histogram.binWidth);
+    return true;
+}
+
+/**
+ * @brief Get an odd element step that samples about kAutoContrastSamples elements
+ */
+qint64 sampleStep(qint64 count)
+{
+    return count > kAutoContrastSamples ? (count / kAutoContrastSamples) | 1 : 1;
+}
+
+/**
+ * @brief Colour a scalar source
+ * @param source Result of scalarSource()
+ * @param image Target image; reused if it has the right size and is not shared
+ */
+QImage mapScalar(const DataBuffer& source, double low, double high, float gamma,
+                 const QVector<QRgb>& colormap, QImage image = QImage())
+{
+    const int height = int(source.shape(0));
+    const int width = int(source.shape(1));
+    if (image.size() != QSize(width, height) || image.format() != QImage::Format_RGBA8888) {
+        image = QImage(width, height, QImage::Format_RGBA8888);
+    }
+
+    switch (source.dtype()) {
+    case DataType::UInt8: {
+        const QVector<quint32> table = ImageKernels::colorTable(256, low, high, gamma, colormap);
+        const quint8* in = source.constData<quint8>();
+        for (int y = 0; y < height; ++y) {
+            ImageKernels::applyTable(in + qint64(y) * width, width, table.constData(),
+                                     reinterpret_cast<quint32*>(image.scanLine(y)));
+        }
+        break;
+    }
+    case DataType::UInt16: {
+        const QVector<quint32> table = ImageKernels::colorTable(65536, low, high, gamma, colormap);
+        const quint16* in = source.constData<quint16>();
+        for (int y = 0; y < height; ++y) {
+            ImageKernels::applyTable(in + qint64(y) * width, width, table.constData(),
+                                     reinterpret_cast<quint32*>(image.scanLine(y)));
+        }
+        break;
+    }
+    case DataType::Float32: {
+        const QVector<quint32> table = ImageKernels::colorTable(kFloatTableSize, 0.0, kFloatTableSize - 1,
+                                                                gamma, colormap);
+        const float* in = source.constData<float>();
+        for (int y = 0; y < height; ++y) {
+            ImageKernels::applyTable(in + qint64(y) * width, width, float(low), float(high),
+                                     table.constData(), kFloatTableSize,
+                                     reinterpret_cast<quint32*>(image.scanLine(y)));
+        }
+        break;
+    }
+    default:
+        return QImage();
+    }
+    return image;
+}
+
+} // namespace
+
+/**
+ * @brief Computes exact percentile limits off the GUI thread
+ *
+ * The result is handed back through the application's event loop; the
+ * layer is only touched there, after checking it still exists.
+ */
+class AutoContrastTask : public QRunnable
+{
+public:
+    AutoContrastTask(ImageLayer* layer, const DataBuffer& source, double lowFraction,
+                     double highFraction, quint64 generation)
+        : m_layer(layer)
+        , m_source(source)
+        , m_lowFraction(lowFraction)
+        , m_highFraction(highFraction)
+        , m_generation(generation)
+    {
+    }
+
+    void run() override
+    {
+        double low = 0.0;
+        double high = 0.0;
+        if (!percentileLimits(m_source, 1, m_lowFraction, m_highFraction, &low, &high)) {
+            return;
+        }
+
+        const QPointer<ImageLayer> layer = m_layer;
+        const quint64 generation = m_generation;
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [layer, generation, low, high]() {
+            if (layer) {
+                layer->finishAutoContrast(generation, low, high);
+            }
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    QPointer<ImageLayer> m_layer;
+    DataBuffer m_source;
+    double m_lowFraction;
+    double m_highFraction;
+    quint64 m_generation;
+};
+
+ImageLayer::ImageLayer(const QString& name, QObject* parent)
+    : Layer(name, LayerType::Image, parent)
+    , m_position(0.0, 0.0)
+    , m_bufferVersion(0)
+    , m_frameSourceId(FrameCache::createSourceId())
+    , m_frameGeneration(1)
+    , m_nextFrame(-1)
+    , m_contrastLow(0.0)
+    , m_contrastHigh(255.0)
+    , m_gamma(1.0f)
+    , m_colormap(ImageKernels::linearColormap())
+    , m_autoContrastGeneration(0)
+    , m_needsAllocation(true)
+    , m_glContext(nullptr)
+    , m_backFrame(-1)
+    , m_backGeneration(0)
+    , m_pixelBuffer(0)
+    , m_maxTextureSize(kMaxBrickSize)
+    , m_supportsRowLength(false)
+{
+}
+
+ImageLayer::~ImageLayer()
+{
+    // GPU resources are released by the viewer through releaseGraphicsResources()
+    if (FrameCache* cache = FrameCache::instance()) {
+        cache->removeSource(m_frameSourceId);
+    }
+}
+
+void ImageLayer::setImage(const QImage& image)
+{
+    m_buffer = DataBuffer();
+    m_plane = DataBuffer();
+    m_slicePoint.clear();
+    m_scalarSource = DataBuffer();
+    invalidateFrames();
+    applyImage(image);
+    markDataChanged();
+}
+
+QImage ImageLayer::imageFromBuffer(const DataBuffer& buffer)
+{
+    if (buffer.isNull() || buffer.ndim() < 2 || buffer.ndim() > 3) {
+        return QImage();
+    }
+
+    const qint64 height = buffer.shape(0);
+    const qint64 width = buffer.shape(1);
+    const qint64 channels = buffer.ndim() == 3 ? buffer.shape(2) : 1;
+    if (width <= 0 || height <= 0 || width > std::numeric_limits<int>::max()
+        || height > std::numeric_limits<int>::max()) {
+        return QImage();
+    }
+
+    const int elementSize = buffer.elementSize();
+    const bool packedPixels = buffer.strides().at(1) == channels * elementSize
+                           && (buffer.ndim() == 2 || buffer.strides().at(2) == elementSize);
+
+    if (buffer.dtype() == DataType::UInt8 && packedPixels) {
+        switch (channels) {
+        case 4: return wrapBuffer(buffer, QImage::Format_RGBA8888);
+        case 3: return wrapBuffer(buffer, QImage::Format_RGB888).convertToFormat(QImage::Format_RGBA8888);
+        case 1: return wrapBuffer(buffer, QImage::Format_Grayscale8).convertToFormat(QImage::Format_RGBA8888);
+        default: return QImage();
+        }
+    }
+
+    if (!isScalarBuffer(buffer)) {
+        return QImage();
+    }
+
+    const DataBuffer source = scalarSource(buffer);
+    double low = 0.0;
+    double high = 0.0;
+    if (!valueRange(source, 1, &low, &high) || high <= low) {
+        high = low + 1.0;
+    }
+    return mapScalar(source, low, high, 1.0f, ImageKernels::linearColormap());
+}
+
+void ImageLayer::updateImage(const QImage& patch, const QPoint& offset)
+{
+    if (m_image.isNull() || patch.isNull()) {
+        return;
+    }
+
+    // A frame shared with the cache would detach; wrap the plane again so
+    // painting still writes into the buffer
+    if (!m_image.isDetached() && !m_plane.isNull() && m_image.constBits() == m_plane.constData()) {
+        m_image = imageFromBuffer(m_plane);
+    }
+
+    QPainter painter(&m_image);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.drawImage(offset, patch);
+    painter.end();
+
+    // Painting detaches the image if someone else holds a reference to it,
+    // after which it no longer reflects the source buffer
+    if (!m_plane.isNull() && m_image.constBits() != m_plane.constData()) {
+        m_buffer = DataBuffer();
+        m_plane = DataBuffer();
+        m_slicePoint.clear();
+        m_scalarSource = DataBuffer();
+    }
+
+    markDirty(QRect(offset, patch.size()));
+}
+
+void ImageLayer::markDirty(const QRect& rect)
+{
+    QRect clipped = rect & m_image.rect();
+    if (clipped.isEmpty()) {
+        return;
+    }
+
+    if (!m_plane.isNull() && m_image.constBits() == m_plane.constData()) {
+        m_buffer.markModified();
+        m_bufferVersion = m_buffer.version();
+    }
+
+    invalidateFrames();
+    m_dirtyRect |= clipped;
+    markDataChanged();
+}
+
+void ImageLayer::setPosition(const QPointF& position)
+{
+    if (m_position != position) {
+        m_position = position;
+        emit changed();
+    }
+}
+
+void ImageLayer::setContrastLimits(double low, double high)
+{
+    // A pending background refinement must not override explicit limits
+    ++m_autoContrastGeneration;
+    applyContrastLimits(low, high);
+}
+
+void ImageLayer::setGamma(float gamma)
+{
+    gamma = qMax(0.01f, gamma);
+    if (m_gamma == gamma) {
+        return;
+    }
+
+    m_gamma = gamma;
+    if (hasScalarData()) {
+        invalidateFrames();
+        remapScalar();
+        markDataChanged();
+    }
+}
+
+void ImageLayer::setColormap(const QVector<QRgb>& colormap)
+{
+    if (m_colormap == colormap || colormap.isEmpty()) {
+        return;
+    }
+
+    m_colormap = colormap;
+    if (hasScalarData()) {
+        invalidateFrames();
+        remapScalar();
+        markDataChanged();
+    }
+}
+
+void ImageLayer::autoContrast(double lowPercentile, double highPercentile)
+{
+    if (!hasScalarData()) {
+        return;
+    }
+
+    const quint64 generation = ++m_autoContrastGeneration;
+    const double lowFraction = qBound(0.0, lowPercentile / 100.0, 1.0);
+    const double highFraction = qBound(lowFraction, highPercentile / 100.0, 1.0);
+    const qint64 step = sampleStep(m_scalarSource.elementCount());
+
+    double low = 0.0;
+    double high = 0.0;
+    if (!percentileLimits(m_scalarSource, step, lowFraction, highFraction, &low, &high)) {
+        return;
+    }
+    applyContrastLimits(low, high);
+
+    if (step > 1) {
+        QThreadPool::globalInstance()->start(
+            new AutoContrastTask(this, m_scalarSource, lowFraction, highFraction, generation));
+    }
+}
+
+void ImageLayer::applyContrastLimits(double low, double high)
+{
+    if (m_contrastLow == low && m_contrastHigh == high) {
+        return;
+    }
+
+    m_contrastLow = low;
+    m_contrastHigh = high;
+    if (hasScalarData()) {
+        invalidateFrames();
+        remapScalar();
+        markDataChanged();
+    }
+    emit contrastLimitsChanged(low, high);
+}
+
+void ImageLayer::finishAutoContrast(quint64 generation, double low, double high)
+{
+    if (generation == m_autoContrastGeneration) {
+        applyContrastLimits(low, high);
+    }
+}
+
+void ImageLayer::remapScalar()
+{
+    // Release our reference first so the pixels are rewritten in place
+    // unless someone else, such as the frame cache, still holds the image
+    QImage image = m_image;
+    m_image = QImage();
+    if (!image.isDetached()) {
+        image = QImage();
+    }
+    applyImage(mapScalar(m_scalarSource, m_contrastLow, m_contrastHigh, m_gamma, m_colormap, std::move(image)));
+}
+
+QVariant ImageLayer::data() const
+{
+    // QImage is implicitly shared, so this does not copy the pixels
+    return QVariant::fromValue(m_image);
+}
+
+void ImageLayer::setData(const QVariant& data)
+{
+    if (data.userType() == qMetaTypeId<DataBuffer>()) {
+        setBuffer(data.value<DataBuffer>());
+    } else if (data.canConvert<QImage>()) {
+        setImage(data.value<QImage>());
+    }
+}
+
+DataBuffer ImageLayer::buffer() const
+{
+    if (!m_buffer.isNull()) {
+        return m_buffer;
+    }
+
+    if (m_image.isNull()) {
+        return DataBuffer();
+    }
+
+    return DataBuffer(DataType::UInt8,
+                      {m_image.height(), m_image.width(), 4},
+                      {m_image.bytesPerLine(), 4, 1},
+                      std::make_shared<ImageStorage>(m_image));
+}
+
+bool ImageLayer::setBuffer(const DataBuffer& buffer)
+{
+    if (buffer.isSameView(m_buffer)) {
+        if (syncBuffer()) {
+            markDataChanged();
+        }
+        return true;
+    }
+
+    // Stacks keep their position when replaced
+    const int planeDims = planeDimensions(buffer);
+    QVector<qint64> point = m_slicePoint;
+    point.resize(qMax(0, buffer.ndim() - planeDims));
+    for (int axis = 0; axis < point.size(); ++axis) {
+        point[axis] = qBound<qint64>(0, point[axis], buffer.shape(axis) - 1);
+    }
+    const DataBuffer plane = planeAt(buffer, point);
+
+    if (isScalarBuffer(plane)) {
+        const DataBuffer source = scalarSource(plane);
+        if (source.isNull()) {
+            qWarning() << "ImageLayer: unsupported buffer" << dataTypeName(buffer.dtype()) << buffer.shape();
+            return false;
+        }
+
+        // New data starts with limits spanning its values; 8-bit data is
+        // shown unstretched
+        double low = 0.0;
+        double high = 255.0;
+        if (source.dtype() != DataType::UInt8 && (!valueRange(source, 1, &low, &high) || high <= low)) {
+            high = low + 1.0;
+        }
+
+        ++m_autoContrastGeneration;
+        invalidateFrames();
+        m_buffer = buffer;
+        m_bufferVersion = buffer.version();
+        m_plane = plane;
+        m_slicePoint = point;
+        m_scalarSource = source;
+        m_contrastLow = low;
+        m_contrastHigh = high;
+        remapScalar();
+        prefetchFrames(point.size() - 1, 1);
+        markDataChanged();
+        emit contrastLimitsChanged(low, high);
+        return true;
+    }
+
+    QImage image = imageFromBuffer(plane);
+    if (image.isNull()) {
+        qWarning() << "ImageLayer: unsupported buffer" << dataTypeName(buffer.dtype()) << buffer.shape();
+        return false;
+    }
+
+    invalidateFrames();
+    applyImage(image);
+    m_buffer = buffer;
+    m_bufferVersion = buffer.version();
+    m_plane = plane;
+    m_slicePoint = point;
+    m_scalarSource = DataBuffer();
+    prefetchFrames(point.size() - 1, 1);
+    markDataChanged();
+    return true;
+}
+
+QVector<qint64> ImageLayer::sliceShape() const
+{
+    QVector<qint64> shape;
+    for (int axis = 0; axis < m_slicePoint.size(); ++axis) {
+        shape.append(m_buffer.shape(axis));
+    }
+    return shape;
+}
+
+void ImageLayer::setSlicePoint(const QVector<qint64>& point)
+{
+    const QVector<qint64> shape = sliceShape();
+    if (shape.isEmpty() || point.size() != shape.size()) {
+        return;
+    }
+
+    QVector<qint64> clamped = point;
+    for (int axis = 0; axis < shape.size(); ++axis) {
+        clamped[axis] = qBound<qint64>(0, clamped[axis], shape[axis] - 1);
+    }
+    if (clamped == m_slicePoint) {
+        return;
+    }
+
+    // Predict the next step from the axis that moved; a jump between the
+    // ends of an axis is playback wrapping around
+    int axis = shape.size() - 1;
+    qint64 direction = 1;
+    for (int i = 0; i < shape.size(); ++i) {
+        const qint64 delta = clamped[i] - m_slicePoint[i];
+        if (delta != 0) {
+            axis = i;
+            const bool wrapped = shape[i] > 2 && qAbs(delta) == shape[i] - 1;
+            direction = (delta > 0) != wrapped ? 1 : -1;
+        }
+    }
+
+    // Keep the frame being left for scrubbing back
+    FrameCache* cache = FrameCache::instance();
+    const qint64 previousFrame = frameIndex(m_slicePoint, shape);
+    const qint64 frame = frameIndex(clamped, shape);
+    if (cache) {
+        cache->insert(m_frameSourceId, m_frameGeneration, previousFrame, m_image);
+    }
+    const bool frontCurrent = m_dirtyRect.isEmpty() && !m_needsAllocation;
+
+    m_slicePoint = clamped;
+    m_plane = planeAt(m_buffer, clamped);
+    if (hasScalarData()) {
+        m_scalarSource = scalarSource(m_plane);
+    }
+
+    QImage image = cache ? cache->frame(m_frameSourceId, m_frameGeneration, frame) : QImage();
+    if (image.isNull()) {
+        image = frameDecoder()(frame);
+    }
+    applyImage(image);
+
+    if (m_backFrame == frame && m_backGeneration == m_frameGeneration && !m_backBricks.isEmpty()
+        && !m_needsAllocation) {
+        // The frame was uploaded after the last draw; the previous one
+        // stays resident for stepping back
+        std::swap(m_bricks, m_backBricks);
+        m_dirtyRect = QRect();
+        m_backFrame = frontCurrent ? previousFrame : -1;
+    }
+
+    prefetchFrames(axis, direction);
+    markDataChanged();
+}
+
+LayerBounds ImageLayer::bounds() const
+{
+    if (m_image.isNull()) {
+        return LayerBounds();
+    }
+
+    return LayerBounds(float(m_position.x()),
+                       float(m_position.y()),
+                       float(m_position.x() + m_image.width()),
+                       float(m_position.y() + m_image.height()));
+}
+
+void ImageLayer::render(void* context)
+{
+    RenderContext* ctx = static_cast<RenderContext*>(context);
+    if (!ctx || !ctx->gl || m_image.isNull()) {
+        return;
+    }
+
+    QOpenGLFunctions* gl = ctx->gl;
+
+    if (syncBuffer()) {
+        ++m_dataVersion;
+    }
+
+    if (m_glContext != ctx->glContext) {
+        // Resources from another context cannot be reused
+        m_bricks.clear();
+        m_backBricks.clear();
+        m_backFrame = -1;
+        m_pixelBuffer = 0;
+        m_quad.invalidate();
+        m_glContext = ctx->glContext;
+        m_needsAllocation = true;
+    }
+
+    if (!m_quad.isCreated() && !initializeResources(gl)) {
+        return;
+    }
+
+    if (m_needsAllocation) {
+        allocateBricks(gl);
+    }
+
+    if (!m_dirtyRect.isEmpty()) {
+        uploadDirtyRegion(gl);
+    }
+
+    m_quad.begin(gl, ctx->viewProjectionMatrix(), m_opacity);
+
+    const qreal top = m_position.y() + m_image.height();
+    for (const TextureBrick& brick : m_bricks) {
+        QRectF worldRect(m_position.x() + brick.rect.x(),
+                         top - brick.rect.y() - brick.rect.height(),
+                         brick.rect.width(), brick.rect.height());
+
+        // Skip bricks outside the viewport in 2D
+        if (!ctx->is3D && !ctx->viewRect.intersects(worldRect)) {
+            continue;
+        }
+
+        m_quad.draw(brick.textureId, worldRect);
+    }
+
+    m_quad.end();
+
+    uploadNextFrame(gl);
+}
+
+void ImageLayer::releaseGraphicsResources()
+{
+    QOpenGLContext* current = QOpenGLContext::currentContext();
+    if (!current || current != m_glContext) {
+        return;
+    }
+
+    QOpenGLFunctions* gl = current->functions();
+    deleteBricks(gl);
+    if (m_pixelBuffer) {
+        gl->glDeleteBuffers(1, &m_pixelBuffer);
+        m_pixelBuffer = 0;
+    }
+    m_quad.destroy();
+    m_glContext = nullptr;
+    m_needsAllocation = true;
+    m_dirtyRect = m_image.rect();
+}
+
+void ImageLayer::applyImage(const QImage& image)
+{
+    QImage converted = image.format() == QImage::Format_RGBA8888
+                     ? image
+                     : image.convertToFormat(QImage::Format_RGBA8888);
+
+    if (converted.size() != m_image.size()) {
+        m_needsAllocation = true;
+    }
+
+    m_image = converted;
+    m_dirtyRect = m_image.rect();
+}
+
+bool ImageLayer::syncBuffer()
+{
+    if (m_buffer.isNull() || m_buffer.version() == m_bufferVersion) {
+        return false;
+    }
+
+    // The producer modified the shared buffer in place
+    m_bufferVersion = m_buffer.version();
+    invalidateFrames();
+    if (!m_scalarSource.isNull()) {
+        m_scalarSource = scalarSource(m_plane);
+        remapScalar();
+    } else if (m_image.constBits() == m_plane.constData()) {
+        m_dirtyRect = m_image.rect();
+    } else {
+        applyImage(imageFromBuffer(m_plane));
+    }
+    return true;
+}
+
+FrameCache::Decoder ImageLayer::frameDecoder() const
+{
+    const DataBuffer buffer = m_buffer;
+    const QVector<qint64> shape = sliceShape();
+    const bool scalar = hasScalarData();
+    const double low = m_contrastLow;
+    const double high = m_contrastHigh;
+    const float gamma = m_gamma;
+    const QVector<QRgb> colormap = m_colormap;
+
+    return [=](qint64 frame) {
+        const DataBuffer plane = planeAt(buffer, framePoint(frame, shape));
+        if (scalar) {
+            return mapScalar(scalarSource(plane), low, high, gamma, colormap);
+        }
+        return imageFromBuffer(plane);
+    };
+}
+
+void ImageLayer::prefetchFrames(int axis, qint64 direction)
+{
+    const QVector<qint64> shape = sliceShape();
+    if (shape.isEmpty() || axis < 0 || axis >= shape.size()) {
+        m_nextFrame = -1;
+        return;
+    }
+
+    // Walk ahead along the axis, wrapping like looped playback
+    QVector<qint64> frames;
+    QVector<qint64> point = m_slicePoint;
+    const int count = int(qMin<qint64>(kPrefetchFrames, shape[axis] - 1));
+    for (int i = 0; i < count; ++i) {
+        point[axis] = (point[axis] + direction + shape[axis]) % shape[axis];
+        frames.append(frameIndex(point, shape));
+    }
+    m_nextFrame = frames.value(0, -1);
+
+    FrameCache* cache = FrameCache::instance();
+    if (cache && !frames.isEmpty()) {
+        cache->request(m_frameSourceId, m_frameGeneration, frames, frameDecoder());
+    }
+}
+
+void ImageLayer::invalidateFrames()
+{
+    ++m_frameGeneration;
+    m_backFrame = -1;
+}
+
+bool ImageLayer::initializeResources(QOpenGLFunctions* gl)
+{
+    if (!m_quad.create()) {
+        return false;
+    }
+
+    GLint maxTextureSize = 0;
+    gl->glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    m_maxTextureSize = qBound(256, int(maxTextureSize), kMaxBrickSize);
+
+    m_supportsRowLength = !m_glContext->isOpenGLES() || m_glContext->format().majorVersion() >= 3;
+    return true;
+}
+
+void ImageLayer::allocateBricks(QOpenGLFunctions* gl)
+{
+    deleteBricks(gl);
+    createBricks(gl, &m_bricks);
+
+    m_needsAllocation = false;
+    m_dirtyRect = m_image.rect();
+}
+
+void ImageLayer::createBricks(QOpenGLFunctions* gl, QVector<TextureBrick>* bricks)
+{
+    GpuResourcePool* pool = GpuResourcePool::current();
+    for (int y = 0; y < m_image.height(); y += m_maxTextureSize) {
+        for (int x = 0; x < m_image.width(); x += m_maxTextureSize) {
+            TextureBrick brick;
+            brick.rect = QRect(x, y,
+                               qMin(m_maxTextureSize, m_image.width() - x),
+                               qMin(m_maxTextureSize, m_image.height() - y));
+
+            brick.textureId = pool->acquireTexture(gl, brick.rect.width(), brick.rect.height());
+            bricks->append(brick);
+        }
+    }
+}
+
+void ImageLayer::uploadNextFrame(QOpenGLFunctions* gl)
+{
+    // Pixel buffers come with row length support (desktop GL, OpenGL ES 3)
+    FrameCache* cache = FrameCache::instance();
+    if (!cache || !m_supportsRowLength || m_nextFrame < 0
+        || (m_backFrame == m_nextFrame && m_backGeneration == m_frameGeneration)) {
+        return;
+    }
+
+    const QImage next = cache->frame(m_frameSourceId, m_frameGeneration, m_nextFrame);
+    if (next.isNull() || next.size() != m_image.size() || next.format() != QImage::Format_RGBA8888) {
+        return;
+    }
+
+    if (m_backBricks.isEmpty()) {
+        createBricks(gl, &m_backBricks);
+    }
+    if (!m_pixelBuffer) {
+        gl->glGenBuffers(1, &m_pixelBuffer);
+    }
+
+    // Re-specifying the store orphans the previous transfer instead of
+    // waiting for it; the texture copy then runs while the frame is shown
+    gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+    gl->glBufferData(GL_PIXEL_UNPACK_BUFFER, next.sizeInBytes(), next.constBits(), GL_STREAM_DRAW);
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    gl->glPixelStorei(GL_UNPACK_ROW_LENGTH, next.bytesPerLine() / 4);
+    for (const TextureBrick& brick : qAsConst(m_backBricks)) {
+        const qintptr offset = qintptr(brick.rect.y()) * next.bytesPerLine() + qintptr(brick.rect.x()) * 4;
+        gl->glBindTexture(GL_TEXTURE_2D, brick.textureId);
+        gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, brick.rect.width(), brick.rect.height(),
+                            GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(offset));
+    }
+    gl->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+    gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    m_backFrame = m_nextFrame;
+    m_backGeneration = m_frameGeneration;
+}
+
+void ImageLayer::uploadDirtyRegion(QOpenGLFunctions* gl)
+{
+    for (const TextureBrick& brick : m_bricks) {
+        QRect rect = brick.rect & m_dirtyRect;
+        if (!rect.isEmpty()) {
+            uploadRect(gl, brick, rect);
+        }
+    }
+
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+    m_dirtyRect = QRect();
+}
+
+void ImageLayer::uploadRect(QOpenGLFunctions* gl, const TextureBrick& brick, const QRect& rect)
+{
+    const int xOffset = rect.x() - brick.rect.x();
+    const int yOffset = rect.y() - brick.rect.y();
+
+    gl->glBindTexture(GL_TEXTURE_2D, brick.textureId);
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (m_supportsRowLength) {
+        // Upload straight from the image memory without an intermediate copy
+        gl->glPixelStorei(GL_UNPACK_ROW_LENGTH, m_image.bytesPerLine() / 4);
+        gl->glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset, yOffset, rect.width(), rect.height(),
+                            GL_RGBA, GL_UNSIGNED_BYTE,
+                            m_image.constScanLine(rect.y()) + rect.x() * 4);
+        gl->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    } else {
+        QImage region = m_image.copy(rect);
+        gl->glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset, yOffset, rect.width(), rect.height(),
+                            GL_RGBA, GL_UNSIGNED_BYTE, region.constBits());
+    }
+}
+
+void ImageLayer::deleteBricks(QOpenGLFunctions* gl)
+{
+    // Bricks of the same size are reused by the next image or layer
+    GpuResourcePool* pool = GpuResourcePool::current();
+    for (const TextureBrick& brick : qAsConst(m_bricks)) {
+        pool->releaseTexture(gl, brick.textureId);
+    }
+    for (const TextureBrick& brick : qAsConst(m_backBricks)) {
+        pool->releaseTexture(gl, brick.textureId);
+    }
+    m_bricks.clear();
+    m_backBricks.clear();
+    m_backFrame = -1;
+}
@@ -0,0 +1,327 @@
+#pragma once
+
+#include "FrameCache.h"
+#include "LayerManager.h"
+#include "TexturedQuad.h"
+#include <QImage>
+#include <QOpenGLFunctions>
+#include <QPointF>
+#include <QPair>
+#include <QRect>
+#include <QRgb>
+#include <QVector>
+
+class QOpenGLContext;
+struct RenderContext;
+
+/**
+ * @brief Image layer with GPU-resident textures
+ *
+ * Pixels are uploaded to OpenGL textures the first time the layer is
+ * rendered and stay resident across frames. Changes are tracked as a dirty
+ * rectangle and only that region is re-uploaded. Images larger than the
+ * maximum texture size are split into several texture bricks.
+ *
+ * Single channel buffers are kept as the source and coloured through a
+ * table combining contrast limits, gamma and colormap (see ImageKernels),
+ * so changing any of them re-maps the pixels without touching the data.
+ *
+ * Buffers with leading dimensions (time series, z stacks) are kept whole
+ * and one plane is shown at a time, selected through setSlicePoint().
+ * Coloured planes go into the FrameCache, and the frames following the
+ * current one along the axis that last moved are decoded ahead on worker
+ * threads. The predicted next frame is also uploaded into a second set of
+ * textures after drawing, so stepping to it only swaps textures.
+ */
+class ImageLayer : public Layer
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * @param name Layer name
+     * @param parent Parent object
+     */
+    explicit ImageLayer(const QString& name, QObject* parent = nullptr);
+
+    /**
+     * @brief Destructor
+     */
+    ~ImageLayer();
+
+    /**
+     * @brief Get image
+     * @return Image in RGBA8888 format
+     */
+    QImage image() const { return m_image; }
+
+    /**
+     * @brief Replace the whole image
+     * @param image New image (converted to RGBA8888 if needed)
+     */
+    void setImage(const QImage& image);
+
+    /**
+     * @brief Convert a data buffer to an RGBA8888 image
+     *
+     * Contiguous uint8 RGBA buffers of shape [height, width, 4] are wrapped
+     * without copying. Other uint8 layouts are converted, and single
+     * channel buffers of other types are scaled from their value range.
+     *
+     * @param buffer Buffer of shape [height, width] or [height, width, channels]
+     * @return Image or a null image if the layout is not supported
+     */
+    static QImage imageFromBuffer(const DataBuffer& buffer);
+
+    /**
+     * @brief Write a patch into the image
+     * @param patch Patch image
+     * @param offset Top-left position of the patch in image pixels
+     */
+    void updateImage(const QImage& patch, const QPoint& offset);
+
+    /**
+     * @brief Mark a region as modified so it gets re-uploaded
+     * @param rect Region in image pixels
+     */
+    void markDirty(const QRect& rect);
+
+    /**
+     * @brief Get world position of the image's bottom-left corner
+     * @return Position in world coordinates
+     */
+    QPointF position() const { return m_position; }
+
+    /**
+     * @brief Set world position of the image's bottom-left corner
+     * @param position Position in world coordinates
+     */
+    void setPosition(const QPointF& position);
+
+    /**
+     * @brief Check whether the layer shows single channel data
+     * @return true if contrast limits, gamma and colormap apply
+     */
+    bool hasScalarData() const { return !m_scalarSource.isNull(); }
+
+    /**
+     * @brief Get values mapped to the first and last colormap entry
+     * @return Low and high limit in data units
+     */
+    QPair<double, double> contrastLimits() const { return qMakePair(m_contrastLow, m_contrastHigh); }
+
+    /**
+     * @brief Set values mapped to the first and last colormap entry
+     * @param low Low limit in data units
+     * @param high High limit in data units
+     */
+    void setContrastLimits(double low, double high);
+
+    /**
+     * @brief Get gamma
+     * @return Exponent applied after contrast stretching
+     */
+    float gamma() const { return m_gamma; }
+
+    /**
+     * @brief Set gamma
+     * @param gamma Exponent applied after contrast stretching
+     */
+    void setGamma(float gamma);
+
+    /**
+     * @brief Get colormap
+     * @return Colours from low to high values
+     */
+    QVector<QRgb> colormap() const { return m_colormap; }
+
+    /**
+     * @brief Set colormap
+     * @param colormap Colours from low to high values, usually 256
+     */
+    void setColormap(const QVector<QRgb>& colormap);
+
+    /**
+     * @brief Set contrast limits from percentiles of the data
+     *
+     * Large images are first sampled sparsely so the limits change at once;
+     * the exact percentiles are then computed in the background and
+     * applied unless the limits were set again in the meantime.
+     *
+     * @param lowPercentile Percentile for the low limit
+     * @param highPercentile Percentile for the high limit
+     */
+    void autoContrast(double lowPercentile = 0.5, double highPercentile = 99.5);
+
+    // Layer interface implementation
+    QVariant data() const override;
+    void setData(const QVariant& data) override;
+    DataBuffer buffer() const override;
+    bool setBuffer(const DataBuffer& buffer) override;
+    QVector<qint64> sliceShape() const override;
+    void setSlicePoint(const QVector<qint64>& point) override;
+    LayerBounds bounds() const override;
+    void render(void* context) override;
+    void releaseGraphicsResources() override;
+
+signals:
+    /**
+     * @brief Emitted when the contrast limits change
+     * @param low Low limit
+     * @param high High limit
+     */
+    void contrastLimitsChanged(double low, double high);
+
+private:
+    friend class AutoContrastTask;
+
+    /**
+     * @brief Colour the scalar source into the image
+     */
+    void remapScalar();
+
+    /**
+     * @brief Change the contrast limits and re-map
+     * @param low Low limit
+     * @param high High limit
+     */
+    void applyContrastLimits(double low, double high);
+
+    /**
+     * @brief Apply limits computed in the background
+     * @param generation Value of m_autoContrastGeneration when the task started
+     * @param low Low limit
+     * @param high High limit
+     */
+    void finishAutoContrast(quint64 generation, double low, double high);
+
+    /**
+     * @brief Install a new image without notifying
+     * @param image New image
+     */
+    void applyImage(const QImage& image);
+
+    /**
+     * @brief Pick up in-place modifications of the source buffer
+     * @return true if the buffer changed since it was last seen
+     */
+    bool syncBuffer();
+
+    /**
+     * @brief Get a decoder colouring planes with the current settings
+     *
+     * The decoder holds its own references, so it can run on a worker
+     * thread after the layer changed.
+     *
+     * @return Decoder taking a frame index
+     */
+    FrameCache::Decoder frameDecoder() const;
+
+    /**
+     * @brief Queue the frames following the current one
+     * @param axis Slider dimension being stepped
+     * @param direction 1 to step forward, -1 to step backward
+     */
+    void prefetchFrames(int axis, qint64 direction);
+
+    /**
+     * @brief Drop frames decoded with the previous data or colouring
+     */
+    void invalidateFrames();
+
+    /**
+     * @brief Texture covering a rectangle of the image
+     */
+    struct TextureBrick
+    {
+        GLuint textureId;
+        QRect rect;
+    };
+
+    /**
+     * @brief Create shared drawing resources
+     * @param gl OpenGL functions
+     * @return true if successful
+     */
+    bool initializeResources(QOpenGLFunctions* gl);
+
+    /**
+     * @brief Allocate texture bricks for the current image size
+     * @param gl OpenGL functions
+     */
+    void allocateBricks(QOpenGLFunctions* gl);
+
+    /**
+     * @brief Create empty textures covering the image
+     * @param gl OpenGL functions
+     * @param bricks Receives the bricks
+     */
+    void createBricks(QOpenGLFunctions* gl, QVector<TextureBrick>* bricks);
+
+    /**
+     * @brief Upload the predicted next frame into the back bricks
+     * @param gl OpenGL functions
+     */
+    void uploadNextFrame(QOpenGLFunctions* gl);
+
+    /**
+     * @brief Upload pending changes to the GPU
+     * @param gl OpenGL functions
+     */
+    void uploadDirtyRegion(QOpenGLFunctions* gl);
+
+    /**
+     * @brief Upload an image region into a brick
+     * @param gl OpenGL functions
+     * @param brick Target brick
+     * @param rect Region in image pixels (inside the brick)
+     */
+    void uploadRect(QOpenGLFunctions* gl, const TextureBrick& brick, const QRect& rect);
+
+    /**
+     * @brief Delete texture bricks
+     * @param gl OpenGL functions
+     */
+    void deleteBricks(QOpenGLFunctions* gl);
+
+private:
+    QImage m_image;
+    QPointF m_position;
+
+    // Source buffer, shared with the producer when set through setBuffer()
+    DataBuffer m_buffer;
+    quint64 m_bufferVersion;
+
+    // Displayed plane of m_buffer, selected by the slice point
+    DataBuffer m_plane;
+    QVector<qint64> m_slicePoint;
+
+    // Decoded frames in the FrameCache, filed under the current generation
+    quint64 m_frameSourceId;
+    quint64 m_frameGeneration;
+    qint64 m_nextFrame;                     // Predicted next frame, -1 if none
+
+    // Contiguous uint8, uint16 or float32 copy (or view) of single channel data
+    DataBuffer m_scalarSource;
+    double m_contrastLow;
+    double m_contrastHigh;
+    float m_gamma;
+    QVector<QRgb> m_colormap;
+    quint64 m_autoContrastGeneration;       // Bumped whenever pending refinements become stale
+
+    // Change tracking
+    QRect m_dirtyRect;
+    bool m_needsAllocation;
+
+    // GPU resources
+    QOpenGLContext* m_glContext;
+    TexturedQuad m_quad;
+    QVector<TextureBrick> m_bricks;
+    QVector<TextureBrick> m_backBricks;     // Hold m_backFrame once uploaded
+    qint64 m_backFrame;
+    quint64 m_backGeneration;
+    GLuint m_pixelBuffer;
+    int m_maxTextureSize;
+    bool m_supportsRowLength;
+};
@@ -0,0 +1,888 @@
+#include "LabelsLayer.h"
+#include "CommandHistory.h"
+#include "GpuResourcePool.h"
+#include "RenderContext.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QPointer>
+#include <QtMath>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Elements per tile
+const int kTileElements = LabelsLayer::kTileSize * LabelsLayer::kTileSize;
+
+// Tiles per texture brick edge (512 elements)
+const int kBrickTiles = 8;
+
+// Decoded tiles kept for painting before they are re-encoded (16 MB)
+const int kHotTileLimit = 256;
+
+// The lookup table is a kLutSize x kLutSize texture indexed by the low 16 bits
+const int kLutSize = 256;
+
+// Serialization
+const quint32 kDataMagic = 0x4c424c31; // "LBL1"
+const quint32 kDataVersion = 1;
+
+const char* kFragmentShader =
+    "#ifdef GL_ES\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform sampler2D u_texture;\n"
+    "uniform sampler2D u_lut;\n"
+    "uniform float u_opacity;\n"
+    "varying vec2 v_texCoord;\n"
+    "void main()\n"
+    "{\n"
+    "    // Texels hold label bytes, least significant in red\n"
+    "    vec4 id = floor(texture2D(u_texture, v_texCoord) * 255.0 + 0.5);\n"
+    "    if (id.r + id.g + id.b + id.a == 0.0) {\n"
+    "        discard;\n"
+    "    }\n"
+    "    vec4 color = texture2D(u_lut, (id.rg + 0.5) / 256.0);\n"
+    "    gl_FragColor = vec4(color.rgb, color.a * u_opacity);\n"
+    "}\n";
+
+int keyX(quint64 key) { return int(key & 0xffff); }
+int keyY(quint64 key) { return int((key >> 16) & 0xffff); }
+int keyZ(quint64 key) { return int(key >> 32); }
+
+// Generated colour of a lookup table entry
+QColor lutColor(int index)
+{
+    // Entry 0 serves labels whose low 16 bits are zero
+    const quint32 hash = quint32(index == 0 ? 0x10000 : index) * 2654435761u;
+    return QColor::fromHsv(int((hash >> 8) % 360), 160 + int((hash >> 4) % 96), 200 + int(hash % 56));
+}
+
+// Label ids must not be interpolated, but pool textures minify linearly
+GLuint acquireNearestTexture(QOpenGLFunctions* gl, int width, int height)
+{
+    const GLuint texture = GpuResourcePool::current()->acquireTexture(gl, width, height);
+    gl->glBindTexture(GL_TEXTURE_2D, texture);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    return texture;
+}
+
+// Restores the pool's filtering for the next user of the texture
+void releaseNearestTexture(QOpenGLFunctions* gl, GLuint texture)
+{
+    gl->glBindTexture(GL_TEXTURE_2D, texture);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+    GpuResourcePool::current()->releaseTexture(gl, texture);
+}
+
+} // namespace
+
+/**
+ * @brief Undo command restoring the tiles touched by a labels stroke
+ */
+class LabelStrokeCommand : public HistoryCommand
+{
+public:
+    LabelStrokeCommand(LabelsLayer* layer, const QHash<quint64, LabelsLayer::Tile>& before,
+                       const QHash<quint64, LabelsLayer::Tile>& after, const QString& text)
+        : HistoryCommand(text)
+        , m_layer(layer)
+        , m_before(before)
+        , m_after(after)
+        , m_firstRedo(true)
+    {
+    }
+
+    void undo() override
+    {
+        if (m_layer) {
+            m_layer->restoreTiles(m_before);
+        }
+    }
+
+    void redo() override
+    {
+        // The stroke is already painted when the command is pushed
+        if (m_firstRedo) {
+            m_firstRedo = false;
+            return;
+        }
+        if (m_layer) {
+            m_layer->restoreTiles(m_after);
+        }
+    }
+
+    qint64 memoryCost() const override
+    {
+        qint64 cost = 0;
+        for (const LabelsLayer::Tile& tile : m_before) {
+            cost += qint64(sizeof(LabelsLayer::Tile)) + tile.data.size() * qint64(sizeof(quint32));
+        }
+        for (const LabelsLayer::Tile& tile : m_after) {
+            cost += qint64(sizeof(LabelsLayer::Tile)) + tile.data.size() * qint64(sizeof(quint32));
+        }
+        return cost;
+    }
+
+private:
+    QPointer<LabelsLayer> m_layer;
+    QHash<quint64, LabelsLayer::Tile> m_before;
+    QHash<quint64, LabelsLayer::Tile> m_after;
+    bool m_firstRedo;
+};
+
+LabelsLayer::LabelsLayer(const QString& name, QObject* parent)
+    : Layer(name, LayerType::Labels, parent)
+    , m_width(0)
+    , m_height(0)
+    , m_depth(0)
+    , m_slice(0)
+    , m_position(0.0, 0.0)
+    , m_recording(false)
+    , m_sliceDirty(true)
+    , m_lutDirty(true)
+    , m_glContext(nullptr)
+    , m_lutTexture(0)
+{
+}
+
+LabelsLayer::~LabelsLayer()
+{
+    // GPU resources are released by the viewer through releaseGraphicsResources()
+}
+
+void LabelsLayer::resize(int width, int height, int depth)
+{
+    // Tile coordinates are stored in 16 bits
+    const int maxExtent = kTileSize * 0xffff;
+    m_width = qBound(0, width, maxExtent);
+    m_height = qBound(0, height, maxExtent);
+    m_depth = qMax(0, depth);
+    m_slice = qBound(0, m_slice, qMax(0, m_depth - 1));
+
+    m_tiles.clear();
+    m_hotTiles.clear();
+    m_strokeTiles.clear();
+    m_dirtyTiles.clear();
+    m_sliceDirty = true;
+    markDataChanged();
+}
+
+void LabelsLayer::setCurrentSlice(int slice)
+{
+    slice = qBound(0, slice, qMax(0, m_depth - 1));
+    if (slice == m_slice) {
+        return;
+    }
+
+    m_slice = slice;
+    m_sliceDirty = true;
+    emit currentSliceChanged(slice);
+    emit changed();
+}
+
+QVector<qint64> LabelsLayer::sliceShape() const
+{
+    return m_depth > 1 ? QVector<qint64>{m_depth} : QVector<qint64>();
+}
+
+void LabelsLayer::setSlicePoint(const QVector<qint64>& point)
+{
+    if (!point.isEmpty()) {
+        setCurrentSlice(int(point.last()));
+    }
+}
+
+void LabelsLayer::setPosition(const QPointF& position)
+{
+    if (m_position != position) {
+        m_position = position;
+        emit changed();
+    }
+}
+
+quint32 LabelsLayer::label(int x, int y, int z) const
+{
+    if (x < 0 || y < 0 || z < 0 || x >= m_width || y >= m_height || z >= m_depth) {
+        return 0;
+    }
+
+    auto it = m_tiles.constFind(tileKey(x / kTileSize, y / kTileSize, z));
+    if (it == m_tiles.constEnd()) {
+        return 0;
+    }
+
+    const int index = (y % kTileSize) * kTileSize + x % kTileSize;
+    switch (it->encoding) {
+    case Tile::Uniform:
+        return it->value;
+    case Tile::Raw:
+        return it->data.at(index);
+    case Tile::RunLength:
+        for (int i = 0, start = 0; i + 1 < it->data.size(); i += 2) {
+            start += int(it->data[i + 1]);
+            if (index < start) {
+                return it->data[i];
+            }
+        }
+        break;
+    }
+    return 0;
+}
+
+void LabelsLayer::paint(const QPoint& center, int radius, quint32 label, int z)
+{
+    radius = qMax(0, radius);
+    const QRect rect = QRect(center.x() - radius, center.y() - radius, 2 * radius + 1, 2 * radius + 1)
+                     & QRect(0, 0, m_width, m_height);
+    if (rect.isEmpty()) {
+        return;
+    }
+
+    // Horizontal extent of the disc on every row of the rectangle
+    QVector<QPair<int, int>> spans(rect.height());
+    for (int row = 0; row < rect.height(); ++row) {
+        const int dy = rect.top() + row - center.y();
+        const int halfWidth = int(std::sqrt(double(radius * radius - dy * dy)));
+        spans[row] = qMakePair(qMax(rect.left(), center.x() - halfWidth),
+                               qMin(rect.right(), center.x() + halfWidth));
+    }
+    paintRows(rect, z < 0 ? m_slice : z, label, spans);
+}
+
+void LabelsLayer::fill(const QRect& rect, quint32 label, int z)
+{
+    const QRect clipped = rect & QRect(0, 0, m_width, m_height);
+    if (clipped.isEmpty()) {
+        return;
+    }
+    paintRows(clipped, z < 0 ? m_slice : z, label,
+              QVector<QPair<int, int>>(clipped.height(), qMakePair(clipped.left(), clipped.right())));
+}
+
+void LabelsLayer::beginStroke()
+{
+    m_recording = true;
+    m_strokeTiles.clear();
+}
+
+HistoryCommand* LabelsLayer::endStroke(const QString& text)
+{
+    m_recording = false;
+    const QHash<quint64, Tile> touched = m_strokeTiles;
+    m_strokeTiles.clear();
+
+    QHash<quint64, Tile> before;
+    QHash<quint64, Tile> after;
+    for (auto it = touched.constBegin(); it != touched.constEnd(); ++it) {
+        compactTile(it.key());
+        const Tile old = it->encoding == Tile::Raw ? encodeTile(it->data.constData()) : it.value();
+        const Tile current = m_tiles.value(it.key());
+        if (old.encoding == current.encoding && old.value == current.value && old.data == current.data) {
+            continue;
+        }
+        before.insert(it.key(), old);
+        after.insert(it.key(), current);
+    }
+
+    if (before.isEmpty()) {
+        return nullptr;
+    }
+    return new LabelStrokeCommand(this, before, after, text.isEmpty() ? tr("Paint Labels") : text);
+}
+
+QColor LabelsLayer::labelColor(quint32 label) const
+{
+    if (label == 0) {
+        return QColor(Qt::transparent);
+    }
+    return m_customColors.value(label & 0xffff, lutColor(int(label & 0xffff)));
+}
+
+void LabelsLayer::setLabelColor(quint32 label, const QColor& color)
+{
+    if (label == 0) {
+        return;
+    }
+    m_customColors.insert(label & 0xffff, color);
+    m_lutDirty = true;
+    emit changed();
+}
+
+QColor LabelsLayer::defaultColor(quint32 label)
+{
+    return label == 0 ? QColor(Qt::transparent) : lutColor(int(label & 0xffff));
+}
+
+qint64 LabelsLayer::memoryUsage() const
+{
+    qint64 bytes = 0;
+    for (const Tile& tile : m_tiles) {
+        bytes += qint64(sizeof(Tile)) + tile.data.size() * qint64(sizeof(quint32));
+    }
+    return bytes;
+}
+
+QVariant LabelsLayer::data() const
+{
+    // Decoded tiles are encoded on the way out
+    QByteArray bytes;
+    QDataStream out(&bytes, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << kDataMagic << kDataVersion << qint32(m_width) << qint32(m_height) << qint32(m_depth)
+        << qint32(m_slice) << quint32(m_tiles.size());
+    for (auto it = m_tiles.constBegin(); it != m_tiles.constEnd(); ++it) {
+        const Tile tile = it->encoding == Tile::Raw ? encodeTile(it->data.constData()) : it.value();
+        out << it.key() << quint8(tile.encoding) << tile.value << tile.data;
+    }
+
+    out << quint32(m_customColors.size());
+    for (auto it = m_customColors.constBegin(); it != m_customColors.constEnd(); ++it) {
+        out << it.key() << it.value();
+    }
+    return bytes;
+}
+
+void LabelsLayer::setData(const QVariant& data)
+{
+    if (data.userType() == qMetaTypeId<DataBuffer>()) {
+        setBuffer(data.value<DataBuffer>());
+        return;
+    }
+    if (data.userType() != QMetaType::QByteArray) {
+        return;
+    }
+
+    QDataStream in(data.toByteArray());
+    in.setVersion(QDataStream::Qt_5_12);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint32 width = 0;
+    qint32 height = 0;
+    qint32 depth = 0;
+    qint32 slice = 0;
+    quint32 tileCount = 0;
+    in >> magic >> version >> width >> height >> depth >> slice >> tileCount;
+    if (in.status() != QDataStream::Ok || magic != kDataMagic || version > kDataVersion) {
+        qWarning() << "LabelsLayer: unsupported label data";
+        return;
+    }
+
+    QHash<quint64, Tile> tiles;
+    tiles.reserve(int(tileCount));
+    for (quint32 i = 0; i < tileCount && in.status() == QDataStream::Ok; ++i) {
+        quint64 key = 0;
+        quint8 encoding = 0;
+        Tile tile;
+        in >> key >> encoding >> tile.value >> tile.data;
+        tile.encoding = Tile::Encoding(encoding);
+        bool valid = (tile.encoding == Tile::Uniform && tile.data.isEmpty())
+                  || (tile.encoding == Tile::RunLength && tile.data.size() % 2 == 0)
+                  || (tile.encoding == Tile::Raw && tile.data.size() == kTileElements);
+        if (valid && tile.encoding == Tile::RunLength) {
+            // Runs have to cover the tile exactly
+            qint64 covered = 0;
+            for (int run = 1; run < tile.data.size(); run += 2) {
+                covered += tile.data[run];
+            }
+            valid = covered == kTileElements;
+        }
+        if (!valid) {
+            qWarning() << "LabelsLayer: corrupt label data";
+            return;
+        }
+        tiles.insert(key, tile);
+    }
+
+    QHash<quint32, QColor> colors;
+    quint32 colorCount = 0;
+    in >> colorCount;
+    for (quint32 i = 0; i < colorCount && in.status() == QDataStream::Ok; ++i) {
+        quint32 index = 0;
+        QColor color;
+        in >> index >> color;
+        colors.insert(index, color);
+    }
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "LabelsLayer: truncated label data";
+        return;
+    }
+
+    resize(width, height, depth);
+    setCurrentSlice(slice);
+
+    // Keys outside the grid would address pixels beyond the layer
+    const int tilesX = (m_width + kTileSize - 1) / kTileSize;
+    const int tilesY = (m_height + kTileSize - 1) / kTileSize;
+    int dropped = 0;
+    for (auto it = tiles.begin(); it != tiles.end();) {
+        const quint64 key = it.key();
+        if (keyX(key) >= tilesX || keyY(key) >= tilesY || keyZ(key) < 0 || keyZ(key) >= m_depth) {
+            it = tiles.erase(it);
+            ++dropped;
+        } else {
+            ++it;
+        }
+    }
+    if (dropped > 0) {
+        qWarning() << "LabelsLayer: dropped" << dropped << "tiles outside the label grid";
+    }
+
+    m_tiles = tiles;
+    m_customColors = colors;
+    m_lutDirty = true;
+    markDataChanged();
+}
+
+bool LabelsLayer::setBuffer(const DataBuffer& buffer)
+{
+    const DataType type = buffer.dtype();
+    const bool integer = type == DataType::UInt8 || type == DataType::UInt16 || type == DataType::UInt32
+                      || type == DataType::Int8 || type == DataType::Int16 || type == DataType::Int32;
+    if (buffer.isNull() || !integer || buffer.ndim() < 2 || buffer.ndim() > 3) {
+        qWarning() << "LabelsLayer: unsupported buffer" << dataTypeName(type) << buffer.shape();
+        return false;
+    }
+
+    // The labels are converted into tiles; the buffer is not referenced
+    const bool volume = buffer.ndim() == 3;
+    const int depth = volume ? int(buffer.shape(0)) : 1;
+    const int height = int(buffer.shape(volume ? 1 : 0));
+    const int width = int(buffer.shape(volume ? 2 : 1));
+    resize(width, height, depth);
+
+    QVector<quint32> labels(kTileElements);
+    for (int z = 0; z < m_depth; ++z) {
+        const DataBuffer slice = volume ? buffer.slice(0, z) : buffer;
+        for (int tileY = 0; tileY * kTileSize < m_height; ++tileY) {
+            for (int tileX = 0; tileX * kTileSize < m_width; ++tileX) {
+                const int x = tileX * kTileSize;
+                const int y = tileY * kTileSize;
+                const int w = qMin(kTileSize, m_width - x);
+                const int h = qMin(kTileSize, m_height - y);
+                const DataBuffer region = slice.region({y, x}, {h, w}).converted(DataType::UInt32);
+                const quint32* in = region.constData<quint32>();
+
+                labels.fill(0);
+                for (int row = 0; row < h; ++row) {
+                    std::memcpy(labels.data() + row * kTileSize, in + row * w, size_t(w) * sizeof(quint32));
+                }
+
+                Tile tile = encodeTile(labels.constData());
+                if (tile.encoding != Tile::Uniform || tile.value != 0) {
+                    m_tiles.insert(tileKey(tileX, tileY, z), tile);
+                }
+            }
+        }
+    }
+
+    markDataChanged();
+    return true;
+}
+
+LayerBounds LabelsLayer::bounds() const
+{
+    if (m_width == 0 || m_height == 0) {
+        return LayerBounds();
+    }
+
+    return LayerBounds(float(m_position.x()),
+                       float(m_position.y()),
+                       float(m_position.x() + m_width),
+                       float(m_position.y() + m_height));
+}
+
+void LabelsLayer::render(void* context)
+{
+    RenderContext* ctx = static_cast<RenderContext*>(context);
+    if (!ctx || !ctx->gl || m_width == 0 || m_height == 0 || m_depth == 0) {
+        return;
+    }
+
+    QOpenGLFunctions* gl = ctx->gl;
+
+    if (m_glContext != ctx->glContext) {
+        // Resources from another context cannot be reused
+        m_bricks.clear();
+        m_lutTexture = 0;
+        m_quad.invalidate();
+        m_glContext = ctx->glContext;
+        m_sliceDirty = true;
+        m_lutDirty = true;
+    }
+
+    if (!m_quad.isCreated() && !initializeResources(gl)) {
+        return;
+    }
+
+    if (m_lutDirty) {
+        uploadLut(gl);
+    }
+    uploadDirtyTiles(gl);
+
+    if (m_bricks.isEmpty()) {
+        return;
+    }
+
+    m_quad.begin(gl, ctx->viewProjectionMatrix(), m_opacity);
+    m_quad.program()->setUniformValue("u_lut", 1);
+    gl->glActiveTexture(GL_TEXTURE1);
+    gl->glBindTexture(GL_TEXTURE_2D, m_lutTexture);
+    gl->glActiveTexture(GL_TEXTURE0);
+
+    const int brickSize = kBrickTiles * kTileSize;
+    const qreal top = m_position.y() + m_height;
+    for (auto it = m_bricks.constBegin(); it != m_bricks.constEnd(); ++it) {
+        const int x = int(it.key() & 0xffff) * brickSize;
+        const int y = int(it.key() >> 16) * brickSize;
+        const int w = qMin(brickSize, m_width - x);
+        const int h = qMin(brickSize, m_height - y);
+        QRectF worldRect(m_position.x() + x, top - y - h, w, h);
+
+        // Skip bricks outside the viewport in 2D
+        if (!ctx->is3D && !ctx->viewRect.intersects(worldRect)) {
+            continue;
+        }
+
+        m_quad.draw(it.value(), worldRect);
+    }
+
+    gl->glActiveTexture(GL_TEXTURE1);
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+    gl->glActiveTexture(GL_TEXTURE0);
+    m_quad.end();
+}
+
+void LabelsLayer::releaseGraphicsResources()
+{
+    QOpenGLContext* current = QOpenGLContext::currentContext();
+    if (!current || current != m_glContext) {
+        return;
+    }
+
+    deleteTextures(current->functions());
+    m_quad.destroy();
+    m_glContext = nullptr;
+    m_sliceDirty = true;
+    m_lutDirty = true;
+}
+
+void LabelsLayer::paintRows(const QRect& rect, int z, quint32 newLabel, const QVector<QPair<int, int>>& spans)
+{
+    if (z < 0 || z >= m_depth) {
+        return;
+    }
+
+    bool changed = false;
+    for (int tileY = rect.top() / kTileSize; tileY <= rect.bottom() / kTileSize; ++tileY) {
+        for (int tileX = rect.left() / kTileSize; tileX <= rect.right() / kTileSize; ++tileX) {
+            const quint64 key = tileKey(tileX, tileY, z);
+            auto existing = m_tiles.constFind(key);
+            if (existing == m_tiles.constEnd() ? newLabel == 0
+                                               : existing->encoding == Tile::Uniform && existing->value == newLabel) {
+                // Nothing to change in this tile
+                continue;
+            }
+
+            // Rows and columns of the tile inside the rectangle
+            const int x0 = tileX * kTileSize;
+            const int y0 = tileY * kTileSize;
+            const int rowBegin = qMax(rect.top(), y0);
+            const int rowEnd = qMin(rect.bottom(), y0 + kTileSize - 1);
+
+            quint32* labels = nullptr;
+            bool tileChanged = false;
+            for (int y = rowBegin; y <= rowEnd; ++y) {
+                const QPair<int, int>& span = spans[y - rect.top()];
+                const int begin = qMax(span.first, x0);
+                const int end = qMin(span.second, x0 + kTileSize - 1);
+                for (int x = begin; x <= end; ++x) {
+                    if (!labels) {
+                        if (label(x, y, z) == newLabel) {
+                            continue;
+                        }
+                        recordTile(key);
+                        labels = writableTile(key);
+                    }
+                    quint32& value = labels[(y - y0) * kTileSize + (x - x0)];
+                    if (value != newLabel) {
+                        value = newLabel;
+                        tileChanged = true;
+                    }
+                }
+            }
+
+            if (tileChanged) {
+                touchTile(key);
+                changed = true;
+            }
+        }
+    }
+
+    compactHotTiles(kHotTileLimit);
+    if (changed) {
+        markDataChanged();
+    }
+}
+
+quint32* LabelsLayer::writableTile(quint64 key)
+{
+    Tile& tile = m_tiles[key];
+    if (tile.encoding != Tile::Raw) {
+        QVector<quint32> labels(kTileElements);
+        decodeTile(tile, labels.data());
+        tile.data = labels;
+        tile.encoding = Tile::Raw;
+        tile.value = 0;
+    }
+
+    // Most recently used last
+    m_hotTiles.removeOne(key);
+    m_hotTiles.append(key);
+    return tile.data.data();
+}
+
+void LabelsLayer::recordTile(quint64 key)
+{
+    if (m_recording && !m_strokeTiles.contains(key)) {
+        // Missing tiles are recorded as background
+        m_strokeTiles.insert(key, m_tiles.value(key));
+    }
+}
+
+void LabelsLayer::touchTile(quint64 key)
+{
+    if (keyZ(key) == m_slice) {
+        m_dirtyTiles.insert(key);
+    }
+}
+
+void LabelsLayer::compactHotTiles(int limit)
+{
+    while (m_hotTiles.size() > limit) {
+        compactTile(m_hotTiles.first());
+    }
+}
+
+void LabelsLayer::compactTile(quint64 key)
+{
+    m_hotTiles.removeOne(key);
+
+    auto it = m_tiles.find(key);
+    if (it == m_tiles.end() || it->encoding != Tile::Raw) {
+        return;
+    }
+
+    Tile encoded = encodeTile(it->data.constData());
+    if (encoded.encoding == Tile::Uniform && encoded.value == 0) {
+        m_tiles.erase(it);
+    } else {
+        *it = encoded;
+    }
+}
+
+LabelsLayer::Tile LabelsLayer::encodeTile(const quint32* labels)
+{
+    QVector<quint32> runs;
+    for (int i = 0; i < kTileElements;) {
+        const quint32 value = labels[i];
+        int end = i + 1;
+        while (end < kTileElements && labels[end] == value) {
+            ++end;
+        }
+        runs.append(value);
+        runs.append(quint32(end - i));
+        i = end;
+
+        // Run-length would be larger than the raw tile
+        if (runs.size() >= kTileElements) {
+            break;
+        }
+    }
+
+    Tile tile;
+    if (runs.size() == 2) {
+        tile.encoding = Tile::Uniform;
+        tile.value = runs[0];
+    } else if (runs.size() < kTileElements) {
+        tile.encoding = Tile::RunLength;
+        tile.data = runs;
+    } else {
+        tile.encoding = Tile::Raw;
+        tile.data = QVector<quint32>(labels, labels + kTileElements);
+    }
+    return tile;
+}
+
+void LabelsLayer::decodeTile(const Tile& tile, quint32* labels)
+{
+    switch (tile.encoding) {
+    case Tile::Uniform:
+        std::fill(labels, labels + kTileElements, tile.value);
+        break;
+    case Tile::Raw:
+        std::copy(tile.data.constBegin(), tile.data.constEnd(), labels);
+        break;
+    case Tile::RunLength: {
+        quint32* out = labels;
+        quint32* const end = labels + kTileElements;
+        for (int i = 0; i + 1 < tile.data.size() && out < end; i += 2) {
+            const qint64 length = qMin<qint64>(tile.data[i + 1], end - out);
+            std::fill(out, out + length, tile.data[i]);
+            out += length;
+        }
+        std::fill(out, end, 0u);
+        break;
+    }
+    }
+}
+
+void LabelsLayer::restoreTiles(const QHash<quint64, Tile>& tiles)
+{
+    const int tilesX = (m_width + kTileSize - 1) / kTileSize;
+    const int tilesY = (m_height + kTileSize - 1) / kTileSize;
+    for (auto it = tiles.constBegin(); it != tiles.constEnd(); ++it) {
+        const quint64 key = it.key();
+        if (keyX(key) >= tilesX || keyY(key) >= tilesY || keyZ(key) < 0 || keyZ(key) >= m_depth) {
+            continue;
+        }
+
+        m_hotTiles.removeOne(key);
+        if (it->encoding == Tile::Uniform && it->value == 0) {
+            m_tiles.remove(key);
+        } else {
+            m_tiles.insert(key, it.value());
+        }
+        touchTile(key);
+    }
+    markDataChanged();
+}
+
+bool LabelsLayer::initializeResources(QOpenGLFunctions* gl)
+{
+    if (!m_quad.create(kFragmentShader)) {
+        return false;
+    }
+
+    m_lutTexture = acquireNearestTexture(gl, kLutSize, kLutSize);
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+    m_lutDirty = true;
+    return true;
+}
+
+void LabelsLayer::uploadLut(QOpenGLFunctions* gl)
+{
+    // Entry index = low byte + 256 * second byte, matching the shader lookup
+    QVector<uchar> lut(kLutSize * kLutSize * 4);
+    for (int i = 0; i < kLutSize * kLutSize; ++i) {
+        const QColor color = m_customColors.value(quint32(i), lutColor(i));
+        lut[4 * i + 0] = uchar(color.red());
+        lut[4 * i + 1] = uchar(color.green());
+        lut[4 * i + 2] = uchar(color.blue());
+        lut[4 * i + 3] = uchar(color.alpha());
+    }
+
+    gl->glBindTexture(GL_TEXTURE_2D, m_lutTexture);
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, kLutSize, kLutSize, GL_RGBA, GL_UNSIGNED_BYTE, lut.constData());
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+    m_lutDirty = false;
+}
+
+void LabelsLayer::uploadDirtyTiles(QOpenGLFunctions* gl)
+{
+    if (m_sliceDirty) {
+        // Another slice is shown: rebuild the bricks from its tiles
+        for (GLuint texture : qAsConst(m_bricks)) {
+            releaseNearestTexture(gl, texture);
+        }
+        m_bricks.clear();
+        m_dirtyTiles.clear();
+        for (auto it = m_tiles.constBegin(); it != m_tiles.constEnd(); ++it) {
+            if (keyZ(it.key()) == m_slice) {
+                m_dirtyTiles.insert(it.key());
+            }
+        }
+        m_sliceDirty = false;
+    }
+
+    if (m_dirtyTiles.isEmpty()) {
+        return;
+    }
+
+    const int brickSize = kBrickTiles * kTileSize;
+    QVector<quint32> labels(kTileElements);
+    QVector<quint32> packed;
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    for (quint64 key : qAsConst(m_dirtyTiles)) {
+        const int tileX = keyX(key);
+        const int tileY = keyY(key);
+        const quint32 brickKey = (quint32(tileY / kBrickTiles) << 16) | quint32(tileX / kBrickTiles);
+        const int brickX = (tileX / kBrickTiles) * brickSize;
+        const int brickY = (tileY / kBrickTiles) * brickSize;
+
+        auto tile = m_tiles.constFind(key);
+        auto brick = m_bricks.find(brickKey);
+        if (brick == m_bricks.end()) {
+            if (tile == m_tiles.constEnd()) {
+                // Background in a brick that does not exist
+                continue;
+            }
+
+            // New bricks start as background
+            const int w = qMin(brickSize, m_width - brickX);
+            const int h = qMin(brickSize, m_height - brickY);
+            const QVector<quint32> zeros(w * h, 0u);
+            const GLuint texture = acquireNearestTexture(gl, w, h);
+            gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, zeros.constData());
+            brick = m_bricks.insert(brickKey, texture);
+        }
+
+        const quint32* source = labels.constData();
+        if (tile == m_tiles.constEnd()) {
+            labels.fill(0);
+        } else if (tile->encoding == Tile::Raw) {
+            source = tile->data.constData();
+        } else {
+            decodeTile(tile.value(), labels.data());
+        }
+
+        // Edge tiles are narrower than the tile stride
+        const int x = tileX * kTileSize;
+        const int y = tileY * kTileSize;
+        const int w = qMin(kTileSize, m_width - x);
+        const int h = qMin(kTileSize, m_height - y);
+        if (w != kTileSize) {
+            packed.resize(w * h);
+            for (int row = 0; row < h; ++row) {
+                std::memcpy(packed.data() + row * w, source + row * kTileSize, size_t(w) * sizeof(quint32));
+            }
+            source = packed.constData();
+        }
+
+        gl->glBindTexture(GL_TEXTURE_2D, brick.value());
+        gl->glTexSubImage2D(GL_TEXTURE_2D, 0, x - brickX, y - brickY, w, h, GL_RGBA, GL_UNSIGNED_BYTE, source);
+    }
+
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+    m_dirtyTiles.clear();
+}
+
+void LabelsLayer::deleteTextures(QOpenGLFunctions* gl)
+{
+    // Bricks of the same size are reused by the next slice or layer
+    for (GLuint texture : qAsConst(m_bricks)) {
+        releaseNearestTexture(gl, texture);
+    }
+    m_bricks.clear();
+
+    if (m_lutTexture) {
+        releaseNearestTexture(gl, m_lutTexture);
+        m_lutTexture = 0;
+    }
+}
@@ -0,0 +1,337 @@
+#pragma once
+
+#include "LayerManager.h"
+#include "TexturedQuad.h"
+#include <QColor>
+#include <QHash>
+#include <QPair>
+#include <QOpenGLFunctions>
+#include <QPointF>
+#include <QRect>
+#include <QSet>
+#include <QVector>
+
+class QOpenGLContext;
+class HistoryCommand;
+struct RenderContext;
+
+/**
+ * @brief Integer segmentation layer stored as sparse compressed tiles
+ *
+ * The label volume (depth x height x width, uint32, 0 = background) is
+ * split into kTileSize x kTileSize tiles per slice. Background tiles are
+ * not stored at all, tiles holding a single label store only that value
+ * and the rest are run-length encoded, so memory follows the labeled
+ * area rather than the volume size. Tiles being painted are kept decoded
+ * in a small most-recently-used set and re-encoded when they fall out of
+ * it.
+ *
+ * The current slice is drawn from texture bricks holding raw label ids;
+ * a fragment shader colours them through a lookup table texture. Bricks
+ * are only created where the slice has labels, and only tiles changed
+ * since the last frame are uploaded.
+ */
+class LabelsLayer : public Layer
+{
+    Q_OBJECT
+
+public:
+    // Tile edge length in elements
+    static constexpr int kTileSize = 64;
+
+    /**
+     * @brief Constructor
+     * @param name Layer name
+     * @param parent Parent object
+     */
+    explicit LabelsLayer(const QString& name, QObject* parent = nullptr);
+
+    /**
+     * @brief Destructor
+     */
+    ~LabelsLayer();
+
+    /**
+     * @brief Set the volume size and clear all labels
+     * @param width Width in elements
+     * @param height Height in elements
+     * @param depth Number of slices
+     */
+    void resize(int width, int height, int depth = 1);
+
+    /**
+     * @brief Get width
+     * @return Width in elements
+     */
+    int width() const { return m_width; }
+
+    /**
+     * @brief Get height
+     * @return Height in elements
+     */
+    int height() const { return m_height; }
+
+    /**
+     * @brief Get number of slices
+     * @return Depth
+     */
+    int depth() const { return m_depth; }
+
+    /**
+     * @brief Get the slice that is displayed and painted by default
+     * @return Slice index
+     */
+    int currentSlice() const { return m_slice; }
+
+    /**
+     * @brief Set the displayed slice
+     * @param slice Slice index, clamped to the volume
+     */
+    void setCurrentSlice(int slice);
+
+    /**
+     * @brief Get world position of the slice's bottom-left corner
+     * @return Position in world coordinates
+     */
+    QPointF position() const { return m_position; }
+
+    /**
+     * @brief Set world position of the slice's bottom-left corner
+     * @param position Position in world coordinates
+     */
+    void setPosition(const QPointF& position);
+
+    /**
+     * @brief Get a label
+     * @param x Column
+     * @param y Row
+     * @param z Slice
+     * @return Label, 0 outside the volume
+     */
+    quint32 label(int x, int y, int z) const;
+
+    /**
+     * @brief Paint a filled disc
+     * @param center Center in elements
+     * @param radius Radius in elements (0 paints a single element)
+     * @param label Label to write, 0 erases
+     * @param z Slice, -1 for the current slice
+     */
+    void paint(const QPoint& center, int radius, quint32 label, int z = -1);
+
+    /**
+     * @brief Fill a rectangle
+     * @param rect Rectangle in elements
+     * @param label Label to write, 0 erases
+     * @param z Slice, -1 for the current slice
+     */
+    void fill(const QRect& rect, quint32 label, int z = -1);
+
+    /**
+     * @brief Start recording edits for undo
+     *
+     * Every tile touched until endStroke() is snapshotted on first touch.
+     */
+    void beginStroke();
+
+    /**
+     * @brief Stop recording edits
+     * @param text Command text
+     * @return Command restoring the touched tiles, nullptr if nothing changed;
+     *         the caller pushes it to a CommandHistory or deletes it
+     */
+    HistoryCommand* endStroke(const QString& text = QString());
+
+    /**
+     * @brief Get the colour of a label
+     * @param label Label
+     * @return Colour
+     */
+    QColor labelColor(quint32 label) const;
+
+    /**
+     * @brief Override the colour of a label
+     *
+     * The lookup table has 65536 entries indexed by the low 16 bits of the
+     * label, so labels that share them share a colour.
+     *
+     * @param label Label (not 0)
+     * @param color Colour
+     */
+    void setLabelColor(quint32 label, const QColor& color);
+
+    /**
+     * @brief Get the generated colour of a label
+     * @param label Label
+     * @return Colour, transparent for 0
+     */
+    static QColor defaultColor(quint32 label);
+
+    /**
+     * @brief Get number of stored tiles
+     * @return Tiles that are not background
+     */
+    int tileCount() const { return m_tiles.size(); }
+
+    /**
+     * @brief Get memory held by the labels
+     * @return Bytes of tile data
+     */
+    qint64 memoryUsage() const;
+
+    // Layer interface implementation
+    QVariant data() const override;
+    void setData(const QVariant& data) override;
+    bool setBuffer(const DataBuffer& buffer) override;
+    QVector<qint64> sliceShape() const override;
+    void setSlicePoint(const QVector<qint64>& point) override;
+    LayerBounds bounds() const override;
+    void render(void* context) override;
+    void releaseGraphicsResources() override;
+
+signals:
+    /**
+     * @brief Emitted when the displayed slice changes
+     * @param slice Slice index
+     */
+    void currentSliceChanged(int slice);
+
+private:
+    friend class LabelStrokeCommand;
+
+    /**
+     * @brief Tile storage
+     */
+    struct Tile
+    {
+        enum Encoding {
+            Uniform,    ///< Every element is value
+            RunLength,  ///< data holds (value, length) pairs in row-major order
+            Raw         ///< data holds kTileSize * kTileSize labels
+        };
+
+        Encoding encoding = Uniform;
+        quint32 value = 0;
+        QVector<quint32> data;
+    };
+
+    /**
+     * @brief Build a tile key
+     */
+    static quint64 tileKey(int tileX, int tileY, int z)
+    {
+        return (quint64(quint32(z)) << 32) | (quint64(tileY) << 16) | quint64(tileX);
+    }
+
+    /**
+     * @brief Write a label to spans of rows, tile by tile
+     * @param rect Rectangle holding the spans, inside the volume
+     * @param z Slice
+     * @param newLabel Label to write
+     * @param spans First and last column written on each row of rect
+     */
+    void paintRows(const QRect& rect, int z, quint32 newLabel, const QVector<QPair<int, int>>& spans);
+
+    /**
+     * @brief Get a decoded tile for writing, creating it if needed
+     * @param key Tile key
+     * @return kTileSize * kTileSize labels
+     */
+    quint32* writableTile(quint64 key);
+
+    /**
+     * @brief Record a tile before its first change in a stroke
+     * @param key Tile key
+     */
+    void recordTile(quint64 key);
+
+    /**
+     * @brief Note that a tile changed
+     * @param key Tile key
+     */
+    void touchTile(quint64 key);
+
+    /**
+     * @brief Re-encode decoded tiles beyond the hot tile limit
+     * @param limit Number of tiles that stay decoded
+     */
+    void compactHotTiles(int limit);
+
+    /**
+     * @brief Encode a decoded tile, dropping it if it is background
+     * @param key Tile key
+     */
+    void compactTile(quint64 key);
+
+    /**
+     * @brief Encode labels
+     * @param labels kTileSize * kTileSize labels
+     * @return Smallest encoding
+     */
+    static Tile encodeTile(const quint32* labels);
+
+    /**
+     * @brief Decode a tile
+     * @param tile Tile
+     * @param labels Receives kTileSize * kTileSize labels
+     */
+    static void decodeTile(const Tile& tile, quint32* labels);
+
+    /**
+     * @brief Install tiles, e.g. from undo
+     * @param tiles Tiles by key; Uniform tiles with value 0 are removed
+     */
+    void restoreTiles(const QHash<quint64, Tile>& tiles);
+
+    /**
+     * @brief Create shared drawing resources
+     * @param gl OpenGL functions
+     * @return true if successful
+     */
+    bool initializeResources(QOpenGLFunctions* gl);
+
+    /**
+     * @brief Upload the colour lookup table
+     * @param gl OpenGL functions
+     */
+    void uploadLut(QOpenGLFunctions* gl);
+
+    /**
+     * @brief Upload changed tiles of the current slice
+     * @param gl OpenGL functions
+     */
+    void uploadDirtyTiles(QOpenGLFunctions* gl);
+
+    /**
+     * @brief Delete all textures
+     * @param gl OpenGL functions
+     */
+    void deleteTextures(QOpenGLFunctions* gl);
+
+private:
+    int m_width;
+    int m_height;
+    int m_depth;
+    int m_slice;
+    QPointF m_position;
+
+    // Label storage
+    QHash<quint64, Tile> m_tiles;
+    QVector<quint64> m_hotTiles;            // Decoded tiles, least recently used first
+    bool m_recording;
+    QHash<quint64, Tile> m_strokeTiles;     // Tiles before the current stroke
+
+    // Colours
+    QHash<quint32, QColor> m_customColors;
+
+    // Change tracking for the current slice
+    QSet<quint64> m_dirtyTiles;
+    bool m_sliceDirty;
+    bool m_lutDirty;
+
+    // GPU resources
+    QOpenGLContext* m_glContext;
+    TexturedQuad m_quad;
+    QHash<quint32, GLuint> m_bricks;        // Brick textures of the current slice by (row << 16 | column)
+    GLuint m_lutTexture;
+};
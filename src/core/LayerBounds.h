@@ -0,0 +1,137 @@
+#pragma once
+
+#include <QPointF>
+#include <QRectF>
+#include <QtGlobal>
+
+/**
+ * @brief Axis-aligned 2D bounding box of a layer, by value
+ *
+ * A default-constructed box is empty; uniting with an empty box leaves
+ * the other box unchanged. Coordinates are world units with y up, so
+ * yMin() is the bottom edge.
+ */
+class LayerBounds
+{
+public:
+    /**
+     * @brief Construct an empty box
+     */
+    constexpr LayerBounds()
+        : m_xMin(0.0f), m_yMin(0.0f), m_xMax(0.0f), m_yMax(0.0f), m_valid(false) {}
+
+    /**
+     * @brief Construct a box from its extremes
+     * @param xMin Left edge
+     * @param yMin Bottom edge
+     * @param xMax Right edge
+     * @param yMax Top edge
+     */
+    constexpr LayerBounds(float xMin, float yMin, float xMax, float yMax)
+        : m_xMin(xMin), m_yMin(yMin), m_xMax(xMax), m_yMax(yMax), m_valid(true) {}
+
+    /**
+     * @brief Check if the box contains anything
+     * @return true unless empty
+     */
+    constexpr bool isValid() const { return m_valid; }
+
+    constexpr float xMin() const { return m_xMin; }
+    constexpr float yMin() const { return m_yMin; }
+    constexpr float xMax() const { return m_xMax; }
+    constexpr float yMax() const { return m_yMax; }
+    constexpr float width() const { return m_xMax - m_xMin; }
+    constexpr float height() const { return m_yMax - m_yMin; }
+
+    /**
+     * @brief Get center
+     * @return Center point
+     */
+    QPointF center() const { return QPointF((qreal(m_xMin) + m_xMax) / 2.0, (qreal(m_yMin) + m_yMax) / 2.0); }
+
+    /**
+     * @brief Convert to a rectangle
+     * @return Rectangle with positive size, or a null rectangle if empty
+     */
+    QRectF toRect() const
+    {
+        return m_valid ? QRectF(QPointF(m_xMin, m_yMin), QPointF(m_xMax, m_yMax)) : QRectF();
+    }
+
+    /**
+     * @brief Grow the box to include another box
+     * @param other Other box
+     */
+    void unite(const LayerBounds& other)
+    {
+        if (!other.m_valid) {
+            return;
+        }
+        if (!m_valid) {
+            *this = other;
+            return;
+        }
+        m_xMin = qMin(m_xMin, other.m_xMin);
+        m_yMin = qMin(m_yMin, other.m_yMin);
+        m_xMax = qMax(m_xMax, other.m_xMax);
+        m_yMax = qMax(m_yMax, other.m_yMax);
+    }
+
+    /**
+     * @brief Grow the box to include a point
+     * @param x X coordinate
+     * @param y Y coordinate
+     */
+    void include(float x, float y)
+    {
+        unite(LayerBounds(x, y, x, y));
+    }
+
+    /**
+     * @brief Get union with another box
+     * @param other Other box
+     * @return Box covering both
+     */
+    LayerBounds united(const LayerBounds& other) const
+    {
+        LayerBounds result = *this;
+        result.unite(other);
+        return result;
+    }
+
+    /**
+     * @brief Check overlap with a rectangle
+     *
+     * Degenerate boxes (a single point or a line) still overlap the
+     * rectangle they lie in.
+     *
+     * @param rect Rectangle in world coordinates
+     * @param margin Distance added on every side of the box
+     * @return true if the grown box and the rectangle overlap
+     */
+    bool intersects(const QRectF& rect, qreal margin = 0.0) const
+    {
+        const QRectF r = rect.normalized();
+        return m_valid
+            && m_xMin - margin <= r.right() && m_xMax + margin >= r.left()
+            && m_yMin - margin <= r.bottom() && m_yMax + margin >= r.top();
+    }
+
+    bool operator==(const LayerBounds& other) const
+    {
+        return m_valid == other.m_valid
+            && (!m_valid || (m_xMin == other.m_xMin && m_yMin == other.m_yMin
+                             && m_xMax == other.m_xMax && m_yMax == other.m_yMax));
+    }
+
+    bool operator!=(const LayerBounds& other) const { return !(*this == other); }
+
+private:
+    float m_xMin;
+    float m_yMin;
+    float m_xMax;
+    float m_yMax;
+    bool m_valid;
+};
+
+Q_DECLARE_TYPEINFO(LayerBounds, Q_PRIMITIVE_TYPE);
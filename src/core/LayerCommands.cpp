@@ -0,0 +1,562 @@
+#include "LayerCommands.h"
+#include "LayerManager.h"
+
+#include <QDebug>
+#include <QObject>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+/**
+ * @brief Copy a contiguous buffer into a view of the same shape
+ */
+void copyInto(const DataBuffer& source, DataBuffer target)
+{
+    if (target.isContiguous()) {
+        std::memcpy(target.data(), source.constData(), size_t(source.byteSize()));
+        return;
+    }
+
+    // Write innermost rows one at a time, walking the outer indices
+    const int dims = target.ndim();
+    const int elementSize = target.elementSize();
+    const qint64 rowLength = target.shape(dims - 1);
+    const qint64 rowBytes = rowLength * elementSize;
+    const bool innerContiguous = target.strides()[dims - 1] == elementSize;
+    QVector<qint64> index(dims, 0);
+    const uchar* in = source.constData();
+    uchar* base = target.data();
+
+    const qint64 rows = target.elementCount() / qMax<qint64>(1, rowLength);
+    for (qint64 row = 0; row < rows; ++row) {
+        uchar* out = base + target.byteOffset(index);
+        if (innerContiguous) {
+            std::memcpy(out, in, size_t(rowBytes));
+        } else {
+            for (qint64 i = 0; i < rowLength; ++i) {
+                std::memcpy(out + i * target.strides()[dims - 1], in + i * elementSize, size_t(elementSize));
+            }
+        }
+        in += rowBytes;
+
+        for (int axis = dims - 2; axis >= 0; --axis) {
+            if (++index[axis] < target.shape(axis)) {
+                break;
+            }
+            index[axis] = 0;
+        }
+    }
+}
+
+qint64 residentBytes(const DataBuffer& buffer)
+{
+    return buffer.isNull() ? 0 : buffer.byteSize();
+}
+
+/**
+ * @brief Check if a layer still shows a buffer
+ */
+bool showsBuffer(const Layer* layer, const DataBuffer& buffer)
+{
+    return layer && layer->buffer().isSameView(buffer);
+}
+
+} // namespace
+
+// AddLayersCommand implementation
+AddLayersCommand::AddLayersCommand(LayerManager* manager, const QList<Layer*>& layers, int index,
+                                   QUndoCommand* parent)
+    : HistoryCommand(layers.size() == 1 ? QObject::tr("Add Layer") : QObject::tr("Add Layers"), parent)
+    , m_manager(manager)
+    , m_layers(layers)
+    , m_index(index)
+    , m_owned(true)
+{
+}
+
+AddLayersCommand::~AddLayersCommand()
+{
+    if (m_owned) {
+        qDeleteAll(m_layers);
+    }
+}
+
+void AddLayersCommand::undo()
+{
+    if (!m_manager) {
+        return;
+    }
+    m_manager->removeLayers(m_layers);
+    for (Layer* layer : qAsConst(m_layers)) {
+        layer->setParent(nullptr);
+    }
+    m_owned = true;
+}
+
+void AddLayersCommand::redo()
+{
+    if (!m_manager || m_layers.isEmpty()) {
+        return;
+    }
+    m_manager->addLayers(m_layers, m_index);
+    // Remember where an append landed so redo after undo uses the same row
+    m_index = m_manager->indexOf(m_layers.first());
+    m_owned = false;
+}
+
+// RemoveLayersCommand implementation
+RemoveLayersCommand::RemoveLayersCommand(LayerManager* manager, const QList<Layer*>& layers,
+                                         QUndoCommand* parent)
+    : HistoryCommand(layers.size() == 1 ? QObject::tr("Remove Layer") : QObject::tr("Remove Layers"), parent)
+    , m_manager(manager)
+    , m_owned(false)
+{
+    if (manager) {
+        for (Layer* layer : layers) {
+            const int row = manager->indexOf(layer);
+            if (row >= 0) {
+                m_rows.append(qMakePair(row, layer));
+            }
+        }
+        std::sort(m_rows.begin(), m_rows.end());
+        m_rows.erase(std::unique(m_rows.begin(), m_rows.end()), m_rows.end());
+    }
+}
+
+RemoveLayersCommand::~RemoveLayersCommand()
+{
+    if (m_owned) {
+        for (const auto& row : qAsConst(m_rows)) {
+            delete row.second;
+        }
+    }
+}
+
+void RemoveLayersCommand::undo()
+{
+    if (!m_manager) {
+        return;
+    }
+
+    // Reinsert in ascending row order, one insertion per contiguous run
+    int begin = 0;
+    while (begin < m_rows.size()) {
+        int end = begin + 1;
+        while (end < m_rows.size() && m_rows[end].first == m_rows[end - 1].first + 1) {
+            ++end;
+        }
+        QList<Layer*> run;
+        for (int i = begin; i < end; ++i) {
+            run.append(m_rows[i].second);
+        }
+        m_manager->addLayers(run, m_rows[begin].first);
+        begin = end;
+    }
+    m_owned = false;
+}
+
+void RemoveLayersCommand::redo()
+{
+    if (!m_manager) {
+        return;
+    }
+
+    QList<Layer*> layers;
+    for (const auto& row : qAsConst(m_rows)) {
+        layers.append(row.second);
+    }
+    m_manager->removeLayers(layers);
+    for (Layer* layer : qAsConst(layers)) {
+        layer->setParent(nullptr);
+    }
+    m_owned = true;
+}
+
+// MoveLayersCommand implementation
+MoveLayersCommand::MoveLayersCommand(LayerManager* manager, const QList<Layer*>& layers, int step,
+                                     QUndoCommand* parent)
+    : HistoryCommand(layers.size() == 1 ? QObject::tr("Move Layer") : QObject::tr("Move Layers"), parent)
+    , m_manager(manager)
+    , m_step(step < 0 ? -1 : 1)
+{
+    for (Layer* layer : layers) {
+        m_layers.append(layer);
+    }
+}
+
+void MoveLayersCommand::undo()
+{
+    if (!m_manager) {
+        return;
+    }
+    for (int i = m_moves.size() - 1; i >= 0; --i) {
+        m_manager->moveLayer(m_moves[i].second, m_moves[i].first);
+    }
+}
+
+void MoveLayersCommand::redo()
+{
+    if (!m_manager) {
+        return;
+    }
+
+    m_moves.clear();
+    for (const QPointer<Layer>& layer : qAsConst(m_layers)) {
+        const int index = m_manager->indexOf(layer);
+        if (index < 0) {
+            continue;
+        }
+        const int target = index + m_step;
+        if (m_manager->moveLayer(index, target)) {
+            m_moves.append(qMakePair(index, target));
+        }
+    }
+}
+
+// SetLayerPropertyCommand implementation
+SetLayerPropertyCommand::SetLayerPropertyCommand(LayerManager* manager, Property property,
+                                                 const QList<Layer*>& layers, const QVariantList& values,
+                                                 QUndoCommand* parent)
+    : HistoryCommand(QString(), parent)
+    , m_manager(manager)
+    , m_property(property)
+    , m_newValues(values)
+{
+    switch (property) {
+    case Visible:
+        setText(QObject::tr("Change Visibility"));
+        break;
+    case Opacity:
+        setText(QObject::tr("Change Opacity"));
+        break;
+    case Name:
+        setText(QObject::tr("Rename Layer"));
+        break;
+    }
+
+    for (Layer* layer : layers) {
+        m_layers.append(layer);
+        switch (property) {
+        case Visible:
+            m_oldValues.append(layer->isVisible());
+            break;
+        case Opacity:
+            m_oldValues.append(layer->opacity());
+            break;
+        case Name:
+            m_oldValues.append(layer->name());
+            break;
+        }
+    }
+}
+
+void SetLayerPropertyCommand::undo()
+{
+    apply(m_oldValues);
+}
+
+void SetLayerPropertyCommand::redo()
+{
+    apply(m_newValues);
+}
+
+int SetLayerPropertyCommand::id() const
+{
+    // Only continuous edits merge
+    return m_property == Opacity ? 0x4c4f5043 : -1;
+}
+
+bool SetLayerPropertyCommand::mergeWith(const QUndoCommand* other)
+{
+    const auto* command = static_cast<const SetLayerPropertyCommand*>(other);
+    if (command->m_property != m_property || command->m_layers != m_layers) {
+        return false;
+    }
+    m_newValues = command->m_newValues;
+    return true;
+}
+
+void SetLayerPropertyCommand::apply(const QVariantList& values)
+{
+    LayerManager::UpdateBatch batch(m_manager);
+
+    for (int i = 0; i < m_layers.size() && i < values.size(); ++i) {
+        Layer* layer = m_layers[i];
+        if (!layer) {
+            continue;
+        }
+        switch (m_property) {
+        case Visible:
+            layer->setVisible(values[i].toBool());
+            break;
+        case Opacity:
+            layer->setOpacity(values[i].toFloat());
+            break;
+        case Name:
+            layer->setName(values[i].toString());
+            break;
+        }
+    }
+}
+
+// SetLayerBufferCommand implementation
+SetLayerBufferCommand::SetLayerBufferCommand(Layer* layer, const DataBuffer& buffer, QUndoCommand* parent)
+    : HistoryCommand(QObject::tr("Replace Layer Data"), parent)
+    , m_layer(layer)
+    , m_spillFile(nullptr)
+    , m_applied(false)
+{
+    const DataBuffer old = layer ? layer->buffer() : DataBuffer();
+    m_old = Slot{old, old.dtype(), old.shape(), HistorySpillFile::Record()};
+    m_new = Slot{buffer, buffer.dtype(), buffer.shape(), HistorySpillFile::Record()};
+}
+
+SetLayerBufferCommand::~SetLayerBufferCommand()
+{
+    if (m_spillFile) {
+        m_spillFile->release(m_old.record);
+        m_spillFile->release(m_new.record);
+    }
+}
+
+void SetLayerBufferCommand::undo()
+{
+    apply(m_old);
+    m_applied = false;
+}
+
+void SetLayerBufferCommand::redo()
+{
+    apply(m_new);
+    m_applied = true;
+}
+
+qint64 SetLayerBufferCommand::memoryCost() const
+{
+    // The buffer on display is held by the layer anyway
+    return residentBytes(m_applied ? m_old.buffer : m_new.buffer);
+}
+
+bool SetLayerBufferCommand::spill(HistorySpillFile* file)
+{
+    Slot& slot = m_applied ? m_old : m_new;
+    if (slot.buffer.isNull() || showsBuffer(m_layer, slot.buffer)) {
+        return false;
+    }
+    if (!slot.record.isValid()) {
+        slot.record = file->write(slot.buffer);
+        if (!slot.record.isValid()) {
+            return false;
+        }
+    }
+    slot.buffer = DataBuffer();
+    m_spillFile = file;
+    return true;
+}
+
+void SetLayerBufferCommand::apply(Slot& slot)
+{
+    if (!m_layer) {
+        return;
+    }
+    if (slot.buffer.isNull() && slot.record.isValid() && m_spillFile) {
+        slot.buffer = m_spillFile->read(slot.record, slot.type, slot.shape);
+    }
+    if (slot.buffer.isNull()) {
+        if (slot.record.isValid()) {
+            qWarning() << "CommandHistory: cannot restore data of layer" << m_layer->name();
+        }
+        return;
+    }
+    m_layer->setBuffer(slot.buffer);
+}
+
+// BufferDeltaCommand implementation
+BufferDeltaCommand::BufferDeltaCommand(Layer* layer, const DataBuffer& buffer, const QVector<Tile>& tiles,
+                                       const QString& text, QUndoCommand* parent)
+    : HistoryCommand(text, parent)
+    , m_layer(layer)
+    , m_buffer(buffer)
+    , m_tiles(tiles)
+    , m_spillFile(nullptr)
+    , m_firstRedo(true)
+{
+}
+
+BufferDeltaCommand::~BufferDeltaCommand()
+{
+    if (m_spillFile) {
+        for (Tile& tile : m_tiles) {
+            m_spillFile->release(tile.beforeRecord);
+            m_spillFile->release(tile.afterRecord);
+        }
+    }
+}
+
+void BufferDeltaCommand::undo()
+{
+    apply(false);
+}
+
+void BufferDeltaCommand::redo()
+{
+    // The edit is already in the buffer when the command is pushed
+    if (m_firstRedo) {
+        m_firstRedo = false;
+        return;
+    }
+    apply(true);
+}
+
+qint64 BufferDeltaCommand::memoryCost() const
+{
+    qint64 cost = 0;
+    for (const Tile& tile : m_tiles) {
+        cost += residentBytes(tile.before) + residentBytes(tile.after);
+    }
+    return cost;
+}
+
+bool BufferDeltaCommand::spill(HistorySpillFile* file)
+{
+    bool released = false;
+    for (Tile& tile : m_tiles) {
+        if (!tile.before.isNull()) {
+            if (!tile.beforeRecord.isValid()) {
+                tile.beforeRecord = file->write(tile.before);
+            }
+            if (tile.beforeRecord.isValid()) {
+                tile.before = DataBuffer();
+                released = true;
+            }
+        }
+        if (!tile.after.isNull()) {
+            if (!tile.afterRecord.isValid()) {
+                tile.afterRecord = file->write(tile.after);
+            }
+            if (tile.afterRecord.isValid()) {
+                tile.after = DataBuffer();
+                released = true;
+            }
+        }
+    }
+    if (released) {
+        m_spillFile = file;
+    }
+    return released;
+}
+
+void BufferDeltaCommand::apply(bool after)
+{
+    if (!m_layer) {
+        return;
+    }
+    if (!showsBuffer(m_layer, m_buffer) || !m_buffer.isWritable()) {
+        qWarning() << "CommandHistory: data of layer" << m_layer->name() << "was replaced, edit not restored";
+        return;
+    }
+
+    for (Tile& tile : m_tiles) {
+        DataBuffer& data = after ? tile.after : tile.before;
+        const HistorySpillFile::Record& record = after ? tile.afterRecord : tile.beforeRecord;
+        if (data.isNull() && m_spillFile) {
+            data = m_spillFile->read(record, m_buffer.dtype(), tile.extent);
+        }
+        if (data.isNull()) {
+            qWarning() << "CommandHistory: cannot restore data of layer" << m_layer->name();
+            continue;
+        }
+        copyInto(data, m_buffer.region(tile.start, tile.extent));
+    }
+
+    m_buffer.markModified();
+    m_layer->setBuffer(m_buffer);
+}
+
+// BufferEdit implementation
+BufferEdit::BufferEdit(Layer* layer, const QString& text)
+    : m_layer(layer)
+    , m_buffer(layer ? layer->buffer() : DataBuffer())
+    , m_text(text.isEmpty() ? QObject::tr("Edit Layer Data") : text)
+{
+}
+
+void BufferEdit::touch(const QVector<qint64>& start, const QVector<qint64>& extent)
+{
+    const int dims = m_buffer.ndim();
+    if (!isValid() || start.size() != dims || extent.size() != dims) {
+        return;
+    }
+
+    // Range of tiles covered by the region, clamped to the buffer
+    QVector<qint64> firstTile(dims), lastTile(dims), tileCounts(dims);
+    for (int axis = 0; axis < dims; ++axis) {
+        const qint64 size = m_buffer.shape(axis);
+        const qint64 begin = qBound<qint64>(0, start[axis], size);
+        const qint64 end = qBound<qint64>(0, start[axis] + extent[axis], size);
+        if (begin >= end) {
+            return;
+        }
+        firstTile[axis] = begin / kTileExtent;
+        lastTile[axis] = (end - 1) / kTileExtent;
+        tileCounts[axis] = (size + kTileExtent - 1) / kTileExtent;
+    }
+
+    QVector<qint64> tile = firstTile;
+    for (;;) {
+        qint64 key = 0;
+        for (int axis = 0; axis < dims; ++axis) {
+            key = key * tileCounts[axis] + tile[axis];
+        }
+
+        if (!m_tiles.contains(key)) {
+            BufferDeltaCommand::Tile stored;
+            stored.start.resize(dims);
+            stored.extent.resize(dims);
+            for (int axis = 0; axis < dims; ++axis) {
+                stored.start[axis] = tile[axis] * kTileExtent;
+                stored.extent[axis] = qMin(kTileExtent, m_buffer.shape(axis) - stored.start[axis]);
+            }
+            stored.before = m_buffer.region(stored.start, stored.extent).copy();
+            m_tiles.insert(key, stored);
+        }
+
+        int axis = dims - 1;
+        for (; axis >= 0; --axis) {
+            if (++tile[axis] <= lastTile[axis]) {
+                break;
+            }
+            tile[axis] = firstTile[axis];
+        }
+        if (axis < 0) {
+            break;
+        }
+    }
+}
+
+BufferDeltaCommand* BufferEdit::finish()
+{
+    if (!isValid() || !m_layer || m_tiles.isEmpty()) {
+        return nullptr;
+    }
+
+    QVector<BufferDeltaCommand::Tile> changed;
+    changed.reserve(m_tiles.size());
+    for (auto it = m_tiles.begin(); it != m_tiles.end(); ++it) {
+        BufferDeltaCommand::Tile& tile = it.value();
+        tile.after = m_buffer.region(tile.start, tile.extent).copy();
+        if (std::memcmp(tile.before.constData(), tile.after.constData(), size_t(tile.before.byteSize())) != 0) {
+            changed.append(tile);
+        }
+    }
+    m_tiles.clear();
+
+    if (changed.isEmpty()) {
+        return nullptr;
+    }
+
+    m_buffer.markModified();
+    m_layer->setBuffer(m_buffer);
+    return new BufferDeltaCommand(m_layer, m_buffer, changed, m_text);
+}
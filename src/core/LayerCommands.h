@@ -0,0 +1,312 @@
+#pragma once
+
+#include "CommandHistory.h"
+#include "DataBuffer.h"
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QPointer>
+#include <QVariant>
+#include <QVector>
+
+class Layer;
+class LayerManager;
+
+/**
+ * @brief Add layers to the stack
+ *
+ * Undo takes the layers out of the manager; while undone the command
+ * owns them and deletes them with itself.
+ */
+class AddLayersCommand : public HistoryCommand
+{
+public:
+    /**
+     * @brief Constructor
+     * @param manager Layer manager
+     * @param layers Layers to add; ownership passes to the manager on redo
+     * @param index Insert position (-1 appends)
+     * @param parent Parent command
+     */
+    AddLayersCommand(LayerManager* manager, const QList<Layer*>& layers, int index = -1,
+                     QUndoCommand* parent = nullptr);
+    ~AddLayersCommand() override;
+
+    void undo() override;
+    void redo() override;
+
+private:
+    QPointer<LayerManager> m_manager;
+    QList<Layer*> m_layers;
+    int m_index;
+    bool m_owned;
+};
+
+/**
+ * @brief Remove layers from the stack
+ *
+ * The removed layers are kept, not copied, so undo puts the same objects
+ * back at their rows. While removed the command owns them.
+ */
+class RemoveLayersCommand : public HistoryCommand
+{
+public:
+    /**
+     * @brief Constructor
+     * @param manager Layer manager
+     * @param layers Layers to remove; unknown layers are ignored
+     * @param parent Parent command
+     */
+    RemoveLayersCommand(LayerManager* manager, const QList<Layer*>& layers, QUndoCommand* parent = nullptr);
+    ~RemoveLayersCommand() override;
+
+    void undo() override;
+    void redo() override;
+
+private:
+    QPointer<LayerManager> m_manager;
+    QVector<QPair<int, Layer*>> m_rows;     // Sorted by row
+    bool m_owned;
+};
+
+/**
+ * @brief Move layers one row up or down
+ *
+ * Redo moves each layer like the layer panel does and records the moves
+ * actually made; undo reverts them in reverse order.
+ */
+class MoveLayersCommand : public HistoryCommand
+{
+public:
+    /**
+     * @brief Constructor
+     * @param manager Layer manager
+     * @param layers Layers to move, in the order they are moved
+     * @param step -1 to move towards row 0, +1 to move away from it
+     * @param parent Parent command
+     */
+    MoveLayersCommand(LayerManager* manager, const QList<Layer*>& layers, int step,
+                      QUndoCommand* parent = nullptr);
+
+    void undo() override;
+    void redo() override;
+
+private:
+    QPointer<LayerManager> m_manager;
+    QList<QPointer<Layer>> m_layers;
+    int m_step;
+    QVector<QPair<int, int>> m_moves;
+};
+
+/**
+ * @brief Change a property of one or more layers
+ *
+ * Consecutive changes of the same property on the same layers merge
+ * into one command, so dragging an opacity slider is undone in one step.
+ */
+class SetLayerPropertyCommand : public HistoryCommand
+{
+public:
+    /**
+     * @brief Layer property
+     */
+    enum Property {
+        Visible,
+        Opacity,
+        Name
+    };
+
+    /**
+     * @brief Constructor
+     * @param manager Layer manager, batches notifications (may be nullptr)
+     * @param property Property
+     * @param layers Layers
+     * @param values New value per layer
+     * @param parent Parent command
+     */
+    SetLayerPropertyCommand(LayerManager* manager, Property property, const QList<Layer*>& layers,
+                            const QVariantList& values, QUndoCommand* parent = nullptr);
+
+    void undo() override;
+    void redo() override;
+    int id() const override;
+    bool mergeWith(const QUndoCommand* other) override;
+
+private:
+    /**
+     * @brief Apply values to the layers
+     * @param values Value per layer
+     */
+    void apply(const QVariantList& values);
+
+private:
+    QPointer<LayerManager> m_manager;
+    Property m_property;
+    QList<QPointer<Layer>> m_layers;
+    QVariantList m_oldValues;
+    QVariantList m_newValues;
+};
+
+/**
+ * @brief Replace the data buffer of a layer
+ *
+ * Keeps handles to the old and the new buffer. The one the layer is not
+ * currently showing can be spilled to disk.
+ */
+class SetLayerBufferCommand : public HistoryCommand
+{
+public:
+    /**
+     * @brief Constructor
+     * @param layer Layer
+     * @param buffer New buffer
+     * @param parent Parent command
+     */
+    SetLayerBufferCommand(Layer* layer, const DataBuffer& buffer, QUndoCommand* parent = nullptr);
+
+    /**
+     * @brief Destructor; releases spilled records
+     */
+    ~SetLayerBufferCommand() override;
+
+    void undo() override;
+    void redo() override;
+    qint64 memoryCost() const override;
+    bool spill(HistorySpillFile* file) override;
+
+private:
+    /**
+     * @brief Buffer that may be released
+     */
+    struct Slot
+    {
+        DataBuffer buffer;
+        DataType type;
+        QVector<qint64> shape;
+        HistorySpillFile::Record record;
+    };
+
+    /**
+     * @brief Show a slot's buffer, reading it back if it was spilled
+     * @param slot Slot
+     */
+    void apply(Slot& slot);
+
+private:
+    QPointer<Layer> m_layer;
+    Slot m_old;
+    Slot m_new;
+    HistorySpillFile* m_spillFile;
+    bool m_applied;
+};
+
+/**
+ * @brief Tiles of a buffer before and after an in-place edit
+ *
+ * Created by BufferEdit. Only the tiles the edit touched are stored, and
+ * only those that actually changed.
+ */
+class BufferDeltaCommand : public HistoryCommand
+{
+public:
+    /**
+     * @brief Stored tile
+     */
+    struct Tile
+    {
+        QVector<qint64> start;
+        QVector<qint64> extent;
+        DataBuffer before;
+        DataBuffer after;
+        HistorySpillFile::Record beforeRecord;
+        HistorySpillFile::Record afterRecord;
+    };
+
+    /**
+     * @brief Constructor
+     * @param layer Edited layer
+     * @param buffer Edited buffer, already holding the result
+     * @param tiles Changed tiles
+     * @param text Command text
+     * @param parent Parent command
+     */
+    BufferDeltaCommand(Layer* layer, const DataBuffer& buffer, const QVector<Tile>& tiles,
+                       const QString& text, QUndoCommand* parent = nullptr);
+
+    /**
+     * @brief Destructor; releases spilled records
+     */
+    ~BufferDeltaCommand() override;
+
+    void undo() override;
+    void redo() override;
+    qint64 memoryCost() const override;
+    bool spill(HistorySpillFile* file) override;
+
+private:
+    /**
+     * @brief Write the stored tiles into the layer's buffer
+     * @param after true to write the edited tiles, false for the originals
+     */
+    void apply(bool after);
+
+private:
+    QPointer<Layer> m_layer;
+    DataBuffer m_buffer;
+    QVector<Tile> m_tiles;
+    HistorySpillFile* m_spillFile;
+    bool m_firstRedo;
+};
+
+/**
+ * @brief Record an in-place edit of a layer buffer as tile deltas
+ *
+ * Call touch() for every region before writing to it through buffer();
+ * the first touch of a tile copies it. finish() copies the touched tiles
+ * again, drops the unchanged ones, notifies the layer and returns the
+ * command to push. Tiles are kTileExtent elements along every axis.
+ */
+class BufferEdit
+{
+public:
+    // Tile size along every axis
+    static constexpr qint64 kTileExtent = 64;
+
+    /**
+     * @brief Constructor
+     * @param layer Layer whose buffer is edited
+     * @param text Command text
+     */
+    explicit BufferEdit(Layer* layer, const QString& text = QString());
+
+    /**
+     * @brief Check if the layer has a writable buffer
+     * @return true if editable
+     */
+    bool isValid() const { return !m_buffer.isNull() && m_buffer.isWritable(); }
+
+    /**
+     * @brief Get the buffer to write to
+     * @return Layer buffer
+     */
+    DataBuffer& buffer() { return m_buffer; }
+
+    /**
+     * @brief Declare a region about to be written
+     * @param start First element per dimension
+     * @param extent Elements per dimension
+     */
+    void touch(const QVector<qint64>& start, const QVector<qint64>& extent);
+
+    /**
+     * @brief Finish the edit
+     * @return Command with the changed tiles, nullptr if nothing changed
+     */
+    BufferDeltaCommand* finish();
+
+private:
+    QPointer<Layer> m_layer;
+    DataBuffer m_buffer;
+    QString m_text;
+    QHash<qint64, BufferDeltaCommand::Tile> m_tiles;   // Keyed by linear tile index
+};
@@ -1,5 +1,8 @@
 #include "LayerManager.h"
+#include "Dims.h"
 #include <QDebug>
+#include <algorithm>
+#include <utility>
 
 // Layer implementation
 Layer::Layer(const QString& name, LayerType type, QObject* parent)
@@ -9,9 +12,16 @@ Layer::Layer(const QString& name, LayerType type, QObject* parent)
     , m_visible(true)
     , m_opacity(1.0f)
     , m_selected(false)
+    , m_dataVersion(0)
 {
 }
 
+void Layer::markDataChanged()
+{
+    ++m_dataVersion;
+    emit changed();
+}
+
 void Layer::setName(const QString& name)
 {
     if (m_name != name) {
@@ -52,7 +62,13 @@ void Layer::setSelected(bool selected)
 // LayerManager implementation
 LayerManager::LayerManager(QObject* parent)
     : QAbstractItemModel(parent)
+    , m_sceneBoundsValid(false)
+    , m_updateDepth(0)
+    , m_selectionChangePending(false)
+    , m_dimsChangePending(false)
+    , m_dims(new Dims(this))
 {
+    connect(m_dims, &Dims::pointChanged, this, &LayerManager::onSlicePointChanged);
 }
 
 LayerManager::~LayerManager()
@@ -171,7 +187,25 @@ bool LayerManager::setData(const QModelIndex& index, const QVariant& value, int
 
 void LayerManager::addLayer(Layer* layer, int index)
 {
-    if (!layer) {
+    addLayers(QList<Layer*>() << layer, index);
+}
+
+void LayerManager::addLayers(const QList<Layer*>& layers, int index)
+{
+    QList<Layer*> added;
+    added.reserve(layers.size());
+    for (Layer* layer : layers) {
+        if (!layer) {
+            continue;
+        }
+        if (m_index.contains(layer) || added.contains(layer)) {
+            qWarning() << "LayerManager: layer" << layer->name() << "is already managed";
+            continue;
+        }
+        added.append(layer);
+    }
+
+    if (added.isEmpty()) {
         return;
     }
 
@@ -179,43 +213,99 @@ void LayerManager::addLayer(Layer* layer, int index)
         index = m_layers.size();
     }
 
-    beginInsertRows(QModelIndex(), index, index);
+    beginInsertRows(QModelIndex(), index, index + added.size() - 1);
+
+    for (int i = 0; i < added.size(); ++i) {
+        Layer* layer = added[i];
 
-    // Connect layer signals
-    connect(layer, &Layer::changed, this, &LayerManager::onLayerChanged);
-    connect(layer, &Layer::selectionChanged, this, &LayerManager::onLayerSelectionChanged);
+        // Connect layer signals
+        connect(layer, &Layer::changed, this, &LayerManager::onLayerChanged, Qt::UniqueConnection);
+        connect(layer, &Layer::selectionChanged, this, &LayerManager::onLayerSelectionChanged, Qt::UniqueConnection);
+        connect(layer, &Layer::nameChanged, this, &LayerManager::onLayerNameChanged, Qt::UniqueConnection);
 
-    // Set parent to manage memory
-    layer->setParent(this);
+        // Set parent to manage memory
+        layer->setParent(this);
+
+        m_layers.insert(index + i, layer);
+        m_index.insert(layer, IndexEntry{index + i, layer->name(), layer->sliceShape()});
+        m_nameIndex.insert(layer->name(), layer);
+        invalidateBounds(layer);
+    }
+    updateRows(index + added.size());
 
-    m_layers.insert(index, layer);
     endInsertRows();
 
-    emit layerAdded(m_layers[index], index);
+    invalidateDims();
+    for (Layer* layer : qAsConst(added)) {
+        applySlicePoint(layer);
+    }
+
+    for (int i = 0; i < added.size(); ++i) {
+        emit layerAdded(added[i], index + i);
+    }
 }
 
 bool LayerManager::removeLayer(int index)
 {
-    if (index < 0 || index >= m_layers.size()) {
+    return removeLayers(index, 1);
+}
+
+bool LayerManager::removeLayers(int first, int count)
+{
+    if (first < 0 || count <= 0 || first + count > m_layers.size()) {
         return false;
     }
-    
-    beginRemoveRows(QModelIndex(), index, index);
-    m_layers.removeAt(index);
+
+    beginRemoveRows(QModelIndex(), first, first + count - 1);
+    for (int i = first; i < first + count; ++i) {
+        unindexLayer(m_layers[i]);
+        m_layerBounds.remove(m_layers[i]);
+    }
+    m_layers.erase(m_layers.begin() + first, m_layers.begin() + first + count);
+    m_sceneBoundsValid = false;
+    updateRows(first);
     endRemoveRows();
-    
-    emit layerRemoved(index);
+
+    invalidateDims();
+
+    // Report from the back so every index is valid at the time it is emitted
+    for (int i = first + count - 1; i >= first; --i) {
+        emit layerRemoved(i);
+    }
     return true;
 }
 
-bool LayerManager::removeLayer(const QString& name)
+int LayerManager::removeLayers(const QList<Layer*>& layers)
 {
-    for (int i = 0; i < m_layers.size(); ++i) {
-        if (m_layers[i]->name() == name) {
-            return removeLayer(i);
+    QVector<int> rows;
+    rows.reserve(layers.size());
+    for (Layer* layer : layers) {
+        const int row = indexOf(layer);
+        if (row >= 0) {
+            rows.append(row);
         }
     }
-    return false;
+
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    // Remove runs back to front so earlier rows stay valid
+    int end = rows.size();
+    while (end > 0) {
+        int begin = end - 1;
+        while (begin > 0 && rows[begin - 1] == rows[begin] - 1) {
+            --begin;
+        }
+        removeLayers(rows[begin], end - begin);
+        end = begin;
+    }
+
+    return rows.size();
+}
+
+bool LayerManager::removeLayer(const QString& name)
+{
+    return removeLayer(indexOf(layer(name)));
 }
 
 Layer* LayerManager::layer(int index) const
@@ -228,17 +318,17 @@ Layer* LayerManager::layer(int index) const
 
 Layer* LayerManager::layer(const QString& name) const
 {
-    for (Layer* layer : m_layers) {
-        if (layer->name() == name) {
-            return layer;
+    // Names are not unique; like a list scan, return the lowest row
+    Layer* result = nullptr;
+    int resultRow = -1;
+    for (auto it = m_nameIndex.constFind(name); it != m_nameIndex.constEnd() && it.key() == name; ++it) {
+        const int row = indexOf(it.value());
+        if (resultRow < 0 || row < resultRow) {
+            result = it.value();
+            resultRow = row;
         }
     }
-    return nullptr;
-}
-
-QList<Layer*> LayerManager::layers() const
-{
-    return m_layers;
+    return result;
 }
 
 QList<Layer*> LayerManager::selectedLayers() const
@@ -252,13 +342,25 @@ QList<Layer*> LayerManager::selectedLayers() const
     return result;
 }
 
+int LayerManager::selectedLayerCount() const
+{
+    int count = 0;
+    forEachSelectedLayer([&count](Layer*) { ++count; });
+    return count;
+}
+
 void LayerManager::clear()
 {
     if (!m_layers.isEmpty()) {
         beginRemoveRows(QModelIndex(), 0, m_layers.size() - 1);
         m_layers.clear();
+        m_index.clear();
+        m_nameIndex.clear();
+        m_layerBounds.clear();
+        m_sceneBoundsValid = false;
         endRemoveRows();
     }
+    invalidateDims();
 }
 
 bool LayerManager::moveLayer(int from, int to)
@@ -269,15 +371,165 @@ bool LayerManager::moveLayer(int from, int to)
     
     beginMoveRows(QModelIndex(), from, from, QModelIndex(), to > from ? to + 1 : to);
     m_layers.move(from, to);
+    for (int i = qMin(from, to); i <= qMax(from, to); ++i) {
+        m_index[m_layers[i]].row = i;
+    }
     endMoveRows();
     
     emit layersReordered();
     return true;
 }
 
-int LayerManager::indexOf(Layer* layer) const
+int LayerManager::indexOf(const Layer* layer) const
+{
+    auto it = m_index.constFind(layer);
+    return it != m_index.constEnd() ? it->row : -1;
+}
+
+LayerBounds LayerManager::layerBounds(Layer* layer) const
+{
+    if (!layer) {
+        return LayerBounds();
+    }
+
+    auto it = m_layerBounds.constFind(layer);
+    if (it != m_layerBounds.constEnd()) {
+        return *it;
+    }
+
+    if (!m_index.contains(layer)) {
+        return LayerBounds();
+    }
+
+    const LayerBounds bounds = layer->bounds();
+    m_layerBounds.insert(layer, bounds);
+    return bounds;
+}
+
+LayerBounds LayerManager::sceneBounds() const
+{
+    if (m_sceneBoundsValid) {
+        return m_sceneBounds;
+    }
+
+    m_sceneBounds = LayerBounds();
+    for (Layer* layer : m_layers) {
+        if (layer->isVisible()) {
+            m_sceneBounds.unite(layerBounds(layer));
+        }
+    }
+    m_sceneBoundsValid = true;
+    return m_sceneBounds;
+}
+
+void LayerManager::beginUpdate()
+{
+    ++m_updateDepth;
+}
+
+void LayerManager::endUpdate()
+{
+    if (m_updateDepth <= 0) {
+        qWarning() << "LayerManager: endUpdate() without beginUpdate()";
+        return;
+    }
+
+    if (--m_updateDepth > 0) {
+        return;
+    }
+
+    // Layers removed during the batch have no row any more
+    int firstRow = -1;
+    int lastRow = -1;
+    for (const Layer* layer : qAsConst(m_pendingChanges)) {
+        const int row = indexOf(layer);
+        if (row < 0) {
+            continue;
+        }
+        firstRow = firstRow < 0 ? row : qMin(firstRow, row);
+        lastRow = qMax(lastRow, row);
+    }
+    m_pendingChanges.clear();
+
+    if (m_dimsChangePending) {
+        m_dimsChangePending = false;
+        updateDims();
+    }
+
+    if (firstRow >= 0) {
+        emit dataChanged(createIndex(firstRow, 0), createIndex(lastRow, columnCount() - 1));
+    }
+
+    if (m_selectionChangePending) {
+        m_selectionChangePending = false;
+        emit selectionChanged();
+    }
+}
+
+void LayerManager::updateRows(int first)
+{
+    for (int i = first; i < m_layers.size(); ++i) {
+        m_index[m_layers[i]].row = i;
+    }
+}
+
+void LayerManager::unindexLayer(const Layer* layer)
 {
-    return m_layers.indexOf(layer);
+    auto it = m_index.find(layer);
+    if (it == m_index.end()) {
+        return;
+    }
+    m_nameIndex.remove(it->name, const_cast<Layer*>(layer));
+    m_index.erase(it);
+}
+
+void LayerManager::invalidateBounds(const Layer* layer)
+{
+    m_layerBounds.remove(layer);
+    m_sceneBoundsValid = false;
+}
+
+void LayerManager::invalidateDims()
+{
+    if (m_updateDepth > 0) {
+        m_dimsChangePending = true;
+        return;
+    }
+    updateDims();
+}
+
+void LayerManager::updateDims()
+{
+    // Right-aligned union: a layer's last slider follows the scene's last
+    QVector<qint64> range;
+    for (const IndexEntry& entry : qAsConst(m_index)) {
+        const QVector<qint64>& shape = entry.sliceShape;
+        if (shape.size() > range.size()) {
+            range.insert(0, shape.size() - range.size(), 1);
+        }
+        const int offset = range.size() - shape.size();
+        for (int i = 0; i < shape.size(); ++i) {
+            range[offset + i] = qMax(range[offset + i], shape[i]);
+        }
+    }
+    m_dims->setRange(range);
+}
+
+void LayerManager::applySlicePoint(Layer* layer)
+{
+    const int dimensions = m_index.value(layer).sliceShape.size();
+    if (dimensions > 0) {
+        layer->setSlicePoint(m_dims->alignedPoint(dimensions));
+    }
+}
+
+void LayerManager::onSlicePointChanged()
+{
+    // One dataChanged() for all layers moving to the new plane
+    UpdateBatch batch(this);
+    for (Layer* layer : qAsConst(m_layers)) {
+        applySlicePoint(layer);
+    }
 }
 
 void LayerManager::onLayerChanged()
@@ -286,6 +538,19 @@ void LayerManager::onLayerChanged()
     if (layer) {
         int index = indexOf(layer);
         if (index >= 0) {
+            invalidateBounds(layer);
+
+            // Most changes leave the slider dimensions alone
+            QVector<qint64> shape = layer->sliceShape();
+            IndexEntry& entry = m_index[layer];
+            if (shape != entry.sliceShape) {
+                entry.sliceShape = std::move(shape);
+                invalidateDims();
+            }
+            if (m_updateDepth > 0) {
+                m_pendingChanges.insert(layer);
+                return;
+            }
             QModelIndex topLeft = createIndex(index, 0);
             QModelIndex bottomRight = createIndex(index, columnCount() - 1);
             emit dataChanged(topLeft, bottomRight);
@@ -296,5 +561,22 @@ void LayerManager::onLayerChanged()
 void LayerManager::onLayerSelectionChanged(bool selected)
 {
     Q_UNUSED(selected)
+    if (m_updateDepth > 0) {
+        m_selectionChangePending = true;
+        return;
+    }
     emit selectionChanged();
 }
+
+void LayerManager::onLayerNameChanged(const QString& name)
+{
+    Layer* layer = qobject_cast<Layer*>(sender());
+    auto it = m_index.find(layer);
+    if (it == m_index.end()) {
+        return;
+    }
+
+    m_nameIndex.remove(it->name, layer);
+    m_nameIndex.insert(name, layer);
+    it->name = name;
+}
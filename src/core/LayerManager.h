@@ -1,11 +1,18 @@
 #pragma once
 
+#include "DataBuffer.h"
+#include "LayerBounds.h"
 #include <QObject>
 #include <QAbstractItemModel>
+#include <QHash>
+#include <QSet>
 #include <QVariant>
 #include <QModelIndex>
+#include <QPointF>
+#include <QRectF>
 #include <memory>
 
+class Dims;
 class Layer;
 
 /**
@@ -110,11 +117,85 @@ public:
      */
     virtual void setData(const QVariant& data) = 0;
 
+    /**
+     * @brief Get layer data as a typed buffer
+     *
+     * The returned buffer shares memory with the layer; no elements are
+     * copied. Layers without array data return a null buffer.
+     *
+     * @return Data buffer
+     */
+    virtual DataBuffer buffer() const { return DataBuffer(); }
+
+    /**
+     * @brief Set layer data from a typed buffer
+     *
+     * Layers keep a reference to the buffer's storage instead of copying
+     * it where the element type and layout allow.
+     *
+     * @param buffer Data buffer
+     * @return true if the buffer was accepted
+     */
+    virtual bool setBuffer(const DataBuffer& buffer) { Q_UNUSED(buffer) return false; }
+
+    /**
+     * @brief Get data version
+     *
+     * Incremented every time the layer data changes, so consumers can
+     * detect changes without comparing contents.
+     *
+     * @return Data version
+     */
+    quint64 dataVersion() const { return m_dataVersion; }
+
     /**
      * @brief Get layer bounds
-     * @return Bounding box as [xmin, ymin, xmax, ymax]
+     *
+     * Called through LayerManager::layerBounds(), which caches the result
+     * until the layer emits changed().
+     *
+     * @return Bounding box, empty if the layer has no extent
+     */
+    virtual LayerBounds bounds() const = 0;
+
+    /**
+     * @brief Find the element under a world position
+     *
+     * Layers with many elements answer this from a spatial index; the
+     * default has no pickable elements.
+     *
+     * @param worldPos Position in world coordinates
+     * @param tolerance Search radius in world units
+     * @return Element index, or -1 if nothing is hit
+     */
+    virtual int pick(const QPointF& worldPos, float tolerance) const
+    {
+        Q_UNUSED(worldPos) Q_UNUSED(tolerance) return -1;
+    }
+
+    /**
+     * @brief Find the elements inside a world rectangle
+     * @param rect Rectangle in world coordinates
+     * @return Element indices
      */
-    virtual QVector<float> bounds() const = 0;
+    virtual QVector<int> elementsIn(const QRectF& rect) const { Q_UNUSED(rect) return QVector<int>(); }
+
+    /**
+     * @brief Get the extent of the dimensions that are not displayed
+     *
+     * Layers with time points, stacked planes or slices report one step
+     * count per slider dimension; the view shows the plane selected by
+     * setSlicePoint(). The default has no slider dimensions.
+     *
+     * @return Step count per slider dimension, outermost first
+     */
+    virtual QVector<qint64> sliceShape() const { return QVector<qint64>(); }
+
+    /**
+     * @brief Select the displayed plane
+     * @param point Index per slider dimension, as many as sliceShape()
+     */
+    virtual void setSlicePoint(const QVector<qint64>& point) { Q_UNUSED(point) }
 
     /**
      * @brief Render the layer
@@ -122,6 +203,25 @@ public:
      */
     virtual void render(void* context) = 0;
 
+    /**
+     * @brief Check if the last render() lacked data that is still loading
+     *
+     * Layers streaming their data in the background draw what they have
+     * and update later. Batch rendering renders again until no layer is
+     * loading, so exported images are complete.
+     *
+     * @return true while data is pending
+     */
+    virtual bool isLoading() const { return false; }
+
+    /**
+     * @brief Release GPU resources owned by the layer
+     *
+     * Called by the viewer with its OpenGL context current, before the
+     * context is destroyed or the layer is removed from the scene.
+     */
+    virtual void releaseGraphicsResources() {}
+
 signals:
     /**
      * @brief Emitted when layer properties change
@@ -152,24 +252,67 @@ signals:
      */
     void selectionChanged(bool selected);
 
+protected:
+    /**
+     * @brief Bump the data version and emit changed()
+     */
+    void markDataChanged();
+
 protected:
     QString m_name;
     LayerType m_type;
     bool m_visible;
     float m_opacity;
     bool m_selected;
+    quint64 m_dataVersion;
 };
 
 /**
  * @brief Layer manager class
  * 
  * Manages a collection of layers and provides a model interface for UI components.
+ *
+ * Changes made between beginUpdate() and endUpdate() are reported once:
+ * a single dataChanged() covering every changed row and at most one
+ * selectionChanged(), emitted when the outermost batch ends. The slider
+ * range of dims() is recomputed then as well, and only if a layer's
+ * slice shape changed.
  */
 class LayerManager : public QAbstractItemModel
 {
     Q_OBJECT
 
 public:
+    /**
+     * @brief Scoped update batch
+     *
+     * Calls beginUpdate() on construction and endUpdate() on destruction,
+     * so notifications are flushed on every exit path.
+     */
+    class UpdateBatch
+    {
+    public:
+        explicit UpdateBatch(LayerManager* manager) : m_manager(manager)
+        {
+            if (m_manager) {
+                m_manager->beginUpdate();
+            }
+        }
+
+        ~UpdateBatch()
+        {
+            if (m_manager) {
+                m_manager->endUpdate();
+            }
+        }
+
+        UpdateBatch(const UpdateBatch&) = delete;
+        UpdateBatch& operator=(const UpdateBatch&) = delete;
+
+    private:
+        LayerManager* m_manager;
+    };
+
     /**
      * @brief Constructor
      * @param parent Parent object
@@ -198,6 +341,17 @@ public:
      */
     void addLayer(Layer* layer, int index = -1);
 
+    /**
+     * @brief Add several layers as one contiguous block
+     *
+     * The model announces the whole block with a single row insertion.
+     * Null layers and layers already in the manager are skipped.
+     *
+     * @param layers Layers to add, in order
+     * @param index Insert position of the first layer (-1 for end)
+     */
+    void addLayers(const QList<Layer*>& layers, int index = -1);
+
     /**
      * @brief Remove a layer
      * @param index Layer index
@@ -205,6 +359,25 @@ public:
      */
     bool removeLayer(int index);
 
+    /**
+     * @brief Remove a contiguous range of layers with one row removal
+     * @param first Index of the first layer
+     * @param count Number of layers
+     * @return true if successful
+     */
+    bool removeLayers(int first, int count);
+
+    /**
+     * @brief Remove several layers
+     *
+     * Layers are grouped into contiguous runs, and each run is removed
+     * with a single row removal.
+     *
+     * @param layers Layers to remove; unknown layers are ignored
+     * @return Number of layers removed
+     */
+    int removeLayers(const QList<Layer*>& layers);
+
     /**
      * @brief Remove a layer by name
      * @param name Layer name
@@ -234,16 +407,56 @@ public:
 
     /**
      * @brief Get all layers
-     * @return List of layer pointers
+     *
+     * The reference is invalidated when layers are added or removed; copy
+     * the list before changing the stack while iterating.
+     *
+     * @return List of layer pointers, bottom first
+     */
+    const QList<Layer*>& layers() const { return m_layers; }
+
+    /**
+     * @brief Iterate over the layers, bottom first
+     * @return Iterator to the first layer
      */
-    QList<Layer*> layers() const;
+    QList<Layer*>::const_iterator begin() const { return m_layers.cbegin(); }
+
+    /**
+     * @brief End of the layer iteration
+     * @return Iterator past the last layer
+     */
+    QList<Layer*>::const_iterator end() const { return m_layers.cend(); }
 
     /**
      * @brief Get selected layers
+     *
+     * Builds a new list; code running per frame or per event should use
+     * forEachSelectedLayer() instead.
+     *
      * @return List of selected layer pointers
      */
     QList<Layer*> selectedLayers() const;
 
+    /**
+     * @brief Call a function for each selected layer without building a list
+     * @param function Callable taking a Layer*
+     */
+    template<typename Function>
+    void forEachSelectedLayer(Function function) const
+    {
+        for (Layer* layer : m_layers) {
+            if (layer->isSelected()) {
+                function(layer);
+            }
+        }
+    }
+
+    /**
+     * @brief Get number of selected layers
+     * @return Selected layer count
+     */
+    int selectedLayerCount() const;
+
     /**
      * @brief Clear all layers
      */
@@ -262,7 +475,59 @@ public:
      * @param layer Layer pointer
      * @return Layer index or -1 if not found
      */
-    int indexOf(Layer* layer) const;
+    int indexOf(const Layer* layer) const;
+
+    /**
+     * @brief Get cached bounds of a layer
+     *
+     * The cached value is dropped whenever the layer emits changed(), so
+     * Layer::bounds() runs at most once per change.
+     *
+     * @param layer Layer pointer
+     * @return Layer bounds, empty for unknown layers
+     */
+    LayerBounds layerBounds(Layer* layer) const;
+
+    /**
+     * @brief Get union of the bounds of all visible layers
+     *
+     * Recomputed from the per-layer cache only after a layer changed or
+     * the layer list was modified.
+     *
+     * @return Scene bounds, empty if no visible layer has an extent
+     */
+    LayerBounds sceneBounds() const;
+
+    /**
+     * @brief Start deferring layer change notifications
+     *
+     * Batches nest; notifications are emitted when the outermost batch
+     * ends. Row insertions, removals and moves are still reported
+     * immediately.
+     */
+    void beginUpdate();
+
+    /**
+     * @brief End a batch started with beginUpdate()
+     */
+    void endUpdate();
+
+    /**
+     * @brief Check if a batch is open
+     * @return true between beginUpdate() and the matching endUpdate()
+     */
+    bool isUpdating() const { return m_updateDepth > 0; }
+
+    /**
+     * @brief Get the slicing state shared by all layers
+     *
+     * The range spans the slider dimensions of every layer, aligned to
+     * the last dimension; moving the point selects the displayed plane
+     * of each layer.
+     *
+     * @return Dims object owned by the manager
+     */
+    Dims* dims() const { return m_dims; }
 
 signals:
     /**
@@ -300,6 +565,79 @@ private slots:
      */
     void onLayerSelectionChanged(bool selected);
 
+    /**
+     * @brief Keep the name index in sync with a renamed layer
+     * @param name New name
+     */
+    void onLayerNameChanged(const QString& name);
+
+    /**
+     * @brief Show the plane at the current point in every layer
+     */
+    void onSlicePointChanged();
+
+private:
+    /**
+     * @brief Refresh stored rows from a position to the end of the list
+     * @param first First row whose layer may have moved
+     */
+    void updateRows(int first);
+
+    /**
+     * @brief Drop a layer from the lookup indexes
+     * @param layer Layer pointer
+     */
+    void unindexLayer(const Layer* layer);
+
+    /**
+     * @brief Drop cached bounds of a layer and the scene
+     * @param layer Layer pointer
+     */
+    void invalidateBounds(const Layer* layer);
+
+    /**
+     * @brief Recompute the slider range now, or at the end of the open batch
+     */
+    void invalidateDims();
+
+    /**
+     * @brief Recompute the slider range from the cached slice shapes
+     */
+    void updateDims();
+
+    /**
+     * @brief Show the plane at the current point in one layer
+     * @param layer Layer pointer
+     */
+    void applySlicePoint(Layer* layer);
+
 private:
     QList<Layer*> m_layers;
+
+    /**
+     * @brief Lookup entry of a managed layer
+     */
+    struct IndexEntry
+    {
+        int row;
+        QString name;   ///< Name the layer is filed under in m_nameIndex
+        QVector<qint64> sliceShape;  ///< Slice shape as of the last changed()
+    };
+
+    // Lookup indexes, kept in sync with m_layers
+    QHash<const Layer*, IndexEntry> m_index;
+    QMultiHash<QString, Layer*> m_nameIndex;
+
+    // Bounds cache, filled on demand
+    mutable QHash<const Layer*, LayerBounds> m_layerBounds;
+    mutable LayerBounds m_sceneBounds;
+    mutable bool m_sceneBoundsValid;
+
+    // Notifications deferred by an open batch
+    int m_updateDepth;
+    QSet<const Layer*> m_pendingChanges;
+    bool m_selectionChangePending;
+    bool m_dimsChangePending;
+
+    Dims* m_dims;
 };
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+#include <functional>
+
+/**
+ * @brief Progress and cancellation state shared with a running load
+ *
+ * Loaders poll isCancelled() between units of work and report progress
+ * through setProgress(). Both may be called from any thread.
+ */
+class LoadRequest
+{
+public:
+    /**
+     * @brief Progress callback, invoked on the loading thread
+     */
+    using ProgressCallback = std::function<void(int percent)>;
+
+    /**
+     * @brief Constructor
+     * @param fileName File being loaded
+     */
+    explicit LoadRequest(const QString& fileName = QString())
+        : m_fileName(fileName)
+        , m_cancelled(false)
+        , m_progress(-1)
+    {
+    }
+
+    /**
+     * @brief Get file name
+     * @return File being loaded
+     */
+    QString fileName() const { return m_fileName; }
+
+    /**
+     * @brief Request cancellation
+     */
+    void cancel() { m_cancelled.store(true, std::memory_order_release); }
+
+    /**
+     * @brief Check if cancellation was requested
+     * @return true if the load should stop
+     */
+    bool isCancelled() const { return m_cancelled.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Get last reported progress
+     * @return Percentage (0 - 100), or -1 before the first report
+     */
+    int progress() const { return m_progress.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Report progress
+     *
+     * The callback only runs when the percentage actually changes, so
+     * loaders may call this as often as convenient.
+     *
+     * @param percent Percentage (0 - 100)
+     */
+    void setProgress(int percent)
+    {
+        percent = qBound(0, percent, 100);
+        if (m_progress.exchange(percent, std::memory_order_relaxed) != percent && m_progressCallback) {
+            m_progressCallback(percent);
+        }
+    }
+
+    /**
+     * @brief Set progress callback
+     *
+     * Must be set before the load starts.
+     *
+     * @param callback Callback
+     */
+    void setProgressCallback(ProgressCallback callback) { m_progressCallback = std::move(callback); }
+
+private:
+    QString m_fileName;
+    std::atomic<bool> m_cancelled;
+    std::atomic<int> m_progress;
+    ProgressCallback m_progressCallback;
+};
@@ -3,6 +3,12 @@
 #include "../ui/LayerWidget.h"
 #include "../ui/ToolBar.h"
 #include "Application.h"
+#include "LayerManager.h"
+#include "FileLoadService.h"
+#include "ProcessingService.h"
+#include "SessionFile.h"
+#include "CommandHistory.h"
+#include "../utils/Profiler.h"
 
 #include <QApplication>
 #include <QMenuBar>
@@ -12,17 +18,27 @@
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QLabel>
+#include <QProgressBar>
 #include <QAction>
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QCloseEvent>
 #include <QSettings>
+#include <QFileInfo>
 #include <QDebug>
+#include <QUndoStack>
 
 MainWindow::MainWindow(QWidget* parent)
     : QMainWindow(parent)
     , m_layerDock(nullptr)
+    , m_cancelLoadAction(nullptr)
+    , m_undoAction(nullptr)
+    , m_redoAction(nullptr)
+    , m_toggleProfilerAction(nullptr)
+    , m_recordTraceAction(nullptr)
+    , m_loadProgressBar(nullptr)
     , m_isModified(false)
+    , m_session(std::make_unique<SessionFile>())
 {
     setWindowTitle("T-GUI Framework");
     setMinimumSize(800, 600);
@@ -63,39 +79,134 @@ void MainWindow::showAbout()
 
 void MainWindow::openFile()
 {
-    QString fileName = QFileDialog::getOpenFileName(this,
-        "Open File", QString(),
-        "All Files (*.*);;Images (*.png *.jpg *.jpeg *.bmp *.tiff)");
+    const QStringList fileNames = QFileDialog::getOpenFileNames(this,
+        "Open Files", QString(),
+        "All Files (*.*);;Sessions (*.tgs);;Images (*.png *.jpg *.jpeg *.bmp *.tiff);;Arrays (*.tif *.tiff *.npy *.raw)");
     
-    if (!fileName.isEmpty()) {
-        // TODO: Implement file loading through layer manager
-        m_currentFile = fileName;
-        updateStatusMessage(QString("Opened: %1").arg(fileName));
-        
-        // Update window title
-        setWindowTitle(QString("T-GUI Framework - %1").arg(QFileInfo(fileName).fileName()));
+    for (const QString& fileName : fileNames) {
+        if (SessionFile::isSessionFile(fileName)) {
+            openSession(fileName);
+        } else {
+            loadFile(fileName);
+        }
+    }
+}
+
+bool MainWindow::openSession(const QString& fileName)
+{
+    LayerManager* layerManager = Application::instance() ? Application::instance()->layerManager() : nullptr;
+    if (!layerManager) {
+        return false;
+    }
+
+    QList<Layer*> layers;
+    SessionViewState view;
+    QString errorMessage;
+    if (!m_session->load(fileName, &layers, &view, &errorMessage)) {
+        QMessageBox::warning(this, "Open Session", errorMessage);
+        return false;
+    }
+
+    // Commands refer to the layers about to be replaced
+    if (CommandHistory* history = Application::instance()->commandHistory()) {
+        history->clear();
+    }
+
+    // Replace the current stack with one row removal and one insertion
+    const QList<Layer*> previous = layerManager->layers();
+    layerManager->clear();
+    for (Layer* layer : previous) {
+        layer->deleteLater();
+    }
+    layerManager->addLayers(layers);
+
+    if (m_viewerWidget) {
+        m_viewerWidget->setViewMode(ViewerWidget::ViewMode(view.viewMode));
+        m_viewerWidget->setZoomLevel(view.zoomLevel);
+        m_viewerWidget->setViewCenter(view.viewCenter);
+        m_viewerWidget->setRotation(view.rotation);
+    }
+
+    m_currentFile = fileName;
+    m_sessionFile = fileName;
+    m_isModified = false;
+    updateStatusMessage(QString("Opened session: %1 (%2 layers)")
+                            .arg(QFileInfo(fileName).fileName()).arg(layers.size()));
+    return true;
+}
+
+int MainWindow::loadFile(const QString& fileName)
+{
+    FileLoadService* service = Application::instance() ? Application::instance()->fileLoadService() : nullptr;
+    if (!service) {
+        return 0;
+    }
+
+    const int requestId = service->load(fileName);
+    m_loadProgress.insert(requestId, 0);
+    updateLoadProgress();
+    updateStatusMessage(QString("Loading: %1").arg(QFileInfo(fileName).fileName()));
+    return requestId;
+}
+
+void MainWindow::cancelFileLoads()
+{
+    if (Application::instance() && Application::instance()->fileLoadService()) {
+        Application::instance()->fileLoadService()->cancelAll();
     }
 }
 
 void MainWindow::save()
 {
-    if (m_currentFile.isEmpty()) {
+    // A data file opened directly is not a session and must not be replaced
+    if (m_sessionFile.isEmpty()) {
         saveAs();
-    } else {
-        // TODO: Implement saving
-        updateStatusMessage(QString("Saved: %1").arg(m_currentFile));
-        m_isModified = false;
+        return;
+    }
+
+    LayerManager* layerManager = Application::instance() ? Application::instance()->layerManager() : nullptr;
+    if (!layerManager) {
+        return;
+    }
+
+    SessionViewState view;
+    if (m_viewerWidget) {
+        view.viewMode = int(m_viewerWidget->viewMode());
+        view.zoomLevel = m_viewerWidget->zoomLevel();
+        view.viewCenter = m_viewerWidget->viewCenter();
+        view.rotation = m_viewerWidget->rotation();
+    }
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QString errorMessage;
+    const bool saved = m_session->save(m_sessionFile, layerManager, view, &errorMessage);
+    QApplication::restoreOverrideCursor();
+
+    if (!saved) {
+        QMessageBox::warning(this, "Save Session", errorMessage);
+        return;
     }
+
+    const SessionFile::SaveStats& stats = m_session->lastSaveStats();
+    updateStatusMessage(QString("Saved: %1 (%2 MB written, %3 layers unchanged)")
+                            .arg(m_sessionFile)
+                            .arg(double(stats.bytesWritten) / (1024.0 * 1024.0), 0, 'f', 1)
+                            .arg(stats.chunksReused));
+    m_isModified = false;
 }
 
 void MainWindow::saveAs()
 {
     QString fileName = QFileDialog::getSaveFileName(this,
-        "Save File", QString(),
-        "All Files (*.*)");
+        "Save Session", QString(),
+        "Sessions (*.tgs);;All Files (*.*)");
     
     if (!fileName.isEmpty()) {
+        if (QFileInfo(fileName).suffix().isEmpty()) {
+            fileName += QString(".") + SessionFile::kFileSuffix;
+        }
         m_currentFile = fileName;
+        m_sessionFile = fileName;
         save();
     }
 }
@@ -117,6 +228,40 @@ void MainWindow::showPluginManager()
     QMessageBox::information(this, "Plugin Manager", "Plugin manager dialog not yet implemented.");
 }
 
+void MainWindow::recordPerformanceTrace(bool record)
+{
+    Profiler* profiler = Profiler::instance();
+    if (!profiler) {
+        return;
+    }
+
+    if (record) {
+        profiler->startCapture();
+        updateStatusMessage("Recording performance trace...");
+        return;
+    }
+
+    profiler->stopCapture();
+    if (!m_toggleProfilerAction->isChecked()) {
+        profiler->setEnabled(false);
+    }
+
+    const QString fileName = QFileDialog::getSaveFileName(this,
+        "Save Performance Trace", "trace.json",
+        "Chrome Trace (*.json);;All Files (*.*)");
+    if (fileName.isEmpty()) {
+        updateStatusMessage("Performance trace discarded");
+        return;
+    }
+
+    if (profiler->exportChromeTrace(fileName)) {
+        updateStatusMessage(QString("Saved %1 trace events to %2")
+            .arg(profiler->capturedEventCount()).arg(QFileInfo(fileName).fileName()));
+    } else {
+        QMessageBox::warning(this, "Performance Trace", QString("Could not write %1").arg(fileName));
+    }
+}
+
 void MainWindow::toggleLayerPanel()
 {
     if (m_layerDock) {
@@ -179,6 +324,69 @@ void MainWindow::onViewerStateChanged()
     updateStatusMessage("Viewer state changed");
 }
 
+void MainWindow::onFileLoadProgress(int requestId, const QString& fileName, int percent)
+{
+    Q_UNUSED(fileName)
+    if (m_loadProgress.contains(requestId)) {
+        m_loadProgress[requestId] = percent;
+        updateLoadProgress();
+    }
+}
+
+void MainWindow::onFileLoadFinished(int requestId, const QString& fileName, Layer* layer)
+{
+    Q_UNUSED(layer)
+    m_loadProgress.remove(requestId);
+    updateLoadProgress();
+
+    m_currentFile = fileName;
+    updateStatusMessage(QString("Opened: %1").arg(fileName));
+    
+    // Update window title
+    setWindowTitle(QString("T-GUI Framework - %1").arg(QFileInfo(fileName).fileName()));
+}
+
+void MainWindow::onFileLoadFailed(int requestId, const QString& fileName, const QString& errorMessage)
+{
+    Q_UNUSED(fileName)
+    m_loadProgress.remove(requestId);
+    updateLoadProgress();
+
+    // Reported in the status bar; a dialog per file would block batch opens
+    updateStatusMessage(errorMessage);
+}
+
+void MainWindow::onFileLoadCancelled(int requestId, const QString& fileName)
+{
+    m_loadProgress.remove(requestId);
+    updateLoadProgress();
+    updateStatusMessage(QString("Cancelled: %1").arg(QFileInfo(fileName).fileName()));
+}
+
+void MainWindow::updateLoadProgress()
+{
+    if (m_cancelLoadAction) {
+        m_cancelLoadAction->setEnabled(!m_loadProgress.isEmpty());
+    }
+
+    if (!m_loadProgressBar) {
+        return;
+    }
+
+    if (m_loadProgress.isEmpty()) {
+        m_loadProgressBar->hide();
+        return;
+    }
+
+    int total = 0;
+    for (int percent : qAsConst(m_loadProgress)) {
+        total += percent;
+    }
+    m_loadProgressBar->setFormat(QString("Loading %1 file(s) %p%").arg(m_loadProgress.size()));
+    m_loadProgressBar->setValue(total / m_loadProgress.size());
+    m_loadProgressBar->show();
+}
+
 void MainWindow::setupUI()
 {
     qDebug() << "Setting up UI...";
@@ -186,17 +394,19 @@ void MainWindow::setupUI()
     createMenuBar();
     qDebug() << "Menu bar created";
 
-    // createToolBar();
-    qDebug() << "Toolbar creation skipped";
-
     createStatusBar();
     qDebug() << "Status bar created";
 
     setupCentralWidget();
     qDebug() << "Central widget setup";
 
-    // createDockWidgets();
-    qDebug() << "Dock widgets creation skipped";
+    // The toolbar drives the viewer and the dims sliders, so it comes last
+    createToolBar();
+    qDebug() << "Toolbar created";
+
+    // The layer panel pushes its edits onto the command history
+    createDockWidgets();
+    qDebug() << "Dock widgets created";
 
     qDebug() << "UI setup completed";
 }
@@ -208,9 +418,14 @@ void MainWindow::createMenuBar()
     
     m_openAction = new QAction("&Open...", this);
     m_openAction->setShortcut(QKeySequence::Open);
-    m_openAction->setStatusTip("Open a file");
+    m_openAction->setStatusTip("Open one or more files");
     fileMenu->addAction(m_openAction);
     
+    m_cancelLoadAction = new QAction("&Cancel Loading", this);
+    m_cancelLoadAction->setStatusTip("Cancel all files that are still loading");
+    m_cancelLoadAction->setEnabled(false);
+    fileMenu->addAction(m_cancelLoadAction);
+    
     fileMenu->addSeparator();
     
     m_saveAction = new QAction("&Save", this);
@@ -230,6 +445,27 @@ void MainWindow::createMenuBar()
     m_exitAction->setStatusTip("Exit the application");
     fileMenu->addAction(m_exitAction);
     
+    // Edit menu; the actions follow the history's undo and redo text
+    QMenu* editMenu = menuBar()->addMenu("&Edit");
+    
+    CommandHistory* history = Application::instance() ? Application::instance()->commandHistory() : nullptr;
+    if (history) {
+        m_undoAction = history->undoStack()->createUndoAction(this, "&Undo");
+        m_redoAction = history->undoStack()->createRedoAction(this, "&Redo");
+    } else {
+        m_undoAction = new QAction("&Undo", this);
+        m_redoAction = new QAction("&Redo", this);
+        m_undoAction->setEnabled(false);
+        m_redoAction->setEnabled(false);
+    }
+    m_undoAction->setShortcut(QKeySequence::Undo);
+    m_undoAction->setStatusTip("Undo the last change");
+    editMenu->addAction(m_undoAction);
+    
+    m_redoAction->setShortcut(QKeySequence::Redo);
+    m_redoAction->setStatusTip("Redo the last undone change");
+    editMenu->addAction(m_redoAction);
+    
     // View menu
     QMenu* viewMenu = menuBar()->addMenu("&View");
     
@@ -242,6 +478,12 @@ void MainWindow::createMenuBar()
     m_toggleToolBarAction->setCheckable(true);
     m_toggleToolBarAction->setChecked(true);
     viewMenu->addAction(m_toggleToolBarAction);
+
+    m_toggleProfilerAction = new QAction("&Frame Profiler", this);
+    m_toggleProfilerAction->setCheckable(true);
+    m_toggleProfilerAction->setShortcut(Qt::Key_F3);
+    m_toggleProfilerAction->setStatusTip("Show frame times and per-layer render costs");
+    viewMenu->addAction(m_toggleProfilerAction);
     
     // Tools menu
     QMenu* toolsMenu = menuBar()->addMenu("&Tools");
@@ -253,6 +495,13 @@ void MainWindow::createMenuBar()
     m_pluginManagerAction = new QAction("&Plugin Manager...", this);
     m_pluginManagerAction->setStatusTip("Open plugin manager");
     toolsMenu->addAction(m_pluginManagerAction);
+
+    toolsMenu->addSeparator();
+
+    m_recordTraceAction = new QAction("&Record Performance Trace", this);
+    m_recordTraceAction->setCheckable(true);
+    m_recordTraceAction->setStatusTip("Record timed scopes and save them as a Chrome trace");
+    toolsMenu->addAction(m_recordTraceAction);
     
     // Help menu
     QMenu* helpMenu = menuBar()->addMenu("&Help");
@@ -266,6 +515,10 @@ void MainWindow::createToolBar()
 {
     m_toolBar = std::make_unique<ToolBar>(this);
     addToolBar(m_toolBar.get());
+    m_toolBar->setViewerWidget(m_viewerWidget.get());
+    if (Application::instance() && Application::instance()->layerManager()) {
+        m_toolBar->setDims(Application::instance()->layerManager()->dims());
+    }
 }
 
 void MainWindow::createStatusBar()
@@ -278,16 +531,23 @@ void MainWindow::createStatusBar()
     
     m_zoomLabel = new QLabel("100%");
     statusBar()->addPermanentWidget(m_zoomLabel);
+    
+    m_loadProgressBar = new QProgressBar;
+    m_loadProgressBar->setRange(0, 100);
+    m_loadProgressBar->setMaximumWidth(240);
+    m_loadProgressBar->hide();
+    statusBar()->addPermanentWidget(m_loadProgressBar);
 }
 
 void MainWindow::setupCentralWidget()
 {
     qDebug() << "Creating central widget...";
 
-    // Create a simple widget instead of ViewerWidget for now
-    QWidget* centralWidget = new QWidget(this);
-    centralWidget->setStyleSheet("background-color: #404040;");
-    setCentralWidget(centralWidget);
+    m_viewerWidget = std::make_unique<ViewerWidget>(this);
+    if (Application::instance()) {
+        m_viewerWidget->setLayerManager(Application::instance()->layerManager());
+    }
+    setCentralWidget(m_viewerWidget.get());
 
     qDebug() << "Central widget created successfully";
 }
@@ -296,7 +556,12 @@ void MainWindow::createDockWidgets()
 {
     // Layer panel dock
     m_layerDock = new QDockWidget("Layers", this);
+    m_layerDock->setObjectName("layerDock");
     m_layerWidget = std::make_unique<LayerWidget>(this);
+    if (Application::instance()) {
+        m_layerWidget->setLayerManager(Application::instance()->layerManager());
+        m_layerWidget->setCommandHistory(Application::instance()->commandHistory());
+    }
     m_layerDock->setWidget(m_layerWidget.get());
     m_layerDock->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
     addDockWidget(Qt::RightDockWidgetArea, m_layerDock);
@@ -306,6 +571,7 @@ void MainWindow::connectSignals()
 {
     // Menu actions
     connect(m_openAction, &QAction::triggered, this, &MainWindow::openFile);
+    connect(m_cancelLoadAction, &QAction::triggered, this, &MainWindow::cancelFileLoads);
     connect(m_saveAction, &QAction::triggered, this, &MainWindow::save);
     connect(m_saveAsAction, &QAction::triggered, this, &MainWindow::saveAs);
     connect(m_exitAction, &QAction::triggered, this, &MainWindow::exit);
@@ -314,6 +580,29 @@ void MainWindow::connectSignals()
     connect(m_pluginManagerAction, &QAction::triggered, this, &MainWindow::showPluginManager);
     connect(m_toggleLayerPanelAction, &QAction::triggered, this, &MainWindow::toggleLayerPanel);
     connect(m_toggleToolBarAction, &QAction::triggered, this, &MainWindow::toggleToolBar);
+    connect(m_toggleProfilerAction, &QAction::toggled, m_viewerWidget.get(), &ViewerWidget::setProfilerOverlayVisible);
+    connect(m_viewerWidget.get(), &ViewerWidget::profilerOverlayVisibilityChanged,
+            m_toggleProfilerAction, &QAction::setChecked);
+    connect(m_recordTraceAction, &QAction::toggled, this, &MainWindow::recordPerformanceTrace);
+
+    if (FileLoadService* service = Application::instance() ? Application::instance()->fileLoadService() : nullptr) {
+        connect(service, &FileLoadService::loadProgress, this, &MainWindow::onFileLoadProgress);
+        connect(service, &FileLoadService::loadFinished, this, &MainWindow::onFileLoadFinished);
+        connect(service, &FileLoadService::loadFailed, this, &MainWindow::onFileLoadFailed);
+        connect(service, &FileLoadService::loadCancelled, this, &MainWindow::onFileLoadCancelled);
+    }
+
+    if (ProcessingService* service = Application::instance() ? Application::instance()->processingService() : nullptr) {
+        connect(service, &ProcessingService::jobFinished, this, [this](int, const QString& operation, Layer* layer) {
+            updateStatusMessage(QString("%1 finished: %2").arg(operation, layer ? layer->name() : QString()));
+        });
+        connect(service, &ProcessingService::jobFailed, this, [this](int, const QString&, const QString& errorMessage) {
+            updateStatusMessage(errorMessage);
+        });
+        connect(service, &ProcessingService::jobCancelled, this, [this](int, const QString& operation) {
+            updateStatusMessage(QString("Cancelled: %1").arg(operation));
+        });
+    }
 }
 
 void MainWindow::loadSettings()
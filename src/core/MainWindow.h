@@ -7,12 +7,16 @@
 #include <QMenuBar>
 #include <QStatusBar>
 #include <QDockWidget>
+#include <QHash>
 #include <memory>
 
 class ViewerWidget;
 class LayerWidget;
 class ToolBar;
 class QLabel;
+class QProgressBar;
+class Layer;
+class SessionFile;
 
 /**
  * @brief Main window class for the GUI framework
@@ -65,8 +69,30 @@ public slots:
      */
     void openFile();
 
+    /**
+     * @brief Load a file into a new layer in the background
+     * @param fileName File name
+     * @return Load request id, or 0 if loading is unavailable
+     */
+    int loadFile(const QString& fileName);
+
+    /**
+     * @brief Cancel all pending file loads
+     */
+    void cancelFileLoads();
+
+    /**
+     * @brief Replace the layer stack and view with a saved session
+     * @param fileName Session file
+     * @return true if successful
+     */
+    bool openSession(const QString& fileName);
+
     /**
      * @brief Save current work
+     *
+     * Saves the layer stack, view state and layer data as a session;
+     * saving again to the same file only writes what changed.
      */
     void save();
 
@@ -90,6 +116,15 @@ public slots:
      */
     void showPluginManager();
 
+    /**
+     * @brief Start or stop recording a performance trace
+     *
+     * Stopping asks for a file and saves the trace in Chrome trace format.
+     *
+     * @param record true to start recording
+     */
+    void recordPerformanceTrace(bool record);
+
     /**
      * @brief Toggle layer panel visibility
      */
@@ -130,6 +165,37 @@ private slots:
      */
     void onViewerStateChanged();
 
+    /**
+     * @brief Handle file load progress
+     * @param requestId Load request id
+     * @param fileName File name
+     * @param percent Percentage
+     */
+    void onFileLoadProgress(int requestId, const QString& fileName, int percent);
+
+    /**
+     * @brief Handle finished file load
+     * @param requestId Load request id
+     * @param fileName File name
+     * @param layer New layer
+     */
+    void onFileLoadFinished(int requestId, const QString& fileName, Layer* layer);
+
+    /**
+     * @brief Handle failed file load
+     * @param requestId Load request id
+     * @param fileName File name
+     * @param errorMessage Reason
+     */
+    void onFileLoadFailed(int requestId, const QString& fileName, const QString& errorMessage);
+
+    /**
+     * @brief Handle cancelled file load
+     * @param requestId Load request id
+     * @param fileName File name
+     */
+    void onFileLoadCancelled(int requestId, const QString& fileName);
+
 private:
     /**
      * @brief Setup the user interface
@@ -176,6 +242,11 @@ private:
      */
     void saveSettings();
 
+    /**
+     * @brief Update the load progress bar from pending loads
+     */
+    void updateLoadProgress();
+
 private:
     // Central widgets
     std::unique_ptr<ViewerWidget> m_viewerWidget;
@@ -193,18 +264,27 @@ private:
     QAction* m_saveAction;
     QAction* m_saveAsAction;
     QAction* m_exitAction;
+    QAction* m_undoAction;
+    QAction* m_redoAction;
     QAction* m_aboutAction;
     QAction* m_preferencesAction;
     QAction* m_pluginManagerAction;
     QAction* m_toggleLayerPanelAction;
     QAction* m_toggleToolBarAction;
+    QAction* m_cancelLoadAction;
+    QAction* m_toggleProfilerAction;
+    QAction* m_recordTraceAction;
 
     // Status bar
     QLabel* m_statusLabel;
     QLabel* m_coordinatesLabel;
     QLabel* m_zoomLabel;
+    QProgressBar* m_loadProgressBar;
 
     // State
     bool m_isModified;
     QString m_currentFile;
+    QString m_sessionFile;  ///< Session saved to by save(); never a source data file
+    QHash<int, int> m_loadProgress;
+    std::unique_ptr<SessionFile> m_session;
 };
@@ -0,0 +1,286 @@
+#include "OffscreenRenderer.h"
+#include "GpuResourcePool.h"
+#include "LayerManager.h"
+#include "RenderContext.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QThread>
+#include <QtMath>
+#include <cstring>
+
+namespace {
+
+// Largest tile rendered in one pass, even if the GPU allows more; keeps
+// the framebuffer and the readback buffer at a moderate size
+const int kMaxTileSize = 4096;
+
+// Margin around layer bounds before culling, in pixels (as in ViewerWidget)
+const qreal kCullMargin = 8.0;
+
+// Default time for streamed layer data to arrive, per tile
+const int kDefaultLoadTimeoutMs = 60000;
+
+} // namespace
+
+OffscreenRenderer::OffscreenRenderer()
+    : m_maxTileSize(kMaxTileSize, kMaxTileSize)
+    , m_gpuTileLimit(kMaxTileSize, kMaxTileSize)
+    , m_backgroundColor(Qt::black)
+    , m_loadTimeoutMs(kDefaultLoadTimeoutMs)
+{
+}
+
+OffscreenRenderer::~OffscreenRenderer()
+{
+    if (m_context && m_context->makeCurrent(m_surface.get())) {
+        m_framebuffer.reset();
+        m_context->doneCurrent();
+    }
+}
+
+bool OffscreenRenderer::initialize(QString* errorMessage)
+{
+    if (isInitialized()) {
+        return true;
+    }
+
+    const auto fail = [errorMessage](const QString& message) {
+        qWarning() << "OffscreenRenderer:" << message;
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+
+    auto surface = std::make_unique<QOffscreenSurface>();
+    surface->setFormat(QSurfaceFormat::defaultFormat());
+    surface->create();
+    if (!surface->isValid()) {
+        return fail("Cannot create an offscreen surface");
+    }
+
+    auto context = std::make_unique<QOpenGLContext>();
+    context->setFormat(surface->requestedFormat());
+    if (!context->create()) {
+        return fail("Cannot create an OpenGL context");
+    }
+    if (!context->makeCurrent(surface.get())) {
+        return fail("Cannot make the offscreen OpenGL context current");
+    }
+
+    // Tiles have to fit the texture, renderbuffer and viewport limits
+    QOpenGLFunctions* gl = context->functions();
+    GLint maxTexture = 0;
+    GLint maxRenderbuffer = 0;
+    GLint maxViewport[2] = {0, 0};
+    gl->glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTexture);
+    gl->glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbuffer);
+    gl->glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    const int limit = qMin(qMin(int(maxTexture), int(maxRenderbuffer)), kMaxTileSize);
+    m_gpuTileLimit = QSize(qMin(limit, int(maxViewport[0])), qMin(limit, int(maxViewport[1])));
+    if (m_gpuTileLimit.width() < 64 || m_gpuTileLimit.height() < 64) {
+        context->doneCurrent();
+        return fail("The OpenGL implementation reports no usable framebuffer size");
+    }
+    m_maxTileSize = m_maxTileSize.boundedTo(m_gpuTileLimit);
+
+    m_rendererName = QString::fromLatin1(reinterpret_cast<const char*>(gl->glGetString(GL_RENDERER)));
+
+    context->doneCurrent();
+    m_surface = std::move(surface);
+    m_context = std::move(context);
+    return true;
+}
+
+void OffscreenRenderer::setMaxTileSize(const QSize& size)
+{
+    m_maxTileSize = size.expandedTo(QSize(16, 16)).boundedTo(m_gpuTileLimit);
+}
+
+QImage OffscreenRenderer::render(LayerManager* layers, const QRectF& worldRect, const QSize& size,
+                                 QString* errorMessage)
+{
+    const auto fail = [errorMessage](const QString& message) {
+        qWarning() << "OffscreenRenderer:" << message;
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return QImage();
+    };
+
+    if (!layers || !isInitialized()) {
+        return fail("Renderer is not initialized");
+    }
+    if (size.isEmpty() || worldRect.isEmpty()) {
+        return fail("Nothing to render: empty image or world rectangle");
+    }
+
+    QImage image(size, QImage::Format_RGBA8888);
+    if (image.isNull()) {
+        return fail(QString("Cannot allocate a %1x%2 image").arg(size.width()).arg(size.height()));
+    }
+
+    if (!m_context->makeCurrent(m_surface.get())) {
+        return fail("Cannot make the offscreen OpenGL context current");
+    }
+
+    const QSize tileSize = m_maxTileSize.boundedTo(size);
+    if (!m_framebuffer || m_framebuffer->width() < tileSize.width() || m_framebuffer->height() < tileSize.height()) {
+        // Grow only, so alternating image sizes do not recreate it every time
+        const QSize framebufferSize = m_framebuffer ? tileSize.expandedTo(m_framebuffer->size()) : tileSize;
+        m_framebuffer.reset();
+        QOpenGLFramebufferObjectFormat format;
+        format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+        m_framebuffer = std::make_unique<QOpenGLFramebufferObject>(framebufferSize, format);
+        if (!m_framebuffer->isValid()) {
+            m_framebuffer.reset();
+            m_context->doneCurrent();
+            return fail(QString("Cannot create a %1x%2 framebuffer").arg(tileSize.width()).arg(tileSize.height()));
+        }
+    }
+
+    // World rectangles have y growing upwards, image rows grow downwards
+    const float zoom = float(size.width() / worldRect.width());
+    const qreal worldPerPixelX = worldRect.width() / size.width();
+    const qreal worldPerPixelY = worldRect.height() / size.height();
+    QByteArray readback;
+    bool timedOut = false;
+
+    for (int y = 0; y < size.height(); y += tileSize.height()) {
+        for (int x = 0; x < size.width(); x += tileSize.width()) {
+            const QSize tile(qMin(tileSize.width(), size.width() - x), qMin(tileSize.height(), size.height() - y));
+            const QRectF tileRect(QPointF(worldRect.left() + x * worldPerPixelX,
+                                          worldRect.bottom() - (y + tile.height()) * worldPerPixelY),
+                                  QSizeF(tile.width() * worldPerPixelX, tile.height() * worldPerPixelY));
+
+            // Streamed data arrives through queued events; draw again until
+            // the layers have it all
+            QElapsedTimer clock;
+            clock.start();
+            while (renderTile(layers, tileRect, tile, zoom)) {
+                if (clock.elapsed() >= m_loadTimeoutMs) {
+                    timedOut = true;
+                    break;
+                }
+                QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+                QThread::msleep(2);
+            }
+
+            const int rowBytes = tile.width() * 4;
+            readback.resize(rowBytes * tile.height());
+            QOpenGLFunctions* gl = m_context->functions();
+            gl->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            gl->glReadPixels(0, 0, tile.width(), tile.height(), GL_RGBA, GL_UNSIGNED_BYTE, readback.data());
+
+            // Framebuffers have their first row at the bottom
+            for (int row = 0; row < tile.height(); ++row) {
+                std::memcpy(image.scanLine(y + tile.height() - 1 - row) + x * 4,
+                            readback.constData() + qint64(row) * rowBytes, size_t(rowBytes));
+            }
+        }
+    }
+
+    m_framebuffer->release();
+    m_context->doneCurrent();
+
+    if (timedOut) {
+        qWarning() << "OffscreenRenderer: layer data did not arrive within" << m_loadTimeoutMs
+                   << "ms; the image is incomplete";
+    }
+    return image;
+}
+
+bool OffscreenRenderer::renderTile(LayerManager* layers, const QRectF& worldRect, const QSize& size, float zoom)
+{
+    // Event processing between passes may have switched contexts
+    m_context->makeCurrent(m_surface.get());
+    QOpenGLFunctions* gl = m_context->functions();
+
+    m_framebuffer->bind();
+    gl->glViewport(0, 0, size.width(), size.height());
+    gl->glClearColor(m_backgroundColor.redF(), m_backgroundColor.greenF(),
+                     m_backgroundColor.blueF(), m_backgroundColor.alphaF());
+    gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    gl->glDisable(GL_DEPTH_TEST);
+    gl->glEnable(GL_BLEND);
+    gl->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    RenderContext context;
+    context.glContext = m_context.get();
+    context.gl = gl;
+    const QSurfaceFormat format = m_context->format();
+    const bool instancing = m_context->isOpenGLES() ? format.majorVersion() >= 3
+                                                    : format.version() >= qMakePair(3, 3);
+    if (instancing) {
+        context.instancing = m_context->extraFunctions();
+    }
+    context.projectionMatrix.ortho(float(worldRect.left()), float(worldRect.right()),
+                                   float(worldRect.top()), float(worldRect.bottom()), -1000.0f, 1000.0f);
+    context.viewRect = worldRect;
+    context.viewportSize = size;
+    context.zoomLevel = zoom;
+    context.arena = &m_frameArena;
+
+    bool loading = false;
+    for (int i = 0; i < layers->layerCount(); ++i) {
+        Layer* layer = layers->layer(i);
+        if (!layer || !layer->isVisible()) {
+            continue;
+        }
+
+        const LayerBounds bounds = layers->layerBounds(layer);
+        if (bounds.isValid() && !bounds.intersects(worldRect, kCullMargin / zoom)) {
+            continue;
+        }
+
+        layer->render(&context);
+        loading = loading || layer->isLoading();
+    }
+
+    m_frameArena.reset();
+    return loading;
+}
+
+void OffscreenRenderer::releaseLayers(LayerManager* layers)
+{
+    if (!layers || !isInitialized() || !m_context->makeCurrent(m_surface.get())) {
+        return;
+    }
+
+    for (Layer* layer : *layers) {
+        layer->releaseGraphicsResources();
+    }
+    if (GpuResourcePool* pool = GpuResourcePool::forContext(m_context.get())) {
+        pool->trim(m_context->functions());
+    }
+    m_context->doneCurrent();
+}
+
+QRectF OffscreenRenderer::fitRect(const LayerBounds& bounds, const QSize& size, qreal margin)
+{
+    if (size.isEmpty() || margin < 0.0 || margin >= 0.5) {
+        return QRectF();
+    }
+
+    const QPointF center = bounds.isValid() ? bounds.center() : QPointF();
+    const qreal fill = qBound<qreal>(0.0, 1.0 - 2.0 * margin, 1.0);
+    qreal zoom = 1.0;
+    if (bounds.isValid() && (bounds.width() > 0.0f || bounds.height() > 0.0f)) {
+        const qreal scaleX = bounds.width() > 0.0f ? size.width() * fill / bounds.width() : qInf();
+        const qreal scaleY = bounds.height() > 0.0f ? size.height() * fill / bounds.height() : qInf();
+        zoom = qMin(scaleX, scaleY);
+    }
+    if (!(zoom > 0.0) || qIsInf(zoom)) {
+        return QRectF();
+    }
+
+    const QSizeF extent(size.width() / zoom, size.height() / zoom);
+    return QRectF(center - QPointF(extent.width() / 2.0, extent.height() / 2.0), extent);
+}
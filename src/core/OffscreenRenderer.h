@@ -0,0 +1,163 @@
+#pragma once
+
+#include "../utils/FrameArena.h"
+#include <QColor>
+#include <QImage>
+#include <QRectF>
+#include <QSize>
+#include <QString>
+#include <memory>
+
+class LayerBounds;
+class LayerManager;
+class QOffscreenSurface;
+class QOpenGLContext;
+class QOpenGLFramebufferObject;
+
+/**
+ * @brief Renders layer scenes into images without a window
+ *
+ * Owns an OpenGL context on a QOffscreenSurface (EGL or GLX, depending on
+ * the platform plugin) and draws the 2D view of a LayerManager into a
+ * framebuffer object, the same way ViewerWidget draws it on screen.
+ *
+ * Images larger than the GPU's framebuffer limit are rendered in tiles:
+ * each tile gets its own orthographic projection onto part of the world
+ * rectangle and is read back into the output image. All tiles share the
+ * same zoom level, so layers pick the same level of detail everywhere and
+ * tiles join without seams.
+ *
+ * Layers that stream their data (see Layer::isLoading()) are rendered
+ * again, with events processed in between, until their data has arrived
+ * or loadTimeout() expires.
+ *
+ * Used from the thread that owns the layers.
+ */
+class OffscreenRenderer
+{
+public:
+    /**
+     * @brief Constructor
+     */
+    OffscreenRenderer();
+
+    /**
+     * @brief Destructor
+     */
+    ~OffscreenRenderer();
+
+    OffscreenRenderer(const OffscreenRenderer&) = delete;
+    OffscreenRenderer& operator=(const OffscreenRenderer&) = delete;
+
+    /**
+     * @brief Create the surface and the context
+     * @param errorMessage Receives the reason on failure (may be nullptr)
+     * @return true if rendering is possible
+     */
+    bool initialize(QString* errorMessage = nullptr);
+
+    /**
+     * @brief Check if initialize() succeeded
+     * @return true if initialized
+     */
+    bool isInitialized() const { return m_context != nullptr; }
+
+    /**
+     * @brief Get the largest tile rendered in one pass
+     * @return Tile size in pixels, limited by the GPU
+     */
+    QSize maxTileSize() const { return m_maxTileSize; }
+
+    /**
+     * @brief Get the OpenGL renderer string of the context
+     * @return Renderer name, empty before initialize()
+     */
+    QString rendererName() const { return m_rendererName; }
+
+    /**
+     * @brief Limit the tile size below the GPU limit
+     * @param size Tile size in pixels
+     */
+    void setMaxTileSize(const QSize& size);
+
+    /**
+     * @brief Get background color
+     * @return Color the image is cleared to
+     */
+    QColor backgroundColor() const { return m_backgroundColor; }
+
+    /**
+     * @brief Set background color
+     * @param color Color the image is cleared to; may be transparent
+     */
+    void setBackgroundColor(const QColor& color) { m_backgroundColor = color; }
+
+    /**
+     * @brief Get time allowed for streamed data to arrive
+     * @return Timeout in milliseconds per tile
+     */
+    int loadTimeout() const { return m_loadTimeoutMs; }
+
+    /**
+     * @brief Set time allowed for streamed data to arrive
+     * @param milliseconds Timeout per tile; 0 renders once
+     */
+    void setLoadTimeout(int milliseconds) { m_loadTimeoutMs = qMax(0, milliseconds); }
+
+    /**
+     * @brief Render a world rectangle into an image
+     *
+     * The rectangle is stretched to the image; pass one with the image's
+     * aspect ratio (see fitRect()) to keep pixels square.
+     *
+     * @param layers Layer stack
+     * @param worldRect Area in world coordinates
+     * @param size Image size in pixels
+     * @param errorMessage Receives the reason on failure (may be nullptr)
+     * @return RGBA image, or a null image on failure
+     */
+    QImage render(LayerManager* layers, const QRectF& worldRect, const QSize& size,
+                  QString* errorMessage = nullptr);
+
+    /**
+     * @brief Release the GPU resources the layers hold in this context
+     *
+     * Call before deleting layers rendered by this renderer, or before
+     * rendering them elsewhere.
+     *
+     * @param layers Layer stack
+     */
+    void releaseLayers(LayerManager* layers);
+
+    /**
+     * @brief Get a world rectangle showing the whole scene at an aspect ratio
+     * @param bounds Scene bounds
+     * @param size Image size in pixels
+     * @param margin Fraction of the image left free around the scene, in [0, 0.5)
+     * @return World rectangle centered on the scene, or an empty rectangle
+     *         if the margin leaves no room
+     */
+    static QRectF fitRect(const LayerBounds& bounds, const QSize& size, qreal margin = 0.0);
+
+private:
+    /**
+     * @brief Render one tile into the framebuffer
+     * @param layers Layer stack
+     * @param worldRect Area of the tile in world coordinates
+     * @param size Tile size in pixels
+     * @param zoom Screen pixels per world unit
+     * @return true if a layer is still loading data
+     */
+    bool renderTile(LayerManager* layers, const QRectF& worldRect, const QSize& size, float zoom);
+
+private:
+    std::unique_ptr<QOffscreenSurface> m_surface;
+    std::unique_ptr<QOpenGLContext> m_context;
+    std::unique_ptr<QOpenGLFramebufferObject> m_framebuffer;
+    FrameArena m_frameArena;
+    QSize m_maxTileSize;
+    QSize m_gpuTileLimit;
+    QString m_rendererName;
+    QColor m_backgroundColor;
+    int m_loadTimeoutMs;
+};
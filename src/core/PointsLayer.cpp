@@ -0,0 +1,467 @@
+#include "PointsLayer.h"
+#include "RenderContext.h"
+
+#include <QDebug>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+static_assert(sizeof(QVector3D) == 3 * sizeof(float), "QVector3D must be tightly packed");
+
+// Smallest on-screen diameter in 2D, in screen pixels
+const float kMinPointPixels = 2.0f;
+
+// Fixed attribute locations
+enum PointAttribute : GLuint
+{
+    CornerAttribute = 0,
+    PositionAttribute = 1,
+    SizeAttribute = 2,
+    ColorAttribute = 3
+};
+
+const char* kVertexShader =
+    "attribute vec2 a_corner;\n"
+    "attribute vec3 a_position;\n"
+    "attribute float a_size;\n"
+    "attribute vec4 a_color;\n"
+    "uniform mat4 u_mvp;\n"
+    "uniform vec3 u_right;\n"
+    "uniform vec3 u_up;\n"
+    "uniform float u_minSize;\n"
+    "varying vec2 v_corner;\n"
+    "varying vec4 v_color;\n"
+    "void main()\n"
+    "{\n"
+    "    float size = max(a_size, u_minSize);\n"
+    "    vec3 offset = (a_corner.x * u_right + a_corner.y * u_up) * size;\n"
+    "    gl_Position = u_mvp * vec4(a_position + offset, 1.0);\n"
+    "    v_corner = a_corner * 2.0;\n"
+    "    v_color = a_color;\n"
+    "}\n";
+
+const char* kFragmentShader =
+    "#ifdef GL_ES\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform float u_opacity;\n"
+    "varying vec2 v_corner;\n"
+    "varying vec4 v_color;\n"
+    "void main()\n"
+    "{\n"
+    "    if (dot(v_corner, v_corner) > 1.0)\n"
+    "        discard;\n"
+    "    gl_FragColor = vec4(v_color.rgb, v_color.a * u_opacity);\n"
+    "}\n";
+
+// Triangle strip covering [-0.5, 0.5] x [-0.5, 0.5]
+const GLfloat kCorners[] = {
+    -0.5f, -0.5f,
+     0.5f, -0.5f,
+    -0.5f,  0.5f,
+     0.5f,  0.5f
+};
+
+} // namespace
+
+PointsLayer::PointsLayer(const QString& name, QObject* parent)
+    : Layer(name, LayerType::Points, parent)
+    , m_defaultSize(1.0f)
+    , m_defaultColor(packVertexColor(QColor(255, 255, 0)))
+    , m_indexValid(false)
+    , m_maxSize(0.0f)
+    , m_glContext(nullptr)
+    , m_program(nullptr)
+    , m_warnedNoInstancing(false)
+{
+}
+
+PointsLayer::~PointsLayer()
+{
+    // GPU resources are released by the viewer through releaseGraphicsResources()
+    delete m_program;
+}
+
+QColor PointsLayer::pointColor(int index) const
+{
+    if (index < 0 || index >= m_colors.size()) {
+        return QColor();
+    }
+    return unpackVertexColor(m_colors.at(index));
+}
+
+void PointsLayer::setPoints(const QVector<QVector3D>& positions)
+{
+    m_positions = positions;
+    m_sizes = QVector<float>(positions.size(), m_defaultSize);
+    m_colors = QVector<quint32>(positions.size(), m_defaultColor);
+
+    m_positionBuffer.markAllDirty();
+    m_sizeBuffer.markAllDirty();
+    m_colorBuffer.markAllDirty();
+
+    m_indexValid = false;
+    updateBounds();
+    markDataChanged();
+}
+
+void PointsLayer::appendPoints(const QVector<QVector3D>& positions)
+{
+    if (positions.isEmpty()) {
+        return;
+    }
+
+    const int first = m_positions.size();
+    m_positions += positions;
+    m_sizes.insert(m_sizes.size(), positions.size(), m_defaultSize);
+    m_colors.insert(m_colors.size(), positions.size(), m_defaultColor);
+
+    // Only the new tail is uploaded
+    m_positionBuffer.markDirty(qint64(first) * sizeof(QVector3D), qint64(positions.size()) * sizeof(QVector3D));
+    m_sizeBuffer.markDirty(qint64(first) * sizeof(float), qint64(positions.size()) * sizeof(float));
+    m_colorBuffer.markDirty(qint64(first) * sizeof(quint32), qint64(positions.size()) * sizeof(quint32));
+
+    if (m_indexValid) {
+        for (int i = 0; i < positions.size(); ++i) {
+            m_index.insert(first + i, positions.at(i));
+        }
+        m_maxSize = qMax(m_maxSize, m_defaultSize);
+    }
+
+    if (first == 0) {
+        updateBounds();
+    } else {
+        extendBounds(first, positions.size());
+    }
+    markDataChanged();
+}
+
+void PointsLayer::clearPoints()
+{
+    if (m_positions.isEmpty()) {
+        return;
+    }
+    setPoints(QVector<QVector3D>());
+}
+
+void PointsLayer::setPointPosition(int index, const QVector3D& position)
+{
+    if (index < 0 || index >= m_positions.size()) {
+        return;
+    }
+
+    const QVector3D previous = m_positions.at(index);
+    m_positions[index] = position;
+    m_positionBuffer.markDirty(qint64(index) * sizeof(QVector3D), sizeof(QVector3D));
+
+    if (m_indexValid) {
+        m_index.insert(index, position);
+    }
+
+    // A full pass is only needed when the point may have defined the bounds
+    const bool onBoundary = previous.x() == m_boundsMin.x() || previous.x() == m_boundsMax.x()
+                         || previous.y() == m_boundsMin.y() || previous.y() == m_boundsMax.y()
+                         || previous.z() == m_boundsMin.z() || previous.z() == m_boundsMax.z();
+    if (onBoundary) {
+        updateBounds();
+    } else {
+        extendBounds(index, 1);
+    }
+    markDataChanged();
+}
+
+void PointsLayer::setPointSize(int index, float size)
+{
+    if (index < 0 || index >= m_sizes.size()) {
+        return;
+    }
+
+    m_sizes[index] = size;
+    m_sizeBuffer.markDirty(qint64(index) * sizeof(float), sizeof(float));
+    m_maxSize = qMax(m_maxSize, size);
+    markDataChanged();
+}
+
+void PointsLayer::setPointColor(int index, const QColor& color)
+{
+    if (index < 0 || index >= m_colors.size()) {
+        return;
+    }
+
+    m_colors[index] = packVertexColor(color);
+    m_colorBuffer.markDirty(qint64(index) * sizeof(quint32), sizeof(quint32));
+    markDataChanged();
+}
+
+void PointsLayer::setSizes(const QVector<float>& sizes)
+{
+    if (sizes.size() != m_positions.size()) {
+        qWarning() << "PointsLayer: expected" << m_positions.size() << "sizes, got" << sizes.size();
+        return;
+    }
+
+    m_sizes = sizes;
+    m_sizeBuffer.markAllDirty();
+    m_maxSize = sizes.isEmpty() ? 0.0f : *std::max_element(sizes.constBegin(), sizes.constEnd());
+    markDataChanged();
+}
+
+void PointsLayer::setColors(const QVector<QColor>& colors)
+{
+    if (colors.size() != m_positions.size()) {
+        qWarning() << "PointsLayer: expected" << m_positions.size() << "colors, got" << colors.size();
+        return;
+    }
+
+    for (int i = 0; i < colors.size(); ++i) {
+        m_colors[i] = packVertexColor(colors.at(i));
+    }
+    m_colorBuffer.markAllDirty();
+    markDataChanged();
+}
+
+QVariant PointsLayer::data() const
+{
+    return QVariant::fromValue(m_positions);
+}
+
+void PointsLayer::setData(const QVariant& data)
+{
+    if (data.userType() == qMetaTypeId<DataBuffer>()) {
+        setBuffer(data.value<DataBuffer>());
+    } else if (data.canConvert<QVector<QVector3D>>()) {
+        setPoints(data.value<QVector<QVector3D>>());
+    }
+}
+
+DataBuffer PointsLayer::buffer() const
+{
+    if (m_positions.isEmpty()) {
+        return DataBuffer();
+    }
+
+    return DataBuffer(DataType::Float32,
+                      {m_positions.size(), 3},
+                      {qint64(sizeof(QVector3D)), qint64(sizeof(float))},
+                      std::make_shared<VectorStorage<QVector3D>>(m_positions));
+}
+
+bool PointsLayer::setBuffer(const DataBuffer& buffer)
+{
+    const qint64 columns = buffer.shape(1);
+    if (buffer.ndim() != 2 || (columns != 2 && columns != 3)
+        || buffer.shape(0) > std::numeric_limits<int>::max()) {
+        qWarning() << "PointsLayer: unsupported buffer shape" << buffer.shape();
+        return false;
+    }
+
+    DataBuffer values = buffer.dtype() == DataType::Float32 && buffer.isContiguous()
+                      ? buffer
+                      : buffer.converted(DataType::Float32);
+    if (values.isNull()) {
+        qWarning() << "PointsLayer: unsupported buffer type" << dataTypeName(buffer.dtype());
+        return false;
+    }
+
+    const int count = int(values.shape(0));
+    const float* in = values.constData<float>();
+    QVector<QVector3D> positions(count);
+
+    if (columns == 3) {
+        std::memcpy(positions.data(), in, size_t(count) * sizeof(QVector3D));
+    } else {
+        for (int i = 0; i < count; ++i) {
+            positions[i] = QVector3D(in[2 * i], in[2 * i + 1], 0.0f);
+        }
+    }
+
+    setPoints(positions);
+    return true;
+}
+
+LayerBounds PointsLayer::bounds() const
+{
+    if (m_positions.isEmpty()) {
+        return LayerBounds();
+    }
+
+    return LayerBounds(m_boundsMin.x(), m_boundsMin.y(), m_boundsMax.x(), m_boundsMax.y());
+}
+
+int PointsLayer::pick(const QPointF& worldPos, float tolerance) const
+{
+    if (m_positions.isEmpty()) {
+        return -1;
+    }
+
+    updateIndex();
+
+    // Search wide enough for the largest point, then check the hit's own size
+    const int id = m_index.nearest(worldPos, tolerance + 0.5f * m_maxSize, m_positions);
+    if (id < 0) {
+        return -1;
+    }
+
+    const QVector3D& p = m_positions.at(id);
+    const qreal dx = p.x() - worldPos.x();
+    const qreal dy = p.y() - worldPos.y();
+    const qreal reach = tolerance + 0.5f * m_sizes.at(id);
+    return dx * dx + dy * dy <= reach * reach ? id : -1;
+}
+
+QVector<int> PointsLayer::elementsIn(const QRectF& rect) const
+{
+    if (m_positions.isEmpty()) {
+        return QVector<int>();
+    }
+
+    updateIndex();
+    return m_index.query(rect, m_positions);
+}
+
+void PointsLayer::render(void* context)
+{
+    RenderContext* ctx = static_cast<RenderContext*>(context);
+    if (!ctx || !ctx->gl || m_positions.isEmpty()) {
+        return;
+    }
+
+    if (!ctx->instancing) {
+        if (!m_warnedNoInstancing) {
+            qWarning() << "PointsLayer: instanced drawing needs OpenGL 3.3 or OpenGL ES 3.0";
+            m_warnedNoInstancing = true;
+        }
+        return;
+    }
+
+    QOpenGLFunctions* gl = ctx->gl;
+    QOpenGLExtraFunctions* extra = ctx->instancing;
+
+    if (m_glContext != ctx->glContext) {
+        // Resources from another context cannot be reused
+        delete m_program;
+        m_program = nullptr;
+        m_cornerBuffer.invalidate();
+        m_positionBuffer.invalidate();
+        m_sizeBuffer.invalidate();
+        m_colorBuffer.invalidate();
+        m_glContext = ctx->glContext;
+    }
+
+    if (!m_program && !initializeResources(gl)) {
+        return;
+    }
+
+    m_positionBuffer.sync(gl, m_positions.constData(), qint64(m_positions.size()) * sizeof(QVector3D));
+    m_sizeBuffer.sync(gl, m_sizes.constData(), qint64(m_sizes.size()) * sizeof(float));
+    m_colorBuffer.sync(gl, m_colors.constData(), qint64(m_colors.size()) * sizeof(quint32));
+
+    // Camera axes in world space, so points face the viewer in 3D as well
+    const QVector3D right = ctx->viewMatrix.row(0).toVector3D().normalized();
+    const QVector3D up = ctx->viewMatrix.row(1).toVector3D().normalized();
+    const float minSize = ctx->is3D ? 0.0f : kMinPointPixels / qMax(ctx->zoomLevel, 1e-6f);
+
+    m_program->bind();
+    m_program->setUniformValue("u_mvp", ctx->viewProjectionMatrix());
+    m_program->setUniformValue("u_right", right);
+    m_program->setUniformValue("u_up", up);
+    m_program->setUniformValue("u_minSize", minSize);
+    m_program->setUniformValue("u_opacity", m_opacity);
+
+    m_cornerBuffer.bindAttribute(gl, CornerAttribute, 2);
+    m_positionBuffer.bindAttribute(gl, PositionAttribute, 3);
+    m_sizeBuffer.bindAttribute(gl, SizeAttribute, 1);
+    m_colorBuffer.bindAttribute(gl, ColorAttribute, 4, GL_UNSIGNED_BYTE, true);
+
+    extra->glVertexAttribDivisor(PositionAttribute, 1);
+    extra->glVertexAttribDivisor(SizeAttribute, 1);
+    extra->glVertexAttribDivisor(ColorAttribute, 1);
+
+    extra->glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, m_positions.size());
+
+    // Attribute state is global; leave it as other layers expect it
+    for (GLuint location = CornerAttribute; location <= ColorAttribute; ++location) {
+        extra->glVertexAttribDivisor(location, 0);
+        gl->glDisableVertexAttribArray(location);
+    }
+    gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_program->release();
+}
+
+void PointsLayer::releaseGraphicsResources()
+{
+    QOpenGLContext* current = QOpenGLContext::currentContext();
+    if (!current || current != m_glContext) {
+        return;
+    }
+
+    QOpenGLFunctions* gl = current->functions();
+    m_cornerBuffer.destroy(gl);
+    m_positionBuffer.destroy(gl);
+    m_sizeBuffer.destroy(gl);
+    m_colorBuffer.destroy(gl);
+    delete m_program;
+    m_program = nullptr;
+    m_glContext = nullptr;
+}
+
+bool PointsLayer::initializeResources(QOpenGLFunctions* gl)
+{
+    m_program = new QOpenGLShaderProgram();
+    m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, kVertexShader);
+    m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, kFragmentShader);
+    m_program->bindAttributeLocation("a_corner", CornerAttribute);
+    m_program->bindAttributeLocation("a_position", PositionAttribute);
+    m_program->bindAttributeLocation("a_size", SizeAttribute);
+    m_program->bindAttributeLocation("a_color", ColorAttribute);
+
+    if (!m_program->link()) {
+        qWarning() << "PointsLayer: failed to link shader program:" << m_program->log();
+        delete m_program;
+        m_program = nullptr;
+        return false;
+    }
+
+    m_cornerBuffer.sync(gl, kCorners, sizeof(kCorners));
+    return true;
+}
+
+void PointsLayer::updateIndex() const
+{
+    if (m_indexValid && !m_index.needsRebuild()) {
+        return;
+    }
+
+    m_index.build(m_positions);
+    m_maxSize = m_sizes.isEmpty() ? 0.0f : *std::max_element(m_sizes.constBegin(), m_sizes.constEnd());
+    m_indexValid = true;
+}
+
+void PointsLayer::updateBounds()
+{
+    if (m_positions.isEmpty()) {
+        m_boundsMin = QVector3D();
+        m_boundsMax = QVector3D();
+        return;
+    }
+
+    m_boundsMin = m_positions.at(0);
+    m_boundsMax = m_positions.at(0);
+    extendBounds(1, m_positions.size() - 1);
+}
+
+void PointsLayer::extendBounds(int first, int count)
+{
+    for (int i = first; i < first + count; ++i) {
+        const QVector3D& p = m_positions.at(i);
+        m_boundsMin = QVector3D(qMin(m_boundsMin.x(), p.x()), qMin(m_boundsMin.y(), p.y()),
+                                qMin(m_boundsMin.z(), p.z()));
+        m_boundsMax = QVector3D(qMax(m_boundsMax.x(), p.x()), qMax(m_boundsMax.y(), p.y()),
+                                qMax(m_boundsMax.z(), p.z()));
+    }
+}
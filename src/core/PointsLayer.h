@@ -0,0 +1,223 @@
+#pragma once
+
+#include "LayerManager.h"
+#include "GpuBuffer.h"
+#include "SpatialIndex.h"
+#include <QColor>
+#include <QVector>
+#include <QVector3D>
+
+class QOpenGLContext;
+class QOpenGLShaderProgram;
+
+/**
+ * @brief Layer drawing large point sets with one instanced draw call
+ *
+ * Positions, sizes and colors are kept as separate arrays (structure of
+ * arrays) and mirrored into one GPU buffer each. Every point is an
+ * instance of a camera-facing quad shaded as a disc. Edits only re-upload
+ * the modified range of the affected array, and appended points only
+ * upload the new elements.
+ *
+ * Sizes are diameters in world units; points never shrink below a couple
+ * of screen pixels, so dense sets stay visible when zoomed out.
+ *
+ * Picking and rectangle queries use a SpatialIndex that is built on the
+ * first query and extended as points are appended.
+ */
+class PointsLayer : public Layer
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * @param name Layer name
+     * @param parent Parent object
+     */
+    explicit PointsLayer(const QString& name, QObject* parent = nullptr);
+
+    /**
+     * @brief Destructor
+     */
+    ~PointsLayer();
+
+    /**
+     * @brief Get number of points
+     * @return Point count
+     */
+    int pointCount() const { return m_positions.size(); }
+
+    /**
+     * @brief Get point positions
+     * @return Positions in world coordinates
+     */
+    const QVector<QVector3D>& positions() const { return m_positions; }
+
+    /**
+     * @brief Get point sizes
+     * @return Diameters in world units
+     */
+    const QVector<float>& sizes() const { return m_sizes; }
+
+    /**
+     * @brief Get color of a point
+     * @param index Point index
+     * @return Color
+     */
+    QColor pointColor(int index) const;
+
+    /**
+     * @brief Replace all points
+     *
+     * Sizes and colors are reset to the defaults.
+     *
+     * @param positions Positions in world coordinates
+     */
+    void setPoints(const QVector<QVector3D>& positions);
+
+    /**
+     * @brief Append points with the default size and color
+     * @param positions Positions in world coordinates
+     */
+    void appendPoints(const QVector<QVector3D>& positions);
+
+    /**
+     * @brief Remove all points
+     */
+    void clearPoints();
+
+    /**
+     * @brief Move a point
+     * @param index Point index
+     * @param position New position
+     */
+    void setPointPosition(int index, const QVector3D& position);
+
+    /**
+     * @brief Set size of a point
+     * @param index Point index
+     * @param size Diameter in world units
+     */
+    void setPointSize(int index, float size);
+
+    /**
+     * @brief Set color of a point
+     * @param index Point index
+     * @param color Color
+     */
+    void setPointColor(int index, const QColor& color);
+
+    /**
+     * @brief Set sizes of all points
+     * @param sizes One diameter per point
+     */
+    void setSizes(const QVector<float>& sizes);
+
+    /**
+     * @brief Set colors of all points
+     * @param colors One color per point
+     */
+    void setColors(const QVector<QColor>& colors);
+
+    /**
+     * @brief Get size given to new points
+     * @return Diameter in world units
+     */
+    float defaultSize() const { return m_defaultSize; }
+
+    /**
+     * @brief Set size given to new points
+     * @param size Diameter in world units
+     */
+    void setDefaultSize(float size) { m_defaultSize = size; }
+
+    /**
+     * @brief Get color given to new points
+     * @return Color
+     */
+    QColor defaultColor() const { return unpackVertexColor(m_defaultColor); }
+
+    /**
+     * @brief Set color given to new points
+     * @param color Color
+     */
+    void setDefaultColor(const QColor& color) { m_defaultColor = packVertexColor(color); }
+
+    // Layer interface implementation
+    QVariant data() const override;
+    void setData(const QVariant& data) override;
+
+    /**
+     * @brief Get positions as a float32 buffer of shape [count, 3]
+     * @return Read-only buffer sharing the layer's position array
+     */
+    DataBuffer buffer() const override;
+
+    /**
+     * @brief Set positions from a buffer of shape [count, 2] or [count, 3]
+     *
+     * Columns are x, y and optionally z; any numeric type is accepted.
+     *
+     * @param buffer Data buffer
+     * @return true if the buffer was accepted
+     */
+    bool setBuffer(const DataBuffer& buffer) override;
+
+    LayerBounds bounds() const override;
+    int pick(const QPointF& worldPos, float tolerance) const override;
+    QVector<int> elementsIn(const QRectF& rect) const override;
+    void render(void* context) override;
+    void releaseGraphicsResources() override;
+
+private:
+    /**
+     * @brief Create shader program and the shared quad buffer
+     * @param gl OpenGL functions
+     * @return true if successful
+     */
+    bool initializeResources(QOpenGLFunctions* gl);
+
+    /**
+     * @brief Bring the spatial index up to date
+     */
+    void updateIndex() const;
+
+    /**
+     * @brief Recompute the bounding box from all positions
+     */
+    void updateBounds();
+
+    /**
+     * @brief Grow the bounding box to include a range of points
+     * @param first First point
+     * @param count Number of points
+     */
+    void extendBounds(int first, int count);
+
+private:
+    // Point attributes, one entry per point
+    QVector<QVector3D> m_positions;
+    QVector<float> m_sizes;
+    QVector<quint32> m_colors;
+
+    float m_defaultSize;
+    quint32 m_defaultColor;
+
+    QVector3D m_boundsMin;
+    QVector3D m_boundsMax;
+
+    // Spatial index, built lazily; m_indexValid is false after removals or moves
+    mutable SpatialIndex m_index;
+    mutable bool m_indexValid;
+    mutable float m_maxSize;
+
+    // GPU resources
+    QOpenGLContext* m_glContext;
+    QOpenGLShaderProgram* m_program;
+    GpuBuffer m_cornerBuffer;
+    GpuBuffer m_positionBuffer;
+    GpuBuffer m_sizeBuffer;
+    GpuBuffer m_colorBuffer;
+    bool m_warnedNoInstancing;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "ChunkedExecutor.h"
+#include "DataBuffer.h"
+#include <QVector>
+
+/**
+ * @brief How a processing operation wants its input split
+ *
+ * The output has the input's shape; only the element type may differ.
+ */
+struct ProcessingOptions
+{
+    DataType outputType = DataType::Unknown;    ///< Output element type (Unknown keeps the input type)
+    QVector<qint64> blockShape;                 ///< Block extent per axis (empty picks a default)
+    QVector<qint64> halo;                       ///< Extra input elements per axis on each side of a block
+};
+
+/**
+ * @brief One block of a processing run, handed to a worker thread
+ *
+ * input covers the block grown by the halo and clipped to the array;
+ * output covers exactly the block and is writable. The output block at
+ * index [0, ...] corresponds to input element inputOffset. Blocks never
+ * share output memory, so workers need no synchronization.
+ */
+struct ProcessingBlock
+{
+    qint64 index = 0;                   ///< Block index
+    QVector<qint64> start;              ///< Position of the output block in the array
+    QVector<qint64> inputOffset;        ///< Position of the output block within input
+    DataBuffer input;                   ///< Input view including the halo
+    DataBuffer output;                  ///< Output view to fill
+    const ChunkedExecutor* executor = nullptr;
+
+    /**
+     * @brief Check if the run was cancelled
+     *
+     * Long-running operations should poll this and return early.
+     *
+     * @return true if the result will be discarded
+     */
+    bool isCancelled() const { return executor && executor->isCancelled(); }
+};
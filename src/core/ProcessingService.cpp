@@ -0,0 +1,383 @@
+#include "ProcessingService.h"
+#include "Application.h"
+#include "CommandHistory.h"
+#include "DataLoader.h"
+#include "EventChannel.h"
+#include "ImageLayer.h"
+#include "LayerCommands.h"
+#include "LayerManager.h"
+#include "../plugins/PluginManager.h"
+
+#include <QDebug>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QThread>
+
+ProcessingService* ProcessingService::s_instance = nullptr;
+
+namespace {
+
+void setError(QString* errorMessage, const QString& message)
+{
+    qWarning() << "Processing:" << message;
+    if (errorMessage) {
+        *errorMessage = message;
+    }
+}
+
+} // namespace
+
+ProcessingService::ProcessingService(QObject* parent)
+    : QObject(parent)
+    , m_nextJobId(1)
+{
+    s_instance = this;
+
+    // Processing is compute bound; leave one core for the GUI thread
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+
+    m_refreshTimer.setInterval(kRefreshIntervalMs);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &ProcessingService::refreshJobs);
+}
+
+ProcessingService::~ProcessingService()
+{
+    shutdown();
+
+    if (s_instance == this) {
+        s_instance = nullptr;
+    }
+}
+
+ProcessingService* ProcessingService::instance()
+{
+    return s_instance;
+}
+
+int ProcessingService::run(const QString& operation, Layer* source, const QVariantMap& parameters,
+                           Layer* target, QString* errorMessage)
+{
+    Application* app = Application::instance();
+    if (app && app->pluginManager()) {
+        for (ProcessingPluginInterface* plugin : app->pluginManager()->pluginsByInterface<ProcessingPluginInterface>()) {
+            if (plugin->operations().contains(operation)) {
+                return run(plugin, operation, source, parameters, target, errorMessage);
+            }
+        }
+    }
+
+    setError(errorMessage, QString("No plugin provides operation %1").arg(operation));
+    return 0;
+}
+
+int ProcessingService::run(ProcessingPluginInterface* plugin, const QString& operation, Layer* source,
+                           const QVariantMap& parameters, Layer* target, QString* errorMessage)
+{
+    if (!plugin || !source) {
+        setError(errorMessage, "No plugin or source layer given");
+        return 0;
+    }
+
+    const DataBuffer input = source->buffer();
+    if (input.isNull() || input.elementCount() == 0) {
+        setError(errorMessage, QString("Layer %1 has no array data").arg(source->name()));
+        return 0;
+    }
+
+    const ProcessingOptions options = plugin->processingOptions(operation, input, parameters);
+    const DataType outputType = options.outputType == DataType::Unknown ? input.dtype() : options.outputType;
+    const QVector<qint64> blockShape = options.blockShape.isEmpty()
+        ? BlockGrid::defaultBlockShape(input.shape()) : options.blockShape;
+    if (blockShape.size() != input.ndim() || (!options.halo.isEmpty() && options.halo.size() != input.ndim())) {
+        setError(errorMessage, QString("Block shape of %1 does not match %2-D data").arg(operation).arg(input.ndim()));
+        return 0;
+    }
+
+    QVector<qint64> halo = options.halo;
+    halo.resize(input.ndim());
+
+    auto job = std::make_shared<Job>();
+    job->id = m_nextJobId++;
+    job->operation = operation;
+
+    if (!target) {
+        // Zero-filled; calloc keeps untouched pages free until blocks arrive
+        job->output = DataBuffer(outputType, input.shape());
+        Layer* layer = DataLoader::createLayer(job->output, QString("%1 (%2)").arg(source->name(), operation));
+        if (!layer) {
+            setError(errorMessage, QString("Cannot show %1 output of layer %2").arg(operation, source->name()));
+            return 0;
+        }
+        if (!m_layerManager) {
+            delete layer;
+            setError(errorMessage, "No layer manager available");
+            return 0;
+        }
+        m_layerManager->addLayer(layer);
+        job->target = layer;
+        job->newLayer = true;
+    } else {
+        // Start from the target's data so unfinished blocks keep showing it;
+        // the source may be the target, so the output never aliases the input
+        const DataBuffer current = target->buffer();
+        job->output = current.shape() == input.shape() ? current.converted(outputType)
+                                                       : DataBuffer(outputType, input.shape());
+        job->command.reset(new SetLayerBufferCommand(target, job->output));
+        job->command->setText(tr("Apply %1").arg(operation));
+        job->command->redo();
+        if (!job->output.storage() || target->buffer().storage() != job->output.storage()) {
+            job->command->undo();
+            setError(errorMessage, QString("Layer %1 cannot show %2 output").arg(target->name(), operation));
+            return 0;
+        }
+        job->target = target;
+    }
+
+    const BlockGrid grid(input.shape(), blockShape);
+    const DataBuffer output = job->output;
+    job->executor.reset(new ChunkedExecutor(&m_pool));
+    const ChunkedExecutor* executor = job->executor.get();
+    const int jobId = job->id;
+
+    // Workers report completion on the GUI thread; the timer picks up progress
+    job->executor->setFinishedCallback([this, jobId]() {
+        QMetaObject::invokeMethod(this, [this, jobId]() { finishJob(jobId); }, Qt::QueuedConnection);
+    });
+
+    const bool started = job->executor->start(grid.blockCount(), [=](qint64 index) {
+        ProcessingBlock block;
+        block.index = index;
+        block.executor = executor;
+
+        QVector<qint64> extent;
+        grid.block(index, &block.start, &extent);
+
+        const int dims = input.ndim();
+        QVector<qint64> inputStart(dims);
+        QVector<qint64> inputExtent(dims);
+        block.inputOffset.resize(dims);
+        for (int axis = 0; axis < dims; ++axis) {
+            inputStart[axis] = qMax<qint64>(0, block.start[axis] - halo[axis]);
+            inputExtent[axis] = qMin(input.shape(axis), block.start[axis] + extent[axis] + halo[axis]) - inputStart[axis];
+            block.inputOffset[axis] = block.start[axis] - inputStart[axis];
+        }
+        block.input = input.region(inputStart, inputExtent);
+        block.output = output.region(block.start, extent);
+
+        QString error;
+        if (!plugin->processBlock(operation, block, parameters, &error)) {
+            if (!executor->isCancelled()) {
+                setJobError(jobId, error.isEmpty() ? QString("%1 failed on block %2").arg(operation).arg(index) : error);
+            }
+            return false;
+        }
+        return true;
+    });
+    if (!started) {
+        revertOutput(*job);
+        setError(errorMessage, QString("Cannot split layer %1 into blocks").arg(source->name()));
+        return 0;
+    }
+
+    m_jobs.insert(jobId, job);
+    if (!m_refreshTimer.isActive()) {
+        m_refreshTimer.start();
+    }
+
+    emit jobStarted(jobId, operation, job->target);
+    publish(CustomEventType::ProcessingStarted, jobId, operation,
+            {{"layerName", job->target->name()}, {"blocks", grid.blockCount()}});
+    return jobId;
+}
+
+void ProcessingService::cancel(int jobId)
+{
+    std::shared_ptr<Job> job = m_jobs.value(jobId);
+    if (!job || job->cancelled) {
+        return;
+    }
+
+    // Workers stop after their current block; finishJob() drops the job
+    job->cancelled = true;
+    job->executor->cancel();
+    revertOutput(*job);
+    emit jobCancelled(jobId, job->operation);
+    publish(CustomEventType::ProcessingCancelled, jobId, job->operation);
+}
+
+void ProcessingService::cancelAll()
+{
+    const QList<int> jobIds = m_jobs.keys();
+    for (int jobId : jobIds) {
+        cancel(jobId);
+    }
+}
+
+void ProcessingService::shutdown()
+{
+    cancelAll();
+    m_refreshTimer.stop();
+
+    // Executors wait for their workers when destroyed
+    m_jobs.clear();
+    m_pool.waitForDone();
+}
+
+bool ProcessingService::isRunning(int jobId) const
+{
+    const std::shared_ptr<Job> job = m_jobs.value(jobId);
+    return job && !job->cancelled;
+}
+
+int ProcessingService::runningCount() const
+{
+    int count = 0;
+    for (const std::shared_ptr<Job>& job : m_jobs) {
+        if (!job->cancelled) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+Layer* ProcessingService::targetLayer(int jobId) const
+{
+    const std::shared_ptr<Job> job = m_jobs.value(jobId);
+    return job && !job->cancelled ? job->target.data() : nullptr;
+}
+
+void ProcessingService::refreshJobs()
+{
+    for (const std::shared_ptr<Job>& job : qAsConst(m_jobs)) {
+        if (job->cancelled) {
+            continue;
+        }
+
+        showOutput(*job);
+
+        const qint64 blocks = qMax<qint64>(1, job->executor->blockCount());
+        const int percent = int(job->shownBlocks * 100 / blocks);
+        if (percent != job->progress) {
+            job->progress = percent;
+            emit jobProgress(job->id, job->operation, percent);
+            // Typed channel; legacy ProcessingProgress subscribers still get a QVariantMap
+            EventChannel<ProcessingProgressPayload>::instance().publish({job->id, job->operation, percent});
+        }
+    }
+}
+
+void ProcessingService::showOutput(Job& job)
+{
+    const qint64 completed = job.executor->completedCount();
+    if (completed == job.shownBlocks || !job.target) {
+        return;
+    }
+    job.shownBlocks = completed;
+
+    // The layer holds a view of the output, possibly a plane of it; a new
+    // version makes it pick up the finished blocks
+    job.output.markModified();
+    const DataBuffer view = job.target->buffer();
+    if (view.storage() == job.output.storage()) {
+        job.target->setBuffer(view);
+    }
+}
+
+void ProcessingService::finishJob(int jobId)
+{
+    std::shared_ptr<Job> job = m_jobs.take(jobId);
+    if (m_jobs.isEmpty()) {
+        m_refreshTimer.stop();
+    }
+
+    QString error;
+    {
+        QMutexLocker locker(&m_errorsMutex);
+        error = m_errors.take(jobId);
+    }
+
+    if (!job || job->cancelled) {
+        // Already reported by cancel()
+        return;
+    }
+
+    if (job->executor->hasFailed()) {
+        revertOutput(*job);
+        qWarning() << "Processing failed:" << error;
+        emit jobFailed(jobId, job->operation, error);
+        publish(CustomEventType::ProcessingFailed, jobId, job->operation, {{"error", error}});
+        return;
+    }
+
+    if (!job->target) {
+        // The output layer was deleted while the job ran
+        emit jobCancelled(jobId, job->operation);
+        publish(CustomEventType::ProcessingCancelled, jobId, job->operation);
+        return;
+    }
+
+    showOutput(*job);
+
+    if (job->newLayer) {
+        // New layers start with limits spanning the zero-filled buffer
+        if (ImageLayer* imageLayer = qobject_cast<ImageLayer*>(job->target.data())) {
+            if (imageLayer->hasScalarData()) {
+                imageLayer->autoContrast();
+            }
+        }
+    } else if (job->command) {
+        Application* app = Application::instance();
+        if (app && app->commandHistory()) {
+            app->commandHistory()->push(job->command.release());
+        }
+    }
+
+    if (job->progress != 100) {
+        job->progress = 100;
+        emit jobProgress(jobId, job->operation, 100);
+        EventChannel<ProcessingProgressPayload>::instance().publish({jobId, job->operation, 100});
+    }
+
+    emit jobFinished(jobId, job->operation, job->target);
+    publish(CustomEventType::ProcessingFinished, jobId, job->operation, {{"layerName", job->target->name()}});
+}
+
+void ProcessingService::revertOutput(Job& job)
+{
+    if (!job.target) {
+        return;
+    }
+
+    if (job.newLayer) {
+        if (m_layerManager) {
+            m_layerManager->removeLayers(QList<Layer*>{job.target.data()});
+        }
+        job.target->deleteLater();
+        job.target.clear();
+    } else if (job.command) {
+        job.command->undo();
+        job.command.reset();
+    }
+}
+
+void ProcessingService::setJobError(int jobId, const QString& errorMessage)
+{
+    QMutexLocker locker(&m_errorsMutex);
+    if (!m_errors.contains(jobId)) {
+        m_errors.insert(jobId, errorMessage);
+    }
+}
+
+void ProcessingService::publish(CustomEventType eventType, int jobId, const QString& operation,
+                                const QVariantMap& extra)
+{
+    EventSystem* eventSystem = EventSystem::instance();
+    if (!eventSystem) {
+        return;
+    }
+
+    QVariantMap data = extra;
+    data.insert("jobId", jobId);
+    data.insert("operation", operation);
+    eventSystem->publish(eventType, data);
+}
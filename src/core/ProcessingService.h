@@ -0,0 +1,252 @@
+#pragma once
+
+#include "ChunkedExecutor.h"
+#include "DataBuffer.h"
+#include "EventSystem.h"
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVariantMap>
+#include <memory>
+
+class Layer;
+class LayerManager;
+class ProcessingPluginInterface;
+class SetLayerBufferCommand;
+
+/**
+ * @brief Runs processing plugins over layer data on a worker pool
+ *
+ * run() splits the source layer's buffer into blocks (see
+ * ProcessingPluginInterface::processingOptions()) and processes them with
+ * a work-stealing ChunkedExecutor. The output goes into a new layer added
+ * to the LayerManager right away, or into an existing layer, and finished
+ * blocks appear in it every kRefreshIntervalMs while the run continues.
+ * Blocks still being written may briefly show partial results.
+ *
+ * Results in an existing layer can be undone as one "Replace Layer Data"
+ * step. Cancelled and failed runs remove the new layer or restore the
+ * existing layer's data.
+ *
+ * Progress and results are reported through signals and through
+ * EventSystem (ProcessingStarted, ProcessingProgress, ProcessingFinished,
+ * ProcessingFailed and ProcessingCancelled, each carrying a QVariantMap
+ * with "jobId" and "operation").
+ *
+ * All public functions must be called on the GUI thread.
+ */
+class ProcessingService : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * @param parent Parent object
+     */
+    explicit ProcessingService(QObject* parent = nullptr);
+
+    /**
+     * @brief Destructor
+     */
+    ~ProcessingService();
+
+    /**
+     * @brief Get singleton instance
+     * @return ProcessingService instance
+     */
+    static ProcessingService* instance();
+
+    /**
+     * @brief Set layer manager receiving new output layers
+     * @param layerManager Layer manager
+     */
+    void setLayerManager(LayerManager* layerManager) { m_layerManager = layerManager; }
+
+    /**
+     * @brief Get the worker pool
+     * @return Thread pool shared by all jobs
+     */
+    QThreadPool* threadPool() { return &m_pool; }
+
+    /**
+     * @brief Start an operation of the first plugin providing it
+     * @param operation Operation name
+     * @param source Layer whose buffer is processed
+     * @param parameters Operation parameters
+     * @param target Layer receiving the output, or nullptr for a new layer
+     * @param errorMessage Receives the reason if the job cannot start
+     * @return Job id, or 0 if the job cannot start
+     */
+    int run(const QString& operation, Layer* source, const QVariantMap& parameters = QVariantMap(),
+            Layer* target = nullptr, QString* errorMessage = nullptr);
+
+    /**
+     * @brief Start an operation of a plugin
+     * @param plugin Processing plugin
+     * @param operation Operation name
+     * @param source Layer whose buffer is processed
+     * @param parameters Operation parameters
+     * @param target Layer receiving the output, or nullptr for a new layer
+     * @param errorMessage Receives the reason if the job cannot start
+     * @return Job id, or 0 if the job cannot start
+     */
+    int run(ProcessingPluginInterface* plugin, const QString& operation, Layer* source,
+            const QVariantMap& parameters = QVariantMap(), Layer* target = nullptr,
+            QString* errorMessage = nullptr);
+
+    /**
+     * @brief Cancel a running job
+     * @param jobId Job id
+     */
+    void cancel(int jobId);
+
+    /**
+     * @brief Cancel all running jobs
+     */
+    void cancelAll();
+
+    /**
+     * @brief Cancel all jobs and wait for the workers to stop
+     */
+    void shutdown();
+
+    /**
+     * @brief Check if a job is still running
+     * @param jobId Job id
+     * @return true if running
+     */
+    bool isRunning(int jobId) const;
+
+    /**
+     * @brief Get number of running jobs
+     * @return Running job count
+     */
+    int runningCount() const;
+
+    /**
+     * @brief Get the output layer of a job
+     * @param jobId Job id
+     * @return Layer, or nullptr if the job is not running
+     */
+    Layer* targetLayer(int jobId) const;
+
+signals:
+    /**
+     * @brief Emitted when a job started
+     * @param jobId Job id
+     * @param operation Operation name
+     * @param target Output layer
+     */
+    void jobStarted(int jobId, const QString& operation, Layer* target);
+
+    /**
+     * @brief Emitted when a job made progress
+     * @param jobId Job id
+     * @param operation Operation name
+     * @param percent Percentage (0 - 100)
+     */
+    void jobProgress(int jobId, const QString& operation, int percent);
+
+    /**
+     * @brief Emitted when a job completed
+     * @param jobId Job id
+     * @param operation Operation name
+     * @param target Output layer
+     */
+    void jobFinished(int jobId, const QString& operation, Layer* target);
+
+    /**
+     * @brief Emitted when a job failed
+     * @param jobId Job id
+     * @param operation Operation name
+     * @param errorMessage Reason
+     */
+    void jobFailed(int jobId, const QString& operation, const QString& errorMessage);
+
+    /**
+     * @brief Emitted when a job was cancelled
+     * @param jobId Job id
+     * @param operation Operation name
+     */
+    void jobCancelled(int jobId, const QString& operation);
+
+private:
+    // Interval at which finished blocks are shown
+    static constexpr int kRefreshIntervalMs = 100;
+
+    /**
+     * @brief State of a running job (GUI thread)
+     */
+    struct Job
+    {
+        int id = 0;
+        QString operation;
+        QPointer<Layer> target;
+        bool newLayer = false;
+        bool cancelled = false;
+        DataBuffer output;
+        std::unique_ptr<SetLayerBufferCommand> command;  // Replaces existing layer data
+        std::unique_ptr<ChunkedExecutor> executor;
+        qint64 shownBlocks = 0;
+        int progress = 0;
+    };
+
+    /**
+     * @brief Show finished blocks of all jobs and report progress
+     */
+    void refreshJobs();
+
+    /**
+     * @brief Show the job's finished blocks in its layer
+     * @param job Job
+     */
+    void showOutput(Job& job);
+
+    /**
+     * @brief Complete a job after its last worker stopped
+     * @param jobId Job id
+     */
+    void finishJob(int jobId);
+
+    /**
+     * @brief Remove a new output layer or restore the target's data
+     * @param job Job
+     */
+    void revertOutput(Job& job);
+
+    /**
+     * @brief Record a block error (worker thread)
+     * @param jobId Job id
+     * @param errorMessage Reason
+     */
+    void setJobError(int jobId, const QString& errorMessage);
+
+    /**
+     * @brief Publish a processing event
+     * @param eventType Event type
+     * @param jobId Job id
+     * @param operation Operation name
+     * @param extra Additional entries
+     */
+    void publish(CustomEventType eventType, int jobId, const QString& operation,
+                 const QVariantMap& extra = QVariantMap());
+
+private:
+    static ProcessingService* s_instance;
+
+    QThreadPool m_pool;
+    QPointer<LayerManager> m_layerManager;
+    QTimer m_refreshTimer;
+
+    // Running jobs (GUI thread only)
+    QHash<int, std::shared_ptr<Job>> m_jobs;
+    int m_nextJobId;
+
+    // First error per job, written by workers
+    QMutex m_errorsMutex;
+    QHash<int, QString> m_errors;
+};
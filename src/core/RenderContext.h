@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QMatrix4x4>
+#include <QRectF>
+#include <QSize>
+
+class FrameArena;
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+class QOpenGLFunctions;
+
+/**
+ * @brief Per-frame render state passed to Layer::render()
+ *
+ * The viewer fills one of these for every frame and hands it to each
+ * visible layer as the opaque render context. The GL context is current
+ * for the whole duration of the render call.
+ *
+ * Scratch data needed only while drawing belongs in the arena rather
+ * than in QVector/QSet temporaries, so that a steady frame does not
+ * allocate. Arena memory is released when the frame ends.
+ */
+struct RenderContext
+{
+    QOpenGLContext* glContext = nullptr;          ///< Current OpenGL context
+    QOpenGLFunctions* gl = nullptr;               ///< OpenGL functions for the context
+    QOpenGLExtraFunctions* instancing = nullptr;  ///< Instanced drawing functions, or nullptr if unsupported
+    QMatrix4x4 projectionMatrix;                  ///< Projection matrix
+    QMatrix4x4 viewMatrix;                        ///< View matrix
+    QRectF viewRect;                              ///< Visible area in world coordinates (2D)
+    QSize viewportSize;                           ///< Viewport size in pixels
+    float zoomLevel = 1.0f;                       ///< Screen pixels per world unit
+    bool is3D = false;                            ///< true when rendering in 3D view mode
+    bool interactive = false;                     ///< true while the view is being moved; layers may trade quality for speed
+    FrameArena* arena = nullptr;                  ///< Per-frame scratch memory, or nullptr outside the viewer
+
+    /**
+     * @brief Get combined view-projection matrix
+     * @return Projection * view
+     */
+    QMatrix4x4 viewProjectionMatrix() const { return projectionMatrix * viewMatrix; }
+};
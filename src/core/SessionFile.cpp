@@ -0,0 +1,739 @@
+#include "SessionFile.h"
+#include "DataLoader.h"
+#include "ImageLayer.h"
+#include "LabelsLayer.h"
+#include "LayerManager.h"
+#include "PointsLayer.h"
+#include "SimpleLayer.h"
+#include "TileSource.h"
+#include "TiledImageLayer.h"
+#include "TracksLayer.h"
+#include "VectorsLayer.h"
+#include "VolumeLayer.h"
+#include "../utils/Profiler.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const char kMagic[8] = {'T', 'G', 'U', 'I', 'S', 'E', 'S', 'S'};
+const quint32 kFormatVersion = 1;
+
+// Header size and chunk alignment
+const qint64 kPageSize = 4096;
+
+// Chunk data is written in pieces of this size
+const qint64 kWriteBlockSize = 64ll * 1024 * 1024;
+
+// qCompress works on int-sized buffers; larger chunks are stored as is
+const qint64 kMaxCompressedChunk = 256ll * 1024 * 1024;
+
+// Fast zlib level; session saves are dominated by data volume
+const int kCompressionLevel = 1;
+
+// Unreferenced bytes tolerated before a save rewrites the whole file
+const qint64 kMinCompactBytes = 64ll * 1024 * 1024;
+
+/**
+ * @brief Contents of the header page
+ */
+struct Header
+{
+    QUuid fileId;
+    qint64 indexOffset = 0;
+    qint64 indexSize = 0;
+    quint16 indexChecksum = 0;
+};
+
+void setError(QString* errorMessage, const QString& message)
+{
+    if (errorMessage) {
+        *errorMessage = message;
+    }
+}
+
+QByteArray encodeHeader(const Header& header)
+{
+    QByteArray page(int(kPageSize), '\0');
+    QDataStream out(&page, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(kMagic, sizeof(kMagic));
+    out << kFormatVersion << quint32(0) << header.indexOffset << header.indexSize << header.indexChecksum;
+    const QByteArray id = header.fileId.toRfc4122();
+    out.writeRawData(id.constData(), id.size());
+    return page;
+}
+
+bool decodeHeader(const char* data, qint64 size, Header* header)
+{
+    if (size < kPageSize || std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+        return false;
+    }
+
+    QDataStream in(QByteArray::fromRawData(data, int(kPageSize)));
+    in.setByteOrder(QDataStream::LittleEndian);
+    in.skipRawData(sizeof(kMagic));
+
+    quint32 version = 0;
+    quint32 flags = 0;
+    in >> version >> flags >> header->indexOffset >> header->indexSize >> header->indexChecksum;
+    char id[16];
+    in.readRawData(id, sizeof(id));
+    header->fileId = QUuid::fromRfc4122(QByteArray(id, sizeof(id)));
+    return in.status() == QDataStream::Ok && version == kFormatVersion;
+}
+
+bool writeAll(QIODevice* device, const uchar* data, qint64 size)
+{
+    while (size > 0) {
+        const qint64 written = device->write(reinterpret_cast<const char*>(data), qMin(size, kWriteBlockSize));
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Writes elements in C order without copying contiguous runs
+bool writeElements(QIODevice* device, const DataBuffer& buffer)
+{
+    if (buffer.isContiguous()) {
+        return writeAll(device, buffer.constData(), buffer.byteSize());
+    }
+    if (buffer.ndim() <= 1) {
+        const DataBuffer copy = buffer.copy();
+        return writeAll(device, copy.constData(), copy.byteSize());
+    }
+    for (qint64 i = 0; i < buffer.shape(0); ++i) {
+        if (!writeElements(device, buffer.slice(0, i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Layer* createLayer(const QString& className, const QString& name)
+{
+    if (className == QLatin1String("ImageLayer")) {
+        return new ImageLayer(name);
+    }
+    if (className == QLatin1String("TiledImageLayer")) {
+        return new TiledImageLayer(name);
+    }
+    if (className == QLatin1String("PointsLayer")) {
+        return new PointsLayer(name);
+    }
+    if (className == QLatin1String("VectorsLayer")) {
+        return new VectorsLayer(name);
+    }
+    if (className == QLatin1String("TracksLayer")) {
+        return new TracksLayer(name);
+    }
+    if (className == QLatin1String("LabelsLayer")) {
+        return new LabelsLayer(name);
+    }
+    if (className == QLatin1String("VolumeLayer")) {
+        return new VolumeLayer(name);
+    }
+    if (className == QLatin1String("SimpleLayer")) {
+        return new SimpleLayer(name);
+    }
+    return nullptr;
+}
+
+bool applyBuffer(Layer* layer, const DataBuffer& buffer)
+{
+    if (TiledImageLayer* tiled = qobject_cast<TiledImageLayer*>(layer)) {
+        auto source = std::make_shared<BufferTileSource>(buffer);
+        if (source->imageSize().isEmpty()) {
+            return false;
+        }
+        tiled->setTileSource(source);
+        return true;
+    }
+    return layer->setBuffer(buffer);
+}
+
+QJsonArray vectorToJson(const QVector3D& vector)
+{
+    return QJsonArray{vector.x(), vector.y(), vector.z()};
+}
+
+QVector3D vectorFromJson(const QJsonValue& value)
+{
+    const QJsonArray array = value.toArray();
+    return QVector3D(float(array.at(0).toDouble()), float(array.at(1).toDouble()), float(array.at(2).toDouble()));
+}
+
+// Integer stored as a JSON number, or -1 if it is missing, negative,
+// fractional or too large to be exact
+qint64 jsonInteger(const QJsonValue& value)
+{
+    const double number = value.toDouble(-1.0);
+    return number >= 0.0 && number <= 9007199254740992.0 && number == std::floor(number) ? qint64(number) : -1;
+}
+
+} // namespace
+
+SessionFile::SessionFile()
+    : m_indexOffset(0)
+    , m_fileSize(0)
+    , m_nextChunkId(1)
+    , m_compress(false)
+{
+}
+
+SessionFile::~SessionFile() = default;
+
+bool SessionFile::isSessionFile(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray page = file.read(kPageSize);
+    Header header;
+    return decodeHeader(page.constData(), page.size(), &header);
+}
+
+void SessionFile::reset()
+{
+    m_fileName.clear();
+    m_fileId = QUuid();
+    m_indexOffset = 0;
+    m_fileSize = 0;
+    m_chunks.clear();
+    m_storedBuffers.clear();
+    m_nextChunkId = 1;
+}
+
+bool SessionFile::save(const QString& fileName, const LayerManager* layers, const SessionViewState& view,
+                       QString* errorMessage)
+{
+    PROFILE_SCOPE("SessionFile::save");
+    m_lastStats = SaveStats();
+    if (!layers) {
+        setError(errorMessage, "No layers to save");
+        return false;
+    }
+
+    const QFileInfo targetInfo(fileName);
+    const QString target = targetInfo.absoluteFilePath();
+
+    // Never replace a data file or anything else that is not a session
+    if (targetInfo.exists() && targetInfo.size() > 0 && !isSessionFile(target)) {
+        setError(errorMessage, QString("%1 exists and is not a session file; choose another name").arg(target));
+        return false;
+    }
+
+    // Append only to the file this session last read or wrote, and only
+    // if it has not been replaced since
+    bool incremental = false;
+    if (target == m_fileName) {
+        QFile existing(target);
+        if (existing.open(QIODevice::ReadOnly)) {
+            const QByteArray page = existing.read(kPageSize);
+            Header header;
+            incremental = decodeHeader(page.constData(), page.size(), &header) && header.fileId == m_fileId
+                          && header.indexOffset == m_indexOffset && existing.size() == m_fileSize;
+        }
+    }
+    if (incremental) {
+        qint64 referenced = kPageSize;
+        for (const Chunk& chunk : qAsConst(m_chunks)) {
+            referenced += chunk.storedSize;
+        }
+        const qint64 unreferenced = m_fileSize - referenced;
+        if (unreferenced > kMinCompactBytes && unreferenced > m_fileSize / 2) {
+            incremental = false;
+        }
+    }
+
+    std::unique_ptr<QFileDevice> device;
+    if (incremental) {
+        auto file = std::make_unique<QFile>(target);
+        if (!file->open(QIODevice::ReadWrite)) {
+            setError(errorMessage, QString("Cannot open %1: %2").arg(target, file->errorString()));
+            return false;
+        }
+        device = std::move(file);
+    } else {
+        // Nothing in the old file is reused; the header page is filled in last
+        reset();
+        auto file = std::make_unique<QSaveFile>(target);
+        if (!file->open(QIODevice::WriteOnly)) {
+            setError(errorMessage, QString("Cannot create %1: %2").arg(target, file->errorString()));
+            return false;
+        }
+        const QByteArray page(int(kPageSize), '\0');
+        if (file->write(page) != page.size()) {
+            setError(errorMessage, QString("Cannot write %1: %2").arg(target, file->errorString()));
+            return false;
+        }
+        device = std::move(file);
+    }
+    m_lastStats.incremental = incremental;
+
+    // Chunks referenced by the new index
+    QHash<int, Chunk> referenced;
+    QJsonArray layerArray;
+
+    const QList<Layer*> all = layers->layers();
+    for (const Layer* layer : all) {
+        QJsonObject entry;
+        entry["name"] = layer->name();
+        entry["class"] = QString::fromLatin1(layer->metaObject()->className());
+        entry["visible"] = layer->isVisible();
+        entry["opacity"] = double(layer->opacity());
+        entry["selected"] = layer->isSelected();
+        if (const ImageLayer* image = qobject_cast<const ImageLayer*>(layer)) {
+            if (image->hasScalarData()) {
+                entry["contrastLimits"] = QJsonArray{image->contrastLimits().first, image->contrastLimits().second};
+                entry["gamma"] = double(image->gamma());
+            }
+        } else if (const TiledImageLayer* tiled = qobject_cast<const TiledImageLayer*>(layer)) {
+            entry["position"] = QJsonArray{tiled->position().x(), tiled->position().y()};
+        } else if (const LabelsLayer* labels = qobject_cast<const LabelsLayer*>(layer)) {
+            entry["position"] = QJsonArray{labels->position().x(), labels->position().y()};
+        } else if (const VolumeLayer* volume = qobject_cast<const VolumeLayer*>(layer)) {
+            entry["position"] = QJsonArray{volume->position().x(), volume->position().y()};
+            entry["spacing"] = vectorToJson(volume->spacing());
+            entry["renderMode"] = int(volume->renderMode());
+            entry["contrastLimits"] = QJsonArray{volume->contrastLimits().first, volume->contrastLimits().second};
+            entry["isoValue"] = volume->isoValue();
+        }
+
+        const DataBuffer buffer = layerBuffer(layer);
+        if (!buffer.isNull()) {
+            int id = storedChunk(buffer);
+            if (id >= 0) {
+                ++m_lastStats.chunksReused;
+            } else {
+                Chunk chunk;
+                if (!writeBufferChunk(device.get(), buffer, &chunk)) {
+                    setError(errorMessage, QString("Cannot write data of layer %1: %2")
+                                               .arg(layer->name(), device->errorString()));
+                    return false;
+                }
+                id = chunk.id;
+                m_storedBuffers.append(StoredBuffer{buffer.storage(), buffer.offset(), buffer.version(),
+                                                    buffer.dtype(), buffer.shape(), buffer.strides(), id});
+            }
+            referenced.insert(id, m_chunks.value(id));
+
+            QJsonArray shape;
+            for (qint64 extent : buffer.shape()) {
+                shape.append(double(extent));
+            }
+            QJsonObject data;
+            data["chunk"] = id;
+            data["dtype"] = dataTypeName(buffer.dtype());
+            data["shape"] = shape;
+            entry["data"] = data;
+        } else {
+            // Layers without array data, e.g. image pyramids, go through QVariant
+            const QVariant value = layer->data();
+            if (value.isValid()) {
+                QByteArray bytes;
+                QDataStream out(&bytes, QIODevice::WriteOnly);
+                out.setVersion(QDataStream::Qt_5_12);
+                out << value;
+
+                Chunk chunk;
+                if (!writeChunk(device.get(), bytes, true, &chunk)) {
+                    setError(errorMessage, QString("Cannot write data of layer %1: %2")
+                                               .arg(layer->name(), device->errorString()));
+                    return false;
+                }
+                referenced.insert(chunk.id, chunk);
+                entry["variant"] = chunk.id;
+            } else {
+                qWarning() << "SessionFile: layer" << layer->name() << "has no data that can be saved";
+            }
+        }
+        layerArray.append(entry);
+    }
+
+    QJsonObject viewObject;
+    viewObject["mode"] = view.viewMode;
+    viewObject["zoom"] = double(view.zoomLevel);
+    viewObject["center"] = vectorToJson(view.viewCenter);
+    viewObject["rotation"] = vectorToJson(view.rotation);
+
+    QJsonObject manifest;
+    manifest["version"] = int(kFormatVersion);
+    manifest["view"] = viewObject;
+    manifest["layers"] = layerArray;
+
+    Chunk manifestChunk;
+    if (!writeChunk(device.get(), QJsonDocument(manifest).toJson(QJsonDocument::Compact), true, &manifestChunk)) {
+        setError(errorMessage, QString("Cannot write %1: %2").arg(target, device->errorString()));
+        return false;
+    }
+    referenced.insert(manifestChunk.id, manifestChunk);
+
+    QJsonArray chunkArray;
+    for (const Chunk& chunk : qAsConst(referenced)) {
+        QJsonObject object;
+        object["id"] = chunk.id;
+        object["offset"] = double(chunk.offset);
+        object["storedSize"] = double(chunk.storedSize);
+        object["size"] = double(chunk.size);
+        object["compression"] = chunk.compressed ? "zlib" : "none";
+        chunkArray.append(object);
+    }
+    QJsonObject index;
+    index["chunks"] = chunkArray;
+    index["manifest"] = manifestChunk.id;
+    const QByteArray indexData = QJsonDocument(index).toJson(QJsonDocument::Compact);
+
+    Header header;
+    header.fileId = incremental ? m_fileId : QUuid::createUuid();
+    header.indexOffset = alignEnd(device.get());
+    header.indexSize = indexData.size();
+    header.indexChecksum = qChecksum(indexData.constData(), uint(indexData.size()));
+    if (header.indexOffset < 0 || device->write(indexData) != indexData.size()) {
+        setError(errorMessage, QString("Cannot write %1: %2").arg(target, device->errorString()));
+        return false;
+    }
+    const qint64 fileSize = header.indexOffset + header.indexSize;
+
+    // The new header makes the session visible; everything it points to
+    // is written first
+    const QByteArray headerPage = encodeHeader(header);
+    if (!device->flush() || !device->seek(0) || device->write(headerPage) != headerPage.size()) {
+        setError(errorMessage, QString("Cannot write %1: %2").arg(target, device->errorString()));
+        return false;
+    }
+
+    bool committed = false;
+    if (incremental) {
+        committed = device->flush();
+        device->close();
+    } else {
+        committed = static_cast<QSaveFile*>(device.get())->commit();
+    }
+    if (!committed) {
+        setError(errorMessage, QString("Cannot write %1: %2").arg(target, device->errorString()));
+        reset();
+        return false;
+    }
+    m_lastStats.bytesWritten += indexData.size() + headerPage.size();
+
+    m_fileName = target;
+    m_fileId = header.fileId;
+    m_indexOffset = header.indexOffset;
+    m_fileSize = fileSize;
+    m_chunks = referenced;
+
+    // Forget buffers whose chunk was dropped or whose storage is gone
+    for (int i = m_storedBuffers.size() - 1; i >= 0; --i) {
+        const StoredBuffer& stored = m_storedBuffers[i];
+        if (!m_chunks.contains(stored.chunk) || stored.storage.expired()) {
+            m_storedBuffers.remove(i);
+        }
+    }
+    return true;
+}
+
+bool SessionFile::load(const QString& fileName, QList<Layer*>* layers, SessionViewState* view,
+                       QString* errorMessage)
+{
+    PROFILE_SCOPE("SessionFile::load");
+    if (!layers) {
+        setError(errorMessage, "No layer list given");
+        return false;
+    }
+
+    std::shared_ptr<MappedFileStorage> mapping = MappedFileStorage::map(fileName, errorMessage);
+    if (!mapping) {
+        return false;
+    }
+
+    const char* base = reinterpret_cast<const char*>(mapping->constData());
+    const qint64 size = mapping->size();
+
+    Header header;
+    if (!decodeHeader(base, size, &header)) {
+        setError(errorMessage, QString("Not a session file or unsupported version: %1").arg(fileName));
+        return false;
+    }
+    if (header.indexOffset < kPageSize || header.indexSize <= 0 || header.indexOffset + header.indexSize > size) {
+        setError(errorMessage, QString("Truncated session file: %1").arg(fileName));
+        return false;
+    }
+
+    const QByteArray indexData = QByteArray::fromRawData(base + header.indexOffset, int(header.indexSize));
+    if (qChecksum(indexData.constData(), uint(indexData.size())) != header.indexChecksum) {
+        setError(errorMessage, QString("Corrupt session index: %1").arg(fileName));
+        return false;
+    }
+
+    QJsonParseError parseError;
+    const QJsonObject index = QJsonDocument::fromJson(indexData, &parseError).object();
+    if (parseError.error != QJsonParseError::NoError) {
+        setError(errorMessage, QString("Corrupt session index: %1").arg(parseError.errorString()));
+        return false;
+    }
+
+    QHash<int, Chunk> chunks;
+    int nextChunkId = 1;
+    for (const QJsonValue& value : index["chunks"].toArray()) {
+        const QJsonObject object = value.toObject();
+        Chunk chunk;
+        chunk.id = object["id"].toInt();
+        chunk.offset = jsonInteger(object["offset"]);
+        chunk.storedSize = jsonInteger(object["storedSize"]);
+        chunk.size = jsonInteger(object["size"]);
+        chunk.compressed = object["compression"].toString() == QLatin1String("zlib");
+        if (chunk.offset < kPageSize || chunk.offset > size || chunk.storedSize < 0 || chunk.size < 0
+            || chunk.storedSize > size - chunk.offset
+            || (chunk.compressed && chunk.storedSize > kMaxCompressedChunk)) {
+            setError(errorMessage, QString("Chunk %1 lies outside the session file").arg(chunk.id));
+            return false;
+        }
+        chunks.insert(chunk.id, chunk);
+        nextChunkId = qMax(nextChunkId, chunk.id + 1);
+    }
+
+    // Small chunks (manifest, QVariant data); data chunks are viewed in place
+    auto chunkBytes = [&](const Chunk& chunk) {
+        if (chunk.storedSize > std::numeric_limits<int>::max()) {
+            return QByteArray();
+        }
+        const QByteArray stored = QByteArray::fromRawData(base + chunk.offset, int(chunk.storedSize));
+        return chunk.compressed ? qUncompress(stored) : QByteArray(stored.constData(), stored.size());
+    };
+
+    const int manifestId = index["manifest"].toInt(-1);
+    if (!chunks.contains(manifestId)) {
+        setError(errorMessage, QString("Session file has no manifest: %1").arg(fileName));
+        return false;
+    }
+    const QJsonObject manifest = QJsonDocument::fromJson(chunkBytes(chunks.value(manifestId)), &parseError).object();
+    if (parseError.error != QJsonParseError::NoError) {
+        setError(errorMessage, QString("Corrupt session manifest: %1").arg(parseError.errorString()));
+        return false;
+    }
+
+    if (view) {
+        const QJsonObject viewObject = manifest["view"].toObject();
+        view->viewMode = viewObject["mode"].toInt();
+        view->zoomLevel = float(viewObject["zoom"].toDouble(1.0));
+        view->viewCenter = vectorFromJson(viewObject["center"]);
+        view->rotation = vectorFromJson(viewObject["rotation"]);
+    }
+
+    QVector<StoredBuffer> storedBuffers;
+    layers->clear();
+    for (const QJsonValue& value : manifest["layers"].toArray()) {
+        const QJsonObject entry = value.toObject();
+        const QString name = entry["name"].toString();
+        const QString className = entry["class"].toString();
+
+        Layer* layer = createLayer(className, name);
+        if (!layer) {
+            qWarning() << "SessionFile: skipping layer" << name << "of unknown class" << className;
+            continue;
+        }
+
+        if (entry.contains("data")) {
+            const QJsonObject data = entry["data"].toObject();
+            const int id = data["chunk"].toInt(-1);
+            const DataType type = dataTypeFromName(data["dtype"].toString());
+            QVector<qint64> shape;
+            bool validShape = !data["shape"].toArray().isEmpty();
+            for (const QJsonValue& extent : data["shape"].toArray()) {
+                shape.append(jsonInteger(extent));
+                validShape = validShape && shape.last() > 0;
+            }
+
+            // The manifest is untrusted: the layout must fit its chunk
+            // before a view is built over the mapping
+            qint64 bytes = 0;
+            validShape = validShape && type != DataType::Unknown && DataBuffer::checkedByteSize(type, shape, &bytes);
+
+            DataBuffer buffer;
+            if (validShape && chunks.contains(id) && bytes <= chunks.value(id).size) {
+                const Chunk chunk = chunks.value(id);
+                std::shared_ptr<BufferStorage> storage = mapping;
+                qint64 offset = chunk.offset;
+                if (chunk.compressed) {
+                    // The decompressed array is not shared, so nothing is copied
+                    storage = std::make_shared<ByteArrayStorage>(chunkBytes(chunk), ByteArrayStorage::Writable);
+                    offset = 0;
+                }
+                if (offset <= storage->size() && bytes <= storage->size() - offset) {
+                    buffer = DataBuffer(type, shape, DataBuffer::contiguousStrides(type, shape), storage, offset);
+                }
+            }
+
+            if (!buffer.isNull() && applyBuffer(layer, buffer)) {
+                storedBuffers.append(StoredBuffer{buffer.storage(), buffer.offset(), buffer.version(),
+                                                  buffer.dtype(), buffer.shape(), buffer.strides(), id});
+            } else {
+                qWarning() << "SessionFile: cannot restore data of layer" << name;
+            }
+        } else if (entry.contains("variant")) {
+            const int id = entry["variant"].toInt(-1);
+            if (chunks.contains(id)) {
+                QDataStream in(chunkBytes(chunks.value(id)));
+                in.setVersion(QDataStream::Qt_5_12);
+                QVariant data;
+                in >> data;
+                layer->setData(data);
+            }
+        }
+
+        if (ImageLayer* image = qobject_cast<ImageLayer*>(layer)) {
+            const QJsonArray limits = entry["contrastLimits"].toArray();
+            if (image->hasScalarData() && limits.size() == 2) {
+                image->setContrastLimits(limits.at(0).toDouble(), limits.at(1).toDouble());
+                image->setGamma(float(entry["gamma"].toDouble(1.0)));
+            }
+        } else if (TiledImageLayer* tiled = qobject_cast<TiledImageLayer*>(layer)) {
+            const QJsonArray position = entry["position"].toArray();
+            tiled->setPosition(QPointF(position.at(0).toDouble(), position.at(1).toDouble()));
+        } else if (LabelsLayer* labels = qobject_cast<LabelsLayer*>(layer)) {
+            const QJsonArray position = entry["position"].toArray();
+            labels->setPosition(QPointF(position.at(0).toDouble(), position.at(1).toDouble()));
+        } else if (VolumeLayer* volume = qobject_cast<VolumeLayer*>(layer)) {
+            const QJsonArray position = entry["position"].toArray();
+            const QJsonArray limits = entry["contrastLimits"].toArray();
+            volume->setPosition(QPointF(position.at(0).toDouble(), position.at(1).toDouble()));
+            if (entry.contains("spacing")) {
+                volume->setSpacing(vectorFromJson(entry["spacing"]));
+            }
+            volume->setRenderMode(VolumeLayer::RenderMode(qBound(0, entry["renderMode"].toInt(), 2)));
+            if (limits.size() == 2) {
+                volume->setContrastLimits(limits.at(0).toDouble(), limits.at(1).toDouble());
+            }
+            if (entry.contains("isoValue")) {
+                volume->setIsoValue(entry["isoValue"].toDouble());
+            }
+        }
+        layer->setVisible(entry["visible"].toBool(true));
+        layer->setOpacity(float(entry["opacity"].toDouble(1.0)));
+        layer->setSelected(entry["selected"].toBool(false));
+        layers->append(layer);
+    }
+
+    m_fileName = QFileInfo(fileName).absoluteFilePath();
+    m_fileId = header.fileId;
+    m_indexOffset = header.indexOffset;
+    m_fileSize = size;
+    m_chunks = chunks;
+    m_storedBuffers = storedBuffers;
+    m_nextChunkId = nextChunkId;
+    return true;
+}
+
+DataBuffer SessionFile::layerBuffer(const Layer* layer)
+{
+    if (const TiledImageLayer* tiled = qobject_cast<const TiledImageLayer*>(layer)) {
+        auto source = std::dynamic_pointer_cast<BufferTileSource>(tiled->tileSource());
+        return source ? source->buffer() : DataBuffer();
+    }
+    return layer->buffer();
+}
+
+int SessionFile::storedChunk(const DataBuffer& buffer) const
+{
+    for (const StoredBuffer& stored : m_storedBuffers) {
+        if (stored.storage.lock() == buffer.storage() && stored.offset == buffer.offset()
+            && stored.version == buffer.version() && stored.type == buffer.dtype()
+            && stored.shape == buffer.shape() && stored.strides == buffer.strides()
+            && m_chunks.contains(stored.chunk)) {
+            return stored.chunk;
+        }
+    }
+    return -1;
+}
+
+bool SessionFile::writeChunk(QFileDevice* device, const QByteArray& data, bool compress, Chunk* chunk)
+{
+    const qint64 offset = alignEnd(device);
+    if (offset < 0) {
+        return false;
+    }
+
+    QByteArray stored = data;
+    bool compressed = false;
+    if (compress && !data.isEmpty() && data.size() <= kMaxCompressedChunk) {
+        const QByteArray packed = qCompress(data, kCompressionLevel);
+        if (packed.size() < data.size()) {
+            stored = packed;
+            compressed = true;
+        }
+    }
+
+    if (!writeAll(device, reinterpret_cast<const uchar*>(stored.constData()), stored.size())) {
+        return false;
+    }
+
+    chunk->id = m_nextChunkId++;
+    chunk->offset = offset;
+    chunk->storedSize = stored.size();
+    chunk->size = data.size();
+    chunk->compressed = compressed;
+    m_chunks.insert(chunk->id, *chunk);
+
+    ++m_lastStats.chunksWritten;
+    m_lastStats.bytesWritten += stored.size();
+    return true;
+}
+
+bool SessionFile::writeBufferChunk(QFileDevice* device, const DataBuffer& buffer, Chunk* chunk)
+{
+    if (m_compress && buffer.byteSize() <= kMaxCompressedChunk) {
+        const DataBuffer contiguous = buffer.isContiguous() ? buffer : buffer.copy();
+        const QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(contiguous.constData()),
+                                                         int(contiguous.byteSize()));
+        return writeChunk(device, bytes, true, chunk);
+    }
+
+    const qint64 offset = alignEnd(device);
+    if (offset < 0 || !writeElements(device, buffer)) {
+        return false;
+    }
+
+    chunk->id = m_nextChunkId++;
+    chunk->offset = offset;
+    chunk->storedSize = buffer.byteSize();
+    chunk->size = buffer.byteSize();
+    chunk->compressed = false;
+    m_chunks.insert(chunk->id, *chunk);
+
+    ++m_lastStats.chunksWritten;
+    m_lastStats.bytesWritten += buffer.byteSize();
+    return true;
+}
+
+qint64 SessionFile::alignEnd(QFileDevice* device)
+{
+    const qint64 end = device->size();
+    if (!device->seek(end)) {
+        return -1;
+    }
+
+    const qint64 offset = (end + kPageSize - 1) / kPageSize * kPageSize;
+    if (offset > end) {
+        const QByteArray padding(int(offset - end), '\0');
+        if (device->write(padding) != padding.size()) {
+            return -1;
+        }
+    }
+    return offset;
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include "DataBuffer.h"
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QUuid>
+#include <QVector>
+#include <QVector3D>
+#include <memory>
+
+class QFileDevice;
+class Layer;
+class LayerManager;
+
+/**
+ * @brief Persisted viewer state
+ */
+struct SessionViewState
+{
+    int viewMode = 0;                   ///< ViewerWidget::ViewMode
+    float zoomLevel = 1.0f;             ///< Zoom level
+    QVector3D viewCenter;               ///< View center
+    QVector3D rotation;                 ///< Rotation in degrees per axis
+};
+
+/**
+ * @brief Session file: layer stack, view state and layer data
+ *
+ * A session is a chunked binary container. A 4 KiB header page points to
+ * a JSON index listing every chunk with its offset, size and compression;
+ * a JSON manifest chunk describes the view and the layers, and each
+ * layer's data is a chunk of its own. Data chunks start on page
+ * boundaries and are stored uncompressed by default, so reopening a
+ * session maps the file and layers view their chunks in place: nothing
+ * is read until it is displayed.
+ *
+ * Saving to the file the session was last loaded from or saved to is
+ * incremental. Layers whose buffers are unchanged since then (same
+ * storage, same modification version) keep their chunks; only new or
+ * modified data, the manifest and the index are appended, and the header
+ * is rewritten last, so an interrupted save leaves the previous session
+ * intact. When more than half of the file is unreferenced the session is
+ * rewritten in full through a temporary file.
+ *
+ * An instance tracks one session and is used from the GUI thread.
+ */
+class SessionFile
+{
+public:
+    /**
+     * @brief Counts of the last save
+     */
+    struct SaveStats
+    {
+        int chunksWritten = 0;      ///< Chunks written
+        int chunksReused = 0;       ///< Unchanged chunks kept in place
+        qint64 bytesWritten = 0;    ///< Bytes written
+        bool incremental = false;   ///< true if appended to the existing file
+    };
+
+    // File suffix used by the file dialogs
+    static constexpr const char* kFileSuffix = "tgs";
+
+    /**
+     * @brief Constructor
+     */
+    SessionFile();
+
+    /**
+     * @brief Destructor
+     */
+    ~SessionFile();
+
+    SessionFile(const SessionFile&) = delete;
+    SessionFile& operator=(const SessionFile&) = delete;
+
+    /**
+     * @brief Check if a file is a session file
+     * @param fileName File name
+     * @return true if the file starts with a session header
+     */
+    static bool isSessionFile(const QString& fileName);
+
+    /**
+     * @brief Save layers and view state
+     *
+     * Refuses to replace an existing file that is not a session.
+     *
+     * @param fileName Session file
+     * @param layers Layer stack
+     * @param view View state
+     * @param errorMessage Receives the reason on failure (may be nullptr)
+     * @return true if successful
+     */
+    bool save(const QString& fileName, const LayerManager* layers, const SessionViewState& view,
+              QString* errorMessage = nullptr);
+
+    /**
+     * @brief Load a session
+     *
+     * Layer data stays mapped from the file. The caller takes ownership
+     * of the layers, typically by adding them to a LayerManager.
+     *
+     * @param fileName Session file
+     * @param layers Receives the layers in stack order
+     * @param view Receives the view state (may be nullptr)
+     * @param errorMessage Receives the reason on failure (may be nullptr)
+     * @return true if successful
+     */
+    bool load(const QString& fileName, QList<Layer*>* layers, SessionViewState* view,
+              QString* errorMessage = nullptr);
+
+    /**
+     * @brief Enable zlib compression of layer data chunks
+     *
+     * Compressed chunks are smaller but are decompressed into memory on
+     * load instead of being mapped. The manifest is always compressed.
+     *
+     * @param enabled true to compress
+     */
+    void setCompressionEnabled(bool enabled) { m_compress = enabled; }
+
+    /**
+     * @brief Check if layer data is compressed
+     * @return true if enabled
+     */
+    bool isCompressionEnabled() const { return m_compress; }
+
+    /**
+     * @brief Get file of the current session
+     * @return Absolute file name, empty before the first load or save
+     */
+    QString fileName() const { return m_fileName; }
+
+    /**
+     * @brief Get counts of the last save
+     * @return Save statistics
+     */
+    const SaveStats& lastSaveStats() const { return m_lastStats; }
+
+    /**
+     * @brief Forget the current session
+     */
+    void reset();
+
+private:
+    /**
+     * @brief Location of a chunk
+     */
+    struct Chunk
+    {
+        int id = 0;
+        qint64 offset = 0;
+        qint64 storedSize = 0;
+        qint64 size = 0;
+        bool compressed = false;
+    };
+
+    /**
+     * @brief Layer buffer known to be stored in a chunk of the session
+     */
+    struct StoredBuffer
+    {
+        std::weak_ptr<BufferStorage> storage;
+        qint64 offset;
+        quint64 version;
+        DataType type;
+        QVector<qint64> shape;
+        QVector<qint64> strides;
+        int chunk;
+    };
+
+    /**
+     * @brief Get the data buffer a layer is saved from
+     * @param layer Layer
+     * @return Buffer, null if the layer has no array data
+     */
+    static DataBuffer layerBuffer(const Layer* layer);
+
+    /**
+     * @brief Find the chunk holding an unchanged buffer
+     * @param buffer Buffer
+     * @return Chunk id, or -1 if the buffer must be written
+     */
+    int storedChunk(const DataBuffer& buffer) const;
+
+    /**
+     * @brief Append a chunk at the next page boundary
+     * @param device Output file
+     * @param data Chunk contents
+     * @param compress true to zlib-compress
+     * @param chunk Receives the location
+     * @return true if written
+     */
+    bool writeChunk(QFileDevice* device, const QByteArray& data, bool compress, Chunk* chunk);
+
+    /**
+     * @brief Append a buffer's elements as a chunk, in C order
+     * @param device Output file
+     * @param buffer Buffer
+     * @param chunk Receives the location
+     * @return true if written
+     */
+    bool writeBufferChunk(QFileDevice* device, const DataBuffer& buffer, Chunk* chunk);
+
+    /**
+     * @brief Seek to the next page boundary at the end of the file
+     * @param device Output file
+     * @return Offset, or -1 on failure
+     */
+    static qint64 alignEnd(QFileDevice* device);
+
+private:
+    QString m_fileName;
+    QUuid m_fileId;
+    qint64 m_indexOffset;
+    qint64 m_fileSize;
+    QHash<int, Chunk> m_chunks;
+    QVector<StoredBuffer> m_storedBuffers;
+    int m_nextChunkId;
+    bool m_compress;
+    SaveStats m_lastStats;
+};
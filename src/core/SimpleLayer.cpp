@@ -2,7 +2,8 @@
 
 SimpleLayer::SimpleLayer(const QString& name, QObject* parent)
     : Layer(name, LayerType::Image, parent)
-    , m_bounds({-100.0f, -100.0f, 100.0f, 100.0f})
+    , m_bufferVersion(0)
+    , m_bounds(-100.0f, -100.0f, 100.0f, 100.0f)
 {
 }
 
@@ -12,18 +13,45 @@ SimpleLayer::~SimpleLayer()
 
 QVariant SimpleLayer::data() const
 {
+    if (!m_buffer.isNull()) {
+        return QVariant::fromValue(m_buffer);
+    }
     return m_data;
 }
 
 void SimpleLayer::setData(const QVariant& data)
 {
-    if (m_data != data) {
-        m_data = data;
-        emit changed();
+    if (data.userType() == qMetaTypeId<DataBuffer>()) {
+        setBuffer(data.value<DataBuffer>());
+        return;
+    }
+
+    // Changes are published through dataVersion(); comparing the old and
+    // new values would scan the whole payload for large arrays
+    m_data = data;
+    m_buffer = DataBuffer();
+    markDataChanged();
+}
+
+DataBuffer SimpleLayer::buffer() const
+{
+    return m_buffer;
+}
+
+bool SimpleLayer::setBuffer(const DataBuffer& buffer)
+{
+    if (buffer.isSameView(m_buffer) && buffer.version() == m_bufferVersion) {
+        return true;
     }
+
+    m_buffer = buffer;
+    m_bufferVersion = buffer.version();
+    m_data = QVariant();
+    markDataChanged();
+    return true;
 }
 
-QVector<float> SimpleLayer::bounds() const
+LayerBounds SimpleLayer::bounds() const
 {
     return m_bounds;
 }
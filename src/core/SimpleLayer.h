@@ -27,10 +27,14 @@ public:
     // Layer interface implementation
     QVariant data() const override;
     void setData(const QVariant& data) override;
-    QVector<float> bounds() const override;
+    DataBuffer buffer() const override;
+    bool setBuffer(const DataBuffer& buffer) override;
+    LayerBounds bounds() const override;
     void render(void* context) override;
 
 private:
     QVariant m_data;
-    QVector<float> m_bounds;
+    DataBuffer m_buffer;
+    quint64 m_bufferVersion;
+    LayerBounds m_bounds;
 };
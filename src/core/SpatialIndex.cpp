@@ -0,0 +1,220 @@
+#include "SpatialIndex.h"
+
+#include <QtMath>
+#include <algorithm>
+
+namespace {
+
+// Average number of points per cell after a build
+const int kPointsPerCell = 8;
+
+// Upper bound on the grid size along each axis
+const int kMaxCellsPerAxis = 4096;
+
+// Overflow size that never triggers a rebuild on its own
+const int kMinRebuildOverflow = 4096;
+
+} // namespace
+
+SpatialIndex::SpatialIndex()
+    : m_cellSize(1.0)
+    , m_columns(0)
+    , m_rows(0)
+    , m_overflowCount(0)
+    , m_count(0)
+{
+}
+
+void SpatialIndex::clear()
+{
+    m_origin = QPointF();
+    m_cellSize = 1.0;
+    m_columns = 0;
+    m_rows = 0;
+    m_cellStart.clear();
+    m_items.clear();
+    m_overflow.clear();
+    m_overflowCount = 0;
+    m_count = 0;
+}
+
+void SpatialIndex::build(const QVector<QVector3D>& points)
+{
+    clear();
+    if (points.isEmpty()) {
+        return;
+    }
+
+    float minX = points.at(0).x();
+    float minY = points.at(0).y();
+    float maxX = minX;
+    float maxY = minY;
+    for (const QVector3D& p : points) {
+        minX = qMin(minX, p.x());
+        minY = qMin(minY, p.y());
+        maxX = qMax(maxX, p.x());
+        maxY = qMax(maxY, p.y());
+    }
+
+    // Size cells for a few points each, over the longer axis if flat
+    const qreal width = qreal(maxX) - minX;
+    const qreal height = qreal(maxY) - minY;
+    const qreal longest = qMax(width, height);
+    const qreal cells = qMax(1, points.size() / kPointsPerCell);
+
+    if (longest <= 0.0) {
+        m_cellSize = 1.0;
+    } else if (width > 0.0 && height > 0.0) {
+        m_cellSize = qSqrt(width * height / cells);
+    } else {
+        m_cellSize = longest / cells;
+    }
+    m_cellSize = qMax(m_cellSize, longest / kMaxCellsPerAxis);
+    if (m_cellSize <= 0.0) {
+        m_cellSize = 1.0;
+    }
+
+    m_origin = QPointF(minX, minY);
+    m_columns = qMin(kMaxCellsPerAxis, int(width / m_cellSize) + 1);
+    m_rows = qMin(kMaxCellsPerAxis, int(height / m_cellSize) + 1);
+
+    // Counting sort of the ids by cell
+    const int cellCount = m_columns * m_rows;
+    QVector<int> cellOf(points.size());
+    m_cellStart.fill(0, cellCount + 1);
+
+    for (int i = 0; i < points.size(); ++i) {
+        const QVector3D& p = points.at(i);
+        const int cell = row(p.y()) * m_columns + column(p.x());
+        cellOf[i] = cell;
+        ++m_cellStart[cell + 1];
+    }
+
+    for (int cell = 0; cell < cellCount; ++cell) {
+        m_cellStart[cell + 1] += m_cellStart[cell];
+    }
+
+    QVector<int> next = m_cellStart;
+    m_items.resize(points.size());
+    for (int i = 0; i < points.size(); ++i) {
+        m_items[next[cellOf[i]]++] = i;
+    }
+
+    m_count = points.size();
+}
+
+void SpatialIndex::insert(int id, const QVector3D& point)
+{
+    if (m_columns == 0) {
+        // Start a single-cell grid; the owner rebuilds once it fills up
+        m_origin = QPointF(point.x(), point.y());
+        m_cellSize = 1.0;
+        m_columns = 1;
+        m_rows = 1;
+        m_cellStart.fill(0, 2);
+    }
+
+    const int cell = row(point.y()) * m_columns + column(point.x());
+    m_overflow[cell].append(id);
+    ++m_overflowCount;
+    ++m_count;
+}
+
+bool SpatialIndex::needsRebuild() const
+{
+    return m_overflowCount > qMax(kMinRebuildOverflow, m_items.size());
+}
+
+template<typename Visitor>
+void SpatialIndex::visitCells(const QRectF& rect, Visitor visit) const
+{
+    if (m_count == 0) {
+        return;
+    }
+
+    const int firstColumn = column(rect.left());
+    const int lastColumn = column(rect.right());
+    const int firstRow = row(rect.top());
+    const int lastRow = row(rect.bottom());
+
+    for (int r = firstRow; r <= lastRow; ++r) {
+        for (int c = firstColumn; c <= lastColumn; ++c) {
+            const int cell = r * m_columns + c;
+
+            if (cell + 1 < m_cellStart.size()) {
+                for (int i = m_cellStart[cell]; i < m_cellStart[cell + 1]; ++i) {
+                    visit(m_items[i]);
+                }
+            }
+
+            if (m_overflowCount > 0) {
+                auto it = m_overflow.constFind(cell);
+                if (it != m_overflow.constEnd()) {
+                    for (int id : *it) {
+                        visit(id);
+                    }
+                }
+            }
+        }
+    }
+}
+
+QVector<int> SpatialIndex::query(const QRectF& rect, const QVector<QVector3D>& points) const
+{
+    QVector<int> result;
+    const QRectF normalized = rect.normalized();
+
+    visitCells(normalized, [&](int id) {
+        const QVector3D& p = points.at(id);
+        if (p.x() >= normalized.left() && p.x() <= normalized.right()
+            && p.y() >= normalized.top() && p.y() <= normalized.bottom()) {
+            result.append(id);
+        }
+    });
+
+    // Re-added points may be found through their old and new entries
+    if (m_overflowCount > 0) {
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+    }
+
+    return result;
+}
+
+int SpatialIndex::nearest(const QPointF& position, float radius, const QVector<QVector3D>& points) const
+{
+    int best = -1;
+    qreal bestDistance = qreal(radius) * radius;
+
+    const QRectF area(position.x() - radius, position.y() - radius, 2.0 * radius, 2.0 * radius);
+    visitCells(area, [&](int id) {
+        const QVector3D& p = points.at(id);
+        const qreal dx = p.x() - position.x();
+        const qreal dy = p.y() - position.y();
+        const qreal distance = dx * dx + dy * dy;
+        if (distance <= bestDistance) {
+            bestDistance = distance;
+            best = id;
+        }
+    });
+
+    return best;
+}
+
+int SpatialIndex::column(qreal x) const
+{
+    const qreal c = (x - m_origin.x()) / m_cellSize;
+    if (c <= 0.0) {
+        return 0;
+    }
+    return c >= m_columns ? m_columns - 1 : int(c);
+}
+
+int SpatialIndex::row(qreal y) const
+{
+    const qreal r = (y - m_origin.y()) / m_cellSize;
+    if (r <= 0.0) {
+        return 0;
+    }
+    return r >= m_rows ? m_rows - 1 : int(r);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <QHash>
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
+#include <QVector3D>
+
+/**
+ * @brief Uniform grid over 2D point positions for hit-testing and culling
+ *
+ * The index stores point ids only; callers pass their position array to
+ * the queries, which check candidates against the actual positions. A
+ * bulk build() sorts ids by cell into one contiguous array, sized for a
+ * handful of points per cell. insert() adds points incrementally into
+ * per-cell overflow lists; when those grow large compared to the built
+ * part, needsRebuild() tells the owner to call build() again.
+ *
+ * Points outside the extent seen at build time are kept in the border
+ * cells, so queries stay correct, only slower, until the next rebuild.
+ */
+class SpatialIndex
+{
+public:
+    /**
+     * @brief Constructor
+     */
+    SpatialIndex();
+
+    /**
+     * @brief Remove all points
+     */
+    void clear();
+
+    /**
+     * @brief Check if the index holds no points
+     * @return true if empty
+     */
+    bool isEmpty() const { return m_count == 0; }
+
+    /**
+     * @brief Get number of entries
+     * @return Entry count (a re-added point counts twice until build())
+     */
+    int count() const { return m_count; }
+
+    /**
+     * @brief Index all points, replacing previous content
+     * @param points Point positions; ids are array indices
+     */
+    void build(const QVector<QVector3D>& points);
+
+    /**
+     * @brief Add a single point, or re-add one that moved
+     *
+     * A moved point keeps its old entry until the next build(); queries
+     * check actual positions, so the stale entry is harmless.
+     *
+     * @param id Point id (index into the position array)
+     * @param point Position
+     */
+    void insert(int id, const QVector3D& point);
+
+    /**
+     * @brief Check if incremental inserts degraded the index
+     * @return true if build() should be called again
+     */
+    bool needsRebuild() const;
+
+    /**
+     * @brief Find points inside a rectangle
+     * @param rect Rectangle in world coordinates
+     * @param points Point positions the index was built from
+     * @return Ids of the points inside the rectangle
+     */
+    QVector<int> query(const QRectF& rect, const QVector<QVector3D>& points) const;
+
+    /**
+     * @brief Find the point closest to a position
+     * @param position Position in world coordinates
+     * @param radius Maximum distance
+     * @param points Point positions the index was built from
+     * @return Id of the closest point within radius, or -1
+     */
+    int nearest(const QPointF& position, float radius, const QVector<QVector3D>& points) const;
+
+private:
+    /**
+     * @brief Get cell column for an x coordinate, clamped to the grid
+     * @param x World x coordinate
+     * @return Column
+     */
+    int column(qreal x) const;
+
+    /**
+     * @brief Get cell row for a y coordinate, clamped to the grid
+     * @param y World y coordinate
+     * @return Row
+     */
+    int row(qreal y) const;
+
+    /**
+     * @brief Visit all ids stored in a range of cells
+     * @param rect Rectangle in world coordinates
+     * @param visit Called with each candidate id
+     */
+    template<typename Visitor>
+    void visitCells(const QRectF& rect, Visitor visit) const;
+
+private:
+    // Grid geometry
+    QPointF m_origin;
+    qreal m_cellSize;
+    int m_columns;
+    int m_rows;
+
+    // Built part: ids sorted by cell, m_cellStart[c] .. m_cellStart[c + 1]
+    QVector<int> m_cellStart;
+    QVector<int> m_items;
+
+    // Points inserted since the last build, by cell
+    QHash<int, QVector<int>> m_overflow;
+    int m_overflowCount;
+
+    int m_count;
+};
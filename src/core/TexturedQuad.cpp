@@ -0,0 +1,128 @@
+#include "TexturedQuad.h"
+
+#include <QOpenGLShaderProgram>
+#include <QVector4D>
+#include <QDebug>
+
+namespace {
+
+const char* kVertexShader =
+    "attribute vec2 a_quad;\n"
+    "uniform mat4 u_mvp;\n"
+    "uniform vec4 u_rect;\n"
+    "varying vec2 v_texCoord;\n"
+    "void main()\n"
+    "{\n"
+    "    v_texCoord = a_quad;\n"
+    "    vec2 pos = vec2(u_rect.x + a_quad.x * u_rect.z, u_rect.y - a_quad.y * u_rect.w);\n"
+    "    gl_Position = u_mvp * vec4(pos, 0.0, 1.0);\n"
+    "}\n";
+
+const char* kFragmentShader =
+    "#ifdef GL_ES\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform sampler2D u_texture;\n"
+    "uniform float u_opacity;\n"
+    "varying vec2 v_texCoord;\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 color = texture2D(u_texture, v_texCoord);\n"
+    "    gl_FragColor = vec4(color.rgb, color.a * u_opacity);\n"
+    "}\n";
+
+} // namespace
+
+TexturedQuad::TexturedQuad()
+    : m_program(nullptr)
+    , m_quadBuffer(QOpenGLBuffer::VertexBuffer)
+    , m_gl(nullptr)
+    , m_rectLocation(-1)
+{
+}
+
+TexturedQuad::~TexturedQuad()
+{
+    delete m_program;
+}
+
+bool TexturedQuad::create(const char* fragmentShader)
+{
+    if (m_program) {
+        return true;
+    }
+
+    m_program = new QOpenGLShaderProgram();
+    m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, kVertexShader);
+    m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShader ? fragmentShader : kFragmentShader);
+    m_program->bindAttributeLocation("a_quad", 0);
+
+    if (!m_program->link()) {
+        qWarning() << "TexturedQuad: failed to link shader program:" << m_program->log();
+        delete m_program;
+        m_program = nullptr;
+        return false;
+    }
+
+    m_rectLocation = m_program->uniformLocation("u_rect");
+
+    // Triangle strip covering [0, 1] x [0, 1]
+    static const GLfloat quad[] = {
+        0.0f, 0.0f,
+        1.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 1.0f
+    };
+
+    m_quadBuffer.create();
+    m_quadBuffer.bind();
+    m_quadBuffer.allocate(quad, sizeof(quad));
+    m_quadBuffer.release();
+    return true;
+}
+
+void TexturedQuad::destroy()
+{
+    m_quadBuffer.destroy();
+    delete m_program;
+    m_program = nullptr;
+}
+
+void TexturedQuad::invalidate()
+{
+    m_quadBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    delete m_program;
+    m_program = nullptr;
+}
+
+void TexturedQuad::begin(QOpenGLFunctions* gl, const QMatrix4x4& mvp, float opacity)
+{
+    m_gl = gl;
+    m_program->bind();
+    m_program->setUniformValue("u_mvp", mvp);
+    m_program->setUniformValue("u_texture", 0);
+    m_program->setUniformValue("u_opacity", opacity);
+
+    m_quadBuffer.bind();
+    m_program->enableAttributeArray(0);
+    m_program->setAttributeBuffer(0, GL_FLOAT, 0, 2);
+
+    m_gl->glActiveTexture(GL_TEXTURE0);
+}
+
+void TexturedQuad::draw(GLuint texture, const QRectF& rect)
+{
+    m_program->setUniformValue(m_rectLocation,
+        QVector4D(float(rect.left()), float(rect.bottom()), float(rect.width()), float(rect.height())));
+    m_gl->glBindTexture(GL_TEXTURE_2D, texture);
+    m_gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+void TexturedQuad::end()
+{
+    m_gl->glBindTexture(GL_TEXTURE_2D, 0);
+    m_program->disableAttributeArray(0);
+    m_quadBuffer.release();
+    m_program->release();
+    m_gl = nullptr;
+}
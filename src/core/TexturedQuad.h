@@ -0,0 +1,91 @@
+#pragma once
+
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QMatrix4x4>
+#include <QRectF>
+
+class QOpenGLShaderProgram;
+
+/**
+ * @brief Shader program and vertex buffer for drawing textured rectangles
+ *
+ * Shared by the image layers. Each draw() places a texture on an
+ * axis-aligned world-space rectangle; all GL objects belong to the context
+ * that was current when create() was called.
+ */
+class TexturedQuad
+{
+public:
+    /**
+     * @brief Constructor
+     */
+    TexturedQuad();
+
+    /**
+     * @brief Destructor
+     */
+    ~TexturedQuad();
+
+    /**
+     * @brief Create GL resources in the current context
+     *
+     * A custom fragment shader receives v_texCoord, u_texture (unit 0)
+     * and u_opacity like the default one; further uniforms are set
+     * through program() between begin() and end().
+     *
+     * @param fragmentShader Fragment shader source, nullptr for the default
+     * @return true if successful
+     */
+    bool create(const char* fragmentShader = nullptr);
+
+    /**
+     * @brief Destroy GL resources (context must be current)
+     */
+    void destroy();
+
+    /**
+     * @brief Forget GL resources without deleting them
+     *
+     * Used when the owning context is gone and the objects cannot be freed.
+     */
+    void invalidate();
+
+    /**
+     * @brief Check if resources were created
+     * @return true if created
+     */
+    bool isCreated() const { return m_program != nullptr; }
+
+    /**
+     * @brief Get the shader program
+     * @return Program, nullptr before create()
+     */
+    QOpenGLShaderProgram* program() const { return m_program; }
+
+    /**
+     * @brief Bind program and vertex state
+     * @param gl OpenGL functions
+     * @param mvp View-projection matrix
+     * @param opacity Layer opacity
+     */
+    void begin(QOpenGLFunctions* gl, const QMatrix4x4& mvp, float opacity);
+
+    /**
+     * @brief Draw a texture on a world rectangle
+     * @param texture Texture id
+     * @param rect World rectangle (texture row 0 maps to the top edge)
+     */
+    void draw(GLuint texture, const QRectF& rect);
+
+    /**
+     * @brief Release program and vertex state
+     */
+    void end();
+
+private:
+    QOpenGLShaderProgram* m_program;
+    QOpenGLBuffer m_quadBuffer;
+    QOpenGLFunctions* m_gl;
+    int m_rectLocation;
+};
@@ -0,0 +1,183 @@
+#include "TileCache.h"
+#include "TileSource.h"
+
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+
+TileCache* TileCache::s_instance = nullptr;
+
+/**
+ * @brief Worker task reading a single tile
+ */
+class TileLoadTask : public QRunnable
+{
+public:
+    TileLoadTask(TileCache* cache, const std::shared_ptr<TileSource>& source, const TileKey& key)
+        : m_cache(cache), m_source(source), m_key(key) {}
+
+    void run() override
+    {
+        m_cache->loadTile(m_source, m_key);
+    }
+
+private:
+    TileCache* m_cache;
+    std::shared_ptr<TileSource> m_source;
+    TileKey m_key;
+};
+
+namespace {
+
+int tileCostKb(const QImage& image)
+{
+    return qMax(1, int(image.sizeInBytes() / 1024));
+}
+
+} // namespace
+
+TileCache::TileCache(qint64 memoryBudget, QObject* parent)
+    : QObject(parent)
+    , m_shuttingDown(false)
+    , m_textureMemoryBudget(256ll * 1024 * 1024)
+{
+    s_instance = this;
+
+    qRegisterMetaType<TileKey>("TileKey");
+
+    m_cache.setMaxCost(int(qMax<qint64>(1, memoryBudget / 1024)));
+
+    // Tile reads are mostly I/O and decode bound; leave cores for rendering
+    m_pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount() / 2));
+}
+
+TileCache::~TileCache()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_shuttingDown = true;
+        m_wanted.clear();
+    }
+    m_pool.waitForDone();
+
+    if (s_instance == this) {
+        s_instance = nullptr;
+    }
+}
+
+TileCache* TileCache::instance()
+{
+    return s_instance;
+}
+
+void TileCache::setMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.setMaxCost(int(qMax<qint64>(1, bytes / 1024)));
+}
+
+qint64 TileCache::memoryBudget() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_cache.maxCost()) * 1024;
+}
+
+qint64 TileCache::memoryUsage() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_cache.totalCost()) * 1024;
+}
+
+QImage TileCache::tile(quint64 sourceId, const TileKey& key) const
+{
+    QMutexLocker locker(&m_mutex);
+    QImage* image = m_cache.object(CacheKey{sourceId, key});
+    return image ? *image : QImage();
+}
+
+void TileCache::request(const std::shared_ptr<TileSource>& source, const QVector<TileKey>& keys)
+{
+    request(source, keys.constData(), keys.size());
+}
+
+void TileCache::request(const std::shared_ptr<TileSource>& source, const TileKey* keys, int count)
+{
+    if (!source) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (m_shuttingDown) {
+        return;
+    }
+
+    QSet<TileKey>& wanted = m_wanted[source->id()];
+    wanted.clear();
+
+    for (int i = 0; i < count; ++i) {
+        const TileKey& key = keys[i];
+        wanted.insert(key);
+
+        CacheKey cacheKey{source->id(), key};
+        if (m_cache.contains(cacheKey) || m_inFlight.contains(cacheKey)) {
+            continue;
+        }
+
+        m_inFlight.insert(cacheKey);
+        m_pool.start(new TileLoadTask(this, source, key));
+    }
+}
+
+void TileCache::removeSource(quint64 sourceId)
+{
+    QMutexLocker locker(&m_mutex);
+    m_wanted.remove(sourceId);
+
+    const QList<CacheKey> keys = m_cache.keys();
+    for (const CacheKey& key : keys) {
+        if (key.sourceId == sourceId) {
+            m_cache.remove(key);
+        }
+    }
+}
+
+void TileCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.clear();
+}
+
+void TileCache::loadTile(const std::shared_ptr<TileSource>& source, const TileKey& key)
+{
+    const CacheKey cacheKey{source->id(), key};
+
+    {
+        // Skip tiles that went out of view while queued
+        QMutexLocker locker(&m_mutex);
+        auto it = m_wanted.constFind(source->id());
+        if (m_shuttingDown || it == m_wanted.constEnd() || !it->contains(key)) {
+            m_inFlight.remove(cacheKey);
+            return;
+        }
+    }
+
+    QImage image = source->readTile(key.level, key.x, key.y);
+    if (!image.isNull() && image.format() != QImage::Format_RGBA8888) {
+        image = image.convertToFormat(QImage::Format_RGBA8888);
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_inFlight.remove(cacheKey);
+        if (image.isNull() || m_shuttingDown || !m_wanted.contains(source->id())) {
+            return;
+        }
+        m_cache.insert(cacheKey, new QImage(image), tileCostKb(image));
+    }
+
+    const quint64 sourceId = source->id();
+    QMetaObject::invokeMethod(this, [this, sourceId, key]() {
+        emit tileLoaded(sourceId, key);
+    }, Qt::QueuedConnection);
+}
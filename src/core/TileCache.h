@@ -0,0 +1,196 @@
+#pragma once
+
+#include <QObject>
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QSet>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+class TileSource;
+
+/**
+ * @brief Tile address inside a pyramid
+ */
+struct TileKey
+{
+    int level = 0;  ///< Pyramid level
+    int x = 0;      ///< Tile column
+    int y = 0;      ///< Tile row
+
+    bool operator==(const TileKey& other) const
+    {
+        return level == other.level && x == other.x && y == other.y;
+    }
+};
+
+/**
+ * @brief Hash function for TileKey
+ */
+inline uint qHash(const TileKey& key, uint seed = 0)
+{
+    return qHash((quint64(quint16(key.level)) << 48) ^ (quint64(quint32(key.x)) << 24) ^ quint32(key.y), seed);
+}
+
+Q_DECLARE_METATYPE(TileKey)
+
+/**
+ * @brief LRU tile cache with a background loader
+ *
+ * Holds decoded tiles of all tiled layers within a shared memory budget.
+ * Layers ask for the tiles they need each frame with request(); missing
+ * tiles are read on a worker pool and tileLoaded() is emitted on the
+ * cache's thread when one becomes available. Requests that are no longer
+ * wanted by the time a worker picks them up are dropped.
+ */
+class TileCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * @param memoryBudget Maximum memory for cached tiles in bytes
+     * @param parent Parent object
+     */
+    explicit TileCache(qint64 memoryBudget = 512ll * 1024 * 1024, QObject* parent = nullptr);
+
+    /**
+     * @brief Destructor
+     */
+    ~TileCache();
+
+    /**
+     * @brief Get singleton instance
+     * @return TileCache instance
+     */
+    static TileCache* instance();
+
+    /**
+     * @brief Set memory budget for cached tiles
+     * @param bytes Budget in bytes
+     */
+    void setMemoryBudget(qint64 bytes);
+
+    /**
+     * @brief Get memory budget for cached tiles
+     * @return Budget in bytes
+     */
+    qint64 memoryBudget() const;
+
+    /**
+     * @brief Get memory currently used by cached tiles
+     * @return Usage in bytes
+     */
+    qint64 memoryUsage() const;
+
+    /**
+     * @brief Set memory budget for GPU-resident tiles per layer
+     * @param bytes Budget in bytes
+     */
+    void setTextureMemoryBudget(qint64 bytes) { m_textureMemoryBudget = bytes; }
+
+    /**
+     * @brief Get memory budget for GPU-resident tiles per layer
+     * @return Budget in bytes
+     */
+    qint64 textureMemoryBudget() const { return m_textureMemoryBudget; }
+
+    /**
+     * @brief Get a cached tile
+     * @param sourceId Tile source id
+     * @param key Tile key
+     * @return Tile image or null image if not cached
+     */
+    QImage tile(quint64 sourceId, const TileKey& key) const;
+
+    /**
+     * @brief Request tiles for a source
+     *
+     * Replaces the set of wanted tiles for the source. Tiles that are not
+     * cached or already loading are queued on the worker pool.
+     *
+     * @param source Tile source
+     * @param keys Wanted tiles, most important first
+     */
+    void request(const std::shared_ptr<TileSource>& source, const QVector<TileKey>& keys);
+
+    /**
+     * @brief Request tiles for a source from a plain array
+     *
+     * Same as request() with a QVector, for callers building the list in
+     * per-frame scratch memory.
+     *
+     * @param source Tile source
+     * @param keys Wanted tiles, most important first
+     * @param count Number of keys
+     */
+    void request(const std::shared_ptr<TileSource>& source, const TileKey* keys, int count);
+
+    /**
+     * @brief Drop pending requests and cached tiles of a source
+     * @param sourceId Tile source id
+     */
+    void removeSource(quint64 sourceId);
+
+    /**
+     * @brief Clear all cached tiles
+     */
+    void clear();
+
+signals:
+    /**
+     * @brief Emitted when a requested tile has been loaded
+     * @param sourceId Tile source id
+     * @param key Tile key
+     */
+    void tileLoaded(quint64 sourceId, const TileKey& key);
+
+private:
+    friend class TileLoadTask;
+
+    /**
+     * @brief Cache key combining source and tile
+     */
+    struct CacheKey
+    {
+        quint64 sourceId;
+        TileKey tile;
+
+        bool operator==(const CacheKey& other) const
+        {
+            return sourceId == other.sourceId && tile == other.tile;
+        }
+    };
+
+    friend uint qHash(const CacheKey& key, uint seed)
+    {
+        return qHash(key.tile, seed) ^ qHash(key.sourceId, seed);
+    }
+
+    /**
+     * @brief Load a tile (runs on a worker thread)
+     * @param source Tile source
+     * @param key Tile key
+     */
+    void loadTile(const std::shared_ptr<TileSource>& source, const TileKey& key);
+
+private:
+    static TileCache* s_instance;
+
+    // Cached tiles, cost in kilobytes
+    mutable QMutex m_mutex;
+    mutable QCache<CacheKey, QImage> m_cache;
+
+    // Loader state
+    QHash<quint64, QSet<TileKey>> m_wanted;
+    QSet<CacheKey> m_inFlight;
+    QThreadPool m_pool;
+    bool m_shuttingDown;
+
+    std::atomic<qint64> m_textureMemoryBudget;
+};
@@ -0,0 +1,223 @@
+#include "TileSource.h"
+
+#include <QtMath>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Number of elements inspected when estimating the display range
+const qint64 kRangeSampleCount = 65536;
+
+template<typename T>
+double elementAt(const uchar* base, qint64 offset)
+{
+    return double(*reinterpret_cast<const T*>(base + offset));
+}
+
+double readElement(DataType type, const uchar* base, qint64 offset)
+{
+    switch (type) {
+    case DataType::UInt8:   return elementAt<quint8>(base, offset);
+    case DataType::UInt16:  return elementAt<quint16>(base, offset);
+    case DataType::UInt32:  return elementAt<quint32>(base, offset);
+    case DataType::Int8:    return elementAt<qint8>(base, offset);
+    case DataType::Int16:   return elementAt<qint16>(base, offset);
+    case DataType::Int32:   return elementAt<qint32>(base, offset);
+    case DataType::Float32: return elementAt<float>(base, offset);
+    case DataType::Float64: return elementAt<double>(base, offset);
+    default:                return 0.0;
+    }
+}
+
+template<typename T>
+void fillGrayTile(const DataBuffer& buffer, QImage& tile, qint64 originX, qint64 originY, int step,
+                  double low, double high)
+{
+    const uchar* base = buffer.constData();
+    const qint64 rowStride = buffer.strides().at(0);
+    const qint64 columnStride = buffer.strides().at(1);
+    const double scale = high > low ? 255.0 / (high - low) : 0.0;
+
+    for (int y = 0; y < tile.height(); ++y) {
+        const uchar* row = base + (originY + qint64(y) * step) * rowStride;
+        uchar* out = tile.scanLine(y);
+        for (int x = 0; x < tile.width(); ++x) {
+            const double value = elementAt<T>(row, (originX + qint64(x) * step) * columnStride);
+            const uchar gray = qIsFinite(value) ? uchar(qBound(0.0, (value - low) * scale + 0.5, 255.0)) : 0;
+            out[4 * x + 0] = gray;
+            out[4 * x + 1] = gray;
+            out[4 * x + 2] = gray;
+            out[4 * x + 3] = 255;
+        }
+    }
+}
+
+} // namespace
+
+ImagePyramidSource::ImagePyramidSource(const QImage& image, int tileSize)
+    : m_tileSize(qMax(16, tileSize))
+{
+    if (image.isNull()) {
+        return;
+    }
+
+    m_levels.append(image.convertToFormat(QImage::Format_RGBA8888));
+
+    while (m_levels.last().width() > m_tileSize || m_levels.last().height() > m_tileSize) {
+        const QImage& previous = m_levels.last();
+        m_levels.append(previous.scaled((previous.width() + 1) / 2, (previous.height() + 1) / 2,
+                                        Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    }
+}
+
+QSize ImagePyramidSource::imageSize() const
+{
+    return m_levels.isEmpty() ? QSize() : m_levels.first().size();
+}
+
+int ImagePyramidSource::levelCount() const
+{
+    return qMax(1, m_levels.size());
+}
+
+QImage ImagePyramidSource::readTile(int level, int tileX, int tileY)
+{
+    if (level < 0 || level >= m_levels.size()) {
+        return QImage();
+    }
+
+    const QImage& image = m_levels[level];
+    QRect rect = QRect(tileX * m_tileSize, tileY * m_tileSize, m_tileSize, m_tileSize) & image.rect();
+    if (rect.isEmpty()) {
+        return QImage();
+    }
+
+    return image.copy(rect);
+}
+
+// BufferTileSource implementation
+BufferTileSource::BufferTileSource(const DataBuffer& buffer, int tileSize)
+    : m_buffer(buffer)
+    , m_tileSize(qMax(16, tileSize))
+    , m_levelCount(1)
+    , m_displayMin(0.0)
+    , m_displayMax(255.0)
+{
+    if (m_buffer.ndim() < 2 || m_buffer.ndim() > 3) {
+        m_buffer = DataBuffer();
+        return;
+    }
+
+    qint64 extent = qMax(m_buffer.shape(0), m_buffer.shape(1));
+    while (extent > m_tileSize) {
+        extent = (extent + 1) / 2;
+        ++m_levelCount;
+    }
+
+    estimateDisplayRange();
+}
+
+QSize BufferTileSource::imageSize() const
+{
+    if (m_buffer.isNull()) {
+        return QSize();
+    }
+    return QSize(int(m_buffer.shape(1)), int(m_buffer.shape(0)));
+}
+
+int BufferTileSource::levelCount() const
+{
+    return m_levelCount;
+}
+
+QImage BufferTileSource::readTile(int level, int tileX, int tileY)
+{
+    if (m_buffer.isNull() || level < 0 || level >= m_levelCount) {
+        return QImage();
+    }
+
+    const QSize size = levelSize(level);
+    const QRect rect = QRect(tileX * m_tileSize, tileY * m_tileSize, m_tileSize, m_tileSize)
+                     & QRect(QPoint(0, 0), size);
+    if (rect.isEmpty()) {
+        return QImage();
+    }
+
+    const int step = 1 << level;
+    const qint64 originX = qint64(rect.x()) * step;
+    const qint64 originY = qint64(rect.y()) * step;
+    const int channels = m_buffer.ndim() == 3 ? int(m_buffer.shape(2)) : 1;
+
+    QImage tile(rect.size(), QImage::Format_RGBA8888);
+
+    if (m_buffer.dtype() == DataType::UInt8 && (channels == 3 || channels == 4)) {
+        const uchar* base = m_buffer.constData();
+        const qint64 rowStride = m_buffer.strides().at(0);
+        const qint64 columnStride = m_buffer.strides().at(1);
+        const qint64 channelStride = m_buffer.strides().at(2);
+
+        for (int y = 0; y < tile.height(); ++y) {
+            const uchar* row = base + (originY + qint64(y) * step) * rowStride;
+            uchar* out = tile.scanLine(y);
+            for (int x = 0; x < tile.width(); ++x) {
+                const uchar* pixel = row + (originX + qint64(x) * step) * columnStride;
+                out[4 * x + 0] = pixel[0];
+                out[4 * x + 1] = pixel[channelStride];
+                out[4 * x + 2] = pixel[2 * channelStride];
+                out[4 * x + 3] = channels == 4 ? pixel[3 * channelStride] : 255;
+            }
+        }
+        return tile;
+    }
+
+    // Scalar data, or the first channel of multi-channel data
+    const DataBuffer plane = m_buffer.ndim() == 3 ? m_buffer.slice(2, 0) : m_buffer;
+    switch (plane.dtype()) {
+    case DataType::UInt8:   fillGrayTile<quint8>(plane, tile, originX, originY, step, m_displayMin, m_displayMax); break;
+    case DataType::UInt16:  fillGrayTile<quint16>(plane, tile, originX, originY, step, m_displayMin, m_displayMax); break;
+    case DataType::UInt32:  fillGrayTile<quint32>(plane, tile, originX, originY, step, m_displayMin, m_displayMax); break;
+    case DataType::Int8:    fillGrayTile<qint8>(plane, tile, originX, originY, step, m_displayMin, m_displayMax); break;
+    case DataType::Int16:   fillGrayTile<qint16>(plane, tile, originX, originY, step, m_displayMin, m_displayMax); break;
+    case DataType::Int32:   fillGrayTile<qint32>(plane, tile, originX, originY, step, m_displayMin, m_displayMax); break;
+    case DataType::Float32: fillGrayTile<float>(plane, tile, originX, originY, step, m_displayMin, m_displayMax); break;
+    case DataType::Float64: fillGrayTile<double>(plane, tile, originX, originY, step, m_displayMin, m_displayMax); break;
+    default:                return QImage();
+    }
+    return tile;
+}
+
+void BufferTileSource::estimateDisplayRange()
+{
+    if (m_buffer.dtype() == DataType::UInt8) {
+        m_displayMin = 0.0;
+        m_displayMax = 255.0;
+        return;
+    }
+
+    // A sparse grid keeps this cheap for mapped files, touching only a
+    // small fraction of the pages
+    const qint64 height = m_buffer.shape(0);
+    const qint64 width = m_buffer.shape(1);
+    const qint64 step = qMax<qint64>(1, qint64(std::sqrt(double(width) * double(height) / kRangeSampleCount)));
+    const qint64 rowStride = m_buffer.strides().at(0);
+    const qint64 columnStride = m_buffer.strides().at(1);
+    const uchar* base = m_buffer.constData();
+
+    double low = std::numeric_limits<double>::max();
+    double high = std::numeric_limits<double>::lowest();
+    for (qint64 y = 0; y < height; y += step) {
+        for (qint64 x = 0; x < width; x += step) {
+            const double value = readElement(m_buffer.dtype(), base, y * rowStride + x * columnStride);
+            if (qIsFinite(value)) {
+                low = qMin(low, value);
+                high = qMax(high, value);
+            }
+        }
+    }
+
+    if (low <= high) {
+        m_displayMin = low;
+        m_displayMax = high;
+    }
+}
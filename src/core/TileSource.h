@@ -0,0 +1,178 @@
+#pragma once
+
+#include "DataBuffer.h"
+#include <QImage>
+#include <QSize>
+#include <QVector>
+#include <atomic>
+
+/**
+ * @brief Source of image tiles for a multi-resolution pyramid
+ *
+ * Level 0 is full resolution; each following level halves both
+ * dimensions (rounding up). Implementations may read tiles from memory,
+ * from a mapped file or from a remote store. readTile() is called from
+ * background loader threads and must be thread-safe.
+ */
+class TileSource
+{
+public:
+    /**
+     * @brief Constructor
+     */
+    TileSource() : m_id(nextId()) {}
+
+    /**
+     * @brief Virtual destructor
+     */
+    virtual ~TileSource() = default;
+
+    /**
+     * @brief Get unique source id
+     * @return Id that is never reused within the process
+     */
+    quint64 id() const { return m_id; }
+
+    /**
+     * @brief Get full resolution image size
+     * @return Size of level 0 in pixels
+     */
+    virtual QSize imageSize() const = 0;
+
+    /**
+     * @brief Get number of pyramid levels
+     * @return Level count (at least 1)
+     */
+    virtual int levelCount() const = 0;
+
+    /**
+     * @brief Get tile edge length
+     * @return Tile size in pixels
+     */
+    virtual int tileSize() const { return 256; }
+
+    /**
+     * @brief Read a tile
+     * @param level Pyramid level
+     * @param tileX Tile column
+     * @param tileY Tile row
+     * @return Tile image (edge tiles may be smaller), null on failure
+     */
+    virtual QImage readTile(int level, int tileX, int tileY) = 0;
+
+    /**
+     * @brief Get image size at a pyramid level
+     * @param level Pyramid level
+     * @return Level size in pixels
+     */
+    QSize levelSize(int level) const
+    {
+        const QSize size = imageSize();
+        const int scale = 1 << level;
+        return QSize((size.width() + scale - 1) / scale, (size.height() + scale - 1) / scale);
+    }
+
+    /**
+     * @brief Get tile grid dimensions at a pyramid level
+     * @param level Pyramid level
+     * @return Number of tile columns and rows
+     */
+    QSize tileGridSize(int level) const
+    {
+        const QSize size = levelSize(level);
+        const int tile = tileSize();
+        return QSize((size.width() + tile - 1) / tile, (size.height() + tile - 1) / tile);
+    }
+
+private:
+    static quint64 nextId()
+    {
+        static std::atomic<quint64> counter(1);
+        return counter++;
+    }
+
+    quint64 m_id;
+};
+
+/**
+ * @brief Tile source backed by an in-memory image
+ *
+ * Builds all pyramid levels up front by repeated 2x downsampling.
+ */
+class ImagePyramidSource : public TileSource
+{
+public:
+    /**
+     * @brief Constructor
+     * @param image Full resolution image
+     * @param tileSize Tile edge length
+     */
+    explicit ImagePyramidSource(const QImage& image, int tileSize = 256);
+
+    // TileSource interface implementation
+    QSize imageSize() const override;
+    int levelCount() const override;
+    int tileSize() const override { return m_tileSize; }
+    QImage readTile(int level, int tileX, int tileY) override;
+
+private:
+    QVector<QImage> m_levels;
+    int m_tileSize;
+};
+
+/**
+ * @brief Tile source sampling a data buffer on demand
+ *
+ * Accepts buffers of shape [height, width] or [height, width, channels].
+ * Tiles are produced when requested, so for memory-mapped buffers only
+ * the pages under visible tiles are read from disk. Coarser levels use
+ * nearest-neighbour subsampling. Scalar data is mapped to grey levels
+ * using a value range estimated from a sparse sample of the buffer.
+ */
+class BufferTileSource : public TileSource
+{
+public:
+    /**
+     * @brief Constructor
+     * @param buffer Source buffer (kept alive by the source)
+     * @param tileSize Tile edge length
+     */
+    explicit BufferTileSource(const DataBuffer& buffer, int tileSize = 256);
+
+    /**
+     * @brief Get source buffer
+     * @return Data buffer
+     */
+    DataBuffer buffer() const { return m_buffer; }
+
+    /**
+     * @brief Get lower bound of the display range
+     * @return Value mapped to black
+     */
+    double displayMin() const { return m_displayMin; }
+
+    /**
+     * @brief Get upper bound of the display range
+     * @return Value mapped to white
+     */
+    double displayMax() const { return m_displayMax; }
+
+    // TileSource interface implementation
+    QSize imageSize() const override;
+    int levelCount() const override;
+    int tileSize() const override { return m_tileSize; }
+    QImage readTile(int level, int tileX, int tileY) override;
+
+private:
+    /**
+     * @brief Estimate the display range from a sample of the buffer
+     */
+    void estimateDisplayRange();
+
+private:
+    DataBuffer m_buffer;
+    int m_tileSize;
+    int m_levelCount;
+    double m_displayMin;
+    double m_displayMax;
+};
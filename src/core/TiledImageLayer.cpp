@@ -0,0 +1,357 @@
+#include "TiledImageLayer.h"
+#include "GpuResourcePool.h"
+#include "RenderContext.h"
+#include "TileSource.h"
+#include "../utils/FrameArena.h"
+
+#include <QOpenGLContext>
+#include <QtMath>
+#include <algorithm>
+
+namespace {
+
+// Limit texture uploads per frame to keep frame times even while streaming
+const int kMaxUploadsPerFrame = 16;
+
+/**
+ * @brief Texture considered for eviction
+ */
+struct EvictionCandidate
+{
+    quint64 lastUsedFrame;
+    TileKey key;
+};
+
+} // namespace
+
+TiledImageLayer::TiledImageLayer(const QString& name, std::shared_ptr<TileSource> source, QObject* parent)
+    : Layer(name, LayerType::Image, parent)
+    , m_source(std::move(source))
+    , m_position(0.0, 0.0)
+    , m_currentLevel(0)
+    , m_glContext(nullptr)
+    , m_frame(0)
+    , m_missingTiles(0)
+{
+}
+
+TiledImageLayer::~TiledImageLayer()
+{
+    // GPU resources are released by the viewer through releaseGraphicsResources()
+    if (m_source && m_connectedCache) {
+        m_connectedCache->removeSource(m_source->id());
+    }
+}
+
+void TiledImageLayer::setTileSource(std::shared_ptr<TileSource> source)
+{
+    if (m_source == source) {
+        return;
+    }
+
+    if (m_source) {
+        cache()->removeSource(m_source->id());
+    }
+
+    // Textures can only be deleted with the GL context current
+    for (const GpuTile& tile : qAsConst(m_textures)) {
+        m_orphanedTextures.append(tile.textureId);
+    }
+    m_textures.clear();
+
+    m_source = std::move(source);
+    m_currentLevel = 0;
+    markDataChanged();
+}
+
+void TiledImageLayer::setPosition(const QPointF& position)
+{
+    if (m_position != position) {
+        m_position = position;
+        emit changed();
+    }
+}
+
+int TiledImageLayer::levelForZoom(float zoom, int levelCount)
+{
+    if (zoom >= 1.0f || levelCount <= 1) {
+        return 0;
+    }
+
+    int level = int(std::floor(std::log2(1.0f / zoom)));
+    return qBound(0, level, levelCount - 1);
+}
+
+QVariant TiledImageLayer::data() const
+{
+    // The dataset is streamed on demand and never held as a single value
+    return QVariant();
+}
+
+void TiledImageLayer::setData(const QVariant& data)
+{
+    if (data.canConvert<QImage>()) {
+        setTileSource(std::make_shared<ImagePyramidSource>(data.value<QImage>()));
+    }
+}
+
+LayerBounds TiledImageLayer::bounds() const
+{
+    if (!m_source || m_source->imageSize().isEmpty()) {
+        return LayerBounds();
+    }
+
+    const QSize size = m_source->imageSize();
+    return LayerBounds(float(m_position.x()),
+                       float(m_position.y()),
+                       float(m_position.x() + size.width()),
+                       float(m_position.y() + size.height()));
+}
+
+void TiledImageLayer::render(void* context)
+{
+    RenderContext* ctx = static_cast<RenderContext*>(context);
+    if (!ctx || !ctx->gl || !m_source || m_source->imageSize().isEmpty()) {
+        return;
+    }
+
+    QOpenGLFunctions* gl = ctx->gl;
+    m_missingTiles = 0;
+
+    if (m_glContext != ctx->glContext) {
+        // Resources from another context cannot be reused
+        m_textures.clear();
+        m_orphanedTextures.clear();
+        m_quad.invalidate();
+        m_glContext = ctx->glContext;
+    }
+
+    if (!m_quad.isCreated() && !m_quad.create()) {
+        return;
+    }
+
+    deleteOrphanedTextures(gl);
+    ++m_frame;
+
+    const QSize imageSize = m_source->imageSize();
+    const int tileSize = m_source->tileSize();
+    const int levelCount = m_source->levelCount();
+    const int level = levelForZoom(ctx->zoomLevel, levelCount);
+    m_currentLevel = level;
+
+    // Visible region in full resolution pixels (image rows grow downwards)
+    const qreal top = m_position.y() + imageSize.height();
+    QRectF pixelRect(0.0, 0.0, imageSize.width(), imageSize.height());
+    if (!ctx->is3D) {
+        pixelRect &= QRectF(ctx->viewRect.left() - m_position.x(), top - ctx->viewRect.bottom(),
+                            ctx->viewRect.width(), ctx->viewRect.height());
+        if (pixelRect.isEmpty()) {
+            return;
+        }
+    }
+
+    const int span = tileSize << level;
+    const QSize grid = m_source->tileGridSize(level);
+    const int x0 = qBound(0, int(pixelRect.left()) / span, grid.width() - 1);
+    const int y0 = qBound(0, int(pixelRect.top()) / span, grid.height() - 1);
+    const int x1 = qBound(0, int(std::ceil(pixelRect.right())) / span, grid.width() - 1);
+    const int y1 = qBound(0, int(std::ceil(pixelRect.bottom())) / span, grid.height() - 1);
+
+    // Per-frame lists live in the viewer's arena so steady frames do not allocate
+    FrameArena localArena;
+    FrameArena* arena = ctx->arena ? ctx->arena : &localArena;
+    const qint64 visibleTiles = qint64(x1 - x0 + 1) * (y1 - y0 + 1);
+    ArenaArray<TileKey> resident(arena, visibleTiles);
+    ArenaArray<TileKey> missing(arena);
+    ArenaArray<TileKey> fallbacks(arena);
+    int uploads = 0;
+
+    for (int ty = y0; ty <= y1; ++ty) {
+        for (int tx = x0; tx <= x1; ++tx) {
+            TileKey key{level, tx, ty};
+            if (ensureTexture(gl, key, uploads)) {
+                resident.append(key);
+                continue;
+            }
+
+            missing.append(key);
+
+            // Stand in with the closest coarser tile that is already on the GPU
+            for (int coarser = level + 1; coarser < levelCount; ++coarser) {
+                const int shift = coarser - level;
+                TileKey parent{coarser, tx >> shift, ty >> shift};
+                auto it = m_textures.find(parent);
+                if (it != m_textures.end()) {
+                    it->lastUsedFrame = m_frame;
+                    fallbacks.append(parent);
+                    break;
+                }
+            }
+        }
+    }
+
+    cache()->request(m_source, missing.data(), int(missing.size()));
+    m_missingTiles = int(missing.size());
+
+    // Coarse stand-ins first so that finer tiles end up on top; neighbouring
+    // missing tiles often share a parent, which is drawn once
+    const auto coarserFirst = [](const TileKey& a, const TileKey& b) {
+        if (a.level != b.level) {
+            return a.level > b.level;
+        }
+        return a.y != b.y ? a.y < b.y : a.x < b.x;
+    };
+    std::sort(fallbacks.begin(), fallbacks.end(), coarserFirst);
+    const TileKey* fallbacksEnd = std::unique(fallbacks.begin(), fallbacks.end());
+
+    m_quad.begin(gl, ctx->viewProjectionMatrix(), m_opacity);
+    for (const TileKey* key = fallbacks.begin(); key != fallbacksEnd; ++key) {
+        m_quad.draw(m_textures.value(*key).textureId, tileWorldRect(*key));
+    }
+    for (const TileKey& key : resident) {
+        m_quad.draw(m_textures.value(key).textureId, tileWorldRect(key));
+    }
+    m_quad.end();
+
+    evictTextures(gl, arena);
+
+    // Cached tiles held back by the upload limit need another frame
+    if (uploads >= kMaxUploadsPerFrame && !missing.isEmpty()) {
+        emit changed();
+    }
+}
+
+void TiledImageLayer::releaseGraphicsResources()
+{
+    QOpenGLContext* current = QOpenGLContext::currentContext();
+    if (!current || current != m_glContext) {
+        return;
+    }
+
+    QOpenGLFunctions* gl = current->functions();
+    GpuResourcePool* pool = GpuResourcePool::forContext(current);
+    for (const GpuTile& tile : qAsConst(m_textures)) {
+        pool->releaseTexture(gl, tile.textureId);
+    }
+    m_textures.clear();
+    deleteOrphanedTextures(gl);
+
+    m_quad.destroy();
+    m_glContext = nullptr;
+}
+
+void TiledImageLayer::onTileLoaded(quint64 sourceId, const TileKey& key)
+{
+    if (m_source && m_source->id() == sourceId && key.level == m_currentLevel) {
+        emit changed();
+    }
+}
+
+TileCache* TiledImageLayer::cache()
+{
+    TileCache* tileCache = TileCache::instance();
+    if (!tileCache) {
+        if (!m_ownCache) {
+            m_ownCache = std::make_unique<TileCache>();
+        }
+        tileCache = m_ownCache.get();
+    }
+
+    if (m_connectedCache != tileCache) {
+        if (m_connectedCache) {
+            disconnect(m_connectedCache, nullptr, this, nullptr);
+        }
+        connect(tileCache, &TileCache::tileLoaded, this, &TiledImageLayer::onTileLoaded);
+        m_connectedCache = tileCache;
+    }
+
+    return tileCache;
+}
+
+bool TiledImageLayer::ensureTexture(QOpenGLFunctions* gl, const TileKey& key, int& uploads)
+{
+    auto it = m_textures.find(key);
+    if (it != m_textures.end()) {
+        it->lastUsedFrame = m_frame;
+        return true;
+    }
+
+    if (uploads >= kMaxUploadsPerFrame) {
+        return false;
+    }
+
+    QImage image = cache()->tile(m_source->id(), key);
+    if (image.isNull()) {
+        return false;
+    }
+
+    GpuTile tile;
+    tile.lastUsedFrame = m_frame;
+
+    // Textures of evicted tiles come back from the pool with storage in place
+    tile.textureId = GpuResourcePool::current()->acquireTexture(gl, image.width(), image.height());
+    gl->glBindTexture(GL_TEXTURE_2D, tile.textureId);
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width(), image.height(),
+                        GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_textures.insert(key, tile);
+    ++uploads;
+    return true;
+}
+
+QRectF TiledImageLayer::tileWorldRect(const TileKey& key) const
+{
+    const int tileSize = m_source->tileSize();
+    const int scale = 1 << key.level;
+    const QSize levelSize = m_source->levelSize(key.level);
+
+    const qreal width = qMin(tileSize, levelSize.width() - key.x * tileSize) * scale;
+    const qreal height = qMin(tileSize, levelSize.height() - key.y * tileSize) * scale;
+    const qreal pixelX = qreal(key.x) * tileSize * scale;
+    const qreal pixelY = qreal(key.y) * tileSize * scale;
+    const qreal top = m_position.y() + m_source->imageSize().height();
+
+    return QRectF(m_position.x() + pixelX, top - pixelY - height, width, height);
+}
+
+void TiledImageLayer::evictTextures(QOpenGLFunctions* gl, FrameArena* arena)
+{
+    const qint64 bytesPerTile = qint64(m_source->tileSize()) * m_source->tileSize() * 4;
+    const int maxTiles = int(qMax<qint64>(16, cache()->textureMemoryBudget() / bytesPerTile));
+    if (m_textures.size() <= maxTiles) {
+        return;
+    }
+
+    ArenaArray<EvictionCandidate> candidates(arena, m_textures.size());
+    for (auto it = m_textures.constBegin(); it != m_textures.constEnd(); ++it) {
+        if (it->lastUsedFrame != m_frame) {
+            candidates.append(EvictionCandidate{it->lastUsedFrame, it.key()});
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(),
+              [](const EvictionCandidate& a, const EvictionCandidate& b) {
+                  return a.lastUsedFrame < b.lastUsedFrame;
+              });
+
+    GpuResourcePool* pool = GpuResourcePool::current();
+    int excess = m_textures.size() - maxTiles;
+    for (qint64 i = 0; i < candidates.size() && excess > 0; ++i, --excess) {
+        pool->releaseTexture(gl, m_textures.take(candidates[i].key).textureId);
+    }
+}
+
+void TiledImageLayer::deleteOrphanedTextures(QOpenGLFunctions* gl)
+{
+    if (m_orphanedTextures.isEmpty()) {
+        return;
+    }
+
+    GpuResourcePool* pool = GpuResourcePool::current();
+    for (GLuint textureId : qAsConst(m_orphanedTextures)) {
+        pool->releaseTexture(gl, textureId);
+    }
+    m_orphanedTextures.clear();
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "LayerManager.h"
+#include "TexturedQuad.h"
+#include "TileCache.h"
+#include <QHash>
+#include <QOpenGLFunctions>
+#include <QPointF>
+#include <QPointer>
+#include <QVector>
+#include <memory>
+
+class QOpenGLContext;
+class FrameArena;
+class TileSource;
+struct RenderContext;
+
+/**
+ * @brief Image layer streamed from a tiled multi-resolution pyramid
+ *
+ * Only tiles inside the viewport are loaded, at the pyramid level that
+ * matches the current zoom. Tiles come from the shared TileCache, which
+ * reads them in the background; while a tile is missing the nearest
+ * coarser resident tile is drawn in its place. GPU textures are kept in a
+ * per-layer LRU bounded by TileCache::textureMemoryBudget().
+ */
+class TiledImageLayer : public Layer
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * @param name Layer name
+     * @param source Tile source (may be set later)
+     * @param parent Parent object
+     */
+    explicit TiledImageLayer(const QString& name,
+                             std::shared_ptr<TileSource> source = std::shared_ptr<TileSource>(),
+                             QObject* parent = nullptr);
+
+    /**
+     * @brief Destructor
+     */
+    ~TiledImageLayer();
+
+    /**
+     * @brief Get tile source
+     * @return Tile source
+     */
+    std::shared_ptr<TileSource> tileSource() const { return m_source; }
+
+    /**
+     * @brief Set tile source
+     * @param source Tile source
+     */
+    void setTileSource(std::shared_ptr<TileSource> source);
+
+    /**
+     * @brief Get world position of the image's bottom-left corner
+     * @return Position in world coordinates
+     */
+    QPointF position() const { return m_position; }
+
+    /**
+     * @brief Set world position of the image's bottom-left corner
+     * @param position Position in world coordinates
+     */
+    void setPosition(const QPointF& position);
+
+    /**
+     * @brief Get pyramid level used in the last frame
+     * @return Pyramid level
+     */
+    int currentLevel() const { return m_currentLevel; }
+
+    /**
+     * @brief Pick the pyramid level for a zoom level
+     * @param zoom Screen pixels per full resolution pixel
+     * @param levelCount Number of levels
+     * @return Level whose texels are closest to one screen pixel
+     */
+    static int levelForZoom(float zoom, int levelCount);
+
+    // Layer interface implementation
+    QVariant data() const override;
+    void setData(const QVariant& data) override;
+    LayerBounds bounds() const override;
+    void render(void* context) override;
+    bool isLoading() const override { return m_missingTiles > 0; }
+    void releaseGraphicsResources() override;
+
+private slots:
+    /**
+     * @brief Handle tile loaded by the cache
+     * @param sourceId Tile source id
+     * @param key Tile key
+     */
+    void onTileLoaded(quint64 sourceId, const TileKey& key);
+
+private:
+    /**
+     * @brief GPU-resident tile
+     */
+    struct GpuTile
+    {
+        GLuint textureId;
+        quint64 lastUsedFrame;
+    };
+
+    /**
+     * @brief Get the tile cache, connecting to it on first use
+     * @return Tile cache
+     */
+    TileCache* cache();
+
+    /**
+     * @brief Make a tile resident on the GPU if possible
+     * @param gl OpenGL functions
+     * @param key Tile key
+     * @param uploads Upload counter for this frame
+     * @return true if the tile texture is resident
+     */
+    bool ensureTexture(QOpenGLFunctions* gl, const TileKey& key, int& uploads);
+
+    /**
+     * @brief Get world rectangle covered by a tile
+     * @param key Tile key
+     * @return World rectangle
+     */
+    QRectF tileWorldRect(const TileKey& key) const;
+
+    /**
+     * @brief Evict least recently used textures over the budget
+     * @param gl OpenGL functions
+     * @param arena Arena for the candidate list
+     */
+    void evictTextures(QOpenGLFunctions* gl, FrameArena* arena);
+
+    /**
+     * @brief Delete textures queued for deletion
+     * @param gl OpenGL functions
+     */
+    void deleteOrphanedTextures(QOpenGLFunctions* gl);
+
+private:
+    std::shared_ptr<TileSource> m_source;
+    QPointF m_position;
+    int m_currentLevel;
+
+    // Tile cache
+    QPointer<TileCache> m_connectedCache;
+    std::unique_ptr<TileCache> m_ownCache;
+
+    // GPU resources
+    QOpenGLContext* m_glContext;
+    TexturedQuad m_quad;
+    QHash<TileKey, GpuTile> m_textures;
+    QVector<GLuint> m_orphanedTextures;
+    quint64 m_frame;
+
+    // Visible tiles not yet drawn at the wanted level in the last frame
+    int m_missingTiles;
+};
@@ -0,0 +1,478 @@
+#include "TracksLayer.h"
+#include "RenderContext.h"
+
+#include <QDebug>
+#include <QMap>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Fixed attribute locations
+enum TrackAttribute : GLuint
+{
+    EndpointAttribute = 0,
+    StartAttribute = 1,
+    EndAttribute = 2,
+    TimeAttribute = 3,
+    ColorAttribute = 4
+};
+
+const char* kVertexShader =
+    "attribute float a_endpoint;\n"
+    "attribute vec3 a_start;\n"
+    "attribute vec3 a_end;\n"
+    "attribute float a_time;\n"
+    "attribute vec4 a_color;\n"
+    "uniform mat4 u_mvp;\n"
+    "uniform float u_currentTime;\n"
+    "uniform float u_tailLength;\n"
+    "varying vec4 v_color;\n"
+    "void main()\n"
+    "{\n"
+    "    float alpha = 1.0;\n"
+    "    if (u_tailLength > 0.0) {\n"
+    "        float age = u_currentTime - a_time;\n"
+    "        alpha = (age < 0.0 || age > u_tailLength) ? 0.0 : 1.0 - age / u_tailLength;\n"
+    "    }\n"
+    "    vec3 pos = mix(a_start, a_end, a_endpoint);\n"
+    "    gl_Position = u_mvp * vec4(pos, 1.0);\n"
+    "    if (alpha <= 0.0)\n"
+    "        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+    "    v_color = vec4(a_color.rgb, a_color.a * alpha);\n"
+    "}\n";
+
+const char* kFragmentShader =
+    "#ifdef GL_ES\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform float u_opacity;\n"
+    "varying vec4 v_color;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = vec4(v_color.rgb, v_color.a * u_opacity);\n"
+    "}\n";
+
+// Line from the segment start (0) to its end (1)
+const GLfloat kEndpoints[] = { 0.0f, 1.0f };
+
+// Spread hues of consecutive ids by the golden angle
+QColor trackIdColor(int trackId)
+{
+    const int hue = int((qint64(trackId) * 137) % 360 + 360) % 360;
+    return QColor::fromHsv(hue, 200, 255);
+}
+
+} // namespace
+
+TracksLayer::TracksLayer(const QString& name, QObject* parent)
+    : Layer(name, LayerType::Tracks, parent)
+    , m_pointCount(0)
+    , m_currentTime(0.0f)
+    , m_tailLength(0.0f)
+    , m_boundsDirty(false)
+    , m_glContext(nullptr)
+    , m_program(nullptr)
+    , m_warnedNoInstancing(false)
+{
+}
+
+TracksLayer::~TracksLayer()
+{
+    // GPU resources are released by the viewer through releaseGraphicsResources()
+    delete m_program;
+}
+
+QList<int> TracksLayer::trackIds() const
+{
+    QList<int> ids = m_tracks.keys();
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+QVector<QVector3D> TracksLayer::trackPoints(int trackId) const
+{
+    auto it = m_tracks.constFind(trackId);
+    return it != m_tracks.constEnd() ? it->points : QVector<QVector3D>();
+}
+
+QVector<float> TracksLayer::trackTimes(int trackId) const
+{
+    auto it = m_tracks.constFind(trackId);
+    return it != m_tracks.constEnd() ? it->times : QVector<float>();
+}
+
+void TracksLayer::appendPoint(int trackId, const QVector3D& position, float time)
+{
+    appendToTrack(ensureTrack(trackId), {position}, {time});
+    markDataChanged();
+}
+
+void TracksLayer::appendPoints(int trackId, const QVector<QVector3D>& positions, const QVector<float>& times)
+{
+    if (positions.size() != times.size()) {
+        qWarning() << "TracksLayer:" << positions.size() << "positions but" << times.size() << "times";
+        return;
+    }
+
+    if (positions.isEmpty()) {
+        return;
+    }
+
+    appendToTrack(ensureTrack(trackId), positions, times);
+    markDataChanged();
+}
+
+bool TracksLayer::removeTrack(int trackId)
+{
+    auto it = m_tracks.find(trackId);
+    if (it == m_tracks.end()) {
+        return false;
+    }
+
+    m_pointCount -= it->points.size();
+    m_tracks.erase(it);
+
+    // Removing from the middle shifts segment indices; compact everything
+    rebuildSegments();
+    m_boundsDirty = true;
+    markDataChanged();
+    return true;
+}
+
+void TracksLayer::clearTracks()
+{
+    if (m_tracks.isEmpty()) {
+        return;
+    }
+
+    m_tracks.clear();
+    m_pointCount = 0;
+    rebuildSegments();
+    m_boundsDirty = true;
+    markDataChanged();
+}
+
+QColor TracksLayer::trackColor(int trackId) const
+{
+    auto it = m_tracks.constFind(trackId);
+    return it != m_tracks.constEnd() ? unpackVertexColor(it->color) : QColor();
+}
+
+void TracksLayer::setTrackColor(int trackId, const QColor& color)
+{
+    auto it = m_tracks.find(trackId);
+    if (it == m_tracks.end()) {
+        return;
+    }
+
+    it->color = packVertexColor(color);
+    for (int segment : qAsConst(it->segments)) {
+        m_segmentColors[segment] = it->color;
+        m_colorBuffer.markDirty(segment * qint64(sizeof(quint32)), sizeof(quint32));
+    }
+    markDataChanged();
+}
+
+void TracksLayer::setCurrentTime(float time)
+{
+    if (m_currentTime != time) {
+        m_currentTime = time;
+        emit changed();
+    }
+}
+
+QVector<qint64> TracksLayer::sliceShape() const
+{
+    // Points of a track are in time order
+    float latest = -std::numeric_limits<float>::infinity();
+    for (const Track& track : m_tracks) {
+        if (!track.times.isEmpty()) {
+            latest = qMax(latest, track.times.last());
+        }
+    }
+    if (!std::isfinite(latest)) {
+        return QVector<qint64>();
+    }
+    return {qMax<qint64>(1, qint64(std::floor(latest)) + 1)};
+}
+
+void TracksLayer::setSlicePoint(const QVector<qint64>& point)
+{
+    if (!point.isEmpty()) {
+        setCurrentTime(float(point.last()));
+    }
+}
+
+void TracksLayer::setTailLength(float length)
+{
+    length = qMax(0.0f, length);
+    if (m_tailLength != length) {
+        m_tailLength = length;
+        emit changed();
+    }
+}
+
+QVariant TracksLayer::data() const
+{
+    DataBuffer result(DataType::Float64, {m_pointCount, 5});
+    double* out = result.data<double>();
+
+    for (int trackId : trackIds()) {
+        const Track& track = *m_tracks.constFind(trackId);
+        for (int i = 0; i < track.points.size(); ++i) {
+            const QVector3D& point = track.points.at(i);
+            *out++ = trackId;
+            *out++ = track.times.at(i);
+            *out++ = point.x();
+            *out++ = point.y();
+            *out++ = point.z();
+        }
+    }
+    return QVariant::fromValue(result);
+}
+
+void TracksLayer::setData(const QVariant& data)
+{
+    if (data.userType() == qMetaTypeId<DataBuffer>()) {
+        setBuffer(data.value<DataBuffer>());
+    }
+}
+
+bool TracksLayer::setBuffer(const DataBuffer& buffer)
+{
+    const qint64 columns = buffer.shape(1);
+    if (buffer.ndim() != 2 || (columns != 4 && columns != 5)
+        || buffer.shape(0) > std::numeric_limits<int>::max()) {
+        qWarning() << "TracksLayer: unsupported buffer shape" << buffer.shape();
+        return false;
+    }
+
+    DataBuffer values = buffer.dtype() == DataType::Float64 && buffer.isContiguous()
+                      ? buffer
+                      : buffer.converted(DataType::Float64);
+    if (values.isNull()) {
+        qWarning() << "TracksLayer: unsupported buffer type" << dataTypeName(buffer.dtype());
+        return false;
+    }
+
+    // Group rows by track, keeping their order within each track
+    QMap<int, QPair<QVector<QVector3D>, QVector<float>>> rows;
+    const double* in = values.constData<double>();
+    const int count = int(values.shape(0));
+    for (int i = 0; i < count; ++i) {
+        const double* row = in + qint64(i) * columns;
+        auto& track = rows[int(std::lround(row[0]))];
+        track.first.append(QVector3D(float(row[2]), float(row[3]), columns == 5 ? float(row[4]) : 0.0f));
+        track.second.append(float(row[1]));
+    }
+
+    m_tracks.clear();
+    m_pointCount = 0;
+    rebuildSegments();
+    m_bounds = LayerBounds();
+    m_boundsDirty = false;
+
+    for (auto it = rows.constBegin(); it != rows.constEnd(); ++it) {
+        appendToTrack(ensureTrack(it.key()), it->first, it->second);
+    }
+
+    markDataChanged();
+    return true;
+}
+
+LayerBounds TracksLayer::bounds() const
+{
+    if (!m_boundsDirty) {
+        return m_bounds;
+    }
+
+    m_bounds = LayerBounds();
+    m_boundsDirty = false;
+
+    for (const Track& track : m_tracks) {
+        for (const QVector3D& point : track.points) {
+            m_bounds.include(point.x(), point.y());
+        }
+    }
+    return m_bounds;
+}
+
+void TracksLayer::render(void* context)
+{
+    RenderContext* ctx = static_cast<RenderContext*>(context);
+    if (!ctx || !ctx->gl || m_segmentStarts.isEmpty()) {
+        return;
+    }
+
+    if (!ctx->instancing) {
+        if (!m_warnedNoInstancing) {
+            qWarning() << "TracksLayer: instanced drawing needs OpenGL 3.3 or OpenGL ES 3.0";
+            m_warnedNoInstancing = true;
+        }
+        return;
+    }
+
+    QOpenGLFunctions* gl = ctx->gl;
+    QOpenGLExtraFunctions* extra = ctx->instancing;
+
+    if (m_glContext != ctx->glContext) {
+        // Resources from another context cannot be reused
+        delete m_program;
+        m_program = nullptr;
+        m_endpointBuffer.invalidate();
+        m_startBuffer.invalidate();
+        m_endBuffer.invalidate();
+        m_timeBuffer.invalidate();
+        m_colorBuffer.invalidate();
+        m_glContext = ctx->glContext;
+    }
+
+    if (!m_program && !initializeResources(gl)) {
+        return;
+    }
+
+    const qint64 segments = m_segmentStarts.size();
+    m_startBuffer.sync(gl, m_segmentStarts.constData(), segments * sizeof(QVector3D));
+    m_endBuffer.sync(gl, m_segmentEnds.constData(), segments * sizeof(QVector3D));
+    m_timeBuffer.sync(gl, m_segmentTimes.constData(), segments * sizeof(float));
+    m_colorBuffer.sync(gl, m_segmentColors.constData(), segments * sizeof(quint32));
+
+    m_program->bind();
+    m_program->setUniformValue("u_mvp", ctx->viewProjectionMatrix());
+    m_program->setUniformValue("u_currentTime", m_currentTime);
+    m_program->setUniformValue("u_tailLength", m_tailLength);
+    m_program->setUniformValue("u_opacity", m_opacity);
+
+    m_endpointBuffer.bindAttribute(gl, EndpointAttribute, 1);
+    m_startBuffer.bindAttribute(gl, StartAttribute, 3);
+    m_endBuffer.bindAttribute(gl, EndAttribute, 3);
+    m_timeBuffer.bindAttribute(gl, TimeAttribute, 1);
+    m_colorBuffer.bindAttribute(gl, ColorAttribute, 4, GL_UNSIGNED_BYTE, true);
+
+    for (GLuint location = StartAttribute; location <= ColorAttribute; ++location) {
+        extra->glVertexAttribDivisor(location, 1);
+    }
+
+    extra->glDrawArraysInstanced(GL_LINES, 0, 2, GLsizei(segments));
+
+    // Attribute state is global; leave it as other layers expect it
+    for (GLuint location = EndpointAttribute; location <= ColorAttribute; ++location) {
+        extra->glVertexAttribDivisor(location, 0);
+        gl->glDisableVertexAttribArray(location);
+    }
+    gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_program->release();
+}
+
+void TracksLayer::releaseGraphicsResources()
+{
+    QOpenGLContext* current = QOpenGLContext::currentContext();
+    if (!current || current != m_glContext) {
+        return;
+    }
+
+    QOpenGLFunctions* gl = current->functions();
+    m_endpointBuffer.destroy(gl);
+    m_startBuffer.destroy(gl);
+    m_endBuffer.destroy(gl);
+    m_timeBuffer.destroy(gl);
+    m_colorBuffer.destroy(gl);
+    delete m_program;
+    m_program = nullptr;
+    m_glContext = nullptr;
+}
+
+TracksLayer::Track& TracksLayer::ensureTrack(int trackId)
+{
+    auto it = m_tracks.find(trackId);
+    if (it == m_tracks.end()) {
+        Track track;
+        track.color = packVertexColor(trackIdColor(trackId));
+        it = m_tracks.insert(trackId, track);
+    }
+    return it.value();
+}
+
+void TracksLayer::appendToTrack(Track& track, const QVector<QVector3D>& positions, const QVector<float>& times)
+{
+    const int firstSegment = m_segmentStarts.size();
+
+    for (int i = 0; i < positions.size(); ++i) {
+        const QVector3D& position = positions.at(i);
+
+        if (!track.points.isEmpty()) {
+            track.segments.append(m_segmentStarts.size());
+            m_segmentStarts.append(track.points.last());
+            m_segmentEnds.append(position);
+            m_segmentTimes.append(times.at(i));
+            m_segmentColors.append(track.color);
+        }
+
+        track.points.append(position);
+        track.times.append(times.at(i));
+
+        if (!m_boundsDirty) {
+            m_bounds.include(position.x(), position.y());
+        }
+    }
+    m_pointCount += positions.size();
+
+    // Only the new segments are uploaded
+    const qint64 added = m_segmentStarts.size() - firstSegment;
+    m_startBuffer.markDirty(firstSegment * qint64(sizeof(QVector3D)), added * qint64(sizeof(QVector3D)));
+    m_endBuffer.markDirty(firstSegment * qint64(sizeof(QVector3D)), added * qint64(sizeof(QVector3D)));
+    m_timeBuffer.markDirty(firstSegment * qint64(sizeof(float)), added * qint64(sizeof(float)));
+    m_colorBuffer.markDirty(firstSegment * qint64(sizeof(quint32)), added * qint64(sizeof(quint32)));
+}
+
+void TracksLayer::rebuildSegments()
+{
+    m_segmentStarts.clear();
+    m_segmentEnds.clear();
+    m_segmentTimes.clear();
+    m_segmentColors.clear();
+
+    for (int trackId : trackIds()) {
+        Track& track = m_tracks[trackId];
+        track.segments.clear();
+        for (int i = 1; i < track.points.size(); ++i) {
+            track.segments.append(m_segmentStarts.size());
+            m_segmentStarts.append(track.points.at(i - 1));
+            m_segmentEnds.append(track.points.at(i));
+            m_segmentTimes.append(track.times.at(i));
+            m_segmentColors.append(track.color);
+        }
+    }
+
+    m_startBuffer.markAllDirty();
+    m_endBuffer.markAllDirty();
+    m_timeBuffer.markAllDirty();
+    m_colorBuffer.markAllDirty();
+}
+
+bool TracksLayer::initializeResources(QOpenGLFunctions* gl)
+{
+    m_program = new QOpenGLShaderProgram();
+    m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, kVertexShader);
+    m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, kFragmentShader);
+    m_program->bindAttributeLocation("a_endpoint", EndpointAttribute);
+    m_program->bindAttributeLocation("a_start", StartAttribute);
+    m_program->bindAttributeLocation("a_end", EndAttribute);
+    m_program->bindAttributeLocation("a_time", TimeAttribute);
+    m_program->bindAttributeLocation("a_color", ColorAttribute);
+
+    if (!m_program->link()) {
+        qWarning() << "TracksLayer: failed to link shader program:" << m_program->log();
+        delete m_program;
+        m_program = nullptr;
+        return false;
+    }
+
+    m_endpointBuffer.sync(gl, kEndpoints, sizeof(kEndpoints));
+    return true;
+}
@@ -0,0 +1,242 @@
+#pragma once
+
+#include "LayerManager.h"
+#include "GpuBuffer.h"
+#include <QColor>
+#include <QHash>
+#include <QVector>
+#include <QVector3D>
+
+class QOpenGLContext;
+class QOpenGLShaderProgram;
+
+/**
+ * @brief Layer drawing object trajectories in one draw call
+ *
+ * A track is a time-ordered polyline identified by an integer id. All
+ * tracks share one set of segment arrays (start, end, time and color, one
+ * GPU buffer each) and every segment is an instance of a two-vertex line.
+ * Appending a point to a track adds one segment at the end of the arrays,
+ * so live tracking only uploads the new segments.
+ *
+ * With a positive tail length only segments ending within
+ * [currentTime - tailLength, currentTime] are drawn, fading with age.
+ */
+class TracksLayer : public Layer
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * @param name Layer name
+     * @param parent Parent object
+     */
+    explicit TracksLayer(const QString& name, QObject* parent = nullptr);
+
+    /**
+     * @brief Destructor
+     */
+    ~TracksLayer();
+
+    /**
+     * @brief Get number of tracks
+     * @return Track count
+     */
+    int trackCount() const { return m_tracks.size(); }
+
+    /**
+     * @brief Get ids of all tracks
+     * @return Track ids in ascending order
+     */
+    QList<int> trackIds() const;
+
+    /**
+     * @brief Get points of a track
+     * @param trackId Track id
+     * @return Positions in time order
+     */
+    QVector<QVector3D> trackPoints(int trackId) const;
+
+    /**
+     * @brief Get point times of a track
+     * @param trackId Track id
+     * @return Times, one per point
+     */
+    QVector<float> trackTimes(int trackId) const;
+
+    /**
+     * @brief Get total number of points over all tracks
+     * @return Point count
+     */
+    int pointCount() const { return m_pointCount; }
+
+    /**
+     * @brief Append a point to a track, creating the track if needed
+     * @param trackId Track id
+     * @param position Position in world coordinates
+     * @param time Time of the point (not earlier than the previous point)
+     */
+    void appendPoint(int trackId, const QVector3D& position, float time);
+
+    /**
+     * @brief Append several points to a track
+     * @param trackId Track id
+     * @param positions Positions in world coordinates
+     * @param times Times, one per position
+     */
+    void appendPoints(int trackId, const QVector<QVector3D>& positions, const QVector<float>& times);
+
+    /**
+     * @brief Remove a track
+     * @param trackId Track id
+     * @return true if the track existed
+     */
+    bool removeTrack(int trackId);
+
+    /**
+     * @brief Remove all tracks
+     */
+    void clearTracks();
+
+    /**
+     * @brief Get color of a track
+     * @param trackId Track id
+     * @return Color, invalid if there is no such track
+     */
+    QColor trackColor(int trackId) const;
+
+    /**
+     * @brief Set color of a track
+     * @param trackId Track id
+     * @param color Color
+     */
+    void setTrackColor(int trackId, const QColor& color);
+
+    /**
+     * @brief Get current time
+     * @return Time at the head of the tails
+     */
+    float currentTime() const { return m_currentTime; }
+
+    /**
+     * @brief Set current time
+     * @param time Time at the head of the tails
+     */
+    void setCurrentTime(float time);
+
+    /**
+     * @brief Get tail length
+     * @return Visible time span, or 0 to draw complete tracks
+     */
+    float tailLength() const { return m_tailLength; }
+
+    /**
+     * @brief Set tail length
+     * @param length Visible time span, or 0 to draw complete tracks
+     */
+    void setTailLength(float length);
+
+    // Layer interface implementation
+
+    /**
+     * @brief Get tracks as a float64 DataBuffer of shape [points, 5]
+     * @return QVariant holding rows of (track id, time, x, y, z)
+     */
+    QVariant data() const override;
+    void setData(const QVariant& data) override;
+
+    /**
+     * @brief Set tracks from a buffer of shape [points, 4] or [points, 5]
+     *
+     * Rows are (track id, time, x, y) or (track id, time, x, y, z); the
+     * points of a track must be in time order. Any numeric type is
+     * accepted.
+     *
+     * @param buffer Data buffer
+     * @return true if the buffer was accepted
+     */
+    bool setBuffer(const DataBuffer& buffer) override;
+
+    /**
+     * @brief Get the time steps covered by the tracks
+     * @return One slider dimension up to the latest time, or none without tracks
+     */
+    QVector<qint64> sliceShape() const override;
+
+    /**
+     * @brief Move the current time to a time step
+     * @param point Time step
+     */
+    void setSlicePoint(const QVector<qint64>& point) override;
+
+    LayerBounds bounds() const override;
+    void render(void* context) override;
+    void releaseGraphicsResources() override;
+
+private:
+    /**
+     * @brief Points and segment indices of one track
+     */
+    struct Track
+    {
+        quint32 color = 0;
+        QVector<QVector3D> points;
+        QVector<float> times;
+        QVector<int> segments;
+    };
+
+    /**
+     * @brief Get a track, creating it with a distinct color if needed
+     * @param trackId Track id
+     * @return Track
+     */
+    Track& ensureTrack(int trackId);
+
+    /**
+     * @brief Append points without notifying
+     * @param track Track
+     * @param positions Positions
+     * @param times Times
+     */
+    void appendToTrack(Track& track, const QVector<QVector3D>& positions, const QVector<float>& times);
+
+    /**
+     * @brief Rebuild the segment arrays from the tracks
+     */
+    void rebuildSegments();
+
+    /**
+     * @brief Create shader program and the shared endpoint buffer
+     * @param gl OpenGL functions
+     * @return true if successful
+     */
+    bool initializeResources(QOpenGLFunctions* gl);
+
+private:
+    QHash<int, Track> m_tracks;
+    int m_pointCount;
+
+    // Segment attributes, one entry per segment over all tracks
+    QVector<QVector3D> m_segmentStarts;
+    QVector<QVector3D> m_segmentEnds;
+    QVector<float> m_segmentTimes;
+    QVector<quint32> m_segmentColors;
+
+    float m_currentTime;
+    float m_tailLength;
+
+    // Bounds are recomputed lazily after removals
+    mutable LayerBounds m_bounds;
+    mutable bool m_boundsDirty;
+
+    // GPU resources
+    QOpenGLContext* m_glContext;
+    QOpenGLShaderProgram* m_program;
+    GpuBuffer m_endpointBuffer;
+    GpuBuffer m_startBuffer;
+    GpuBuffer m_endBuffer;
+    GpuBuffer m_timeBuffer;
+    GpuBuffer m_colorBuffer;
+    bool m_warnedNoInstancing;
+};
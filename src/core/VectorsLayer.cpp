@@ -0,0 +1,364 @@
+#include "VectorsLayer.h"
+#include "RenderContext.h"
+
+#include <QDebug>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <limits>
+
+namespace {
+
+// Fixed attribute locations
+enum VectorAttribute : GLuint
+{
+    EndpointAttribute = 0,
+    OriginAttribute = 1,
+    DirectionAttribute = 2,
+    ColorAttribute = 3
+};
+
+const char* kVertexShader =
+    "attribute float a_endpoint;\n"
+    "attribute vec3 a_origin;\n"
+    "attribute vec3 a_direction;\n"
+    "attribute vec4 a_color;\n"
+    "uniform mat4 u_mvp;\n"
+    "uniform float u_lengthScale;\n"
+    "varying vec4 v_color;\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 pos = a_origin + a_direction * (a_endpoint * u_lengthScale);\n"
+    "    gl_Position = u_mvp * vec4(pos, 1.0);\n"
+    "    v_color = a_color;\n"
+    "}\n";
+
+const char* kFragmentShader =
+    "#ifdef GL_ES\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform float u_opacity;\n"
+    "varying vec4 v_color;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = vec4(v_color.rgb, v_color.a * u_opacity);\n"
+    "}\n";
+
+// Line from the origin (0) to the tip (1)
+const GLfloat kEndpoints[] = { 0.0f, 1.0f };
+
+} // namespace
+
+VectorsLayer::VectorsLayer(const QString& name, QObject* parent)
+    : Layer(name, LayerType::Vectors, parent)
+    , m_defaultColor(packVertexColor(QColor(255, 255, 255)))
+    , m_lengthScale(1.0f)
+    , m_boundsDirty(true)
+    , m_glContext(nullptr)
+    , m_program(nullptr)
+    , m_warnedNoInstancing(false)
+{
+}
+
+VectorsLayer::~VectorsLayer()
+{
+    // GPU resources are released by the viewer through releaseGraphicsResources()
+    delete m_program;
+}
+
+QColor VectorsLayer::vectorColor(int index) const
+{
+    if (index < 0 || index >= m_colors.size()) {
+        return QColor();
+    }
+    return unpackVertexColor(m_colors.at(index));
+}
+
+void VectorsLayer::setVectors(const QVector<QVector3D>& origins, const QVector<QVector3D>& directions)
+{
+    if (origins.size() != directions.size()) {
+        qWarning() << "VectorsLayer:" << origins.size() << "origins but" << directions.size() << "directions";
+        return;
+    }
+
+    m_origins = origins;
+    m_directions = directions;
+    m_colors = QVector<quint32>(origins.size(), m_defaultColor);
+
+    m_originBuffer.markAllDirty();
+    m_directionBuffer.markAllDirty();
+    m_colorBuffer.markAllDirty();
+
+    m_boundsDirty = true;
+    markDataChanged();
+}
+
+void VectorsLayer::appendVectors(const QVector<QVector3D>& origins, const QVector<QVector3D>& directions)
+{
+    if (origins.size() != directions.size()) {
+        qWarning() << "VectorsLayer:" << origins.size() << "origins but" << directions.size() << "directions";
+        return;
+    }
+
+    if (origins.isEmpty()) {
+        return;
+    }
+
+    const int first = m_origins.size();
+    m_origins += origins;
+    m_directions += directions;
+    m_colors.insert(m_colors.size(), origins.size(), m_defaultColor);
+
+    // Only the new tail is uploaded
+    const qint64 count = origins.size();
+    m_originBuffer.markDirty(first * qint64(sizeof(QVector3D)), count * qint64(sizeof(QVector3D)));
+    m_directionBuffer.markDirty(first * qint64(sizeof(QVector3D)), count * qint64(sizeof(QVector3D)));
+    m_colorBuffer.markDirty(first * qint64(sizeof(quint32)), count * qint64(sizeof(quint32)));
+
+    m_boundsDirty = true;
+    markDataChanged();
+}
+
+void VectorsLayer::clearVectors()
+{
+    if (m_origins.isEmpty()) {
+        return;
+    }
+    setVectors(QVector<QVector3D>(), QVector<QVector3D>());
+}
+
+void VectorsLayer::setVector(int index, const QVector3D& origin, const QVector3D& direction)
+{
+    if (index < 0 || index >= m_origins.size()) {
+        return;
+    }
+
+    m_origins[index] = origin;
+    m_directions[index] = direction;
+    m_originBuffer.markDirty(index * qint64(sizeof(QVector3D)), sizeof(QVector3D));
+    m_directionBuffer.markDirty(index * qint64(sizeof(QVector3D)), sizeof(QVector3D));
+
+    m_boundsDirty = true;
+    markDataChanged();
+}
+
+void VectorsLayer::setVectorColor(int index, const QColor& color)
+{
+    if (index < 0 || index >= m_colors.size()) {
+        return;
+    }
+
+    m_colors[index] = packVertexColor(color);
+    m_colorBuffer.markDirty(index * qint64(sizeof(quint32)), sizeof(quint32));
+    markDataChanged();
+}
+
+void VectorsLayer::setColors(const QVector<QColor>& colors)
+{
+    if (colors.size() != m_origins.size()) {
+        qWarning() << "VectorsLayer: expected" << m_origins.size() << "colors, got" << colors.size();
+        return;
+    }
+
+    for (int i = 0; i < colors.size(); ++i) {
+        m_colors[i] = packVertexColor(colors.at(i));
+    }
+    m_colorBuffer.markAllDirty();
+    markDataChanged();
+}
+
+void VectorsLayer::setLengthScale(float scale)
+{
+    if (m_lengthScale != scale) {
+        m_lengthScale = scale;
+        m_boundsDirty = true;
+        emit changed();
+    }
+}
+
+QVariant VectorsLayer::data() const
+{
+    DataBuffer result(DataType::Float32, {m_origins.size(), 2, 3});
+    float* out = result.data<float>();
+    for (int i = 0; i < m_origins.size(); ++i) {
+        const QVector3D& origin = m_origins.at(i);
+        const QVector3D& direction = m_directions.at(i);
+        out[6 * i + 0] = origin.x();
+        out[6 * i + 1] = origin.y();
+        out[6 * i + 2] = origin.z();
+        out[6 * i + 3] = direction.x();
+        out[6 * i + 4] = direction.y();
+        out[6 * i + 5] = direction.z();
+    }
+    return QVariant::fromValue(result);
+}
+
+void VectorsLayer::setData(const QVariant& data)
+{
+    if (data.userType() == qMetaTypeId<DataBuffer>()) {
+        setBuffer(data.value<DataBuffer>());
+    }
+}
+
+bool VectorsLayer::setBuffer(const DataBuffer& buffer)
+{
+    const qint64 dims = buffer.shape(2);
+    if (buffer.ndim() != 3 || buffer.shape(1) != 2 || (dims != 2 && dims != 3)
+        || buffer.shape(0) > std::numeric_limits<int>::max()) {
+        qWarning() << "VectorsLayer: unsupported buffer shape" << buffer.shape();
+        return false;
+    }
+
+    DataBuffer values = buffer.dtype() == DataType::Float32 && buffer.isContiguous()
+                      ? buffer
+                      : buffer.converted(DataType::Float32);
+    if (values.isNull()) {
+        qWarning() << "VectorsLayer: unsupported buffer type" << dataTypeName(buffer.dtype());
+        return false;
+    }
+
+    const int count = int(values.shape(0));
+    const float* in = values.constData<float>();
+    QVector<QVector3D> origins(count);
+    QVector<QVector3D> directions(count);
+
+    for (int i = 0; i < count; ++i) {
+        const float* origin = in + qint64(i) * 2 * dims;
+        const float* direction = origin + dims;
+        origins[i] = QVector3D(origin[0], origin[1], dims == 3 ? origin[2] : 0.0f);
+        directions[i] = QVector3D(direction[0], direction[1], dims == 3 ? direction[2] : 0.0f);
+    }
+
+    setVectors(origins, directions);
+    return true;
+}
+
+LayerBounds VectorsLayer::bounds() const
+{
+    if (!m_boundsDirty) {
+        return m_bounds;
+    }
+
+    m_bounds = LayerBounds();
+    m_boundsDirty = false;
+    if (m_origins.isEmpty()) {
+        return m_bounds;
+    }
+
+    float minX = m_origins.at(0).x();
+    float minY = m_origins.at(0).y();
+    float maxX = minX;
+    float maxY = minY;
+
+    for (int i = 0; i < m_origins.size(); ++i) {
+        const QVector3D& origin = m_origins.at(i);
+        const QVector3D tip = origin + m_directions.at(i) * m_lengthScale;
+        minX = qMin(minX, qMin(origin.x(), tip.x()));
+        minY = qMin(minY, qMin(origin.y(), tip.y()));
+        maxX = qMax(maxX, qMax(origin.x(), tip.x()));
+        maxY = qMax(maxY, qMax(origin.y(), tip.y()));
+    }
+
+    m_bounds = LayerBounds(minX, minY, maxX, maxY);
+    return m_bounds;
+}
+
+void VectorsLayer::render(void* context)
+{
+    RenderContext* ctx = static_cast<RenderContext*>(context);
+    if (!ctx || !ctx->gl || m_origins.isEmpty()) {
+        return;
+    }
+
+    if (!ctx->instancing) {
+        if (!m_warnedNoInstancing) {
+            qWarning() << "VectorsLayer: instanced drawing needs OpenGL 3.3 or OpenGL ES 3.0";
+            m_warnedNoInstancing = true;
+        }
+        return;
+    }
+
+    QOpenGLFunctions* gl = ctx->gl;
+    QOpenGLExtraFunctions* extra = ctx->instancing;
+
+    if (m_glContext != ctx->glContext) {
+        // Resources from another context cannot be reused
+        delete m_program;
+        m_program = nullptr;
+        m_endpointBuffer.invalidate();
+        m_originBuffer.invalidate();
+        m_directionBuffer.invalidate();
+        m_colorBuffer.invalidate();
+        m_glContext = ctx->glContext;
+    }
+
+    if (!m_program && !initializeResources(gl)) {
+        return;
+    }
+
+    m_originBuffer.sync(gl, m_origins.constData(), qint64(m_origins.size()) * sizeof(QVector3D));
+    m_directionBuffer.sync(gl, m_directions.constData(), qint64(m_directions.size()) * sizeof(QVector3D));
+    m_colorBuffer.sync(gl, m_colors.constData(), qint64(m_colors.size()) * sizeof(quint32));
+
+    m_program->bind();
+    m_program->setUniformValue("u_mvp", ctx->viewProjectionMatrix());
+    m_program->setUniformValue("u_lengthScale", m_lengthScale);
+    m_program->setUniformValue("u_opacity", m_opacity);
+
+    m_endpointBuffer.bindAttribute(gl, EndpointAttribute, 1);
+    m_originBuffer.bindAttribute(gl, OriginAttribute, 3);
+    m_directionBuffer.bindAttribute(gl, DirectionAttribute, 3);
+    m_colorBuffer.bindAttribute(gl, ColorAttribute, 4, GL_UNSIGNED_BYTE, true);
+
+    extra->glVertexAttribDivisor(OriginAttribute, 1);
+    extra->glVertexAttribDivisor(DirectionAttribute, 1);
+    extra->glVertexAttribDivisor(ColorAttribute, 1);
+
+    extra->glDrawArraysInstanced(GL_LINES, 0, 2, m_origins.size());
+
+    // Attribute state is global; leave it as other layers expect it
+    for (GLuint location = EndpointAttribute; location <= ColorAttribute; ++location) {
+        extra->glVertexAttribDivisor(location, 0);
+        gl->glDisableVertexAttribArray(location);
+    }
+    gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_program->release();
+}
+
+void VectorsLayer::releaseGraphicsResources()
+{
+    QOpenGLContext* current = QOpenGLContext::currentContext();
+    if (!current || current != m_glContext) {
+        return;
+    }
+
+    QOpenGLFunctions* gl = current->functions();
+    m_endpointBuffer.destroy(gl);
+    m_originBuffer.destroy(gl);
+    m_directionBuffer.destroy(gl);
+    m_colorBuffer.destroy(gl);
+    delete m_program;
+    m_program = nullptr;
+    m_glContext = nullptr;
+}
+
+bool VectorsLayer::initializeResources(QOpenGLFunctions* gl)
+{
+    m_program = new QOpenGLShaderProgram();
+    m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, kVertexShader);
+    m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, kFragmentShader);
+    m_program->bindAttributeLocation("a_endpoint", EndpointAttribute);
+    m_program->bindAttributeLocation("a_origin", OriginAttribute);
+    m_program->bindAttributeLocation("a_direction", DirectionAttribute);
+    m_program->bindAttributeLocation("a_color", ColorAttribute);
+
+    if (!m_program->link()) {
+        qWarning() << "VectorsLayer: failed to link shader program:" << m_program->log();
+        delete m_program;
+        m_program = nullptr;
+        return false;
+    }
+
+    m_endpointBuffer.sync(gl, kEndpoints, sizeof(kEndpoints));
+    return true;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "LayerManager.h"
+#include "GpuBuffer.h"
+#include <QColor>
+#include <QVector>
+#include <QVector3D>
+
+class QOpenGLContext;
+class QOpenGLShaderProgram;
+
+/**
+ * @brief Layer drawing vector fields as line segments in one draw call
+ *
+ * Each vector is an origin and a direction; its segment runs from the
+ * origin to origin + direction * lengthScale(). Origins, directions and
+ * colors are separate arrays with one GPU buffer each, and every vector
+ * is an instance of a two-vertex line, so changing the length scale costs
+ * no upload at all.
+ */
+class VectorsLayer : public Layer
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * @param name Layer name
+     * @param parent Parent object
+     */
+    explicit VectorsLayer(const QString& name, QObject* parent = nullptr);
+
+    /**
+     * @brief Destructor
+     */
+    ~VectorsLayer();
+
+    /**
+     * @brief Get number of vectors
+     * @return Vector count
+     */
+    int vectorCount() const { return m_origins.size(); }
+
+    /**
+     * @brief Get vector origins
+     * @return Origins in world coordinates
+     */
+    const QVector<QVector3D>& origins() const { return m_origins; }
+
+    /**
+     * @brief Get vector directions
+     * @return Directions in world units
+     */
+    const QVector<QVector3D>& directions() const { return m_directions; }
+
+    /**
+     * @brief Get color of a vector
+     * @param index Vector index
+     * @return Color
+     */
+    QColor vectorColor(int index) const;
+
+    /**
+     * @brief Replace all vectors
+     *
+     * Colors are reset to the default color.
+     *
+     * @param origins Origins in world coordinates
+     * @param directions Directions, one per origin
+     */
+    void setVectors(const QVector<QVector3D>& origins, const QVector<QVector3D>& directions);
+
+    /**
+     * @brief Append vectors with the default color
+     * @param origins Origins in world coordinates
+     * @param directions Directions, one per origin
+     */
+    void appendVectors(const QVector<QVector3D>& origins, const QVector<QVector3D>& directions);
+
+    /**
+     * @brief Remove all vectors
+     */
+    void clearVectors();
+
+    /**
+     * @brief Change a single vector
+     * @param index Vector index
+     * @param origin New origin
+     * @param direction New direction
+     */
+    void setVector(int index, const QVector3D& origin, const QVector3D& direction);
+
+    /**
+     * @brief Set color of a vector
+     * @param index Vector index
+     * @param color Color
+     */
+    void setVectorColor(int index, const QColor& color);
+
+    /**
+     * @brief Set colors of all vectors
+     * @param colors One color per vector
+     */
+    void setColors(const QVector<QColor>& colors);
+
+    /**
+     * @brief Get color given to new vectors
+     * @return Color
+     */
+    QColor defaultColor() const { return unpackVertexColor(m_defaultColor); }
+
+    /**
+     * @brief Set color given to new vectors
+     * @param color Color
+     */
+    void setDefaultColor(const QColor& color) { m_defaultColor = packVertexColor(color); }
+
+    /**
+     * @brief Get length scale
+     * @return Factor applied to every direction
+     */
+    float lengthScale() const { return m_lengthScale; }
+
+    /**
+     * @brief Set length scale
+     * @param scale Factor applied to every direction
+     */
+    void setLengthScale(float scale);
+
+    // Layer interface implementation
+
+    /**
+     * @brief Get vectors as a float32 DataBuffer of shape [count, 2, 3]
+     * @return QVariant holding a copy of origins and directions
+     */
+    QVariant data() const override;
+    void setData(const QVariant& data) override;
+
+    /**
+     * @brief Set vectors from a buffer of shape [count, 2, 2] or [count, 2, 3]
+     *
+     * Element [i, 0] is the origin and [i, 1] the direction of vector i,
+     * each as x, y and optionally z; any numeric type is accepted.
+     *
+     * @param buffer Data buffer
+     * @return true if the buffer was accepted
+     */
+    bool setBuffer(const DataBuffer& buffer) override;
+
+    LayerBounds bounds() const override;
+    void render(void* context) override;
+    void releaseGraphicsResources() override;
+
+private:
+    /**
+     * @brief Create shader program and the shared endpoint buffer
+     * @param gl OpenGL functions
+     * @return true if successful
+     */
+    bool initializeResources(QOpenGLFunctions* gl);
+
+private:
+    // Vector attributes, one entry per vector
+    QVector<QVector3D> m_origins;
+    QVector<QVector3D> m_directions;
+    QVector<quint32> m_colors;
+
+    quint32 m_defaultColor;
+    float m_lengthScale;
+
+    // Bounds are recomputed lazily after changes
+    mutable LayerBounds m_bounds;
+    mutable bool m_boundsDirty;
+
+    // GPU resources
+    QOpenGLContext* m_glContext;
+    QOpenGLShaderProgram* m_program;
+    GpuBuffer m_endpointBuffer;
+    GpuBuffer m_originBuffer;
+    GpuBuffer m_directionBuffer;
+    GpuBuffer m_colorBuffer;
+    bool m_warnedNoInstancing;
+};
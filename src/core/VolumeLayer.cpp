@@ -0,0 +1,715 @@
+#include "VolumeLayer.h"
+#include "RenderContext.h"
+
+#include <QDebug>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include <QtMath>
+#include <algorithm>
+#include <limits>
+
+#ifndef GL_R16
+#define GL_R16 0x822A
+#endif
+
+namespace {
+
+// Upload granularity; keeps the staging copy small for large volumes
+const qint64 kSlabBytes = 64 * 1024 * 1024;
+
+// Volumes whose 16-bit texture would exceed this are uploaded with 8 bits
+const qint64 kMax16BitTextureBytes = qint64(1024) * 1024 * 1024;
+
+// Resolution and step used while the view is moving
+const qreal kInteractiveScale = 0.5;
+const float kInteractiveStepScale = 2.0f;
+
+// Ray casting shader drawn on a full screen quad. Rays are intersected with
+// the volume box in texture space; samples inside blocks that cannot change
+// the result are skipped using the occupancy grid, which holds the dilated
+// maximum of every block.
+const char* kRaymarchShader =
+    "#ifdef GL_ES\n"
+    "precision highp float;\n"
+    "#endif\n"
+    "uniform sampler3D u_volume;\n"
+    "uniform sampler3D u_occupancy;\n"
+    "uniform mat4 u_inverseMvp;\n"
+    "uniform vec3 u_size;\n"
+    "uniform vec3 u_blockScale;\n"
+    "uniform vec3 u_occupancySize;\n"
+    "uniform float u_stepSize;\n"
+    "uniform int u_mode;\n"
+    "uniform float u_low;\n"
+    "uniform float u_high;\n"
+    "uniform float u_iso;\n"
+    "uniform float u_attenuation;\n"
+    "uniform vec3 u_color;\n"
+    "uniform float u_opacity;\n"
+    "varying vec2 v_texCoord;\n"
+    "const int kMaxSteps = 4096;\n"
+    "vec3 unproject(float depth)\n"
+    "{\n"
+    "    vec4 p = u_inverseMvp * vec4(v_texCoord * 2.0 - 1.0, depth, 1.0);\n"
+    "    return p.xyz / p.w;\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 origin = unproject(-1.0);\n"
+    "    vec3 dir = unproject(1.0) - origin;\n"
+    "    vec3 safeDir = dir + 1e-7 * vec3(equal(dir, vec3(0.0)));\n"
+    "    vec3 t0 = -origin / safeDir;\n"
+    "    vec3 t1 = (vec3(1.0) - origin) / safeDir;\n"
+    "    vec3 tMin = min(t0, t1);\n"
+    "    vec3 tMax = max(t0, t1);\n"
+    "    float tNear = max(max(tMin.x, tMin.y), max(tMin.z, 0.0));\n"
+    "    float tFar = min(min(tMax.x, tMax.y), min(tMax.z, 1.0));\n"
+    "    if (tNear >= tFar) {\n"
+    "        discard;\n"
+    "    }\n"
+    "    float dt = u_stepSize / length(dir * u_size);\n"
+    "    float range = max(u_high - u_low, 1e-6);\n"
+    "    vec3 blockDir = safeDir * u_blockScale;\n"
+    "    float t = tNear + 0.5 * dt;\n"
+    "    float best = 0.0;\n"
+    "    float sum = 0.0;\n"
+    "    bool hit = false;\n"
+    "    for (int i = 0; i < kMaxSteps; ++i) {\n"
+    "        if (t > tFar) {\n"
+    "            break;\n"
+    "        }\n"
+    "        vec3 p = origin + dir * t;\n"
+    "        vec3 block = p * u_blockScale;\n"
+    "        vec3 cell = floor(block);\n"
+    "        float occupancy = texture3D(u_occupancy, (cell + 0.5) / u_occupancySize).r;\n"
+    "        float skipBelow = u_mode == 2 ? u_iso : (u_mode == 0 ? u_low + best * range : u_low);\n"
+    "        if (occupancy <= skipBelow) {\n"
+    "            vec3 exitT = (cell + step(0.0, dir) - block) / blockDir;\n"
+    "            t += max(min(min(exitT.x, exitT.y), exitT.z), 0.0) + 0.5 * dt;\n"
+    "            continue;\n"
+    "        }\n"
+    "        float value = texture3D(u_volume, p).r;\n"
+    "        if (u_mode == 2) {\n"
+    "            if (value >= u_iso) {\n"
+    "                hit = true;\n"
+    "                break;\n"
+    "            }\n"
+    "        } else {\n"
+    "            float intensity = clamp((value - u_low) / range, 0.0, 1.0);\n"
+    "            if (u_mode == 0) {\n"
+    "                best = max(best, intensity);\n"
+    "                if (best >= 1.0) {\n"
+    "                    break;\n"
+    "                }\n"
+    "            } else {\n"
+    "                float weight = exp(-u_attenuation * sum);\n"
+    "                best = max(best, intensity * weight);\n"
+    "                sum += intensity * u_stepSize;\n"
+    "                if (weight <= best) {\n"
+    "                    break;\n"
+    "                }\n"
+    "            }\n"
+    "        }\n"
+    "        t += dt;\n"
+    "    }\n"
+    "    if (u_mode != 2) {\n"
+    "        if (best <= 0.0) {\n"
+    "            discard;\n"
+    "        }\n"
+    "        gl_FragColor = vec4(u_color, best * u_opacity);\n"
+    "        return;\n"
+    "    }\n"
+    "    if (!hit) {\n"
+    "        discard;\n"
+    "    }\n"
+    "    float a = max(t - dt, tNear);\n"
+    "    float b = t;\n"
+    "    for (int j = 0; j < 6; ++j) {\n"
+    "        float m = 0.5 * (a + b);\n"
+    "        if (texture3D(u_volume, origin + dir * m).r >= u_iso) {\n"
+    "            b = m;\n"
+    "        } else {\n"
+    "            a = m;\n"
+    "        }\n"
+    "    }\n"
+    "    vec3 p = origin + dir * b;\n"
+    "    vec3 e = 1.0 / u_size;\n"
+    "    vec3 gradient = vec3(\n"
+    "        texture3D(u_volume, p + vec3(e.x, 0.0, 0.0)).r - texture3D(u_volume, p - vec3(e.x, 0.0, 0.0)).r,\n"
+    "        texture3D(u_volume, p + vec3(0.0, e.y, 0.0)).r - texture3D(u_volume, p - vec3(0.0, e.y, 0.0)).r,\n"
+    "        texture3D(u_volume, p + vec3(0.0, 0.0, e.z)).r - texture3D(u_volume, p - vec3(0.0, 0.0, e.z)).r);\n"
+    "    float magnitude = length(gradient);\n"
+    "    float diffuse = magnitude > 0.0 ? abs(dot(gradient / magnitude, normalize(dir * u_size))) : 1.0;\n"
+    "    gl_FragColor = vec4(u_color * (0.25 + 0.75 * diffuse), u_opacity);\n"
+    "}\n";
+
+/**
+ * @brief Find the finite value range of a 3D buffer
+ */
+template<typename T>
+void scanRange(const DataBuffer& buffer, double& low, double& high)
+{
+    const qint64 depth = buffer.shape(0);
+    const qint64 height = buffer.shape(1);
+    const qint64 width = buffer.shape(2);
+    const QVector<qint64>& strides = buffer.strides();
+    const uchar* base = buffer.constData();
+
+    low = std::numeric_limits<double>::max();
+    high = std::numeric_limits<double>::lowest();
+    for (qint64 z = 0; z < depth; ++z) {
+        for (qint64 y = 0; y < height; ++y) {
+            const uchar* row = base + z * strides[0] + y * strides[1];
+            for (qint64 x = 0; x < width; ++x) {
+                const double value = double(*reinterpret_cast<const T*>(row + x * strides[2]));
+                if (qIsFinite(value)) {
+                    low = qMin(low, value);
+                    high = qMax(high, value);
+                }
+            }
+        }
+    }
+    if (low > high) {
+        low = high = 0.0;
+    }
+}
+
+/**
+ * @brief Resample slices of a 3D buffer into texture values
+ *
+ * Every factor-th voxel along each axis is taken; values are mapped from
+ * [offset, offset + scale] to [0, maximum of Out]. The maximum of every
+ * VolumeLayer::kOccupancyBlock block, quantized up to 8 bits, is merged
+ * into occupancy.
+ */
+template<typename T, typename Out>
+void sampleSlab(const DataBuffer& buffer, int factor, int firstSlice, int slices,
+                int width, int height, double offset, double scale,
+                Out* out, QVector<quint8>& occupancy, int blocksX, int blocksY)
+{
+    const QVector<qint64>& strides = buffer.strides();
+    const uchar* base = buffer.constData();
+    const double outMax = double(std::numeric_limits<Out>::max());
+    const double toTexel = scale > 0.0 ? outMax / scale : 0.0;
+    const int block = VolumeLayer::kOccupancyBlock;
+
+    for (int z = firstSlice; z < firstSlice + slices; ++z) {
+        quint8* occupancySlice = occupancy.data() + qint64(z / block) * blocksX * blocksY;
+        for (int y = 0; y < height; ++y) {
+            const uchar* row = base + qint64(z) * factor * strides[0] + qint64(y) * factor * strides[1];
+            quint8* occupancyRow = occupancySlice + (y / block) * blocksX;
+            for (int x = 0; x < width; ++x) {
+                const double value = double(*reinterpret_cast<const T*>(row + qint64(x) * factor * strides[2]));
+                const Out texel = qIsFinite(value)
+                                ? Out(qBound(0.0, (value - offset) * toTexel + 0.5, outMax))
+                                : Out(0);
+                *out++ = texel;
+
+                const quint8 level = quint8((quint32(texel) * 255 + quint32(outMax) - 1) / quint32(outMax));
+                quint8& blockMax = occupancyRow[x / block];
+                blockMax = qMax(blockMax, level);
+            }
+        }
+    }
+}
+
+template<typename Out>
+void sampleVolumeSlab(const DataBuffer& buffer, int factor, int firstSlice, int slices,
+                int width, int height, double offset, double scale,
+                Out* out, QVector<quint8>& occupancy, int blocksX, int blocksY)
+{
+    switch (buffer.dtype()) {
+    case DataType::UInt8:   sampleSlab<quint8>(buffer, factor, firstSlice, slices, width, height, offset, scale, out, occupancy, blocksX, blocksY); break;
+    case DataType::UInt16:  sampleSlab<quint16>(buffer, factor, firstSlice, slices, width, height, offset, scale, out, occupancy, blocksX, blocksY); break;
+    case DataType::UInt32:  sampleSlab<quint32>(buffer, factor, firstSlice, slices, width, height, offset, scale, out, occupancy, blocksX, blocksY); break;
+    case DataType::Int8:    sampleSlab<qint8>(buffer, factor, firstSlice, slices, width, height, offset, scale, out, occupancy, blocksX, blocksY); break;
+    case DataType::Int16:   sampleSlab<qint16>(buffer, factor, firstSlice, slices, width, height, offset, scale, out, occupancy, blocksX, blocksY); break;
+    case DataType::Int32:   sampleSlab<qint32>(buffer, factor, firstSlice, slices, width, height, offset, scale, out, occupancy, blocksX, blocksY); break;
+    case DataType::Float32: sampleSlab<float>(buffer, factor, firstSlice, slices, width, height, offset, scale, out, occupancy, blocksX, blocksY); break;
+    case DataType::Float64: sampleSlab<double>(buffer, factor, firstSlice, slices, width, height, offset, scale, out, occupancy, blocksX, blocksY); break;
+    default:                break;
+    }
+}
+
+/**
+ * @brief Spread every block's maximum to its 26 neighbours
+ *
+ * Trilinear sampling near a block face reads voxels of the neighbouring
+ * block, so a block may only be skipped if its neighbours are empty too.
+ */
+QVector<quint8> dilateOccupancy(const QVector<quint8>& occupancy, int blocksX, int blocksY, int blocksZ)
+{
+    QVector<quint8> result(occupancy.size(), 0);
+    for (int z = 0; z < blocksZ; ++z) {
+        for (int y = 0; y < blocksY; ++y) {
+            for (int x = 0; x < blocksX; ++x) {
+                quint8 level = 0;
+                for (int nz = qMax(0, z - 1); nz <= qMin(blocksZ - 1, z + 1); ++nz) {
+                    for (int ny = qMax(0, y - 1); ny <= qMin(blocksY - 1, y + 1); ++ny) {
+                        for (int nx = qMax(0, x - 1); nx <= qMin(blocksX - 1, x + 1); ++nx) {
+                            level = qMax(level, occupancy[(nz * blocksY + ny) * blocksX + nx]);
+                        }
+                    }
+                }
+                result[(z * blocksY + y) * blocksX + x] = level;
+            }
+        }
+    }
+    return result;
+}
+
+double rangeOf(const DataBuffer& buffer, double* high)
+{
+    double low = 0.0;
+    *high = 0.0;
+    switch (buffer.dtype()) {
+    case DataType::UInt8:   scanRange<quint8>(buffer, low, *high); break;
+    case DataType::UInt16:  scanRange<quint16>(buffer, low, *high); break;
+    case DataType::UInt32:  scanRange<quint32>(buffer, low, *high); break;
+    case DataType::Int8:    scanRange<qint8>(buffer, low, *high); break;
+    case DataType::Int16:   scanRange<qint16>(buffer, low, *high); break;
+    case DataType::Int32:   scanRange<qint32>(buffer, low, *high); break;
+    case DataType::Float32: scanRange<float>(buffer, low, *high); break;
+    case DataType::Float64: scanRange<double>(buffer, low, *high); break;
+    default:                break;
+    }
+    return low;
+}
+
+} // namespace
+
+VolumeLayer::VolumeLayer(const QString& name, QObject* parent)
+    : Layer(name, LayerType::Volume, parent)
+    , m_bufferVersion(0)
+    , m_dataMin(0.0)
+    , m_dataMax(0.0)
+    , m_renderMode(RenderMode::Mip)
+    , m_contrastLow(0.0)
+    , m_contrastHigh(1.0)
+    , m_isoValue(0.5)
+    , m_attenuation(0.05f)
+    , m_color(Qt::white)
+    , m_stepSize(1.0f)
+    , m_position(0.0, 0.0)
+    , m_spacing(1.0f, 1.0f, 1.0f)
+    , m_textureOffset(0.0)
+    , m_textureScale(1.0)
+    , m_glContext(nullptr)
+    , m_volumeTexture(0)
+    , m_occupancyTexture(0)
+    , m_max3DTextureSize(0)
+    , m_needsUpload(true)
+    , m_unsupported(false)
+{
+}
+
+VolumeLayer::~VolumeLayer()
+{
+    // GPU resources are released by the viewer through releaseGraphicsResources()
+}
+
+void VolumeLayer::setRenderMode(RenderMode mode)
+{
+    if (m_renderMode != mode) {
+        m_renderMode = mode;
+        emit changed();
+    }
+}
+
+void VolumeLayer::setContrastLimits(double low, double high)
+{
+    if (m_contrastLow != low || m_contrastHigh != high) {
+        m_contrastLow = low;
+        m_contrastHigh = high;
+        emit changed();
+    }
+}
+
+void VolumeLayer::setIsoValue(double value)
+{
+    if (m_isoValue != value) {
+        m_isoValue = value;
+        emit changed();
+    }
+}
+
+void VolumeLayer::setAttenuation(float attenuation)
+{
+    attenuation = qMax(0.0f, attenuation);
+    if (m_attenuation != attenuation) {
+        m_attenuation = attenuation;
+        emit changed();
+    }
+}
+
+void VolumeLayer::setColor(const QColor& color)
+{
+    if (m_color != color) {
+        m_color = color;
+        emit changed();
+    }
+}
+
+void VolumeLayer::setStepSize(float voxels)
+{
+    voxels = qMax(0.25f, voxels);
+    if (m_stepSize != voxels) {
+        m_stepSize = voxels;
+        emit changed();
+    }
+}
+
+void VolumeLayer::setPosition(const QPointF& position)
+{
+    if (m_position != position) {
+        m_position = position;
+        emit changed();
+    }
+}
+
+void VolumeLayer::setSpacing(const QVector3D& spacing)
+{
+    if (m_spacing != spacing && spacing.x() > 0.0f && spacing.y() > 0.0f && spacing.z() > 0.0f) {
+        m_spacing = spacing;
+        emit changed();
+    }
+}
+
+QVariant VolumeLayer::data() const
+{
+    return QVariant::fromValue(m_buffer);
+}
+
+void VolumeLayer::setData(const QVariant& data)
+{
+    if (data.userType() == qMetaTypeId<DataBuffer>()) {
+        setBuffer(data.value<DataBuffer>());
+    }
+}
+
+bool VolumeLayer::setBuffer(const DataBuffer& buffer)
+{
+    const DataType type = buffer.dtype();
+    if (buffer.isNull() || buffer.ndim() != 3 || dataTypeSize(type) == 0 || buffer.elementCount() == 0) {
+        qWarning() << "VolumeLayer: unsupported buffer" << dataTypeName(type) << buffer.shape();
+        return false;
+    }
+
+    const bool sameView = buffer.isSameView(m_buffer);
+    if (sameView && buffer.version() == m_bufferVersion) {
+        return true;
+    }
+
+    m_dataMin = rangeOf(buffer, &m_dataMax);
+    if (!sameView) {
+        // New data starts with contrast limits spanning its values
+        m_contrastLow = m_dataMin;
+        m_contrastHigh = m_dataMax > m_dataMin ? m_dataMax : m_dataMin + 1.0;
+        m_isoValue = 0.5 * (m_contrastLow + m_contrastHigh);
+    }
+
+    m_buffer = buffer;
+    m_bufferVersion = buffer.version();
+    m_needsUpload = true;
+    markDataChanged();
+    return true;
+}
+
+LayerBounds VolumeLayer::bounds() const
+{
+    if (m_buffer.isNull()) {
+        return LayerBounds();
+    }
+
+    return LayerBounds(float(m_position.x()),
+                       float(m_position.y()),
+                       float(m_position.x() + m_buffer.shape(2) * m_spacing.x()),
+                       float(m_position.y() + m_buffer.shape(1) * m_spacing.y()));
+}
+
+void VolumeLayer::render(void* context)
+{
+    RenderContext* ctx = static_cast<RenderContext*>(context);
+    if (!ctx || !ctx->gl || m_buffer.isNull() || m_unsupported) {
+        return;
+    }
+
+    QOpenGLFunctions* gl = ctx->gl;
+
+    if (m_glContext != ctx->glContext) {
+        // Resources from another context cannot be reused
+        m_volumeTexture = 0;
+        m_occupancyTexture = 0;
+        m_lowResTarget.reset();
+        m_rayQuad.invalidate();
+        m_compositeQuad.invalidate();
+        m_glContext = ctx->glContext;
+        m_needsUpload = true;
+    }
+
+    if (!m_rayQuad.isCreated() && !initializeResources(ctx)) {
+        return;
+    }
+
+    if (m_needsUpload && !uploadVolume(gl, ctx->glContext->extraFunctions())) {
+        return;
+    }
+
+    if (!ctx->interactive || ctx->viewportSize.isEmpty()) {
+        m_lowResTarget.reset();
+        drawRays(ctx, false);
+        return;
+    }
+
+    // While the view moves, cast a quarter of the rays and upscale
+    const QSize lowResSize(qMax(1, qRound(ctx->viewportSize.width() * kInteractiveScale)),
+                           qMax(1, qRound(ctx->viewportSize.height() * kInteractiveScale)));
+    if (!m_lowResTarget || m_lowResTarget->size() != lowResSize) {
+        m_lowResTarget.reset(new QOpenGLFramebufferObject(lowResSize));
+        gl->glBindTexture(GL_TEXTURE_2D, m_lowResTarget->texture());
+        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        gl->glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4] = {0, 0, 0, 0};
+    gl->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    gl->glGetIntegerv(GL_VIEWPORT, previousViewport);
+    const bool blending = gl->glIsEnabled(GL_BLEND);
+
+    m_lowResTarget->bind();
+    gl->glViewport(0, 0, lowResSize.width(), lowResSize.height());
+    gl->glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    gl->glClear(GL_COLOR_BUFFER_BIT);
+    gl->glDisable(GL_BLEND);
+    drawRays(ctx, true);
+
+    gl->glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer));
+    gl->glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    if (blending) {
+        gl->glEnable(GL_BLEND);
+    }
+
+    const bool depthTest = gl->glIsEnabled(GL_DEPTH_TEST);
+    gl->glDisable(GL_DEPTH_TEST);
+    m_compositeQuad.begin(gl, QMatrix4x4(), 1.0f);
+    m_compositeQuad.draw(m_lowResTarget->texture(), QRectF(-1.0, 1.0, 2.0, -2.0));
+    m_compositeQuad.end();
+    if (depthTest) {
+        gl->glEnable(GL_DEPTH_TEST);
+    }
+}
+
+void VolumeLayer::releaseGraphicsResources()
+{
+    QOpenGLContext* current = QOpenGLContext::currentContext();
+    if (!current || current != m_glContext) {
+        return;
+    }
+
+    deleteTextures(current->functions());
+    m_rayQuad.destroy();
+    m_compositeQuad.destroy();
+    m_glContext = nullptr;
+    m_needsUpload = true;
+}
+
+bool VolumeLayer::initializeResources(RenderContext* ctx)
+{
+    if (ctx->glContext->isOpenGLES()) {
+        // GL_R16 and texture3D() are desktop only
+        qWarning() << "VolumeLayer: volume rendering requires desktop OpenGL";
+        m_unsupported = true;
+        return false;
+    }
+
+    if (!m_rayQuad.create(kRaymarchShader) || !m_compositeQuad.create()) {
+        m_unsupported = true;
+        return false;
+    }
+
+    GLint maxSize = 0;
+    ctx->gl->glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxSize);
+    m_max3DTextureSize = qMax(16, int(maxSize));
+    return true;
+}
+
+bool VolumeLayer::uploadVolume(QOpenGLFunctions* gl, QOpenGLExtraFunctions* gl3)
+{
+    m_needsUpload = false;
+    deleteTextures(gl);
+
+    const int depth = int(m_buffer.shape(0));
+    const int height = int(m_buffer.shape(1));
+    const int width = int(m_buffer.shape(2));
+
+    // Keep every axis within the 3D texture limit
+    const int largest = qMax(width, qMax(height, depth));
+    const int factor = (largest + m_max3DTextureSize - 1) / m_max3DTextureSize;
+    if (factor > 1) {
+        qWarning() << "VolumeLayer:" << name() << "exceeds the 3D texture limit of"
+                   << m_max3DTextureSize << "and is drawn at 1 /" << factor << "resolution";
+    }
+    const int textureWidth = (width + factor - 1) / factor;
+    const int textureHeight = (height + factor - 1) / factor;
+    const int textureDepth = (depth + factor - 1) / factor;
+    const qint64 voxels = qint64(textureWidth) * textureHeight * textureDepth;
+
+    // 8-bit data is uploaded as is, everything else is mapped onto 16 bits
+    // (or 8 bits for very large volumes) between the data minimum and maximum
+    const DataType type = m_buffer.dtype();
+    const bool eightBit = type == DataType::UInt8 || voxels * 2 > kMax16BitTextureBytes;
+    if (type == DataType::UInt8) {
+        m_textureOffset = 0.0;
+        m_textureScale = 255.0;
+    } else if (type == DataType::UInt16 && !eightBit) {
+        m_textureOffset = 0.0;
+        m_textureScale = 65535.0;
+    } else {
+        m_textureOffset = m_dataMin;
+        m_textureScale = m_dataMax > m_dataMin ? m_dataMax - m_dataMin : 1.0;
+    }
+
+    const int blocksX = (textureWidth + kOccupancyBlock - 1) / kOccupancyBlock;
+    const int blocksY = (textureHeight + kOccupancyBlock - 1) / kOccupancyBlock;
+    const int blocksZ = (textureDepth + kOccupancyBlock - 1) / kOccupancyBlock;
+    QVector<quint8> occupancy(blocksX * blocksY * blocksZ, 0);
+
+    gl->glGenTextures(1, &m_volumeTexture);
+    gl->glBindTexture(GL_TEXTURE_3D, m_volumeTexture);
+    gl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    gl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    gl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    const GLenum pixelType = eightBit ? GL_UNSIGNED_BYTE : GL_UNSIGNED_SHORT;
+    gl3->glTexImage3D(GL_TEXTURE_3D, 0, eightBit ? GL_R8 : GL_R16,
+                      textureWidth, textureHeight, textureDepth, 0, GL_RED, pixelType, nullptr);
+    if (gl->glGetError() == GL_OUT_OF_MEMORY) {
+        qWarning() << "VolumeLayer: not enough GPU memory for" << name();
+        deleteTextures(gl);
+        return false;
+    }
+
+    // Upload in slabs of slices; block maxima are gathered on the way
+    const qint64 sliceBytes = qint64(textureWidth) * textureHeight * (eightBit ? 1 : 2);
+    const int slabSlices = int(qBound<qint64>(1, kSlabBytes / sliceBytes, textureDepth));
+    QByteArray staging;
+    for (int z = 0; z < textureDepth; z += slabSlices) {
+        const int slices = qMin(slabSlices, textureDepth - z);
+        staging.resize(int(sliceBytes * slices));
+        if (eightBit) {
+            sampleVolumeSlab(m_buffer, factor, z, slices, textureWidth, textureHeight, m_textureOffset, m_textureScale,
+                       reinterpret_cast<quint8*>(staging.data()), occupancy, blocksX, blocksY);
+        } else {
+            sampleVolumeSlab(m_buffer, factor, z, slices, textureWidth, textureHeight, m_textureOffset, m_textureScale,
+                       reinterpret_cast<quint16*>(staging.data()), occupancy, blocksX, blocksY);
+        }
+        gl3->glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, z, textureWidth, textureHeight, slices,
+                             GL_RED, pixelType, staging.constData());
+    }
+
+    const QVector<quint8> dilated = dilateOccupancy(occupancy, blocksX, blocksY, blocksZ);
+    gl->glGenTextures(1, &m_occupancyTexture);
+    gl->glBindTexture(GL_TEXTURE_3D, m_occupancyTexture);
+    gl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    gl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    gl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    gl3->glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, blocksX, blocksY, blocksZ, 0,
+                      GL_RED, GL_UNSIGNED_BYTE, dilated.constData());
+    gl->glBindTexture(GL_TEXTURE_3D, 0);
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    m_textureSize = QVector3D(textureWidth, textureHeight, textureDepth);
+    m_occupancySize = QVector3D(blocksX, blocksY, blocksZ);
+    return true;
+}
+
+void VolumeLayer::drawRays(RenderContext* ctx, bool coarse)
+{
+    QOpenGLFunctions* gl = ctx->gl;
+
+    bool invertible = false;
+    const QMatrix4x4 inverseMvp = (ctx->viewProjectionMatrix() * modelMatrix()).inverted(&invertible);
+    if (!invertible) {
+        return;
+    }
+
+    const bool depthTest = gl->glIsEnabled(GL_DEPTH_TEST);
+    gl->glDisable(GL_DEPTH_TEST);
+
+    m_rayQuad.begin(gl, QMatrix4x4(), m_opacity);
+    QOpenGLShaderProgram* program = m_rayQuad.program();
+    program->setUniformValue("u_volume", 1);
+    program->setUniformValue("u_occupancy", 2);
+    program->setUniformValue("u_inverseMvp", inverseMvp);
+    program->setUniformValue("u_size", m_textureSize);
+    program->setUniformValue("u_blockScale", m_textureSize / float(kOccupancyBlock));
+    program->setUniformValue("u_occupancySize", m_occupancySize);
+    program->setUniformValue("u_stepSize", coarse ? m_stepSize * kInteractiveStepScale : m_stepSize);
+    program->setUniformValue("u_mode", int(m_renderMode));
+    program->setUniformValue("u_low", normalized(m_contrastLow));
+    program->setUniformValue("u_high", normalized(m_contrastHigh));
+    program->setUniformValue("u_iso", normalized(m_isoValue));
+    program->setUniformValue("u_attenuation", m_attenuation);
+    program->setUniformValue("u_color", QVector3D(float(m_color.redF()), float(m_color.greenF()), float(m_color.blueF())));
+
+    gl->glActiveTexture(GL_TEXTURE1);
+    gl->glBindTexture(GL_TEXTURE_3D, m_volumeTexture);
+    gl->glActiveTexture(GL_TEXTURE2);
+    gl->glBindTexture(GL_TEXTURE_3D, m_occupancyTexture);
+    gl->glActiveTexture(GL_TEXTURE0);
+
+    // Full screen quad; v_texCoord * 2 - 1 is the fragment's NDC position
+    m_rayQuad.draw(0, QRectF(-1.0, 1.0, 2.0, -2.0));
+
+    gl->glActiveTexture(GL_TEXTURE2);
+    gl->glBindTexture(GL_TEXTURE_3D, 0);
+    gl->glActiveTexture(GL_TEXTURE1);
+    gl->glBindTexture(GL_TEXTURE_3D, 0);
+    gl->glActiveTexture(GL_TEXTURE0);
+    m_rayQuad.end();
+
+    if (depthTest) {
+        gl->glEnable(GL_DEPTH_TEST);
+    }
+}
+
+QMatrix4x4 VolumeLayer::modelMatrix() const
+{
+    // Texture coordinates (u, v, w) in [0, 1]^3 to world; v runs down the
+    // rows like ImageLayer and the slices are centered on z = 0
+    const float width = float(m_buffer.shape(2)) * m_spacing.x();
+    const float height = float(m_buffer.shape(1)) * m_spacing.y();
+    const float depth = float(m_buffer.shape(0)) * m_spacing.z();
+
+    QMatrix4x4 model;
+    model.translate(float(m_position.x()), float(m_position.y()) + height, -0.5f * depth);
+    model.scale(width, -height, depth);
+    return model;
+}
+
+float VolumeLayer::normalized(double value) const
+{
+    return float((value - m_textureOffset) / m_textureScale);
+}
+
+void VolumeLayer::deleteTextures(QOpenGLFunctions* gl)
+{
+    if (m_volumeTexture) {
+        gl->glDeleteTextures(1, &m_volumeTexture);
+        m_volumeTexture = 0;
+    }
+    if (m_occupancyTexture) {
+        gl->glDeleteTextures(1, &m_occupancyTexture);
+        m_occupancyTexture = 0;
+    }
+    m_lowResTarget.reset();
+}
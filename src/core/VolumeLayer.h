@@ -0,0 +1,252 @@
+#pragma once
+
+#include "LayerManager.h"
+#include "TexturedQuad.h"
+#include <QColor>
+#include <QOpenGLFunctions>
+#include <QPointF>
+#include <QSize>
+#include <QVector3D>
+#include <memory>
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+class QOpenGLFramebufferObject;
+struct RenderContext;
+
+/**
+ * @brief Scalar volume rendered by GPU ray marching
+ *
+ * The volume (a [depth, height, width] buffer) is uploaded once into a 3D
+ * texture, together with a coarse occupancy grid holding the maximum of
+ * every kOccupancyBlock^3 block. A fragment shader marches one ray per
+ * pixel through the volume's box and skips blocks that cannot change the
+ * result: blocks below the contrast or iso threshold in every mode, and in
+ * MIP mode blocks no brighter than the maximum found so far. Rays stop
+ * early when the result cannot change any more.
+ *
+ * While the view is moving (RenderContext::interactive) the layer renders
+ * at reduced resolution with a coarser step and the viewer refines the
+ * image once the interaction stops.
+ *
+ * World placement follows ImageLayer: x and y are in pixels from
+ * position() with row 0 at the top; slices are stacked along z, centered
+ * on z = 0.
+ */
+class VolumeLayer : public Layer
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Ray compositing mode
+     */
+    enum class RenderMode {
+        Mip,            ///< Maximum intensity projection
+        AttenuatedMip,  ///< MIP where samples behind bright ones are attenuated
+        Isosurface      ///< First crossing of the iso value, shaded
+    };
+
+    // Edge length of occupancy grid blocks in voxels
+    static constexpr int kOccupancyBlock = 16;
+
+    /**
+     * @brief Constructor
+     * @param name Layer name
+     * @param parent Parent object
+     */
+    explicit VolumeLayer(const QString& name, QObject* parent = nullptr);
+
+    /**
+     * @brief Destructor
+     */
+    ~VolumeLayer();
+
+    /**
+     * @brief Get rendering mode
+     * @return Mode
+     */
+    RenderMode renderMode() const { return m_renderMode; }
+
+    /**
+     * @brief Set rendering mode
+     * @param mode Mode
+     */
+    void setRenderMode(RenderMode mode);
+
+    /**
+     * @brief Get values mapped to transparent and fully bright
+     * @return Low and high limit in data units
+     */
+    QPair<double, double> contrastLimits() const { return qMakePair(m_contrastLow, m_contrastHigh); }
+
+    /**
+     * @brief Set values mapped to transparent and fully bright
+     * @param low Low limit in data units
+     * @param high High limit in data units
+     */
+    void setContrastLimits(double low, double high);
+
+    /**
+     * @brief Get iso value of Isosurface mode
+     * @return Value in data units
+     */
+    double isoValue() const { return m_isoValue; }
+
+    /**
+     * @brief Set iso value of Isosurface mode
+     * @param value Value in data units
+     */
+    void setIsoValue(double value);
+
+    /**
+     * @brief Get attenuation of AttenuatedMip mode
+     * @return Attenuation per voxel of full intensity
+     */
+    float attenuation() const { return m_attenuation; }
+
+    /**
+     * @brief Set attenuation of AttenuatedMip mode
+     * @param attenuation Attenuation per voxel of full intensity
+     */
+    void setAttenuation(float attenuation);
+
+    /**
+     * @brief Get colour of bright voxels and surfaces
+     * @return Colour
+     */
+    QColor color() const { return m_color; }
+
+    /**
+     * @brief Set colour of bright voxels and surfaces
+     * @param color Colour
+     */
+    void setColor(const QColor& color);
+
+    /**
+     * @brief Get ray step
+     * @return Step in voxels
+     */
+    float stepSize() const { return m_stepSize; }
+
+    /**
+     * @brief Set ray step
+     * @param voxels Step in voxels (at least 0.25)
+     */
+    void setStepSize(float voxels);
+
+    /**
+     * @brief Get world position of the volume's bottom-left corner
+     * @return Position in world coordinates
+     */
+    QPointF position() const { return m_position; }
+
+    /**
+     * @brief Set world position of the volume's bottom-left corner
+     * @param position Position in world coordinates
+     */
+    void setPosition(const QPointF& position);
+
+    /**
+     * @brief Get voxel size
+     * @return World units per voxel along x, y and z
+     */
+    QVector3D spacing() const { return m_spacing; }
+
+    /**
+     * @brief Set voxel size, e.g. for anisotropic stacks
+     * @param spacing World units per voxel along x, y and z
+     */
+    void setSpacing(const QVector3D& spacing);
+
+    /**
+     * @brief Get the value range of the data
+     * @return Minimum and maximum in data units
+     */
+    QPair<double, double> dataRange() const { return qMakePair(m_dataMin, m_dataMax); }
+
+    // Layer interface implementation
+    QVariant data() const override;
+    void setData(const QVariant& data) override;
+    DataBuffer buffer() const override { return m_buffer; }
+    bool setBuffer(const DataBuffer& buffer) override;
+    LayerBounds bounds() const override;
+    void render(void* context) override;
+    void releaseGraphicsResources() override;
+
+private:
+    /**
+     * @brief Create shaders and query limits
+     * @param ctx Render context
+     * @return true if volumes can be rendered
+     */
+    bool initializeResources(RenderContext* ctx);
+
+    /**
+     * @brief Upload the volume and its occupancy grid
+     * @param gl OpenGL functions
+     * @param gl3 OpenGL 3 functions
+     * @return true if successful
+     */
+    bool uploadVolume(QOpenGLFunctions* gl, QOpenGLExtraFunctions* gl3);
+
+    /**
+     * @brief Cast rays into the bound framebuffer
+     * @param ctx Render context
+     * @param coarse true for the interactive step
+     */
+    void drawRays(RenderContext* ctx, bool coarse);
+
+    /**
+     * @brief Get the transform from texture coordinates to world
+     * @return Model matrix
+     */
+    QMatrix4x4 modelMatrix() const;
+
+    /**
+     * @brief Map a data value to the texture's [0, 1] range
+     * @param value Value in data units
+     * @return Normalized value
+     */
+    float normalized(double value) const;
+
+    /**
+     * @brief Delete textures and framebuffers
+     * @param gl OpenGL functions
+     */
+    void deleteTextures(QOpenGLFunctions* gl);
+
+private:
+    DataBuffer m_buffer;
+    quint64 m_bufferVersion;
+    double m_dataMin;
+    double m_dataMax;
+
+    // Appearance
+    RenderMode m_renderMode;
+    double m_contrastLow;
+    double m_contrastHigh;
+    double m_isoValue;
+    float m_attenuation;
+    QColor m_color;
+    float m_stepSize;
+    QPointF m_position;
+    QVector3D m_spacing;
+
+    // Texture value v corresponds to m_textureOffset + v * m_textureScale
+    double m_textureOffset;
+    double m_textureScale;
+
+    // GPU resources
+    QOpenGLContext* m_glContext;
+    TexturedQuad m_rayQuad;
+    TexturedQuad m_compositeQuad;
+    std::unique_ptr<QOpenGLFramebufferObject> m_lowResTarget;
+    GLuint m_volumeTexture;
+    GLuint m_occupancyTexture;
+    QVector3D m_textureSize;            // Voxels uploaded per axis (x, y, z)
+    QVector3D m_occupancySize;          // Occupancy blocks per axis
+    int m_max3DTextureSize;
+    bool m_needsUpload;
+    bool m_unsupported;
+};
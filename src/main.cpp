@@ -1,8 +1,11 @@
 #include "core/Application.h"
+#include "core/BatchRenderer.h"
+#include "utils/StartupTimer.h"
 #include <QDebug>
 #include <QMessageBox>
 #include <QDir>
 #include <QStandardPaths>
+#include <QSurfaceFormat>
 
 /**
  * @brief Setup application environment
@@ -21,6 +24,14 @@ void setupEnvironment()
 
     // Set default style
     QApplication::setStyle("Fusion");
+
+    // Request a context with instanced arrays for the point, vector and
+    // track layers; the compatibility profile keeps the GLSL 1.10 shaders
+    QSurfaceFormat format;
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CompatibilityProfile);
+    format.setDepthBufferSize(24);
+    QSurfaceFormat::setDefaultFormat(format);
 }
 
 /**
@@ -82,6 +93,14 @@ void printApplicationInfo()
  */
 int main(int argc, char* argv[])
 {
+    // Start the startup clock before anything else
+    Application::startupTimer();
+
+    // Figure and movie export runs without a window or Application
+    if (BatchRenderer::isHeadless(argc, argv)) {
+        return BatchRenderer::run(argc, argv);
+    }
+
     // Setup environment before creating QApplication
     setupEnvironment();
     
@@ -1,11 +1,17 @@
 #pragma once
 
+#include "../core/DataBuffer.h"
+#include "../core/LoadRequest.h"
+#include "../core/ProcessingBlock.h"
 #include <QString>
 #include <QObject>
 #include <QWidget>
 #include <QJsonObject>
+#include <QVariantMap>
+#include <memory>
 
 class Application;
+class TileSource;
 
 /**
  * @brief Plugin metadata structure
@@ -145,6 +151,9 @@ public:
  * @brief Interface for data processing plugins
  * 
  * Data processing plugins can manipulate layer data and provide analysis tools.
+ *
+ * Version 1.1 added loadBuffer() and openTileSource(); plugins built
+ * against 1.0 have a different vtable and are not cast to this interface.
  */
 class DataPluginInterface : public PluginInterface
 {
@@ -164,11 +173,61 @@ public:
 
     /**
      * @brief Load data from file
+     *
+     * Called on the GUI thread when the plugin provides neither
+     * loadBuffer() nor openTileSource() for the file.
+     *
      * @param fileName File name
      * @return true if successful
      */
     virtual bool loadData(const QString& fileName) = 0;
 
+    /**
+     * @brief Load data from file into a buffer
+     *
+     * Implementations should return buffers that reference their storage
+     * (for example a MappedFileStorage) rather than copying the file into
+     * the heap. The default returns a null buffer, in which case the caller
+     * falls back to openTileSource() and then to loadData().
+     *
+     * @param fileName File name
+     * @return Data buffer, or a null buffer if not supported
+     */
+    virtual DataBuffer loadBuffer(const QString& fileName) { Q_UNUSED(fileName) return DataBuffer(); }
+
+    /**
+     * @brief Load data from file into a buffer with progress reporting
+     *
+     * Called on a loader thread. Implementations doing substantial work
+     * should report progress and return early once the request is
+     * cancelled. The default forwards to loadBuffer(const QString&).
+     *
+     * @param fileName File name
+     * @param request Progress and cancellation state
+     * @return Data buffer, or a null buffer if not supported
+     */
+    virtual DataBuffer loadBuffer(const QString& fileName, LoadRequest& request)
+    {
+        Q_UNUSED(request)
+        return loadBuffer(fileName);
+    }
+
+    /**
+     * @brief Open a file for streaming tile access
+     *
+     * For formats too large to map, or stored remotely or compressed in
+     * chunks, the returned source is read tile by tile as the view needs.
+     * Called on a loader thread.
+     *
+     * @param fileName File name
+     * @return Tile source, or nullptr if not supported
+     */
+    virtual std::shared_ptr<TileSource> openTileSource(const QString& fileName)
+    {
+        Q_UNUSED(fileName)
+        return std::shared_ptr<TileSource>();
+    }
+
     /**
      * @brief Save data to file
      * @param fileName File name
@@ -177,7 +236,62 @@ public:
     virtual bool saveData(const QString& fileName) = 0;
 };
 
+/**
+ * @brief Interface for block-wise processing plugins
+ *
+ * Filters, denoisers and detectors implement processBlock() for a single
+ * block; ProcessingService splits the layer data, runs the blocks on its
+ * worker pool and streams finished blocks into the output layer. Plugins
+ * do not create threads of their own.
+ */
+class ProcessingPluginInterface : public PluginInterface
+{
+public:
+    /**
+     * @brief Get names of the operations this plugin provides
+     * @return Operation names
+     */
+    virtual QStringList operations() const = 0;
+
+    /**
+     * @brief Get output type, block shape and halo of an operation
+     *
+     * Called on the GUI thread before a run starts. Neighbourhood filters
+     * return their radius as halo; the default processes blocks of a
+     * default shape without halo and keeps the input type.
+     *
+     * @param operation Operation name
+     * @param input Whole input buffer
+     * @param parameters Operation parameters
+     * @return Options
+     */
+    virtual ProcessingOptions processingOptions(const QString& operation, const DataBuffer& input,
+                                                const QVariantMap& parameters) const
+    {
+        Q_UNUSED(operation) Q_UNUSED(parameters)
+        ProcessingOptions options;
+        options.outputType = input.dtype();
+        return options;
+    }
+
+    /**
+     * @brief Process one block
+     *
+     * Called concurrently on worker threads, so implementations must be
+     * reentrant and must not touch widgets or layers.
+     *
+     * @param operation Operation name
+     * @param block Input and output views of the block
+     * @param parameters Operation parameters
+     * @param errorMessage Receives the reason on failure
+     * @return false to fail the whole run
+     */
+    virtual bool processBlock(const QString& operation, ProcessingBlock& block,
+                              const QVariantMap& parameters, QString* errorMessage) = 0;
+};
+
 // Qt plugin interface macros
 Q_DECLARE_INTERFACE(PluginInterface, "org.t-gui.PluginInterface/1.0")
 Q_DECLARE_INTERFACE(UIPluginInterface, "org.t-gui.UIPluginInterface/1.0")
-Q_DECLARE_INTERFACE(DataPluginInterface, "org.t-gui.DataPluginInterface/1.0")
+Q_DECLARE_INTERFACE(DataPluginInterface, "org.t-gui.DataPluginInterface/1.1")
+Q_DECLARE_INTERFACE(ProcessingPluginInterface, "org.t-gui.ProcessingPluginInterface/1.0")
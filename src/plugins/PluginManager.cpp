@@ -1,13 +1,79 @@
 #include "PluginManager.h"
 #include "../core/Application.h"
 #include "../utils/Logger.h"
+#include "../utils/Profiler.h"
 
 #include <QDir>
 #include <QPluginLoader>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QRunnable>
 #include <QDebug>
 
+namespace {
+
+/**
+ * @brief Loads one plugin library on a pool thread
+ */
+class LibraryLoadTask : public QRunnable
+{
+public:
+    explicit LibraryLoadTask(QPluginLoader* loader) : m_loader(loader) {}
+    void run() override { m_loader->load(); }
+
+private:
+    QPluginLoader* m_loader;
+};
+
+/**
+ * @brief Get the plugin interface of a plugin object
+ *
+ * Plugins declare the most derived interface in Q_INTERFACES, so the
+ * base interface is reached through it.
+ */
+PluginInterface* toPluginInterface(QObject* object)
+{
+    if (PluginInterface* plugin = qobject_cast<PluginInterface*>(object)) {
+        return plugin;
+    }
+    if (UIPluginInterface* plugin = qobject_cast<UIPluginInterface*>(object)) {
+        return plugin;
+    }
+    if (DataPluginInterface* plugin = qobject_cast<DataPluginInterface*>(object)) {
+        return plugin;
+    }
+    return qobject_cast<ProcessingPluginInterface*>(object);
+}
+
+} // namespace
+
+QJsonObject PluginMetadata::toJson() const
+{
+    QJsonObject json;
+    json["name"] = name;
+    json["version"] = version;
+    json["description"] = description;
+    json["author"] = author;
+    json["license"] = license;
+    json["dependencies"] = QJsonArray::fromStringList(dependencies);
+    return json;
+}
+
+PluginMetadata PluginMetadata::fromJson(const QJsonObject& json)
+{
+    PluginMetadata metadata;
+    metadata.name = json.value("name").toString();
+    metadata.version = json.value("version").toString();
+    metadata.description = json.value("description").toString();
+    metadata.author = json.value("author").toString();
+    metadata.license = json.value("license").toString();
+    for (const QJsonValue& dependency : json.value("dependencies").toArray()) {
+        metadata.dependencies.append(dependency.toString());
+    }
+    return metadata;
+}
+
 PluginManager::PluginManager(const QString& pluginsDir, QObject* parent)
     : QObject(parent)
     , m_pluginsDir(pluginsDir)
@@ -22,28 +88,65 @@ PluginManager::~PluginManager()
     unloadAllPlugins();
 }
 
-int PluginManager::loadPluginsFromDirectory(const QString& directory)
+int PluginManager::discoverPlugins(const QString& directory)
 {
+    PROFILE_SCOPE("PluginManager::discoverPlugins");
+
     QDir dir(directory);
     if (!dir.exists()) {
         qWarning() << "Plugin directory does not exist:" << directory;
         return 0;
     }
 
-    int loadedCount = 0;
     QStringList filters;
     for (const QString& ext : m_supportedExtensions) {
         filters << QString("*.%1").arg(ext);
     }
 
-    QFileInfoList files = dir.entryInfoList(filters, QDir::Files);
-    for (const QFileInfo& fileInfo : files) {
-        if (loadPlugin(fileInfo.absoluteFilePath())) {
-            loadedCount++;
+    const QFileInfoList files = dir.entryInfoList(filters, QDir::Files);
+    const QVector<PluginMetadataCache::Entry> entries = m_metadataCache.metadata(files, &m_loadPool);
+    m_metadataCache.save();
+
+    int discoveredCount = 0;
+    for (int i = 0; i < files.size(); ++i) {
+        const PluginMetadataCache::Entry& entry = entries[i];
+        const QString pluginName = files[i].baseName();
+        if (m_plugins.contains(pluginName)) {
+            continue;
+        }
+
+        // Other libraries, and Qt plugins of other applications, are skipped
+        if (!entry.errorString.isEmpty() || !entry.iid.startsWith("org.t-gui.")) {
+            continue;
         }
+
+        PluginInfo* info = new PluginInfo();
+        info->fileName = files[i].fileName();
+        info->filePath = entry.filePath;
+        info->iid = entry.iid;
+        info->metadata = PluginMetadata::fromJson(entry.metaData);
+        info->loadOnStartup = entry.metaData.value("loadOnStartup").toBool();
+        info->loader = new QPluginLoader(entry.filePath);
+        m_plugins[pluginName] = info;
+        discoveredCount++;
     }
 
-    return loadedCount;
+    return discoveredCount;
+}
+
+int PluginManager::loadPluginsFromDirectory(const QString& directory)
+{
+    discoverPlugins(directory);
+
+    const QString path = QDir(directory).absolutePath();
+    QStringList pluginNames;
+    for (auto it = m_plugins.constBegin(); it != m_plugins.constEnd(); ++it) {
+        if (QFileInfo(it.value()->filePath).absolutePath() == path) {
+            pluginNames.append(it.key());
+        }
+    }
+
+    return loadPlugins(pluginNames);
 }
 
 bool PluginManager::loadPlugin(const QString& filePath)
@@ -52,49 +155,176 @@ bool PluginManager::loadPlugin(const QString& filePath)
     QString pluginName = fileInfo.baseName();
 
     // Check if already loaded
-    if (m_plugins.contains(pluginName)) {
+    const PluginInfo* existing = pluginInfo(pluginName);
+    if (existing && existing->loaded) {
         qWarning() << "Plugin already loaded:" << pluginName;
         return false;
     }
 
-    // Create plugin info
-    PluginInfo* info = new PluginInfo();
-    info->fileName = fileInfo.fileName();
-    info->filePath = filePath;
-    info->loader = new QPluginLoader(filePath);
+    if (!existing) {
+        const QVector<PluginMetadataCache::Entry> entries =
+            m_metadataCache.metadata(QFileInfoList{fileInfo}, &m_loadPool);
+        m_metadataCache.save();
+        const PluginMetadataCache::Entry& entry = entries.first();
+        if (!entry.errorString.isEmpty()) {
+            qWarning() << "Failed to load plugin:" << pluginName << entry.errorString;
+            emit pluginLoadFailed(filePath, entry.errorString);
+            return false;
+        }
+
+        PluginInfo* info = new PluginInfo();
+        info->fileName = fileInfo.fileName();
+        info->filePath = entry.filePath;
+        info->iid = entry.iid;
+        info->metadata = PluginMetadata::fromJson(entry.metaData);
+        info->loadOnStartup = entry.metaData.value("loadOnStartup").toBool();
+        info->loader = new QPluginLoader(entry.filePath);
+        m_plugins[pluginName] = info;
+    }
+
+    return ensureLoaded(pluginName);
+}
+
+int PluginManager::loadPlugins(const QStringList& pluginNames)
+{
+    QHash<QString, int> depths;
+    QSet<QString> visiting;
+    QVector<QStringList> levels;
+
+    for (const QString& pluginName : pluginNames) {
+        if (dependencyDepth(pluginName, depths, visiting) < 0) {
+            const PluginInfo* info = pluginInfo(pluginName);
+            const QString error = info ? info->errorString : QString("Unknown plugin");
+            qWarning() << "Failed to load plugin:" << pluginName << error;
+            emit pluginLoadFailed(info ? info->filePath : pluginName, error);
+        }
+    }
+
+    // Plugins of one level only depend on plugins of lower levels
+    for (auto it = depths.constBegin(); it != depths.constEnd(); ++it) {
+        if (it.value() > 0) {
+            if (levels.size() < it.value()) {
+                levels.resize(it.value());
+            }
+            levels[it.value() - 1].append(it.key());
+        }
+    }
+
+    int loadedCount = 0;
+    for (QStringList& level : levels) {
+        level.sort();
+
+        // Lower levels are done; dependents of plugins that failed there
+        // are not initialized against a missing dependency
+        for (auto it = level.begin(); it != level.end();) {
+            PluginInfo* info = m_plugins.value(*it);
+            QString failedDependency;
+            for (const QString& dependency : qAsConst(info->metadata.dependencies)) {
+                const PluginInfo* dependencyInfo = m_plugins.value(resolveDependency(dependency));
+                if (!dependencyInfo || !dependencyInfo->loaded) {
+                    failedDependency = dependency;
+                    break;
+                }
+            }
+            if (failedDependency.isEmpty()) {
+                ++it;
+                continue;
+            }
+
+            info->errorString = QString("Dependency failed: %1").arg(failedDependency);
+            qWarning() << "Failed to load plugin:" << *it << info->errorString;
+            emit pluginLoadFailed(info->filePath, info->errorString);
+            it = level.erase(it);
+        }
+
+        // Mapping the libraries and running their static initializers is
+        // the slow part, and needs no GUI thread
+        PROFILE_SCOPE("PluginManager::loadLibraries");
+        for (const QString& pluginName : qAsConst(level)) {
+            m_loadPool.start(new LibraryLoadTask(m_plugins.value(pluginName)->loader));
+        }
+        m_loadPool.waitForDone();
+
+        for (const QString& pluginName : qAsConst(level)) {
+            if (instantiatePlugin(pluginName, *m_plugins.value(pluginName))) {
+                loadedCount++;
+            }
+        }
+    }
+
+    return loadedCount;
+}
+
+int PluginManager::loadStartupPlugins()
+{
+    QStringList pluginNames;
+    for (auto it = m_plugins.constBegin(); it != m_plugins.constEnd(); ++it) {
+        if (it.value()->loadOnStartup && !it.value()->loaded) {
+            pluginNames.append(it.key());
+        }
+    }
+    return pluginNames.isEmpty() ? 0 : loadPlugins(pluginNames);
+}
+
+bool PluginManager::ensureLoaded(const QString& pluginName)
+{
+    const PluginInfo* info = pluginInfo(pluginName);
+    if (!info) {
+        return false;
+    }
+    if (!info->loaded) {
+        loadPlugins(QStringList{pluginName});
+    }
+    return info->loaded;
+}
+
+bool PluginManager::instantiatePlugin(const QString& pluginName, PluginInfo& info)
+{
+    PROFILE_SCOPE_LABEL("PluginManager::loadPlugin", pluginName);
+
+    if (!info.loader->isLoaded()) {
+        info.errorString = info.loader->errorString();
+        qWarning() << "Failed to load plugin:" << pluginName << info.errorString;
+        emit pluginLoadFailed(info.filePath, info.errorString);
+        return false;
+    }
 
     // Load the plugin
-    QObject* pluginObject = info->loader->instance();
+    QObject* pluginObject = info.loader->instance();
     if (!pluginObject) {
-        info->errorString = info->loader->errorString();
-        qWarning() << "Failed to load plugin:" << pluginName << info->errorString;
+        info.errorString = info.loader->errorString();
+        qWarning() << "Failed to load plugin:" << pluginName << info.errorString;
+        info.loader->unload();
+        emit pluginLoadFailed(info.filePath, info.errorString);
         return false;
     }
 
     // Cast to plugin interface
-    PluginInterface* plugin = qobject_cast<PluginInterface*>(pluginObject);
+    PluginInterface* plugin = toPluginInterface(pluginObject);
     if (!plugin) {
-        info->errorString = "Plugin does not implement PluginInterface";
-        qWarning() << info->errorString << pluginName;
-        info->loader->unload();
+        info.errorString = "Plugin does not implement PluginInterface";
+        qWarning() << info.errorString << pluginName;
+        info.loader->unload();
+        emit pluginLoadFailed(info.filePath, info.errorString);
         return false;
     }
 
-    info->instance = plugin;
-    info->metadata = plugin->metadata();
-    info->loaded = true;
+    info.instance = plugin;
+    info.metadata = plugin->metadata();
+    info.loaded = true;
 
     // Initialize plugin
-    if (!initializePlugin(*info)) {
-        info->loaded = false;
-        info->loader->unload();
-        delete info;
+    if (!initializePlugin(info)) {
+        qWarning() << "Failed to initialize plugin:" << pluginName << info.errorString;
+        info.instance = nullptr;
+        info.loaded = false;
+        info.loader->unload();
+        emit pluginLoadFailed(info.filePath, info.errorString);
         return false;
     }
 
-    // Store plugin info
-    m_plugins[pluginName] = info;
-
+    info.errorString.clear();
+    m_loadOrder.append(pluginName);
     emit pluginLoaded(pluginName);
     return true;
 }
@@ -113,14 +343,24 @@ bool PluginManager::unloadPlugin(const QString& pluginName)
         info->loader->unload();
     }
 
+    const bool wasLoaded = info->loaded;
     delete info;
     m_plugins.erase(it);
-    emit pluginUnloaded(pluginName);
+    m_loadOrder.removeAll(pluginName);
+    if (wasLoaded) {
+        emit pluginUnloaded(pluginName);
+    }
     return true;
 }
 
 void PluginManager::unloadAllPlugins()
 {
+    // Dependents go before the plugins they depend on
+    const QStringList loadOrder = m_loadOrder;
+    for (auto it = loadOrder.crbegin(); it != loadOrder.crend(); ++it) {
+        unloadPlugin(*it);
+    }
+
     QStringList pluginNames = m_plugins.keys();
     for (const QString& name : pluginNames) {
         unloadPlugin(name);
@@ -129,7 +369,13 @@ void PluginManager::unloadAllPlugins()
 
 QStringList PluginManager::loadedPlugins() const
 {
-    return m_plugins.keys();
+    QStringList result;
+    for (auto it = m_plugins.constBegin(); it != m_plugins.constEnd(); ++it) {
+        if (it.value()->loaded) {
+            result.append(it.key());
+        }
+    }
+    return result;
 }
 
 const PluginInfo* PluginManager::pluginInfo(const QString& pluginName) const
@@ -138,10 +384,12 @@ const PluginInfo* PluginManager::pluginInfo(const QString& pluginName) const
     return (it != m_plugins.end()) ? it.value() : nullptr;
 }
 
-PluginInterface* PluginManager::plugin(const QString& pluginName) const
+PluginInterface* PluginManager::plugin(const QString& pluginName)
 {
-    const PluginInfo* info = pluginInfo(pluginName);
-    return info ? info->instance : nullptr;
+    if (!ensureLoaded(pluginName)) {
+        return nullptr;
+    }
+    return m_plugins.value(pluginName)->instance;
 }
 
 bool PluginManager::setPluginEnabled(const QString& pluginName, bool enabled)
@@ -156,6 +404,17 @@ bool PluginManager::setPluginEnabled(const QString& pluginName, bool enabled)
         return true;
     }
 
+    // Enabling a plugin that was never used loads it, which enables it
+    if (enabled && !info->loaded) {
+        if (!ensureLoaded(pluginName)) {
+            return false;
+        }
+        if (info->enabled) {
+            emit pluginEnabledChanged(pluginName, true);
+            return true;
+        }
+    }
+
     if (info->instance) {
         info->instance->setEnabled(enabled);
         info->enabled = enabled;
@@ -174,7 +433,7 @@ bool PluginManager::isPluginEnabled(const QString& pluginName) const
 
 void PluginManager::refresh()
 {
-    loadPluginsFromDirectory(m_pluginsDir);
+    discoverPlugins(m_pluginsDir);
 }
 
 bool PluginManager::validatePlugin(PluginInterface* plugin) const
@@ -227,13 +486,89 @@ void PluginManager::shutdownPlugin(PluginInfo& info)
 bool PluginManager::checkDependencies(const PluginMetadata& metadata) const
 {
     for (const QString& dependency : metadata.dependencies) {
-        if (!m_plugins.contains(dependency)) {
+        const PluginInfo* info = pluginInfo(resolveDependency(dependency));
+        if (!info || !info->loaded) {
             return false;
         }
     }
     return true;
 }
 
+QString PluginManager::resolveDependency(const QString& dependency) const
+{
+    if (m_plugins.contains(dependency)) {
+        return dependency;
+    }
+    for (auto it = m_plugins.constBegin(); it != m_plugins.constEnd(); ++it) {
+        if (it.value()->metadata.name == dependency) {
+            return it.key();
+        }
+    }
+    return QString();
+}
+
+int PluginManager::dependencyDepth(const QString& pluginName, QHash<QString, int>& depths, QSet<QString>& visiting)
+{
+    auto known = depths.constFind(pluginName);
+    if (known != depths.constEnd()) {
+        return known.value();
+    }
+
+    PluginInfo* info = m_plugins.value(pluginName);
+    if (!info) {
+        return -1;
+    }
+    if (info->loaded) {
+        depths.insert(pluginName, 0);
+        return 0;
+    }
+    if (visiting.contains(pluginName)) {
+        info->errorString = "Plugin dependency cycle";
+        return -1;
+    }
+
+    visiting.insert(pluginName);
+    int depth = 1;
+    for (const QString& dependency : qAsConst(info->metadata.dependencies)) {
+        const QString dependencyName = resolveDependency(dependency);
+        if (dependencyName.isEmpty()) {
+            info->errorString = QString("Missing dependency: %1").arg(dependency);
+            depth = -1;
+            break;
+        }
+
+        const int dependencyLevel = dependencyDepth(dependencyName, depths, visiting);
+        if (dependencyLevel < 0) {
+            info->errorString = QString("Dependency not loadable: %1").arg(dependency);
+            depth = -1;
+            break;
+        }
+        depth = qMax(depth, dependencyLevel + 1);
+    }
+    visiting.remove(pluginName);
+
+    depths.insert(pluginName, depth);
+    return depth;
+}
+
+QStringList PluginManager::pluginsWithInterface(const char* iid) const
+{
+    const bool anyInterface = qstrcmp(iid, qobject_interface_iid<PluginInterface*>()) == 0;
+
+    QStringList result;
+    for (auto it = m_plugins.constBegin(); it != m_plugins.constEnd(); ++it) {
+        const PluginInfo* info = it.value();
+        // Plugins that already failed are retried through ensureLoaded() only
+        if (info->loaded || !info->errorString.isEmpty()) {
+            continue;
+        }
+        if (anyInterface || info->iid == QLatin1String(iid)) {
+            result.append(it.key());
+        }
+    }
+    return result;
+}
+
 QJsonObject PluginManager::loadPluginConfig(const QString& pluginName) const
 {
     // TODO: Implement plugin configuration loading
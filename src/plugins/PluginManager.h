@@ -1,11 +1,15 @@
 #pragma once
 
 #include "PluginInterface.h"
+#include "PluginMetadataCache.h"
 #include <QObject>
 #include <QPluginLoader>
 #include <QDir>
+#include <QHash>
 #include <QJsonObject>
 #include <QMap>
+#include <QSet>
+#include <QThreadPool>
 #include <memory>
 
 class Application;
@@ -17,14 +21,16 @@ struct PluginInfo
 {
     QString fileName;                           ///< Plugin file name
     QString filePath;                          ///< Full file path
+    QString iid;                               ///< Interface ID from Q_PLUGIN_METADATA
     PluginMetadata metadata;                   ///< Plugin metadata
     QPluginLoader* loader;                     ///< Plugin loader
     PluginInterface* instance;                 ///< Plugin instance
     bool loaded;                               ///< Load status
     bool enabled;                              ///< Enable status
+    bool loadOnStartup;                        ///< Instantiate at startup instead of on first use
     QString errorString;                       ///< Error message if any
 
-    PluginInfo() : loader(nullptr), instance(nullptr), loaded(false), enabled(false) {}
+    PluginInfo() : loader(nullptr), instance(nullptr), loaded(false), enabled(false), loadOnStartup(false) {}
     ~PluginInfo() { delete loader; }
 };
 
@@ -32,6 +38,14 @@ struct PluginInfo
  * @brief Plugin manager class
  * 
  * Manages loading, unloading, and lifecycle of plugins.
+ *
+ * Plugins are discovered from their embedded metadata without loading
+ * them (see PluginMetadataCache) and are instantiated on first use:
+ * plugin(), pluginsByInterface() or setPluginEnabled(). Plugins whose
+ * plugin.json sets "loadOnStartup" are loaded by loadStartupPlugins().
+ * Loading resolves "dependencies" into a graph; the libraries of each
+ * level are loaded in parallel, then instantiated and initialized on the
+ * calling thread with their dependencies first.
  */
 class PluginManager : public QObject
 {
@@ -51,7 +65,14 @@ public:
     ~PluginManager();
 
     /**
-     * @brief Load plugins from directory
+     * @brief Register the plugins of a directory without loading them
+     * @param directory Directory path
+     * @return Number of plugins found
+     */
+    int discoverPlugins(const QString& directory);
+
+    /**
+     * @brief Discover and load all plugins of a directory
      * @param directory Directory path
      * @return Number of plugins loaded
      */
@@ -64,6 +85,26 @@ public:
      */
     bool loadPlugin(const QString& filePath);
 
+    /**
+     * @brief Load discovered plugins and their dependencies
+     * @param pluginNames Plugin names
+     * @return Number of plugins loaded by this call
+     */
+    int loadPlugins(const QStringList& pluginNames);
+
+    /**
+     * @brief Load the plugins marked "loadOnStartup"
+     * @return Number of plugins loaded
+     */
+    int loadStartupPlugins();
+
+    /**
+     * @brief Make sure a discovered plugin is loaded
+     * @param pluginName Plugin name
+     * @return true if the plugin is loaded
+     */
+    bool ensureLoaded(const QString& pluginName);
+
     /**
      * @brief Unload a plugin
      * @param pluginName Plugin name
@@ -82,6 +123,12 @@ public:
      */
     QStringList loadedPlugins() const;
 
+    /**
+     * @brief Get discovered plugins, loaded or not
+     * @return List of plugin names
+     */
+    QStringList discoveredPlugins() const { return m_plugins.keys(); }
+
     /**
      * @brief Get plugin info
      * @param pluginName Plugin name
@@ -90,11 +137,11 @@ public:
     const PluginInfo* pluginInfo(const QString& pluginName) const;
 
     /**
-     * @brief Get plugin instance
+     * @brief Get plugin instance, loading the plugin if needed
      * @param pluginName Plugin name
      * @return Plugin instance or nullptr
      */
-    PluginInterface* plugin(const QString& pluginName) const;
+    PluginInterface* plugin(const QString& pluginName);
 
     /**
      * @brief Enable or disable a plugin
@@ -113,11 +160,14 @@ public:
 
     /**
      * @brief Get plugins by interface type
+     *
+     * Discovered plugins declaring the interface's IID are loaded first.
+     *
      * @tparam T Interface type
      * @return List of plugins implementing the interface
      */
     template<typename T>
-    QList<T*> pluginsByInterface() const;
+    QList<T*> pluginsByInterface();
 
     /**
      * @brief Refresh plugin list
@@ -197,6 +247,37 @@ private:
      */
     bool checkDependencies(const PluginMetadata& metadata) const;
 
+    /**
+     * @brief Find a plugin by file base name or metadata name
+     * @param dependency Dependency name
+     * @return Plugin name, empty if unknown
+     */
+    QString resolveDependency(const QString& dependency) const;
+
+    /**
+     * @brief Get depth of a plugin in the dependency graph
+     * @param pluginName Plugin name
+     * @param depths Depths found so far; 0 for loaded plugins
+     * @param visiting Plugins on the current path, to detect cycles
+     * @return Depth, 1 for plugins without unloaded dependencies; -1 on error
+     */
+    int dependencyDepth(const QString& pluginName, QHash<QString, int>& depths, QSet<QString>& visiting);
+
+    /**
+     * @brief Instantiate and initialize a plugin whose library is loaded
+     * @param pluginName Plugin name
+     * @param info Plugin info
+     * @return true if successful
+     */
+    bool instantiatePlugin(const QString& pluginName, PluginInfo& info);
+
+    /**
+     * @brief Get unloaded plugins declaring an interface
+     * @param iid Interface ID
+     * @return Plugin names
+     */
+    QStringList pluginsWithInterface(const char* iid) const;
+
     /**
      * @brief Load plugin configuration
      * @param pluginName Plugin name
@@ -216,15 +297,26 @@ private:
     Application* m_application;
     QMap<QString, PluginInfo*> m_plugins;
     QStringList m_supportedExtensions;
+
+    // Loaded plugins in initialization order; unloaded in reverse
+    QStringList m_loadOrder;
+
+    PluginMetadataCache m_metadataCache;
+    QThreadPool m_loadPool;
 };
 
 template<typename T>
-QList<T*> PluginManager::pluginsByInterface() const
+QList<T*> PluginManager::pluginsByInterface()
 {
+    const QStringList pending = pluginsWithInterface(qobject_interface_iid<T*>());
+    if (!pending.isEmpty()) {
+        loadPlugins(pending);
+    }
+
     QList<T*> result;
     for (PluginInfo* info : m_plugins) {
         if (info->loaded && info->enabled && info->instance) {
-            T* interface = qobject_cast<T*>(info->instance);
+            T* interface = qobject_cast<T*>(dynamic_cast<QObject*>(info->instance));
             if (interface) {
                 result.append(interface);
             }
@@ -0,0 +1,213 @@
+#include "PluginMetadataCache.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QPluginLoader>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <functional>
+
+namespace {
+
+// Bump when the cache layout changes; older caches are ignored
+const int kCacheVersion = 1;
+
+/**
+ * @brief Computes one entry on a pool thread
+ */
+class ScanTask : public QRunnable
+{
+public:
+    ScanTask(std::function<void()> function) : m_function(std::move(function)) {}
+    void run() override { m_function(); }
+
+private:
+    std::function<void()> m_function;
+};
+
+} // namespace
+
+PluginMetadataCache::PluginMetadataCache(const QString& cacheFile)
+    : m_cacheFile(cacheFile)
+    , m_loaded(false)
+    , m_modified(false)
+{
+    if (m_cacheFile.isEmpty()) {
+        const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+        m_cacheFile = QDir(cacheDir).filePath("plugin-metadata.json");
+    }
+}
+
+QVector<PluginMetadataCache::Entry> PluginMetadataCache::metadata(const QFileInfoList& files, QThreadPool* pool)
+{
+    load();
+
+    QVector<Entry> result(files.size());
+    QVector<CachedEntry> fresh(files.size());
+    QVector<int> changed;
+
+    for (int i = 0; i < files.size(); ++i) {
+        const QFileInfo& file = files[i];
+        const QString path = file.absoluteFilePath();
+        fresh[i].size = file.size();
+        fresh[i].modified = file.lastModified().toMSecsSinceEpoch();
+
+        auto it = m_entries.constFind(path);
+        if (it != m_entries.constEnd() && it->size == fresh[i].size && it->modified == fresh[i].modified) {
+            result[i] = it->entry;
+        } else {
+            changed.append(i);
+        }
+    }
+
+    if (changed.isEmpty()) {
+        return result;
+    }
+
+    // Hash and, if the contents differ, scan changed files in parallel
+    QHash<QString, CachedEntry> previous;
+    for (int i : qAsConst(changed)) {
+        const QString path = files[i].absoluteFilePath();
+        previous.insert(path, m_entries.value(path));
+    }
+
+    for (int i : qAsConst(changed)) {
+        const QString path = files[i].absoluteFilePath();
+        const CachedEntry* old = &previous[path];
+        CachedEntry* target = &fresh[i];
+        pool->start(new ScanTask([path, old, target]() {
+            target->hash = hashFile(path);
+            if (!old->hash.isEmpty() && old->hash == target->hash) {
+                target->entry = old->entry;
+            } else {
+                target->entry = scan(path);
+            }
+        }));
+    }
+    pool->waitForDone();
+
+    for (int i : qAsConst(changed)) {
+        result[i] = fresh[i].entry;
+        m_entries.insert(files[i].absoluteFilePath(), fresh[i]);
+    }
+    m_modified = true;
+    return result;
+}
+
+bool PluginMetadataCache::save()
+{
+    if (!m_modified) {
+        return true;
+    }
+
+    QJsonObject plugins;
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        // Forget plugins that were removed
+        if (!QFileInfo::exists(it.key())) {
+            continue;
+        }
+
+        QJsonObject entry;
+        entry["size"] = double(it->size);
+        entry["modified"] = double(it->modified);
+        entry["hash"] = QString::fromLatin1(it->hash.toHex());
+        entry["iid"] = it->entry.iid;
+        entry["className"] = it->entry.className;
+        entry["metaData"] = it->entry.metaData;
+        if (!it->entry.errorString.isEmpty()) {
+            entry["error"] = it->entry.errorString;
+        }
+        plugins[it.key()] = entry;
+    }
+
+    QJsonObject root;
+    root["version"] = kCacheVersion;
+    root["plugins"] = plugins;
+
+    QDir().mkpath(QFileInfo(m_cacheFile).absolutePath());
+    QSaveFile file(m_cacheFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write plugin metadata cache:" << m_cacheFile;
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    if (!file.commit()) {
+        qWarning() << "Cannot write plugin metadata cache:" << m_cacheFile << file.errorString();
+        return false;
+    }
+
+    m_modified = false;
+    return true;
+}
+
+void PluginMetadataCache::load()
+{
+    if (m_loaded) {
+        return;
+    }
+    m_loaded = true;
+
+    QFile file(m_cacheFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    if (root.value("version").toInt() != kCacheVersion) {
+        return;
+    }
+
+    const QJsonObject plugins = root.value("plugins").toObject();
+    for (auto it = plugins.constBegin(); it != plugins.constEnd(); ++it) {
+        const QJsonObject object = it.value().toObject();
+        CachedEntry cached;
+        cached.size = qint64(object.value("size").toDouble(-1));
+        cached.modified = qint64(object.value("modified").toDouble());
+        cached.hash = QByteArray::fromHex(object.value("hash").toString().toLatin1());
+        cached.entry.filePath = it.key();
+        cached.entry.iid = object.value("iid").toString();
+        cached.entry.className = object.value("className").toString();
+        cached.entry.metaData = object.value("metaData").toObject();
+        cached.entry.errorString = object.value("error").toString();
+        m_entries.insert(it.key(), cached);
+    }
+}
+
+PluginMetadataCache::Entry PluginMetadataCache::scan(const QString& filePath)
+{
+    Entry entry;
+    entry.filePath = filePath;
+
+    // metaData() reads the embedded JSON without loading the library
+    QPluginLoader loader(filePath);
+    const QJsonObject metaData = loader.metaData();
+    if (metaData.isEmpty()) {
+        entry.errorString = "No plugin metadata found";
+        return entry;
+    }
+
+    entry.iid = metaData.value("IID").toString();
+    entry.className = metaData.value("className").toString();
+    entry.metaData = metaData.value("MetaData").toObject();
+    return entry;
+}
+
+QByteArray PluginMetadataCache::hashFile(const QString& filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (!hash.addData(&file)) {
+        return QByteArray();
+    }
+    return hash.result();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+class QThreadPool;
+
+/**
+ * @brief Persistent cache of plugin metadata
+ *
+ * The metadata embedded by Q_PLUGIN_METADATA (IID, class name and the
+ * plugin.json contents) is read by QPluginLoader::metaData() without
+ * loading the library, but that still scans the whole file. The cache
+ * keeps the result per file path. An entry is reused while the file size
+ * and modification time match; when only the time changed, the content
+ * hash decides, so reinstalling an identical plugin costs one hash.
+ */
+class PluginMetadataCache
+{
+public:
+    /**
+     * @brief Metadata of one plugin file
+     */
+    struct Entry
+    {
+        QString filePath;       ///< Absolute file path
+        QString iid;            ///< Interface ID from Q_PLUGIN_METADATA
+        QString className;      ///< Plugin class name
+        QJsonObject metaData;   ///< Contents of the plugin's JSON file
+        QString errorString;    ///< Why the file is not a plugin, if it is not
+    };
+
+    /**
+     * @brief Constructor
+     * @param cacheFile Cache file; empty for the default in the cache location
+     */
+    explicit PluginMetadataCache(const QString& cacheFile = QString());
+
+    /**
+     * @brief Get cache file path
+     * @return Cache file path
+     */
+    QString cacheFile() const { return m_cacheFile; }
+
+    /**
+     * @brief Get metadata of plugin files
+     *
+     * Files missing from the cache or changed since are scanned on the
+     * given pool in parallel.
+     *
+     * @param files Plugin files
+     * @param pool Thread pool for scanning
+     * @return One entry per file, in order
+     */
+    QVector<Entry> metadata(const QFileInfoList& files, QThreadPool* pool);
+
+    /**
+     * @brief Write the cache if it changed
+     * @return true if successful or nothing to write
+     */
+    bool save();
+
+private:
+    /**
+     * @brief Cached metadata with the file state it was read from
+     */
+    struct CachedEntry
+    {
+        qint64 size = -1;
+        qint64 modified = 0;
+        QByteArray hash;
+        Entry entry;
+    };
+
+    /**
+     * @brief Read the cache file once
+     */
+    void load();
+
+    /**
+     * @brief Read metadata from a plugin file (any thread)
+     * @param filePath Plugin file
+     * @return Entry
+     */
+    static Entry scan(const QString& filePath);
+
+    /**
+     * @brief Hash file contents (any thread)
+     * @param filePath File
+     * @return SHA-1, empty if the file cannot be read
+     */
+    static QByteArray hashFile(const QString& filePath);
+
+private:
+    QString m_cacheFile;
+    QHash<QString, CachedEntry> m_entries;
+    bool m_loaded;
+    bool m_modified;
+};
@@ -0,0 +1,90 @@
+#include "FrameScheduler.h"
+
+#include <QGuiApplication>
+#include <QOpenGLWidget>
+#include <QScreen>
+#include <QWindow>
+#include <QtMath>
+
+namespace {
+
+// Frames not presented within this many intervals are considered lost
+const int kWatchdogFrames = 6;
+
+} // namespace
+
+FrameScheduler::FrameScheduler(QOpenGLWidget* widget)
+    : QObject(widget)
+    , m_widget(widget)
+    , m_frameRequested(false)
+    , m_frameInFlight(false)
+    , m_frameCount(0)
+{
+    connect(m_widget, &QOpenGLWidget::frameSwapped, this, &FrameScheduler::onFrameSwapped);
+
+    connect(&m_watchdog, &QTimer::timeout, this, &FrameScheduler::checkWatchdog);
+}
+
+void FrameScheduler::requestFrame()
+{
+    if (m_frameRequested) {
+        return;
+    }
+
+    m_frameRequested = true;
+    if (!m_frameInFlight) {
+        m_widget->update();
+    }
+}
+
+void FrameScheduler::beginFrame()
+{
+    m_frameRequested = false;
+    m_frameInFlight = true;
+    ++m_frameCount;
+
+    // Restarting a timer registers it anew with the event dispatcher, which
+    // allocates; one timer keeps running while frames are produced and
+    // compares against the frame clock instead
+    m_frameClock.start();
+    if (!m_watchdog.isActive()) {
+        m_watchdog.start(kWatchdogFrames * frameInterval());
+    }
+}
+
+int FrameScheduler::frameInterval() const
+{
+    QScreen* screen = nullptr;
+    if (QWindow* window = m_widget->window()->windowHandle()) {
+        screen = window->screen();
+    }
+    if (!screen) {
+        screen = QGuiApplication::primaryScreen();
+    }
+
+    const qreal refreshRate = screen && screen->refreshRate() > 1.0 ? screen->refreshRate() : 60.0;
+    return qMax(1, qRound(1000.0 / refreshRate));
+}
+
+void FrameScheduler::onFrameSwapped()
+{
+    m_frameInFlight = false;
+    emit framePresented();
+
+    if (m_frameRequested) {
+        m_widget->update();
+    }
+}
+
+void FrameScheduler::checkWatchdog()
+{
+    if (!m_frameInFlight) {
+        // No frames in a while
+        m_watchdog.stop();
+        return;
+    }
+
+    if (m_frameClock.elapsed() >= m_watchdog.interval()) {
+        onFrameSwapped();
+    }
+}
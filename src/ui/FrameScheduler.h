@@ -0,0 +1,85 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+class QOpenGLWidget;
+
+/**
+ * @brief Coalesces redraw requests into at most one frame per refresh
+ *
+ * Widgets call requestFrame() instead of update(). A request made while
+ * the previous frame is still being presented is held back until the
+ * widget reports frameSwapped(), which with vsync happens once per display
+ * refresh, so any number of requests in between yield a single repaint.
+ */
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * @param widget Widget whose repaints are scheduled
+     */
+    explicit FrameScheduler(QOpenGLWidget* widget);
+
+    /**
+     * @brief Request a repaint in the next frame
+     */
+    void requestFrame();
+
+    /**
+     * @brief Check if a repaint has been requested but not started
+     * @return true if a frame is pending
+     */
+    bool isFrameRequested() const { return m_frameRequested; }
+
+    /**
+     * @brief Mark the start of a frame
+     *
+     * Called at the beginning of paintGL(); requests made after this point
+     * are served by the next frame.
+     */
+    void beginFrame();
+
+    /**
+     * @brief Get number of frames started
+     * @return Frame counter
+     */
+    quint64 frameCount() const { return m_frameCount; }
+
+    /**
+     * @brief Get display refresh interval
+     * @return Interval in milliseconds
+     */
+    int frameInterval() const;
+
+signals:
+    /**
+     * @brief Emitted after a frame has been presented
+     */
+    void framePresented();
+
+private slots:
+    /**
+     * @brief Handle frame swap of the widget
+     */
+    void onFrameSwapped();
+
+    /**
+     * @brief Release a frame whose swap was not reported in time
+     */
+    void checkWatchdog();
+
+private:
+    QOpenGLWidget* m_widget;
+    bool m_frameRequested;
+    bool m_frameInFlight;
+    quint64 m_frameCount;
+
+    // Recovers if a swap is never reported, e.g. when the widget is hidden
+    QTimer m_watchdog;
+    QElapsedTimer m_frameClock;
+};
@@ -1,5 +1,7 @@
 #include "LayerWidget.h"
 #include "../core/LayerManager.h"
+#include "../core/CommandHistory.h"
+#include "../core/LayerCommands.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QTreeView>
@@ -79,12 +81,14 @@ void LayerWidget::removeSelectedLayers()
     }
     
     QList<Layer*> layers = selectedLayers();
-    for (Layer* layer : layers) {
-        int index = m_layerManager->indexOf(layer);
-        if (index >= 0) {
-            m_layerManager->removeLayer(index);
-        }
+    if (layers.isEmpty()) {
+        return;
     }
+    if (m_commandHistory) {
+        m_commandHistory->push(new RemoveLayersCommand(m_layerManager, layers));
+        return;
+    }
+    m_layerManager->removeLayers(layers);
 }
 
 void LayerWidget::duplicateSelectedLayers()
@@ -100,6 +104,12 @@ void LayerWidget::moveLayersUp()
     }
     
     QList<Layer*> layers = selectedLayers();
+    if (m_commandHistory) {
+        if (!layers.isEmpty()) {
+            m_commandHistory->push(new MoveLayersCommand(m_layerManager, layers, -1));
+        }
+        return;
+    }
     for (Layer* layer : layers) {
         int index = m_layerManager->indexOf(layer);
         if (index > 0) {
@@ -115,6 +125,12 @@ void LayerWidget::moveLayersDown()
     }
     
     QList<Layer*> layers = selectedLayers();
+    if (m_commandHistory) {
+        if (!layers.isEmpty()) {
+            m_commandHistory->push(new MoveLayersCommand(m_layerManager, layers, 1));
+        }
+        return;
+    }
     for (Layer* layer : layers) {
         int index = m_layerManager->indexOf(layer);
         if (index < m_layerManager->layerCount() - 1) {
@@ -126,6 +142,20 @@ void LayerWidget::moveLayersDown()
 void LayerWidget::toggleLayerVisibility()
 {
     QList<Layer*> layers = selectedLayers();
+    if (m_commandHistory) {
+        if (!layers.isEmpty()) {
+            QVariantList values;
+            for (Layer* layer : layers) {
+                values.append(!layer->isVisible());
+            }
+            m_commandHistory->push(new SetLayerPropertyCommand(m_layerManager, SetLayerPropertyCommand::Visible,
+                                                               layers, values));
+        }
+        return;
+    }
+
+    // One model notification and one repaint for the whole selection
+    LayerManager::UpdateBatch batch(m_layerManager);
     for (Layer* layer : layers) {
         layer->setVisible(!layer->isVisible());
     }
@@ -313,7 +343,9 @@ void LayerWidget::createContextMenu()
 
 void LayerWidget::updateButtonStates()
 {
-    bool hasSelection = !selectedLayers().isEmpty();
+    // Runs on every model change; avoid building the selection list
+    bool hasSelection = m_layerManager && m_treeView->selectionModel()
+                        && m_treeView->selectionModel()->hasSelection();
     bool hasLayers = m_layerManager && m_layerManager->layerCount() > 0;
     
     m_removeButton->setEnabled(hasSelection);
@@ -9,8 +9,10 @@
 #include <QMenu>
 #include <QAction>
 #include <QContextMenuEvent>
+#include <QPointer>
 
 class LayerManager;
+class CommandHistory;
 class Layer;
 class QStandardItemModel;
 
@@ -48,6 +50,16 @@ public:
      */
     void setLayerManager(LayerManager* manager);
 
+    /**
+     * @brief Set the history layer operations are recorded in
+     *
+     * Without a history the operations are applied directly and cannot
+     * be undone.
+     *
+     * @param history Command history (may be nullptr)
+     */
+    void setCommandHistory(CommandHistory* history) { m_commandHistory = history; }
+
     /**
      * @brief Get selected layers
      * @return List of selected layer pointers
@@ -222,4 +234,5 @@ private:
     
     // Data
     LayerManager* m_layerManager;
+    QPointer<CommandHistory> m_commandHistory;
 };
@@ -0,0 +1,127 @@
+#include "ProfilerOverlay.h"
+#include "../utils/Profiler.h"
+
+#include <QFontMetrics>
+#include <QPainter>
+#include <algorithm>
+
+namespace {
+
+const int kRefreshInterval = 250;
+const int kHistogramHeight = 60;
+const int kTopScopes = 8;
+
+// Histogram scale: 33 ms at full height, 16.7 ms marked
+const double kHistogramMaxMs = 33.3;
+const double kFrameBudgetMs = 16.7;
+
+double toMs(qint64 nanoseconds)
+{
+    return nanoseconds / 1.0e6;
+}
+
+} // namespace
+
+ProfilerOverlay::ProfilerOverlay(QWidget* parent)
+    : QWidget(parent)
+{
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setAttribute(Qt::WA_NoSystemBackground);
+    setFocusPolicy(Qt::NoFocus);
+    resize(Profiler::kHistoryFrames + 20, kHistogramHeight + 24 + (kTopScopes + 1) * fontMetrics().height());
+
+    m_refreshTimer.setInterval(kRefreshInterval);
+    connect(&m_refreshTimer, &QTimer::timeout, this, QOverload<>::of(&QWidget::update));
+}
+
+void ProfilerOverlay::showEvent(QShowEvent* event)
+{
+    m_refreshTimer.start();
+    QWidget::showEvent(event);
+}
+
+void ProfilerOverlay::hideEvent(QHideEvent* event)
+{
+    m_refreshTimer.stop();
+    QWidget::hideEvent(event);
+}
+
+void ProfilerOverlay::paintEvent(QPaintEvent*)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(0, 0, 0, 170));
+
+    Profiler* profiler = Profiler::instance();
+    if (!profiler) {
+        return;
+    }
+
+    const QVector<qint64> cpuTimes = profiler->frameTimes();
+    const QVector<qint64> gpuTimes = profiler->gpuTimes();
+    const QVector<Profiler::ScopeCost> costs = profiler->lastFrameCosts();
+
+    const QFontMetrics metrics = painter.fontMetrics();
+    const int lineHeight = metrics.height();
+    const int left = 10;
+    int y = 6 + metrics.ascent();
+
+    // Averages over frames that were actually recorded
+    qint64 cpuTotal = 0, cpuMax = 0, gpuTotal = 0;
+    int cpuCount = 0, gpuCount = 0;
+    for (qint64 time : cpuTimes) {
+        if (time > 0) {
+            cpuTotal += time;
+            cpuMax = qMax(cpuMax, time);
+            ++cpuCount;
+        }
+    }
+    for (qint64 time : gpuTimes) {
+        if (time >= 0) {
+            gpuTotal += time;
+            ++gpuCount;
+        }
+    }
+
+    painter.setPen(Qt::white);
+    QString summary = QString("CPU %1 ms (max %2)")
+        .arg(cpuCount ? toMs(cpuTotal / cpuCount) : 0.0, 0, 'f', 2)
+        .arg(toMs(cpuMax), 0, 'f', 2);
+    summary += gpuCount ? QString("  GPU %1 ms").arg(toMs(gpuTotal / gpuCount), 0, 'f', 2)
+                        : QString("  GPU n/a");
+    painter.drawText(left, y, summary);
+    y += 6;
+
+    // One column per frame, oldest on the left; GPU time drawn over CPU time
+    const QRect histogram(left, y, Profiler::kHistoryFrames, kHistogramHeight);
+    painter.fillRect(histogram, QColor(255, 255, 255, 25));
+    for (int i = 0; i < cpuTimes.size(); ++i) {
+        const int x = histogram.left() + i;
+        const double cpu = qMin(toMs(cpuTimes[i]) / kHistogramMaxMs, 1.0);
+        const int cpuHeight = int(cpu * kHistogramHeight);
+        painter.setPen(toMs(cpuTimes[i]) > kFrameBudgetMs ? QColor(230, 80, 60) : QColor(90, 200, 90));
+        painter.drawLine(x, histogram.bottom(), x, histogram.bottom() - cpuHeight);
+
+        if (i < gpuTimes.size() && gpuTimes[i] >= 0) {
+            const double gpu = qMin(toMs(gpuTimes[i]) / kHistogramMaxMs, 1.0);
+            painter.setPen(QColor(80, 160, 255));
+            painter.drawPoint(x, histogram.bottom() - int(gpu * kHistogramHeight));
+        }
+    }
+    const int budgetY = histogram.bottom() - int(kFrameBudgetMs / kHistogramMaxMs * kHistogramHeight);
+    painter.setPen(QColor(255, 255, 255, 120));
+    painter.drawLine(histogram.left(), budgetY, histogram.right(), budgetY);
+    y = histogram.bottom() + 6 + metrics.ascent();
+
+    // Most expensive scopes of the last frame
+    const int shown = std::min<int>(costs.size(), kTopScopes);
+    for (int i = 0; i < shown; ++i) {
+        const Profiler::ScopeCost& cost = costs[i];
+        const QString text = QString("%1 ms  %2%3")
+            .arg(toMs(cost.time), 6, 'f', 2)
+            .arg(cost.name)
+            .arg(cost.calls > 1 ? QString(" (x%1)").arg(cost.calls) : QString());
+        painter.setPen(Qt::white);
+        painter.drawText(left, y, metrics.elidedText(text, Qt::ElideRight, width() - 2 * left));
+        y += lineHeight;
+    }
+}
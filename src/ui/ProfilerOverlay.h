@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QTimer>
+#include <QWidget>
+
+/**
+ * @brief Frame-time readout drawn on top of a viewer
+ *
+ * Shows a histogram of the recent CPU and GPU frame times kept by the
+ * Profiler, their averages, and the most expensive scopes of the last
+ * frame (one per layer for Layer::render). The overlay ignores mouse
+ * input and repaints a few times per second, not with every frame.
+ */
+class ProfilerOverlay : public QWidget
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * @param parent Widget to draw over
+     */
+    explicit ProfilerOverlay(QWidget* parent);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
+private:
+    QTimer m_refreshTimer;
+};
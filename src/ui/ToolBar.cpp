@@ -1,17 +1,22 @@
 #include "ToolBar.h"
 #include "ViewerWidget.h"
+#include "../core/Dims.h"
 #include <QAction>
 #include <QActionGroup>
 #include <QComboBox>
 #include <QSlider>
 #include <QLabel>
 #include <QHBoxLayout>
+#include <QSignalBlocker>
+#include <QSpinBox>
 #include <QWidget>
+#include <limits>
 
 ToolBar::ToolBar(QWidget* parent)
     : QToolBar(parent)
     , m_currentTool(ToolType::Select)
     , m_viewerWidget(nullptr)
+    , m_dims(nullptr)
 {
     setObjectName("MainToolBar");
     setWindowTitle("Tools");
@@ -47,6 +52,25 @@ void ToolBar::setViewerWidget(ViewerWidget* viewer)
     }
 }
 
+void ToolBar::setDims(Dims* dims)
+{
+    if (m_dims) {
+        disconnect(m_dims, nullptr, this, nullptr);
+    }
+
+    m_dims = dims;
+
+    if (m_dims) {
+        connect(m_dims, &Dims::rangeChanged, this, &ToolBar::updatePlaybackControls);
+        connect(m_dims, &Dims::pointChanged, this, &ToolBar::updateFrameDisplay);
+        connect(m_dims, &Dims::playbackChanged, this, [this](bool playing) {
+            QSignalBlocker blocker(m_playAction);
+            m_playAction->setChecked(playing);
+        });
+    }
+    updatePlaybackControls();
+}
+
 void ToolBar::resetView()
 {
     if (m_viewerWidget) {
@@ -132,11 +156,89 @@ void ToolBar::onViewModeChanged(int index)
     }
 }
 
+void ToolBar::onPlayToggled(bool playing)
+{
+    if (!m_dims) {
+        return;
+    }
+
+    if (playing) {
+        m_dims->setFps(m_fpsSpin->value());
+        m_dims->play(m_axisCombo->currentIndex());
+    } else {
+        m_dims->stop();
+    }
+}
+
+void ToolBar::onFrameChanged(int frame)
+{
+    if (m_dims) {
+        m_dims->setIndex(m_axisCombo->currentIndex(), frame);
+    }
+}
+
+void ToolBar::onPlaybackAxisChanged(int axis)
+{
+    Q_UNUSED(axis)
+    if (m_dims && m_dims->isPlaying()) {
+        m_dims->play(m_axisCombo->currentIndex());
+    }
+    updateFrameDisplay();
+}
+
+void ToolBar::onFpsChanged(int fps)
+{
+    if (m_dims) {
+        m_dims->setFps(fps);
+    }
+}
+
+void ToolBar::updatePlaybackControls()
+{
+    const int ndim = m_dims ? m_dims->ndim() : 0;
+
+    {
+        QSignalBlocker blocker(m_axisCombo);
+        const int axis = qBound(0, m_axisCombo->currentIndex(), qMax(0, ndim - 1));
+        m_axisCombo->clear();
+        for (int i = 0; i < ndim; ++i) {
+            m_axisCombo->addItem(QString("Axis %1").arg(i));
+        }
+        m_axisCombo->setCurrentIndex(ndim > 0 ? axis : -1);
+    }
+
+    for (QAction* action : qAsConst(m_playbackActions)) {
+        action->setVisible(ndim > 0);
+    }
+    m_axisComboAction->setVisible(ndim > 1);
+
+    updateFrameDisplay();
+}
+
+void ToolBar::updateFrameDisplay()
+{
+    const int axis = m_axisCombo->currentIndex();
+    if (!m_dims || axis < 0 || axis >= m_dims->ndim()) {
+        return;
+    }
+
+    const int last = int(qMin<qint64>(m_dims->range().at(axis) - 1, std::numeric_limits<int>::max()));
+    const int frame = int(m_dims->point().at(axis));
+
+    QSignalBlocker sliderBlocker(m_frameSlider);
+    QSignalBlocker spinBlocker(m_frameSpin);
+    m_frameSlider->setRange(0, last);
+    m_frameSpin->setRange(0, last);
+    m_frameSlider->setValue(frame);
+    m_frameSpin->setValue(frame);
+}
+
 void ToolBar::setupToolbar()
 {
     createToolActions();
     createViewActions();
     createZoomControls();
+    createPlaybackControls();
     
     // Add separators between sections
     addSeparator();
@@ -151,6 +253,16 @@ void ToolBar::setupToolbar()
     addWidget(new QLabel("Zoom:"));
     addWidget(m_zoomSlider);
     addWidget(m_zoomLabel);
+
+    // Playback controls
+    m_playbackActions << addSeparator();
+    m_playbackActions << m_playAction;
+    addAction(m_playAction);
+    m_axisComboAction = addWidget(m_axisCombo);
+    m_playbackActions << addWidget(m_frameSlider);
+    m_playbackActions << addWidget(m_frameSpin);
+    m_playbackActions << addWidget(m_fpsSpin);
+    updatePlaybackControls();
 }
 
 void ToolBar::createToolActions()
@@ -273,6 +385,36 @@ void ToolBar::createZoomControls()
     m_zoomLabel->setAlignment(Qt::AlignCenter);
 }
 
+void ToolBar::createPlaybackControls()
+{
+    m_playAction = new QAction("Play", this);
+    m_playAction->setCheckable(true);
+    m_playAction->setToolTip("Play through the selected dimension");
+    m_playAction->setShortcut(QKeySequence("Ctrl+P"));
+    connect(m_playAction, &QAction::toggled, this, &ToolBar::onPlayToggled);
+
+    m_axisCombo = new QComboBox(this);
+    m_axisCombo->setToolTip("Dimension to step and play");
+    connect(m_axisCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &ToolBar::onPlaybackAxisChanged);
+
+    m_frameSlider = new QSlider(Qt::Horizontal, this);
+    m_frameSlider->setFixedWidth(160);
+    m_frameSlider->setToolTip("Current index");
+    connect(m_frameSlider, &QSlider::valueChanged, this, &ToolBar::onFrameChanged);
+
+    m_frameSpin = new QSpinBox(this);
+    m_frameSpin->setToolTip("Current index");
+    connect(m_frameSpin, QOverload<int>::of(&QSpinBox::valueChanged), this, &ToolBar::onFrameChanged);
+
+    m_fpsSpin = new QSpinBox(this);
+    m_fpsSpin->setRange(1, 120);
+    m_fpsSpin->setValue(10);
+    m_fpsSpin->setSuffix(" fps");
+    m_fpsSpin->setToolTip("Playback rate");
+    connect(m_fpsSpin, QOverload<int>::of(&QSpinBox::valueChanged), this, &ToolBar::onFpsChanged);
+}
+
 void ToolBar::updateToolStates()
 {
     switch (m_currentTool) {
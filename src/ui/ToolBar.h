@@ -8,12 +8,14 @@
 #include <QSlider>
 #include <QLabel>
 
+class Dims;
 class ViewerWidget;
 
 /**
  * @brief Main toolbar for the application
  * 
- * Provides quick access to common tools and view controls.
+ * Provides quick access to common tools and view controls, and playback
+ * controls for the slider dimensions of a Dims object.
  */
 class ToolBar : public QToolBar
 {
@@ -67,6 +69,21 @@ public:
      */
     void setViewerWidget(ViewerWidget* viewer);
 
+    /**
+     * @brief Get slicing state driven by the playback controls
+     * @return Dims pointer
+     */
+    Dims* dims() const { return m_dims; }
+
+    /**
+     * @brief Set slicing state driven by the playback controls
+     *
+     * The controls are hidden while there are no slider dimensions.
+     *
+     * @param dims Dims object
+     */
+    void setDims(Dims* dims);
+
 public slots:
     /**
      * @brief Reset view
@@ -151,6 +168,40 @@ private slots:
      */
     void onViewModeChanged(int index);
 
+    /**
+     * @brief Start or stop playback
+     * @param playing true to play
+     */
+    void onPlayToggled(bool playing);
+
+    /**
+     * @brief Handle frame slider or spin box change
+     * @param frame Index along the selected dimension
+     */
+    void onFrameChanged(int frame);
+
+    /**
+     * @brief Handle selection of the dimension to step and play
+     * @param axis Dimension
+     */
+    void onPlaybackAxisChanged(int axis);
+
+    /**
+     * @brief Handle playback rate change
+     * @param fps Frames per second
+     */
+    void onFpsChanged(int fps);
+
+    /**
+     * @brief Show controls matching the slider dimensions
+     */
+    void updatePlaybackControls();
+
+    /**
+     * @brief Show the current index of the selected dimension
+     */
+    void updateFrameDisplay();
+
 private:
     /**
      * @brief Setup toolbar
@@ -172,6 +223,11 @@ private:
      */
     void createZoomControls();
 
+    /**
+     * @brief Create playback controls
+     */
+    void createPlaybackControls();
+
     /**
      * @brief Update tool states
      */
@@ -207,7 +263,17 @@ private:
     QSlider* m_zoomSlider;
     QLabel* m_zoomLabel;
 
+    // Playback controls, shown while there are slider dimensions
+    QAction* m_playAction;
+    QComboBox* m_axisCombo;
+    QSlider* m_frameSlider;
+    QSpinBox* m_frameSpin;
+    QSpinBox* m_fpsSpin;
+    QAction* m_axisComboAction;
+    QList<QAction*> m_playbackActions;
+
     // State
     ToolType m_currentTool;
     ViewerWidget* m_viewerWidget;
+    Dims* m_dims;
 };
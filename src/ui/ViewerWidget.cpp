@@ -1,13 +1,52 @@
 #include "ViewerWidget.h"
+#include "FrameScheduler.h"
+#include "ProfilerOverlay.h"
+#include "../core/GpuResourcePool.h"
 #include "../core/LayerManager.h"
+#include "../core/RenderContext.h"
+#include "../core/EventChannel.h"
+#include "../utils/Profiler.h"
 
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
 #include <QOpenGLFunctions>
+#ifndef QT_OPENGL_ES_2
+#include <QOpenGLTimerQuery>
+#endif
 #include <QMatrix4x4>
 #include <QMouseEvent>
+#include <QtMath>
 #include <QWheelEvent>
 #include <QKeyEvent>
 #include <QDebug>
 
+namespace {
+
+// Hover picking radius in screen pixels
+const float kPickTolerance = 4.0f;
+
+// Time without view changes after which an interaction counts as finished
+const int kInteractionSettleMs = 150;
+
+// Margin around layer bounds before culling, in screen pixels, so points
+// drawn with a minimum screen size are not dropped at the edges
+const qreal kCullMargin = 8.0;
+
+// Vertical field of view of the 3D camera in degrees
+const float kFieldOfView = 45.0f;
+
+/**
+ * @brief Get the 3D camera distance at which the z = 0 plane appears at
+ *        the same scale as in the 2D view
+ */
+float cameraDistance(int viewportHeight, float zoom)
+{
+    return float(viewportHeight) / (2.0f * zoom * qTan(qDegreesToRadians(kFieldOfView * 0.5f)));
+}
+
+} // namespace
+
 ViewerWidget::ViewerWidget(QWidget* parent)
     : QOpenGLWidget(parent)
     , m_viewMode(ViewMode::View2D)
@@ -22,21 +61,52 @@ ViewerWidget::ViewerWidget(QWidget* parent)
     , m_showGrid(true)
     , m_showAxes(true)
     , m_glInitialized(false)
+    , m_frameScheduler(new FrameScheduler(this))
+    , m_projectionDirty(true)
+    , m_viewDirty(true)
+    , m_sceneDirty(true)
+    , m_cachedLayerCount(0)
+    , m_layerCacheValid(false)
+    , m_mousePositionPending(false)
+    , m_hoveredElement(-1)
+    , m_profilerOverlay(nullptr)
+    , m_gpuTimerIndex(0)
+    , m_gpuTimerRunning(false)
+    , m_gpuTimingUnsupported(false)
 {
     setFocusPolicy(Qt::StrongFocus);
     setMouseTracking(true);
+
+    for (int i = 0; i < kGpuTimerCount; ++i) {
+        m_gpuTimers[i] = nullptr;
+        m_gpuTimerPending[i] = false;
+    }
+
+    m_mouseThrottle.setSingleShot(true);
+    connect(&m_mouseThrottle, &QTimer::timeout, this, &ViewerWidget::emitMousePosition);
+
+    // Redraw at full quality once the view stops moving
+    m_interactionTimer.setSingleShot(true);
+    m_interactionTimer.setInterval(kInteractionSettleMs);
+    connect(&m_interactionTimer, &QTimer::timeout, this, [this]() {
+        m_sceneDirty = true;
+        requestFrame();
+    });
 }
 
 ViewerWidget::~ViewerWidget()
 {
+    cleanupGL();
+    if (context()) {
+        disconnect(context(), nullptr, this, nullptr);
+    }
 }
 
 void ViewerWidget::setViewMode(ViewMode mode)
 {
     if (m_viewMode != mode) {
         m_viewMode = mode;
-        updateProjectionMatrix();
-        update();
+        invalidateView();
         emit viewModeChanged(mode);
     }
 }
@@ -46,8 +116,10 @@ void ViewerWidget::setZoomLevel(float zoom)
     zoom = qMax(0.1f, qMin(100.0f, zoom));
     if (qAbs(m_zoomLevel - zoom) > 0.001f) {
         m_zoomLevel = zoom;
-        updateProjectionMatrix();
-        update();
+        m_projectionDirty = true;
+        m_viewDirty = true;         // The 3D camera distance follows the zoom
+        m_sceneDirty = true;
+        requestFrame();
         emit zoomChanged(zoom);
     }
 }
@@ -56,8 +128,20 @@ void ViewerWidget::setViewCenter(const QVector3D& center)
 {
     if (m_viewCenter != center) {
         m_viewCenter = center;
-        updateViewMatrix();
-        update();
+        m_viewDirty = true;
+        m_sceneDirty = true;
+        requestFrame();
+        emit viewChanged();
+    }
+}
+
+void ViewerWidget::setRotation(const QVector3D& rotation)
+{
+    if (m_rotation != rotation) {
+        m_rotation = rotation;
+        m_viewDirty = true;
+        m_sceneDirty = true;
+        requestFrame();
         emit viewChanged();
     }
 }
@@ -65,18 +149,23 @@ void ViewerWidget::setViewCenter(const QVector3D& center)
 void ViewerWidget::setLayerManager(LayerManager* manager)
 {
     if (m_layerManager) {
+        cleanupGL();
         disconnect(m_layerManager, nullptr, this, nullptr);
     }
     
     m_layerManager = manager;
     
     if (m_layerManager) {
-        connect(m_layerManager, &LayerManager::dataChanged, this, &ViewerWidget::onLayerChanged);
+        connect(m_layerManager, &LayerManager::dataChanged, this, &ViewerWidget::onLayerDataChanged);
         connect(m_layerManager, &LayerManager::rowsInserted, this, &ViewerWidget::onLayerChanged);
         connect(m_layerManager, &LayerManager::rowsRemoved, this, &ViewerWidget::onLayerChanged);
+        connect(m_layerManager, &LayerManager::rowsMoved, this, &ViewerWidget::onLayerChanged);
+        connect(m_layerManager, &LayerManager::modelReset, this, &ViewerWidget::onLayerChanged);
+        connect(m_layerManager, &LayerManager::rowsAboutToBeRemoved,
+                this, &ViewerWidget::onLayersAboutToBeRemoved);
     }
     
-    update();
+    onLayerChanged();
 }
 
 QVector3D ViewerWidget::screenToWorld(const QPoint& screenPos) const
@@ -88,6 +177,38 @@ QVector3D ViewerWidget::screenToWorld(const QPoint& screenPos) const
     return QVector3D(x, y, 0.0f);
 }
 
+Layer* ViewerWidget::pickAt(const QPoint& screenPos, int* elementIndex) const
+{
+    if (elementIndex) {
+        *elementIndex = -1;
+    }
+
+    if (!m_layerManager || m_viewMode != ViewMode::View2D) {
+        return nullptr;
+    }
+
+    const QVector3D worldPos = screenToWorld(screenPos);
+    const float tolerance = kPickTolerance / m_zoomLevel;
+
+    // Topmost layers are drawn last, so they are tested first
+    for (int i = m_layerManager->layerCount() - 1; i >= 0; --i) {
+        Layer* layer = m_layerManager->layer(i);
+        if (!layer || !layer->isVisible()) {
+            continue;
+        }
+
+        const int index = layer->pick(worldPos.toPointF(), tolerance);
+        if (index >= 0) {
+            if (elementIndex) {
+                *elementIndex = index;
+            }
+            return layer;
+        }
+    }
+
+    return nullptr;
+}
+
 QPoint ViewerWidget::worldToScreen(const QVector3D& worldPos) const
 {
     // Simple world to screen conversion
@@ -101,9 +222,7 @@ void ViewerWidget::resetView()
     m_zoomLevel = 1.0f;
     m_viewCenter = QVector3D(0.0f, 0.0f, 0.0f);
     m_rotation = QVector3D(0.0f, 0.0f, 0.0f);
-    updateProjectionMatrix();
-    updateViewMatrix();
-    update();
+    invalidateView();
     emit viewChanged();
     emit zoomChanged(m_zoomLevel);
 }
@@ -125,22 +244,21 @@ void ViewerWidget::zoomToFit()
         return;
     }
 
-    QVector<float> bounds = calculateViewBounds();
-    if (bounds.size() >= 4) {
-        float width = bounds[2] - bounds[0];
-        float height = bounds[3] - bounds[1];
-        float centerX = (bounds[0] + bounds[2]) / 2.0f;
-        float centerY = (bounds[1] + bounds[3]) / 2.0f;
-        
-        m_viewCenter = QVector3D(centerX, centerY, 0.0f);
-        
-        float scaleX = this->width() / width;
-        float scaleY = this->height() / height;
-        m_zoomLevel = qMin(scaleX, scaleY) * 0.9f; // 90% to add some margin
-        
-        updateProjectionMatrix();
-        updateViewMatrix();
-        update();
+    const LayerBounds bounds = calculateViewBounds();
+    if (bounds.isValid()) {
+        const QPointF center = bounds.center();
+        m_viewCenter = QVector3D(float(center.x()), float(center.y()), 0.0f);
+
+        // A single point or a line has no extent to fit; keep the zoom level
+        const float width = bounds.width();
+        const float height = bounds.height();
+        if (width > 0.0f && height > 0.0f) {
+            float scaleX = this->width() / width;
+            float scaleY = this->height() / height;
+            m_zoomLevel = qMin(scaleX, scaleY) * 0.9f; // 90% to add some margin
+        }
+
+        invalidateView();
         emit viewChanged();
         emit zoomChanged(m_zoomLevel);
     }
@@ -153,20 +271,27 @@ void ViewerWidget::toggleViewMode()
 
 void ViewerWidget::updateDisplay()
 {
-    update();
+    m_sceneDirty = true;
+    requestFrame();
 }
 
 void ViewerWidget::initializeGL()
 {
     initializeOpenGLFunctions();
     setupGL();
+
+    connect(context(), &QOpenGLContext::aboutToBeDestroyed,
+            this, &ViewerWidget::cleanupGL, Qt::DirectConnection);
+
     m_glInitialized = true;
 }
 
 void ViewerWidget::resizeGL(int w, int h)
 {
     glViewport(0, 0, w, h);
-    updateProjectionMatrix();
+    m_projectionDirty = true;
+    m_viewDirty = true;
+    m_sceneDirty = true;
 }
 
 void ViewerWidget::paintGL()
@@ -175,6 +300,27 @@ void ViewerWidget::paintGL()
         return;
     }
 
+    m_frameScheduler->beginFrame();
+
+    // The profiler frame spans paintGL()
+    Profiler* profiler = Profiler::activeInstance();
+    if (profiler) {
+        profiler->beginFrame();
+        beginGpuTimer();
+    }
+
+    // Matrices are only rebuilt once per frame, however often the view changed
+    const bool viewMoved = m_projectionDirty || m_viewDirty;
+    if (m_projectionDirty) {
+        updateProjectionMatrix();
+    }
+    if (m_viewDirty) {
+        updateViewMatrix();
+    }
+    if (viewMoved) {
+        EventChannel<ViewChangedPayload>::instance().publish({m_viewCenter, m_zoomLevel});
+    }
+
     // Clear the screen
     glClearColor(m_backgroundColor.redF(), m_backgroundColor.greenF(), 
                  m_backgroundColor.blueF(), 1.0f);
@@ -189,6 +335,38 @@ void ViewerWidget::paintGL()
 
     // Render layers
     renderLayers();
+
+    if (profiler) {
+        endGpuTimer();
+        profiler->endFrame();
+    }
+
+    m_frameArena.reset();
+}
+
+void ViewerWidget::setProfilerOverlayVisible(bool visible)
+{
+    Profiler* profiler = Profiler::instance();
+    if (!profiler) {
+        return;
+    }
+
+    if (visible && !m_profilerOverlay) {
+        m_profilerOverlay = new ProfilerOverlay(this);
+        m_profilerOverlay->move(8, 8);
+    }
+    if (!m_profilerOverlay || m_profilerOverlay->isVisible() == visible) {
+        return;
+    }
+
+    if (visible) {
+        profiler->setEnabled(true);
+    } else if (!profiler->isCapturing()) {
+        profiler->setEnabled(false);
+    }
+    m_profilerOverlay->setVisible(visible);
+    requestFrame();
+    emit profilerOverlayVisibilityChanged(visible);
 }
 
 void ViewerWidget::mousePressEvent(QMouseEvent* event)
@@ -215,9 +393,12 @@ void ViewerWidget::mouseMoveEvent(QMouseEvent* event)
         handleRotation(delta);
     }
 
-    // Emit mouse position
-    QVector3D worldPos = screenToWorld(event->pos());
-    emit mousePositionChanged(worldPos, event->pos());
+    // Report the mouse position at most once per frame
+    m_pendingMousePos = event->pos();
+    m_mousePositionPending = true;
+    if (!m_mouseThrottle.isActive()) {
+        emitMousePosition();
+    }
 
     m_lastMousePos = event->pos();
     QOpenGLWidget::mouseMoveEvent(event);
@@ -261,6 +442,9 @@ void ViewerWidget::keyPressEvent(QKeyEvent* event)
     case Qt::Key_Space:
         toggleViewMode();
         break;
+    case Qt::Key_F3:
+        setProfilerOverlayVisible(!m_profilerOverlay || !m_profilerOverlay->isVisible());
+        break;
     default:
         QOpenGLWidget::keyPressEvent(event);
         break;
@@ -269,7 +453,157 @@ void ViewerWidget::keyPressEvent(QKeyEvent* event)
 
 void ViewerWidget::onLayerChanged()
 {
-    update();
+    // Layer order or membership changed; the cache no longer matches
+    m_dirtyLayers.clear();
+    m_layerCacheValid = false;
+    m_sceneDirty = true;
+    requestFrame();
+}
+
+void ViewerWidget::onLayerDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+{
+    if (!m_layerManager) {
+        return;
+    }
+
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+        if (Layer* layer = m_layerManager->layer(row)) {
+            m_dirtyLayers.insert(layer);
+        }
+    }
+    requestFrame();
+}
+
+void ViewerWidget::emitMousePosition()
+{
+    if (!m_mousePositionPending) {
+        return;
+    }
+
+    m_mousePositionPending = false;
+    const QVector3D worldPos = screenToWorld(m_pendingMousePos);
+    emit mousePositionChanged(worldPos, m_pendingMousePos);
+
+    EventChannel<MousePositionPayload>& mouseChannel = EventChannel<MousePositionPayload>::instance();
+    if (mouseChannel.hasSubscribers()) {
+        mouseChannel.publish({worldPos, m_pendingMousePos});
+    }
+
+    int element = -1;
+    Layer* layer = pickAt(m_pendingMousePos, &element);
+    if (layer != m_hoveredLayer || element != m_hoveredElement) {
+        m_hoveredLayer = layer;
+        m_hoveredElement = element;
+        emit hoveredElementChanged(layer, element);
+    }
+
+    m_mouseThrottle.start(m_frameScheduler->frameInterval());
+}
+
+void ViewerWidget::onLayersAboutToBeRemoved(const QModelIndex& parent, int first, int last)
+{
+    Q_UNUSED(parent)
+
+    if (!m_glInitialized || !m_layerManager) {
+        return;
+    }
+
+    makeCurrent();
+    for (int i = first; i <= last; ++i) {
+        Layer* layer = m_layerManager->layer(i);
+        if (layer) {
+            m_dirtyLayers.remove(layer);
+            layer->releaseGraphicsResources();
+        }
+    }
+    doneCurrent();
+}
+
+void ViewerWidget::cleanupGL()
+{
+    if (!m_glInitialized) {
+        return;
+    }
+
+    makeCurrent();
+    releaseLayerCache();
+    releaseGpuTimers();
+    if (m_layerManager) {
+        for (int i = 0; i < m_layerManager->layerCount(); ++i) {
+            Layer* layer = m_layerManager->layer(i);
+            if (layer) {
+                layer->releaseGraphicsResources();
+            }
+        }
+    }
+    if (GpuResourcePool* pool = GpuResourcePool::current()) {
+        pool->trim(context()->functions());
+    }
+    doneCurrent();
+}
+
+void ViewerWidget::beginGpuTimer()
+{
+#ifndef QT_OPENGL_ES_2
+    if (m_gpuTimingUnsupported) {
+        return;
+    }
+
+    if (!m_gpuTimers[0]) {
+        for (int i = 0; i < kGpuTimerCount; ++i) {
+            m_gpuTimers[i] = new QOpenGLTimerQuery(this);
+            if (!m_gpuTimers[i]->create()) {
+                qDebug() << "GPU timer queries not supported; GPU frame times unavailable";
+                releaseGpuTimers();
+                m_gpuTimingUnsupported = true;
+                return;
+            }
+        }
+    }
+
+    Profiler* profiler = Profiler::activeInstance();
+    for (int i = 0; i < kGpuTimerCount; ++i) {
+        if (m_gpuTimerPending[i] && m_gpuTimers[i]->isResultAvailable()) {
+            const GLuint64 elapsed = m_gpuTimers[i]->waitForResult();
+            m_gpuTimerPending[i] = false;
+            if (profiler) {
+                profiler->recordGpuTime(qint64(elapsed));
+            }
+        }
+    }
+
+    // Skip timing this frame rather than stall on a query still in flight
+    if (!m_gpuTimerPending[m_gpuTimerIndex]) {
+        m_gpuTimers[m_gpuTimerIndex]->begin();
+        m_gpuTimerRunning = true;
+    }
+#endif
+}
+
+void ViewerWidget::endGpuTimer()
+{
+#ifndef QT_OPENGL_ES_2
+    if (!m_gpuTimerRunning) {
+        return;
+    }
+
+    m_gpuTimers[m_gpuTimerIndex]->end();
+    m_gpuTimerPending[m_gpuTimerIndex] = true;
+    m_gpuTimerIndex = (m_gpuTimerIndex + 1) % kGpuTimerCount;
+    m_gpuTimerRunning = false;
+#endif
+}
+
+void ViewerWidget::releaseGpuTimers()
+{
+#ifndef QT_OPENGL_ES_2
+    for (int i = 0; i < kGpuTimerCount; ++i) {
+        delete m_gpuTimers[i];
+        m_gpuTimers[i] = nullptr;
+        m_gpuTimerPending[i] = false;
+    }
+#endif
+    m_gpuTimerRunning = false;
 }
 
 void ViewerWidget::setupGL()
@@ -286,8 +620,32 @@ void ViewerWidget::setupGL()
     updateViewMatrix();
 }
 
+bool ViewerWidget::supportsInstancing() const
+{
+    // Instanced arrays are core in desktop GL 3.3 and OpenGL ES 3.0
+    const QSurfaceFormat format = context()->format();
+    if (context()->isOpenGLES()) {
+        return format.majorVersion() >= 3;
+    }
+    return format.version() >= qMakePair(3, 3);
+}
+
+void ViewerWidget::requestFrame()
+{
+    m_frameScheduler->requestFrame();
+}
+
+void ViewerWidget::invalidateView()
+{
+    m_projectionDirty = true;
+    m_viewDirty = true;
+    m_sceneDirty = true;
+    requestFrame();
+}
+
 void ViewerWidget::updateProjectionMatrix()
 {
+    m_projectionDirty = false;
     m_projectionMatrix.setToIdentity();
     
     float aspect = float(width()) / float(height());
@@ -298,19 +656,21 @@ void ViewerWidget::updateProjectionMatrix()
         float halfHeight = height() / (2.0f * m_zoomLevel);
         m_projectionMatrix.ortho(-halfWidth, halfWidth, -halfHeight, halfHeight, -1000.0f, 1000.0f);
     } else {
-        // Perspective projection for 3D
-        m_projectionMatrix.perspective(45.0f, aspect, 0.1f, 1000.0f);
+        // Perspective projection for 3D; depth range follows the camera distance
+        const float distance = cameraDistance(height(), m_zoomLevel);
+        m_projectionMatrix.perspective(kFieldOfView, aspect, distance * 0.01f, distance * 100.0f + 1000.0f);
     }
 }
 
 void ViewerWidget::updateViewMatrix()
 {
+    m_viewDirty = false;
     m_viewMatrix.setToIdentity();
     
     if (m_viewMode == ViewMode::View2D) {
         m_viewMatrix.translate(-m_viewCenter.x(), -m_viewCenter.y(), 0.0f);
     } else {
-        m_viewMatrix.translate(0.0f, 0.0f, -10.0f);
+        m_viewMatrix.translate(0.0f, 0.0f, -cameraDistance(height(), m_zoomLevel));
         m_viewMatrix.rotate(m_rotation.x(), 1.0f, 0.0f, 0.0f);
         m_viewMatrix.rotate(m_rotation.y(), 0.0f, 1.0f, 0.0f);
         m_viewMatrix.rotate(m_rotation.z(), 0.0f, 0.0f, 1.0f);
@@ -324,16 +684,140 @@ void ViewerWidget::renderLayers()
         return;
     }
 
-    // Render each layer
-    for (int i = 0; i < m_layerManager->layerCount(); ++i) {
+    PROFILE_SCOPE("ViewerWidget::renderLayers");
+
+    RenderContext renderContext;
+    renderContext.glContext = context();
+    renderContext.gl = context()->functions();
+    if (supportsInstancing()) {
+        renderContext.instancing = context()->extraFunctions();
+    }
+    renderContext.projectionMatrix = m_projectionMatrix;
+    renderContext.viewMatrix = m_viewMatrix;
+    renderContext.viewRect = visibleWorldRect();
+    renderContext.viewportSize = size() * devicePixelRatioF();
+    renderContext.zoomLevel = m_zoomLevel;
+    renderContext.is3D = (m_viewMode == ViewMode::View3D);
+    renderContext.interactive = m_interactionTimer.isActive();
+    renderContext.arena = &m_frameArena;
+
+    const int layerCount = m_layerManager->layerCount();
+
+    // Lowest layer that changed since the last frame
+    int firstDirty = layerCount;
+    for (Layer* layer : qAsConst(m_dirtyLayers)) {
+        const int row = m_layerManager->indexOf(layer);
+        if (row >= 0) {
+            firstDirty = qMin(firstDirty, row);
+        }
+    }
+    m_dirtyLayers.clear();
+
+    const bool sceneDirty = m_sceneDirty;
+    m_sceneDirty = false;
+
+    // 2D layers all sit at z = 0 and are composited in list order
+    if (renderContext.is3D) {
+        glEnable(GL_DEPTH_TEST);
+        m_layerCacheValid = false;
+        renderLayerRange(renderContext, 0, layerCount);
+        return;
+    }
+    glDisable(GL_DEPTH_TEST);
+
+    if (sceneDirty) {
+        // The view is moving: every layer has to be drawn again anyway, and
+        // refreshing the cache would only add a pass
+        m_layerCacheValid = false;
+        renderLayerRange(renderContext, 0, layerCount);
+        return;
+    }
+
+    if (!m_layerCacheValid || firstDirty < m_cachedLayerCount) {
+        // Cache the layers below the lowest changed one; those are the ones
+        // likely to stay unchanged during the next frames
+        if (firstDirty == 0 || !updateLayerCache(renderContext, firstDirty)) {
+            renderLayerRange(renderContext, 0, layerCount);
+            return;
+        }
+    }
+
+    drawLayerCache(renderContext);
+    renderLayerRange(renderContext, m_cachedLayerCount, layerCount);
+}
+
+void ViewerWidget::renderLayerRange(RenderContext& context, int first, int last)
+{
+    for (int i = first; i < last; ++i) {
         Layer* layer = m_layerManager->layer(i);
-        if (layer && layer->isVisible()) {
-            // TODO: Implement actual layer rendering
-            // layer->render(renderContext);
+        if (!layer || !layer->isVisible()) {
+            continue;
+        }
+
+        // Skip layers entirely outside the viewport in 2D
+        if (!context.is3D) {
+            const LayerBounds bounds = m_layerManager->layerBounds(layer);
+            if (bounds.isValid() && !bounds.intersects(context.viewRect, kCullMargin / context.zoomLevel)) {
+                continue;
+            }
         }
+
+        PROFILE_SCOPE_LABEL("Layer::render", layer->name());
+        layer->render(&context);
     }
 }
 
+bool ViewerWidget::updateLayerCache(RenderContext& context, int count)
+{
+    m_layerCacheValid = false;
+
+    if (!m_layerCache || m_layerCache->size() != context.viewportSize) {
+        m_layerCache.reset();
+        m_layerCache = std::make_unique<QOpenGLFramebufferObject>(context.viewportSize);
+        if (!m_layerCache->isValid()) {
+            m_layerCache.reset();
+            return false;
+        }
+    }
+
+    m_layerCache->bind();
+    glViewport(0, 0, context.viewportSize.width(), context.viewportSize.height());
+    glClearColor(m_backgroundColor.redF(), m_backgroundColor.greenF(),
+                 m_backgroundColor.blueF(), 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    renderLayerRange(context, 0, count);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+    glViewport(0, 0, context.viewportSize.width(), context.viewportSize.height());
+
+    m_cachedLayerCount = count;
+    m_layerCacheValid = true;
+    return true;
+}
+
+void ViewerWidget::drawLayerCache(RenderContext& context)
+{
+    if (!m_cacheQuad.isCreated() && !m_cacheQuad.create()) {
+        m_layerCacheValid = false;
+        return;
+    }
+
+    // Framebuffer textures have their first row at the bottom, so the quad
+    // is given a negative height to cover clip space without flipping
+    m_cacheQuad.begin(context.gl, QMatrix4x4(), 1.0f);
+    m_cacheQuad.draw(m_layerCache->texture(), QRectF(-1.0, 1.0, 2.0, -2.0));
+    m_cacheQuad.end();
+}
+
+void ViewerWidget::releaseLayerCache()
+{
+    m_layerCache.reset();
+    m_cacheQuad.destroy();
+    m_layerCacheValid = false;
+    m_cachedLayerCount = 0;
+}
+
 void ViewerWidget::renderBackground()
 {
     // Background is already cleared in paintGL
@@ -345,53 +829,32 @@ void ViewerWidget::renderGrid()
     // This would draw a grid overlay to help with navigation
 }
 
-QVector<float> ViewerWidget::calculateViewBounds() const
+LayerBounds ViewerWidget::calculateViewBounds() const
 {
-    QVector<float> bounds;
-    
-    if (!m_layerManager || m_layerManager->layerCount() == 0) {
-        return bounds;
-    }
-
-    bool first = true;
-    float minX = 0, minY = 0, maxX = 0, maxY = 0;
-
-    for (int i = 0; i < m_layerManager->layerCount(); ++i) {
-        Layer* layer = m_layerManager->layer(i);
-        if (layer && layer->isVisible()) {
-            QVector<float> layerBounds = layer->bounds();
-            if (layerBounds.size() >= 4) {
-                if (first) {
-                    minX = layerBounds[0];
-                    minY = layerBounds[1];
-                    maxX = layerBounds[2];
-                    maxY = layerBounds[3];
-                    first = false;
-                } else {
-                    minX = qMin(minX, layerBounds[0]);
-                    minY = qMin(minY, layerBounds[1]);
-                    maxX = qMax(maxX, layerBounds[2]);
-                    maxY = qMax(maxY, layerBounds[3]);
-                }
-            }
-        }
-    }
-
-    if (!first) {
-        bounds << minX << minY << maxX << maxY;
+    if (!m_layerManager) {
+        return LayerBounds();
     }
+    return m_layerManager->sceneBounds();
+}
 
-    return bounds;
+QRectF ViewerWidget::visibleWorldRect() const
+{
+    QVector3D topLeft = screenToWorld(QPoint(0, 0));
+    QVector3D bottomRight = screenToWorld(QPoint(width(), height()));
+    return QRectF(QPointF(topLeft.x(), bottomRight.y()),
+                  QPointF(bottomRight.x(), topLeft.y()));
 }
 
 void ViewerWidget::handlePan(const QPoint& delta)
 {
+    beginInteraction();
     QVector3D worldDelta = QVector3D(delta.x() / m_zoomLevel, -delta.y() / m_zoomLevel, 0.0f);
     setViewCenter(m_viewCenter - worldDelta);
 }
 
 void ViewerWidget::handleZoom(float delta, const QPoint& center)
 {
+    beginInteraction();
     QVector3D worldCenter = screenToWorld(center);
     float newZoom = m_zoomLevel * (1.0f + delta);
     
@@ -406,10 +869,17 @@ void ViewerWidget::handleZoom(float delta, const QPoint& center)
 void ViewerWidget::handleRotation(const QPoint& delta)
 {
     if (m_viewMode == ViewMode::View3D) {
+        beginInteraction();
         m_rotation.setX(m_rotation.x() + delta.y() * 0.5f);
         m_rotation.setY(m_rotation.y() + delta.x() * 0.5f);
-        updateViewMatrix();
-        update();
+        m_viewDirty = true;
+        m_sceneDirty = true;
+        requestFrame();
         emit viewChanged();
     }
 }
+
+void ViewerWidget::beginInteraction()
+{
+    m_interactionTimer.start();
+}
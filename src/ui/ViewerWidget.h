@@ -7,15 +7,34 @@
 #include <QMouseEvent>
 #include <QWheelEvent>
 #include <QKeyEvent>
+#include <QModelIndex>
+#include <QPointer>
+#include <QRectF>
+#include <QSet>
+#include <QTimer>
+#include <memory>
+#include "../core/LayerBounds.h"
+#include "../core/TexturedQuad.h"
+#include "../utils/FrameArena.h"
 
 class Layer;
 class LayerManager;
+class FrameScheduler;
+class QOpenGLFramebufferObject;
+class QOpenGLTimerQuery;
+class ProfilerOverlay;
+struct RenderContext;
 
 /**
  * @brief Main viewer widget for displaying layers
  * 
  * This widget provides 2D/3D visualization capabilities using OpenGL.
  * It supports pan, zoom, and rotation interactions.
+ *
+ * Repaints go through a FrameScheduler, so bursts of view and layer
+ * changes produce one frame per display refresh. In 2D, layers below the
+ * lowest changed layer are kept in an offscreen cache and are not
+ * re-rendered while only layers above them change.
  */
 class ViewerWidget : public QOpenGLWidget, protected QOpenGLFunctions
 {
@@ -78,6 +97,18 @@ public:
      */
     void setViewCenter(const QVector3D& center);
 
+    /**
+     * @brief Get 3D view rotation
+     * @return Rotation in degrees about the x, y and z axes
+     */
+    QVector3D rotation() const { return m_rotation; }
+
+    /**
+     * @brief Set 3D view rotation
+     * @param rotation Rotation in degrees about the x, y and z axes
+     */
+    void setRotation(const QVector3D& rotation);
+
     /**
      * @brief Get layer manager
      * @return Layer manager pointer
@@ -104,6 +135,14 @@ public:
      */
     QPoint worldToScreen(const QVector3D& worldPos) const;
 
+    /**
+     * @brief Find the topmost element under a screen position (2D only)
+     * @param screenPos Screen position
+     * @param elementIndex Receives the element index within the layer
+     * @return Layer owning the element, or nullptr if nothing is hit
+     */
+    Layer* pickAt(const QPoint& screenPos, int* elementIndex = nullptr) const;
+
 public slots:
     /**
      * @brief Reset view to fit all layers
@@ -135,6 +174,16 @@ public slots:
      */
     void updateDisplay();
 
+    /**
+     * @brief Show or hide the frame profiler overlay
+     *
+     * Showing the overlay enables the profiler; hiding it disables the
+     * profiler again unless a trace capture is running.
+     *
+     * @param visible true to show the overlay
+     */
+    void setProfilerOverlayVisible(bool visible);
+
 signals:
     /**
      * @brief Emitted when view changes
@@ -154,12 +203,25 @@ signals:
      */
     void mousePositionChanged(const QVector3D& worldPos, const QPoint& screenPos);
 
+    /**
+     * @brief Emitted when the element under the mouse changes
+     * @param layer Layer owning the element, or nullptr
+     * @param elementIndex Element index within the layer, or -1
+     */
+    void hoveredElementChanged(Layer* layer, int elementIndex);
+
     /**
      * @brief Emitted when view mode changes
      * @param mode New view mode
      */
     void viewModeChanged(ViewMode mode);
 
+    /**
+     * @brief Emitted when the profiler overlay is shown or hidden
+     * @param visible true if the overlay is visible
+     */
+    void profilerOverlayVisibilityChanged(bool visible);
+
 protected:
     // QOpenGLWidget interface
     void initializeGL() override;
@@ -175,10 +237,35 @@ protected:
 
 private slots:
     /**
-     * @brief Handle layer changes
+     * @brief Handle layers being added, removed or moved
      */
     void onLayerChanged();
 
+    /**
+     * @brief Mark changed layers dirty
+     * @param topLeft First changed index
+     * @param bottomRight Last changed index
+     */
+    void onLayerDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
+
+    /**
+     * @brief Emit the latest mouse position and hovered element, at most once per frame
+     */
+    void emitMousePosition();
+
+    /**
+     * @brief Release GPU resources of layers about to be removed
+     * @param parent Parent index
+     * @param first First removed row
+     * @param last Last removed row
+     */
+    void onLayersAboutToBeRemoved(const QModelIndex& parent, int first, int last);
+
+    /**
+     * @brief Release GPU resources before the GL context goes away
+     */
+    void cleanupGL();
+
 private:
     /**
      * @brief Setup OpenGL state
@@ -195,11 +282,54 @@ private:
      */
     void updateViewMatrix();
 
+    /**
+     * @brief Check if the context supports instanced drawing
+     * @return true if instanced arrays are available
+     */
+    bool supportsInstancing() const;
+
+    /**
+     * @brief Schedule a repaint
+     */
+    void requestFrame();
+
+    /**
+     * @brief Mark matrices and the whole scene for recomputation
+     */
+    void invalidateView();
+
     /**
      * @brief Render all layers
      */
     void renderLayers();
 
+    /**
+     * @brief Render a range of layers
+     * @param context Render context
+     * @param first First layer index
+     * @param last One past the last layer index
+     */
+    void renderLayerRange(RenderContext& context, int first, int last);
+
+    /**
+     * @brief Render the bottom layers into the layer cache
+     * @param context Render context
+     * @param count Number of layers to cache
+     * @return true if the cache is valid
+     */
+    bool updateLayerCache(RenderContext& context, int count);
+
+    /**
+     * @brief Draw the layer cache into the current framebuffer
+     * @param context Render context
+     */
+    void drawLayerCache(RenderContext& context);
+
+    /**
+     * @brief Free the layer cache
+     */
+    void releaseLayerCache();
+
     /**
      * @brief Render background
      */
@@ -212,9 +342,15 @@ private:
 
     /**
      * @brief Calculate view bounds
-     * @return View bounds [xmin, ymin, xmax, ymax]
+     * @return Bounds of all visible layers
      */
-    QVector<float> calculateViewBounds() const;
+    LayerBounds calculateViewBounds() const;
+
+    /**
+     * @brief Get visible area in world coordinates
+     * @return Visible rectangle
+     */
+    QRectF visibleWorldRect() const;
 
     /**
      * @brief Handle pan gesture
@@ -235,6 +371,26 @@ private:
      */
     void handleRotation(const QPoint& delta);
 
+    /**
+     * @brief Note that the user is moving the view
+     */
+    void beginInteraction();
+
+    /**
+     * @brief Collect finished GPU timer queries and start one for this frame
+     */
+    void beginGpuTimer();
+
+    /**
+     * @brief End the GPU timer query of this frame
+     */
+    void endGpuTimer();
+
+    /**
+     * @brief Delete GPU timer queries (context current)
+     */
+    void releaseGpuTimers();
+
 private:
     // View state
     ViewMode m_viewMode;
@@ -254,7 +410,7 @@ private:
     Qt::MouseButton m_activeButton;
     
     // Layer management
-    LayerManager* m_layerManager;
+    QPointer<LayerManager> m_layerManager;
     
     // Rendering settings
     QColor m_backgroundColor;
@@ -263,4 +419,42 @@ private:
     
     // OpenGL state
     bool m_glInitialized;
+
+    // Frame scheduling
+    FrameScheduler* m_frameScheduler;
+    bool m_projectionDirty;
+    bool m_viewDirty;
+    bool m_sceneDirty;
+    QSet<Layer*> m_dirtyLayers;
+
+    // Scratch memory for layers, released at the end of each paintGL()
+    FrameArena m_frameArena;
+
+    // Cache of the bottom layers that did not change (2D only)
+    std::unique_ptr<QOpenGLFramebufferObject> m_layerCache;
+    TexturedQuad m_cacheQuad;
+    int m_cachedLayerCount;
+    bool m_layerCacheValid;
+
+    // Running while the user moves the view; expensive layers draw at
+    // reduced quality until it fires and the frame is refined
+    QTimer m_interactionTimer;
+
+    // Mouse position reporting, throttled to the frame rate
+    QTimer m_mouseThrottle;
+    QPoint m_pendingMousePos;
+    bool m_mousePositionPending;
+
+    // Element under the mouse
+    QPointer<Layer> m_hoveredLayer;
+    int m_hoveredElement;
+
+    // Profiling; GPU results are read a few frames late so the CPU never waits
+    static constexpr int kGpuTimerCount = 3;
+    ProfilerOverlay* m_profilerOverlay;
+    QOpenGLTimerQuery* m_gpuTimers[kGpuTimerCount];
+    bool m_gpuTimerPending[kGpuTimerCount];
+    int m_gpuTimerIndex;
+    bool m_gpuTimerRunning;
+    bool m_gpuTimingUnsupported;
 };
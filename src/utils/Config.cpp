@@ -1,16 +1,45 @@
 #include "Config.h"
+#include "Profiler.h"
 #include <QStandardPaths>
 #include <QDir>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QFile>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSettings>
+#include <QThread>
 #include <QDebug>
+#include <algorithm>
+
+/**
+ * @brief Writes a configuration snapshot on the save thread
+ */
+class ConfigSaveTask : public QRunnable
+{
+public:
+    ConfigSaveTask(Config* config, const QString& filePath,
+                   std::shared_ptr<const Config::ValueTable> values, quint64 generation)
+        : m_config(config), m_filePath(filePath), m_values(std::move(values)), m_generation(generation) {}
+
+    void run() override { m_config->writeSnapshot(m_filePath, m_values, m_generation); }
+
+private:
+    Config* m_config;
+    QString m_filePath;
+    std::shared_ptr<const Config::ValueTable> m_values;
+    quint64 m_generation;
+};
 
 Config::Config(const QString& configDir, QObject* parent)
     : QObject(parent)
+    , m_values(std::make_shared<ValueTable>())
+    , m_snapshot(m_values)
     , m_loaded(false)
-    , m_modified(false)
+    , m_generation(0)
+    , m_savedGeneration(0)
+    , m_latestSaveRequest(0)
 {
     if (configDir.isEmpty()) {
         m_configDir = QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation);
@@ -19,25 +48,27 @@ Config::Config(const QString& configDir, QObject* parent)
     }
     
     m_configFilePath = QDir(m_configDir).filePath("config.json");
-    
-    // Initialize QSettings
-    m_settings = std::make_unique<QSettings>(
-        QDir(m_configDir).filePath("settings.ini"),
-        QSettings::IniFormat
-    );
+
+    // Debounce saves so a burst of changes is written once
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(kSaveDelayMs);
+    connect(&m_saveTimer, &QTimer::timeout, this, &Config::saveAsync);
+    m_savePool.setMaxThreadCount(1);
     
     initializeDefaults();
 }
 
 Config::~Config()
 {
-    if (m_modified) {
+    if (m_loaded && isModified()) {
         save();
     }
+    m_savePool.waitForDone();
 }
 
 bool Config::load()
 {
+    PROFILE_SCOPE("Config::load");
     if (m_loaded) {
         return true;
     }
@@ -47,137 +78,304 @@ bool Config::load()
         return false;
     }
     
+    return applyLoaded(readFile(m_configFilePath));
+}
+
+QJsonObject Config::readFile(const QString& filePath)
+{
     // Load from JSON file if it exists
-    QFile file(m_configFilePath);
-    if (file.exists() && file.open(QIODevice::ReadOnly)) {
-        QByteArray data = file.readAll();
-        QJsonParseError error;
-        QJsonDocument doc = QJsonDocument::fromJson(data, &error);
-        
-        if (error.error == QJsonParseError::NoError && doc.isObject()) {
-            fromJson(doc.object());
-        } else {
-            qWarning() << "Failed to parse config file:" << error.errorString();
-        }
+    QFile file(filePath);
+    if (!file.exists() || !file.open(QIODevice::ReadOnly)) {
+        return QJsonObject();
+    }
+
+    QByteArray data = file.readAll();
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(data, &error);
+    
+    if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+        qWarning() << "Failed to parse config file:" << error.errorString();
+        return QJsonObject();
+    }
+    return doc.object();
+}
+
+bool Config::applyLoaded(const QJsonObject& json)
+{
+    if (m_loaded) {
+        return true;
+    }
+
+    if (!json.isEmpty()) {
+        fromJson(json);
+    }
+
+    // Values that came from the file are not unsaved changes
+    {
+        QMutexLocker locker(&m_writeMutex);
+        m_savedGeneration.store(m_generation, std::memory_order_release);
     }
     
     // Migrate old configuration if needed
     migrateConfiguration();
     
     m_loaded = true;
+    if (isModified()) {
+        m_saveTimer.start();
+    }
     emit configurationLoaded();
     return true;
 }
 
 bool Config::save()
 {
-    if (!createConfigDirectory()) {
+    m_saveTimer.stop();
+    if (isModified()) {
+        saveAsync();
+    }
+    m_savePool.waitForDone();
+
+    // The queued completion may never run at shutdown, so retire the old
+    // settings file here
+    const bool saved = !isModified();
+    if (saved && !m_legacySettingsPath.isEmpty()) {
+        QFile::remove(m_legacySettingsPath);
+        m_legacySettingsPath.clear();
+    }
+    return saved;
+}
+
+void Config::saveAsync()
+{
+    m_saveTimer.stop();
+
+    std::shared_ptr<const ValueTable> snapshot;
+    quint64 generation = 0;
+    {
+        QMutexLocker locker(&m_writeMutex);
+        if (m_generation == m_savedGeneration.load(std::memory_order_acquire)) {
+            return;
+        }
+        snapshot = m_values;
+        generation = m_generation;
+    }
+
+    m_latestSaveRequest.store(generation, std::memory_order_release);
+    m_savePool.start(new ConfigSaveTask(this, m_configFilePath, std::move(snapshot), generation));
+}
+
+bool Config::isModified() const
+{
+    QMutexLocker locker(&m_writeMutex);
+    return m_generation != m_savedGeneration.load(std::memory_order_acquire);
+}
+
+bool Config::writeSnapshot(const QString& filePath, const std::shared_ptr<const ValueTable>& values,
+                           quint64 generation)
+{
+    // A newer snapshot is queued behind this one
+    if (generation < m_latestSaveRequest.load(std::memory_order_acquire)) {
         return false;
     }
-    
-    // Save to JSON file
-    QJsonObject config = toJson();
-    QJsonDocument doc(config);
-    
-    QFile file(m_configFilePath);
-    if (!file.open(QIODevice::WriteOnly)) {
-        qWarning() << "Failed to open config file for writing:" << m_configFilePath;
+
+    const QFileInfo fileInfo(filePath);
+    QDir dir = fileInfo.dir();
+    if (!dir.exists() && !dir.mkpath(".")) {
+        qWarning() << "Failed to create config directory:" << dir.path();
+        QMetaObject::invokeMethod(this, [this]() { onSaveFinished(false); }, Qt::QueuedConnection);
         return false;
     }
-    
-    file.write(doc.toJson());
-    file.close();
-    
-    // Sync QSettings
-    m_settings->sync();
-    
-    m_modified = false;
+
+    // QSaveFile writes a temporary file and renames it over the old one,
+    // so a crash mid-write never leaves a truncated configuration
+    QSaveFile file(filePath);
+    bool success = file.open(QIODevice::WriteOnly);
+    if (success) {
+        file.write(QJsonDocument(tableToJson(*values)).toJson());
+        success = file.commit();
+    }
+    if (!success) {
+        qWarning() << "Failed to write config file:" << filePath << file.errorString();
+    } else {
+        m_savedGeneration.store(generation, std::memory_order_release);
+    }
+
+    QMetaObject::invokeMethod(this, [this, success]() { onSaveFinished(success); }, Qt::QueuedConnection);
+    return success;
+}
+
+void Config::onSaveFinished(bool success)
+{
+    if (!success) {
+        return;
+    }
+
+    // Everything from the old settings file is in the JSON file now
+    if (!m_legacySettingsPath.isEmpty()) {
+        QFile::remove(m_legacySettingsPath);
+        m_legacySettingsPath.clear();
+    }
     emit configurationSaved();
-    return true;
+}
+
+std::shared_ptr<const Config::ValueTable> Config::values() const
+{
+    return m_snapshot.load();
+}
+
+void Config::publishLocked(std::shared_ptr<const ValueTable> values)
+{
+    m_values = std::move(values);
+    m_snapshot.store(m_values);
+    ++m_generation;
+}
+
+void Config::markModified()
+{
+    if (!m_loaded) {
+        // Saving defaults before the file is read would overwrite it
+        return;
+    }
+
+    if (QThread::currentThread() == thread()) {
+        m_saveTimer.start();
+    } else {
+        QMetaObject::invokeMethod(&m_saveTimer, "start", Qt::QueuedConnection);
+    }
 }
 
 QVariant Config::value(const QString& key, const QVariant& defaultValue) const
 {
-    QString fullKeyPath = fullKey(key);
-    return m_settings->value(fullKeyPath, defaultValue);
+    return value(Key(fullKey(key)), defaultValue);
+}
+
+QVariant Config::value(const Key& key, const QVariant& defaultValue) const
+{
+    const std::shared_ptr<const ValueTable> table = values();
+    auto it = table->constFind(key);
+    return it != table->constEnd() ? it.value() : defaultValue;
 }
 
 void Config::setValue(const QString& key, const QVariant& value)
 {
-    QString fullKeyPath = fullKey(key);
-    QVariant oldValue = m_settings->value(fullKeyPath);
-    
-    if (oldValue != value) {
-        m_settings->setValue(fullKeyPath, value);
-        m_modified = true;
-        emit configurationChanged(key, value);
+    const Key fullKeyPath(fullKey(key));
+    {
+        QMutexLocker locker(&m_writeMutex);
+        auto it = m_values->constFind(fullKeyPath);
+        if (it != m_values->constEnd() && it.value() == value) {
+            return;
+        }
+
+        auto table = std::make_shared<ValueTable>(*m_values);
+        table->insert(fullKeyPath, value);
+        publishLocked(std::move(table));
     }
+
+    markModified();
+    emit configurationChanged(key, value);
 }
 
 bool Config::contains(const QString& key) const
 {
-    QString fullKeyPath = fullKey(key);
-    return m_settings->contains(fullKeyPath);
+    return values()->contains(Key(fullKey(key)));
 }
 
 void Config::remove(const QString& key)
 {
-    QString fullKeyPath = fullKey(key);
-    if (m_settings->contains(fullKeyPath)) {
-        m_settings->remove(fullKeyPath);
-        m_modified = true;
-        emit configurationChanged(key, QVariant());
+    // Like QSettings, removing a key also removes the keys below it
+    const QString fullKeyPath = fullKey(key);
+    const QString prefix = fullKeyPath + "/";
+    {
+        QMutexLocker locker(&m_writeMutex);
+        auto table = std::make_shared<ValueTable>(*m_values);
+        bool removed = table->remove(Key(fullKeyPath)) > 0;
+        for (auto it = table->begin(); it != table->end();) {
+            if (it.key().path().startsWith(prefix)) {
+                it = table->erase(it);
+                removed = true;
+            } else {
+                ++it;
+            }
+        }
+        if (!removed) {
+            return;
+        }
+        publishLocked(std::move(table));
     }
+
+    markModified();
+    emit configurationChanged(key, QVariant());
 }
 
 QStringList Config::allKeys() const
 {
-    return m_settings->allKeys();
+    const std::shared_ptr<const ValueTable> table = values();
+    QStringList keys;
+    keys.reserve(table->size());
+    for (auto it = table->constBegin(); it != table->constEnd(); ++it) {
+        keys.append(it.key().path());
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
 }
 
 void Config::clear()
 {
-    m_settings->clear();
-    m_modified = true;
+    {
+        QMutexLocker locker(&m_writeMutex);
+        publishLocked(std::make_shared<ValueTable>());
+    }
+    markModified();
 }
 
 QJsonObject Config::group(const QString& group) const
 {
+    const std::shared_ptr<const ValueTable> table = values();
+    const QString prefix = group + "/";
     QJsonObject result;
-    m_settings->beginGroup(group);
-    QStringList keys = m_settings->allKeys();
-    for (const QString& key : keys) {
-        QVariant value = m_settings->value(key);
-        result[key] = QJsonValue::fromVariant(value);
+    for (auto it = table->constBegin(); it != table->constEnd(); ++it) {
+        if (it.key().path().startsWith(prefix)) {
+            result[it.key().path().mid(prefix.size())] = QJsonValue::fromVariant(it.value());
+        }
     }
-    m_settings->endGroup();
     return result;
 }
 
 void Config::setGroup(const QString& group, const QJsonObject& values)
 {
-    m_settings->beginGroup(group);
-    m_settings->remove(""); // Clear existing values in group
-    
-    for (auto it = values.begin(); it != values.end(); ++it) {
-        m_settings->setValue(it.key(), it.value().toVariant());
+    const QString prefix = group + "/";
+    {
+        QMutexLocker locker(&m_writeMutex);
+        auto table = std::make_shared<ValueTable>(*m_values);
+
+        // Clear existing values in group
+        for (auto it = table->begin(); it != table->end();) {
+            if (it.key().path().startsWith(prefix)) {
+                it = table->erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        for (auto it = values.begin(); it != values.end(); ++it) {
+            table->insert(Key(prefix + it.key()), it.value().toVariant());
+        }
+        publishLocked(std::move(table));
     }
-    
-    m_settings->endGroup();
-    m_modified = true;
+    markModified();
 }
 
 void Config::beginGroup(const QString& group)
 {
     m_groupStack.append(group);
-    m_settings->beginGroup(group);
+    m_groupPrefix = m_groupStack.join("/") + "/";
 }
 
 void Config::endGroup()
 {
     if (!m_groupStack.isEmpty()) {
         m_groupStack.removeLast();
-        m_settings->endGroup();
+        m_groupPrefix = m_groupStack.isEmpty() ? QString() : m_groupStack.join("/") + "/";
     }
 }
 
@@ -217,31 +415,35 @@ bool Config::exportToJson(const QString& filePath) const
     QJsonObject config = toJson();
     QJsonDocument doc(config);
     
-    QFile file(filePath);
+    QSaveFile file(filePath);
     if (!file.open(QIODevice::WriteOnly)) {
         return false;
     }
     
     file.write(doc.toJson());
-    return true;
+    return file.commit();
 }
 
 QJsonObject Config::toJson() const
 {
-    QJsonObject result;
-    QStringList keys = m_settings->allKeys();
+    return tableToJson(*values());
+}
 
-    for (const QString& key : keys) {
-        QVariant value = m_settings->value(key);
-        result[key] = QJsonValue::fromVariant(value);
+QJsonObject Config::tableToJson(const ValueTable& values)
+{
+    QJsonObject result;
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        result[it.key().path()] = QJsonValue::fromVariant(it.value());
     }
-
     return result;
 }
 
 void Config::fromJson(const QJsonObject& json)
 {
-    // Flatten JSON object to QSettings keys
+    QMutexLocker locker(&m_writeMutex);
+    auto table = std::make_shared<ValueTable>(*m_values);
+
+    // Flatten JSON object to key paths
     std::function<void(const QJsonObject&, const QString&)> flatten;
     flatten = [&](const QJsonObject& obj, const QString& prefix) {
         for (auto it = obj.begin(); it != obj.end(); ++it) {
@@ -250,13 +452,15 @@ void Config::fromJson(const QJsonObject& json)
             if (it.value().isObject()) {
                 flatten(it.value().toObject(), key);
             } else {
-                m_settings->setValue(key, it.value().toVariant());
+                table->insert(Key(key), it.value().toVariant());
             }
         }
     };
     
     flatten(json, QString());
-    m_modified = true;
+    publishLocked(std::move(table));
+    locker.unlock();
+    markModified();
 }
 
 void Config::resetToDefaults()
@@ -292,7 +496,16 @@ QJsonObject Config::defaultConfiguration()
     viewer["zoomStep"] = 0.1;
     viewer["panSensitivity"] = 1.0;
     viewer["rotationSensitivity"] = 1.0;
+    viewer["tileCacheMemoryMB"] = 512;
+    viewer["tileTextureMemoryMB"] = 256;
+    viewer["frameCacheMemoryMB"] = 1024;
     defaults["viewer"] = viewer;
+
+    // Undo history settings
+    QJsonObject history;
+    history["memoryLimitMB"] = 256;
+    history["diskLimitMB"] = 4096;
+    defaults["history"] = history;
     
     // Plugin settings
     QJsonObject plugins;
@@ -305,7 +518,7 @@ QJsonObject Config::defaultConfiguration()
 
 void Config::onSettingsChanged(const QString& key)
 {
-    emit configurationChanged(key, m_settings->value(key));
+    emit configurationChanged(key, value(Key(key)));
 }
 
 void Config::initializeDefaults()
@@ -331,14 +544,34 @@ bool Config::validateConfiguration() const
 
 bool Config::migrateConfiguration()
 {
-    // TODO: Implement configuration migration for version updates
+    // Earlier versions kept values in a QSettings file next to the JSON
+    // file; import keys the JSON file does not have. The old file is
+    // removed once a save has written them.
+    const QString legacyPath = QDir(m_configDir).filePath("settings.ini");
+    if (!QFile::exists(legacyPath)) {
+        return true;
+    }
+
+    QSettings legacy(legacyPath, QSettings::IniFormat);
+    const QStringList keys = legacy.allKeys();
+    {
+        QMutexLocker locker(&m_writeMutex);
+        auto table = std::make_shared<ValueTable>(*m_values);
+        for (const QString& key : keys) {
+            if (!table->contains(Key(key))) {
+                table->insert(Key(key), legacy.value(key));
+            }
+        }
+        publishLocked(std::move(table));
+    }
+    m_legacySettingsPath = legacyPath;
     return true;
 }
 
 QString Config::fullKey(const QString& key) const
 {
-    if (m_groupStack.isEmpty()) {
+    if (m_groupPrefix.isEmpty()) {
         return key;
     }
-    return m_groupStack.join("/") + "/" + key;
+    return m_groupPrefix + key;
 }
@@ -1,25 +1,75 @@
 #pragma once
 
 #include <QObject>
-#include <QSettings>
+#include <QHash>
+#include <QMutex>
+#include <QThreadPool>
+#include <QTimer>
 #include <QVariant>
 #include <QJsonObject>
 #include <QJsonDocument>
 #include <QString>
 #include <QStringList>
+#include <atomic>
 #include <memory>
+#include "SnapshotPtr.h"
 
 /**
  * @brief Configuration manager class
  * 
- * Manages application settings and configuration with support for
- * both QSettings and JSON configuration files.
+ * Manages application settings and configuration, persisted as a JSON
+ * configuration file.
+ *
+ * Values live in a flat in-memory table keyed by full key path. The
+ * table is an immutable snapshot replaced on every change; readers fetch
+ * it through a SnapshotPtr, so value(const Key&) takes no lock, except
+ * on the first read on a thread after a change, and may be called from
+ * any thread, including render and plugin worker threads. String keys
+ * are resolved against the current group, which is owner-thread state:
+ * on other threads use Key, or string keys only while no group is
+ * active. Changes mark the configuration modified
+ * and schedule a save; saves are debounced, serialized on a background
+ * thread and written atomically (temporary file and rename).
  */
 class Config : public QObject
 {
     Q_OBJECT
 
 public:
+    /**
+     * @brief Precomputed configuration key
+     *
+     * Holds a full key path together with its hash, so hot paths can
+     * look values up without building or hashing a string. Keys are
+     * absolute: the current group is not applied to them.
+     */
+    class Key
+    {
+    public:
+        Key() : m_hash(0) {}
+        explicit Key(const QString& path) : m_path(path), m_hash(::qHash(path)) {}
+
+        /**
+         * @brief Get key path
+         * @return Full key path
+         */
+        const QString& path() const { return m_path; }
+
+        bool operator==(const Key& other) const { return m_hash == other.m_hash && m_path == other.m_path; }
+        bool operator!=(const Key& other) const { return !(*this == other); }
+
+        friend uint qHash(const Key& key, uint seed = 0) { return key.m_hash ^ seed; }
+
+    private:
+        QString m_path;
+        uint m_hash;
+    };
+
+    using ValueTable = QHash<Key, QVariant>;
+
+    // Changes are saved this long after the last modification
+    static constexpr int kSaveDelayMs = 1000;
+
     /**
      * @brief Constructor
      * @param configDir Configuration directory
@@ -39,19 +89,66 @@ public:
     bool load();
 
     /**
-     * @brief Save configuration
+     * @brief Read a configuration file without applying it
+     *
+     * Safe to call from any thread, so the file I/O of load() can run on
+     * a worker; pass the result to applyLoaded() on the owning thread.
+     *
+     * @param filePath Configuration file
+     * @return Parsed configuration, empty if the file is missing or invalid
+     */
+    static QJsonObject readFile(const QString& filePath);
+
+    /**
+     * @brief Finish loading with a configuration read by readFile()
+     * @param json Parsed configuration
+     * @return true if successful
+     */
+    bool applyLoaded(const QJsonObject& json);
+
+    /**
+     * @brief Check if the configuration has been loaded
+     * @return true once load() or applyLoaded() has run
+     */
+    bool isLoaded() const { return m_loaded; }
+
+    /**
+     * @brief Save configuration and wait for it to be written
+     *
+     * Does nothing if there are no unsaved changes. Used at shutdown;
+     * elsewhere prefer saveAsync().
+     *
      * @return true if successful
      */
     bool save();
 
+    /**
+     * @brief Check for unsaved changes
+     * @return true if modified since the last successful save
+     */
+    bool isModified() const;
+
     /**
      * @brief Get configuration value
-     * @param key Configuration key
+     *
+     * Resolving the key reads the current group, so call this on the
+     * owning thread; other threads may only use it while no group is
+     * active, and should prefer value(const Key&).
+     *
+     * @param key Configuration key, relative to the current group
      * @param defaultValue Default value if key doesn't exist
      * @return Configuration value
      */
     QVariant value(const QString& key, const QVariant& defaultValue = QVariant()) const;
 
+    /**
+     * @brief Get configuration value by precomputed key (any thread)
+     * @param key Absolute configuration key
+     * @param defaultValue Default value if key doesn't exist
+     * @return Configuration value
+     */
+    QVariant value(const Key& key, const QVariant& defaultValue = QVariant()) const;
+
     /**
      * @brief Set configuration value
      * @param key Configuration key
@@ -163,6 +260,15 @@ public:
      */
     static QJsonObject defaultConfiguration();
 
+public slots:
+    /**
+     * @brief Save configuration in the background
+     *
+     * The current values are written by a worker thread; the GUI thread
+     * only takes a snapshot. Does nothing if there are no unsaved changes.
+     */
+    void saveAsync();
+
 signals:
     /**
      * @brief Emitted when configuration changes
@@ -219,18 +325,71 @@ private:
      */
     QString fullKey(const QString& key) const;
 
+    /**
+     * @brief Get current value table (any thread)
+     * @return Immutable snapshot
+     */
+    std::shared_ptr<const ValueTable> values() const;
+
+    /**
+     * @brief Replace the value table (m_writeMutex held)
+     * @param values New values
+     */
+    void publishLocked(std::shared_ptr<const ValueTable> values);
+
+    /**
+     * @brief Mark the configuration modified and schedule a save
+     */
+    void markModified();
+
+    /**
+     * @brief Write a snapshot to the configuration file (any thread)
+     * @param filePath Configuration file
+     * @param values Values to write
+     * @param generation Modification count of the snapshot
+     * @return true if written
+     */
+    bool writeSnapshot(const QString& filePath, const std::shared_ptr<const ValueTable>& values,
+                       quint64 generation);
+
+    /**
+     * @brief Finish a save on the owning thread
+     * @param success true if the file was written
+     */
+    void onSaveFinished(bool success);
+
+    /**
+     * @brief Convert a value table to JSON
+     * @param values Values
+     * @return JSON object with one member per key path
+     */
+    static QJsonObject tableToJson(const ValueTable& values);
+
+    friend class ConfigSaveTask;
+
 private:
-    // Configuration storage
-    std::unique_ptr<QSettings> m_settings;
+    // Configuration storage; writers build on m_values under m_writeMutex
+    // and publish each new table to readers through m_snapshot
+    std::shared_ptr<const ValueTable> m_values;
+    SnapshotPtr<ValueTable> m_snapshot;
+    mutable QMutex m_writeMutex;
     QString m_configDir;
     QString m_configFilePath;
     
     // Group management
     QStringList m_groupStack;
+    QString m_groupPrefix;
     
     // State
     bool m_loaded;
-    bool m_modified;
+    quint64 m_generation;
+    std::atomic<quint64> m_savedGeneration;
+    std::atomic<quint64> m_latestSaveRequest;
+
+    // Background saving; one thread keeps writes in order
+    QTimer m_saveTimer;
+    QThreadPool m_savePool;
+    QString m_legacySettingsPath;
     
     // Default values
     QJsonObject m_defaults;
@@ -0,0 +1,85 @@
+#include "FrameArena.h"
+
+#include <cstdlib>
+#include <new>
+
+FrameArena::FrameArena(qint64 blockSize)
+    : m_current(0)
+    , m_offset(0)
+    , m_used(0)
+    , m_capacity(0)
+    , m_blockSize(qMax<qint64>(1024, blockSize))
+{
+}
+
+FrameArena::~FrameArena()
+{
+    freeBlocks();
+}
+
+void* FrameArena::allocate(qint64 bytes, qint64 alignment)
+{
+    bytes = qMax<qint64>(1, bytes);
+    alignment = qMax<qint64>(1, alignment);
+
+    while (true) {
+        if (m_current < m_blocks.size()) {
+            const Block& block = m_blocks[m_current];
+            const quintptr address = quintptr(block.data) + quintptr(m_offset);
+            const qint64 padding = qint64((quintptr(alignment) - address % quintptr(alignment)) % quintptr(alignment));
+            if (m_offset + padding + bytes <= block.size) {
+                void* result = block.data + m_offset + padding;
+                m_offset += padding + bytes;
+                m_used += padding + bytes;
+                return result;
+            }
+
+            // Leave the rest of this block unused for the frame
+            ++m_current;
+            m_offset = 0;
+            continue;
+        }
+
+        addBlock(bytes + alignment);
+    }
+}
+
+void FrameArena::reset()
+{
+    if (m_blocks.size() > 1) {
+        // One block that fits the whole frame, so the next one stays in it
+        const qint64 total = m_capacity;
+        freeBlocks();
+        m_blockSize = qMax(m_blockSize, total);
+        addBlock(total);
+    }
+
+    m_current = 0;
+    m_offset = 0;
+    m_used = 0;
+}
+
+void FrameArena::addBlock(qint64 minimumSize)
+{
+    const qint64 size = qMax(m_blockSize, minimumSize);
+    uchar* data = static_cast<uchar*>(std::malloc(size_t(size)));
+    if (!data) {
+        throw std::bad_alloc();
+    }
+
+    // Later blocks double so a frame needs few of them
+    m_blocks.push_back(Block{data, size});
+    m_capacity += size;
+    m_blockSize = qMax(m_blockSize, size * 2);
+}
+
+void FrameArena::freeBlocks()
+{
+    for (const Block& block : m_blocks) {
+        std::free(block.data);
+    }
+    m_blocks.clear();
+    m_current = 0;
+    m_offset = 0;
+    m_capacity = 0;
+}
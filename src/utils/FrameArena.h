@@ -0,0 +1,199 @@
+#pragma once
+
+#include <QtGlobal>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Linear allocator for data that lives for one frame
+ *
+ * allocate() bumps a pointer inside a block; nothing is freed
+ * individually. reset() releases everything at once at the end of the
+ * frame. When a frame needed more than one block, reset() replaces them
+ * with a single block of the combined size, so after a few frames the
+ * arena holds one block large enough for the busiest frame and steady
+ * state rendering does not touch the heap.
+ *
+ * Only trivially destructible types may live in the arena, since no
+ * destructors run on reset(). Not thread-safe.
+ */
+class FrameArena
+{
+public:
+    /**
+     * @brief Constructor
+     *
+     * No memory is reserved until the first allocation.
+     *
+     * @param blockSize Size of the first block in bytes
+     */
+    explicit FrameArena(qint64 blockSize = 64 * 1024);
+
+    /**
+     * @brief Destructor
+     */
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    /**
+     * @brief Allocate uninitialized memory valid until the next reset()
+     * @param bytes Size in bytes
+     * @param alignment Alignment, a power of two
+     * @return Memory, never nullptr
+     */
+    void* allocate(qint64 bytes, qint64 alignment = alignof(std::max_align_t));
+
+    /**
+     * @brief Allocate an uninitialized array valid until the next reset()
+     * @param count Number of elements
+     * @return First element
+     */
+    template<typename T>
+    T* allocate(qint64 count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "FrameArena does not run destructors");
+        return static_cast<T*>(allocate(count * qint64(sizeof(T)), qint64(alignof(T))));
+    }
+
+    /**
+     * @brief Release all allocations
+     */
+    void reset();
+
+    /**
+     * @brief Get bytes allocated since the last reset()
+     * @return Size in bytes, including alignment padding
+     */
+    qint64 bytesUsed() const { return m_used; }
+
+    /**
+     * @brief Get memory held by the arena
+     * @return Size of all blocks in bytes
+     */
+    qint64 capacity() const { return m_capacity; }
+
+private:
+    /**
+     * @brief Memory block
+     */
+    struct Block
+    {
+        uchar* data;
+        qint64 size;
+    };
+
+    /**
+     * @brief Append a block
+     * @param minimumSize Bytes the block must hold
+     */
+    void addBlock(qint64 minimumSize);
+
+    /**
+     * @brief Free all blocks
+     */
+    void freeBlocks();
+
+private:
+    std::vector<Block> m_blocks;
+    size_t m_current;
+    qint64 m_offset;
+    qint64 m_used;
+    qint64 m_capacity;
+    qint64 m_blockSize;
+};
+
+/**
+ * @brief Growable array of trivially copyable values in a FrameArena
+ *
+ * A stand-in for QVector in per-frame code. Growing copies the values
+ * to a larger arena allocation; the old storage is reclaimed with the
+ * rest of the frame on FrameArena::reset(). The array must not be used
+ * after that.
+ */
+template<typename T>
+class ArenaArray
+{
+    static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value,
+                  "ArenaArray holds plain values only");
+
+public:
+    /**
+     * @brief Constructor
+     * @param arena Arena holding the values
+     * @param reserve Initial capacity
+     */
+    explicit ArenaArray(FrameArena* arena, qint64 reserve = 0)
+        : m_arena(arena)
+        , m_data(nullptr)
+        , m_size(0)
+        , m_capacity(0)
+    {
+        if (reserve > 0) {
+            grow(reserve);
+        }
+    }
+
+    /**
+     * @brief Append a value
+     * @param value Value
+     */
+    void append(const T& value)
+    {
+        if (m_size == m_capacity) {
+            grow(qMax<qint64>(16, m_capacity * 2));
+        }
+        m_data[m_size++] = value;
+    }
+
+    /**
+     * @brief Remove all values, keeping the capacity
+     */
+    void clear() { m_size = 0; }
+
+    /**
+     * @brief Get number of values
+     * @return Size
+     */
+    qint64 size() const { return m_size; }
+
+    /**
+     * @brief Check if the array is empty
+     * @return true if empty
+     */
+    bool isEmpty() const { return m_size == 0; }
+
+    T* data() { return m_data; }
+    const T* data() const { return m_data; }
+    T* begin() { return m_data; }
+    T* end() { return m_data + m_size; }
+    const T* begin() const { return m_data; }
+    const T* end() const { return m_data + m_size; }
+    T& operator[](qint64 index) { return m_data[index]; }
+    const T& operator[](qint64 index) const { return m_data[index]; }
+
+private:
+    /**
+     * @brief Move the values to a larger allocation
+     * @param capacity New capacity
+     */
+    void grow(qint64 capacity)
+    {
+        T* data = m_arena->allocate<T>(capacity);
+        if (m_size > 0) {
+            std::memcpy(static_cast<void*>(data), m_data, size_t(m_size) * sizeof(T));
+        }
+        m_data = data;
+        m_capacity = capacity;
+    }
+
+private:
+    FrameArena* m_arena;
+    T* m_data;
+    qint64 m_size;
+    qint64 m_capacity;
+};
@@ -0,0 +1,775 @@
+#include "ImageKernels.h"
+
+#include <QtMath>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TGUI_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define TGUI_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+// x86 kernels are compiled for their own instruction set so the rest of
+// the build keeps the baseline target; they only run after detection
+#if defined(TGUI_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TGUI_TARGET(isa) __attribute__((target(isa)))
+#else
+#define TGUI_TARGET(isa)
+#endif
+
+namespace ImageKernels {
+
+namespace {
+
+const float kInfinity = std::numeric_limits<float>::infinity();
+
+/**
+ * @brief Kernel entry points of one implementation
+ *
+ * Callers guarantee count > 0.
+ */
+struct Kernels
+{
+    void (*minMaxU8)(const quint8* data, qint64 count, quint8* low, quint8* high);
+    void (*minMaxU16)(const quint16* data, qint64 count, quint16* low, quint16* high);
+    void (*minMaxF32)(const float* data, qint64 count, float* low, float* high);
+    void (*tableU8)(const quint8* data, qint64 count, const quint32* table, quint32* out);
+    void (*tableU16)(const quint16* data, qint64 count, const quint32* table, quint32* out);
+    void (*tableF32)(const float* data, qint64 count, float low, float scale, float lastIndex,
+                     const quint32* table, quint32* out);
+};
+
+// Scalar reference implementation, also used for the tails of the vector loops
+
+template<typename T>
+void minMaxScalar(const T* data, qint64 count, T* low, T* high)
+{
+    T lo = *low;
+    T hi = *high;
+    for (qint64 i = 0; i < count; ++i) {
+        lo = qMin(lo, data[i]);
+        hi = qMax(hi, data[i]);
+    }
+    *low = lo;
+    *high = hi;
+}
+
+void minMaxU8Scalar(const quint8* data, qint64 count, quint8* low, quint8* high)
+{
+    *low = 255;
+    *high = 0;
+    minMaxScalar(data, count, low, high);
+}
+
+void minMaxU16Scalar(const quint16* data, qint64 count, quint16* low, quint16* high)
+{
+    *low = 65535;
+    *high = 0;
+    minMaxScalar(data, count, low, high);
+}
+
+void minMaxF32Tail(const float* data, qint64 count, float* low, float* high)
+{
+    for (qint64 i = 0; i < count; ++i) {
+        if (qIsFinite(data[i])) {
+            *low = qMin(*low, data[i]);
+            *high = qMax(*high, data[i]);
+        }
+    }
+}
+
+void minMaxF32Scalar(const float* data, qint64 count, float* low, float* high)
+{
+    *low = kInfinity;
+    *high = -kInfinity;
+    minMaxF32Tail(data, count, low, high);
+}
+
+template<typename T>
+void tableScalar(const T* data, qint64 count, const quint32* table, quint32* out)
+{
+    qint64 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        out[i] = table[data[i]];
+        out[i + 1] = table[data[i + 1]];
+        out[i + 2] = table[data[i + 2]];
+        out[i + 3] = table[data[i + 3]];
+    }
+    for (; i < count; ++i) {
+        out[i] = table[data[i]];
+    }
+}
+
+void tableU8Scalar(const quint8* data, qint64 count, const quint32* table, quint32* out)
+{
+    tableScalar(data, count, table, out);
+}
+
+void tableU16Scalar(const quint16* data, qint64 count, const quint32* table, quint32* out)
+{
+    tableScalar(data, count, table, out);
+}
+
+inline int floatIndex(float value, float low, float scale, float lastIndex)
+{
+    // NaN fails the comparison and selects entry 0
+    const float x = (value - low) * scale + 0.5f;
+    return x > 0.0f ? int(qMin(x, lastIndex)) : 0;
+}
+
+void tableF32Scalar(const float* data, qint64 count, float low, float scale, float lastIndex,
+                    const quint32* table, quint32* out)
+{
+    for (qint64 i = 0; i < count; ++i) {
+        out[i] = table[floatIndex(data[i], low, scale, lastIndex)];
+    }
+}
+
+const Kernels kScalarKernels = {
+    minMaxU8Scalar, minMaxU16Scalar, minMaxF32Scalar,
+    tableU8Scalar, tableU16Scalar, tableF32Scalar
+};
+
+#if defined(TGUI_KERNELS_X86)
+
+TGUI_TARGET("sse4.1")
+void minMaxU8Sse41(const quint8* data, qint64 count, quint8* low, quint8* high)
+{
+    __m128i lo = _mm_set1_epi8(char(0xff));
+    __m128i hi = _mm_setzero_si128();
+    qint64 i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        lo = _mm_min_epu8(lo, v);
+        hi = _mm_max_epu8(hi, v);
+    }
+
+    alignas(16) quint8 los[16];
+    alignas(16) quint8 his[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(los), lo);
+    _mm_store_si128(reinterpret_cast<__m128i*>(his), hi);
+    *low = *std::min_element(los, los + 16);
+    *high = *std::max_element(his, his + 16);
+    minMaxScalar(data + i, count - i, low, high);
+}
+
+TGUI_TARGET("sse4.1")
+void minMaxU16Sse41(const quint16* data, qint64 count, quint16* low, quint16* high)
+{
+    __m128i lo = _mm_set1_epi16(-1);
+    __m128i hi = _mm_setzero_si128();
+    qint64 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        lo = _mm_min_epu16(lo, v);
+        hi = _mm_max_epu16(hi, v);
+    }
+
+    alignas(16) quint16 los[8];
+    alignas(16) quint16 his[8];
+    _mm_store_si128(reinterpret_cast<__m128i*>(los), lo);
+    _mm_store_si128(reinterpret_cast<__m128i*>(his), hi);
+    *low = *std::min_element(los, los + 8);
+    *high = *std::max_element(his, his + 8);
+    minMaxScalar(data + i, count - i, low, high);
+}
+
+TGUI_TARGET("sse4.1")
+void minMaxF32Sse41(const float* data, qint64 count, float* low, float* high)
+{
+    // Non-finite lanes are replaced by the neutral element: x - x is only
+    // zero for finite x
+    const __m128 plusInf = _mm_set1_ps(kInfinity);
+    const __m128 minusInf = _mm_set1_ps(-kInfinity);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 lo = plusInf;
+    __m128 hi = minusInf;
+    qint64 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 v = _mm_loadu_ps(data + i);
+        const __m128 finite = _mm_cmpeq_ps(_mm_sub_ps(v, v), zero);
+        lo = _mm_min_ps(lo, _mm_blendv_ps(plusInf, v, finite));
+        hi = _mm_max_ps(hi, _mm_blendv_ps(minusInf, v, finite));
+    }
+
+    alignas(16) float los[4];
+    alignas(16) float his[4];
+    _mm_store_ps(los, lo);
+    _mm_store_ps(his, hi);
+    *low = qMin(qMin(los[0], los[1]), qMin(los[2], los[3]));
+    *high = qMax(qMax(his[0], his[1]), qMax(his[2], his[3]));
+    minMaxF32Tail(data + i, count - i, low, high);
+}
+
+TGUI_TARGET("sse4.1")
+void tableF32Sse41(const float* data, qint64 count, float low, float scale, float lastIndex,
+                   const quint32* table, quint32* out)
+{
+    const __m128 vlow = _mm_set1_ps(low);
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vhalf = _mm_set1_ps(0.5f);
+    const __m128 vlast = _mm_set1_ps(lastIndex);
+    const __m128 zero = _mm_setzero_ps();
+    alignas(16) qint32 index[4];
+    qint64 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(data + i), vlow), vscale), vhalf);
+        x = _mm_min_ps(_mm_max_ps(x, zero), vlast);     // max_ps returns zero for NaN
+        _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_cvttps_epi32(x));
+        out[i] = table[index[0]];
+        out[i + 1] = table[index[1]];
+        out[i + 2] = table[index[2]];
+        out[i + 3] = table[index[3]];
+    }
+    tableF32Scalar(data + i, count - i, low, scale, lastIndex, table, out + i);
+}
+
+TGUI_TARGET("avx2")
+void minMaxU8Avx2(const quint8* data, qint64 count, quint8* low, quint8* high)
+{
+    __m256i lo = _mm256_set1_epi8(char(0xff));
+    __m256i hi = _mm256_setzero_si256();
+    qint64 i = 0;
+    for (; i + 32 <= count; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        lo = _mm256_min_epu8(lo, v);
+        hi = _mm256_max_epu8(hi, v);
+    }
+
+    alignas(32) quint8 los[32];
+    alignas(32) quint8 his[32];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(los), lo);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(his), hi);
+    *low = *std::min_element(los, los + 32);
+    *high = *std::max_element(his, his + 32);
+    minMaxScalar(data + i, count - i, low, high);
+}
+
+TGUI_TARGET("avx2")
+void minMaxU16Avx2(const quint16* data, qint64 count, quint16* low, quint16* high)
+{
+    __m256i lo = _mm256_set1_epi16(-1);
+    __m256i hi = _mm256_setzero_si256();
+    qint64 i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        lo = _mm256_min_epu16(lo, v);
+        hi = _mm256_max_epu16(hi, v);
+    }
+
+    alignas(32) quint16 los[16];
+    alignas(32) quint16 his[16];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(los), lo);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(his), hi);
+    *low = *std::min_element(los, los + 16);
+    *high = *std::max_element(his, his + 16);
+    minMaxScalar(data + i, count - i, low, high);
+}
+
+TGUI_TARGET("avx2")
+void minMaxF32Avx2(const float* data, qint64 count, float* low, float* high)
+{
+    const __m256 plusInf = _mm256_set1_ps(kInfinity);
+    const __m256 minusInf = _mm256_set1_ps(-kInfinity);
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 lo = plusInf;
+    __m256 hi = minusInf;
+    qint64 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 v = _mm256_loadu_ps(data + i);
+        const __m256 finite = _mm256_cmp_ps(_mm256_sub_ps(v, v), zero, _CMP_EQ_OQ);
+        lo = _mm256_min_ps(lo, _mm256_blendv_ps(plusInf, v, finite));
+        hi = _mm256_max_ps(hi, _mm256_blendv_ps(minusInf, v, finite));
+    }
+
+    alignas(32) float los[8];
+    alignas(32) float his[8];
+    _mm256_store_ps(los, lo);
+    _mm256_store_ps(his, hi);
+    *low = *std::min_element(los, los + 8);
+    *high = *std::max_element(his, his + 8);
+    minMaxF32Tail(data + i, count - i, low, high);
+}
+
+TGUI_TARGET("avx2")
+void tableU8Avx2(const quint8* data, qint64 count, const quint32* table, quint32* out)
+{
+    const int* base = reinterpret_cast<const int*>(table);
+    qint64 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_i32gather_epi32(base, index, 4));
+    }
+    tableScalar(data + i, count - i, table, out + i);
+}
+
+TGUI_TARGET("avx2")
+void tableU16Avx2(const quint16* data, qint64 count, const quint32* table, quint32* out)
+{
+    const int* base = reinterpret_cast<const int*>(table);
+    qint64 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_i32gather_epi32(base, index, 4));
+    }
+    tableScalar(data + i, count - i, table, out + i);
+}
+
+TGUI_TARGET("avx2")
+void tableF32Avx2(const float* data, qint64 count, float low, float scale, float lastIndex,
+                  const quint32* table, quint32* out)
+{
+    const int* base = reinterpret_cast<const int*>(table);
+    const __m256 vlow = _mm256_set1_ps(low);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256 vhalf = _mm256_set1_ps(0.5f);
+    const __m256 vlast = _mm256_set1_ps(lastIndex);
+    const __m256 zero = _mm256_setzero_ps();
+    qint64 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(data + i), vlow), vscale), vhalf);
+        x = _mm256_min_ps(_mm256_max_ps(x, zero), vlast);
+        const __m256i index = _mm256_cvttps_epi32(x);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_i32gather_epi32(base, index, 4));
+    }
+    tableF32Scalar(data + i, count - i, low, scale, lastIndex, table, out + i);
+}
+
+// SSE4.1 has no gather, so the integer table lookups stay scalar
+const Kernels kSse41Kernels = {
+    minMaxU8Sse41, minMaxU16Sse41, minMaxF32Sse41,
+    tableU8Scalar, tableU16Scalar, tableF32Sse41
+};
+
+const Kernels kAvx2Kernels = {
+    minMaxU8Avx2, minMaxU16Avx2, minMaxF32Avx2,
+    tableU8Avx2, tableU16Avx2, tableF32Avx2
+};
+
+#endif // TGUI_KERNELS_X86
+
+#if defined(TGUI_KERNELS_NEON)
+
+void minMaxU8Neon(const quint8* data, qint64 count, quint8* low, quint8* high)
+{
+    uint8x16_t lo = vdupq_n_u8(255);
+    uint8x16_t hi = vdupq_n_u8(0);
+    qint64 i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t v = vld1q_u8(data + i);
+        lo = vminq_u8(lo, v);
+        hi = vmaxq_u8(hi, v);
+    }
+    *low = vminvq_u8(lo);
+    *high = vmaxvq_u8(hi);
+    minMaxScalar(data + i, count - i, low, high);
+}
+
+void minMaxU16Neon(const quint16* data, qint64 count, quint16* low, quint16* high)
+{
+    uint16x8_t lo = vdupq_n_u16(65535);
+    uint16x8_t hi = vdupq_n_u16(0);
+    qint64 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const uint16x8_t v = vld1q_u16(data + i);
+        lo = vminq_u16(lo, v);
+        hi = vmaxq_u16(hi, v);
+    }
+    *low = vminvq_u16(lo);
+    *high = vmaxvq_u16(hi);
+    minMaxScalar(data + i, count - i, low, high);
+}
+
+void minMaxF32Neon(const float* data, qint64 count, float* low, float* high)
+{
+    const float32x4_t plusInf = vdupq_n_f32(kInfinity);
+    const float32x4_t minusInf = vdupq_n_f32(-kInfinity);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    float32x4_t lo = plusInf;
+    float32x4_t hi = minusInf;
+    qint64 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t v = vld1q_f32(data + i);
+        const uint32x4_t finite = vceqq_f32(vsubq_f32(v, v), zero);
+        lo = vminq_f32(lo, vbslq_f32(finite, v, plusInf));
+        hi = vmaxq_f32(hi, vbslq_f32(finite, v, minusInf));
+    }
+    *low = vminvq_f32(lo);
+    *high = vmaxvq_f32(hi);
+    minMaxF32Tail(data + i, count - i, low, high);
+}
+
+void tableF32Neon(const float* data, qint64 count, float low, float scale, float lastIndex,
+                  const quint32* table, quint32* out)
+{
+    const float32x4_t vlow = vdupq_n_f32(low);
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    const float32x4_t vhalf = vdupq_n_f32(0.5f);
+    const float32x4_t vlast = vdupq_n_f32(lastIndex);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    qint64 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t x = vmlaq_f32(vhalf, vsubq_f32(vld1q_f32(data + i), vlow), vscale);
+        x = vminq_f32(vmaxnmq_f32(x, zero), vlast);     // maxnm returns zero for NaN
+        const int32x4_t index = vcvtq_s32_f32(x);
+        out[i] = table[vgetq_lane_s32(index, 0)];
+        out[i + 1] = table[vgetq_lane_s32(index, 1)];
+        out[i + 2] = table[vgetq_lane_s32(index, 2)];
+        out[i + 3] = table[vgetq_lane_s32(index, 3)];
+    }
+    tableF32Scalar(data + i, count - i, low, scale, lastIndex, table, out + i);
+}
+
+// NEON has no gather, so the integer table lookups stay scalar
+const Kernels kNeonKernels = {
+    minMaxU8Neon, minMaxU16Neon, minMaxF32Neon,
+    tableU8Scalar, tableU16Scalar, tableF32Neon
+};
+
+#endif // TGUI_KERNELS_NEON
+
+InstructionSet detectInstructionSet()
+{
+#if defined(TGUI_KERNELS_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4] = {0, 0, 0, 0};
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool osSavesAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0
+                         && (_xgetbv(0) & 0x6) == 0x6;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osSavesAvx) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    const bool sse41 = __builtin_cpu_supports("sse4.1");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) {
+        return InstructionSet::AVX2;
+    }
+    if (sse41) {
+        return InstructionSet::SSE41;
+    }
+    return InstructionSet::Scalar;
+#elif defined(TGUI_KERNELS_NEON)
+    // Advanced SIMD is part of every AArch64 core
+    return InstructionSet::NEON;
+#else
+    return InstructionSet::Scalar;
+#endif
+}
+
+std::atomic<int>& activeSet()
+{
+    static std::atomic<int> set{int(supportedInstructionSet())};
+    return set;
+}
+
+const Kernels& kernels()
+{
+    switch (InstructionSet(activeSet().load(std::memory_order_relaxed))) {
+#if defined(TGUI_KERNELS_X86)
+    case InstructionSet::AVX2:  return kAvx2Kernels;
+    case InstructionSet::SSE41: return kSse41Kernels;
+#endif
+#if defined(TGUI_KERNELS_NEON)
+    case InstructionSet::NEON:  return kNeonKernels;
+#endif
+    default:                    return kScalarKernels;
+    }
+}
+
+/**
+ * @brief Scan every step-th element; decimated scans are too sparse to vectorize
+ */
+template<typename T>
+bool minMaxStrided(const T* data, qint64 count, qint64 step, double* min, double* max)
+{
+    double low = std::numeric_limits<double>::max();
+    double high = std::numeric_limits<double>::lowest();
+    for (qint64 i = 0; i < count; i += step) {
+        const double value = double(data[i]);
+        if (qIsFinite(value)) {
+            low = qMin(low, value);
+            high = qMax(high, value);
+        }
+    }
+    if (low > high) {
+        return false;
+    }
+    *min = low;
+    *max = high;
+    return true;
+}
+
+quint32 packRgba(QRgb color)
+{
+    quint32 packed = 0;
+    uchar* bytes = reinterpret_cast<uchar*>(&packed);
+    bytes[0] = uchar(qRed(color));
+    bytes[1] = uchar(qGreen(color));
+    bytes[2] = uchar(qBlue(color));
+    bytes[3] = uchar(qAlpha(color));
+    return packed;
+}
+
+} // namespace
+
+InstructionSet instructionSet()
+{
+    return InstructionSet(activeSet().load(std::memory_order_relaxed));
+}
+
+InstructionSet supportedInstructionSet()
+{
+    static const InstructionSet supported = detectInstructionSet();
+    return supported;
+}
+
+void setInstructionSet(InstructionSet set)
+{
+    const InstructionSet supported = supportedInstructionSet();
+    const bool available = set == InstructionSet::Scalar || set == supported
+                        || (set == InstructionSet::SSE41 && supported == InstructionSet::AVX2);
+    activeSet().store(int(available ? set : InstructionSet::Scalar), std::memory_order_relaxed);
+}
+
+const char* instructionSetName(InstructionSet set)
+{
+    switch (set) {
+    case InstructionSet::SSE41: return "SSE4.1";
+    case InstructionSet::AVX2:  return "AVX2";
+    case InstructionSet::NEON:  return "NEON";
+    default:                    return "Scalar";
+    }
+}
+
+bool minMax(const quint8* data, qint64 count, double* min, double* max, qint64 step)
+{
+    if (!data || count <= 0) {
+        return false;
+    }
+    if (step > 1) {
+        return minMaxStrided(data, count, step, min, max);
+    }
+
+    quint8 low = 0;
+    quint8 high = 0;
+    kernels().minMaxU8(data, count, &low, &high);
+    *min = low;
+    *max = high;
+    return true;
+}
+
+bool minMax(const quint16* data, qint64 count, double* min, double* max, qint64 step)
+{
+    if (!data || count <= 0) {
+        return false;
+    }
+    if (step > 1) {
+        return minMaxStrided(data, count, step, min, max);
+    }
+
+    quint16 low = 0;
+    quint16 high = 0;
+    kernels().minMaxU16(data, count, &low, &high);
+    *min = low;
+    *max = high;
+    return true;
+}
+
+bool minMax(const float* data, qint64 count, double* min, double* max, qint64 step)
+{
+    if (!data || count <= 0) {
+        return false;
+    }
+    if (step > 1) {
+        return minMaxStrided(data, count, step, min, max);
+    }
+
+    float low = 0.0f;
+    float high = 0.0f;
+    kernels().minMaxF32(data, count, &low, &high);
+    if (low > high) {
+        return false;
+    }
+    *min = low;
+    *max = high;
+    return true;
+}
+
+void Histogram::add(const Histogram& other)
+{
+    if (counts.isEmpty()) {
+        *this = other;
+        return;
+    }
+    if (other.counts.size() != counts.size()) {
+        return;
+    }
+
+    for (int i = 0; i < counts.size(); ++i) {
+        counts[i] += other.counts[i];
+    }
+    total += other.total;
+}
+
+double Histogram::percentile(double fraction) const
+{
+    if (total == 0 || counts.isEmpty()) {
+        return low;
+    }
+
+    const double target = qBound(0.0, fraction, 1.0) * double(total);
+    double cumulative = 0.0;
+    for (int i = 0; i < counts.size(); ++i) {
+        const double count = double(counts[i]);
+        if (count > 0.0 && cumulative + count >= target) {
+            return low + binWidth * (i + (target - cumulative) / count);
+        }
+        cumulative += count;
+    }
+    return low + binWidth * counts.size();
+}
+
+Histogram histogram(const quint8* data, qint64 count, qint64 step)
+{
+    Histogram result;
+    result.counts.fill(0, 256);
+    if (!data || count <= 0) {
+        return result;
+    }
+    step = qMax<qint64>(1, step);
+
+    // Four interleaved sub-histograms keep consecutive equal values from
+    // stalling on the same counter
+    quint64 sub[4][256] = {};
+    qint64 i = 0;
+    for (; i + 3 * step < count; i += 4 * step) {
+        ++sub[0][data[i]];
+        ++sub[1][data[i + step]];
+        ++sub[2][data[i + 2 * step]];
+        ++sub[3][data[i + 3 * step]];
+    }
+    for (; i < count; i += step) {
+        ++sub[0][data[i]];
+    }
+
+    for (int bin = 0; bin < 256; ++bin) {
+        result.counts[bin] = sub[0][bin] + sub[1][bin] + sub[2][bin] + sub[3][bin];
+        result.total += result.counts[bin];
+    }
+    return result;
+}
+
+Histogram histogram(const quint16* data, qint64 count, qint64 step)
+{
+    Histogram result;
+    result.counts.fill(0, 65536);
+    if (!data || count <= 0) {
+        return result;
+    }
+    step = qMax<qint64>(1, step);
+
+    quint64* counts = result.counts.data();
+    for (qint64 i = 0; i < count; i += step) {
+        ++counts[data[i]];
+        ++result.total;
+    }
+    return result;
+}
+
+Histogram histogram(const float* data, qint64 count, double low, double high, int bins, qint64 step)
+{
+    Histogram result;
+    bins = qMax(1, bins);
+    result.low = low;
+    result.binWidth = high > low ? (high - low) / bins : 1.0;
+    result.counts.fill(0, bins);
+    if (!data || count <= 0) {
+        return result;
+    }
+    step = qMax<qint64>(1, step);
+
+    const double scale = 1.0 / result.binWidth;
+    const int last = bins - 1;
+    quint64* counts = result.counts.data();
+    for (qint64 i = 0; i < count; i += step) {
+        const float value = data[i];
+        if (qIsNaN(value)) {
+            continue;
+        }
+        const double x = (double(value) - low) * scale;
+        ++counts[x <= 0.0 ? 0 : int(qMin(x, double(last)))];
+        ++result.total;
+    }
+    return result;
+}
+
+QVector<QRgb> linearColormap(const QColor& color)
+{
+    QVector<QRgb> colormap(256);
+    for (int i = 0; i < 256; ++i) {
+        colormap[i] = qRgb(color.red() * i / 255, color.green() * i / 255, color.blue() * i / 255);
+    }
+    return colormap;
+}
+
+QVector<quint32> colorTable(int size, double low, double high, float gamma, const QVector<QRgb>& colormap)
+{
+    const QVector<QRgb> colors = colormap.isEmpty() ? linearColormap() : colormap;
+    const int last = colors.size() - 1;
+    const double range = high - low;
+
+    QVector<quint32> table(qMax(0, size));
+    for (int i = 0; i < table.size(); ++i) {
+        double t = range > 0.0 ? (i - low) / range : (i >= high ? 1.0 : 0.0);
+        t = qBound(0.0, t, 1.0);
+        if (gamma != 1.0f) {
+            t = std::pow(t, double(gamma));
+        }
+        table[i] = packRgba(colors[int(t * last + 0.5)]);
+    }
+    return table;
+}
+
+void applyTable(const quint8* data, qint64 count, const quint32* table, quint32* out)
+{
+    if (count > 0) {
+        kernels().tableU8(data, count, table, out);
+    }
+}
+
+void applyTable(const quint16* data, qint64 count, const quint32* table, quint32* out)
+{
+    if (count > 0) {
+        kernels().tableU16(data, count, table, out);
+    }
+}
+
+void applyTable(const float* data, qint64 count, float low, float high,
+                const quint32* table, int tableSize, quint32* out)
+{
+    if (count <= 0 || tableSize <= 0) {
+        return;
+    }
+
+    const float lastIndex = float(tableSize - 1);
+    const float scale = high > low ? lastIndex / (high - low) : 0.0f;
+    kernels().tableF32(data, count, low, scale, lastIndex, table, out);
+}
+
+} // namespace ImageKernels
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <QColor>
+#include <QVector>
+#include <QtGlobal>
+
+/**
+ * @brief Vectorized pixel kernels for displaying scalar images
+ *
+ * Contrast stretching, gamma and colormapping are folded into one colour
+ * table per setting, so displaying an image costs a single table lookup
+ * per pixel. Min/max scans and table lookups use SSE4.1, AVX2 or NEON when
+ * the CPU supports them; the implementation is picked once at runtime.
+ *
+ * Colours are written as RGBA8888 (byte order R, G, B, A), ready for
+ * QImage::Format_RGBA8888 or a GL_RGBA upload. All functions are
+ * reentrant and may be called from worker threads.
+ */
+namespace ImageKernels {
+
+/**
+ * @brief Kernel implementation
+ */
+enum class InstructionSet {
+    Scalar,
+    SSE41,
+    AVX2,
+    NEON
+};
+
+/**
+ * @brief Get the implementation in use
+ * @return Instruction set
+ */
+InstructionSet instructionSet();
+
+/**
+ * @brief Get the best implementation this CPU supports
+ * @return Instruction set
+ */
+InstructionSet supportedInstructionSet();
+
+/**
+ * @brief Select the implementation, e.g. to compare them in benchmarks
+ * @param set Instruction set; unsupported sets fall back to Scalar
+ */
+void setInstructionSet(InstructionSet set);
+
+/**
+ * @brief Get a printable name
+ * @param set Instruction set
+ * @return Name such as "AVX2"
+ */
+const char* instructionSetName(InstructionSet set);
+
+/**
+ * @brief Find the value range
+ *
+ * Only every step-th element is read, which gives a quick estimate for
+ * large images. NaN and infinite values are ignored.
+ *
+ * @param data Elements
+ * @param count Number of elements
+ * @param min Receives the minimum
+ * @param max Receives the maximum
+ * @param step Element step (1 reads everything)
+ * @return false if no finite value was found
+ */
+bool minMax(const quint8* data, qint64 count, double* min, double* max, qint64 step = 1);
+bool minMax(const quint16* data, qint64 count, double* min, double* max, qint64 step = 1);
+bool minMax(const float* data, qint64 count, double* min, double* max, qint64 step = 1);
+
+/**
+ * @brief Value histogram
+ */
+struct Histogram
+{
+    double low = 0.0;           ///< Lower edge of the first bin
+    double binWidth = 1.0;      ///< Width of every bin
+    QVector<quint64> counts;    ///< Count per bin
+    quint64 total = 0;          ///< Sum of all counts
+
+    /**
+     * @brief Merge another histogram with the same bins
+     * @param other Histogram
+     */
+    void add(const Histogram& other);
+
+    /**
+     * @brief Get the value below which a fraction of the samples lies
+     * @param fraction Fraction in [0, 1]
+     * @return Value, interpolated within the bin
+     */
+    double percentile(double fraction) const;
+};
+
+/**
+ * @brief Count values, one bin per possible value
+ * @param data Elements
+ * @param count Number of elements
+ * @param step Element step (1 reads everything)
+ * @return 256 or 65536 bins starting at 0
+ */
+Histogram histogram(const quint8* data, qint64 count, qint64 step = 1);
+Histogram histogram(const quint16* data, qint64 count, qint64 step = 1);
+
+/**
+ * @brief Count values in equal bins over a range
+ * @param data Elements
+ * @param count Number of elements
+ * @param low Lower edge of the first bin
+ * @param high Upper edge of the last bin
+ * @param bins Number of bins
+ * @param step Element step (1 reads everything)
+ * @return Histogram; values outside the range go to the outer bins, NaN is skipped
+ */
+Histogram histogram(const float* data, qint64 count, double low, double high, int bins, qint64 step = 1);
+
+/**
+ * @brief Build a colormap running from black to a colour
+ * @param color Colour of the brightest value
+ * @return 256 colours
+ */
+QVector<QRgb> linearColormap(const QColor& color = Qt::white);
+
+/**
+ * @brief Build a colour table for integer pixel values
+ *
+ * Entry i holds the colour of value i: values are stretched so that
+ * [low, high] covers [0, 1], raised to gamma and looked up in the colormap.
+ *
+ * @param size Number of entries (256 for uint8, 65536 for uint16)
+ * @param low Value shown as the first colormap entry
+ * @param high Value shown as the last colormap entry
+ * @param gamma Gamma exponent
+ * @param colormap Colours, usually 256
+ * @return RGBA8888 colours
+ */
+QVector<quint32> colorTable(int size, double low, double high, float gamma, const QVector<QRgb>& colormap);
+
+/**
+ * @brief Colour pixels through a table indexed by their value
+ * @param data Elements
+ * @param count Number of elements
+ * @param table Table from colorTable() with 256 entries
+ * @param out Receives count RGBA8888 colours
+ */
+void applyTable(const quint8* data, qint64 count, const quint32* table, quint32* out);
+
+/**
+ * @brief Colour pixels through a table indexed by their value
+ * @param data Elements
+ * @param count Number of elements
+ * @param table Table from colorTable() with 65536 entries
+ * @param out Receives count RGBA8888 colours
+ */
+void applyTable(const quint16* data, qint64 count, const quint32* table, quint32* out);
+
+/**
+ * @brief Colour float pixels through a table over [low, high]
+ *
+ * Values are mapped linearly so that low selects the first entry and high
+ * the last; NaN selects the first entry. The table is typically built with
+ * colorTable(size, 0, size - 1, gamma, colormap).
+ *
+ * @param data Elements
+ * @param count Number of elements
+ * @param low Value of the first entry
+ * @param high Value of the last entry
+ * @param table Colours
+ * @param tableSize Number of entries
+ * @param out Receives count RGBA8888 colours
+ */
+void applyTable(const float* data, qint64 count, float low, float high,
+                const quint32* table, int tableSize, quint32* out);
+
+} // namespace ImageKernels
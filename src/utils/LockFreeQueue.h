@@ -0,0 +1,144 @@
+#pragma once
+
+#include <QtGlobal>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * @brief Bounded lock-free queue for many producers and one consumer
+ *
+ * A ring of preallocated slots, each with a sequence number telling
+ * whether it is free for the producer of a given position or holds a
+ * value for the consumer. Producers claim a position with a single
+ * compare-and-swap on the tail; the consumer owns the head outright.
+ * Slots are reused in place, so steady-state traffic does not allocate.
+ *
+ * tryPush() may be called from any thread. tryPop() must only be called
+ * from one thread at a time.
+ */
+template<typename T>
+class LockFreeQueue
+{
+public:
+    /**
+     * @brief Constructor
+     * @param capacity Number of slots, rounded up to a power of two
+     */
+    explicit LockFreeQueue(int capacity)
+    {
+        size_t size = 2;
+        while (size < size_t(qMax(capacity, 2))) {
+            size *= 2;
+        }
+
+        m_mask = size - 1;
+        m_slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+    }
+
+    LockFreeQueue(const LockFreeQueue&) = delete;
+    LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+    /**
+     * @brief Get number of slots
+     * @return Capacity
+     */
+    int capacity() const { return int(m_mask + 1); }
+
+    /**
+     * @brief Get approximate number of queued values
+     * @return Value count, exact only when no producer is active
+     */
+    int size() const
+    {
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        const size_t head = m_head.load(std::memory_order_acquire);
+        return int(tail - head);
+    }
+
+    /**
+     * @brief Check if the queue looks empty
+     * @return true if no value is queued
+     */
+    bool isEmpty() const { return size() <= 0; }
+
+    /**
+     * @brief Append a value
+     * @param value Value, moved into a slot on success
+     * @return false if the queue is full
+     */
+    bool tryPush(T&& value) { return emplace(std::move(value)); }
+
+    /**
+     * @brief Append a copy of a value
+     * @param value Value
+     * @return false if the queue is full
+     */
+    bool tryPush(const T& value) { return emplace(value); }
+
+    /**
+     * @brief Take the oldest value (consumer thread only)
+     * @param value Receives the value
+     * @return false if the queue is empty
+     */
+    bool tryPop(T& value)
+    {
+        const size_t position = m_head.load(std::memory_order_relaxed);
+        Slot& slot = m_slots[position & m_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+            return false;
+        }
+
+        value = std::move(slot.value);
+        slot.value = T();
+        slot.sequence.store(position + m_mask + 1, std::memory_order_release);
+        m_head.store(position + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    template<typename U>
+    bool emplace(U&& value)
+    {
+        size_t position = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = m_slots[position & m_mask];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t diff = std::ptrdiff_t(sequence) - std::ptrdiff_t(position);
+
+            if (diff == 0) {
+                // Slot is free for this position; claim it
+                if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.value = std::forward<U>(value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // The consumer has not freed this slot yet
+                return false;
+            } else {
+                position = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // Producers and the consumer touch different ends; keep them apart
+    static constexpr size_t kCacheLine = 64;
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_mask;
+    alignas(kCacheLine) std::atomic<size_t> m_head;
+    alignas(kCacheLine) std::atomic<size_t> m_tail;
+};
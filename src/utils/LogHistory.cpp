@@ -0,0 +1,231 @@
+#include "LogHistory.h"
+#include "Logger.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+quint64 roundUpToPowerOfTwo(quint64 value)
+{
+    quint64 result = 2;
+    while (result < value) {
+        result *= 2;
+    }
+    return result;
+}
+
+} // namespace
+
+LogHistory::LogHistory(int capacity, qint64 textCapacity)
+    : m_epochMSecs(QDateTime::currentMSecsSinceEpoch())
+    , m_slots(nullptr)
+    , m_mask(roundUpToPowerOfTwo(quint64(qMax(capacity, 2))) - 1)
+    , m_head(0)
+    , m_begin(0)
+    , m_text(nullptr)
+    , m_textMask(roundUpToPowerOfTwo(quint64(qMax<qint64>(textCapacity, kMaxMessageBytes))) - 1)
+    , m_textHead(0)
+    , m_textReserved(0)
+    , m_stringCount(1)
+{
+    m_clock.start();
+
+    // calloc leaves untouched pages uncommitted; a zero sequence marks an empty slot
+    m_slots = static_cast<Slot*>(std::calloc(m_mask + 1, sizeof(Slot)));
+    m_text = static_cast<char*>(std::malloc(m_textMask + 1));
+    if (!m_slots || !m_text) {
+        qWarning() << "LogHistory: failed to reserve" << (m_mask + 1) << "records";
+        std::free(m_slots);
+        std::free(m_text);
+        m_slots = nullptr;
+        m_text = nullptr;
+    }
+
+    for (auto& chunk : m_stringChunks) {
+        chunk.store(nullptr, std::memory_order_relaxed);
+    }
+
+    // Id 0 is the empty string
+    QString* first = new QString[kChunkSize];
+    m_stringChunks[0].store(first, std::memory_order_release);
+}
+
+LogHistory::~LogHistory()
+{
+    std::free(m_slots);
+    std::free(m_text);
+    for (auto& chunk : m_stringChunks) {
+        delete[] chunk.load(std::memory_order_relaxed);
+    }
+}
+
+void LogHistory::append(qint64 timestamp, LogLevel level, const QString& category, const QString& message,
+                        const QString& file, int line, const QString& function)
+{
+    if (!m_slots) {
+        return;
+    }
+
+    QByteArray text = message.toUtf8();
+    if (text.size() > kMaxMessageBytes) {
+        // Cut before a code point, not inside one: skip back over
+        // continuation bytes (10xxxxxx) to the lead byte
+        int length = kMaxMessageBytes;
+        while (length > 0 && (uchar(text.at(length)) & 0xc0) == 0x80) {
+            --length;
+        }
+        text.truncate(length);
+    }
+
+    // Copy the message into the text ring; readers check m_textReserved
+    // to detect bytes overwritten while they copied them
+    const quint64 textBegin = m_textHead.load(std::memory_order_relaxed);
+    const quint64 textEnd = textBegin + quint64(text.size());
+    m_textReserved.store(textEnd, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const quint64 textSize = m_textMask + 1;
+    const quint64 offset = textBegin & m_textMask;
+    const quint64 firstPart = qMin<quint64>(quint64(text.size()), textSize - offset);
+    std::memcpy(m_text + offset, text.constData(), firstPart);
+    std::memcpy(m_text, text.constData() + firstPart, quint64(text.size()) - firstPart);
+    m_textHead.store(textEnd, std::memory_order_release);
+
+    // Seqlock write of the record slot
+    const quint64 index = m_head.load(std::memory_order_relaxed);
+    Slot& slot = m_slots[index & m_mask];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.timestamp = timestamp;
+    slot.textBegin = textBegin;
+    slot.textLength = quint32(text.size());
+    slot.line = line;
+    slot.category = intern(category);
+    slot.file = intern(file);
+    slot.function = intern(function);
+    slot.level = quint8(level);
+
+    slot.sequence.store(index + 1, std::memory_order_release);
+    m_head.store(index + 1, std::memory_order_release);
+}
+
+QList<LogEntry> LogHistory::snapshot(int count) const
+{
+    QList<LogEntry> result;
+    if (!m_slots || count <= 0) {
+        return result;
+    }
+
+    const quint64 head = m_head.load(std::memory_order_acquire);
+    quint64 first = head > quint64(count) ? head - quint64(count) : 0;
+    first = qMax(first, m_begin.load(std::memory_order_acquire));
+    if (head > m_mask + 1) {
+        first = qMax(first, head - (m_mask + 1));
+    }
+
+    result.reserve(int(head - first));
+    QByteArray text;
+    const quint64 textSize = m_textMask + 1;
+
+    for (quint64 index = first; index < head; ++index) {
+        const Slot& slot = m_slots[index & m_mask];
+        const quint64 sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != index + 1) {
+            continue;
+        }
+
+        const qint64 timestamp = slot.timestamp;
+        const quint64 textBegin = slot.textBegin;
+        const quint32 textLength = qMin<quint32>(slot.textLength, kMaxMessageBytes);
+        const qint32 line = slot.line;
+        const quint16 category = slot.category;
+        const quint16 file = slot.file;
+        const quint16 function = slot.function;
+        const quint8 level = slot.level;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+            continue;
+        }
+
+        text.resize(int(textLength));
+        const quint64 offset = textBegin & m_textMask;
+        const quint64 firstPart = qMin<quint64>(textLength, textSize - offset);
+        std::memcpy(text.data(), m_text + offset, firstPart);
+        std::memcpy(text.data() + firstPart, m_text, textLength - firstPart);
+
+        // The message is valid if the writer has not reached it again
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_textReserved.load(std::memory_order_relaxed) > textBegin + textSize) {
+            continue;
+        }
+
+        LogEntry entry;
+        entry.timestamp = QDateTime::fromMSecsSinceEpoch(toMSecsSinceEpoch(timestamp));
+        entry.level = LogLevel(level);
+        entry.category = internedString(category);
+        entry.message = QString::fromUtf8(text);
+        entry.file = internedString(file);
+        entry.line = line;
+        entry.function = internedString(function);
+        result.append(entry);
+    }
+
+    return result;
+}
+
+int LogHistory::size() const
+{
+    const quint64 head = m_head.load(std::memory_order_acquire);
+    const quint64 begin = m_begin.load(std::memory_order_acquire);
+    return int(qMin(head - qMin(begin, head), m_mask + 1));
+}
+
+void LogHistory::clear()
+{
+    m_begin.store(m_head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+quint16 LogHistory::intern(const QString& text)
+{
+    if (text.isEmpty()) {
+        return 0;
+    }
+
+    auto it = m_stringIds.constFind(text);
+    if (it != m_stringIds.constEnd()) {
+        return *it;
+    }
+
+    const int id = m_stringCount.load(std::memory_order_relaxed);
+    if (id >= kMaxChunks * kChunkSize) {
+        return 0;
+    }
+
+    std::atomic<QString*>& chunkSlot = m_stringChunks[id >> kChunkBits];
+    QString* chunk = chunkSlot.load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new QString[kChunkSize];
+        chunkSlot.store(chunk, std::memory_order_release);
+    }
+
+    // Published strings are never modified, so readers may copy them freely
+    chunk[id & (kChunkSize - 1)] = text;
+    m_stringCount.store(id + 1, std::memory_order_release);
+    m_stringIds.insert(text, quint16(id));
+    return quint16(id);
+}
+
+QString LogHistory::internedString(quint16 id) const
+{
+    if (id == 0 || id >= m_stringCount.load(std::memory_order_acquire)) {
+        return QString();
+    }
+
+    const QString* chunk = m_stringChunks[id >> kChunkBits].load(std::memory_order_acquire);
+    return chunk ? chunk[id & (kChunkSize - 1)] : QString();
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <atomic>
+#include <memory>
+
+enum class LogLevel;
+struct LogEntry;
+
+/**
+ * @brief Fixed-capacity ring of compact log records
+ *
+ * Records are small fixed-size slots: a monotonic timestamp, the level,
+ * ids of interned category, file and function strings, and the position
+ * of the UTF-8 message in a separate byte ring. Nothing is allocated per
+ * record once the interned strings are known, and the oldest records are
+ * overwritten in place when the ring is full. Memory is reserved up front
+ * but zero pages are only committed as the history fills.
+ *
+ * append() must be called from one thread at a time (the log writer).
+ * snapshot() may be called from any thread and takes no lock: every slot
+ * carries a sequence number, and a record that was overwritten while it
+ * was being copied is skipped.
+ */
+class LogHistory
+{
+public:
+    /**
+     * @brief Constructor
+     * @param capacity Number of records, rounded up to a power of two
+     * @param textCapacity Bytes of message text, rounded up to a power of two
+     */
+    LogHistory(int capacity, qint64 textCapacity);
+
+    /**
+     * @brief Destructor
+     */
+    ~LogHistory();
+
+    LogHistory(const LogHistory&) = delete;
+    LogHistory& operator=(const LogHistory&) = delete;
+
+    /**
+     * @brief Get monotonic time for record timestamps
+     * @return Nanoseconds since the history was created
+     */
+    qint64 now() const { return m_clock.nsecsElapsed(); }
+
+    /**
+     * @brief Convert a record timestamp to wall-clock time
+     * @param timestamp Value returned by now()
+     * @return Milliseconds since epoch
+     */
+    qint64 toMSecsSinceEpoch(qint64 timestamp) const { return m_epochMSecs + timestamp / 1000000; }
+
+    /**
+     * @brief Append a record (writer thread only)
+     * @param timestamp Value returned by now()
+     * @param level Log level
+     * @param category Log category
+     * @param message Log message, truncated to kMaxMessageBytes of UTF-8
+     * @param file Source file
+     * @param line Source line
+     * @param function Source function
+     */
+    void append(qint64 timestamp, LogLevel level, const QString& category, const QString& message,
+                const QString& file, int line, const QString& function);
+
+    /**
+     * @brief Copy the most recent records
+     * @param count Maximum number of records
+     * @return Records, oldest first
+     */
+    QList<LogEntry> snapshot(int count) const;
+
+    /**
+     * @brief Get number of records kept
+     * @return Record count
+     */
+    int size() const;
+
+    /**
+     * @brief Get maximum number of records kept
+     * @return Capacity
+     */
+    int capacity() const { return int(m_mask + 1); }
+
+    /**
+     * @brief Get number of records appended since creation
+     * @return Total record count
+     */
+    quint64 totalCount() const { return m_head.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Hide all current records from snapshots
+     */
+    void clear();
+
+    // Longer messages are cut to this many bytes
+    static constexpr int kMaxMessageBytes = 4096;
+
+private:
+    /**
+     * @brief Fixed-size record slot, valid while sequence == index + 1
+     */
+    struct Slot
+    {
+        std::atomic<quint64> sequence;
+        qint64 timestamp;
+        quint64 textBegin;
+        quint32 textLength;
+        qint32 line;
+        quint16 category;
+        quint16 file;
+        quint16 function;
+        quint8 level;
+    };
+
+    /**
+     * @brief Get id of an interned string, adding it if needed (writer thread)
+     * @param text String
+     * @return Id, 0 for the empty string or when the table is full
+     */
+    quint16 intern(const QString& text);
+
+    /**
+     * @brief Get an interned string (any thread)
+     * @param id String id
+     * @return String
+     */
+    QString internedString(quint16 id) const;
+
+private:
+    QElapsedTimer m_clock;
+    qint64 m_epochMSecs;
+
+    // Record ring; m_head counts appended records
+    Slot* m_slots;
+    quint64 m_mask;
+    std::atomic<quint64> m_head;
+    std::atomic<quint64> m_begin;
+
+    // Message text ring; bytes up to m_textReserved may be in flux
+    char* m_text;
+    quint64 m_textMask;
+    std::atomic<quint64> m_textHead;
+    std::atomic<quint64> m_textReserved;
+
+    // Interned strings in fixed chunks, so readers never see a reallocation
+    static constexpr int kChunkBits = 8;
+    static constexpr int kChunkSize = 1 << kChunkBits;
+    static constexpr int kMaxChunks = 65536 / kChunkSize;
+    std::atomic<QString*> m_stringChunks[kMaxChunks];
+    std::atomic<int> m_stringCount;
+    QHash<QString, quint16> m_stringIds;
+};
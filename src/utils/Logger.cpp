@@ -3,28 +3,68 @@
 #include <QDir>
 #include <QDateTime>
 #include <QDebug>
+#include <QFileInfo>
 #include <QMutexLocker>
+#include <QThread>
+#include <atomic>
 #include <iostream>
 
 Logger* Logger::s_instance = nullptr;
 
+namespace {
+
+// Records held between log() and the writer thread
+const int kQueueCapacity = 65536;
+
+// Producer retries before a record is dropped on a full queue
+const int kPushRetries = 1000;
+
+// Records formatted per writer batch
+const int kBatchSize = 1024;
+
+const int kDefaultFlushInterval = 1000;
+
+// Post-mortem history: records and message bytes (about 64 bytes each)
+const int kHistoryCapacity = 1 << 20;
+const qint64 kHistoryTextCapacity = qint64(64) << 20;
+
+} // namespace
+
 Logger::Logger(QObject* parent)
     : QObject(parent)
-    , m_logLevel(LogLevel::Info)
+    , m_logLevel(int(LogLevel::Info))
     , m_consoleOutput(true)
     , m_fileOutput(false)
-    , m_maxHistorySize(1000)
+    , m_flushInterval(kDefaultFlushInterval)
+    , m_history(kHistoryCapacity, kHistoryTextCapacity)
+    , m_queue(kQueueCapacity)
+    , m_enqueued(0)
+    , m_written(0)
+    , m_dropped(0)
+    , m_writerIdle(false)
+    , m_flushRequested(false)
+    , m_flushRequests(0)
+    , m_flushesDone(0)
+    , m_running(true)
 {
     s_instance = this;
+    qRegisterMetaType<LogEntry>();
     
     // Set default log file name
     QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
     m_logFileName = QDir(dataDir).filePath("application.log");
+
+    m_writer.reset(QThread::create([this]() { writerLoop(); }));
+    m_writer->setObjectName("LogWriter");
+    m_writer->start(QThread::LowPriority);
 }
 
 Logger::~Logger()
 {
-    flush();
+    // The writer drains the queue before it exits
+    m_running.store(false, std::memory_order_release);
+    wakeWriter();
+    m_writer->wait();
     s_instance = nullptr;
 }
 
@@ -35,8 +75,7 @@ Logger* Logger::instance()
 
 void Logger::setLogLevel(LogLevel level)
 {
-    QMutexLocker locker(&m_mutex);
-    m_logLevel = level;
+    m_logLevel.store(int(level), std::memory_order_relaxed);
 }
 
 void Logger::setConsoleOutput(bool enabled)
@@ -68,6 +107,7 @@ void Logger::addCategoryFilter(const QString& category)
     QMutexLocker locker(&m_mutex);
     if (!m_categoryFilters.contains(category)) {
         m_categoryFilters.append(category);
+        updateCategorySnapshotLocked();
     }
 }
 
@@ -75,65 +115,58 @@ void Logger::removeCategoryFilter(const QString& category)
 {
     QMutexLocker locker(&m_mutex);
     m_categoryFilters.removeAll(category);
+    updateCategorySnapshotLocked();
 }
 
 void Logger::clearCategoryFilters()
 {
     QMutexLocker locker(&m_mutex);
     m_categoryFilters.clear();
+    updateCategorySnapshotLocked();
+}
+
+void Logger::setFlushInterval(int msec)
+{
+    m_flushInterval.store(qMax(1, msec), std::memory_order_relaxed);
+    wakeWriter();
 }
 
 void Logger::log(LogLevel level, const QString& category, const QString& message,
                  const QString& file, int line, const QString& function)
 {
-    QMutexLocker locker(&m_mutex);
-    
-    // Check log level
-    if (level < m_logLevel) {
+    // Filtered records cost two atomic loads and nothing else
+    if (int(level) < m_logLevel.load(std::memory_order_relaxed)) {
         return;
     }
-    
-    // Check category filter
     if (!shouldLogCategory(category)) {
         return;
     }
-    
-    // Create log entry
-    LogEntry entry;
-    entry.timestamp = QDateTime::currentDateTime();
-    entry.level = level;
-    entry.category = category;
-    entry.message = message;
-    entry.file = file;
-    entry.line = line;
-    entry.function = function;
-    
-    // Add to history
-    m_logHistory.append(entry);
-    if (m_logHistory.size() > m_maxHistorySize) {
-        m_logHistory.removeFirst();
-    }
-    
-    // Format message
-    QString formattedMessage = formatLogEntry(entry);
-    
-    // Output to console
-    if (m_consoleOutput) {
-        if (level >= LogLevel::Error) {
-            std::cerr << formattedMessage.toStdString() << std::endl;
-        } else {
-            std::cout << formattedMessage.toStdString() << std::endl;
+
+    LogRecord record;
+    record.timestamp = m_history.now();
+    record.level = level;
+    record.category = category;
+    record.message = message;
+    record.file = file;
+    record.line = line;
+    record.function = function;
+
+    // A full queue means the writer is behind; give it a chance first
+    int retries = 0;
+    while (!m_queue.tryPush(record)) {
+        if (++retries > kPushRetries) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
         }
+        wakeWriter();
+        QThread::yieldCurrentThread();
     }
-    
-    // Output to file
-    if (m_fileOutput && m_fileStream) {
-        *m_fileStream << formattedMessage << Qt::endl;
-        m_fileStream->flush();
+    m_enqueued.fetch_add(1, std::memory_order_release);
+
+    if (level >= LogLevel::Error) {
+        m_flushRequested.store(true, std::memory_order_relaxed);
     }
-    
-    // Emit signal
-    emit logEntryAdded(entry);
+    wakeWriter();
 }
 
 void Logger::debug(const QString& message, const QString& category)
@@ -163,27 +196,171 @@ void Logger::critical(const QString& message, const QString& category)
 
 QList<LogEntry> Logger::recentEntries(int count) const
 {
-    QMutexLocker locker(&m_mutex);
-    
-    if (count >= m_logHistory.size()) {
-        return m_logHistory;
-    }
-    
-    return m_logHistory.mid(m_logHistory.size() - count);
+    return m_history.snapshot(count);
 }
 
 void Logger::clearHistory()
 {
-    QMutexLocker locker(&m_mutex);
-    m_logHistory.clear();
+    m_history.clear();
 }
 
 void Logger::flush()
 {
+    const quint64 target = m_enqueued.load(std::memory_order_acquire);
+    const quint64 request = m_flushRequests.fetch_add(1, std::memory_order_acq_rel) + 1;
+    wakeWriter();
+
+    if (QThread::currentThread() == m_writer.get()) {
+        return;
+    }
+
+    QMutexLocker locker(&m_wakeMutex);
+    while (m_running.load(std::memory_order_acquire)
+           && (m_written.load(std::memory_order_acquire) < target
+               || m_flushesDone.load(std::memory_order_acquire) < request)) {
+        m_writtenCondition.wait(&m_wakeMutex, 100);
+    }
+}
+
+void Logger::wakeWriter()
+{
+    // Only the producer that finds the writer asleep takes the mutex. The
+    // fence pairs with the one in writerLoop(): either the writer sees the
+    // new record, or this producer sees the writer idle
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_writerIdle.exchange(false, std::memory_order_seq_cst)) {
+        QMutexLocker locker(&m_wakeMutex);
+        m_wakeCondition.wakeOne();
+    }
+}
+
+void Logger::writerLoop()
+{
+    QVector<LogRecord> batch;
+    batch.reserve(kBatchSize);
+    qint64 lastFlush = QDateTime::currentMSecsSinceEpoch();
+
+    for (;;) {
+        LogRecord record;
+        while (batch.size() < kBatchSize && m_queue.tryPop(record)) {
+            batch.append(std::move(record));
+        }
+
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        const bool intervalElapsed = now - lastFlush >= m_flushInterval.load(std::memory_order_relaxed);
+        const quint64 flushRequests = m_flushRequests.load(std::memory_order_acquire);
+        const bool flushRequested = m_flushRequested.exchange(false, std::memory_order_relaxed)
+                                 || flushRequests != m_flushesDone.load(std::memory_order_relaxed);
+
+        if (!batch.isEmpty() || flushRequested || intervalElapsed) {
+            writeRecords(batch, flushRequested || intervalElapsed);
+            m_written.fetch_add(quint64(batch.size()), std::memory_order_release);
+            batch.clear();
+            if (flushRequested || intervalElapsed) {
+                lastFlush = now;
+                m_flushesDone.store(flushRequests, std::memory_order_release);
+            }
+
+            QMutexLocker locker(&m_wakeMutex);
+            m_writtenCondition.wakeAll();
+        }
+
+        if (!m_queue.isEmpty()) {
+            continue;
+        }
+
+        QMutexLocker locker(&m_wakeMutex);
+        if (!m_running.load(std::memory_order_acquire)) {
+            if (m_queue.isEmpty()) {
+                break;
+            }
+            continue;
+        }
+
+        // Publish idle before re-checking; without the full fence the
+        // store could pass the queue check and a wakeup would be lost
+        m_writerIdle.store(true, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_queue.isEmpty() && !m_flushRequested.load(std::memory_order_relaxed)
+            && m_flushRequests.load(std::memory_order_acquire) == m_flushesDone.load(std::memory_order_relaxed)) {
+            m_wakeCondition.wait(&m_wakeMutex, ulong(m_flushInterval.load(std::memory_order_relaxed)));
+        }
+        m_writerIdle.store(false, std::memory_order_release);
+    }
+
+    // Final flush on shutdown
     QMutexLocker locker(&m_mutex);
     if (m_fileStream) {
         m_fileStream->flush();
     }
+    std::cout.flush();
+}
+
+void Logger::writeRecords(const QVector<LogRecord>& records, bool flushRequested)
+{
+    QList<LogEntry> entries;
+    entries.reserve(records.size());
+
+    QMutexLocker locker(&m_mutex);
+
+    QString out;
+    QString err;
+    QString fileText;
+    bool hasErrors = false;
+
+    for (const LogRecord& record : records) {
+        LogEntry entry;
+        entry.timestamp = QDateTime::fromMSecsSinceEpoch(m_history.toMSecsSinceEpoch(record.timestamp));
+        entry.level = record.level;
+        entry.category = record.category;
+        entry.message = record.message;
+        entry.file = record.file;
+        entry.line = record.line;
+        entry.function = record.function;
+
+        m_history.append(record.timestamp, record.level, record.category, record.message,
+                         record.file, record.line, record.function);
+
+        const QString formattedMessage = formatLogEntry(entry);
+        if (m_consoleOutput) {
+            QString& console = record.level >= LogLevel::Error ? err : out;
+            console += formattedMessage;
+            console += QLatin1Char('\n');
+        }
+        if (m_fileOutput && m_fileStream) {
+            fileText += formattedMessage;
+            fileText += QLatin1Char('\n');
+        }
+        hasErrors = hasErrors || record.level >= LogLevel::Error;
+
+        entries.append(entry);
+    }
+
+    // One write per batch and stream
+    if (!out.isEmpty()) {
+        std::cout << out.toStdString();
+        if (flushRequested || hasErrors) {
+            std::cout.flush();
+        }
+    }
+    if (!err.isEmpty()) {
+        std::cerr << err.toStdString();
+        std::cerr.flush();
+    }
+    if (m_fileStream) {
+        if (!fileText.isEmpty()) {
+            *m_fileStream << fileText;
+        }
+        if (flushRequested || hasErrors) {
+            m_fileStream->flush();
+        }
+    }
+
+    // Receivers may call back into the logger
+    locker.unlock();
+    for (const LogEntry& entry : qAsConst(entries)) {
+        emit logEntryAdded(entry);
+    }
 }
 
 QString Logger::formatLogEntry(const LogEntry& entry) const
@@ -220,12 +397,22 @@ QString Logger::logLevelString(LogLevel level) const
 bool Logger::shouldLogCategory(const QString& category) const
 {
     // If no filters are set, log everything
-    if (m_categoryFilters.isEmpty()) {
+    const std::shared_ptr<const QSet<QString>> filters = m_categorySnapshot.load();
+    if (!filters || filters->isEmpty()) {
         return true;
     }
     
     // Check if category is in filter list
-    return m_categoryFilters.contains(category);
+    return filters->contains(category);
+}
+
+void Logger::updateCategorySnapshotLocked()
+{
+    std::shared_ptr<const QSet<QString>> filters;
+    if (!m_categoryFilters.isEmpty()) {
+        filters = std::make_shared<const QSet<QString>>(m_categoryFilters.begin(), m_categoryFilters.end());
+    }
+    m_categorySnapshot.store(std::move(filters));
 }
 
 void Logger::initializeLogFile()
@@ -6,7 +6,16 @@
 #include <QTextStream>
 #include <QFile>
 #include <QMutex>
+#include <QSet>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
 #include <memory>
+#include "LockFreeQueue.h"
+#include "LogHistory.h"
+#include "SnapshotPtr.h"
+
+class QThread;
 
 /**
  * @brief Log level enumeration
@@ -34,10 +43,23 @@ struct LogEntry
     QString function;       ///< Source function
 };
 
+Q_DECLARE_METATYPE(LogEntry)
+
 /**
  * @brief Logger class for application logging
  * 
  * Provides thread-safe logging with multiple output targets and filtering.
+ *
+ * log() only checks the level and category filters and pushes the raw
+ * record into a lock-free queue; it formats nothing and takes no lock,
+ * except once per thread after the category filters change.
+ * A background writer thread formats queued records in batches, writes
+ * them and emits logEntryAdded() from the writer thread. The log file is
+ * flushed every flushInterval() milliseconds, and right away after an
+ * Error or Critical record.
+ *
+ * The writer also appends every record to a LogHistory ring holding the
+ * last million records, which recentEntries() reads without locking.
  */
 class Logger : public QObject
 {
@@ -71,7 +93,7 @@ public:
      * @brief Get current log level
      * @return Current log level
      */
-    LogLevel logLevel() const { return m_logLevel; }
+    LogLevel logLevel() const { return LogLevel(m_logLevel.load(std::memory_order_relaxed)); }
 
     /**
      * @brief Enable/disable console output
@@ -121,6 +143,24 @@ public:
      */
     void clearCategoryFilters();
 
+    /**
+     * @brief Set interval between file flushes
+     * @param msec Interval in milliseconds
+     */
+    void setFlushInterval(int msec);
+
+    /**
+     * @brief Get interval between file flushes
+     * @return Interval in milliseconds
+     */
+    int flushInterval() const { return m_flushInterval.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get number of records dropped because the queue was full
+     * @return Dropped record count
+     */
+    quint64 droppedCount() const { return m_dropped.load(std::memory_order_relaxed); }
+
     /**
      * @brief Log a message
      * @param level Log level
@@ -170,18 +210,30 @@ public:
 
     /**
      * @brief Get recent log entries
+     *
+     * Lock-free; safe to call from any thread while logging continues.
+     *
      * @param count Maximum number of entries
-     * @return List of log entries
+     * @return List of log entries, oldest first
      */
     QList<LogEntry> recentEntries(int count = 100) const;
 
+    /**
+     * @brief Get log history
+     * @return History ring
+     */
+    const LogHistory& history() const { return m_history; }
+
     /**
      * @brief Clear log history
      */
     void clearHistory();
 
     /**
-     * @brief Flush log outputs
+     * @brief Write all queued records and flush log outputs
+     *
+     * Blocks until the writer thread has handled every record logged
+     * before the call.
      */
     void flush();
 
@@ -193,6 +245,37 @@ signals:
     void logEntryAdded(const LogEntry& entry);
 
 private:
+    /**
+     * @brief Raw record as queued by log()
+     */
+    struct LogRecord
+    {
+        qint64 timestamp = 0;   ///< LogHistory::now() at the time of the call
+        LogLevel level = LogLevel::Info;
+        QString category;
+        QString message;
+        QString file;
+        int line = 0;
+        QString function;
+    };
+
+    /**
+     * @brief Writer thread main loop
+     */
+    void writerLoop();
+
+    /**
+     * @brief Format and write a batch of records (writer thread)
+     * @param records Records
+     * @param flushRequested true to flush the file even without errors
+     */
+    void writeRecords(const QVector<LogRecord>& records, bool flushRequested);
+
+    /**
+     * @brief Wake the writer thread if it is waiting
+     */
+    void wakeWriter();
+
     /**
      * @brief Format log entry for output
      * @param entry Log entry
@@ -209,11 +292,20 @@ private:
 
     /**
      * @brief Check if category should be logged
+     *
+     * Reads the current filter snapshot; locks only on the first call
+     * on a thread after the filters change.
+     *
      * @param category Category name
      * @return true if should be logged
      */
     bool shouldLogCategory(const QString& category) const;
 
+    /**
+     * @brief Publish a new filter snapshot (m_mutex held)
+     */
+    void updateCategorySnapshotLocked();
+
     /**
      * @brief Initialize log file
      */
@@ -222,23 +314,41 @@ private:
 private:
     static Logger* s_instance;
 
-    // Configuration
-    LogLevel m_logLevel;
+    // Configuration; level and filters are read lock-free by log()
+    std::atomic<int> m_logLevel;
     bool m_consoleOutput;
     bool m_fileOutput;
     QString m_logFileName;
     QStringList m_categoryFilters;
+    SnapshotPtr<QSet<QString>> m_categorySnapshot;
+    std::atomic<int> m_flushInterval;
 
     // Output streams
     std::unique_ptr<QFile> m_logFile;
     std::unique_ptr<QTextStream> m_fileStream;
 
-    // Log history
-    QList<LogEntry> m_logHistory;
-    int m_maxHistorySize;
+    // Log history, appended by the writer thread only
+    LogHistory m_history;
 
-    // Thread safety
+    // Thread safety; m_mutex guards outputs and configuration
     mutable QMutex m_mutex;
+
+    // Queue between log() and the writer thread
+    LockFreeQueue<LogRecord> m_queue;
+    std::atomic<quint64> m_enqueued;
+    std::atomic<quint64> m_written;
+    std::atomic<quint64> m_dropped;
+
+    // Writer thread; m_wakeMutex only serializes sleeping and waking it
+    std::unique_ptr<QThread> m_writer;
+    QMutex m_wakeMutex;
+    QWaitCondition m_wakeCondition;
+    QWaitCondition m_writtenCondition;
+    std::atomic<bool> m_writerIdle;
+    std::atomic<bool> m_flushRequested;
+    std::atomic<quint64> m_flushRequests;
+    std::atomic<quint64> m_flushesDone;
+    std::atomic<bool> m_running;
 };
 
 // Convenience macros for logging with file/line information
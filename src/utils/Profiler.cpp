@@ -0,0 +1,219 @@
+#include "Profiler.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+
+Profiler* Profiler::s_instance = nullptr;
+
+namespace {
+
+// Caps a forgotten capture at a few hundred megabytes
+const int kMaxTraceEvents = 2000000;
+
+} // namespace
+
+Profiler::Profiler()
+    : m_enabled(false)
+    , m_capturing(false)
+    , m_frameStart(-1)
+    , m_frameTimes(kHistoryFrames, 0)
+    , m_gpuTimes(kHistoryFrames, -1)
+    , m_frameIndex(0)
+{
+    m_clock.start();
+    s_instance = this;
+}
+
+Profiler::~Profiler()
+{
+    s_instance = nullptr;
+}
+
+Profiler* Profiler::instance()
+{
+    return s_instance;
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    m_enabled.store(enabled, std::memory_order_relaxed);
+    if (!enabled) {
+        QMutexLocker locker(&m_mutex);
+        m_frameStart = -1;
+        m_currentCosts.clear();
+    }
+}
+
+void Profiler::record(const char* name, const QString& label, qint64 start, qint64 end)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const QString key = label.isEmpty() ? QString::fromLatin1(name)
+                                        : QString::fromLatin1(name) + QLatin1String(": ") + label;
+    ScopeCost& cost = m_currentCosts[key];
+    if (cost.calls == 0) {
+        cost.name = key;
+    }
+    cost.time += end - start;
+    ++cost.calls;
+
+    if (m_capturing.load(std::memory_order_relaxed) && m_events.size() < kMaxTraceEvents) {
+        m_events.append(TraceEvent{name, label, start, end - start, threadIdLocked()});
+    }
+}
+
+void Profiler::beginFrame()
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_frameStart = now();
+}
+
+void Profiler::endFrame()
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (m_frameStart < 0) {
+        return;
+    }
+
+    const qint64 duration = now() - m_frameStart;
+    m_frameIndex = (m_frameIndex + 1) % kHistoryFrames;
+    m_frameTimes[m_frameIndex] = duration;
+    m_gpuTimes[m_frameIndex] = -1;
+    if (m_capturing.load(std::memory_order_relaxed) && m_events.size() < kMaxTraceEvents) {
+        m_events.append(TraceEvent{"Frame", QString(), m_frameStart, duration, threadIdLocked()});
+    }
+    m_frameStart = -1;
+
+    m_lastCosts = m_currentCosts.values().toVector();
+    std::sort(m_lastCosts.begin(), m_lastCosts.end(),
+              [](const ScopeCost& a, const ScopeCost& b) { return a.time > b.time; });
+    m_currentCosts.clear();
+}
+
+void Profiler::recordGpuTime(qint64 nanoseconds)
+{
+    QMutexLocker locker(&m_mutex);
+    m_gpuTimes[m_frameIndex] = nanoseconds;
+}
+
+QVector<qint64> Profiler::frameTimes() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVector<qint64> result;
+    result.reserve(kHistoryFrames);
+    for (int i = 1; i <= kHistoryFrames; ++i) {
+        result.append(m_frameTimes[(m_frameIndex + i) % kHistoryFrames]);
+    }
+    return result;
+}
+
+QVector<qint64> Profiler::gpuTimes() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVector<qint64> result;
+    result.reserve(kHistoryFrames);
+    for (int i = 1; i <= kHistoryFrames; ++i) {
+        result.append(m_gpuTimes[(m_frameIndex + i) % kHistoryFrames]);
+    }
+    return result;
+}
+
+QVector<Profiler::ScopeCost> Profiler::lastFrameCosts() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_lastCosts;
+}
+
+void Profiler::startCapture()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_events.clear();
+    }
+    m_capturing.store(true, std::memory_order_relaxed);
+    setEnabled(true);
+}
+
+void Profiler::stopCapture()
+{
+    m_capturing.store(false, std::memory_order_relaxed);
+}
+
+int Profiler::capturedEventCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_events.size();
+}
+
+bool Profiler::exportChromeTrace(const QString& fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qWarning() << "Profiler: cannot write trace file" << fileName;
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    // Complete events ("ph": "X") with microsecond timestamps
+    QTextStream out(&file);
+    out.setCodec("UTF-8");
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    for (auto it = m_threadIds.constBegin(); it != m_threadIds.constEnd(); ++it) {
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << it.value()
+            << ",\"args\":{\"name\":\"" << (it.value() == 0 ? "main" : "worker") << "\"}},\n";
+    }
+
+    for (int i = 0; i < m_events.size(); ++i) {
+        const TraceEvent& event = m_events[i];
+        out << "{\"name\":\"" << event.name << "\",\"cat\":\"t_gui\",\"ph\":\"X\""
+            << ",\"ts\":" << QString::number(event.start / 1000.0, 'f', 3)
+            << ",\"dur\":" << QString::number(event.duration / 1000.0, 'f', 3)
+            << ",\"pid\":" << pid << ",\"tid\":" << event.thread;
+        if (!event.label.isEmpty()) {
+            // Labels are user data (layer names); let QJsonDocument escape them
+            QJsonObject args;
+            args.insert("label", event.label);
+            out << ",\"args\":" << QString::fromUtf8(QJsonDocument(args).toJson(QJsonDocument::Compact));
+        }
+        out << (i + 1 < m_events.size() ? "},\n" : "}\n");
+    }
+
+    out << "]}\n";
+    out.flush();
+    if (file.error() != QFileDevice::NoError) {
+        qWarning() << "Profiler: failed to write trace file" << fileName << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+int Profiler::threadIdLocked()
+{
+    const quintptr thread = quintptr(QThread::currentThreadId());
+    auto it = m_threadIds.constFind(thread);
+    if (it != m_threadIds.constEnd()) {
+        return *it;
+    }
+
+    const int id = m_threadIds.size();
+    m_threadIds.insert(thread, id);
+    return id;
+}
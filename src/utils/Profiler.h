@@ -0,0 +1,250 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+/**
+ * @brief Frame and hot-path timing collector
+ *
+ * Scoped timers (PROFILE_SCOPE) add their duration to the statistics of
+ * the current frame, delimited by beginFrame() and endFrame(). The last
+ * kHistoryFrames frame times, CPU and GPU, are kept for the overlay
+ * histogram. While a capture is running every timed scope is also kept
+ * as a trace event, and exportChromeTrace() writes them in the Chrome
+ * trace event format (chrome://tracing, Perfetto).
+ *
+ * Timers cost one atomic load while the profiler is disabled, and the
+ * macros compile to nothing without TGUI_ENABLE_PROFILING.
+ */
+class Profiler
+{
+public:
+    /**
+     * @brief Accumulated cost of one scope name and label in a frame
+     */
+    struct ScopeCost
+    {
+        QString name;       ///< Scope name, with the label if any
+        qint64 time = 0;    ///< Total time in nanoseconds
+        int calls = 0;      ///< Number of times the scope ran
+    };
+
+    // Frames kept for the histogram
+    static constexpr int kHistoryFrames = 240;
+
+    /**
+     * @brief Constructor
+     */
+    Profiler();
+
+    /**
+     * @brief Destructor
+     */
+    ~Profiler();
+
+    /**
+     * @brief Get singleton instance
+     * @return Profiler instance
+     */
+    static Profiler* instance();
+
+    /**
+     * @brief Get the instance if it is recording
+     * @return Profiler, or nullptr when absent or disabled
+     */
+    static Profiler* activeInstance()
+    {
+        Profiler* profiler = s_instance;
+        return profiler && profiler->m_enabled.load(std::memory_order_relaxed) ? profiler : nullptr;
+    }
+
+    /**
+     * @brief Enable or disable timing
+     * @param enabled true to record scopes and frames
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * @brief Check if timing is enabled
+     * @return true if enabled
+     */
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get profiler time
+     * @return Nanoseconds since the profiler was created
+     */
+    qint64 now() const { return m_clock.nsecsElapsed(); }
+
+    /**
+     * @brief Record a finished scope
+     * @param name Scope name (string literal)
+     * @param label Optional label, e.g. a layer name
+     * @param start Start time from now()
+     * @param end End time from now()
+     */
+    void record(const char* name, const QString& label, qint64 start, qint64 end);
+
+    /**
+     * @brief Mark the start of a frame
+     */
+    void beginFrame();
+
+    /**
+     * @brief Mark the end of a frame
+     *
+     * Stores the frame time, makes the scope costs of the frame available
+     * through lastFrameCosts() and, while capturing, adds a "Frame" event.
+     */
+    void endFrame();
+
+    /**
+     * @brief Record GPU time of a frame
+     *
+     * GPU results arrive a few frames late; they are stored with the
+     * frame that is current when they arrive.
+     *
+     * @param nanoseconds GPU time
+     */
+    void recordGpuTime(qint64 nanoseconds);
+
+    /**
+     * @brief Get recent CPU frame times
+     * @return Nanoseconds per frame, oldest first
+     */
+    QVector<qint64> frameTimes() const;
+
+    /**
+     * @brief Get recent GPU frame times
+     * @return Nanoseconds per frame, oldest first; -1 where unknown
+     */
+    QVector<qint64> gpuTimes() const;
+
+    /**
+     * @brief Get scope costs of the last completed frame
+     * @return Costs, most expensive first
+     */
+    QVector<ScopeCost> lastFrameCosts() const;
+
+    /**
+     * @brief Start keeping trace events
+     *
+     * Clears events of a previous capture and enables the profiler.
+     */
+    void startCapture();
+
+    /**
+     * @brief Stop keeping trace events
+     */
+    void stopCapture();
+
+    /**
+     * @brief Check if a capture is running
+     * @return true while capturing
+     */
+    bool isCapturing() const { return m_capturing.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get number of captured trace events
+     * @return Event count
+     */
+    int capturedEventCount() const;
+
+    /**
+     * @brief Write captured events as Chrome trace JSON
+     * @param fileName Output file
+     * @return true if successful
+     */
+    bool exportChromeTrace(const QString& fileName) const;
+
+private:
+    /**
+     * @brief Timed scope kept during a capture
+     */
+    struct TraceEvent
+    {
+        const char* name;
+        QString label;
+        qint64 start;
+        qint64 duration;
+        int thread;
+    };
+
+    /**
+     * @brief Get small id of the calling thread (m_mutex held)
+     * @return Thread id
+     */
+    int threadIdLocked();
+
+private:
+    static Profiler* s_instance;
+
+    QElapsedTimer m_clock;
+    std::atomic<bool> m_enabled;
+    std::atomic<bool> m_capturing;
+
+    mutable QMutex m_mutex;
+
+    // Per-frame statistics
+    qint64 m_frameStart;
+    QHash<QString, ScopeCost> m_currentCosts;
+    QVector<ScopeCost> m_lastCosts;
+    QVector<qint64> m_frameTimes;
+    QVector<qint64> m_gpuTimes;
+    int m_frameIndex;
+
+    // Capture
+    QVector<TraceEvent> m_events;
+    QHash<quintptr, int> m_threadIds;
+};
+
+/**
+ * @brief Times the enclosing scope
+ */
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name)
+        : m_profiler(Profiler::activeInstance()), m_name(name), m_start(m_profiler ? m_profiler->now() : 0) {}
+
+    ProfileScope(const char* name, const QString& label)
+        : m_profiler(Profiler::activeInstance()), m_name(name), m_start(m_profiler ? m_profiler->now() : 0)
+    {
+        if (m_profiler) {
+            m_label = label;
+        }
+    }
+
+    ~ProfileScope()
+    {
+        if (m_profiler) {
+            m_profiler->record(m_name, m_label, m_start, m_profiler->now());
+        }
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    Profiler* m_profiler;
+    const char* m_name;
+    QString m_label;
+    qint64 m_start;
+};
+
+// Instrumentation macros; they compile to nothing without TGUI_ENABLE_PROFILING
+#ifdef TGUI_ENABLE_PROFILING
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_SCOPE(name) \
+    ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name)
+#define PROFILE_SCOPE_LABEL(name, label) \
+    ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name, label)
+#else
+#define PROFILE_SCOPE(name) do {} while (false)
+#define PROFILE_SCOPE_LABEL(name, label) do {} while (false)
+#endif
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QtGlobal>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Immutable snapshot that readers fetch without taking a lock
+ *
+ * Writers replace the value under a mutex and bump a generation number.
+ * Every reading thread keeps its own reference to the snapshot it saw
+ * last, tagged with that generation, so load() is one atomic load and a
+ * reference count increment while the value is unchanged. Only the first
+ * load on a thread after a store() takes the mutex, to refresh the copy.
+ *
+ * std::atomic_load() on a shared_ptr looks equivalent, but common
+ * standard libraries implement it with a process-wide pool of hashed
+ * mutexes, so every reader in the process contends on them.
+ *
+ * A thread keeps the snapshot it loaded last until it loads again or
+ * exits, so a replaced value may be released late.
+ */
+template<typename T>
+class SnapshotPtr
+{
+public:
+    using Pointer = std::shared_ptr<const T>;
+
+    /**
+     * @brief Constructor
+     * @param value Initial value
+     */
+    explicit SnapshotPtr(Pointer value = Pointer())
+        : m_state(std::make_shared<State>())
+    {
+        m_state->value = std::move(value);
+    }
+
+    SnapshotPtr(const SnapshotPtr&) = delete;
+    SnapshotPtr& operator=(const SnapshotPtr&) = delete;
+
+    /**
+     * @brief Get current value
+     *
+     * Lock-free unless the value changed since this thread last loaded it.
+     *
+     * @return Snapshot
+     */
+    Pointer load() const
+    {
+        State* state = m_state.get();
+        const quint64 generation = state->generation.load(std::memory_order_acquire);
+
+        CacheEntry& entry = cacheEntry(state);
+        if (entry.generation != generation) {
+            QMutexLocker locker(&state->mutex);
+            entry.value = state->value;
+            entry.generation = state->generation.load(std::memory_order_relaxed);
+        }
+        return entry.value;
+    }
+
+    /**
+     * @brief Replace value
+     * @param value New value
+     */
+    void store(Pointer value)
+    {
+        Pointer old;
+        {
+            QMutexLocker locker(&m_state->mutex);
+            old = std::move(m_state->value);
+            m_state->value = std::move(value);
+            m_state->generation.fetch_add(1, std::memory_order_release);
+        }
+        // The old value is released outside the lock
+    }
+
+private:
+    struct State
+    {
+        QMutex mutex;
+        Pointer value;
+        std::atomic<quint64> generation{1};
+    };
+
+    struct CacheEntry
+    {
+        // Holding the state keeps its address from being reused
+        std::shared_ptr<State> state;
+        Pointer value;
+        quint64 generation = 0;
+    };
+
+    CacheEntry& cacheEntry(State* state) const
+    {
+        thread_local std::vector<CacheEntry> cache;
+
+        for (CacheEntry& entry : cache) {
+            if (entry.state.get() == state) {
+                return entry;
+            }
+        }
+
+        // Drop entries of snapshots that no longer exist
+        for (size_t i = 0; i < cache.size();) {
+            if (cache[i].state.use_count() == 1) {
+                cache[i] = std::move(cache.back());
+                cache.pop_back();
+            } else {
+                ++i;
+            }
+        }
+
+        CacheEntry entry;
+        entry.state = m_state;
+        cache.push_back(std::move(entry));
+        return cache.back();
+    }
+
+private:
+    std::shared_ptr<State> m_state;
+};
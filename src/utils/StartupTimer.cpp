@@ -0,0 +1,63 @@
+#include "StartupTimer.h"
+
+#include <QMutexLocker>
+#include <algorithm>
+
+StartupTimer::StartupTimer()
+{
+    m_clock.start();
+}
+
+void StartupTimer::addStage(const QString& name, qint64 start, qint64 end)
+{
+    QMutexLocker locker(&m_mutex);
+    m_stages.append(Stage{name, start, end - start, false});
+}
+
+void StartupTimer::mark(const QString& name)
+{
+    const qint64 now = elapsed();
+    QMutexLocker locker(&m_mutex);
+    m_stages.append(Stage{name, now, 0, true});
+}
+
+qint64 StartupTimer::markTime(const QString& name) const
+{
+    QMutexLocker locker(&m_mutex);
+    for (const Stage& stage : m_stages) {
+        if (stage.mark && stage.name == name) {
+            return stage.start;
+        }
+    }
+    return -1;
+}
+
+QVector<StartupTimer::Stage> StartupTimer::stages() const
+{
+    QVector<Stage> result;
+    {
+        QMutexLocker locker(&m_mutex);
+        result = m_stages;
+    }
+    std::stable_sort(result.begin(), result.end(),
+                     [](const Stage& a, const Stage& b) { return a.start < b.start; });
+    return result;
+}
+
+QString StartupTimer::report() const
+{
+    const QVector<Stage> all = stages();
+
+    int nameWidth = 5;
+    for (const Stage& stage : all) {
+        nameWidth = qMax(nameWidth, stage.name.size());
+    }
+
+    QString result = QString("%1 %2 %3\n").arg("Stage", -nameWidth).arg("Start", 10).arg("Time", 10);
+    for (const Stage& stage : all) {
+        const QString start = QString::number(stage.start / 1.0e6, 'f', 1) + " ms";
+        const QString duration = stage.mark ? QString("--") : QString::number(stage.duration / 1.0e6, 'f', 1) + " ms";
+        result += QString("%1 %2 %3\n").arg(stage.name, -nameWidth).arg(start, 10).arg(duration, 10);
+    }
+    return result;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief Breakdown of application startup time
+ *
+ * Stages are timed from the moment the timer is created, which the
+ * application does first thing. Stages may overlap (work on a worker
+ * thread runs alongside GUI stages) and milestones such as the first
+ * frame are recorded as zero-length marks. report() formats the result
+ * as a table for the log.
+ */
+class StartupTimer
+{
+public:
+    /**
+     * @brief One timed stage, or a mark when duration is 0
+     */
+    struct Stage
+    {
+        QString name;       ///< Stage name
+        qint64 start;       ///< Nanoseconds since startup
+        qint64 duration;    ///< Nanoseconds, 0 for marks
+        bool mark;          ///< true for milestones
+    };
+
+    /**
+     * @brief Times a stage for the lifetime of the object
+     */
+    class Scope
+    {
+    public:
+        Scope(StartupTimer& timer, const QString& name)
+            : m_timer(timer), m_name(name), m_start(timer.elapsed()) {}
+        ~Scope() { m_timer.addStage(m_name, m_start, m_timer.elapsed()); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        StartupTimer& m_timer;
+        QString m_name;
+        qint64 m_start;
+    };
+
+    /**
+     * @brief Constructor; starts the clock
+     */
+    StartupTimer();
+
+    /**
+     * @brief Get time since startup
+     * @return Nanoseconds
+     */
+    qint64 elapsed() const { return m_clock.nsecsElapsed(); }
+
+    /**
+     * @brief Record a finished stage (any thread)
+     * @param name Stage name
+     * @param start Start from elapsed()
+     * @param end End from elapsed()
+     */
+    void addStage(const QString& name, qint64 start, qint64 end);
+
+    /**
+     * @brief Record a milestone at the current time
+     * @param name Milestone name
+     */
+    void mark(const QString& name);
+
+    /**
+     * @brief Get the time of a milestone
+     * @param name Milestone name
+     * @return Nanoseconds since startup, -1 if not reached
+     */
+    qint64 markTime(const QString& name) const;
+
+    /**
+     * @brief Get recorded stages and marks
+     * @return Stages in start order
+     */
+    QVector<Stage> stages() const;
+
+    /**
+     * @brief Format stages as a table
+     * @return Multi-line report
+     */
+    QString report() const;
+
+private:
+    QElapsedTimer m_clock;
+    mutable QMutex m_mutex;
+    QVector<Stage> m_stages;
+};